@@ -0,0 +1,50 @@
+//
+//  PHCaptureQualityController.h
+//  PerchRTC
+//
+//  Created by Christopher Eagleston on 2015-07-06.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#if !TARGET_IPHONE_SIMULATOR
+
+#import <Foundation/Foundation.h>
+
+#import "AVCaptureDevice+PHCapturePresets.h"
+
+@class PHVideoCaptureKit;
+
+typedef void (^PHCaptureQualityChangeBlock)(PHCapturePreset preset, double frameRate);
+
+/**
+ *  Watches process CPU, encode time, and dropped frames once a second, and steps the capture format down when the
+ *  device can't keep up (or back up when it can). The change handler is called on the main queue.
+ */
+@interface PHCaptureQualityController : NSObject
+
+@property (nonatomic, assign, readonly) PHCapturePreset preset;
+@property (nonatomic, assign, readonly) double frameRate;
+@property (nonatomic, assign, readonly, getter = isRunning) BOOL running;
+
+- (instancetype)initWithCaptureKit:(PHVideoCaptureKit *)captureKit
+                            preset:(PHCapturePreset)preset
+                         frameRate:(double)frameRate
+                     changeHandler:(PHCaptureQualityChangeBlock)handler;
+
+- (void)start;
+- (void)stop;
+
+/**
+ *  The best format that may be chosen. Lowering it takes effect right away. Raising it takes effect right away too,
+ *  unless the device is currently struggling, in which case the format climbs back up as load allows.
+ */
+- (void)setMaximumPreset:(PHCapturePreset)preset frameRate:(double)frameRate;
+
+/**
+ *  Reports the encoder's average time per frame, for example from WebRTC's googAvgEncodeMs statistic.
+ */
+- (void)reportAverageEncodeTime:(NSTimeInterval)encodeTime;
+
+@end
+
+#endif
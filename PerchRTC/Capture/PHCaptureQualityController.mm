@@ -0,0 +1,281 @@
+//
+//  PHCaptureQualityController.mm
+//  PerchRTC
+//
+//  Created by Christopher Eagleston on 2015-07-06.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#if !TARGET_IPHONE_SIMULATOR
+
+#import "PHCaptureQualityController.h"
+
+#import "PHVideoCaptureKit.h"
+
+#include "PHQualityController.h"
+
+#include <mach/mach.h>
+
+@import QuartzCore;
+
+static NSTimeInterval kSampleInterval = 1.0;
+
+typedef struct {
+    PHCapturePreset preset;
+    int frameRate;
+} PHCaptureQualityTier;
+
+// Best first. Frame rate is given up before resolution, since it costs the least to the eye.
+static const PHCaptureQualityTier kQualityLadder[] = {
+    { PHCapturePresetAcademyHighQuality, 30 },
+    { PHCapturePresetAcademyMediumQuality, 30 },
+    { PHCapturePresetAcademyMediumQuality, 20 },
+    { PHCapturePresetAcademyLowQuality, 20 },
+    { PHCapturePresetAcademyLowQuality, 15 },
+    { PHCapturePresetAcademyExtraLowQuality, 15 },
+};
+
+static const int kQualityLadderCount = sizeof(kQualityLadder) / sizeof(kQualityLadder[0]);
+
+@interface PHCaptureQualityController()
+{
+    std::unique_ptr<perch::QualityController> _controller;
+
+    // Counters from the previous sample.
+    uint64_t _lastFrames;
+    uint64_t _lastClockDrops;
+    uint64_t _lastQueueDrops;
+
+    double _encodeTimeMs;
+}
+
+@property (nonatomic, weak) PHVideoCaptureKit *captureKit;
+@property (nonatomic, copy) PHCaptureQualityChangeBlock changeHandler;
+@property (nonatomic, strong) dispatch_queue_t queue;
+@property (nonatomic, strong) dispatch_source_t timer;
+
+@property (nonatomic, assign) PHCapturePreset preset;
+@property (nonatomic, assign) double frameRate;
+@property (nonatomic, assign, getter = isRunning) BOOL running;
+
+@end
+
+@implementation PHCaptureQualityController
+
+- (instancetype)initWithCaptureKit:(PHVideoCaptureKit *)captureKit
+                            preset:(PHCapturePreset)preset
+                         frameRate:(double)frameRate
+                     changeHandler:(PHCaptureQualityChangeBlock)handler
+{
+    self = [super init];
+
+    if (self) {
+        std::vector<perch::QualityTier> ladder;
+
+        for (int i = 0; i < kQualityLadderCount; i++) {
+            CMVideoDimensions dimensions = [AVCaptureDevice dimensionsForPreset:kQualityLadder[i].preset];
+            perch::QualityTier tier = { (int)kQualityLadder[i].preset, dimensions.width, dimensions.height, kQualityLadder[i].frameRate };
+            ladder.push_back(tier);
+        }
+
+        int initialTier = [[self class] tierForPreset:preset frameRate:frameRate];
+
+        _controller.reset(new perch::QualityController(ladder, initialTier));
+        _controller->SetCeiling(initialTier, [[self class] now]);
+
+        _captureKit = captureKit;
+        _changeHandler = [handler copy];
+        _queue = dispatch_queue_create("com.perch.capturequality", DISPATCH_QUEUE_SERIAL);
+        _preset = kQualityLadder[initialTier].preset;
+        _frameRate = kQualityLadder[initialTier].frameRate;
+        _encodeTimeMs = -1;
+    }
+
+    return self;
+}
+
+- (void)dealloc
+{
+    if (_timer) {
+        dispatch_source_cancel(_timer);
+    }
+}
+
+#pragma mark - Class
+
++ (int64_t)now
+{
+    return (int64_t)(CACurrentMediaTime() * NSEC_PER_SEC);
+}
+
+// The best tier which is no larger, and no faster, than the requested format.
++ (int)tierForPreset:(PHCapturePreset)preset frameRate:(double)frameRate
+{
+    CMVideoDimensions requested = [AVCaptureDevice dimensionsForPreset:preset];
+    int32_t requestedPixels = requested.width * requested.height;
+
+    for (int i = 0; i < kQualityLadderCount; i++) {
+        CMVideoDimensions dimensions = [AVCaptureDevice dimensionsForPreset:kQualityLadder[i].preset];
+
+        if (dimensions.width * dimensions.height <= requestedPixels && kQualityLadder[i].frameRate <= frameRate) {
+            return i;
+        }
+    }
+
+    return kQualityLadderCount - 1;
+}
+
+// Process CPU usage summed over all threads, as a fraction of all cores.
++ (double)processCPULoad
+{
+    thread_act_array_t threads = NULL;
+    mach_msg_type_number_t threadCount = 0;
+
+    if (task_threads(mach_task_self(), &threads, &threadCount) != KERN_SUCCESS) {
+        return 0;
+    }
+
+    double usage = 0;
+
+    for (mach_msg_type_number_t i = 0; i < threadCount; i++) {
+        thread_basic_info_data_t info;
+        mach_msg_type_number_t infoCount = THREAD_BASIC_INFO_COUNT;
+
+        if (thread_info(threads[i], THREAD_BASIC_INFO, (thread_info_t)&info, &infoCount) == KERN_SUCCESS &&
+            !(info.flags & TH_FLAGS_IDLE)) {
+            usage += (double)info.cpu_usage / TH_USAGE_SCALE;
+        }
+
+        mach_port_deallocate(mach_task_self(), threads[i]);
+    }
+
+    vm_deallocate(mach_task_self(), (vm_address_t)threads, threadCount * sizeof(thread_t));
+
+    NSUInteger cores = [NSProcessInfo processInfo].activeProcessorCount;
+
+    return cores > 0 ? usage / cores : usage;
+}
+
+#pragma mark - Public
+
+- (void)start
+{
+    if (self.isRunning) {
+        return;
+    }
+
+    self.running = YES;
+
+    dispatch_source_t timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, self.queue);
+    uint64_t interval = (uint64_t)(kSampleInterval * NSEC_PER_SEC);
+    __weak typeof(self) weakSelf = self;
+
+    dispatch_source_set_timer(timer, dispatch_time(DISPATCH_TIME_NOW, interval), interval, interval / 10);
+    dispatch_source_set_event_handler(timer, ^{
+        [weakSelf sample];
+    });
+
+    dispatch_async(self.queue, ^{
+        // Counters carried over from a previous run would look like a burst of frames.
+        [self resetCounters];
+    });
+
+    dispatch_resume(timer);
+    self.timer = timer;
+}
+
+- (void)stop
+{
+    if (!self.isRunning) {
+        return;
+    }
+
+    self.running = NO;
+
+    dispatch_source_cancel(self.timer);
+    self.timer = nil;
+}
+
+- (void)setMaximumPreset:(PHCapturePreset)preset frameRate:(double)frameRate
+{
+    int ceiling = [[self class] tierForPreset:preset frameRate:frameRate];
+
+    dispatch_async(self.queue, ^{
+        if (_controller->SetCeiling(ceiling, [[self class] now])) {
+            [self notifyTierChange];
+        }
+    });
+}
+
+- (void)reportAverageEncodeTime:(NSTimeInterval)encodeTime
+{
+    dispatch_async(self.queue, ^{
+        _encodeTimeMs = encodeTime * 1000.0;
+    });
+}
+
+#pragma mark - Private
+
+- (void)resetCounters
+{
+    NSDictionary *clockStats = [self.captureKit captureClockStatistics];
+    NSDictionary *queueStats = [self.captureKit captureQueueStatistics];
+
+    _lastFrames = [clockStats[@"frames"] unsignedLongLongValue];
+    _lastClockDrops = MAX([clockStats[@"missedFrames"] unsignedLongLongValue], [clockStats[@"reportedDrops"] unsignedLongLongValue]);
+    _lastQueueDrops = [queueStats[@"evicted"] unsignedLongLongValue] + [queueStats[@"rejected"] unsignedLongLongValue];
+}
+
+- (void)sample
+{
+    NSDictionary *clockStats = [self.captureKit captureClockStatistics];
+    NSDictionary *queueStats = [self.captureKit captureQueueStatistics];
+
+    // The capture kit starts its counters over when capture restarts.
+
+    uint64_t frames = [clockStats[@"frames"] unsignedLongLongValue];
+    uint64_t clockDrops = MAX([clockStats[@"missedFrames"] unsignedLongLongValue], [clockStats[@"reportedDrops"] unsignedLongLongValue]);
+    uint64_t queueDrops = [queueStats[@"evicted"] unsignedLongLongValue] + [queueStats[@"rejected"] unsignedLongLongValue];
+
+    perch::QualitySample sample;
+    sample.timeNs = [[self class] now];
+    sample.cpuLoad = [[self class] processCPULoad];
+    sample.encodeTimeMs = _encodeTimeMs;
+    sample.framesCaptured = (uint32_t)(frames >= _lastFrames ? frames - _lastFrames : frames);
+    sample.framesDropped = (uint32_t)((clockDrops >= _lastClockDrops ? clockDrops - _lastClockDrops : clockDrops) +
+                                      (queueDrops >= _lastQueueDrops ? queueDrops - _lastQueueDrops : queueDrops));
+
+    _lastFrames = frames;
+    _lastClockDrops = clockDrops;
+    _lastQueueDrops = queueDrops;
+
+    if (_controller->Update(sample)) {
+        DDLogInfo(@"Capture quality tier %d (CPU %.2f, encode %.1f ms, dropped %u of %u).",
+                  _controller->Tier(), sample.cpuLoad, sample.encodeTimeMs, sample.framesDropped, sample.framesCaptured + sample.framesDropped);
+
+        [self notifyTierChange];
+    }
+}
+
+- (void)notifyTierChange
+{
+    const perch::QualityTier &tier = _controller->CurrentTier();
+    PHCapturePreset preset = (PHCapturePreset)tier.preset;
+    double frameRate = tier.frameRate;
+
+    // The encode time was measured for the old format.
+    _encodeTimeMs = -1;
+
+    dispatch_async(dispatch_get_main_queue(), ^{
+        self.preset = preset;
+        self.frameRate = frameRate;
+
+        if (self.changeHandler) {
+            self.changeHandler(preset, frameRate);
+        }
+    });
+}
+
+@end
+
+#endif
@@ -0,0 +1,133 @@
+//
+//  PHQualityController.cpp
+//  PerchRTC
+//
+//  Created by Christopher Eagleston on 2015-07-06.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#include "PHQualityController.h"
+
+namespace perch {
+
+    namespace {
+
+        const int64_t kNoTime = -1;
+
+        inline int Clamp(int value, int low, int high)
+        {
+            return value < low ? low : (value > high ? high : value);
+        }
+
+    } // namespace
+
+    QualityController::QualityController(const std::vector<QualityTier> &ladder, int initialTier, QualityControllerConfig config)
+    : _ladder(ladder), _config(config), _tier(0), _ceiling(0), _state(kQualityStateStable),
+      _stateSinceNs(kNoTime), _cooldownUntilNs(kNoTime), _lastUpgradeNs(kNoTime), _upgradeHoldNs(config.upgradeHoldNs)
+    {
+        if (_ladder.empty()) {
+            QualityTier fallback = { 0, 0, 0, 0 };
+            _ladder.push_back(fallback);
+        }
+
+        _tier = Clamp(initialTier, 0, (int)_ladder.size() - 1);
+    }
+
+    bool QualityController::Update(const QualitySample &sample)
+    {
+        const int64_t now = sample.timeNs;
+
+        if (_cooldownUntilNs != kNoTime && now < _cooldownUntilNs) {
+            _state = kQualityStateCoolingDown;
+            return false;
+        }
+
+        // An upgrade that held up for long enough earns back the normal hold time.
+
+        if (_upgradeHoldNs > _config.upgradeHoldNs && _lastUpgradeNs != kNoTime && now - _lastUpgradeNs >= _config.maxUpgradeHoldNs) {
+            _upgradeHoldNs = _config.upgradeHoldNs;
+        }
+
+        const int verdict = Classify(sample);
+
+        if (verdict < 0) {
+            if (_state != kQualityStatePressured) {
+                _state = kQualityStatePressured;
+                _stateSinceNs = now;
+            }
+            else if (now - _stateSinceNs >= _config.degradeHoldNs && _tier < (int)_ladder.size() - 1) {
+                // Going straight back down means the last upgrade was premature, so be slower to try it again.
+
+                if (_lastUpgradeNs != kNoTime && now - _lastUpgradeNs < _upgradeHoldNs + _config.cooldownNs) {
+                    _upgradeHoldNs = _upgradeHoldNs * 2 < _config.maxUpgradeHoldNs ? _upgradeHoldNs * 2 : _config.maxUpgradeHoldNs;
+                }
+
+                ChangeTier(_tier + 1, now);
+                return true;
+            }
+        }
+        else if (verdict > 0) {
+            if (_state != kQualityStateRecovering) {
+                _state = kQualityStateRecovering;
+                _stateSinceNs = now;
+            }
+            else if (now - _stateSinceNs >= _upgradeHoldNs && _tier > _ceiling) {
+                ChangeTier(_tier - 1, now);
+                _lastUpgradeNs = now;
+                return true;
+            }
+        }
+        else {
+            _state = kQualityStateStable;
+            _stateSinceNs = now;
+        }
+
+        return false;
+    }
+
+    bool QualityController::SetCeiling(int tier, int64_t nowNs)
+    {
+        const bool pinned = _tier == _ceiling;
+
+        _ceiling = Clamp(tier, 0, (int)_ladder.size() - 1);
+
+        if (_tier < _ceiling || (pinned && _tier > _ceiling && _state != kQualityStatePressured)) {
+            ChangeTier(_ceiling, nowNs);
+            return true;
+        }
+
+        return false;
+    }
+
+    int QualityController::Classify(const QualitySample &sample) const
+    {
+        const QualityTier &tier = _ladder[_tier];
+        const uint32_t frames = sample.framesCaptured + sample.framesDropped;
+        const double dropRatio = frames > 0 ? (double)sample.framesDropped / frames : 0;
+        const double frameIntervalMs = tier.frameRate > 0 ? 1000.0 / tier.frameRate : 0;
+        const bool encodeKnown = sample.encodeTimeMs >= 0 && frameIntervalMs > 0;
+
+        if (sample.cpuLoad >= _config.highCpuLoad ||
+            dropRatio >= _config.highDropRatio ||
+            (encodeKnown && sample.encodeTimeMs >= _config.encodeBudget * frameIntervalMs)) {
+            return -1;
+        }
+
+        if (sample.cpuLoad <= _config.lowCpuLoad &&
+            dropRatio <= _config.lowDropRatio &&
+            (!encodeKnown || sample.encodeTimeMs <= _config.encodeHeadroom * frameIntervalMs)) {
+            return 1;
+        }
+
+        return 0;
+    }
+
+    void QualityController::ChangeTier(int tier, int64_t nowNs)
+    {
+        _tier = tier;
+        _state = kQualityStateCoolingDown;
+        _stateSinceNs = nowNs;
+        _cooldownUntilNs = nowNs + _config.cooldownNs;
+    }
+
+} // namespace perch
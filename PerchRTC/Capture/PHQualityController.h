@@ -0,0 +1,117 @@
+//
+//  PHQualityController.h
+//  PerchRTC
+//
+//  Created by Christopher Eagleston on 2015-07-06.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#ifndef PerchRTC_PHQualityController_h
+#define PerchRTC_PHQualityController_h
+
+#include <stdint.h>
+#include <vector>
+
+namespace perch {
+
+    // One rung of the capture quality ladder. `preset` is opaque to the controller (a PHCapturePreset on iOS).
+    struct QualityTier
+    {
+        int preset;
+        int width;
+        int height;
+        int frameRate;
+    };
+
+    struct QualitySample
+    {
+        int64_t timeNs;
+        // Process CPU usage, as a fraction of all cores.
+        double cpuLoad;
+        // Average time to encode a frame, or a negative value if unknown.
+        double encodeTimeMs;
+        uint32_t framesCaptured;
+        // Frames lost anywhere between the camera and the encoder.
+        uint32_t framesDropped;
+    };
+
+    struct QualityControllerConfig
+    {
+        QualityControllerConfig()
+        : highCpuLoad(0.85), lowCpuLoad(0.55),
+          encodeBudget(0.8), encodeHeadroom(0.5),
+          highDropRatio(0.1), lowDropRatio(0.02),
+          degradeHoldNs(2000000000LL), upgradeHoldNs(10000000000LL),
+          maxUpgradeHoldNs(80000000000LL), cooldownNs(4000000000LL)
+        {}
+
+        double highCpuLoad;
+        double lowCpuLoad;
+        // Encode time as a fraction of the frame interval.
+        double encodeBudget;
+        double encodeHeadroom;
+        double highDropRatio;
+        double lowDropRatio;
+
+        // How long pressure, or headroom, must last before stepping down, or up.
+        int64_t degradeHoldNs;
+        int64_t upgradeHoldNs;
+        // Stepping straight back down after stepping up doubles the upgrade hold, up to this much.
+        int64_t maxUpgradeHoldNs;
+        // Samples are ignored for this long after every change, while the pipeline settles.
+        int64_t cooldownNs;
+    };
+
+    enum QualityState
+    {
+        kQualityStateStable = 0,
+        kQualityStatePressured,
+        kQualityStateRecovering,
+        kQualityStateCoolingDown,
+    };
+
+    /**
+     *  Steps capture quality up and down a ladder of tiers, from samples of CPU load, encode time, and frame drops.
+     *  Tier 0 is the best. Changes need sustained pressure (or headroom) and are followed by a cooldown, so a brief
+     *  spike doesn't change the format, and a device which keeps overheating settles on a lower tier instead of
+     *  flapping between two of them.
+     *
+     *  This is a pure state machine, time only advances with the samples.
+     */
+    class QualityController
+    {
+    public:
+        QualityController(const std::vector<QualityTier> &ladder, int initialTier, QualityControllerConfig config = QualityControllerConfig());
+
+        // Returns true if the tier changed.
+        bool Update(const QualitySample &sample);
+
+        // Tiers better than the ceiling are off limits. If the tier was held back only by the old ceiling, it follows a
+        // raised ceiling right away, unless the device is under pressure. Returns true if the tier changed.
+        bool SetCeiling(int tier, int64_t nowNs);
+
+        int Tier() const { return _tier; }
+        int Ceiling() const { return _ceiling; }
+        const QualityTier &CurrentTier() const { return _ladder[_tier]; }
+        QualityState State() const { return _state; }
+        int64_t UpgradeHoldNs() const { return _upgradeHoldNs; }
+
+    private:
+        // -1 for pressure, 1 for headroom, 0 for neither.
+        int Classify(const QualitySample &sample) const;
+        void ChangeTier(int tier, int64_t nowNs);
+
+        std::vector<QualityTier> _ladder;
+        QualityControllerConfig _config;
+        int _tier;
+        int _ceiling;
+        QualityState _state;
+        int64_t _stateSinceNs;
+        int64_t _cooldownUntilNs;
+        int64_t _lastUpgradeNs;
+        int64_t _upgradeHoldNs;
+    };
+
+} // namespace perch
+
+#endif
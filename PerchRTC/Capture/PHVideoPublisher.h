@@ -26,12 +26,22 @@
 
 @property (nonatomic, assign, readonly) PHCapturePreset capturePreset;
 
+@property (nonatomic, assign, readonly) double frameRate;
+
 @property (atomic, assign) id<PHVideoCaptureConsumer> videoCaptureConsumer;
 
 - (void)updateVideoOrientation:(UIInterfaceOrientation)orientation;
 
+/**
+ *  Sets the best capture format to use. The format is lowered further, and restored, as the device's load allows.
+ */
 - (void)updateCaptureFormat:(PHCapturePreset)preset;
 
+/**
+ *  Reports the encoder's average time per frame, which helps decide whether the capture format is sustainable.
+ */
+- (void)reportAverageEncodeTime:(NSTimeInterval)encodeTime;
+
 + (PHCapturePreset)recommendedCapturePreset;
 
 @end
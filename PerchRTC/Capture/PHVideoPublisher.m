@@ -10,6 +10,7 @@
 
 #import "PHVideoPublisher.h"
 #import "PHCaptureManager.h"
+#import "PHCaptureQualityController.h"
 
 #import "UIDevice+PHDeviceAdditions.h"
 
@@ -28,6 +29,8 @@ static PHPixelFormat kCapturePixelFormat = PHPixelFormatYUV420BiPlanarFullRange;
 @property (nonatomic, strong) PHCaptureManager *capturePipeline;
 @property (nonatomic, strong) PHVideoCaptureKit *captureKit;
 @property (nonatomic, assign) PHCapturePreset capturePreset;
+@property (nonatomic, assign) double frameRate;
+@property (nonatomic, strong) PHCaptureQualityController *qualityController;
 
 @end
 
@@ -40,8 +43,18 @@ static PHPixelFormat kCapturePixelFormat = PHPixelFormatYUV420BiPlanarFullRange;
     if (self) {
 
         _capturePreset = [[self class] recommendedCapturePreset];
+        _frameRate = [[self class] recommendedFrameRate];
         _captureKit = [[PHVideoCaptureKit alloc] initWithCapturer:self];
 
+        __weak typeof(self) weakSelf = self;
+
+        _qualityController = [[PHCaptureQualityController alloc] initWithCaptureKit:_captureKit
+                                                                             preset:_capturePreset
+                                                                          frameRate:_frameRate
+                                                                      changeHandler:^(PHCapturePreset preset, double frameRate) {
+            [weakSelf applyCapturePreset:preset frameRate:frameRate];
+        }];
+
         [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(handleOrientationNotification) name:@"StatusBarOrientationDidChange" object:nil];
     }
 
@@ -76,6 +89,14 @@ static PHPixelFormat kCapturePixelFormat = PHPixelFormatYUV420BiPlanarFullRange;
     return preset;
 }
 
++ (double)recommendedFrameRate
+{
+    BOOL isLowPerformance = [UIDevice currentDevice].isLowPerformance;
+    BOOL isMediumPerformance = [UIDevice currentDevice].isMediumPerformance;
+
+    return isLowPerformance ? kCaptureFPSLowPerformance : (isMediumPerformance ? kCaptureFPSMediumPerformance : kCaptureFPS);
+}
+
 #pragma mark - Public
 
 - (PHCapturePreviewView *)previewView
@@ -90,20 +111,39 @@ static PHPixelFormat kCapturePixelFormat = PHPixelFormatYUV420BiPlanarFullRange;
 
 - (void)updateCaptureFormat:(PHCapturePreset)preset
 {
-    if (self.capturePreset != preset) {
-        self.capturePreset = preset;
+    // The quality controller calls back with the format to use, which may be lower than requested.
 
-        double captureFPS = [self videoCaptureFormat].frameRate;
+    [self.qualityController setMaximumPreset:preset frameRate:[[self class] recommendedFrameRate]];
+}
 
-        [self.capturePipeline configureSession:^{
-            [self.capturePipeline setDeviceCapturePreset:preset];
-            [self.capturePipeline setFrameRate:captureFPS];
-        }];
-    }
+- (void)reportAverageEncodeTime:(NSTimeInterval)encodeTime
+{
+    [self.qualityController reportAverageEncodeTime:encodeTime];
 }
 
 #pragma mark - Private
 
+- (void)applyCapturePreset:(PHCapturePreset)preset frameRate:(double)frameRate
+{
+    if (self.capturePreset == preset && self.frameRate == frameRate) {
+        return;
+    }
+
+    BOOL presetChanged = self.capturePreset != preset;
+
+    self.capturePreset = preset;
+    self.frameRate = frameRate;
+
+    [self.videoCaptureConsumer prepareForCaptureFormatChange];
+
+    [self.capturePipeline configureSession:^{
+        if (presetChanged) {
+            [self.capturePipeline setDeviceCapturePreset:preset];
+        }
+        [self.capturePipeline setFrameRate:frameRate];
+    }];
+}
+
 - (void)handleOrientationNotification
 {
     [self updateVideoOrientation:[UIApplication sharedApplication].statusBarOrientation];
@@ -163,6 +203,7 @@ static PHPixelFormat kCapturePixelFormat = PHPixelFormatYUV420BiPlanarFullRange;
 - (void)startCapturing
 {
     [self.capturePipeline startSession];
+    [self.qualityController start];
 }
 
 /**
@@ -170,19 +211,17 @@ static PHPixelFormat kCapturePixelFormat = PHPixelFormatYUV420BiPlanarFullRange;
  */
 - (void)stopCapturing
 {
+    [self.qualityController stop];
     [self.capturePipeline clearVideoCaptureDelegate];
     [self.capturePipeline stopSession];
 }
 
 - (PHVideoFormat)videoCaptureFormat
 {
-    BOOL isLowPerformance = [UIDevice currentDevice].isLowPerformance;
-    BOOL isMediumPerformance = [UIDevice currentDevice].isMediumPerformance;
-
     PHVideoFormat format;
     PHCapturePreset capturePreset = self.capturePreset;
     format.dimensions = [AVCaptureDevice dimensionsForPreset:capturePreset];
-    format.frameRate = isLowPerformance ? kCaptureFPSLowPerformance : (isMediumPerformance ? kCaptureFPSMediumPerformance : kCaptureFPS);
+    format.frameRate = self.frameRate;
     format.pixelFormat = kCapturePixelFormat;
 
     return format;
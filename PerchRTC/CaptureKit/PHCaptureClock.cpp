@@ -0,0 +1,212 @@
+//
+//  PHCaptureClock.cpp
+//  PerchRTC
+//
+//  Created by Christopher Eagleston on 2015-06-29.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#include "PHCaptureClock.h"
+
+namespace perch {
+
+    namespace {
+
+        const int64_t kNanosecondsPerSecond = 1000000000;
+
+        // Source time that jumps further than this is not trusted, the timeline is re-anchored instead.
+        const int64_t kCaptureClockMaxIntervalNs = 5 * kNanosecondsPerSecond;
+
+        // Used to space frames after a discontinuity, before there is an estimate.
+        const int64_t kCaptureClockFallbackIntervalNs = kNanosecondsPerSecond / 30;
+
+        // Consecutive intervals on the same side of the estimate which are taken as a new frame rate.
+        const int kCaptureClockRateChangeRun = 4;
+
+        // Both filters weigh new samples by 1/16.
+        const int64_t kCaptureClockSmoothing = 16;
+
+        inline int64_t Abs(int64_t value)
+        {
+            return value < 0 ? -value : value;
+        }
+
+    } // namespace
+
+    CaptureClock::CaptureClock(int64_t nominalIntervalNs)
+    {
+        Reset(nominalIntervalNs);
+    }
+
+    void CaptureClock::Reset(int64_t nominalIntervalNs)
+    {
+        std::lock_guard<std::mutex> guard(_statsLock);
+
+        _nominalIntervalNs = nominalIntervalNs > 0 ? nominalIntervalNs : 0;
+        _started = false;
+        _expectRateChange = false;
+        _offsetNs = 0;
+        _firstTimestampNs = 0;
+        _lastPtsNs = 0;
+        _lastTimestampNs = 0;
+        _outlierCount = 0;
+        _outlierDirection = 0;
+        _outlierSumNs = 0;
+
+        _stats = CaptureClockStats();
+        _stats.estimatedIntervalNs = _nominalIntervalNs;
+    }
+
+    void CaptureClock::ExpectRateChange()
+    {
+        std::lock_guard<std::mutex> guard(_statsLock);
+        _expectRateChange = true;
+    }
+
+    CaptureClockFrame CaptureClock::Update(int64_t ptsValue, int32_t ptsTimescale, int64_t nowNs)
+    {
+        const int64_t ptsNs = PtsToNanoseconds(ptsValue, ptsTimescale);
+
+        std::lock_guard<std::mutex> guard(_statsLock);
+
+        CaptureClockFrame frame = CaptureClockFrame();
+
+        if (!_started) {
+            _started = true;
+            _firstTimestampNs = nowNs;
+            Anchor(ptsNs, nowNs);
+        }
+        else {
+            const int64_t interval = ptsNs - _lastPtsNs;
+            int64_t estimate = _stats.estimatedIntervalNs;
+
+            if (interval <= 0 || interval > kCaptureClockMaxIntervalNs) {
+                // Continue one interval after the last frame, or from now if the source really was gone for a while.
+
+                int64_t next = _lastTimestampNs + (estimate > 0 ? estimate : kCaptureClockFallbackIntervalNs);
+
+                if (interval > 0 && nowNs > next) {
+                    next = nowNs;
+                }
+
+                Anchor(ptsNs, next);
+                _outlierCount = 0;
+                _stats.discontinuities++;
+
+                frame.discontinuity = true;
+                frame.intervalNs = interval > 0 ? interval : 0;
+            }
+            else {
+                frame.intervalNs = interval;
+
+                if (estimate == 0 || _expectRateChange) {
+                    if (estimate != 0) {
+                        _stats.rateChanges++;
+                    }
+
+                    estimate = interval;
+                    _expectRateChange = false;
+                    _outlierCount = 0;
+                }
+                else {
+                    int direction = 0;
+
+                    if (2 * interval > 3 * estimate) {
+                        // A gap. Count the frames we didn't see, rounding to the nearest interval.
+
+                        int64_t missed = (interval + estimate / 2) / estimate - 1;
+                        frame.missedFrames = (int)(missed > 0 ? missed : 1);
+
+                        _stats.gaps++;
+                        _stats.missedFrames += frame.missedFrames;
+                        direction = 1;
+                    }
+                    else {
+                        frame.jitterNs = interval - estimate;
+                        UpdateJitter(frame.jitterNs);
+
+                        if (4 * interval < 3 * estimate) {
+                            direction = -1;
+                        }
+                        else {
+                            estimate += (interval - estimate) / kCaptureClockSmoothing;
+                        }
+                    }
+
+                    if (direction == 0) {
+                        _outlierCount = 0;
+                    }
+                    else if (direction == _outlierDirection && _outlierCount > 0) {
+                        _outlierCount++;
+                        _outlierSumNs += interval;
+                    }
+                    else {
+                        _outlierCount = 1;
+                        _outlierDirection = direction;
+                        _outlierSumNs = interval;
+                    }
+
+                    if (_outlierCount >= kCaptureClockRateChangeRun) {
+                        estimate = _outlierSumNs / _outlierCount;
+                        _outlierCount = 0;
+                        _stats.rateChanges++;
+                    }
+                }
+
+                _stats.estimatedIntervalNs = estimate;
+            }
+        }
+
+        frame.timestampNs = ptsNs + _offsetNs;
+        frame.elapsedTimeNs = frame.timestampNs - _firstTimestampNs;
+
+        _lastPtsNs = ptsNs;
+        _lastTimestampNs = frame.timestampNs;
+        _stats.frames++;
+
+        return frame;
+    }
+
+    void CaptureClock::NoteDroppedFrame()
+    {
+        std::lock_guard<std::mutex> guard(_statsLock);
+        _stats.reportedDrops++;
+    }
+
+    CaptureClockStats CaptureClock::Stats() const
+    {
+        std::lock_guard<std::mutex> guard(_statsLock);
+        return _stats;
+    }
+
+    int64_t CaptureClock::PtsToNanoseconds(int64_t value, int32_t timescale)
+    {
+        if (timescale <= 0) {
+            return 0;
+        }
+
+        // Split into whole seconds and a remainder, so that value * 1e9 never has to be formed.
+
+        const int64_t seconds = value / timescale;
+        const int64_t remainder = value % timescale;
+
+        return seconds * kNanosecondsPerSecond + (remainder * kNanosecondsPerSecond) / timescale;
+    }
+
+    void CaptureClock::Anchor(int64_t ptsNs, int64_t timestampNs)
+    {
+        _offsetNs = timestampNs - ptsNs;
+    }
+
+    void CaptureClock::UpdateJitter(int64_t deviationNs)
+    {
+        const int64_t deviation = Abs(deviationNs);
+
+        _stats.jitterNs += (deviation - _stats.jitterNs) / kCaptureClockSmoothing;
+
+        if (deviation > _stats.maxJitterNs) {
+            _stats.maxJitterNs = deviation;
+        }
+    }
+
+} // namespace perch
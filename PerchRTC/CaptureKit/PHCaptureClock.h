@@ -0,0 +1,102 @@
+//
+//  PHCaptureClock.h
+//  PerchRTC
+//
+//  Created by Christopher Eagleston on 2015-06-29.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#ifndef PerchRTC_PHCaptureClock_h
+#define PerchRTC_PHCaptureClock_h
+
+#include <mutex>
+#include <stdint.h>
+
+namespace perch {
+
+    struct CaptureClockFrame
+    {
+        // Monotonic, in the clock passed to Update(). Strictly increasing from frame to frame.
+        int64_t timestampNs;
+        // Time since the first frame after Reset().
+        int64_t elapsedTimeNs;
+        // Source time since the previous frame, or 0 for the first frame.
+        int64_t intervalNs;
+        // How far the interval strayed from the estimate (interval - estimate). Zero for gaps and discontinuities.
+        int64_t jitterNs;
+        // Frames that should have arrived before this one, judging by the estimated interval.
+        int missedFrames;
+        // The source time went backwards, or jumped too far to trust, and the timeline was re-anchored.
+        bool discontinuity;
+    };
+
+    struct CaptureClockStats
+    {
+        uint64_t frames;
+        uint64_t gaps;
+        uint64_t missedFrames;
+        // Drops reported by the capture device itself.
+        uint64_t reportedDrops;
+        uint64_t discontinuities;
+        uint64_t rateChanges;
+
+        int64_t estimatedIntervalNs;
+        // Smoothed mean absolute deviation of the interval, like RTP interarrival jitter (RFC 3550).
+        int64_t jitterNs;
+        int64_t maxJitterNs;
+    };
+
+    /**
+     *  Turns capture presentation timestamps into a monotonic nanosecond timeline, using integer math only.
+     *
+     *  The first frame is anchored to the caller's clock, and later frames keep their source spacing. The frame interval is
+     *  estimated with an exponentially weighted moving average (1/16). Intervals well beyond the estimate count as gaps,
+     *  and a run of consistently different intervals is taken as a frame rate change, which reseeds the estimate.
+     *
+     *  Update() and NoteDroppedFrame() must be called from one thread. Stats() may be called from any thread.
+     */
+    class CaptureClock
+    {
+    public:
+        explicit CaptureClock(int64_t nominalIntervalNs = 0);
+
+        // Starts a new timeline. Pass 0 if the frame interval is unknown.
+        void Reset(int64_t nominalIntervalNs);
+
+        // The next interval reseeds the estimate, for example after the capture frame rate was changed.
+        void ExpectRateChange();
+
+        // `ptsValue` and `ptsTimescale` are a CMTime style rational. `nowNs` is only used to anchor the timeline.
+        CaptureClockFrame Update(int64_t ptsValue, int32_t ptsTimescale, int64_t nowNs);
+
+        void NoteDroppedFrame();
+
+        CaptureClockStats Stats() const;
+
+        // Exact for any timescale, without overflowing for realistic presentation times.
+        static int64_t PtsToNanoseconds(int64_t value, int32_t timescale);
+
+    private:
+        void Anchor(int64_t ptsNs, int64_t timestampNs);
+        void UpdateJitter(int64_t deviationNs);
+
+        int64_t _nominalIntervalNs;
+        bool _started;
+        bool _expectRateChange;
+        int64_t _offsetNs;
+        int64_t _firstTimestampNs;
+        int64_t _lastPtsNs;
+        int64_t _lastTimestampNs;
+
+        // A run of intervals which didn't fit the estimate, all in the same direction.
+        int _outlierCount;
+        int _outlierDirection;
+        int64_t _outlierSumNs;
+
+        mutable std::mutex _statsLock;
+        CaptureClockStats _stats;
+    };
+
+} // namespace perch
+
+#endif
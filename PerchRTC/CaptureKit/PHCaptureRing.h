@@ -0,0 +1,271 @@
+//
+//  PHCaptureRing.h
+//  PerchRTC
+//
+//  Created by Christopher Eagleston on 2015-06-24.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#ifndef PerchRTC_PHCaptureRing_h
+#define PerchRTC_PHCaptureRing_h
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+namespace perch {
+
+    // A slot's sequence can't distinguish "written" from "free for the next lap" with a single slot, so depths start at 2.
+    const size_t kCaptureRingMinDepth = 2;
+    const size_t kCaptureRingMaxDepth = 16;
+
+    // Latency bucket 0 counts waits under 0.5 msec. Each following bucket doubles, and the last one is open ended (>= 512 msec).
+    const int kCaptureRingLatencyBuckets = 12;
+    const int64_t kCaptureRingFirstLatencyBucketNs = 500000;
+
+    struct CaptureRingStats
+    {
+        uint64_t pushed;
+        uint64_t popped;
+        // The oldest entry was discarded to make room for a new one.
+        uint64_t evicted;
+        // The new entry was discarded, because the consumer was busy taking the oldest one.
+        uint64_t rejected;
+
+        uint64_t totalLatencyNs;
+        uint64_t maxLatencyNs;
+
+        // Indexed by the ring's depth right after each push, [1, depth].
+        uint64_t depthHistogram[kCaptureRingMaxDepth + 1];
+        uint64_t latencyHistogram[kCaptureRingLatencyBuckets];
+    };
+
+    inline int CaptureRingLatencyBucket(int64_t latencyNs)
+    {
+        int bucket = 0;
+        int64_t bound = kCaptureRingFirstLatencyBucketNs;
+
+        while (latencyNs >= bound && bucket < kCaptureRingLatencyBuckets - 1) {
+            bound *= 2;
+            bucket++;
+        }
+
+        return bucket;
+    }
+
+    /**
+     *  A bounded ring between one producer (the capture queue) and one consumer (the thread which feeds the encoder).
+     *  When the ring is full, Push() discards the oldest entry instead of waiting, so the producer never blocks and the
+     *  consumer always sees the freshest frames.
+     *
+     *  Every slot carries a sequence number, in the style of Vyukov's bounded queue. The producer only writes a slot after
+     *  its previous entry has been read, and readers claim entries with a compare-and-swap on the head. Eviction is just
+     *  the producer claiming the head entry, which also makes Discard() safe from a third thread.
+     *
+     *  Timestamps are supplied by the caller, which keeps the ring independent of any particular clock.
+     */
+    template <typename T>
+    class CaptureRing
+    {
+    public:
+        enum PushResult {
+            kPushed,
+            kPushedEvictingOldest,
+            kRejected,
+        };
+
+        explicit CaptureRing(size_t depth)
+        : _depth(depth < kCaptureRingMinDepth ? kCaptureRingMinDepth : (depth > kCaptureRingMaxDepth ? kCaptureRingMaxDepth : depth)),
+          _slots(_depth), _head(0), _tail(0), _stats()
+        {
+            for (size_t i = 0; i < _depth; i++) {
+                _slots[i].sequence.store(i, std::memory_order_relaxed);
+            }
+        }
+
+        size_t Depth() const { return _depth; }
+
+        size_t Size() const
+        {
+            uint64_t tail = _tail.load(std::memory_order_acquire);
+            uint64_t head = _head.load(std::memory_order_acquire);
+            return tail > head ? (size_t)(tail - head) : 0;
+        }
+
+        // Producer only. An entry that is evicted or rejected is moved into `discarded`, for the caller to dispose of.
+        PushResult Push(T value, int64_t nowNs, T *discarded)
+        {
+            const uint64_t tail = _tail.load(std::memory_order_relaxed);
+            Slot &slot = _slots[tail % _depth];
+            PushResult result = kPushed;
+
+            while (slot.sequence.load(std::memory_order_acquire) != tail) {
+                // The slot still holds the entry from one lap ago. Claim it, unless a reader got there first.
+
+                uint64_t oldest = tail - _depth;
+
+                if (_head.compare_exchange_strong(oldest, oldest + 1, std::memory_order_acq_rel, std::memory_order_acquire)) {
+                    *discarded = std::move(slot.value);
+                    slot.sequence.store(tail, std::memory_order_release);
+                    Increment(_stats.evicted);
+                    result = kPushedEvictingOldest;
+                    break;
+                }
+
+                if (oldest > tail - _depth) {
+                    if (slot.sequence.load(std::memory_order_acquire) == tail) {
+                        break;
+                    }
+
+                    // A reader owns the slot and is moving the value out. Don't wait on it.
+
+                    *discarded = std::move(value);
+                    Increment(_stats.rejected);
+                    return kRejected;
+                }
+            }
+
+            slot.value = std::move(value);
+            slot.enqueueTimeNs = nowNs;
+            slot.sequence.store(tail + 1, std::memory_order_release);
+            _tail.store(tail + 1, std::memory_order_release);
+
+            uint64_t depth = tail + 1 - _head.load(std::memory_order_acquire);
+            Increment(_stats.depthHistogram[depth < kCaptureRingMaxDepth ? depth : kCaptureRingMaxDepth]);
+            Increment(_stats.pushed);
+
+            return result;
+        }
+
+        // Consumer. Returns false when the ring is empty. `latencyNs` is the time spent in the ring, and may be NULL.
+        bool Pop(int64_t nowNs, T *value, int64_t *latencyNs)
+        {
+            return Take(nowNs, value, latencyNs, true);
+        }
+
+        // Removes the oldest entry without counting it as delivered. Safe to call from any thread, for example while flushing.
+        bool Discard(T *value)
+        {
+            return Take(0, value, NULL, false);
+        }
+
+        CaptureRingStats Stats() const
+        {
+            CaptureRingStats stats;
+            stats.pushed = Load(_stats.pushed);
+            stats.popped = Load(_stats.popped);
+            stats.evicted = Load(_stats.evicted);
+            stats.rejected = Load(_stats.rejected);
+            stats.totalLatencyNs = Load(_stats.totalLatencyNs);
+            stats.maxLatencyNs = Load(_stats.maxLatencyNs);
+
+            for (size_t i = 0; i <= kCaptureRingMaxDepth; i++) {
+                stats.depthHistogram[i] = Load(_stats.depthHistogram[i]);
+            }
+            for (int i = 0; i < kCaptureRingLatencyBuckets; i++) {
+                stats.latencyHistogram[i] = Load(_stats.latencyHistogram[i]);
+            }
+
+            return stats;
+        }
+
+    private:
+        bool Take(int64_t nowNs, T *value, int64_t *latencyNs, bool record)
+        {
+            uint64_t head = _head.load(std::memory_order_acquire);
+
+            for (;;) {
+                Slot &slot = _slots[head % _depth];
+
+                if (slot.sequence.load(std::memory_order_acquire) != head + 1) {
+                    // Either the ring is empty, or the producer evicted our entry and we need to look further ahead.
+
+                    uint64_t current = _head.load(std::memory_order_acquire);
+
+                    if (current == head) {
+                        return false;
+                    }
+
+                    head = current;
+                    continue;
+                }
+
+                if (_head.compare_exchange_weak(head, head + 1, std::memory_order_acq_rel, std::memory_order_acquire)) {
+                    int64_t latency = nowNs > slot.enqueueTimeNs ? nowNs - slot.enqueueTimeNs : 0;
+
+                    *value = std::move(slot.value);
+                    slot.sequence.store(head + _depth, std::memory_order_release);
+
+                    if (record) {
+                        RecordLatency(latency);
+                    }
+
+                    if (latencyNs) {
+                        *latencyNs = latency;
+                    }
+
+                    return true;
+                }
+            }
+        }
+
+        struct Slot
+        {
+            Slot() : sequence(0), value(), enqueueTimeNs(0) {}
+
+            std::atomic<uint64_t> sequence;
+            T value;
+            int64_t enqueueTimeNs;
+        };
+
+        // Counters are written by one side each, and read from anywhere.
+        struct AtomicStats
+        {
+            std::atomic<uint64_t> pushed;
+            std::atomic<uint64_t> popped;
+            std::atomic<uint64_t> evicted;
+            std::atomic<uint64_t> rejected;
+            std::atomic<uint64_t> totalLatencyNs;
+            std::atomic<uint64_t> maxLatencyNs;
+            std::atomic<uint64_t> depthHistogram[kCaptureRingMaxDepth + 1];
+            std::atomic<uint64_t> latencyHistogram[kCaptureRingLatencyBuckets];
+        };
+
+        static void Increment(std::atomic<uint64_t> &counter, uint64_t amount = 1)
+        {
+            counter.fetch_add(amount, std::memory_order_relaxed);
+        }
+
+        static uint64_t Load(const std::atomic<uint64_t> &counter)
+        {
+            return counter.load(std::memory_order_relaxed);
+        }
+
+        void RecordLatency(int64_t latencyNs)
+        {
+            Increment(_stats.popped);
+            Increment(_stats.totalLatencyNs, (uint64_t)latencyNs);
+            Increment(_stats.latencyHistogram[CaptureRingLatencyBucket(latencyNs)]);
+
+            uint64_t current = Load(_stats.maxLatencyNs);
+
+            while ((uint64_t)latencyNs > current &&
+                   !_stats.maxLatencyNs.compare_exchange_weak(current, (uint64_t)latencyNs, std::memory_order_relaxed)) {
+            }
+        }
+
+        const size_t _depth;
+        std::vector<Slot> _slots;
+        std::atomic<uint64_t> _head;
+        std::atomic<uint64_t> _tail;
+        AtomicStats _stats;
+
+        CaptureRing(const CaptureRing &) = delete;
+        CaptureRing &operator=(const CaptureRing &) = delete;
+    };
+
+} // namespace perch
+
+#endif
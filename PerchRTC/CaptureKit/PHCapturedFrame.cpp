@@ -0,0 +1,176 @@
+//
+//  PHCapturedFrame.cpp
+//  PerchRTC
+//
+//  Created by Christopher Eagleston on 2015-06-22.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#include "PHCapturedFrame.h"
+
+namespace perch {
+
+    // PooledFrameSource
+
+    PooledFrameSource::PooledFrameSource(FramePool &pool, FrameBuffer *buffer)
+    : _pool(pool), _buffer(buffer)
+    {
+        // The pooled layout pads every row and plane, so a packed layout always fits inside of it.
+
+        const FrameKey &key = _buffer->Key();
+        const int chromaWidth = (key.width + 1) / 2;
+        const int chromaHeight = (key.height + 1) / 2;
+
+        switch (key.format) {
+            case kFrameFormatI420:
+                _layout.planeCount = 3;
+                _layout.strides[0] = key.width;
+                _layout.strides[1] = chromaWidth;
+                _layout.strides[2] = chromaWidth;
+                break;
+            case kFrameFormatNV12:
+                _layout.planeCount = 2;
+                _layout.strides[0] = key.width;
+                _layout.strides[1] = 2 * chromaWidth;
+                break;
+            default:
+                _layout.planeCount = 1;
+                _layout.strides[0] = 4 * key.width;
+                break;
+        }
+
+        size_t offset = 0;
+
+        for (int plane = 0; plane < _layout.planeCount; plane++) {
+            _layout.offsets[plane] = offset;
+            offset += (size_t)_layout.strides[plane] * (plane == 0 ? key.height : chromaHeight);
+        }
+
+        _layout.byteSize = offset;
+    }
+
+    PooledFrameSource::~PooledFrameSource()
+    {
+        _pool.Release(_buffer);
+    }
+
+    bool PooledFrameSource::LockPlanes(CapturedFramePlanes *planes)
+    {
+        const uint8_t *base = (const uint8_t *)_buffer->Handle();
+
+        planes->planeCount = _layout.planeCount;
+
+        for (int plane = 0; plane < _layout.planeCount; plane++) {
+            planes->data[plane] = base + _layout.offsets[plane];
+            planes->strides[plane] = _layout.strides[plane];
+        }
+
+        return true;
+    }
+
+    uint8_t *PooledFrameSource::MutablePlane(int plane, int *stride)
+    {
+        if (plane < 0 || plane >= _layout.planeCount) {
+            return NULL;
+        }
+
+        *stride = _layout.strides[plane];
+
+        return (uint8_t *)_buffer->Handle() + _layout.offsets[plane];
+    }
+
+    // CapturedFrame
+
+    CapturedFrame *CapturedFrame::Create(std::unique_ptr<CapturedFrameSource> source, int64_t timestampNs, int64_t elapsedTimeNs)
+    {
+        if (!source) {
+            return NULL;
+        }
+
+        return new CapturedFrame(std::move(source), timestampNs, elapsedTimeNs);
+    }
+
+    CapturedFrame::CapturedFrame(std::unique_ptr<CapturedFrameSource> source, int64_t timestampNs, int64_t elapsedTimeNs)
+    : _source(std::move(source)), _timestampNs(timestampNs), _elapsedTimeNs(elapsedTimeNs), _enqueueTimeNs(0), _dequeueTimeNs(0), _refCount(1), _copyCount(0)
+    {
+    }
+
+    int CapturedFrame::AddRef() const
+    {
+        return _refCount.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+
+    int CapturedFrame::Release() const
+    {
+        int count = _refCount.fetch_sub(1, std::memory_order_acq_rel) - 1;
+
+        if (count == 0) {
+            delete this;
+        }
+
+        return count;
+    }
+
+    // CapturedFrameQueue
+
+    CapturedFrameQueue::CapturedFrameQueue(size_t depth)
+    : _ring(depth), _copies(0)
+    {
+    }
+
+    CapturedFrameQueue::~CapturedFrameQueue()
+    {
+        Clear();
+    }
+
+    bool CapturedFrameQueue::Push(CapturedFrame *frame, int64_t nowNs)
+    {
+        CapturedFrame *discarded = NULL;
+
+        frame->AddRef();
+        frame->_enqueueTimeNs = nowNs;
+
+        CaptureRing<CapturedFrame *>::PushResult result = _ring.Push(frame, nowNs, &discarded);
+
+        // Either the oldest frame, or this one if the consumer was busy with the oldest.
+
+        if (discarded) {
+            discarded->Release();
+        }
+
+        return result != CaptureRing<CapturedFrame *>::kRejected;
+    }
+
+    CapturedFrame *CapturedFrameQueue::Pop(int64_t nowNs)
+    {
+        CapturedFrame *frame = NULL;
+
+        if (!_ring.Pop(nowNs, &frame, NULL)) {
+            return NULL;
+        }
+
+        frame->_dequeueTimeNs = nowNs;
+        _copies.fetch_add(frame->CopyCount(), std::memory_order_relaxed);
+
+        return frame;
+    }
+
+    void CapturedFrameQueue::Clear()
+    {
+        CapturedFrame *frame = NULL;
+
+        while (_ring.Discard(&frame)) {
+            frame->Release();
+        }
+    }
+
+    CapturedFrameQueueStats CapturedFrameQueue::Stats() const
+    {
+        CapturedFrameQueueStats stats;
+        stats.ring = _ring.Stats();
+        stats.copies = _copies.load(std::memory_order_relaxed);
+
+        return stats;
+    }
+
+} // namespace perch
@@ -0,0 +1,167 @@
+//
+//  PHCapturedFrame.h
+//  PerchRTC
+//
+//  Created by Christopher Eagleston on 2015-06-22.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#ifndef PerchRTC_PHCapturedFrame_h
+#define PerchRTC_PHCapturedFrame_h
+
+#include <atomic>
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "PHCaptureRing.h"
+#include "PHFramePool.h"
+
+namespace perch {
+
+    struct CapturedFramePlanes
+    {
+        int planeCount;
+        const uint8_t *data[3];
+        int strides[3];
+    };
+
+    /**
+     *  Owns the memory behind a captured frame. On iOS this is a retained CMSampleBufferRef, elsewhere it can be a heap
+     *  buffer or a fake source. The memory stays valid until the source is destroyed.
+     */
+    class CapturedFrameSource
+    {
+    public:
+        virtual ~CapturedFrameSource() {}
+
+        virtual int Width() const = 0;
+        virtual int Height() const = 0;
+        // One of the kFrameFormat constants.
+        virtual uint32_t Format() const = 0;
+
+        // Planes are only valid between LockPlanes() and UnlockPlanes().
+        virtual bool LockPlanes(CapturedFramePlanes *planes) = 0;
+        virtual void UnlockPlanes() = 0;
+
+        // A platform handle which the frame factory understands (a CMSampleBufferRef on iOS), or NULL.
+        virtual void *NativeHandle() const { return NULL; }
+    };
+
+    /**
+     *  A source whose planes live in a buffer borrowed from a FramePool with an AlignedHeapAllocator.
+     *  The planes are packed back to back without row padding, which is what cricket expects of I420 and NV12 frame data.
+     */
+    class PooledFrameSource : public CapturedFrameSource
+    {
+    public:
+        PooledFrameSource(FramePool &pool, FrameBuffer *buffer);
+        ~PooledFrameSource() override;
+
+        int Width() const override { return _buffer->Key().width; }
+        int Height() const override { return _buffer->Key().height; }
+        uint32_t Format() const override { return _buffer->Key().format; }
+
+        bool LockPlanes(CapturedFramePlanes *planes) override;
+        void UnlockPlanes() override {}
+
+        // Writable planes, for filling the buffer.
+        uint8_t *MutablePlane(int plane, int *stride);
+
+        const uint8_t *Data() const { return (const uint8_t *)_buffer->Handle(); }
+        size_t ByteSize() const { return _layout.byteSize; }
+
+    private:
+        FramePool &_pool;
+        FrameBuffer *_buffer;
+        FramePlaneLayout _layout;
+
+        PooledFrameSource(const PooledFrameSource &) = delete;
+        PooledFrameSource &operator=(const PooledFrameSource &) = delete;
+    };
+
+    /**
+     *  A reference counted captured frame. The source is released along with the last reference, so capture memory
+     *  is held exactly as long as the delivery queue and the encoder need it, and no longer.
+     */
+    class CapturedFrame
+    {
+    public:
+        // Returns a frame with one reference.
+        static CapturedFrame *Create(std::unique_ptr<CapturedFrameSource> source, int64_t timestampNs, int64_t elapsedTimeNs);
+
+        int AddRef() const;
+        int Release() const;
+
+        CapturedFrameSource &Source() const { return *_source; }
+
+        // The presentation time reported by the capture device.
+        int64_t TimestampNs() const { return _timestampNs; }
+        int64_t ElapsedTimeNs() const { return _elapsedTimeNs; }
+
+        // Set by the delivery queue, in the queue's clock.
+        int64_t EnqueueTimeNs() const { return _enqueueTimeNs; }
+        int64_t DequeueTimeNs() const { return _dequeueTimeNs; }
+
+        // Counts the full frame copies made on the way to the encoder.
+        void RecordCopy() { _copyCount.fetch_add(1, std::memory_order_relaxed); }
+        int CopyCount() const { return _copyCount.load(std::memory_order_relaxed); }
+
+    private:
+        friend class CapturedFrameQueue;
+
+        CapturedFrame(std::unique_ptr<CapturedFrameSource> source, int64_t timestampNs, int64_t elapsedTimeNs);
+        ~CapturedFrame() {}
+
+        std::unique_ptr<CapturedFrameSource> _source;
+        const int64_t _timestampNs;
+        const int64_t _elapsedTimeNs;
+        int64_t _enqueueTimeNs;
+        int64_t _dequeueTimeNs;
+        mutable std::atomic<int> _refCount;
+        std::atomic<int> _copyCount;
+
+        CapturedFrame(const CapturedFrame &) = delete;
+        CapturedFrame &operator=(const CapturedFrame &) = delete;
+    };
+
+    struct CapturedFrameQueueStats
+    {
+        CaptureRingStats ring;
+        // Full frame copies made by the frames which were delivered.
+        uint64_t copies;
+    };
+
+    /**
+     *  Delivers captured frames from the capture queue to the thread which feeds the encoder, through a CaptureRing.
+     *  When the consumer falls behind the oldest waiting frame is dropped, and the capture queue is never blocked.
+     */
+    class CapturedFrameQueue
+    {
+    public:
+        explicit CapturedFrameQueue(size_t depth);
+        ~CapturedFrameQueue();
+
+        // Producer only. Takes a reference when the frame is queued, and returns false if it was dropped instead.
+        bool Push(CapturedFrame *frame, int64_t nowNs);
+
+        // Returns a frame that the caller must Release(), or NULL when the queue is empty.
+        CapturedFrame *Pop(int64_t nowNs);
+
+        // Releases every queued frame.
+        void Clear();
+
+        size_t Depth() const { return _ring.Depth(); }
+        CapturedFrameQueueStats Stats() const;
+
+    private:
+        CaptureRing<CapturedFrame *> _ring;
+        std::atomic<uint64_t> _copies;
+
+        CapturedFrameQueue(const CapturedFrameQueue &) = delete;
+        CapturedFrameQueue &operator=(const CapturedFrameQueue &) = delete;
+    };
+
+} // namespace perch
+
+#endif
@@ -24,6 +24,19 @@ typedef struct PHVideoFormat {
     double frameRate;
 } PHVideoFormat;
 
+// One of the scaled layers we send a peer.
+typedef struct PHVideoLayer {
+    // -1 when no layer is selected.
+    NSInteger index;
+    PHVideoFormat format;
+    // In kbps.
+    NSUInteger bitRate;
+    // The most the peer will take, in kbps. 0 for no limit.
+    NSUInteger maxBitRate;
+} PHVideoLayer;
+
+static const PHVideoLayer PHVideoLayerNone = { -1, { { 0, 0 }, PHPixelFormatYUV420BiPlanarFullRange, 0 }, 0, 0 };
+
 static double PHMediaSessionFrameWeightExponentDenominator = 3.5;
 
 static inline NSUInteger PHVideoFormatComputePeakRate(PHVideoFormat format, double targetBpp, NSUInteger maxRate)
@@ -17,12 +17,17 @@
 #include <vector>
 
 #include "talk/media/base/videocapturer.h"
+#include "webrtc/base/criticalsection.h"
+#include "webrtc/base/messagehandler.h"
 
 #import "PHVideoCaptureKit.h"
 
+#include "PHCaptureClock.h"
+#include "PHCapturedFrame.h"
+
 namespace perch {
 
-    class VideoCapturerKit : public cricket::VideoCapturer
+    class VideoCapturerKit : public cricket::VideoCapturer, public rtc::MessageHandler
     {
     public:
 
@@ -36,9 +41,22 @@ namespace perch {
 
         // Inject captured frames.
 
+        // Wraps the frame without copying when the pooled frame factory is in use, and queues it for the start thread.
+        // The sample buffer stays retained until the encoder is done with it.
         void CopyCapturedFrame(CMSampleBufferRef incomingFrame);
         void HandleDroppedFrame(CMSampleBufferRef droppedFrame);
-        void SignalFrameCapturedOnStartThread(const cricket::CapturedFrame* frame);
+        // The capture frame rate is about to change.
+        void PrepareForFormatChange();
+
+        // Frames waiting for the start thread, before the oldest is dropped. Only takes effect while stopped.
+        bool SetDeliveryQueueDepth(size_t depth);
+        size_t DeliveryQueueDepth() const;
+        CapturedFrameQueueStats DeliveryStats() const;
+        CaptureClockStats ClockStats() const;
+
+        // rtc::MessageHandler implementation.
+
+        void OnMessage(rtc::Message* msg) override;
 
         // cricket::VideoCapturer implementation.
 
@@ -51,14 +69,18 @@ namespace perch {
         bool IsScreencast() const override;
         
     private:
-        rtc::Thread* _startThread;  // Set in Start(), unset in Stop().
+        void DeliverQueuedFrame();
+
+        rtc::Thread* _startThread;  // Set in Start(), unset in Stop(). Guarded by _startThreadLock.
+        rtc::CriticalSection _startThreadLock;
         id<PHVideoCapture> _captureHandler;
         PHVideoCaptureKit *_owner;
-        int64 _initialTimestamp;
-        int64 _nextTimestamp;
         int64 _frameDuration;
-        cricket::CapturedFrame _planarFrame;
+        CaptureClock _clock;
+        uint32 _captureFourcc;
         std::vector<cricket::VideoFormat> _formats;
+        std::unique_ptr<CapturedFrameQueue> _deliveryQueue;
+        FramePool _planarPool;
 
         DISALLOW_COPY_AND_ASSIGN(VideoCapturerKit);
     };
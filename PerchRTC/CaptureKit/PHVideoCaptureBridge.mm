@@ -13,26 +13,84 @@
 #include "talk/media/base/videocommon.h"
 #include "talk/media/base/videoframe.h"
 #include "webrtc/base/timeutils.h"
-#include "third_party/libyuv/include/libyuv/convert.h"
 #ifdef HAVE_WEBRTC_VIDEO
 #include "talk/media/webrtc/webrtcvideoframefactory.h"
 #include "webrtc/modules/video_capture/include/video_capture_factory.h"
 #endif
 
-#include "webrtc/base/bind.h"
+#include "webrtc/base/thread.h"
+
+#include "PHConvert.h"
 
 static BOOL VideoCaptureKitUsePooledMemory = YES;
 
+// Frames waiting for the start thread. Each one holds a capture buffer, so keep this small or AVFoundation will run dry.
+static const size_t kVideoCaptureKitQueueDepth = 3;
+
 using std::endl;
 
 namespace perch {
 
+    namespace {
+
+        enum {
+            kMessageDeliverFrame = 1,
+        };
+
+        // Keeps the captured sample buffer alive until the last reference to the frame is gone.
+        class SampleBufferFrameSource : public CapturedFrameSource
+        {
+        public:
+            explicit SampleBufferFrameSource(CMSampleBufferRef sampleBuffer)
+            : _sampleBuffer((CMSampleBufferRef)CFRetain(sampleBuffer)), _pixelBuffer(CMSampleBufferGetImageBuffer(sampleBuffer))
+            {
+            }
+
+            ~SampleBufferFrameSource() override
+            {
+                CFRelease(_sampleBuffer);
+            }
+
+            int Width() const override { return (int)CVPixelBufferGetWidth(_pixelBuffer); }
+            int Height() const override { return (int)CVPixelBufferGetHeight(_pixelBuffer); }
+            uint32_t Format() const override { return CVPixelBufferGetPixelFormatType(_pixelBuffer); }
+
+            bool LockPlanes(CapturedFramePlanes *planes) override
+            {
+                if (CVPixelBufferLockBaseAddress(_pixelBuffer, kCVPixelBufferLock_ReadOnly) != kCVReturnSuccess) {
+                    return false;
+                }
+
+                planes->planeCount = (int)MIN(CVPixelBufferGetPlaneCount(_pixelBuffer), (size_t)3);
+
+                for (int plane = 0; plane < planes->planeCount; plane++) {
+                    planes->data[plane] = (const uint8_t *)CVPixelBufferGetBaseAddressOfPlane(_pixelBuffer, plane);
+                    planes->strides[plane] = (int)CVPixelBufferGetBytesPerRowOfPlane(_pixelBuffer, plane);
+                }
+
+                return true;
+            }
+
+            void UnlockPlanes() override
+            {
+                CVPixelBufferUnlockBaseAddress(_pixelBuffer, kCVPixelBufferLock_ReadOnly);
+            }
+
+            void *NativeHandle() const override { return _sampleBuffer; }
+
+        private:
+            CMSampleBufferRef _sampleBuffer;
+            CVPixelBufferRef _pixelBuffer;
+        };
+
+    } // namespace
+
     VideoCapturerKit::VideoCapturerKit()
-    : _startThread(nullptr)
+    : _startThread(nullptr),
+      _captureFourcc(cricket::FOURCC_NV12),
+      _deliveryQueue(new CapturedFrameQueue(kVideoCaptureKitQueueDepth)),
+      _planarPool(std::unique_ptr<FrameAllocator>(new AlignedHeapAllocator()), kVideoCaptureKitQueueDepth + 1)
     {
-        _initialTimestamp = time(NULL) * rtc::kNumNanosecsPerSec;
-        _nextTimestamp = rtc::kNumNanosecsPerMillisec;
-
 #ifdef HAVE_WEBRTC_VIDEO
         if (VideoCaptureKitUsePooledMemory) {
             set_frame_factory(new cricket::WebRtcPooledVideoFrameFactory());
@@ -45,8 +103,13 @@ namespace perch {
 
     VideoCapturerKit::~VideoCapturerKit()
     {
-        if (_planarFrame.data) {
-            free(_planarFrame.data);
+        {
+            rtc::CritScope lock(&_startThreadLock);
+
+            if (_startThread) {
+                _startThread->Clear(this);
+            }
+            _deliveryQueue->Clear();
         }
 //        SignalStateChange(this, capture_state());
         [_owner invalidate];
@@ -62,10 +125,15 @@ namespace perch {
 
             // Keep track of which thread capture started on. This is the thread that
             // frames need to be sent to.
-            DCHECK(!_startThread);
-            _startThread = rtc::Thread::Current();
+            {
+                rtc::CritScope lock(&_startThreadLock);
+
+                DCHECK(!_startThread);
+                _startThread = rtc::Thread::Current();
+            }
 
             _frameDuration = capture_format.interval;
+            _clock.Reset(_frameDuration);
 
             [_captureHandler prepareForCapture];
             [_captureHandler startCapturing];
@@ -84,8 +152,20 @@ namespace perch {
             }
             [_captureHandler stopCapturing];
 
+            // Give the capture buffers back right away, rather than waiting for the next start.
+            // The capture queue may be queueing a frame right now, so this waits for it to finish, and it won't queue another.
+
+            {
+                rtc::CritScope lock(&_startThreadLock);
+
+                if (_startThread) {
+                    _startThread->Clear(this);
+                }
+                _startThread = nullptr;
+                _deliveryQueue->Clear();
+            }
+
             SetCaptureFormat(NULL);
-            _startThread = nullptr;
             SetCaptureState(cricket::CS_STOPPED);
             return;
         } catch (...) {}
@@ -101,9 +181,8 @@ namespace perch {
 
         size_t width = CVPixelBufferGetWidthOfPlane(videoFrame, kYPlaneIndex);
         size_t yPlaneHeight = CVPixelBufferGetHeightOfPlane(videoFrame, kYPlaneIndex);
-        CMSampleTimingInfo info;
-        CMSampleBufferGetSampleTimingInfo(incomingBuffer, 0, &info);
-        int64 timestamp = CMTimeGetSeconds(info.presentationTimeStamp) * rtc::kNumNanosecsPerSec;
+        CMTime presentationTime = CMSampleBufferGetPresentationTimeStamp(incomingBuffer);
+        int64 now = rtc::TimeNanos();
 
         if (capture_state() == cricket::CS_STOPPED) {
             NSLog(@"Tried to copy a frame while stopped %@.", incomingBuffer);
@@ -112,20 +191,28 @@ namespace perch {
 
         // Format Conversion
 
-#if 1
-        _planarFrame.time_stamp = timestamp;
-        _planarFrame.elapsed_time = _nextTimestamp;
-        _planarFrame.width = (int)width;
-        _planarFrame.height = (int)yPlaneHeight;
+        std::unique_ptr<CapturedFrameSource> source;
+        bool copied = false;
 
         if (VideoCaptureKitUsePooledMemory) {
-            // Our pooled frame factory will convert the buffer, locking as needed.
+            // Our pooled frame factory will convert the buffer, locking as needed. Hold on to it until then.
 
-            _planarFrame.nativeHandle = incomingBuffer;
+            source.reset(new SampleBufferFrameSource(incomingBuffer));
         }
         else {
             // Deliver an unpadded I420 frame which can be understood by the default frame factory.
 
+            FrameBuffer *planarBuffer = _planarPool.Acquire(FrameKey((int)width, (int)yPlaneHeight, kFrameFormatI420));
+
+            if (planarBuffer == NULL) {
+                NSLog(@"Out of planar capture buffers, dropping frame.");
+                HandleDroppedFrame(incomingBuffer);
+                return;
+            }
+
+            PooledFrameSource *planarSource = new PooledFrameSource(_planarPool, planarBuffer);
+            source.reset(planarSource);
+
             CVPixelBufferLockBaseAddress(videoFrame, kCVPixelBufferLock_ReadOnly);
 
             uint8_t *baseAddress = (uint8_t*)CVPixelBufferGetBaseAddressOfPlane(videoFrame, kYPlaneIndex);
@@ -135,67 +222,159 @@ namespace perch {
             size_t uvPlaneHeight = CVPixelBufferGetHeightOfPlane(videoFrame, kUVPlaneIndex);
             size_t chromaWidth = CVPixelBufferGetWidthOfPlane(videoFrame, kUVPlaneIndex);
 
-            size_t ySize = (size_t)(width * yPlaneHeight);
-            size_t uSize = (size_t)(chromaWidth * uvPlaneHeight);
-            uint8 *yBuffer = (uint8 *)_planarFrame.data;
-            uint8 *uBuffer = &yBuffer[ySize];
-            uint8 *vBuffer = &yBuffer[ySize + uSize];
+            int yStride, uStride, vStride;
+            uint8 *yBuffer = planarSource->MutablePlane(0, &yStride);
+            uint8 *uBuffer = planarSource->MutablePlane(1, &uStride);
+            uint8 *vBuffer = planarSource->MutablePlane(2, &vStride);
 
-            libyuv::NV12ToI420(baseAddress, (int)yPlaneBytesPerRow,
-                               uvAddress, (int)uvPlaneBytesPerRow,
-                               yBuffer, (int)width,
-                               uBuffer, (int)chromaWidth,
-                               vBuffer, (int)chromaWidth,
-                               (int)width, (int)yPlaneHeight);
+            PHCopyPlane(baseAddress, (int)yPlaneBytesPerRow,
+                        yBuffer, yStride,
+                        (int)width, (int)yPlaneHeight);
+
+            PHDeinterleavePlane(uvAddress, (int)uvPlaneBytesPerRow,
+                                uBuffer, uStride,
+                                vBuffer, vStride,
+                                (int)chromaWidth, (int)uvPlaneHeight);
 
             CVPixelBufferUnlockBaseAddress(videoFrame, kCVPixelBufferLock_ReadOnly);
+            copied = true;
         }
 
-        // Signal the captured frame.
+        // Both timestamps come from the presentation time, mapped onto the monotonic clock.
 
-        if (_startThread->IsCurrent()) {
-            SignalFrameCaptured(this, &_planarFrame);
-        } else {
-            _startThread->Invoke<void>(
-                                       rtc::Bind(&VideoCapturerKit::SignalFrameCapturedOnStartThread,
-                                                 this, &_planarFrame));
+        if (!CMTIME_IS_NUMERIC(presentationTime)) {
+            presentationTime = CMTimeMake(now, (int32_t)rtc::kNumNanosecsPerSec);
         }
 
-#else
-        int frameSize = yPlaneBytesPerRow * yPlaneHeight + uvPlaneBytesPerRow * uvPlaneHeight;
-        cricket::CapturedFrame frame;
-        frame.width = CVPixelBufferGetWidth(videoFrame);
-        frame.height = CVPixelBufferGetHeight(videoFrame);
-        frame.fourcc = cricket::FOURCC_NV12;
-        frame.data_size = frameSize;
-        frame.data = baseAddress;
-        frame.time_stamp = timestamp;
-        frame.elapsed_time = _nextTimestamp;
-
-        if (_startThread->IsCurrent()) {
-            SignalFrameCaptured(this, &frame);
-        } else {
-            _startThread->Invoke<void>(
-                                       rtc::Bind(&VideoCapturerKit::SignalFrameCapturedOnStartThread,
-                                                 this, &frame));
+        CaptureClockFrame timing = _clock.Update(presentationTime.value, presentationTime.timescale, now);
+
+        CapturedFrame *frame = CapturedFrame::Create(std::move(source), timing.timestampNs, timing.elapsedTimeNs);
+
+        if (copied) {
+            frame->RecordCopy();
         }
 
-        CVPixelBufferUnlockBaseAddress(videoFrame, kCVPixelBufferLock_ReadOnly);
+        // Signal the captured frame. Never block the capture queue on the start thread, if it falls behind the oldest frame is dropped.
+        // A message that finds its frame already dropped delivers the next one instead, or nothing.
+        // The frame is queued and posted under the lock, so Stop() either sees it and clears it, or it is never queued.
 
-#endif
-        _nextTimestamp += _frameDuration;
+        bool deliverNow = false;
+
+        {
+            rtc::CritScope lock(&_startThreadLock);
+
+            if (_startThread == nullptr) {
+                NSLog(@"Tried to copy a frame while stopped %@.", incomingBuffer);
+            }
+            else if (_deliveryQueue->Push(frame, now)) {
+                if (_startThread->IsCurrent()) {
+                    deliverNow = true;
+                } else {
+                    _startThread->Post(this, kMessageDeliverFrame);
+                }
+            }
+        }
 
+        frame->Release();
+
+        // Deliver outside of the lock, so that a Stop() from another thread isn't held up by the encoder.
+
+        if (deliverNow) {
+            DeliverQueuedFrame();
+        }
     }
 
-    void VideoCapturerKit::SignalFrameCapturedOnStartThread(const cricket::CapturedFrame* frame)
+    void VideoCapturerKit::OnMessage(rtc::Message* msg)
     {
-        DCHECK(_startThread->IsCurrent());
-        SignalFrameCaptured(this, frame);
+        if (msg->message_id == kMessageDeliverFrame) {
+            DeliverQueuedFrame();
+        }
+    }
+
+    void VideoCapturerKit::DeliverQueuedFrame()
+    {
+        {
+            rtc::CritScope lock(&_startThreadLock);
+
+            // Stopped since the frame was queued, the queue has already been cleared.
+
+            if (_startThread == nullptr) {
+                return;
+            }
+
+            DCHECK(_startThread->IsCurrent());
+        }
+
+        CapturedFrame *frame = _deliveryQueue->Pop(rtc::TimeNanos());
+
+        if (frame == NULL) {
+            return;
+        }
+
+        CapturedFrameSource &source = frame->Source();
+        void *nativeHandle = source.NativeHandle();
+
+        cricket::CapturedFrame capturedFrame;
+        capturedFrame.width = source.Width();
+        capturedFrame.height = source.Height();
+        capturedFrame.fourcc = _captureFourcc;
+        capturedFrame.data_size = (capturedFrame.width * capturedFrame.height * 3) / 2;
+        capturedFrame.time_stamp = frame->TimestampNs();
+        capturedFrame.elapsed_time = frame->ElapsedTimeNs();
+
+        CapturedFramePlanes planes;
+
+        if (nativeHandle) {
+            capturedFrame.nativeHandle = nativeHandle;
+            SignalFrameCaptured(this, &capturedFrame);
+        }
+        else if (source.LockPlanes(&planes)) {
+            capturedFrame.data = (void *)planes.data[0];
+            SignalFrameCaptured(this, &capturedFrame);
+            source.UnlockPlanes();
+        }
+
+        // The frame factory has made its own I420 frame by now, so the capture buffer can go back to its owner.
+
+        frame->Release();
+    }
+
+    bool VideoCapturerKit::SetDeliveryQueueDepth(size_t depth)
+    {
+        if (capture_state() == cricket::CS_RUNNING) {
+            return false;
+        }
+
+        _deliveryQueue.reset(new CapturedFrameQueue(depth));
+
+        return true;
+    }
+
+    size_t VideoCapturerKit::DeliveryQueueDepth() const
+    {
+        return _deliveryQueue->Depth();
+    }
+
+    CapturedFrameQueueStats VideoCapturerKit::DeliveryStats() const
+    {
+        return _deliveryQueue->Stats();
+    }
+
+    CaptureClockStats VideoCapturerKit::ClockStats() const
+    {
+        return _clock.Stats();
     }
 
     void VideoCapturerKit::HandleDroppedFrame(CMSampleBufferRef droppedFrame)
     {
-        _nextTimestamp += _frameDuration;
+        // The gap shows up in the next frame's presentation time, this just keeps count.
+
+        _clock.NoteDroppedFrame();
+    }
+
+    void VideoCapturerKit::PrepareForFormatChange()
+    {
+        _clock.ExpectRateChange();
     }
 
     void VideoCapturerKit::SetCaptureHandler(id<PHVideoCapture> captureHandler)
@@ -257,21 +436,9 @@ namespace perch {
         best_format->fourcc = supportedFormat.fourcc;
         best_format->interval = supportedFormat.interval;
 
-        // Setup a temporary conversion buffer.
+        // Planar frames are converted into pooled buffers, as they are captured.
 
-        int planarBufferSize = 1.5 * (best_format->width * best_format->height);
-        _planarFrame.data_size = planarBufferSize;
-        _planarFrame.width = best_format->width;
-        _planarFrame.height = best_format->height;
-
-        if (VideoCaptureKitUsePooledMemory) {
-            _planarFrame.fourcc = cricket::FOURCC_NV12;
-            _planarFrame.data = NULL;
-        }
-        else {
-            _planarFrame.fourcc = cricket::FOURCC_I420;
-            _planarFrame.data = malloc(planarBufferSize);
-        }
+        _captureFourcc = VideoCaptureKitUsePooledMemory ? cricket::FOURCC_NV12 : cricket::FOURCC_I420;
 
         return true;
     }
@@ -16,7 +16,8 @@
 
 /**
  *  Provides a frame to the capture consumer. 
-*   @note By the time this method returns the consumer will have copied the contents of the sample buffer.
+*   @note The consumer may retain the sample buffer until the frame has been encoded, and never blocks waiting for the encoder.
+ *        Frames are dropped when too many are already waiting.
  *
  *  @param frame A CMSampleBufferRef containing a CVPixelBufferRef.
  */
@@ -72,6 +73,25 @@
 
 @property (nonatomic, weak, readonly) id<PHVideoCapture> videoCapturer;
 
+/**
+ *  The number of captured frames which may wait for the encoder. When another frame arrives the oldest one is dropped.
+ *  Only applied while capture is stopped. Defaults to 3, and is limited to [2, 16].
+ */
+@property (nonatomic, assign) NSUInteger captureQueueDepth;
+
+/**
+ *  Delivery counters for the capture queue: pushed, delivered, evicted, rejected, copies, averageLatency, and maxLatency (seconds).
+ *  Also `depthHistogram` (frames waiting after each capture, starting from 0), and `latencyHistogram` (buckets starting
+ *  below 0.5 msec, doubling, with the last one open ended).
+ */
+- (NSDictionary *)captureQueueStatistics;
+
+/**
+ *  Capture timing, measured from presentation timestamps: frames, gaps, missedFrames, reportedDrops, discontinuities,
+ *  rateChanges, and the estimated frameInterval, jitter, and maxJitter (seconds).
+ */
+- (NSDictionary *)captureClockStatistics;
+
 - (void)invalidate;
 
 /**
@@ -15,6 +15,7 @@
 #include "talk/media/base/videocapturer.h"
 #include "talk/media/devices/devicemanager.h"
 #include "webrtc/modules/video_capture/include/video_capture_factory.h"
+#include "webrtc/base/timeutils.h"
 
 
 /**
@@ -113,6 +114,74 @@
 
 #endif // Not iPhone Simulator
 
+#pragma mark - Capture Queue
+
+- (NSUInteger)captureQueueDepth
+{
+    return _rtcCapturer ? _rtcCapturer->DeliveryQueueDepth() : 0;
+}
+
+- (void)setCaptureQueueDepth:(NSUInteger)captureQueueDepth
+{
+    if (_rtcCapturer && !_rtcCapturer->SetDeliveryQueueDepth(captureQueueDepth)) {
+        DDLogWarn(@"Can't change the capture queue depth while capturing.");
+    }
+}
+
+- (NSDictionary *)captureQueueStatistics
+{
+    if (!_rtcCapturer) {
+        return nil;
+    }
+
+    perch::CapturedFrameQueueStats stats = _rtcCapturer->DeliveryStats();
+    const perch::CaptureRingStats &ring = stats.ring;
+
+    NSMutableArray *depthHistogram = [NSMutableArray array];
+    NSMutableArray *latencyHistogram = [NSMutableArray array];
+
+    for (size_t i = 0; i <= _rtcCapturer->DeliveryQueueDepth(); i++) {
+        [depthHistogram addObject:@(ring.depthHistogram[i])];
+    }
+    for (int i = 0; i < perch::kCaptureRingLatencyBuckets; i++) {
+        [latencyHistogram addObject:@(ring.latencyHistogram[i])];
+    }
+
+    double averageLatency = ring.popped > 0 ? (double)ring.totalLatencyNs / ring.popped / rtc::kNumNanosecsPerSec : 0;
+
+    return @{ @"pushed" : @(ring.pushed),
+              @"delivered" : @(ring.popped),
+              @"evicted" : @(ring.evicted),
+              @"rejected" : @(ring.rejected),
+              @"copies" : @(stats.copies),
+              @"averageLatency" : @(averageLatency),
+              @"maxLatency" : @((double)ring.maxLatencyNs / rtc::kNumNanosecsPerSec),
+              @"depthHistogram" : depthHistogram,
+              @"latencyHistogram" : latencyHistogram };
+}
+
+- (NSDictionary *)captureClockStatistics
+{
+    if (!_rtcCapturer) {
+        return nil;
+    }
+
+    perch::CaptureClockStats stats = _rtcCapturer->ClockStats();
+    double nanosecondsPerSecond = rtc::kNumNanosecsPerSec;
+
+    return @{ @"frames" : @(stats.frames),
+              @"gaps" : @(stats.gaps),
+              @"missedFrames" : @(stats.missedFrames),
+              @"reportedDrops" : @(stats.reportedDrops),
+              @"discontinuities" : @(stats.discontinuities),
+              @"rateChanges" : @(stats.rateChanges),
+              @"frameInterval" : @(stats.estimatedIntervalNs / nanosecondsPerSecond),
+              @"jitter" : @(stats.jitterNs / nanosecondsPerSecond),
+              @"maxJitter" : @(stats.maxJitterNs / nanosecondsPerSecond) };
+}
+
+#pragma mark - Public
+
 - (void)invalidate
 {
     _rtcCapturer = nil;
@@ -139,7 +208,11 @@
 
 - (void)prepareForCaptureFormatChange
 {
-    // TODO: Inform our cricket::videoCapturer subclass of the impending format change.
+    // TODO: Inform our cricket::videoCapturer subclass of dimension changes, not just frame rate changes.
+
+    if (_rtcCapturer) {
+        _rtcCapturer->PrepareForFormatChange();
+    }
 }
 
 @end
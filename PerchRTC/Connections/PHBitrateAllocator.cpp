@@ -0,0 +1,312 @@
+//
+//  PHBitrateAllocator.cpp
+//  PerchRTC
+//
+//  Created by Christopher Eagleston on 2015-07-29.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#include "PHBitrateAllocator.h"
+
+#include <algorithm>
+#include <math.h>
+
+namespace perch {
+
+    namespace {
+
+        const int64_t kNoTime = -1;
+
+        // Audio climbs its curve this many times faster than video. A call survives bad video, but not bad audio.
+        const double kAudioPriority = 2;
+
+        // Enough to settle well below 1 kbps on any budget we will see.
+        const int kWaterFillIterations = 32;
+
+        struct CurvePoint
+        {
+            double fraction;
+            double quality;
+        };
+
+        struct Curve
+        {
+            const CurvePoint *points;
+            size_t count;
+        };
+
+        // Quality against bitrate, as a fraction of the stream's peak. The first point is the least worth sending.
+        // Video follows the usual PSNR knee, which VideoToolbox's H.264 reaches later than libvpx's VP8 does at these
+        // sizes. Opus is transparent well before its peak, and iSAC tops out at 32 kbps, half our usual audio peak.
+
+        const CurvePoint kVP8Curve[] = { {0.10, 0.15}, {0.25, 0.50}, {0.50, 0.78}, {0.75, 0.93}, {1.00, 1.00} };
+        const CurvePoint kH264Curve[] = { {0.15, 0.15}, {0.35, 0.50}, {0.60, 0.78}, {0.85, 0.93}, {1.00, 1.00} };
+        const CurvePoint kOpusCurve[] = { {0.10, 0.30}, {0.25, 0.70}, {0.50, 0.90}, {1.00, 1.00} };
+        const CurvePoint kISACCurve[] = { {0.15, 0.40}, {0.30, 0.75}, {0.50, 1.00}, {1.00, 1.00} };
+
+        Curve CurveForCodec(BitrateCodec codec)
+        {
+            switch (codec) {
+                case BitrateCodecOpus: {
+                    Curve curve = { kOpusCurve, sizeof(kOpusCurve) / sizeof(kOpusCurve[0]) };
+                    return curve;
+                }
+                case BitrateCodecISAC: {
+                    Curve curve = { kISACCurve, sizeof(kISACCurve) / sizeof(kISACCurve[0]) };
+                    return curve;
+                }
+                case BitrateCodecH264: {
+                    Curve curve = { kH264Curve, sizeof(kH264Curve) / sizeof(kH264Curve[0]) };
+                    return curve;
+                }
+                case BitrateCodecVP8:
+                default: {
+                    Curve curve = { kVP8Curve, sizeof(kVP8Curve) / sizeof(kVP8Curve[0]) };
+                    return curve;
+                }
+            }
+        }
+
+        bool IsAudio(BitrateCodec codec)
+        {
+            return codec == BitrateCodecOpus || codec == BitrateCodecISAC;
+        }
+
+        // The inverse of BitrateQuality(), clamped to the curve's first point.
+        double FractionForQuality(const Curve &curve, double quality)
+        {
+            if (quality <= curve.points[0].quality) {
+                return curve.points[0].fraction;
+            }
+
+            for (size_t i = 1; i < curve.count; i++) {
+                const CurvePoint &low = curve.points[i - 1];
+                const CurvePoint &high = curve.points[i];
+
+                if (quality <= high.quality) {
+                    double span = high.quality - low.quality;
+                    double t = span > 0 ? (quality - low.quality) / span : 0;
+                    return low.fraction + t * (high.fraction - low.fraction);
+                }
+            }
+
+            return curve.points[curve.count - 1].fraction;
+        }
+
+        struct StreamLimits
+        {
+            Curve curve;
+            double priority;
+            double peak;
+            double minimum;
+            double ceiling;
+        };
+
+        double RateAtLevel(const StreamLimits &limits, double level)
+        {
+            double quality = std::min(1.0, level * limits.priority);
+            double rate = FractionForQuality(limits.curve, quality) * limits.peak;
+
+            return std::max(limits.minimum, std::min(limits.ceiling, rate));
+        }
+
+        double TotalAtLevel(const std::vector<StreamLimits> &limits, double level)
+        {
+            double total = 0;
+
+            for (size_t i = 0; i < limits.size(); i++) {
+                total += RateAtLevel(limits[i], level);
+            }
+
+            return total;
+        }
+
+        // Gives every stream of one kind its minimum, or an even share of what's left if that's not enough.
+        // Returns false if it wasn't enough.
+        bool AllocateMinimums(const std::vector<StreamLimits> &limits, const std::vector<BitrateStream> &streams, bool audio,
+                              uint32_t *remaining, std::vector<uint32_t> *allocation)
+        {
+            uint32_t needed = 0;
+            uint32_t count = 0;
+
+            for (size_t i = 0; i < streams.size(); i++) {
+                if (IsAudio(streams[i].codec) == audio) {
+                    needed += (uint32_t)limits[i].minimum;
+                    count++;
+                }
+            }
+
+            bool enough = needed <= *remaining;
+            uint32_t share = count > 0 ? *remaining / count : 0;
+
+            for (size_t i = 0; i < streams.size(); i++) {
+                if (IsAudio(streams[i].codec) == audio) {
+                    uint32_t given = enough ? (uint32_t)limits[i].minimum : std::min(share, (uint32_t)limits[i].minimum);
+                    (*allocation)[i] = given;
+                    *remaining -= given;
+                }
+            }
+
+            return enough;
+        }
+
+    } // namespace
+
+    double BitrateQuality(BitrateCodec codec, double fractionOfPeak)
+    {
+        Curve curve = CurveForCodec(codec);
+
+        if (fractionOfPeak < curve.points[0].fraction) {
+            // Below the least worth sending, quality falls away to nothing.
+            return curve.points[0].quality * std::max(0.0, fractionOfPeak) / curve.points[0].fraction;
+        }
+
+        for (size_t i = 1; i < curve.count; i++) {
+            const CurvePoint &low = curve.points[i - 1];
+            const CurvePoint &high = curve.points[i];
+
+            if (fractionOfPeak <= high.fraction) {
+                double t = (fractionOfPeak - low.fraction) / (high.fraction - low.fraction);
+                return low.quality + t * (high.quality - low.quality);
+            }
+        }
+
+        return 1.0;
+    }
+
+    std::vector<uint32_t> AllocateBitrate(const std::vector<BitrateStream> &streams, uint32_t budgetKbps)
+    {
+        std::vector<uint32_t> allocation(streams.size(), 0);
+        std::vector<StreamLimits> limits(streams.size());
+
+        for (size_t i = 0; i < streams.size(); i++) {
+            const BitrateStream &stream = streams[i];
+            StreamLimits &limit = limits[i];
+
+            limit.curve = CurveForCodec(stream.codec);
+            limit.priority = IsAudio(stream.codec) ? kAudioPriority : 1.0;
+            limit.peak = stream.peakKbps;
+            limit.ceiling = stream.capKbps > 0 ? std::min(stream.peakKbps, stream.capKbps) : stream.peakKbps;
+            limit.minimum = std::min(limit.ceiling, ceil(limit.curve.points[0].fraction * limit.peak));
+        }
+
+        // Minimums first, audio before video.
+
+        uint32_t remaining = budgetKbps;
+
+        if (!AllocateMinimums(limits, streams, true, &remaining, &allocation) ||
+            !AllocateMinimums(limits, streams, false, &remaining, &allocation)) {
+            return allocation;
+        }
+
+        // Then find the highest common quality level which fits, and give every stream its rate at that level.
+
+        double level = 1.0;
+
+        if (TotalAtLevel(limits, level) > budgetKbps) {
+            double low = 0;
+            double high = 1.0;
+
+            for (int i = 0; i < kWaterFillIterations; i++) {
+                double middle = (low + high) / 2;
+
+                if (TotalAtLevel(limits, middle) <= budgetKbps) {
+                    low = middle;
+                }
+                else {
+                    high = middle;
+                }
+            }
+
+            level = low;
+        }
+
+        for (size_t i = 0; i < streams.size(); i++) {
+            allocation[i] = (uint32_t)floor(RateAtLevel(limits[i], level));
+        }
+
+        return allocation;
+    }
+
+    // BitrateAllocator
+
+    BitrateAllocator::BitrateAllocator(BitrateAllocatorConfig config)
+    : _config(config), _estimateKbps(0), _lastDecreaseMs(kNoTime), _lastIncreaseMs(kNoTime)
+    {
+        if (_config.increaseSmoothing < 1) {
+            _config.increaseSmoothing = 1;
+        }
+    }
+
+    bool BitrateAllocator::Update(const std::vector<BitrateStream> &streams, uint32_t estimateKbps, int64_t nowMs,
+                                  std::map<std::string, uint32_t> *caps)
+    {
+        if (_estimateKbps == 0 || estimateKbps < _estimateKbps) {
+            _estimateKbps = estimateKbps;
+        }
+        else {
+            uint32_t smoothing = (uint32_t)_config.increaseSmoothing;
+            _estimateKbps += (estimateKbps - _estimateKbps + smoothing - 1) / smoothing;
+        }
+
+        std::vector<uint32_t> allocation = AllocateBitrate(streams, _estimateKbps);
+        std::map<std::string, uint32_t> current;
+        bool canDecrease = _lastDecreaseMs == kNoTime || nowMs - _lastDecreaseMs >= _config.minDecreaseIntervalMs;
+        bool canIncrease = _lastIncreaseMs == kNoTime || nowMs - _lastIncreaseMs >= _config.minIncreaseIntervalMs;
+        bool decreased = false;
+        bool increased = false;
+
+        caps->clear();
+
+        for (size_t i = 0; i < streams.size(); i++) {
+            const std::string &key = streams[i].key;
+            std::map<std::string, uint32_t>::const_iterator previous = _caps.find(key);
+            uint32_t cap = allocation[i];
+
+            if (previous == _caps.end()) {
+                (*caps)[key] = cap;
+                current[key] = cap;
+                continue;
+            }
+
+            uint32_t last = previous->second;
+            uint32_t change = cap > last ? cap - last : last - cap;
+            bool significant = change > 0 && change >= _config.minChangeFraction * last;
+
+            if (significant && cap < last && canDecrease) {
+                (*caps)[key] = cap;
+                current[key] = cap;
+                decreased = true;
+            }
+            else if (significant && cap > last && canIncrease) {
+                (*caps)[key] = cap;
+                current[key] = cap;
+                increased = true;
+            }
+            else {
+                current[key] = last;
+            }
+        }
+
+        if (decreased) {
+            _lastDecreaseMs = nowMs;
+        }
+
+        if (increased) {
+            _lastIncreaseMs = nowMs;
+        }
+
+        _caps.swap(current);
+
+        return !caps->empty();
+    }
+
+    void BitrateAllocator::Reset()
+    {
+        _estimateKbps = 0;
+        _lastDecreaseMs = kNoTime;
+        _lastIncreaseMs = kNoTime;
+        _caps.clear();
+    }
+
+} // namespace perch
@@ -0,0 +1,108 @@
+//
+//  PHBitrateAllocator.h
+//  PerchRTC
+//
+//  Created by Christopher Eagleston on 2015-07-29.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#ifndef PerchRTC_PHBitrateAllocator_h
+#define PerchRTC_PHBitrateAllocator_h
+
+#include <map>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace perch {
+
+    enum BitrateCodec
+    {
+        BitrateCodecOpus,
+        BitrateCodecISAC,
+        BitrateCodecVP8,
+        BitrateCodecH264
+    };
+
+    struct BitrateStream
+    {
+        BitrateStream() : codec(BitrateCodecVP8), peakKbps(0), capKbps(0) {}
+        BitrateStream(const std::string &streamKey, BitrateCodec streamCodec, uint32_t peak, uint32_t cap = 0)
+        : key(streamKey), codec(streamCodec), peakKbps(peak), capKbps(cap)
+        {}
+
+        // Identifies the stream from one allocation to the next.
+        std::string key;
+        BitrateCodec codec;
+        // Where the codec's quality curve tops out. For video, the peak rate of the format being sent.
+        uint32_t peakKbps;
+        // The most the receiver will take. 0 for no limit.
+        uint32_t capKbps;
+    };
+
+    // The codec's quality, from 0 to 1, at a bitrate given as a fraction of the stream's peak.
+    double BitrateQuality(BitrateCodec codec, double fractionOfPeak);
+
+    /**
+     *  Splits a budget between streams. Every stream first gets the least its codec is usable at, audio before video.
+     *  The rest is shared so that every video stream reaches the same quality on its codec's curve, with audio
+     *  climbing its curve twice as fast. No stream gets more than its peak or its cap. Allocations are in the same
+     *  order as the streams, and never add up to more than the budget.
+     */
+    std::vector<uint32_t> AllocateBitrate(const std::vector<BitrateStream> &streams, uint32_t budgetKbps);
+
+    struct BitrateAllocatorConfig
+    {
+        BitrateAllocatorConfig()
+        : increaseSmoothing(4), minChangeFraction(0.1), minDecreaseIntervalMs(4000), minIncreaseIntervalMs(5000)
+        {}
+
+        // Increases in the estimate are followed by 1/increaseSmoothing per update. Decreases are taken at once.
+        int increaseSmoothing;
+        // Smaller changes to a stream's allocation aren't worth pushing.
+        double minChangeFraction;
+        // How long to wait after pushing a decrease, before pushing another one. WebRTC's own estimate keeps the
+        // encoder under the cap in the meantime, so this only saves renegotiating on every step of a falling estimate.
+        int64_t minDecreaseIntervalMs;
+        // How long to wait after pushing an increase, before pushing another one.
+        int64_t minIncreaseIntervalMs;
+    };
+
+    /**
+     *  Follows an uplink estimate, and decides when the allocation has changed enough to push new caps. Pushing a cap
+     *  can mean renegotiating, so the first decrease goes out right away, but later ones are spaced out, and increases
+     *  are held back until they are worth it and then spaced out further.
+     */
+    class BitrateAllocator
+    {
+    public:
+        explicit BitrateAllocator(BitrateAllocatorConfig config = BitrateAllocatorConfig());
+
+        /**
+         *  Allocates the smoothed estimate between `streams`. Returns true if any cap should be pushed, in which case
+         *  `caps` holds the ones to push by stream key. A stream which hasn't been pushed before is always pushed.
+         */
+        bool Update(const std::vector<BitrateStream> &streams, uint32_t estimateKbps, int64_t nowMs,
+                    std::map<std::string, uint32_t> *caps);
+
+        /**
+         *  The caps pushed so far, by stream key. Every stream which still exists must be passed to each update,
+         *  including those which can't take a new cap yet; the caps of streams missing from an update are forgotten.
+         */
+        const std::map<std::string, uint32_t> &Caps() const { return _caps; }
+
+        uint32_t EstimateKbps() const { return _estimateKbps; }
+
+        void Reset();
+
+    private:
+        BitrateAllocatorConfig _config;
+        uint32_t _estimateKbps;
+        int64_t _lastDecreaseMs;
+        int64_t _lastIncreaseMs;
+        std::map<std::string, uint32_t> _caps;
+    };
+
+} // namespace perch
+
+#endif
@@ -0,0 +1,436 @@
+//
+//  PHConnectionStats.cpp
+//  PerchRTC
+//
+//  Created by Christopher Eagleston on 2015-08-09.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#include "PHConnectionStats.h"
+
+#include <stdint.h>
+#include <string.h>
+
+namespace perch {
+
+    namespace {
+
+        enum StreamField
+        {
+            StreamFieldSsrc,
+            StreamFieldMediaType,
+            StreamFieldBytesSent,
+            StreamFieldBytesReceived,
+            StreamFieldPacketsSent,
+            StreamFieldPacketsReceived,
+            StreamFieldPacketsLost,
+            StreamFieldRtt,
+            StreamFieldJitter,
+            StreamFieldFrameRate,
+            StreamFieldFrameWidth,
+            StreamFieldFrameHeight,
+            StreamFieldCodecTime
+        };
+
+        struct FieldName
+        {
+            const char *name;
+            int field;
+        };
+
+        // The values of an "ssrc" report which we record. Audio and video, send and receive reports share the table.
+        const FieldName kStreamFields[] = {
+            { "ssrc", StreamFieldSsrc },
+            { "mediaType", StreamFieldMediaType },
+            { "bytesSent", StreamFieldBytesSent },
+            { "bytesReceived", StreamFieldBytesReceived },
+            { "packetsSent", StreamFieldPacketsSent },
+            { "packetsReceived", StreamFieldPacketsReceived },
+            { "packetsLost", StreamFieldPacketsLost },
+            { "googRtt", StreamFieldRtt },
+            { "googJitterReceived", StreamFieldJitter },
+            { "googFrameRateSent", StreamFieldFrameRate },
+            { "googFrameRateReceived", StreamFieldFrameRate },
+            { "googFrameWidthSent", StreamFieldFrameWidth },
+            { "googFrameWidthReceived", StreamFieldFrameWidth },
+            { "googFrameHeightSent", StreamFieldFrameHeight },
+            { "googFrameHeightReceived", StreamFieldFrameHeight },
+            { "googAvgEncodeMs", StreamFieldCodecTime },
+            { "googDecodeMs", StreamFieldCodecTime }
+        };
+
+        enum BandwidthField
+        {
+            BandwidthFieldAvailableSend,
+            BandwidthFieldAvailableReceive,
+            BandwidthFieldTransmit,
+            BandwidthFieldRetransmit,
+            BandwidthFieldTargetEncode,
+            BandwidthFieldActualEncode
+        };
+
+        const FieldName kBandwidthFields[] = {
+            { "googAvailableSendBandwidth", BandwidthFieldAvailableSend },
+            { "googAvailableReceiveBandwidth", BandwidthFieldAvailableReceive },
+            { "googTransmitBitrate", BandwidthFieldTransmit },
+            { "googRetransmitBitrate", BandwidthFieldRetransmit },
+            { "googTargetEncBitrate", BandwidthFieldTargetEncode },
+            { "googActualEncBitrate", BandwidthFieldActualEncode }
+        };
+
+        template <size_t Count>
+        int FieldForName(const FieldName (&fields)[Count], const char *name)
+        {
+            for (size_t i = 0; i < Count; i++) {
+                if (strcmp(fields[i].name, name) == 0) {
+                    return fields[i].field;
+                }
+            }
+
+            return -1;
+        }
+
+        // Reads a decimal integer. A fraction is dropped, WebRTC reports some rates with one.
+        bool ToInt64(const char *text, int64_t *value)
+        {
+            bool isNegative = *text == '-';
+            const char *cursor = isNegative ? text + 1 : text;
+            int64_t parsed = 0;
+
+            if (*cursor < '0' || *cursor > '9') {
+                return false;
+            }
+
+            while (*cursor >= '0' && *cursor <= '9') {
+                if (parsed > (INT64_MAX - 9) / 10) {
+                    return false;
+                }
+
+                parsed = parsed * 10 + (*cursor - '0');
+                cursor++;
+            }
+
+            if (*cursor != '\0' && *cursor != '.') {
+                return false;
+            }
+
+            *value = isNegative ? -parsed : parsed;
+            return true;
+        }
+
+        void ToInt32(const char *text, int32_t *value)
+        {
+            int64_t parsed = 0;
+
+            if (ToInt64(text, &parsed)) {
+                *value = (int32_t)parsed;
+            }
+        }
+
+        void ToKbps(const char *text, int32_t *kbps)
+        {
+            int64_t bps = 0;
+
+            if (ToInt64(text, &bps) && bps >= 0) {
+                *kbps = (int32_t)(bps / 1000);
+            }
+        }
+
+        bool HasSuffix(const char *text, const char *suffix)
+        {
+            size_t textLength = strlen(text);
+            size_t suffixLength = strlen(suffix);
+
+            return textLength >= suffixLength && strcmp(text + textLength - suffixLength, suffix) == 0;
+        }
+
+    } // namespace
+
+    // StatsReportParser
+
+    bool StatsReportParser::Begin(const char *type, const char *reportId, double timestampMs)
+    {
+        _report = ReportNone;
+
+        if (!type) {
+            return false;
+        }
+
+        if (strcmp(type, "ssrc") == 0) {
+            _report = ReportSsrc;
+            _stream = StreamStats();
+            _stream.timestampMs = (int64_t)timestampMs;
+
+            // m45 names them "ssrc_<ssrc>_send" and "ssrc_<ssrc>_recv".
+
+            if (reportId && HasSuffix(reportId, "_send")) {
+                _stream.direction = StatsDirectionSend;
+            }
+            else if (reportId && HasSuffix(reportId, "_recv")) {
+                _stream.direction = StatsDirectionReceive;
+            }
+        }
+        else if (strcmp(type, "VideoBwe") == 0) {
+            _report = ReportBandwidth;
+            _snapshot.bandwidth.timestampMs = (int64_t)timestampMs;
+            _snapshot.hasBandwidth = true;
+        }
+        else if (strcmp(type, "googCandidatePair") == 0) {
+            _report = ReportCandidatePair;
+            _isActivePair = false;
+            _pairRttMs = -1;
+        }
+
+        return _report != ReportNone;
+    }
+
+    void StatsReportParser::AddValue(const char *name, const char *value)
+    {
+        if (!name || !value) {
+            return;
+        }
+
+        switch (_report) {
+            case ReportSsrc: {
+                int64_t number = 0;
+
+                switch (FieldForName(kStreamFields, name)) {
+                    case StreamFieldSsrc:
+                        if (ToInt64(value, &number)) {
+                            _stream.ssrc = (uint32_t)number;
+                        }
+                        break;
+                    case StreamFieldMediaType:
+                        _stream.media = strcmp(value, "audio") == 0 ? StatsMediaAudio :
+                                        strcmp(value, "video") == 0 ? StatsMediaVideo : StatsMediaUnknown;
+                        break;
+                    case StreamFieldBytesSent:
+                    case StreamFieldBytesReceived:
+                        ToInt64(value, &_stream.bytes);
+                        if (_stream.direction == StatsDirectionUnknown) {
+                            bool isSent = strcmp(name, "bytesSent") == 0;
+                            _stream.direction = isSent ? StatsDirectionSend : StatsDirectionReceive;
+                        }
+                        break;
+                    case StreamFieldPacketsSent:
+                    case StreamFieldPacketsReceived:
+                        ToInt64(value, &_stream.packets);
+                        break;
+                    case StreamFieldPacketsLost:
+                        ToInt64(value, &_stream.packetsLost);
+                        break;
+                    case StreamFieldRtt:
+                        ToInt32(value, &_stream.rttMs);
+                        break;
+                    case StreamFieldJitter:
+                        ToInt32(value, &_stream.jitterMs);
+                        break;
+                    case StreamFieldFrameRate:
+                        ToInt32(value, &_stream.frameRate);
+                        break;
+                    case StreamFieldFrameWidth:
+                        ToInt32(value, &_stream.frameWidth);
+                        break;
+                    case StreamFieldFrameHeight:
+                        ToInt32(value, &_stream.frameHeight);
+                        break;
+                    case StreamFieldCodecTime:
+                        ToInt32(value, &_stream.codecTimeMs);
+                        break;
+                    default:
+                        break;
+                }
+                break;
+            }
+            case ReportBandwidth: {
+                BandwidthStats &bandwidth = _snapshot.bandwidth;
+
+                switch (FieldForName(kBandwidthFields, name)) {
+                    case BandwidthFieldAvailableSend:
+                        ToKbps(value, &bandwidth.availableSendKbps);
+                        break;
+                    case BandwidthFieldAvailableReceive:
+                        ToKbps(value, &bandwidth.availableReceiveKbps);
+                        break;
+                    case BandwidthFieldTransmit:
+                        ToKbps(value, &bandwidth.transmitKbps);
+                        break;
+                    case BandwidthFieldRetransmit:
+                        ToKbps(value, &bandwidth.retransmitKbps);
+                        break;
+                    case BandwidthFieldTargetEncode:
+                        ToKbps(value, &bandwidth.targetEncodeKbps);
+                        break;
+                    case BandwidthFieldActualEncode:
+                        ToKbps(value, &bandwidth.actualEncodeKbps);
+                        break;
+                    default:
+                        break;
+                }
+                break;
+            }
+            case ReportCandidatePair:
+                if (strcmp(name, "googActiveConnection") == 0) {
+                    _isActivePair = strcmp(value, "true") == 0;
+                }
+                else if (strcmp(name, "googRtt") == 0) {
+                    ToInt32(value, &_pairRttMs);
+                }
+                break;
+            case ReportNone:
+                break;
+        }
+    }
+
+    void StatsReportParser::End()
+    {
+        if (_report == ReportSsrc && _stream.ssrc != 0) {
+            _snapshot.streams.push_back(_stream);
+        }
+        else if (_report == ReportCandidatePair && _isActivePair && _pairRttMs >= 0) {
+            _snapshot.bandwidth.rttMs = _pairRttMs;
+            _snapshot.hasBandwidth = true;
+        }
+
+        _report = ReportNone;
+    }
+
+    // ConnectionStats
+
+    ConnectionStats::ConnectionStats()
+    {}
+
+    void ConnectionStats::Record(const StatsSnapshot &snapshot)
+    {
+        for (size_t i = 0; i < snapshot.streams.size(); i++) {
+            const StreamStats &stats = snapshot.streams[i];
+            StreamSlot *slot = SlotForWriting(stats.ssrc);
+            const StreamStats &previous = slot->previous;
+
+            StreamStats sample = stats;
+
+            if (slot->lastTimestampMs != 0) {
+                int64_t intervalMs = stats.timestampMs - previous.timestampMs;
+
+                // The same report, collected twice.
+
+                if (intervalMs <= 0) {
+                    continue;
+                }
+
+                // Counters go backwards when a stream is recreated. Its next sample starts over.
+
+                if (stats.bytes >= previous.bytes && stats.packets >= previous.packets) {
+                    int64_t packets = stats.packets - previous.packets;
+                    int64_t lost = stats.packetsLost > previous.packetsLost ? stats.packetsLost - previous.packetsLost : 0;
+                    int64_t expected = stats.direction == StatsDirectionReceive ? packets + lost : packets;
+
+                    sample.intervalMs = intervalMs;
+                    sample.bitrateKbps = (uint32_t)((stats.bytes - previous.bytes) * 8 / intervalMs);
+                    sample.packetRate = (uint32_t)(packets * 1000 / intervalMs);
+                    sample.lossFraction = expected > 0 ? (lost < expected ? (float)lost / expected : 1.0f) : 0;
+                }
+            }
+
+            slot->series.Append(sample);
+            slot->previous = sample;
+            slot->lastTimestampMs = stats.timestampMs;
+        }
+
+        if (snapshot.hasBandwidth) {
+            _bandwidth.Append(snapshot.bandwidth);
+        }
+    }
+
+    bool ConnectionStats::LatestStream(uint32_t ssrc, StreamStats *stats) const
+    {
+        const StreamSlot *slot = SlotForReading(ssrc);
+
+        return slot && slot->series.Latest(stats) && stats->ssrc == ssrc;
+    }
+
+    size_t ConnectionStats::StreamHistory(uint32_t ssrc, StreamStats *samples, size_t maxSamples) const
+    {
+        const StreamSlot *slot = SlotForReading(ssrc);
+
+        if (!slot) {
+            return 0;
+        }
+
+        size_t copied = slot->series.Copy(samples, maxSamples);
+        size_t kept = 0;
+
+        // A slot which was taken over still holds some of the old stream's samples.
+
+        for (size_t i = 0; i < copied; i++) {
+            if (samples[i].ssrc == ssrc) {
+                samples[kept++] = samples[i];
+            }
+        }
+
+        return kept;
+    }
+
+    size_t ConnectionStats::LatestStreams(StatsMedia media, StatsDirection direction, StreamStats *stats, size_t maxStreams) const
+    {
+        size_t copied = 0;
+
+        for (size_t i = 0; i < kMaxStreams && copied < maxStreams; i++) {
+            const StreamSlot &slot = _streams[i];
+            uint32_t ssrc = slot.ssrc.load(std::memory_order_acquire);
+            StreamStats &latest = stats[copied];
+
+            if (ssrc == 0 || !slot.series.Latest(&latest) || latest.ssrc != ssrc) {
+                continue;
+            }
+
+            if (latest.media == media && latest.direction == direction) {
+                copied++;
+            }
+        }
+
+        return copied;
+    }
+
+    ConnectionStats::StreamSlot *ConnectionStats::SlotForWriting(uint32_t ssrc)
+    {
+        StreamSlot *freeSlot = NULL;
+        StreamSlot *stalest = &_streams[0];
+
+        for (size_t i = 0; i < kMaxStreams; i++) {
+            StreamSlot &slot = _streams[i];
+            uint32_t slotSsrc = slot.ssrc.load(std::memory_order_relaxed);
+
+            if (slotSsrc == ssrc) {
+                return &slot;
+            }
+
+            if (slotSsrc == 0 && !freeSlot) {
+                freeSlot = &slot;
+            }
+            else if (slot.lastTimestampMs < stalest->lastTimestampMs) {
+                stalest = &slot;
+            }
+        }
+
+        StreamSlot *slot = freeSlot ? freeSlot : stalest;
+
+        slot->lastTimestampMs = 0;
+        slot->previous = StreamStats();
+        slot->ssrc.store(ssrc, std::memory_order_release);
+
+        return slot;
+    }
+
+    const ConnectionStats::StreamSlot *ConnectionStats::SlotForReading(uint32_t ssrc) const
+    {
+        for (size_t i = 0; i < kMaxStreams; i++) {
+            if (_streams[i].ssrc.load(std::memory_order_acquire) == ssrc) {
+                return &_streams[i];
+            }
+        }
+
+        return NULL;
+    }
+
+} // namespace perch
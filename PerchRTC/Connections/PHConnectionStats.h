@@ -0,0 +1,316 @@
+//
+//  PHConnectionStats.h
+//  PerchRTC
+//
+//  Created by Christopher Eagleston on 2015-08-09.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#ifndef PerchRTC_PHConnectionStats_h
+#define PerchRTC_PHConnectionStats_h
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+#include <vector>
+
+namespace perch {
+
+    enum StatsMedia
+    {
+        StatsMediaUnknown = 0,
+        StatsMediaAudio,
+        StatsMediaVideo
+    };
+
+    enum StatsDirection
+    {
+        StatsDirectionUnknown = 0,
+        StatsDirectionSend,
+        StatsDirectionReceive
+    };
+
+    /**
+     *  One sample of an SSRC. Counters are cumulative, as WebRTC reports them. Rates are over the interval since the
+     *  stream's previous sample, and are 0 on its first. Values WebRTC didn't report are -1.
+     */
+    struct StreamStats
+    {
+        StreamStats()
+        : ssrc(0), media(StatsMediaUnknown), direction(StatsDirectionUnknown), timestampMs(0), bytes(0), packets(0),
+          packetsLost(0), rttMs(-1), jitterMs(-1), frameRate(-1), frameWidth(-1), frameHeight(-1), codecTimeMs(-1),
+          intervalMs(0), bitrateKbps(0), packetRate(0), lossFraction(0)
+        {}
+
+        uint32_t ssrc;
+        StatsMedia media;
+        StatsDirection direction;
+        int64_t timestampMs;
+
+        int64_t bytes;
+        int64_t packets;
+        int64_t packetsLost;
+
+        int32_t rttMs;
+        int32_t jitterMs;
+        int32_t frameRate;
+        int32_t frameWidth;
+        int32_t frameHeight;
+        // Average encode time when sending, decode time when receiving.
+        int32_t codecTimeMs;
+
+        int64_t intervalMs;
+        uint32_t bitrateKbps;
+        uint32_t packetRate;
+        // Of the packets sent or expected in the interval, the fraction which were lost.
+        float lossFraction;
+    };
+
+    // The connection's bandwidth estimate (WebRTC's "VideoBwe" report), in kbps.
+    struct BandwidthStats
+    {
+        BandwidthStats()
+        : timestampMs(0), availableSendKbps(-1), availableReceiveKbps(-1), transmitKbps(-1), retransmitKbps(-1),
+          targetEncodeKbps(-1), actualEncodeKbps(-1), rttMs(-1)
+        {}
+
+        int64_t timestampMs;
+        int32_t availableSendKbps;
+        int32_t availableReceiveKbps;
+        int32_t transmitKbps;
+        int32_t retransmitKbps;
+        int32_t targetEncodeKbps;
+        int32_t actualEncodeKbps;
+        // Of the active candidate pair.
+        int32_t rttMs;
+    };
+
+    // What one round of getStats said.
+    struct StatsSnapshot
+    {
+        StatsSnapshot() : hasBandwidth(false) {}
+
+        std::vector<StreamStats> streams;
+        BandwidthStats bandwidth;
+        bool hasBandwidth;
+    };
+
+    /**
+     *  Turns the string values of WebRTC's stats reports into a snapshot. Reports are given one at a time: Begin, then
+     *  each of the report's values, then End. Reports we don't record can skip their values.
+     */
+    class StatsReportParser
+    {
+    public:
+        StatsReportParser() : _report(ReportNone), _isActivePair(false), _pairRttMs(-1) {}
+
+        // Returns false if the report isn't recorded.
+        bool Begin(const char *type, const char *reportId, double timestampMs);
+        void AddValue(const char *name, const char *value);
+        void End();
+
+        const StatsSnapshot &Snapshot() const { return _snapshot; }
+
+    private:
+        enum Report
+        {
+            ReportNone,
+            ReportSsrc,
+            ReportBandwidth,
+            ReportCandidatePair
+        };
+
+        Report _report;
+        StreamStats _stream;
+        bool _isActivePair;
+        int32_t _pairRttMs;
+        StatsSnapshot _snapshot;
+    };
+
+    /**
+     *  A ring of the last Capacity samples, for one writer and any number of readers. Each slot is a seqlock: the
+     *  writer makes its sequence odd, stores the sample, then makes it even again, and never waits. A reader copies the
+     *  slot and retries if the sequence moved meanwhile. Samples are stored as relaxed atomic words, so a copy which
+     *  races the writer is thrown away rather than being a data race.
+     */
+    template <typename T, size_t Capacity>
+    class StatsSeries
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "Samples are copied as words.");
+
+    public:
+        StatsSeries() : _count(0)
+        {
+            for (size_t i = 0; i < Capacity; i++) {
+                _slots[i].sequence.store(0, std::memory_order_relaxed);
+                _slots[i].index.store(0, std::memory_order_relaxed);
+
+                for (size_t j = 0; j < kWords; j++) {
+                    _slots[i].words[j].store(0, std::memory_order_relaxed);
+                }
+            }
+        }
+
+        void Append(const T &sample)
+        {
+            uint64_t index = _count.load(std::memory_order_relaxed);
+            Slot &slot = _slots[index % Capacity];
+            uint32_t sequence = slot.sequence.load(std::memory_order_relaxed);
+            uint64_t words[kWords] = {};
+
+            memcpy(words, &sample, sizeof(T));
+
+            slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+
+            slot.index.store(index, std::memory_order_relaxed);
+
+            for (size_t i = 0; i < kWords; i++) {
+                slot.words[i].store(words[i], std::memory_order_relaxed);
+            }
+
+            slot.sequence.store(sequence + 2, std::memory_order_release);
+            _count.store(index + 1, std::memory_order_release);
+        }
+
+        // Samples appended so far, including those which have been overwritten.
+        uint64_t Count() const { return _count.load(std::memory_order_acquire); }
+
+        bool Latest(T *sample) const
+        {
+            uint64_t count = Count();
+
+            while (count > 0) {
+                if (Read(count - 1, sample)) {
+                    return true;
+                }
+
+                // The writer lapped us. Read what is now the latest.
+
+                count = Count();
+            }
+
+            return false;
+        }
+
+        // Copies up to `maxSamples` of the latest samples, oldest first. Returns how many were copied, which is fewer
+        // only if the writer overwrote the oldest of them meanwhile.
+        size_t Copy(T *samples, size_t maxSamples) const
+        {
+            uint64_t count = Count();
+            uint64_t available = count < Capacity ? count : Capacity;
+            uint64_t wanted = available < maxSamples ? available : maxSamples;
+            size_t copied = 0;
+
+            for (uint64_t index = count - wanted; index < count; index++) {
+                if (Read(index, &samples[copied])) {
+                    copied++;
+                }
+            }
+
+            return copied;
+        }
+
+    private:
+        static const size_t kWords = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+        struct Slot
+        {
+            std::atomic<uint32_t> sequence;
+            std::atomic<uint64_t> index;
+            std::atomic<uint64_t> words[kWords];
+        };
+
+        // Returns false if the sample at `index` has been overwritten.
+        bool Read(uint64_t index, T *sample) const
+        {
+            const Slot &slot = _slots[index % Capacity];
+            uint64_t words[kWords];
+
+            for (;;) {
+                uint32_t before = slot.sequence.load(std::memory_order_acquire);
+
+                if (before & 1) {
+                    continue;
+                }
+
+                uint64_t slotIndex = slot.index.load(std::memory_order_relaxed);
+
+                for (size_t i = 0; i < kWords; i++) {
+                    words[i] = slot.words[i].load(std::memory_order_relaxed);
+                }
+
+                std::atomic_thread_fence(std::memory_order_acquire);
+
+                if (slot.sequence.load(std::memory_order_relaxed) != before) {
+                    continue;
+                }
+                if (slotIndex != index) {
+                    return false;
+                }
+
+                memcpy(sample, words, sizeof(T));
+                return true;
+            }
+        }
+
+        Slot _slots[Capacity];
+        std::atomic<uint64_t> _count;
+
+        StatsSeries(const StatsSeries &) = delete;
+        StatsSeries &operator=(const StatsSeries &) = delete;
+    };
+
+    /**
+     *  A connection's stats over time. Record is called by one thread at a time, readers may be on any thread.
+     *
+     *  Each SSRC gets its own series, in one of a fixed number of slots. When they are all taken, a new SSRC takes
+     *  the slot which has gone longest without a sample.
+     */
+    class ConnectionStats
+    {
+    public:
+        static const size_t kMaxStreams = 8;
+        static const size_t kSeriesCapacity = 64;
+
+        ConnectionStats();
+
+        // Computes the snapshot's rates from the previous samples, and appends it.
+        void Record(const StatsSnapshot &snapshot);
+
+        bool LatestStream(uint32_t ssrc, StreamStats *stats) const;
+        // Copies up to `maxSamples` of an SSRC's latest samples, oldest first.
+        size_t StreamHistory(uint32_t ssrc, StreamStats *samples, size_t maxSamples) const;
+        // The latest sample of every stream with the given media and direction. Returns how many were copied.
+        size_t LatestStreams(StatsMedia media, StatsDirection direction, StreamStats *stats, size_t maxStreams) const;
+
+        bool LatestBandwidth(BandwidthStats *stats) const { return _bandwidth.Latest(stats); }
+
+    private:
+        struct StreamSlot
+        {
+            StreamSlot() : ssrc(0), lastTimestampMs(0) {}
+
+            std::atomic<uint32_t> ssrc;
+            StatsSeries<StreamStats, kSeriesCapacity> series;
+
+            // Only touched by the writer.
+            int64_t lastTimestampMs;
+            StreamStats previous;
+        };
+
+        StreamSlot *SlotForWriting(uint32_t ssrc);
+        const StreamSlot *SlotForReading(uint32_t ssrc) const;
+
+        StreamSlot _streams[kMaxStreams];
+        StatsSeries<BandwidthStats, kSeriesCapacity> _bandwidth;
+
+        ConnectionStats(const ConnectionStats &);
+        ConnectionStats &operator=(const ConnectionStats &);
+    };
+
+} // namespace perch
+
+#endif
@@ -0,0 +1,177 @@
+//
+//  PHIceCandidate.cpp
+//  PerchRTC
+//
+//  Created by Christopher Eagleston on 2015-08-06.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#include "PHIceCandidate.h"
+
+namespace perch {
+
+    namespace {
+
+        const uint32_t kIceMaxPort = 65535;
+        const size_t kIceMaxFoundationLength = 32;
+
+        inline bool IsSeparator(char c)
+        {
+            return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+        }
+
+        // Takes the next space separated word from `rest`. Returns false at the end.
+        bool NextWord(SdpToken *rest, SdpToken *word)
+        {
+            const char *cursor = rest->data;
+            const char *end = rest->data + rest->size;
+
+            while (cursor < end && IsSeparator(*cursor)) {
+                cursor++;
+            }
+
+            const char *start = cursor;
+
+            while (cursor < end && !IsSeparator(*cursor)) {
+                cursor++;
+            }
+
+            *word = SdpToken(start, cursor - start);
+            *rest = SdpToken(cursor, end - cursor);
+
+            return !word->Empty();
+        }
+
+        // ice-char: ALPHA / DIGIT / "+" / "/"
+        bool IsFoundation(SdpToken token)
+        {
+            if (token.Empty() || token.size > kIceMaxFoundationLength) {
+                return false;
+            }
+
+            for (size_t i = 0; i < token.size; i++) {
+                char c = token.data[i];
+                bool isIceChar = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '+' || c == '/';
+
+                if (!isIceChar) {
+                    return false;
+                }
+            }
+
+            return true;
+        }
+
+        bool ToPort(SdpToken token, uint32_t *port)
+        {
+            uint32_t value = 0;
+
+            if (!token.ToUInt(&value) || value > kIceMaxPort) {
+                return false;
+            }
+
+            *port = value;
+            return true;
+        }
+
+        IceTransport TransportForToken(SdpToken token)
+        {
+            // Firefox writes "UDP" and "TCP".
+
+            if (token.EqualsIgnoringCase("udp")) {
+                return IceTransportUDP;
+            }
+            if (token.EqualsIgnoringCase("tcp")) {
+                return IceTransportTCP;
+            }
+
+            return IceTransportUnknown;
+        }
+
+        IceCandidateType TypeForToken(SdpToken token)
+        {
+            switch (token.size) {
+                case 4:
+                    return token.Equals("host") ? IceCandidateTypeHost : IceCandidateTypeUnknown;
+                case 5:
+                    if (token.Equals("srflx")) {
+                        return IceCandidateTypeServerReflexive;
+                    }
+                    if (token.Equals("prflx")) {
+                        return IceCandidateTypePeerReflexive;
+                    }
+                    return token.Equals("relay") ? IceCandidateTypeRelay : IceCandidateTypeUnknown;
+                default:
+                    return IceCandidateTypeUnknown;
+            }
+        }
+
+        IceTcpType TcpTypeForToken(SdpToken token)
+        {
+            if (token.Equals("active")) {
+                return IceTcpTypeActive;
+            }
+            if (token.Equals("passive")) {
+                return IceTcpTypePassive;
+            }
+
+            return token.Equals("so") ? IceTcpTypeSimultaneousOpen : IceTcpTypeNone;
+        }
+
+    } // namespace
+
+    bool ParseIceCandidate(SdpToken text, IceCandidateAttribute *candidate)
+    {
+        SdpToken rest = text.Trimmed();
+
+        if (rest.StartsWith("a=")) {
+            rest = SdpToken(rest.data + 2, rest.size - 2);
+        }
+        if (rest.StartsWith("candidate:")) {
+            rest = SdpToken(rest.data + 10, rest.size - 10);
+        }
+
+        IceCandidateAttribute parsed;
+        SdpToken foundation, component, transport, priority, address, port, typ, type;
+
+        bool hasFields = NextWord(&rest, &foundation) && NextWord(&rest, &component) && NextWord(&rest, &transport) &&
+                         NextWord(&rest, &priority) && NextWord(&rest, &address) && NextWord(&rest, &port) &&
+                         NextWord(&rest, &typ) && NextWord(&rest, &type);
+
+        if (!hasFields || !IsFoundation(foundation) || !component.ToUInt(&parsed.component) || parsed.component == 0 ||
+            !priority.ToUInt(&parsed.priority) || !ToPort(port, &parsed.port) || !typ.Equals("typ")) {
+            return false;
+        }
+
+        parsed.foundation = foundation;
+        parsed.transport = TransportForToken(transport);
+        parsed.address = address;
+        parsed.type = TypeForToken(type);
+
+        // Extensions come in name value pairs. Those we don't know are skipped, as is a name without a value.
+
+        SdpToken name, value;
+
+        while (NextWord(&rest, &name) && NextWord(&rest, &value)) {
+            if (name.Equals("raddr")) {
+                parsed.relatedAddress = value;
+            }
+            else if (name.Equals("rport")) {
+                ToPort(value, &parsed.relatedPort);
+            }
+            else if (name.Equals("tcptype")) {
+                parsed.tcpType = TcpTypeForToken(value);
+            }
+            else if (name.Equals("ufrag")) {
+                parsed.ufrag = value;
+            }
+            else if (name.Equals("generation")) {
+                value.ToUInt(&parsed.generation);
+            }
+        }
+
+        *candidate = parsed;
+
+        return true;
+    }
+
+} // namespace perch
@@ -0,0 +1,81 @@
+//
+//  PHIceCandidate.h
+//  PerchRTC
+//
+//  Created by Christopher Eagleston on 2015-08-06.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#ifndef PerchRTC_PHIceCandidate_h
+#define PerchRTC_PHIceCandidate_h
+
+#include "PHSdp.h"
+
+namespace perch {
+
+    enum IceCandidateType
+    {
+        // An extension type we don't know.
+        IceCandidateTypeUnknown = 0,
+        IceCandidateTypeHost,
+        IceCandidateTypeServerReflexive,
+        IceCandidateTypePeerReflexive,
+        IceCandidateTypeRelay
+    };
+
+    enum IceTransport
+    {
+        IceTransportUnknown = 0,
+        IceTransportUDP,
+        IceTransportTCP
+    };
+
+    enum IceTcpType
+    {
+        IceTcpTypeNone = 0,
+        IceTcpTypeActive,
+        IceTcpTypePassive,
+        IceTcpTypeSimultaneousOpen
+    };
+
+    /**
+     *  The fields of a candidate attribute (RFC 5245 section 15.1):
+     *
+     *  candidate:<foundation> <component> <transport> <priority> <address> <port> typ <type>
+     *            [raddr <address>] [rport <port>] *(<extension name> <extension value>)
+     *
+     *  Tokens point into the parsed text.
+     */
+    struct IceCandidateAttribute
+    {
+        IceCandidateAttribute()
+        : component(0), transport(IceTransportUnknown), priority(0), port(0), type(IceCandidateTypeUnknown),
+          tcpType(IceTcpTypeNone), relatedPort(0), generation(0)
+        {}
+
+        SdpToken foundation;
+        uint32_t component;
+        IceTransport transport;
+        uint32_t priority;
+        SdpToken address;
+        uint32_t port;
+        IceCandidateType type;
+
+        // Extensions. Those which weren't given are empty, or 0.
+        IceTcpType tcpType;
+        SdpToken relatedAddress;
+        uint32_t relatedPort;
+        SdpToken ufrag;
+        uint32_t generation;
+    };
+
+    /**
+     *  Parses a candidate, given as "a=candidate:...", "candidate:...", or as the value of an SdpLine's candidate
+     *  attribute. Returns false if the mandatory fields are missing or malformed. Unknown transports, types and
+     *  extensions are allowed, as the RFC requires.
+     */
+    bool ParseIceCandidate(SdpToken text, IceCandidateAttribute *candidate);
+
+} // namespace perch
+
+#endif
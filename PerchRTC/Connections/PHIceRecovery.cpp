@@ -0,0 +1,250 @@
+//
+//  PHIceRecovery.cpp
+//  PerchRTC
+//
+//  Created by Christopher Eagleston on 2015-08-11.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#include "PHIceRecovery.h"
+
+#include <algorithm>
+
+namespace perch {
+
+    const int64_t IceRecovery::kNoTime;
+
+    IceRecovery::IceRecovery(IceRecoveryConfig config, uint32_t seed)
+    : _config(config), _random(seed ? seed : 1), _isSignalingAvailable(true)
+    {}
+
+    int64_t IceRecovery::OnIceState(const std::string &key, bool isInitiator, IceConnectionState state, int64_t nowMs)
+    {
+        if (state == IceConnectionStateClosed) {
+            Remove(key);
+            return kNoTime;
+        }
+
+        Connection &connection = _connections[key];
+        connection.isInitiator = isInitiator;
+        connection.isIceConnected = state == IceConnectionStateConnected || state == IceConnectionStateCompleted;
+
+        switch (state) {
+            case IceConnectionStateConnected:
+            case IceConnectionStateCompleted:
+                // A stalled pair can stay connected, or reconnect without media. Wait for the media.
+
+                if (!connection.awaitsMedia) {
+                    return Recover(&connection, nowMs);
+                }
+                break;
+            case IceConnectionStateDisconnected:
+                // A restart in progress already has a deadline.
+
+                if (connection.phase == PhaseConnected) {
+                    Lose(&connection, nowMs);
+                }
+                break;
+            case IceConnectionStateFailed:
+                if (connection.phase == PhaseConnected) {
+                    Lose(&connection, nowMs);
+                }
+
+                // There's nothing left to wait for. The initiator, or a receiver which has taken over, tries again.
+
+                if (connection.phase != PhaseGaveUp && (connection.isInitiator || connection.phase == PhaseRestarting)) {
+                    int64_t earliestMs = connection.lastRestartMs != kNoTime ? connection.lastRestartMs + _config.minRestartIntervalMs : nowMs;
+                    int64_t retryMs = std::max(nowMs, earliestMs);
+
+                    if (connection.dueMs == kNoTime || retryMs < connection.dueMs) {
+                        connection.dueMs = retryMs;
+                    }
+                }
+                break;
+            case IceConnectionStateNew:
+            case IceConnectionStateChecking:
+            case IceConnectionStateClosed:
+                break;
+        }
+
+        return kNoTime;
+    }
+
+    int64_t IceRecovery::OnMediaReceived(const std::string &key, bool isReceiving, int64_t sinceMs, int64_t nowMs)
+    {
+        std::map<std::string, Connection>::iterator it = _connections.find(key);
+
+        if (it == _connections.end() || !it->second.isIceConnected) {
+            return kNoTime;
+        }
+
+        Connection &connection = it->second;
+
+        if (isReceiving) {
+            connection.stalledMs = kNoTime;
+
+            // Media which may have arrived before the connection was lost doesn't count.
+
+            bool isRecovered = connection.phase != PhaseConnected && connection.phase != PhaseGaveUp && sinceMs >= connection.lostMs;
+
+            return isRecovered ? Recover(&connection, nowMs) : kNoTime;
+        }
+
+        if (connection.phase != PhaseConnected) {
+            return kNoTime;
+        }
+
+        if (connection.stalledMs == kNoTime) {
+            connection.stalledMs = nowMs;
+        }
+        else if (nowMs - connection.stalledMs >= _config.stallMs) {
+            Lose(&connection, connection.stalledMs);
+            connection.awaitsMedia = true;
+        }
+
+        return kNoTime;
+    }
+
+    void IceRecovery::OnNetworkChange(int64_t nowMs)
+    {
+        for (std::map<std::string, Connection>::iterator it = _connections.begin(); it != _connections.end(); ++it) {
+            Connection &connection = it->second;
+
+            if (connection.phase == PhaseGaveUp) {
+                continue;
+            }
+
+            if (connection.phase == PhaseConnected) {
+                Lose(&connection, nowMs);
+            }
+
+            // The old path may stay connected for a while, so wait for media to arrive over the new one.
+
+            connection.awaitsMedia = true;
+            connection.dueMs = nowMs;
+        }
+    }
+
+    void IceRecovery::OnRemoteOffer(const std::string &key, int64_t nowMs)
+    {
+        std::map<std::string, Connection>::iterator it = _connections.find(key);
+
+        if (it == _connections.end() || it->second.phase == PhaseConnected || it->second.phase == PhaseGaveUp) {
+            return;
+        }
+
+        // The peer is restarting. Give its restart as long to work as one of our own.
+
+        Connection &connection = it->second;
+        connection.phase = PhaseRestarting;
+        connection.dueMs = nowMs + BackoffMs(std::max(connection.restarts, 1));
+    }
+
+    void IceRecovery::SetSignalingAvailable(bool isAvailable)
+    {
+        _isSignalingAvailable = isAvailable;
+    }
+
+    void IceRecovery::Poll(int64_t nowMs, std::vector<IceRecoveryAction> *actions)
+    {
+        if (!_isSignalingAvailable) {
+            return;
+        }
+
+        for (std::map<std::string, Connection>::iterator it = _connections.begin(); it != _connections.end(); ++it) {
+            Connection &connection = it->second;
+
+            if (connection.dueMs == kNoTime || connection.dueMs > nowMs) {
+                continue;
+            }
+
+            if (connection.restarts >= _config.maxRestarts) {
+                connection.phase = PhaseGaveUp;
+                connection.dueMs = kNoTime;
+                _metrics.failures++;
+
+                actions->push_back(IceRecoveryAction(it->first, IceRecoveryActionGiveUp));
+                continue;
+            }
+
+            connection.restarts++;
+            connection.phase = PhaseRestarting;
+            connection.lastRestartMs = nowMs;
+            connection.dueMs = nowMs + BackoffMs(connection.restarts);
+            _metrics.restarts++;
+
+            actions->push_back(IceRecoveryAction(it->first, IceRecoveryActionRestart));
+        }
+    }
+
+    int64_t IceRecovery::NextDueMs() const
+    {
+        int64_t next = kNoTime;
+
+        if (!_isSignalingAvailable) {
+            return next;
+        }
+
+        for (std::map<std::string, Connection>::const_iterator it = _connections.begin(); it != _connections.end(); ++it) {
+            int64_t dueMs = it->second.dueMs;
+
+            if (dueMs != kNoTime && (next == kNoTime || dueMs < next)) {
+                next = dueMs;
+            }
+        }
+
+        return next;
+    }
+
+    void IceRecovery::Lose(Connection *connection, int64_t lostMs)
+    {
+        _metrics.disconnections++;
+
+        connection->phase = PhaseDisconnected;
+        connection->lostMs = lostMs;
+        connection->stalledMs = kNoTime;
+        connection->dueMs = lostMs + _config.disconnectGraceMs + (connection->isInitiator ? 0 : _config.receiverTakeoverMs);
+    }
+
+    int64_t IceRecovery::Recover(Connection *connection, int64_t nowMs)
+    {
+        int64_t lostForMs = connection->lostMs != kNoTime ? nowMs - connection->lostMs : kNoTime;
+
+        if (lostForMs != kNoTime) {
+            _metrics.recoveries++;
+            _metrics.totalRecoveryMs += lostForMs;
+            _metrics.maxRecoveryMs = std::max(_metrics.maxRecoveryMs, lostForMs);
+        }
+
+        connection->phase = PhaseConnected;
+        connection->awaitsMedia = false;
+        connection->restarts = 0;
+        connection->lostMs = kNoTime;
+        connection->stalledMs = kNoTime;
+        connection->dueMs = kNoTime;
+
+        return lostForMs;
+    }
+
+    int64_t IceRecovery::BackoffMs(int restarts)
+    {
+        int64_t backoffMs = _config.initialBackoffMs;
+
+        for (int i = 1; i < restarts && backoffMs < _config.maxBackoffMs; i++) {
+            backoffMs *= 2;
+        }
+
+        backoffMs = std::min(backoffMs, _config.maxBackoffMs);
+
+        // xorshift32, so a seed replays the same way.
+
+        _random ^= _random << 13;
+        _random ^= _random >> 17;
+        _random ^= _random << 5;
+
+        double spread = (_random / 4294967295.0) * 2 - 1;
+
+        return (int64_t)(backoffMs * (1 + _config.jitter * spread));
+    }
+
+} // namespace perch
@@ -0,0 +1,173 @@
+//
+//  PHIceRecovery.h
+//  PerchRTC
+//
+//  Created by Christopher Eagleston on 2015-08-11.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#ifndef PerchRTC_PHIceRecovery_h
+#define PerchRTC_PHIceRecovery_h
+
+#include <map>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace perch {
+
+    // Mirrors RTCICEConnectionState.
+    enum IceConnectionState
+    {
+        IceConnectionStateNew = 0,
+        IceConnectionStateChecking,
+        IceConnectionStateConnected,
+        IceConnectionStateCompleted,
+        IceConnectionStateFailed,
+        IceConnectionStateDisconnected,
+        IceConnectionStateClosed
+    };
+
+    struct IceRecoveryConfig
+    {
+        IceRecoveryConfig()
+        : disconnectGraceMs(1500), receiverTakeoverMs(6000), stallMs(4000), initialBackoffMs(2000), maxBackoffMs(16000),
+          jitter(0.2), maxRestarts(3), minRestartIntervalMs(1000)
+        {}
+
+        // Disconnections often clear up by themselves. The initiator restarts once one has lasted this long.
+        int64_t disconnectGraceMs;
+        // The receiver leaves restarting to the initiator, and only restarts itself when this much longer has passed.
+        int64_t receiverTakeoverMs;
+        // ICE only notices a dead candidate pair once its consent checks time out. A connected pair which has received
+        // nothing for this long is treated as disconnected.
+        int64_t stallMs;
+        // How long a restart has to reconnect before the next one. Doubles with each restart.
+        int64_t initialBackoffMs;
+        int64_t maxBackoffMs;
+        // Backoffs are randomly spread by this fraction either way, so peers don't act in lockstep.
+        double jitter;
+        // Restarts before giving up on a connection.
+        int maxRestarts;
+        // A restart which fails outright is retried, but no sooner than this.
+        int64_t minRestartIntervalMs;
+    };
+
+    enum IceRecoveryActionType
+    {
+        IceRecoveryActionRestart,
+        IceRecoveryActionGiveUp
+    };
+
+    struct IceRecoveryAction
+    {
+        IceRecoveryAction(const std::string &actionKey, IceRecoveryActionType actionType) : key(actionKey), type(actionType) {}
+
+        std::string key;
+        IceRecoveryActionType type;
+    };
+
+    struct IceRecoveryMetrics
+    {
+        IceRecoveryMetrics() : disconnections(0), recoveries(0), restarts(0), failures(0), totalRecoveryMs(0), maxRecoveryMs(0) {}
+
+        double MeanRecoveryMs() const { return recoveries ? (double)totalRecoveryMs / recoveries : 0; }
+
+        uint64_t disconnections;
+        uint64_t recoveries;
+        uint64_t restarts;
+        // Connections given up on.
+        uint64_t failures;
+        // From losing the connection to having it back.
+        int64_t totalRecoveryMs;
+        int64_t maxRecoveryMs;
+    };
+
+    /**
+     *  Decides when to restart ICE on connections which have lost connectivity, rather than leaving media frozen until
+     *  WebRTC declares the connection failed.
+     *
+     *  A disconnected initiator restarts after a short grace period. If that doesn't reconnect in time it restarts
+     *  again, backing off exponentially with jitter, and gives up after maxRestarts. To avoid both sides offering at
+     *  once, the receiver waits for the initiator's restart, and only takes over if none arrives. Nothing is restarted
+     *  while signaling is unavailable, since the offer couldn't be delivered.
+     *
+     *  A connection is also lost when its candidate pair stops receiving media, which is often well before ICE notices.
+     *  It is recovered once media flows again, rather than when ICE reconnects, since ICE may never have disconnected.
+     *  The same goes for every connection when the local network changes, since their candidate pairs are on the old one.
+     *
+     *  Time is passed in, so that a simulated clock can drive it.
+     */
+    class IceRecovery
+    {
+    public:
+        static const int64_t kNoTime = -1;
+
+        explicit IceRecovery(IceRecoveryConfig config = IceRecoveryConfig(), uint32_t seed = 1);
+
+        // Returns how long the connection was lost for, if this state recovered it. Otherwise kNoTime.
+        int64_t OnIceState(const std::string &key, bool isInitiator, IceConnectionState state, int64_t nowMs);
+
+        // Whether the connection received any media between sinceMs and nowMs. Returns as OnIceState does.
+        int64_t OnMediaReceived(const std::string &key, bool isReceiving, int64_t sinceMs, int64_t nowMs);
+
+        // The local network changed. Every connection is restarted as soon as signaling allows, whatever its role.
+        void OnNetworkChange(int64_t nowMs);
+
+        // The peer sent an offer, which may restart ICE on its own.
+        void OnRemoteOffer(const std::string &key, int64_t nowMs);
+
+        void SetSignalingAvailable(bool isAvailable);
+
+        // Moves the actions which are due into `actions`.
+        void Poll(int64_t nowMs, std::vector<IceRecoveryAction> *actions);
+
+        // When Poll next has something to do, or kNoTime.
+        int64_t NextDueMs() const;
+
+        void Remove(const std::string &key) { _connections.erase(key); }
+
+        const IceRecoveryMetrics &Metrics() const { return _metrics; }
+
+    private:
+        enum Phase
+        {
+            PhaseConnected,
+            PhaseDisconnected,
+            PhaseRestarting,
+            PhaseGaveUp
+        };
+
+        struct Connection
+        {
+            Connection()
+            : isInitiator(true), isIceConnected(false), awaitsMedia(false), phase(PhaseConnected), restarts(0),
+              lostMs(kNoTime), stalledMs(kNoTime), dueMs(kNoTime), lastRestartMs(kNoTime)
+            {}
+
+            bool isInitiator;
+            bool isIceConnected;
+            // Lost to a stall or a network change, rather than to ICE. Only media recovers it.
+            bool awaitsMedia;
+            Phase phase;
+            int restarts;
+            int64_t lostMs;
+            int64_t stalledMs;
+            int64_t dueMs;
+            int64_t lastRestartMs;
+        };
+
+        void Lose(Connection *connection, int64_t lostMs);
+        int64_t Recover(Connection *connection, int64_t nowMs);
+        int64_t BackoffMs(int restarts);
+
+        IceRecoveryConfig _config;
+        uint32_t _random;
+        bool _isSignalingAvailable;
+        std::map<std::string, Connection> _connections;
+        IceRecoveryMetrics _metrics;
+    };
+
+} // namespace perch
+
+#endif
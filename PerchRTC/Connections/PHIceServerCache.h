@@ -0,0 +1,56 @@
+//
+//  PHIceServerCache.h
+//  PerchRTC
+//
+//  Created by Christopher Eagleston on 2015-08-07.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+typedef void (^PHIceServersCompletion)(NSArray *iceServers, NSError *error);
+
+/**
+ *  Fetches ICE servers, and calls `completion` with RTCICEServers. Returns the task, so that it may be cancelled.
+ */
+typedef NSURLSessionDataTask *(^PHIceServersFetch)(PHIceServersCompletion completion);
+
+/**
+ *  Caches the ICE servers (and TURN credentials) for a room, so that only the first peer connection waits for them.
+ *  Credentials are kept until they expire, and are refreshed in the background once they near expiry. Requests made
+ *  while a fetch is in flight wait for that fetch, instead of starting another.
+ *
+ *  Credentials following the TURN REST convention ("<expiry timestamp>:<user>") expire when they say they do. Others
+ *  are kept for `defaultLifetime`.
+ */
+@interface PHIceServerCache : NSObject
+
+- (instancetype)initWithFetch:(PHIceServersFetch)fetch;
+
+/* How long to keep credentials which don't say when they expire. Defaults to 5 minutes. */
+@property (nonatomic, assign) NSTimeInterval defaultLifetime;
+
+/* Refresh once this fraction of the credentials' lifetime remains. Defaults to 0.25. */
+@property (nonatomic, assign) double refreshFraction;
+
+/* Cached servers which haven't expired, or nil. */
+@property (nonatomic, strong, readonly) NSArray *iceServers;
+
+@property (nonatomic, assign, readonly, getter = isFetching) BOOL fetching;
+
+/**
+ *  Calls `completion` on the main queue. At once with cached servers if there are any, otherwise once a fetch completes.
+ */
+- (void)fetchIceServers:(PHIceServersCompletion)completion;
+
+/**
+ *  Fetches ahead of need, if there are no servers cached or they are nearing expiry.
+ */
+- (void)prefetch;
+
+/**
+ *  Cancels any fetch, and forgets the cached servers. Waiting completions are not called.
+ */
+- (void)invalidate;
+
+@end
@@ -0,0 +1,213 @@
+//
+//  PHIceServerCache.m
+//  PerchRTC
+//
+//  Created by Christopher Eagleston on 2015-08-07.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#import "PHIceServerCache.h"
+
+#import "RTCICEServer.h"
+
+static NSTimeInterval PHIceServerCacheDefaultLifetime = 5 * 60;
+static double PHIceServerCacheDefaultRefreshFraction = 0.25;
+
+@interface PHIceServerCache()
+
+@property (nonatomic, copy) PHIceServersFetch fetch;
+@property (nonatomic, strong) NSURLSessionDataTask *fetchTask;
+@property (nonatomic, strong) NSMutableArray *waitingCompletions;
+@property (nonatomic, strong) NSArray *cachedServers;
+@property (nonatomic, strong) NSDate *fetchDate;
+@property (nonatomic, strong) NSDate *expiryDate;
+// Results from fetches started before an invalidate are ignored.
+@property (nonatomic, assign) NSUInteger generation;
+
+@end
+
+@implementation PHIceServerCache
+
+#pragma mark - Init & Dealloc
+
+- (instancetype)initWithFetch:(PHIceServersFetch)fetch
+{
+    NSParameterAssert(fetch);
+
+    self = [super init];
+
+    if (self) {
+        _fetch = [fetch copy];
+        _waitingCompletions = [NSMutableArray array];
+        _defaultLifetime = PHIceServerCacheDefaultLifetime;
+        _refreshFraction = PHIceServerCacheDefaultRefreshFraction;
+    }
+
+    return self;
+}
+
+- (void)dealloc
+{
+    [_fetchTask cancel];
+}
+
+#pragma mark - Properties
+
+- (NSArray *)iceServers
+{
+    BOOL isExpired = !self.expiryDate || [self.expiryDate timeIntervalSinceNow] <= 0;
+
+    return isExpired ? nil : self.cachedServers;
+}
+
+- (BOOL)isFetching
+{
+    return self.fetchTask != nil;
+}
+
+#pragma mark - Public
+
+- (void)fetchIceServers:(PHIceServersCompletion)completion
+{
+    NSParameterAssert(completion);
+
+    NSArray *servers = self.iceServers;
+
+    if (servers) {
+        completion(servers, nil);
+        [self prefetch];
+        return;
+    }
+
+    [self.waitingCompletions addObject:[completion copy]];
+
+    [self startFetch];
+}
+
+- (void)prefetch
+{
+    if ([self shouldRefresh]) {
+        [self startFetch];
+    }
+}
+
+- (void)invalidate
+{
+    [self.fetchTask cancel];
+    self.fetchTask = nil;
+
+    [self.waitingCompletions removeAllObjects];
+
+    self.cachedServers = nil;
+    self.fetchDate = nil;
+    self.expiryDate = nil;
+    self.generation++;
+}
+
+#pragma mark - Private
+
+- (BOOL)shouldRefresh
+{
+    if (!self.iceServers) {
+        return YES;
+    }
+
+    NSTimeInterval lifetime = [self.expiryDate timeIntervalSinceDate:self.fetchDate];
+    NSTimeInterval remaining = [self.expiryDate timeIntervalSinceNow];
+
+    return remaining <= lifetime * self.refreshFraction;
+}
+
+- (void)startFetch
+{
+    if (self.fetchTask) {
+        DDLogVerbose(@"Not fetching ICE servers, a request is already in progress.");
+        return;
+    }
+
+    DDLogVerbose(@"Fetching ICE servers.");
+
+    NSUInteger generation = self.generation;
+    __weak PHIceServerCache *weakSelf = self;
+
+    self.fetchTask = self.fetch(^(NSArray *iceServers, NSError *error) {
+        dispatch_async(dispatch_get_main_queue(), ^{
+            PHIceServerCache *strongSelf = weakSelf;
+
+            if (strongSelf.generation == generation) {
+                [strongSelf finishFetchWithServers:iceServers error:error];
+            }
+        });
+    });
+}
+
+- (void)finishFetchWithServers:(NSArray *)iceServers error:(NSError *)error
+{
+    self.fetchTask = nil;
+
+    if (!error) {
+        NSDate *now = [NSDate date];
+
+        self.cachedServers = iceServers;
+        self.fetchDate = now;
+        self.expiryDate = [self expiryDateForServers:iceServers fetchDate:now];
+
+        DDLogVerbose(@"Cached %lu ICE servers until: %@", (unsigned long)[iceServers count], self.expiryDate);
+    }
+    else {
+        DDLogWarn(@"Failed to fetch ICE servers: %@", error);
+    }
+
+    // A failed refresh leaves servers which haven't expired yet in use.
+
+    NSArray *servers = error ? self.iceServers : iceServers;
+    NSArray *completions = [self.waitingCompletions copy];
+    [self.waitingCompletions removeAllObjects];
+
+    for (PHIceServersCompletion completion in completions) {
+        completion(servers, servers ? nil : error);
+    }
+}
+
+- (NSDate *)expiryDateForServers:(NSArray *)iceServers fetchDate:(NSDate *)fetchDate
+{
+    NSDate *expiryDate = [fetchDate dateByAddingTimeInterval:self.defaultLifetime];
+    NSDate *earliestExpiry = nil;
+
+    for (RTCICEServer *server in iceServers) {
+        NSDate *serverExpiry = [[self class] expiryDateForUsername:server.username];
+
+        // Ignore timestamps in the past. The server's clock and ours may disagree, but the credentials are new.
+
+        if ([serverExpiry compare:fetchDate] != NSOrderedDescending) {
+            continue;
+        }
+
+        if (!earliestExpiry || [serverExpiry compare:earliestExpiry] == NSOrderedAscending) {
+            earliestExpiry = serverExpiry;
+        }
+    }
+
+    return earliestExpiry ?: expiryDate;
+}
+
+// TURN REST usernames are "<unix expiry timestamp>:<user>".
++ (NSDate *)expiryDateForUsername:(NSString *)username
+{
+    NSRange separator = [username rangeOfString:@":"];
+
+    if (separator.location == NSNotFound || separator.location == 0) {
+        return nil;
+    }
+
+    NSString *timestamp = [username substringToIndex:separator.location];
+    NSCharacterSet *nonDigits = [[NSCharacterSet decimalDigitCharacterSet] invertedSet];
+
+    if ([timestamp rangeOfCharacterFromSet:nonDigits].location != NSNotFound) {
+        return nil;
+    }
+
+    return [NSDate dateWithTimeIntervalSince1970:[timestamp doubleValue]];
+}
+
+@end
@@ -0,0 +1,152 @@
+//
+//  PHIceTrickle.cpp
+//  PerchRTC
+//
+//  Created by Christopher Eagleston on 2015-08-05.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#include "PHIceTrickle.h"
+
+#include "PHIceCandidate.h"
+
+#include <algorithm>
+#include <stdio.h>
+
+namespace perch {
+
+    namespace {
+
+        // Two candidates with the same transport address, for the same component of the same media, are the same
+        // candidate (RFC 5245 section 4.1.3). Foundations and priorities may differ between signalings of it.
+        std::string CandidateIdentity(const IceCandidate &candidate)
+        {
+            IceCandidateAttribute attribute;
+            std::string identity = candidate.mid;
+
+            identity += '\n';
+
+            if (!ParseIceCandidate(SdpToken(candidate.sdp.data(), candidate.sdp.size()), &attribute)) {
+                identity += candidate.sdp;
+                return identity;
+            }
+
+            char fields[32];
+            int length = snprintf(fields, sizeof(fields), "%u %d %u ", attribute.component, (int)attribute.transport, attribute.port);
+
+            identity.append(fields, length > 0 ? length : 0);
+            identity.append(attribute.address.data, attribute.address.size);
+            identity += ' ';
+            identity.append(attribute.ufrag.data, attribute.ufrag.size);
+
+            return identity;
+        }
+
+        uint32_t CandidatePriority(const IceCandidate &candidate)
+        {
+            IceCandidateAttribute attribute;
+            return ParseIceCandidate(SdpToken(candidate.sdp.data(), candidate.sdp.size()), &attribute) ? attribute.priority : 0;
+        }
+
+        bool IsHigherPriority(const std::pair<uint32_t, size_t> &a, const std::pair<uint32_t, size_t> &b)
+        {
+            return a.first > b.first;
+        }
+
+    } // namespace
+
+    // IceCandidateBatcher
+
+    const int64_t IceCandidateBatcher::kNoTime;
+
+    IceCandidateBatcher::IceCandidateBatcher(int64_t windowMs, size_t maxBatchSize)
+    : _windowMs(windowMs), _maxBatchSize(std::max<size_t>(maxBatchSize, 1))
+    {
+    }
+
+    void IceCandidateBatcher::Add(const std::string &key, const IceCandidate &candidate, int64_t nowMs)
+    {
+        std::map<std::string, PendingBatch>::iterator it = _pending.find(key);
+
+        if (it == _pending.end()) {
+            PendingBatch batch;
+            batch.dueMs = nowMs + _windowMs;
+            it = _pending.insert(std::make_pair(key, batch)).first;
+        }
+
+        PendingBatch &batch = it->second;
+        batch.candidates.push_back(candidate);
+
+        if (batch.candidates.size() >= _maxBatchSize) {
+            batch.dueMs = std::min(batch.dueMs, nowMs);
+        }
+    }
+
+    void IceCandidateBatcher::Finish(const std::string &key, int64_t nowMs)
+    {
+        std::map<std::string, PendingBatch>::iterator it = _pending.find(key);
+
+        if (it != _pending.end()) {
+            it->second.dueMs = std::min(it->second.dueMs, nowMs);
+        }
+    }
+
+    void IceCandidateBatcher::Remove(const std::string &key)
+    {
+        _pending.erase(key);
+    }
+
+    void IceCandidateBatcher::TakeDue(int64_t nowMs, std::vector<IceCandidateBatch> *batches)
+    {
+        for (std::map<std::string, PendingBatch>::iterator it = _pending.begin(); it != _pending.end();) {
+            if (it->second.dueMs > nowMs) {
+                ++it;
+                continue;
+            }
+
+            // Highest priority first, so the far end can pair and check the best candidates first.
+
+            std::vector<IceCandidate> &pending = it->second.candidates;
+            std::vector<std::pair<uint32_t, size_t> > order(pending.size());
+
+            for (size_t i = 0; i < pending.size(); i++) {
+                order[i] = std::make_pair(CandidatePriority(pending[i]), i);
+            }
+
+            std::stable_sort(order.begin(), order.end(), IsHigherPriority);
+
+            IceCandidateBatch batch;
+            batch.key = it->first;
+            batch.candidates.reserve(pending.size());
+
+            for (size_t i = 0; i < order.size(); i++) {
+                batch.candidates.push_back(pending[order[i].second]);
+            }
+
+            batches->push_back(batch);
+
+            _pending.erase(it++);
+        }
+    }
+
+    int64_t IceCandidateBatcher::NextDueMs() const
+    {
+        int64_t next = kNoTime;
+
+        for (std::map<std::string, PendingBatch>::const_iterator it = _pending.begin(); it != _pending.end(); ++it) {
+            if (next == kNoTime || it->second.dueMs < next) {
+                next = it->second.dueMs;
+            }
+        }
+
+        return next;
+    }
+
+    // IceCandidateFilter
+
+    bool IceCandidateFilter::Accept(const IceCandidate &candidate)
+    {
+        return _seen.insert(CandidateIdentity(candidate)).second;
+    }
+
+} // namespace perch
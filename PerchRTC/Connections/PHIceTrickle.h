@@ -0,0 +1,101 @@
+//
+//  PHIceTrickle.h
+//  PerchRTC
+//
+//  Created by Christopher Eagleston on 2015-08-05.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#ifndef PerchRTC_PHIceTrickle_h
+#define PerchRTC_PHIceTrickle_h
+
+#include <map>
+#include <set>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace perch {
+
+    struct IceCandidate
+    {
+        IceCandidate() : index(0) {}
+        IceCandidate(const std::string &candidateMid, int32_t candidateIndex, const std::string &candidateSdp)
+        : mid(candidateMid), index(candidateIndex), sdp(candidateSdp)
+        {}
+
+        std::string mid;
+        int32_t index;
+        // The candidate attribute, "candidate:...".
+        std::string sdp;
+    };
+
+    struct IceCandidateBatch
+    {
+        // The connection the candidates belong to.
+        std::string key;
+        std::vector<IceCandidate> candidates;
+    };
+
+    /**
+     *  Coalesces trickled candidates per connection. Gathering produces a burst of candidates in the first moments of
+     *  a call, host candidates at once and reflexive ones a STUN round trip later. Rather than signaling each one, a
+     *  connection's candidates are held from the first of them for a short window, or until gathering completes or the
+     *  batch is full, and are then sent together, highest priority first.
+     */
+    class IceCandidateBatcher
+    {
+    public:
+        static const int64_t kNoTime = -1;
+
+        explicit IceCandidateBatcher(int64_t windowMs = 100, size_t maxBatchSize = 20);
+
+        void Add(const std::string &key, const IceCandidate &candidate, int64_t nowMs);
+
+        // Gathering has completed, the connection's batch is due now.
+        void Finish(const std::string &key, int64_t nowMs);
+
+        // Drops anything pending for a connection which has gone away.
+        void Remove(const std::string &key);
+
+        // Moves every batch which is due into `batches`.
+        void TakeDue(int64_t nowMs, std::vector<IceCandidateBatch> *batches);
+
+        // When the next batch is due, or kNoTime if nothing is pending.
+        int64_t NextDueMs() const;
+
+        bool Empty() const { return _pending.empty(); }
+
+    private:
+        struct PendingBatch
+        {
+            int64_t dueMs;
+            std::vector<IceCandidate> candidates;
+        };
+
+        int64_t _windowMs;
+        size_t _maxBatchSize;
+        std::map<std::string, PendingBatch> _pending;
+    };
+
+    /**
+     *  Remembers the candidates received for one connection, so that candidates which arrive twice (a batch resent
+     *  after a reconnect, or the same candidate relayed by a retrying peer) are only added once. Reset when a new ICE
+     *  generation starts.
+     */
+    class IceCandidateFilter
+    {
+    public:
+        // Returns false if the candidate has been seen before.
+        bool Accept(const IceCandidate &candidate);
+
+        void Reset() { _seen.clear(); }
+
+    private:
+        std::set<std::string> _seen;
+    };
+
+} // namespace perch
+
+#endif
@@ -61,7 +61,9 @@ static double PHMediaSessionTargetBpp = 0.00008403125;
  PHIceProtocolAny
  PHAudioCodecOpus
  PHVideoCodecVP8
- 640x480 @ 30 fps, Bi-Planar Full Range 
+ 640x480 @ 30 fps, Bi-Planar Full Range, received and sent
+ Up to 3 send layers, sharing PHMediaSessionMaximumVideoRate
+ Video retransmission and forward error correction enabled
  */
 + (instancetype)defaultConfiguration;
 
@@ -72,5 +74,15 @@ static double PHMediaSessionTargetBpp = 0.00008403125;
 @property (nonatomic, assign) PHVideoCodec preferredVideoCodec;
 @property (nonatomic, assign) NSUInteger maxAudioBitrate;
 @property (nonatomic, assign) PHVideoFormat preferredReceiverFormat;
+/* The largest format we send. Each connection is sent a layer scaled down from it, to suit the peer. */
+@property (nonatomic, assign) PHVideoFormat maxSendFormat;
+/* The number of layers to scale down to, including maxSendFormat itself. */
+@property (nonatomic, assign) NSUInteger sendLayerCount;
+/* The video send budget in kbps, split between the connections. */
+@property (nonatomic, assign) NSUInteger maxVideoSendBitrate;
+/* When disabled, rtx is removed from the video sections of our session descriptions. */
+@property (nonatomic, assign) BOOL videoRetransmissionEnabled;
+/* When disabled, red and ulpfec are removed from the video sections of our session descriptions. */
+@property (nonatomic, assign) BOOL videoForwardErrorCorrectionEnabled;
 
 @end
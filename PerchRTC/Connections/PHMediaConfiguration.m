@@ -27,6 +27,11 @@
     format.pixelFormat = PHPixelFormatYUV420BiPlanarFullRange;
 
     config.preferredReceiverFormat = format;
+    config.maxSendFormat = format;
+    config.sendLayerCount = 3;
+    config.maxVideoSendBitrate = PHMediaSessionMaximumVideoRate;
+    config.videoRetransmissionEnabled = YES;
+    config.videoForwardErrorCorrectionEnabled = YES;
 
     return config;
 }
@@ -42,6 +47,11 @@
     copy.preferredAudioCodec = self.preferredAudioCodec;
     copy.preferredVideoCodec = self.preferredVideoCodec;
     copy.preferredReceiverFormat = self.preferredReceiverFormat;
+    copy.maxSendFormat = self.maxSendFormat;
+    copy.sendLayerCount = self.sendLayerCount;
+    copy.maxVideoSendBitrate = self.maxVideoSendBitrate;
+    copy.videoRetransmissionEnabled = self.videoRetransmissionEnabled;
+    copy.videoForwardErrorCorrectionEnabled = self.videoForwardErrorCorrectionEnabled;
 
     return copy;
 }
@@ -21,6 +21,28 @@
 
 @class PHMediaSession;
 
+typedef struct {
+    /* Connections created for the pool. */
+    NSUInteger created;
+    /* Peers which were given a pooled connection, and those which had to wait for a new one. */
+    NSUInteger hits;
+    NSUInteger misses;
+    /* Pooled connections closed unused, because they were too old or the pool shrank. */
+    NSUInteger discarded;
+} PHConnectionPoolMetrics;
+
+typedef struct {
+    /* Connections which lost connectivity, and those which got it back. */
+    NSUInteger disconnections;
+    NSUInteger recoveries;
+    NSUInteger restarts;
+    /* Connections given up on after restarting as many times as allowed. */
+    NSUInteger failures;
+    /* From losing connectivity to having it back, over the recoveries. */
+    NSTimeInterval meanRecoveryTime;
+    NSTimeInterval maxRecoveryTime;
+} PHIceRecoveryMetrics;
+
 @protocol PHSignalingDelegate <NSObject>
 
 - (void)signalOffer:(RTCSessionDescription *)sdpOffer forConnection:(PHPeerConnection *)connection;
@@ -33,21 +55,57 @@
 
 - (BOOL)session:(PHMediaSession *)session shouldRenegotiateConnectionsWithFormat:(PHVideoFormat)receiverFormat;
 
+@optional
+
+- (void)session:(PHMediaSession *)session connection:(PHPeerConnection *)connection didSelectSendFormat:(PHVideoFormat)sendFormat;
+
+/* Trickled candidates are coalesced per connection. Without this, each candidate in a batch is signaled on its own. */
+- (void)signalICECandidates:(NSArray *)iceCandidates forConnection:(PHPeerConnection *)connection;
+
+/* Pooled connections are created with these servers. Without this, there is no pool. */
+- (void)session:(PHMediaSession *)session needsIceServers:(void (^)(NSArray *iceServers))completion;
+
+/* ICE restarts didn't bring the connection back. Without this, the session closes it. */
+- (void)session:(PHMediaSession *)session didFailToRecoverConnection:(PHPeerConnection *)connection;
+
+/* The time spent encoding each captured frame, summed over every connection's encoder, from the latest stats. */
+- (void)session:(PHMediaSession *)session didMeasureAverageEncodeTime:(NSTimeInterval)encodeTime;
+
 @end
 
 @interface PHMediaSession : NSObject
 
 @property (nonatomic, copy, readonly) PHMediaConfiguration *sessionConfiguration;
 @property (nonatomic, assign, readonly) NSUInteger connectionCount;
+@property (nonatomic, strong, readonly) NSArray *connections;
+/* The largest layer sent to any peer. Capture needs to be at least this big. */
+@property (nonatomic, assign, readonly) PHVideoFormat sendFormat;
 
 @property (nonatomic, weak, readonly) id<PHSignalingDelegate>delegate;
 @property (nonatomic, strong, readonly) RTCMediaStream *localStream;
 
+/**
+ *  How many connections to keep ready for peers we connect to. Pooled connections have the local stream attached, and
+ *  an offer set so that ICE gathering is underway. The offer, and the candidates gathered so far, are signaled once
+ *  connectToPeer: claims one. Defaults to 0.
+ */
+@property (nonatomic, assign) NSUInteger connectionPoolSize;
+@property (nonatomic, assign, readonly) PHConnectionPoolMetrics connectionPoolMetrics;
+
+/**
+ *  Connections which lose connectivity are restarted rather than left to fail, but an ICE restart needs signaling.
+ *  While this is NO, restarts wait. Defaults to YES.
+ */
+@property (nonatomic, assign) BOOL signalingAvailable;
+@property (nonatomic, assign, readonly) PHIceRecoveryMetrics iceRecoveryMetrics;
+
 - (instancetype)initWithDelegate:(id<PHSignalingDelegate>)delegate;
 - (instancetype)initWithDelegate:(id<PHSignalingDelegate>)delegate configuration:(PHMediaConfiguration *)config andCapturer:(PHVideoCaptureKit *)capturer;
 
 - (void)addIceServers:(NSArray *)iceServers singleUse:(BOOL)isSingleUse;
 - (void)addIceCandidate:(RTCICECandidate *)candidate forPeer:(NSString *)peerId connectionId:(NSString *)connectionId;
+/* Candidates which have already been added for the connection's current ICE generation are dropped. */
+- (void)addIceCandidates:(NSArray *)candidates forPeer:(NSString *)peerId connectionId:(NSString *)connectionId;
 - (void)addAnswer:(RTCSessionDescription *)answerSDP forPeer:(NSString *)peerId connectionId:(NSString *)connectionId;
 - (void)addOffer:(RTCSessionDescription *)offerSDP forPeer:(NSString *)peerId connectionId:(NSString *)connectionId;
 
@@ -59,6 +117,8 @@
 - (void)acceptConnectionFromPeer:(NSString *)peerId withId:(NSString *)connectionId offer:(RTCSessionDescription *)offer;
 
 - (void)restartIceWithPeer:(NSString *)peerId;
+/* The local network changed. Every connection is restarted on the new one, once signaling is available. */
+- (void)restartIceForNetworkChange;
 
 - (void)stopLocalMedia;
 
@@ -0,0 +1,1977 @@
+//
+//  PHMediaSession.m
+//  PerchRTC
+//
+//  Created by Christopher Eagleston on 2014-12-16.
+//  Copyright (c) 2014 Perch Communications. All rights reserved.
+//
+
+#import "PHMediaSession.h"
+
+#import "PHAudioSessionController.h"
+#import "PHMediaConfiguration.h"
+#import "PHPeerConnection.h"
+#import "PHSessionDescriptionFactory.h"
+#import "PHVideoPublisher.h"
+
+// WebRTC classes.
+#import "RTCICECandidate.h"
+#import "RTCICEServer.h"
+#import "RTCMediaConstraints.h"
+#import "RTCMediaStream.h"
+#import "RTCPair.h"
+#import "RTCPeerConnection.h"
+#import "RTCPeerConnectionDelegate.h"
+#import "RTCPeerConnectionFactory.h"
+#import "RTCSessionDescription.h"
+#import "RTCSessionDescriptionDelegate.h"
+#import "RTCStatsDelegate.h"
+#import "RTCVideoCapturer.h"
+#import "RTCVideoSource.h"
+#import "RTCVideoTrack.h"
+#import "RTCStatsReport.h"
+#import "RTCMediaStream.h"
+#import "RTCMediaStreamTrack.h"
+
+#include "PHBitrateAllocator.h"
+#include "PHConnectionStats.h"
+#include "PHIceCandidate.h"
+#include "PHIceRecovery.h"
+#include "PHIceTrickle.h"
+#include "PHReceiveQualityController.h"
+#include "PHSimulcast.h"
+
+#include <map>
+#include <memory>
+
+@import AVFoundation;
+
+static BOOL PHMediaSessionLogConnectionStats = NO;
+static NSTimeInterval PHMediaSessionStatsInterval = 2;
+
+// WebRTC's estimate can't go past the cap we gave a connection. Near the cap, probe this far above it.
+static double PHMediaSessionProbeFactor = 1.25;
+
+// Local candidates are held this long from the first of a burst, and then signaled together.
+static int64_t PHMediaSessionIceBatchWindowMs = 100;
+static size_t PHMediaSessionIceBatchMaxSize = 20;
+
+// Each pooled connection holds a TURN allocation, which WebRTC refreshes for as long as the connection lives, so they
+// are kept until the ICE server cache renews the credentials they were made with. Their server reflexive candidates
+// rely on NAT bindings which nothing keeps open, but host and relay candidates carry a call until connectivity checks
+// find a peer reflexive one. This caps how stale those candidates get.
+static NSTimeInterval PHMediaSessionPooledConnectionLifetime = 10 * 60;
+
+// How often the pool checks for renewed credentials. The cache answers from memory until they near expiry.
+static NSTimeInterval PHMediaSessionConnectionPoolMaintenanceInterval = 30;
+
+// The formats we can ask a peer to step down to, each half the size of the one before, starting with the preferred one.
+static NSUInteger PHMediaSessionReceiveLevelCount = 3;
+
+// How many connections the device can encode at the largest send format in real time. Rooms are capped at two
+// remote peers by default for this reason. A layer only caps a connection's bitrate, and every connection still
+// encodes the shared capture at the send format, so stepping layers down in larger rooms doesn't share it out.
+static NSUInteger PHMediaSessionEncodeBudget = 2;
+
+static_assert(perch::IceConnectionStateDisconnected == (int)RTCICEConnectionDisconnected &&
+              perch::IceConnectionStateClosed == (int)RTCICEConnectionClosed, "ICE connection states are out of step with WebRTC's.");
+
+static int64_t PHMediaSessionNowMs()
+{
+    return (int64_t)([[NSProcessInfo processInfo] systemUptime] * 1000);
+}
+
+static std::string PHStdString(NSString *string)
+{
+    const char *utf8 = [string UTF8String];
+    return utf8 ? std::string(utf8) : std::string();
+}
+
+static BOOL PHIceServersEqual(NSArray *servers, NSArray *otherServers)
+{
+    if ([servers count] != [otherServers count]) {
+        return NO;
+    }
+
+    for (NSUInteger i = 0; i < [servers count]; i++) {
+        RTCICEServer *server = servers[i];
+        RTCICEServer *otherServer = otherServers[i];
+
+        if (![server.URI isEqual:otherServer.URI] || ![server.username isEqualToString:otherServer.username] ||
+            ![server.password isEqualToString:otherServer.password]) {
+            return NO;
+        }
+    }
+
+    return YES;
+}
+
+// A connection waiting for a peer to claim it.
+@interface PHPooledConnection : NSObject
+
+@property (nonatomic, strong) PHPeerConnection *connectionWrapper;
+@property (nonatomic, strong) NSDate *creationDate;
+// What the connection was made with, after filtering.
+@property (nonatomic, copy) NSArray *iceServers;
+// Gathered before there was anyone to signal them to.
+@property (nonatomic, strong) NSMutableArray *localCandidates;
+
+@end
+
+@implementation PHPooledConnection
+
+@end
+
+@interface PHMediaSession() <RTCPeerConnectionDelegate, RTCSessionDescriptionDelegate, RTCMediaStreamTrackDelegate, RTCStatsDelegate>
+{
+    perch::BitrateAllocator _bitrateAllocator;
+    perch::ReceiveQualityController _receiveQualityController;
+    perch::IceRecovery _iceRecovery;
+    perch::SimulcastStepDown _layerStepDown;
+    perch::IceCandidateBatcher _localCandidateBatcher;
+    // Keyed by connection id.
+    std::map<std::string, perch::IceCandidateFilter> _remoteCandidateFilters;
+    // Keyed by connection id. Recorded on the main queue, and may be read from any thread.
+    std::map<std::string, std::shared_ptr<perch::ConnectionStats> > _connectionStats;
+    // Keyed by connection id. Receive quality decisions waiting for a description of ours to carry them, and those in
+    // a description which is being set. A decision is only committed once its description is set.
+    std::map<std::string, perch::ReceiveQualityDecision> _pendingReceiveQuality;
+    std::map<std::string, perch::ReceiveQualityDecision> _describedReceiveQuality;
+}
+
+@property (nonatomic, strong) PHAudioSessionController *audioController;
+@property (nonatomic, weak) PHVideoCaptureKit *captureKit;
+@property (nonatomic, strong) RTCMediaStream *localStream;
+@property (nonatomic, strong) RTCVideoSource *videoSource;
+@property (nonatomic, strong) RTCPeerConnectionFactory *peerConnectionFactory;
+
+@property (nonatomic, strong) NSArray *iceServers;
+@property (nonatomic, strong) NSMutableDictionary *peerToConnectionMap;
+@property (nonatomic, strong) NSTimer *statsTimer;
+@property (nonatomic, assign) BOOL candidateFlushScheduled;
+// When the scheduled recovery poll runs, or kNoTime.
+@property (nonatomic, assign) int64_t iceRecoveryDueMs;
+// When the scheduled step down poll runs, or kNoTime.
+@property (nonatomic, assign) int64_t layerStepDownDueMs;
+
+@property (nonatomic, strong) NSMutableArray *connectionPool;
+// Local candidates of claimed connections, keyed by connection id. Held until the offer has been signaled, since the
+// peer drops candidates for a connection it doesn't know.
+@property (nonatomic, strong) NSMutableDictionary *claimedCandidates;
+@property (nonatomic, assign) PHConnectionPoolMetrics connectionPoolMetrics;
+@property (nonatomic, assign) BOOL connectionPoolFetchInProgress;
+@property (nonatomic, assign) BOOL connectionPoolMaintenanceScheduled;
+
+@end
+
+@implementation PHMediaSession
+
+#pragma mark - Init & Dealloc
+
+- (instancetype)init
+{
+    // Results in a parameter assertion. The session must be initialized with a delegate.
+
+    return [self initWithDelegate:nil];
+}
+
+- (instancetype)initWithDelegate:(id<PHSignalingDelegate>)delegate
+{
+    PHMediaConfiguration *config = [PHMediaConfiguration defaultConfiguration];
+
+    return [self initWithDelegate:delegate configuration:config andCapturer:nil];
+}
+
+- (instancetype)initWithDelegate:(id<PHSignalingDelegate>)delegate configuration:(PHMediaConfiguration *)config andCapturer:(PHVideoCaptureKit *)capturer
+{
+    NSParameterAssert(delegate);
+    NSParameterAssert(config);
+
+    self = [super init];
+
+    if (self) {
+        _captureKit = capturer;
+        _delegate = delegate;
+        _sessionConfiguration = [config copy];
+
+        [RTCPeerConnectionFactory initializeSSL];
+
+        _peerConnectionFactory = [[RTCPeerConnectionFactory alloc] init];
+        _peerToConnectionMap = [NSMutableDictionary dictionary];
+        _connectionPool = [NSMutableArray array];
+        _claimedCandidates = [NSMutableDictionary dictionary];
+        _audioController = [[PHAudioSessionController alloc] init];
+        _localCandidateBatcher = perch::IceCandidateBatcher(PHMediaSessionIceBatchWindowMs, PHMediaSessionIceBatchMaxSize);
+        _receiveQualityController = perch::ReceiveQualityController([self receiveLevelPeakRates]);
+        _iceRecovery = perch::IceRecovery(perch::IceRecoveryConfig(), arc4random());
+        _iceRecoveryDueMs = perch::IceRecovery::kNoTime;
+        _layerStepDownDueMs = perch::SimulcastStepDown::kNoTime;
+        _signalingAvailable = YES;
+
+        // TODO: Should local media setup and teardown be dynamic?
+
+        [self setupLocalMedia];
+    }
+
+    return self;
+}
+
+- (void)dealloc
+{
+    DDLogDebug(@"%s", __PRETTY_FUNCTION__);
+
+    [_peerToConnectionMap removeAllObjects];
+
+    _videoSource = nil;
+    _localStream = nil;
+    _peerConnectionFactory = nil;
+
+    [RTCPeerConnectionFactory deinitializeSSL];
+
+    [_audioController deactivateSessionWithAudioMode:PHAudioSessionModeAmbient];
+}
+
+#pragma mark - Public
+
+- (void)connectToPeer:(NSString *)peerId
+{
+    [self connectToPeer:peerId iceServers:self.iceServers];
+}
+
+- (void)acceptConnectionFromPeer:(NSString *)peerId withId:(NSString *)connectionId offer:(RTCSessionDescription *)offer
+{
+    [self acceptConnectionFromPeer:peerId withId:connectionId offer:offer iceServers:self.iceServers];
+}
+
+- (void)addIceServers:(NSArray *)iceServers singleUse:(BOOL)isSingleUse
+{
+    NSArray *filteredIceServers = [self filteredIceServers:iceServers];
+
+    if (!isSingleUse) {
+        self.iceServers = filteredIceServers;
+    }
+
+    [self.peerToConnectionMap enumerateKeysAndObjectsUsingBlock:^(NSString *peerId, PHPeerConnection *peerConnectionWrapper, BOOL *stop)
+    {
+        if (!peerConnectionWrapper.peerConnection) {
+            peerConnectionWrapper.peerConnection = [self peerConnnectionWithServers:filteredIceServers];
+            if (peerConnectionWrapper.role == PHPeerConnectionRoleInitiator) {
+                RTCMediaConstraints *constraints = [PHSessionDescriptionFactory offerConstraints];
+                [peerConnectionWrapper.peerConnection createOfferWithDelegate:self constraints:constraints];
+            }
+            else {
+                RTCSessionDescription *offer = peerConnectionWrapper.queuedOffer;
+                [self setRemoteDescription:offer forConnection:peerConnectionWrapper];
+                peerConnectionWrapper.queuedOffer = nil;
+            }
+        }
+    }];
+}
+
+- (void)restartIceWithPeer:(NSString *)peerId
+{
+    DDLogVerbose(@"Restart ICE with peer: %@", peerId);
+
+    PHPeerConnection *connectionWrapper = self.peerToConnectionMap[peerId];
+    RTCMediaConstraints *offerConstraints = [PHSessionDescriptionFactory offerConstraintsRestartIce:YES];
+
+    [connectionWrapper.peerConnection createOfferWithDelegate:self constraints:offerConstraints];
+}
+
+- (void)restartIceForNetworkChange
+{
+    DDLogInfo(@"Network changed. Restarting ICE for %lu connections.", (unsigned long)self.connectionCount);
+
+    _iceRecovery.OnNetworkChange(PHMediaSessionNowMs());
+
+    [self scheduleIceRecovery];
+}
+
+- (void)closeConnectionWithPeer:(NSString *)peerId
+{
+    NSParameterAssert(peerId);
+
+    PHPeerConnection *peerConnection = self.peerToConnectionMap[peerId];
+
+    if (!peerConnection) {
+        DDLogWarn(@"No connection to close for: %@", peerId);
+        return;
+    }
+
+    DDLogVerbose(@"Closing connection with peer: %@", peerId);
+
+    RTCMediaStream *remoteStream = peerConnection.remoteStream;
+    [peerConnection close];
+
+    std::string connectionKey = PHStdString(peerConnection.connectionId);
+    _localCandidateBatcher.Remove(connectionKey);
+    _remoteCandidateFilters.erase(connectionKey);
+    _connectionStats.erase(connectionKey);
+    [self.claimedCandidates removeObjectForKey:peerConnection.connectionId];
+    _receiveQualityController.Remove(connectionKey);
+    _pendingReceiveQuality.erase(connectionKey);
+    _describedReceiveQuality.erase(connectionKey);
+    _iceRecovery.Remove(connectionKey);
+    _layerStepDown.Remove(connectionKey);
+
+    if (remoteStream) {
+        [self.delegate connection:peerConnection removedStream:remoteStream];
+    }
+
+    [self.peerToConnectionMap removeObjectForKey:peerId];
+
+    if ([self activeConnectionCount] == 1) {
+        [self renegotiateActiveConnectionsChangingFormat:YES];
+    }
+    else if (self.connectionCount == 0) {
+        [self stopStatsCollection];
+    }
+}
+
+- (void)addIceCandidate:(RTCICECandidate *)candidate forPeer:(NSString *)peerId connectionId:(NSString *)connectionId
+{
+    PHPeerConnection *connectionWrapper = self.peerToConnectionMap[peerId];
+
+    // Handle case where ICE candidates reach us before we are able to fetch ICE servers and create a connection.
+
+    if (!connectionWrapper) {
+        DDLogWarn(@"No connection for ICE candidate: %@", candidate);
+        return;
+    }
+
+    RTCICECandidate *filteredCandidate = [self filteredIceCandidate:candidate];
+
+    if (!filteredCandidate) {
+        return;
+    }
+
+    perch::IceCandidate remoteCandidate(PHStdString(candidate.sdpMid), (int32_t)candidate.sdpMLineIndex, PHStdString(candidate.sdp));
+
+    if (!_remoteCandidateFilters[PHStdString(connectionWrapper.connectionId)].Accept(remoteCandidate)) {
+        DDLogVerbose(@"Discarding a duplicate ICE candidate: %@", candidate);
+        return;
+    }
+
+    [connectionWrapper addIceCandidate:filteredCandidate];
+}
+
+- (void)addIceCandidates:(NSArray *)candidates forPeer:(NSString *)peerId connectionId:(NSString *)connectionId
+{
+    for (RTCICECandidate *candidate in candidates) {
+        [self addIceCandidate:candidate forPeer:peerId connectionId:connectionId];
+    }
+}
+
+- (void)addAnswer:(RTCSessionDescription *)answerSDP forPeer:(NSString *)peerId connectionId:(NSString *)connectionId
+{
+    PHPeerConnection *connectionWrapper = self.peerToConnectionMap[peerId];
+
+    [self setRemoteDescription:answerSDP forConnection:connectionWrapper];
+}
+
+- (void)addOffer:(RTCSessionDescription *)offerSDP forPeer:(NSString *)peerId connectionId:(NSString *)connectionId
+{
+    PHPeerConnection *connectionWrapper = self.peerToConnectionMap[peerId];
+
+    _iceRecovery.OnRemoteOffer(PHStdString(connectionWrapper.connectionId), PHMediaSessionNowMs());
+
+    [self setRemoteDescription:offerSDP forConnection:connectionWrapper];
+}
+
+- (void)setSignalingAvailable:(BOOL)signalingAvailable
+{
+    _signalingAvailable = signalingAvailable;
+    _iceRecovery.SetSignalingAvailable(signalingAvailable);
+
+    [self scheduleIceRecovery];
+}
+
+- (PHIceRecoveryMetrics)iceRecoveryMetrics
+{
+    const perch::IceRecoveryMetrics &recoveryMetrics = _iceRecovery.Metrics();
+    PHIceRecoveryMetrics metrics;
+
+    metrics.disconnections = (NSUInteger)recoveryMetrics.disconnections;
+    metrics.recoveries = (NSUInteger)recoveryMetrics.recoveries;
+    metrics.restarts = (NSUInteger)recoveryMetrics.restarts;
+    metrics.failures = (NSUInteger)recoveryMetrics.failures;
+    metrics.meanRecoveryTime = recoveryMetrics.MeanRecoveryMs() / 1000;
+    metrics.maxRecoveryTime = recoveryMetrics.maxRecoveryMs / 1000.0;
+
+    return metrics;
+}
+
+- (PHPeerConnection *)connectionForPeerId:(NSString *)peerId
+{
+    return self.peerToConnectionMap[peerId];
+}
+
+- (NSUInteger)connectionCount
+{
+    return [self.peerToConnectionMap count];
+}
+
+- (NSArray *)connections
+{
+    return [self.peerToConnectionMap allValues];
+}
+
+- (void)setConnectionPoolSize:(NSUInteger)connectionPoolSize
+{
+    _connectionPoolSize = connectionPoolSize;
+
+    [self maintainConnectionPool];
+}
+
+- (NSUInteger)activeConnectionCount
+{
+    return [[self activeConnections] count];
+}
+
+- (PHVideoFormat)sendFormat
+{
+    PHVideoLayer largest = PHVideoLayerNone;
+
+    for (PHPeerConnection *connectionWrapper in [self.peerToConnectionMap allValues]) {
+        if (connectionWrapper.sendLayer.index > largest.index) {
+            largest = connectionWrapper.sendLayer;
+        }
+    }
+
+    return largest.index >= 0 ? largest.format : self.sessionConfiguration.maxSendFormat;
+}
+
+#pragma mark - Private
+
+- (NSArray *)activeConnections
+{
+    NSSet *keys = [self.peerToConnectionMap keysOfEntriesPassingTest:^BOOL(NSString *peerId, PHPeerConnection *peerConnection, BOOL *stop) {
+        RTCPeerConnection *rtcConnection = peerConnection.peerConnection;
+        if (rtcConnection.signalingState == RTCSignalingStable && rtcConnection.iceConnectionState != RTCICEConnectionFailed) {
+            return YES;
+        }
+        return NO;
+    }];
+
+    return [self.peerToConnectionMap objectsForKeys:[keys allObjects] notFoundMarker:[NSNull null]];
+}
+
+- (NSArray *)filteredIceServers:(NSArray *)serversToFilter
+{
+    PHIceFilter iceFilter = self.sessionConfiguration.iceFilter;
+
+    if (iceFilter == PHIceFilterAny) {
+        return serversToFilter;
+    }
+
+    NSIndexSet *indexSet = [serversToFilter indexesOfObjectsPassingTest:^BOOL(RTCICEServer *server, NSUInteger idx, BOOL *stop) {
+        BOOL pass = NO;
+
+        if (iceFilter & PHIceFilterStun) {
+            pass = [server.URI.scheme isEqualToString:@"stun"];
+        }
+        else if (iceFilter & PHIceFilterTurn) {
+            pass = [server.URI.scheme isEqualToString:@"turn"];
+        }
+
+        return pass;
+    }];
+
+    return [serversToFilter objectsAtIndexes:indexSet];
+}
+
+- (RTCICECandidate *)filteredIceCandidate:(RTCICECandidate *)candidate
+{
+    const char *sdp = [candidate.sdp UTF8String];
+    perch::IceCandidateAttribute attribute;
+
+    if (!sdp || !perch::ParseIceCandidate(perch::SdpToken(sdp, strlen(sdp)), &attribute)) {
+        DDLogWarn(@"Discarding a malformed ICE candidate: %@", candidate.sdp);
+        return nil;
+    }
+
+    BOOL sendCandidate = YES;
+
+    // Filter candidates by type.
+
+    PHIceFilter iceFilter = self.sessionConfiguration.iceFilter;
+
+    switch (attribute.type) {
+        case perch::IceCandidateTypeHost:
+            sendCandidate = (iceFilter & PHIceFilterLocal) != 0;
+            break;
+        case perch::IceCandidateTypeServerReflexive:
+            sendCandidate = (iceFilter & PHIceFilterStun) != 0;
+            break;
+        case perch::IceCandidateTypeRelay:
+            sendCandidate = (iceFilter & PHIceFilterTurn) != 0;
+            break;
+        default:
+            break;
+    }
+
+    // Filter by ice protocol.
+
+    PHIceProtocol iceProtocol = self.sessionConfiguration.iceProtocol;
+
+    NSAssert(iceProtocol != PHIceProtocolNone, @"Must choose an ICE protocol!");
+
+    if (sendCandidate && (iceProtocol == PHIceProtocolTCP)) {
+        sendCandidate = attribute.transport == perch::IceTransportTCP;
+    }
+    else if (sendCandidate && (iceProtocol == PHIceProtocolUDP)) {
+        sendCandidate = attribute.transport == perch::IceTransportUDP;
+    }
+
+    return sendCandidate ? candidate : nil;
+}
+
+- (PHPeerConnection *)connectionWrapperWithPeer:(NSString *)peerId connectionId:(NSString *)connectionId andServers:(NSArray *)iceServers
+{
+    NSParameterAssert(peerId);
+    NSParameterAssert(connectionId);
+
+    DDLogInfo(@"Setup peer connection with ICE servers: %@", iceServers);
+
+    RTCPeerConnection *connection = nil;
+
+    if (iceServers) {
+        connection = [self peerConnnectionWithServers:iceServers];
+    }
+
+    PHPeerConnection *connectionWrapper = [[PHPeerConnection alloc] initWithConnection:connection];
+    connectionWrapper.peerId = peerId;
+    connectionWrapper.connectionId = connectionId;
+
+    return connectionWrapper;
+}
+
+- (RTCPeerConnection *)peerConnnectionWithServers:(NSArray *)iceServers
+{
+    RTCMediaConstraints *constraints = [PHSessionDescriptionFactory connectionConstraints];
+    RTCPeerConnection *connection = [self.peerConnectionFactory peerConnectionWithICEServers:iceServers constraints:constraints delegate:self];
+
+    [connection addStream:self.localStream];
+
+    return connection;
+}
+
+- (NSUInteger)sendBitRateForConnection:(PHPeerConnection *)connectionWrapper
+{
+    const std::map<std::string, uint32_t> &caps = _bitrateAllocator.Caps();
+    std::map<std::string, uint32_t>::const_iterator cap = connectionWrapper ? caps.find([self videoKeyForConnection:connectionWrapper]) : caps.end();
+
+    if (cap != caps.end()) {
+        return cap->second;
+    }
+
+    // Until there's an allocation, every connection runs its own encoder so they split the budget.
+
+    return self.sessionConfiguration.maxVideoSendBitrate / MAX(self.connectionCount, 1);
+}
+
+- (NSInteger)maxSendLayerForConnection:(PHPeerConnection *)connectionWrapper
+{
+    // An accepted connection is conditioned before it is in the map.
+
+    NSMutableArray *connections = [[self.peerToConnectionMap allValues] mutableCopy];
+
+    if (![connections containsObject:connectionWrapper]) {
+        [connections addObject:connectionWrapper];
+    }
+
+    // Every connection is planned together, in the same order each time, so that a peer joining only steps layers down.
+
+    [connections sortUsingComparator:^NSComparisonResult(PHPeerConnection *first, PHPeerConnection *second) {
+        return [first.peerId compare:second.peerId];
+    }];
+
+    NSArray *maxLayers = [PHSessionDescriptionFactory maxLayersForConfiguration:self.sessionConfiguration
+                                                                connectionCount:[connections count]
+                                                                   encodeBudget:PHMediaSessionEncodeBudget];
+
+    return [maxLayers[[connections indexOfObject:connectionWrapper]] integerValue];
+}
+
+// Whether to offer now to step down the layer sent on a connection, which is over the room's plan. Only the initiator
+// offers straight away, since both ends re-plan when a peer joins and m45 can't roll back an offer which collides.
+- (BOOL)shouldStepDownLayerForConnection:(PHPeerConnection *)connectionWrapper
+{
+    std::string connectionKey = PHStdString(connectionWrapper.connectionId);
+
+    if (connectionWrapper.sendLayer.index <= [self maxSendLayerForConnection:connectionWrapper]) {
+        _layerStepDown.OnFitted(connectionKey);
+        return NO;
+    }
+
+    // Checked again once the connection is stable.
+
+    if (connectionWrapper.peerConnection.signalingState != RTCSignalingStable) {
+        return NO;
+    }
+
+    BOOL isInitiator = connectionWrapper.role == PHPeerConnectionRoleInitiator;
+    BOOL shouldStepDown = _layerStepDown.OnOverBudget(connectionKey, isInitiator, PHMediaSessionNowMs());
+
+    if (!shouldStepDown) {
+        DDLogVerbose(@"Waiting for %@ to offer a smaller layer.", connectionWrapper.peerId);
+        [self scheduleLayerStepDown];
+    }
+
+    return shouldStepDown;
+}
+
+- (void)setRemoteDescription:(RTCSessionDescription *)sdp forConnection:(PHPeerConnection *)connectionWrapper
+{
+    PHVideoLayer layer = connectionWrapper.sendLayer;
+    RTCSessionDescription *conditionedSDP = [PHSessionDescriptionFactory conditionedRemoteDescription:sdp
+                                                                                         configuration:self.sessionConfiguration
+                                                                                           sendBitRate:[self sendBitRateForConnection:connectionWrapper]
+                                                                                              maxLayer:[self maxSendLayerForConnection:connectionWrapper]
+                                                                                                 layer:&layer];
+
+    BOOL layerChanged = layer.index != connectionWrapper.sendLayer.index;
+
+    connectionWrapper.sendLayer = layer;
+
+    // A new description may start a new ICE generation, whose candidates can repeat the last one's.
+
+    _remoteCandidateFilters.erase(PHStdString(connectionWrapper.connectionId));
+
+    [connectionWrapper.peerConnection setRemoteDescriptionWithDelegate:self sessionDescription:conditionedSDP];
+
+    if (!layerChanged) {
+        return;
+    }
+
+    DDLogVerbose(@"Sending %@ layer %ld: %dx%d at %lu kbps.", connectionWrapper.peerId, (long)layer.index,
+                 layer.format.dimensions.width, layer.format.dimensions.height, (unsigned long)layer.bitRate);
+
+    if ([self.delegate respondsToSelector:@selector(session:connection:didSelectSendFormat:)]) {
+        [self.delegate session:self connection:connectionWrapper didSelectSendFormat:layer.format];
+    }
+}
+
+- (void)acceptConnectionFromPeer:(NSString *)peerId withId:(NSString *)connectionId offer:(RTCSessionDescription *)offer iceServers:(NSArray *)iceServers
+{
+    NSParameterAssert(offer);
+    NSAssert(self.peerToConnectionMap[peerId] == nil, @"Attempted to connect to a peer which we are already connected!");
+
+    PHPeerConnection *peerConnectionWrapper = [self connectionWrapperWithPeer:peerId connectionId:connectionId andServers:iceServers];
+    peerConnectionWrapper.role = PHPeerConnectionRoleReceiver;
+
+    if (peerConnectionWrapper.peerConnection) {
+        [self setRemoteDescription:offer forConnection:peerConnectionWrapper];
+    }
+    else {
+        peerConnectionWrapper.queuedOffer = offer;
+    }
+
+    self.peerToConnectionMap[peerId] = peerConnectionWrapper;
+
+    [self renegotiateActiveConnectionsChangingFormat:[self activeConnectionCount] > 1];
+}
+
+- (void)connectToPeer:(NSString *)peerId iceServers:(NSArray *)iceServers
+{
+    NSAssert(self.peerToConnectionMap[peerId] == nil, @"Attempted to connect to a peer which we are already connected!");
+
+    PHPeerConnection *peerConnectionWrapper = [self claimPooledConnectionForPeer:peerId];
+
+    if (!peerConnectionWrapper) {
+        peerConnectionWrapper = [self connectionWrapperWithPeer:peerId connectionId:[self createGUID] andServers:iceServers];
+        peerConnectionWrapper.role = PHPeerConnectionRoleInitiator;
+
+        if (peerConnectionWrapper.peerConnection) {
+            RTCMediaConstraints *constraints = [PHSessionDescriptionFactory offerConstraints];
+            [peerConnectionWrapper.peerConnection createOfferWithDelegate:self constraints:constraints];
+        }
+
+        self.peerToConnectionMap[peerId] = peerConnectionWrapper;
+    }
+
+    [self renegotiateActiveConnectionsChangingFormat:[self activeConnectionCount] > 1];
+}
+
+- (void)renegotiateActiveConnectionsChangingFormat:(BOOL)changeFormat
+{
+    NSArray *activeConnections = [self activeConnections];
+    BOOL shouldRenegotiate = NO;
+
+    if (changeFormat) {
+        [self updateReceiverFormat];
+
+        shouldRenegotiate = [self.delegate session:self shouldRenegotiateConnectionsWithFormat:self.sessionConfiguration.preferredReceiverFormat];
+    }
+
+    // Whatever the delegate says, a connection sending more than the room's plan allows is offered again to step down.
+
+    [activeConnections enumerateObjectsUsingBlock:^(PHPeerConnection *connectionWrapper, NSUInteger idx, BOOL *stop) {
+        BOOL shouldStepDown = [self shouldStepDownLayerForConnection:connectionWrapper];
+
+        if (!shouldStepDown && !(shouldRenegotiate && connectionWrapper.role == PHPeerConnectionRoleInitiator)) {
+            return;
+        }
+
+        if (shouldStepDown) {
+            DDLogVerbose(@"Stepping down the layer sent to %@ to fit the encode budget.", connectionWrapper.peerId);
+        }
+
+        RTCMediaConstraints *constraints = [PHSessionDescriptionFactory offerConstraints];
+        [connectionWrapper.peerConnection createOfferWithDelegate:self constraints:constraints];
+
+        _receiveQualityController.DidRenegotiate(PHStdString(connectionWrapper.connectionId), PHMediaSessionNowMs());
+    }];
+}
+
+- (void)setupLocalMedia
+{
+    RTCMediaConstraints *videoConstraints = nil;
+
+#if !TARGET_IPHONE_SIMULATOR
+
+    if (self.captureKit) {
+        PHVideoFormat captureFormat = [self.captureKit.videoCapturer videoCaptureFormat];
+        videoConstraints = [PHSessionDescriptionFactory videoConstraintsForFormat:captureFormat];
+    }
+
+#endif
+
+    [self setupLocalMediaWithVideoConstraints:videoConstraints];
+}
+
+- (void)setupLocalMediaWithVideoConstraints:(RTCMediaConstraints *)videoConstraints
+{
+    DDLogInfo(@"Setup local media with video constraints: %@", videoConstraints);
+
+    RTCMediaStream *localMediaStream = [self.peerConnectionFactory mediaStreamWithLabel:[self createGUID]];
+    RTCAudioTrack *audioTrack = [self.peerConnectionFactory audioTrackWithID:@"Audio"];
+
+    if (audioTrack) {
+        [localMediaStream addAudioTrack:audioTrack];
+    }
+
+    // The iOS simulator doesn't provide any sort of camera capture
+    // support or emulation (http://goo.gl/rHAnC1) so don't bother
+    // trying to open a local video track.
+
+#if !TARGET_IPHONE_SIMULATOR
+
+    RTCVideoCapturer *videoCapturer = nil;
+
+    if (self.captureKit) {
+        videoCapturer = (RTCVideoCapturer *)self.captureKit;
+    }
+    else {
+        NSString *frontCameraId = [self frontFacingCameraDevice];
+
+        NSAssert(frontCameraId, @"Unable to get the front camera id");
+
+        videoCapturer = [RTCVideoCapturer capturerWithDeviceName:frontCameraId];
+    }
+
+    RTCVideoSource *videoSource = [self.peerConnectionFactory videoSourceWithCapturer:videoCapturer constraints:videoConstraints];
+    RTCVideoTrack *localVideoTrack = [self.peerConnectionFactory videoTrackWithID:@"Video" source:videoSource];
+
+    if (localVideoTrack) {
+        [localMediaStream addVideoTrack:localVideoTrack];
+    }
+
+    self.videoSource = videoSource;
+
+#endif
+
+    self.localStream = localMediaStream;
+}
+
+- (void)stopLocalMedia
+{
+    DDLogDebug(@"%s", __PRETTY_FUNCTION__);
+
+    NSArray *connectionWrappers = [self.peerToConnectionMap allValues];
+
+    for (PHPeerConnection *connectionWrapper in connectionWrappers) {
+        [connectionWrapper close];
+    }
+
+    _connectionPoolSize = 0;
+
+    while ([self.connectionPool count] > 0) {
+        [self discardPooledConnection:[self.connectionPool lastObject]];
+    }
+
+    // The stats timer retains us.
+
+    [self stopStatsCollection];
+
+    [self.localStream removeAudioTrack:[self.localStream.audioTracks firstObject]];
+    [self.localStream removeVideoTrack:[self.localStream.videoTracks firstObject]];
+
+    self.videoSource = nil;
+    self.localStream = nil;
+
+    self.captureKit = nil;
+}
+
+- (NSString *)createGUID
+{
+    return [[NSUUID UUID] UUIDString];
+}
+
+- (NSString *)frontFacingCameraDevice
+{
+    NSString *cameraID = nil;
+
+    for (AVCaptureDevice* captureDevice in [AVCaptureDevice devicesWithMediaType:AVMediaTypeVideo]) {
+        if (captureDevice.position == AVCaptureDevicePositionFront) {
+            cameraID = [captureDevice localizedName];
+            break;
+        }
+    }
+
+    return cameraID;
+}
+
+- (PHPeerConnection *)wrapperForConnection:(RTCPeerConnection *)connection
+{
+    PHPeerConnection *connectionWrapper = nil;
+    NSArray *connectionWrappers = [self.peerToConnectionMap allValues];
+
+    for (PHPeerConnection *wrapper in connectionWrappers) {
+        if ([wrapper.peerConnection isEqual:connection]) {
+            connectionWrapper = wrapper;
+            break;
+        }
+    }
+
+    return connectionWrapper;
+}
+
+- (PHPeerConnection *)wrapperForConnectionId:(NSString *)connectionId
+{
+    for (PHPeerConnection *wrapper in [self.peerToConnectionMap allValues]) {
+        if ([wrapper.connectionId isEqualToString:connectionId]) {
+            return wrapper;
+        }
+    }
+
+    return nil;
+}
+
+#if !TARGET_IPHONE_SIMULATOR
+- (PHVideoFormat)activeFormat
+{
+    PHVideoFormat format;
+
+    if (self.captureKit) {
+        format = [self.captureKit.videoCapturer videoCaptureFormat];
+    }
+    else {
+        format.dimensions = (CMVideoDimensions){640, 480};
+        format.frameRate = 30;
+        format.pixelFormat = PHPixelFormatYUV420BiPlanarFullRange;
+    }
+
+    return format;
+}
+#endif
+
+- (void)startStatsCollectionWithInterval:(NSTimeInterval)interval
+{
+    NSTimer *statsTimer = [NSTimer timerWithTimeInterval:interval target:self selector:@selector(collectConnectionStats) userInfo:nil repeats:YES];
+
+    [[NSRunLoop mainRunLoop] addTimer:statsTimer forMode:NSRunLoopCommonModes];
+
+    self.statsTimer = statsTimer;
+}
+
+- (void)collectConnectionStats
+{
+    NSArray *connectionWrappers = [self.peerToConnectionMap allValues];
+
+    for (PHPeerConnection *peerConnectionWrapper in connectionWrappers) {
+        RTCPeerConnection *peerConnection = peerConnectionWrapper.peerConnection;
+        [peerConnection getStatsWithDelegate:self mediaStreamTrack:nil statsOutputLevel:RTCStatsOutputLevelStandard];
+    }
+
+    // Allocate with what the last round of stats said. This round's arrive asynchronously.
+
+    [self updateBitrateAllocation];
+    [self updateReceiveQuality];
+    [self reportEncodeTime];
+}
+
+- (void)stopStatsCollection
+{
+    [self.statsTimer invalidate];
+    self.statsTimer = nil;
+
+    _bitrateAllocator.Reset();
+    _connectionStats.clear();
+}
+
+- (void)updateBitrateAllocation
+{
+    PHMediaConfiguration *config = self.sessionConfiguration;
+    perch::BitrateCodec audioCodec = config.preferredAudioCodec == PHAudioCodecISAC ? perch::BitrateCodecISAC : perch::BitrateCodecOpus;
+    perch::BitrateCodec videoCodec = config.preferredVideoCodec == PHVideoCodecH264 ? perch::BitrateCodecH264 : perch::BitrateCodecVP8;
+
+    // Video is allocated against the largest layer, so that a connection on a small layer can earn its way up.
+    // Every connection takes part, including those still negotiating, so that they keep their caps and share the uplink.
+
+    uint32_t videoPeak = (uint32_t)PHVideoFormatComputePeakRate(config.maxSendFormat, PHMediaSessionTargetBpp, PHMediaSessionMaximumVideoRate);
+    NSArray *connections = [self.peerToConnectionMap allValues];
+    NSUInteger budget = config.maxVideoSendBitrate + config.maxAudioBitrate * [connections count];
+    NSUInteger estimate = 0;
+    BOOL measured = NO;
+    std::vector<perch::BitrateStream> streams;
+
+    for (PHPeerConnection *connectionWrapper in connections) {
+        streams.push_back(perch::BitrateStream([self audioKeyForConnection:connectionWrapper], audioCodec, (uint32_t)config.maxAudioBitrate));
+        streams.push_back(perch::BitrateStream([self videoKeyForConnection:connectionWrapper], videoCodec, videoPeak,
+                                               (uint32_t)connectionWrapper.sendLayer.maxBitRate));
+
+        NSUInteger available = connectionWrapper.availableSendBandwidth;
+
+        if (available > 0) {
+            NSUInteger cap = connectionWrapper.sendLayer.bitRate + config.maxAudioBitrate;
+            estimate += available >= 0.9 * cap ? (NSUInteger)(available * PHMediaSessionProbeFactor) : available;
+            measured = YES;
+        }
+    }
+
+    estimate = measured ? MIN(estimate, budget) : budget;
+
+    std::map<std::string, uint32_t> caps;
+    int64_t nowMs = PHMediaSessionNowMs();
+
+    if (!_bitrateAllocator.Update(streams, (uint32_t)estimate, nowMs, &caps)) {
+        return;
+    }
+
+    // WebRTC takes a connection's send cap from the remote description, and m45 has no way to change it in place.
+    // Connections we initiated re-offer, and pick the cap up from the answer. The others pick it up when the peer
+    // next offers, which its own allocator will do as its estimate moves. A connection which is still negotiating
+    // picks it up from the answer already on its way.
+
+    for (PHPeerConnection *connectionWrapper in connections) {
+        std::map<std::string, uint32_t>::const_iterator cap = caps.find([self videoKeyForConnection:connectionWrapper]);
+
+        if (cap == caps.end() || connectionWrapper.sendLayer.index < 0) {
+            continue;
+        }
+
+        DDLogVerbose(@"Video send cap for %@ is now %u kbps, of an estimated %u kbps.", connectionWrapper.peerId, cap->second,
+                     _bitrateAllocator.EstimateKbps());
+
+        if (connectionWrapper.role == PHPeerConnectionRoleInitiator && connectionWrapper.peerConnection.signalingState == RTCSignalingStable) {
+            RTCMediaConstraints *constraints = [PHSessionDescriptionFactory offerConstraints];
+            [connectionWrapper.peerConnection createOfferWithDelegate:self constraints:constraints];
+
+            _receiveQualityController.DidRenegotiate(PHStdString(connectionWrapper.connectionId), nowMs);
+        }
+    }
+}
+
+- (void)updateReceiveQuality
+{
+    int64_t nowMs = PHMediaSessionNowMs();
+
+    for (PHPeerConnection *connectionWrapper in [self activeConnections]) {
+        std::shared_ptr<const perch::ConnectionStats> stats = [self statsForConnection:connectionWrapper];
+        perch::StreamStats streams[perch::ConnectionStats::kMaxStreams];
+        size_t streamCount = stats ? stats->LatestStreams(perch::StatsMediaVideo, perch::StatsDirectionReceive, streams, perch::ConnectionStats::kMaxStreams) : 0;
+
+        if (streamCount == 0) {
+            continue;
+        }
+
+        perch::ReceiveQualitySample sample;
+        perch::BandwidthStats bandwidth;
+
+        for (size_t i = 0; i < streamCount; i++) {
+            sample.lossFraction = MAX(sample.lossFraction, streams[i].lossFraction);
+            sample.receiveKbps += streams[i].bitrateKbps;
+        }
+
+        if (stats->LatestBandwidth(&bandwidth)) {
+            sample.rttMs = bandwidth.rttMs;
+            sample.availableReceiveKbps = bandwidth.availableReceiveKbps;
+        }
+
+        perch::ReceiveQualityDecision decision;
+        std::string connectionKey = PHStdString(connectionWrapper.connectionId);
+
+        if (!_receiveQualityController.Update(connectionKey, sample, nowMs, &decision)) {
+            continue;
+        }
+
+        // The next description of ours carries the decision. Only the initiator offers for it, since both ends see
+        // the same link and m45 can't recover from both offering at once. The other end asks in its next answer, which
+        // the initiator's own controller will usually prompt soon enough. Until a description with the decision is
+        // set, it isn't committed, and the next stats round proposes it again.
+
+        _pendingReceiveQuality[connectionKey] = decision;
+
+        if (connectionWrapper.role != PHPeerConnectionRoleInitiator) {
+            DDLogVerbose(@"Asking %@ for receive level %lu in our next answer.", connectionWrapper.peerId, (unsigned long)decision.level);
+            continue;
+        }
+
+        if (connectionWrapper.peerConnection.signalingState != RTCSignalingStable) {
+            DDLogVerbose(@"Deferring receive level %lu for %@ until signaling is stable.", (unsigned long)decision.level, connectionWrapper.peerId);
+            continue;
+        }
+
+        DDLogInfo(@"Asking %@ for receive level %lu capped at %u kbps, after %.0f%% loss and %d ms RTT.", connectionWrapper.peerId,
+                  (unsigned long)decision.level, decision.capKbps, sample.lossFraction * 100, sample.rttMs);
+
+        RTCMediaConstraints *constraints = [PHSessionDescriptionFactory offerConstraints];
+        [connectionWrapper.peerConnection createOfferWithDelegate:self constraints:constraints];
+    }
+}
+
+- (void)commitReceiveQualityForConnection:(PHPeerConnection *)connectionWrapper
+{
+    std::string connectionKey = PHStdString(connectionWrapper.connectionId);
+    std::map<std::string, perch::ReceiveQualityDecision>::iterator described = _describedReceiveQuality.find(connectionKey);
+
+    if (described == _describedReceiveQuality.end()) {
+        return;
+    }
+
+    _receiveQualityController.Commit(connectionKey, described->second, PHMediaSessionNowMs());
+    _describedReceiveQuality.erase(described);
+    _pendingReceiveQuality.erase(connectionKey);
+}
+
+- (void)reportEncodeTime
+{
+    if (![self.delegate respondsToSelector:@selector(session:didMeasureAverageEncodeTime:)]) {
+        return;
+    }
+
+    // Every connection encodes each captured frame on its own, so their times add up.
+
+    int32_t encodeTimeMs = 0;
+    BOOL measured = NO;
+
+    for (PHPeerConnection *connectionWrapper in [self.peerToConnectionMap allValues]) {
+        std::shared_ptr<const perch::ConnectionStats> stats = [self statsForConnection:connectionWrapper];
+        perch::StreamStats streams[perch::ConnectionStats::kMaxStreams];
+        size_t streamCount = stats ? stats->LatestStreams(perch::StatsMediaVideo, perch::StatsDirectionSend, streams, perch::ConnectionStats::kMaxStreams) : 0;
+        int32_t connectionTimeMs = -1;
+
+        for (size_t i = 0; i < streamCount; i++) {
+            connectionTimeMs = MAX(connectionTimeMs, streams[i].codecTimeMs);
+        }
+
+        if (connectionTimeMs >= 0) {
+            encodeTimeMs += connectionTimeMs;
+            measured = YES;
+        }
+    }
+
+    if (measured) {
+        [self.delegate session:self didMeasureAverageEncodeTime:encodeTimeMs / 1000.0];
+    }
+}
+
+- (std::vector<uint32_t>)receiveLevelPeakRates
+{
+    std::vector<uint32_t> peakRates;
+
+    for (NSUInteger level = 0; level < PHMediaSessionReceiveLevelCount; level++) {
+        PHVideoFormat format = [self receiveFormatForLevel:level];
+        peakRates.push_back((uint32_t)PHVideoFormatComputePeakRate(format, PHMediaSessionTargetBpp, PHMediaSessionMaximumVideoRate));
+    }
+
+    return peakRates;
+}
+
+- (PHVideoFormat)receiveFormatForLevel:(NSUInteger)level
+{
+    PHVideoFormat format = self.sessionConfiguration.preferredReceiverFormat;
+
+    // Keep the dimensions even.
+
+    format.dimensions.width = (format.dimensions.width >> level) & ~1;
+    format.dimensions.height = (format.dimensions.height >> level) & ~1;
+
+    return format;
+}
+
+- (std::shared_ptr<const perch::ConnectionStats>)statsForConnection:(PHPeerConnection *)connectionWrapper
+{
+    std::map<std::string, std::shared_ptr<perch::ConnectionStats> >::const_iterator stats = _connectionStats.find(PHStdString(connectionWrapper.connectionId));
+
+    return stats != _connectionStats.end() ? stats->second : std::shared_ptr<const perch::ConnectionStats>();
+}
+
+- (std::string)audioKeyForConnection:(PHPeerConnection *)connectionWrapper
+{
+    return std::string("audio:") + [connectionWrapper.peerId UTF8String];
+}
+
+- (std::string)videoKeyForConnection:(PHPeerConnection *)connectionWrapper
+{
+    return std::string("video:") + [connectionWrapper.peerId UTF8String];
+}
+
+- (void)updateReceiverFormat
+{
+    // Checks the audio rate, based upon the number of connected peers.
+    // Video isn't stepped down here. Each peer is sent a layer which suits it, see setRemoteDescription:forConnection:.
+
+    BOOL isMultiparty = self.connectionCount > 1;
+
+    self.sessionConfiguration.maxAudioBitrate = isMultiparty ? PHMediaSessionMaximumAudioRateMultiparty : PHMediaSessionMaximumAudioRate;
+}
+
+#pragma mark - ICE Trickle
+
+- (void)queueLocalCandidate:(RTCICECandidate *)candidate forConnection:(PHPeerConnection *)connectionWrapper
+{
+    NSMutableArray *heldCandidates = self.claimedCandidates[connectionWrapper.connectionId];
+
+    if (heldCandidates) {
+        [heldCandidates addObject:candidate];
+        return;
+    }
+
+    perch::IceCandidate localCandidate(PHStdString(candidate.sdpMid), (int32_t)candidate.sdpMLineIndex, PHStdString(candidate.sdp));
+
+    _localCandidateBatcher.Add(PHStdString(connectionWrapper.connectionId), localCandidate, PHMediaSessionNowMs());
+
+    [self scheduleCandidateFlush];
+}
+
+- (void)scheduleCandidateFlush
+{
+    int64_t dueMs = _localCandidateBatcher.NextDueMs();
+
+    if (dueMs == perch::IceCandidateBatcher::kNoTime) {
+        return;
+    }
+
+    int64_t delayMs = dueMs - PHMediaSessionNowMs();
+
+    if (delayMs <= 0) {
+        [self flushLocalCandidates];
+        return;
+    }
+
+    // Every batch waits as long, so a flush which is already scheduled is never later than this one.
+
+    if (self.candidateFlushScheduled) {
+        return;
+    }
+
+    self.candidateFlushScheduled = YES;
+
+    __weak PHMediaSession *weakSelf = self;
+
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, delayMs * NSEC_PER_MSEC), dispatch_get_main_queue(), ^{
+        PHMediaSession *strongSelf = weakSelf;
+
+        strongSelf.candidateFlushScheduled = NO;
+        [strongSelf flushLocalCandidates];
+    });
+}
+
+- (void)flushLocalCandidates
+{
+    std::vector<perch::IceCandidateBatch> batches;
+
+    _localCandidateBatcher.TakeDue(PHMediaSessionNowMs(), &batches);
+
+    for (size_t i = 0; i < batches.size(); i++) {
+        const perch::IceCandidateBatch &batch = batches[i];
+        PHPeerConnection *connectionWrapper = [self wrapperForConnectionId:[NSString stringWithUTF8String:batch.key.c_str()]];
+
+        if (!connectionWrapper) {
+            continue;
+        }
+
+        NSMutableArray *candidates = [NSMutableArray arrayWithCapacity:batch.candidates.size()];
+
+        for (size_t j = 0; j < batch.candidates.size(); j++) {
+            const perch::IceCandidate &candidate = batch.candidates[j];
+            RTCICECandidate *iceCandidate = [[RTCICECandidate alloc] initWithMid:[NSString stringWithUTF8String:candidate.mid.c_str()]
+                                                                           index:candidate.index
+                                                                             sdp:[NSString stringWithUTF8String:candidate.sdp.c_str()]];
+            [candidates addObject:iceCandidate];
+        }
+
+        DDLogVerbose(@"Signal %lu ICE candidates to peer: %@", (unsigned long)[candidates count], connectionWrapper.peerId);
+
+        if ([self.delegate respondsToSelector:@selector(signalICECandidates:forConnection:)]) {
+            [self.delegate signalICECandidates:candidates forConnection:connectionWrapper];
+        }
+        else {
+            for (RTCICECandidate *candidate in candidates) {
+                [self.delegate signalICECandidate:candidate forConnection:connectionWrapper];
+            }
+        }
+    }
+
+    [self scheduleCandidateFlush];
+}
+
+#pragma mark - Layer Step Down
+
+- (void)scheduleLayerStepDown
+{
+    int64_t dueMs = _layerStepDown.NextDueMs();
+
+    if (dueMs == perch::SimulcastStepDown::kNoTime) {
+        return;
+    }
+
+    if (self.layerStepDownDueMs != perch::SimulcastStepDown::kNoTime && self.layerStepDownDueMs <= dueMs) {
+        return;
+    }
+
+    self.layerStepDownDueMs = dueMs;
+
+    int64_t delayMs = MAX(dueMs - PHMediaSessionNowMs(), 0);
+    __weak PHMediaSession *weakSelf = self;
+
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, delayMs * NSEC_PER_MSEC), dispatch_get_main_queue(), ^{
+        PHMediaSession *strongSelf = weakSelf;
+
+        if (strongSelf.layerStepDownDueMs == dueMs) {
+            strongSelf.layerStepDownDueMs = perch::SimulcastStepDown::kNoTime;
+        }
+
+        [strongSelf stepDownLayers];
+    });
+}
+
+// Takes over from initiators which haven't offered to step down.
+- (void)stepDownLayers
+{
+    std::vector<std::string> connectionKeys;
+
+    _layerStepDown.Poll(PHMediaSessionNowMs(), &connectionKeys);
+
+    for (size_t i = 0; i < connectionKeys.size(); i++) {
+        PHPeerConnection *connectionWrapper = [self wrapperForConnectionId:[NSString stringWithUTF8String:connectionKeys[i].c_str()]];
+
+        if (!connectionWrapper) {
+            _layerStepDown.Remove(connectionKeys[i]);
+        }
+        else if ([self shouldStepDownLayerForConnection:connectionWrapper]) {
+            DDLogInfo(@"%@ didn't offer a smaller layer. Offering it ourselves.", connectionWrapper.peerId);
+            [connectionWrapper.peerConnection createOfferWithDelegate:self constraints:[PHSessionDescriptionFactory offerConstraints]];
+        }
+    }
+
+    [self scheduleLayerStepDown];
+}
+
+#pragma mark - ICE Recovery
+
+- (void)scheduleIceRecovery
+{
+    int64_t dueMs = _iceRecovery.NextDueMs();
+
+    if (dueMs == perch::IceRecovery::kNoTime) {
+        return;
+    }
+
+    int64_t delayMs = dueMs - PHMediaSessionNowMs();
+
+    if (delayMs <= 0) {
+        [self recoverConnections];
+        return;
+    }
+
+    // Deadlines can move earlier, such as when a connection fails outright. Only a poll which is already sooner will do.
+
+    if (self.iceRecoveryDueMs != perch::IceRecovery::kNoTime && self.iceRecoveryDueMs <= dueMs) {
+        return;
+    }
+
+    self.iceRecoveryDueMs = dueMs;
+
+    __weak PHMediaSession *weakSelf = self;
+
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, delayMs * NSEC_PER_MSEC), dispatch_get_main_queue(), ^{
+        PHMediaSession *strongSelf = weakSelf;
+
+        if (strongSelf.iceRecoveryDueMs == dueMs) {
+            strongSelf.iceRecoveryDueMs = perch::IceRecovery::kNoTime;
+        }
+
+        [strongSelf recoverConnections];
+    });
+}
+
+- (void)recoverConnections
+{
+    std::vector<perch::IceRecoveryAction> actions;
+
+    _iceRecovery.Poll(PHMediaSessionNowMs(), &actions);
+
+    for (size_t i = 0; i < actions.size(); i++) {
+        const perch::IceRecoveryAction &action = actions[i];
+        PHPeerConnection *connectionWrapper = [self wrapperForConnectionId:[NSString stringWithUTF8String:action.key.c_str()]];
+
+        if (!connectionWrapper) {
+            _iceRecovery.Remove(action.key);
+            continue;
+        }
+
+        if (action.type == perch::IceRecoveryActionRestart) {
+            DDLogInfo(@"Lost connectivity with %@. Restarting ICE.", connectionWrapper.peerId);
+            [self restartIceWithPeer:connectionWrapper.peerId];
+        }
+        else {
+            DDLogWarn(@"ICE restarts didn't reconnect with %@.", connectionWrapper.peerId);
+
+            if ([self.delegate respondsToSelector:@selector(session:didFailToRecoverConnection:)]) {
+                [self.delegate session:self didFailToRecoverConnection:connectionWrapper];
+            }
+            else {
+                [self closeConnectionWithPeer:connectionWrapper.peerId];
+            }
+        }
+    }
+
+    [self scheduleIceRecovery];
+}
+
+// Checks that the connection's candidate pair is still carrying media, from the streams in this round of stats.
+- (void)checkMediaFlowForConnection:(PHPeerConnection *)connectionWrapper snapshot:(const perch::StatsSnapshot &)snapshot
+                              stats:(const perch::ConnectionStats &)connectionStats
+{
+    int64_t intervalMs = 0;
+    BOOL receiving = NO;
+
+    for (size_t i = 0; i < snapshot.streams.size() && !receiving; i++) {
+        perch::StreamStats stream;
+
+        if (snapshot.streams[i].direction != perch::StatsDirectionReceive ||
+            !connectionStats.LatestStream(snapshot.streams[i].ssrc, &stream) || stream.intervalMs <= 0) {
+            continue;
+        }
+
+        intervalMs = stream.intervalMs;
+        receiving = stream.packetRate > 0;
+    }
+
+    if (intervalMs == 0) {
+        return;
+    }
+
+    int64_t nowMs = PHMediaSessionNowMs();
+    int64_t lostForMs = _iceRecovery.OnMediaReceived(PHStdString(connectionWrapper.connectionId), receiving, nowMs - intervalMs, nowMs);
+
+    if (lostForMs != perch::IceRecovery::kNoTime) {
+        DDLogInfo(@"Media from %@ is flowing again, after %lld ms.", connectionWrapper.peerId, (long long)lostForMs);
+    }
+
+    [self scheduleIceRecovery];
+}
+
+#pragma mark - Connection Pool
+
+- (void)maintainConnectionPool
+{
+    NSDate *now = [NSDate date];
+
+    for (PHPooledConnection *pooledConnection in [self.connectionPool copy]) {
+        if ([now timeIntervalSinceDate:pooledConnection.creationDate] >= PHMediaSessionPooledConnectionLifetime) {
+            [self discardPooledConnection:pooledConnection];
+        }
+    }
+
+    while ([self.connectionPool count] > self.connectionPoolSize) {
+        [self discardPooledConnection:[self.connectionPool lastObject]];
+    }
+
+    // Even a full pool asks, to learn whether the credentials were renewed.
+
+    [self fetchServersForConnectionPool];
+    [self scheduleConnectionPoolMaintenance];
+}
+
+- (void)fillConnectionPool
+{
+    if ([self.connectionPool count] < self.connectionPoolSize) {
+        [self fetchServersForConnectionPool];
+    }
+}
+
+- (void)fetchServersForConnectionPool
+{
+    BOOL canFetch = self.localStream && [self.delegate respondsToSelector:@selector(session:needsIceServers:)];
+
+    if (!canFetch || self.connectionPoolFetchInProgress || self.connectionPoolSize == 0) {
+        return;
+    }
+
+    self.connectionPoolFetchInProgress = YES;
+
+    __weak PHMediaSession *weakSelf = self;
+
+    [self.delegate session:self needsIceServers:^(NSArray *iceServers) {
+        PHMediaSession *strongSelf = weakSelf;
+
+        strongSelf.connectionPoolFetchInProgress = NO;
+        [strongSelf addPooledConnectionsWithServers:iceServers];
+    }];
+}
+
+- (void)addPooledConnectionsWithServers:(NSArray *)iceServers
+{
+    if (!iceServers || !self.localStream) {
+        return;
+    }
+
+    NSArray *filteredIceServers = [self filteredIceServers:iceServers];
+    RTCMediaConstraints *constraints = [PHSessionDescriptionFactory offerConstraints];
+
+    // Connections made with credentials which have since been renewed are replaced, and only those.
+
+    for (PHPooledConnection *pooledConnection in [self.connectionPool copy]) {
+        if (!PHIceServersEqual(pooledConnection.iceServers, filteredIceServers)) {
+            DDLogVerbose(@"Replacing a pooled connection, its ICE servers were renewed.");
+            [self discardPooledConnection:pooledConnection];
+        }
+    }
+
+    while ([self.connectionPool count] < self.connectionPoolSize) {
+        PHPeerConnection *connectionWrapper = [[PHPeerConnection alloc] initWithConnection:[self peerConnnectionWithServers:filteredIceServers]];
+        connectionWrapper.connectionId = [self createGUID];
+        connectionWrapper.role = PHPeerConnectionRoleInitiator;
+
+        PHPooledConnection *pooledConnection = [[PHPooledConnection alloc] init];
+        pooledConnection.connectionWrapper = connectionWrapper;
+        pooledConnection.creationDate = [NSDate date];
+        pooledConnection.iceServers = filteredIceServers;
+        pooledConnection.localCandidates = [NSMutableArray array];
+
+        [self.connectionPool addObject:pooledConnection];
+        _connectionPoolMetrics.created++;
+
+        // Gathering starts once the offer is set as the local description.
+
+        [connectionWrapper.peerConnection createOfferWithDelegate:self constraints:constraints];
+    }
+
+    DDLogVerbose(@"Connection pool has %lu connections.", (unsigned long)[self.connectionPool count]);
+}
+
+- (void)scheduleConnectionPoolMaintenance
+{
+    if (self.connectionPoolMaintenanceScheduled || self.connectionPoolSize == 0) {
+        return;
+    }
+
+    self.connectionPoolMaintenanceScheduled = YES;
+
+    __weak PHMediaSession *weakSelf = self;
+    int64_t delay = (int64_t)(PHMediaSessionConnectionPoolMaintenanceInterval * NSEC_PER_SEC);
+
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, delay), dispatch_get_main_queue(), ^{
+        PHMediaSession *strongSelf = weakSelf;
+
+        strongSelf.connectionPoolMaintenanceScheduled = NO;
+        [strongSelf maintainConnectionPool];
+    });
+}
+
+- (void)discardPooledConnection:(PHPooledConnection *)pooledConnection
+{
+    [pooledConnection.connectionWrapper close];
+    [self.connectionPool removeObject:pooledConnection];
+
+    _connectionPoolMetrics.discarded++;
+}
+
+- (PHPooledConnection *)pooledConnectionForConnection:(RTCPeerConnection *)connection
+{
+    for (PHPooledConnection *pooledConnection in self.connectionPool) {
+        if ([pooledConnection.connectionWrapper.peerConnection isEqual:connection]) {
+            return pooledConnection;
+        }
+    }
+
+    return nil;
+}
+
+- (PHPeerConnection *)claimPooledConnectionForPeer:(NSString *)peerId
+{
+    PHPooledConnection *pooledConnection = nil;
+    NSDate *now = [NSDate date];
+
+    for (PHPooledConnection *candidate in [self.connectionPool copy]) {
+        if ([now timeIntervalSinceDate:candidate.creationDate] < PHMediaSessionPooledConnectionLifetime) {
+            pooledConnection = candidate;
+            break;
+        }
+
+        [self discardPooledConnection:candidate];
+    }
+
+    if (!pooledConnection) {
+        _connectionPoolMetrics.misses++;
+
+        if (self.connectionPoolSize > 0) {
+            DDLogInfo(@"No pooled connection for peer: %@ (%lu hits, %lu misses).", peerId,
+                      (unsigned long)_connectionPoolMetrics.hits, (unsigned long)_connectionPoolMetrics.misses);
+        }
+
+        return nil;
+    }
+
+    [self.connectionPool removeObject:pooledConnection];
+    _connectionPoolMetrics.hits++;
+
+    DDLogInfo(@"Using a pooled connection for peer: %@ (%lu hits, %lu misses).", peerId,
+              (unsigned long)_connectionPoolMetrics.hits, (unsigned long)_connectionPoolMetrics.misses);
+
+    PHPeerConnection *connectionWrapper = pooledConnection.connectionWrapper;
+    RTCPeerConnection *peerConnection = connectionWrapper.peerConnection;
+
+    connectionWrapper.peerId = peerId;
+    self.peerToConnectionMap[peerId] = connectionWrapper;
+
+    // The pooled offer was conditioned for no peer in particular, and for the room as it was. Offer again, now that
+    // both are known. The candidates gathered for the first offer still hold, as the ICE credentials don't change.
+
+    if (peerConnection.signalingState == RTCSignalingHaveLocalOffer) {
+        [peerConnection createOfferWithDelegate:self constraints:[PHSessionDescriptionFactory offerConstraints]];
+    }
+    else {
+        connectionWrapper.needsOffer = YES;
+    }
+
+    self.claimedCandidates[connectionWrapper.connectionId] = pooledConnection.localCandidates;
+
+    [self fillConnectionPool];
+
+    return connectionWrapper;
+}
+
+- (void)releaseClaimedCandidatesForConnection:(PHPeerConnection *)connectionWrapper
+{
+    NSArray *heldCandidates = self.claimedCandidates[connectionWrapper.connectionId];
+
+    if (!heldCandidates) {
+        return;
+    }
+
+    [self.claimedCandidates removeObjectForKey:connectionWrapper.connectionId];
+
+    for (RTCICECandidate *candidate in heldCandidates) {
+        [self queueLocalCandidate:candidate forConnection:connectionWrapper];
+    }
+
+    if (connectionWrapper.peerConnection.iceGatheringState == RTCICEGatheringComplete) {
+        _localCandidateBatcher.Finish(PHStdString(connectionWrapper.connectionId), PHMediaSessionNowMs());
+        [self flushLocalCandidates];
+    }
+}
+
+#pragma mark - String utilities
+
+- (NSString *)stringForSignalingState:(RTCSignalingState)state
+{
+    switch (state) {
+        case RTCSignalingStable:
+            return @"Stable";
+            break;
+        case RTCSignalingHaveLocalOffer:
+            return @"Have Local Offer";
+            break;
+        case RTCSignalingHaveRemoteOffer:
+            return @"Have Remote Offer";
+            break;
+        case RTCSignalingClosed:
+            return @"Closed";
+            break;
+        default:
+            return @"Other state";
+            break;
+    }
+}
+
+- (NSString *)stringForConnectionState:(RTCICEConnectionState)state
+{
+    switch (state) {
+        case RTCICEConnectionNew:
+            return @"New";
+            break;
+        case RTCICEConnectionChecking:
+            return @"Checking";
+            break;
+        case RTCICEConnectionConnected:
+            return @"Connected";
+            break;
+        case RTCICEConnectionCompleted:
+            return @"Completed";
+            break;
+        case RTCICEConnectionFailed:
+            return @"Failed";
+            break;
+        case RTCICEConnectionDisconnected:
+            return @"Disconnected";
+            break;
+        case RTCICEConnectionClosed:
+            return @"Closed";
+            break;
+        default:
+            return @"Other state";
+            break;
+    }
+}
+
+- (NSString *)stringForGatheringState:(RTCICEGatheringState)state
+{
+    switch (state) {
+        case RTCICEGatheringNew:
+            return @"New";
+            break;
+        case RTCICEGatheringGathering:
+            return @"Gathering";
+            break;
+        case RTCICEGatheringComplete:
+            return @"Complete";
+            break;
+        default:
+            return @"Other state";
+            break;
+    }
+}
+
+#pragma mark - RTCPeerConnectionDelegate
+
+- (void)peerConnectionOnError:(RTCPeerConnection *)peerConnection
+{
+    // TODO: Connection Error handling.
+//    [self.delegate connectionManager:self didErrorWithMessage:@"Media connection error."];
+}
+
+- (void)peerConnection:(RTCPeerConnection *)peerConnection signalingStateChanged:(RTCSignalingState)stateChanged
+{
+    DDLogVerbose(@"Peer connection: Signaling state changed: %@", [self stringForSignalingState:stateChanged]);
+}
+
+- (void)peerConnection:(RTCPeerConnection *)peerConnection addedStream:(RTCMediaStream *)stream
+{
+    dispatch_async(dispatch_get_main_queue(), ^{
+        DDLogVerbose(@"Peer connection added stream: %@", stream);
+
+        PHPeerConnection *connectionWrapper = [self wrapperForConnection:peerConnection];
+
+        connectionWrapper.remoteStream = stream;
+        RTCVideoTrack *videoTrack = [stream.videoTracks firstObject];
+        videoTrack.delegate = self;
+
+        [self.delegate connection:connectionWrapper addedStream:stream];
+
+        if (!self.statsTimer) {
+            [self startStatsCollectionWithInterval:PHMediaSessionStatsInterval];
+        }
+    });
+}
+
+- (void)peerConnection:(RTCPeerConnection *)peerConnection removedStream:(RTCMediaStream *)stream
+{
+    dispatch_async(dispatch_get_main_queue(), ^{
+        DDLogVerbose(@"Peer connection removed stream: %@", stream);
+
+        PHPeerConnection *connectionWrapper = [self wrapperForConnection:peerConnection];
+        connectionWrapper.remoteStream = nil;
+
+        [self.delegate connection:connectionWrapper removedStream:stream];
+    });
+}
+
+// Triggered when renegotiation is needed, for example the ICE has restarted.
+- (void)peerConnectionOnRenegotiationNeeded:(RTCPeerConnection *)peerConnection
+{
+    // Not sure if this is needed or not. Why does the AppRTC demo not implement it?
+
+    DDLogVerbose(@"Peer connection renegotiation needed: %@", peerConnection);
+}
+
+- (void)peerConnection:(RTCPeerConnection *)peerConnection iceConnectionChanged:(RTCICEConnectionState)newState
+{
+    dispatch_async(dispatch_get_main_queue(), ^{
+        DDLogVerbose(@"Peer connection ICE status is: %@", [self stringForConnectionState:newState]);
+
+        PHPeerConnection *connectionWrapper = [self wrapperForConnection:peerConnection];
+
+        if (!connectionWrapper) {
+            return;
+        }
+
+        if (newState == RTCICEConnectionFailed) {
+            connectionWrapper.iceAttempts++;
+            [connectionWrapper removeRemoteCandidates];
+        }
+        else if (newState == RTCICEConnectionConnected) {
+            connectionWrapper.iceAttempts = 0;
+        }
+
+        BOOL isInitiator = connectionWrapper.role == PHPeerConnectionRoleInitiator;
+        int64_t lostForMs = _iceRecovery.OnIceState(PHStdString(connectionWrapper.connectionId), isInitiator,
+                                                    (perch::IceConnectionState)newState, PHMediaSessionNowMs());
+
+        if (lostForMs != perch::IceRecovery::kNoTime) {
+            perch::IceRecoveryMetrics metrics = _iceRecovery.Metrics();
+
+            DDLogInfo(@"Reconnected with %@ after %lld ms. %llu of %llu disconnections recovered, in %.0f ms on average.",
+                      connectionWrapper.peerId, (long long)lostForMs, (unsigned long long)metrics.recoveries,
+                      (unsigned long long)metrics.disconnections, metrics.MeanRecoveryMs());
+        }
+
+        [self scheduleIceRecovery];
+
+        [self.delegate connection:connectionWrapper iceStatusChanged:newState];
+    });
+}
+
+- (void)peerConnection:(RTCPeerConnection *)peerConnection iceGatheringChanged:(RTCICEGatheringState)newState
+{
+    if (newState == RTCICEGatheringComplete) {
+        dispatch_async(dispatch_get_main_queue(), ^{
+            PHPeerConnection *connectionWrapper = [self wrapperForConnection:peerConnection];
+
+            if (connectionWrapper && !self.claimedCandidates[connectionWrapper.connectionId]) {
+                _localCandidateBatcher.Finish(PHStdString(connectionWrapper.connectionId), PHMediaSessionNowMs());
+                [self flushLocalCandidates];
+            }
+        });
+    }
+    else if (newState == RTCICEGatheringGathering) {
+        dispatch_async(dispatch_get_main_queue(), ^{
+            DDLogVerbose(@"Peer connection ICE gathering changed: %@", [self stringForGatheringState:newState]);
+
+            if (peerConnection.iceGatheringState == RTCICEGatheringGathering) {
+                PHPeerConnection *connectionWrapper = [self wrapperForConnection:peerConnection];
+                [connectionWrapper drainRemoteCandidates];
+            }
+        });
+    }
+}
+
+- (void)peerConnection:(RTCPeerConnection *)peerConnection gotICECandidate:(RTCICECandidate *)candidate
+{
+    // Share this ICE candidate with our peers.
+
+    dispatch_async(dispatch_get_main_queue(), ^{
+        RTCICECandidate *filteredCandidate = [self filteredIceCandidate:candidate];
+
+        if (!filteredCandidate) {
+            return;
+        }
+
+        PHPeerConnection *connectionWrapper = [self wrapperForConnection:peerConnection];
+
+        if (connectionWrapper) {
+            [self queueLocalCandidate:filteredCandidate forConnection:connectionWrapper];
+        }
+        else {
+            [[self pooledConnectionForConnection:peerConnection].localCandidates addObject:filteredCandidate];
+        }
+    });
+}
+
+- (void)peerConnection:(RTCPeerConnection *)peerConnection didOpenDataChannel:(RTCDataChannel *)dataChannel
+{
+    // Not used in this sample.
+
+    DDLogVerbose(@"Peer connection did open data channel: %@", dataChannel);
+}
+
+#pragma mark - RTCSessionDescriptionDelegate
+
+- (void)peerConnection:(RTCPeerConnection *)peerConnection didCreateSessionDescription:(RTCSessionDescription *)sdp error:(NSError *)error
+{
+    if (error) {
+        DDLogError(@"Peer connection did create SDP: %@ with error: %@", sdp, error);
+        return;
+    }
+
+    // Send an SDP.
+
+    dispatch_async(dispatch_get_main_queue(), ^{
+
+        DDLogVerbose(@"Peer connection did create %@", sdp.type);
+
+        // Set the local description.
+
+        // Ask for what the quality controller last decided this peer can deliver, or for a decision it has proposed.
+
+        PHPeerConnection *connectionWrapper = [self wrapperForConnection:peerConnection];
+        connectionWrapper.needsOffer = NO;
+
+        std::string connectionKey = PHStdString(connectionWrapper.connectionId);
+        perch::ReceiveQualityDecision receiveQuality = _receiveQualityController.Current(connectionKey);
+        std::map<std::string, perch::ReceiveQualityDecision>::const_iterator pending = _pendingReceiveQuality.find(connectionKey);
+
+        if (connectionWrapper && pending != _pendingReceiveQuality.end()) {
+            receiveQuality = pending->second;
+            _describedReceiveQuality[connectionKey] = receiveQuality;
+        }
+        PHMediaConfiguration *configuration = self.sessionConfiguration;
+
+        PHVideoFormat format = [self receiveFormatForLevel:receiveQuality.level];
+        NSUInteger maxVideoRate = PHVideoFormatComputePeakRate(format, PHMediaSessionTargetBpp, PHMediaSessionMaximumVideoRate);
+        NSUInteger maxAudioRate = configuration.maxAudioBitrate;
+
+        if (receiveQuality.level > 0) {
+            configuration = [configuration copy];
+            configuration.preferredReceiverFormat = format;
+        }
+
+        if (receiveQuality.capKbps > 0) {
+            maxVideoRate = MIN(maxVideoRate, receiveQuality.capKbps);
+        }
+
+        DDLogVerbose(@"Using max video bandwidth: %lu, audio: %lu", (unsigned long)maxVideoRate, (unsigned long)maxAudioRate);
+
+        RTCSessionDescription *conditionedSDP = [PHSessionDescriptionFactory conditionedSessionDescription:sdp
+                                                                                             configuration:configuration
+                                                                                              videoBitRate:maxVideoRate];
+
+        [peerConnection setLocalDescriptionWithDelegate:self sessionDescription:conditionedSDP];
+    });
+}
+
+- (void)peerConnection:(RTCPeerConnection *)peerConnection didSetSessionDescriptionWithError:(NSError *)error
+{
+    if (error) {
+        DDLogError(@"Peer connection did set SDP with error: %@", error);
+
+        // A decision in a description which wasn't set hasn't been asked for. It's proposed again.
+
+        dispatch_async(dispatch_get_main_queue(), ^{
+            PHPeerConnection *connectionWrapper = [self wrapperForConnection:peerConnection];
+
+            if (connectionWrapper) {
+                _describedReceiveQuality.erase(PHStdString(connectionWrapper.connectionId));
+            }
+        });
+
+        return;
+    }
+
+    // Send an Offer/Answer, Create an offer, or drain ICE candidates.
+
+    dispatch_async(dispatch_get_main_queue(), ^{
+
+        DDLogVerbose(@"Peer connection did set session description: %@", peerConnection);
+
+        // Check gathering state.
+
+        PHPeerConnection *connectionWrapper = [self wrapperForConnection:peerConnection];
+
+        if (!connectionWrapper) {
+            return;
+        }
+
+        if (peerConnection.iceGatheringState != RTCICEGatheringNew) {
+            [connectionWrapper drainRemoteCandidates];
+        }
+
+        // Check signaling state.
+
+        if (peerConnection.signalingState == RTCSignalingHaveLocalOffer && connectionWrapper.needsOffer) {
+            connectionWrapper.needsOffer = NO;
+            [peerConnection createOfferWithDelegate:self constraints:[PHSessionDescriptionFactory offerConstraints]];
+        }
+        else if (peerConnection.signalingState == RTCSignalingHaveLocalOffer) {
+            [self commitReceiveQualityForConnection:connectionWrapper];
+
+            RTCSessionDescription *conditionedOffer = peerConnection.localDescription;
+            [self.delegate signalOffer:conditionedOffer forConnection:connectionWrapper];
+            [self releaseClaimedCandidatesForConnection:connectionWrapper];
+        }
+        else if (peerConnection.signalingState == RTCSignalingHaveRemoteOffer) {
+            RTCMediaConstraints *constraints = [PHSessionDescriptionFactory offerConstraints];
+            [peerConnection createAnswerWithDelegate:self constraints:constraints];
+        }
+        else if (peerConnection.signalingState == RTCSignalingStable) {
+            // Either side may offer, since the receiver takes over ICE restarts and layer step downs which the initiator
+            // doesn't make.
+
+            if ([peerConnection.localDescription.type isEqualToString:@"answer"]) {
+                [self commitReceiveQualityForConnection:connectionWrapper];
+
+                RTCSessionDescription *conditionedAnswer = peerConnection.localDescription;
+                [self.delegate signalAnswer:conditionedAnswer forConnection:connectionWrapper];
+            }
+
+            // A peer which joined while this was negotiating re-planned the room, but couldn't offer to it then.
+
+            if ([self shouldStepDownLayerForConnection:connectionWrapper]) {
+                DDLogVerbose(@"Stepping down the layer sent to %@ to fit the encode budget.", connectionWrapper.peerId);
+                [peerConnection createOfferWithDelegate:self constraints:[PHSessionDescriptionFactory offerConstraints]];
+            }
+        }
+    });
+}
+
+#pragma mark - RTCStatsDelegate
+
+- (void)peerConnection:(RTCPeerConnection *)peerConnection didGetStats:(NSArray *)stats
+{
+    // Parse on WebRTC's thread, so that the main queue only has typed values to record.
+
+    perch::StatsReportParser parser;
+
+    for (RTCStatsReport *report in stats) {
+        if (PHMediaSessionLogConnectionStats) {
+            DDLogVerbose(@"%@ %@", report.type, report.values);
+        }
+
+        if (!parser.Begin([report.type UTF8String], [report.reportId UTF8String], report.timestamp)) {
+            continue;
+        }
+
+        for (RTCPair *pair in report.values) {
+            parser.AddValue([pair.key UTF8String], [pair.value UTF8String]);
+        }
+
+        parser.End();
+    }
+
+    perch::StatsSnapshot snapshot = parser.Snapshot();
+
+    dispatch_async(dispatch_get_main_queue(), ^{
+        PHPeerConnection *connectionWrapper = [self wrapperForConnection:peerConnection];
+
+        if (!connectionWrapper) {
+            return;
+        }
+
+        std::shared_ptr<perch::ConnectionStats> &connectionStats = _connectionStats[PHStdString(connectionWrapper.connectionId)];
+
+        if (!connectionStats) {
+            connectionStats = std::make_shared<perch::ConnectionStats>();
+        }
+
+        connectionStats->Record(snapshot);
+
+        [self checkMediaFlowForConnection:connectionWrapper snapshot:snapshot stats:*connectionStats];
+
+        if (snapshot.hasBandwidth && snapshot.bandwidth.availableSendKbps >= 0) {
+            connectionWrapper.availableSendBandwidth = snapshot.bandwidth.availableSendKbps;
+        }
+    });
+}
+
+#pragma mark - RTCMediaStreamTrackDelegate
+
+- (void)mediaStreamTrackDidChange:(RTCMediaStreamTrack *)mediaStreamTrack
+{
+    DDLogVerbose(@"Media stream track did change: %@", mediaStreamTrack);
+}
+
+@end
@@ -8,6 +8,8 @@
 
 #import <Foundation/Foundation.h>
 
+#import "PHFormats.h"
+
 @class RTCPeerConnection;
 @class RTCICECandidate;
 @class RTCMediaStream;
@@ -31,6 +33,12 @@ typedef NS_ENUM(NSUInteger, PHPeerConnectionRole)
 @property (nonatomic, assign) PHPeerConnectionRole role;
 @property (nonatomic, strong) RTCMediaStream *remoteStream;
 @property (nonatomic, assign) NSUInteger iceAttempts;
+/* The layer we send this peer, chosen from its latest session description. */
+@property (nonatomic, assign) PHVideoLayer sendLayer;
+/* The send bandwidth WebRTC estimates for this connection in kbps, from the latest stats. 0 until there are some. */
+@property (nonatomic, assign) NSUInteger availableSendBandwidth;
+/* The local offer being set was conditioned before the peer was known. It's made again, rather than signaled. */
+@property (nonatomic, assign) BOOL needsOffer;
 
 - (void)addIceCandidate:(RTCICECandidate *)candidate;
 - (void)drainRemoteCandidates;
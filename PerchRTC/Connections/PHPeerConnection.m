@@ -26,6 +26,7 @@
         _peerConnection = connection;
         _role = PHPeerConnectionRoleInitiator;
         _iceAttempts = 0;
+        _sendLayer = PHVideoLayerNone;
     }
 
     return self;
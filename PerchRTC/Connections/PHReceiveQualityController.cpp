@@ -0,0 +1,165 @@
+//
+//  PHReceiveQualityController.cpp
+//  PerchRTC
+//
+//  Created by Christopher Eagleston on 2015-08-10.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#include "PHReceiveQualityController.h"
+
+#include <algorithm>
+
+namespace perch {
+
+    const int64_t ReceiveQualityController::kNoTime;
+
+    ReceiveQualityController::ReceiveQualityController(const std::vector<uint32_t> &levelPeakKbps, ReceiveQualityConfig config)
+    : _levelPeakKbps(levelPeakKbps), _config(config), _lastChangeMs(kNoTime)
+    {
+        if (_levelPeakKbps.empty()) {
+            _levelPeakKbps.push_back(0);
+        }
+    }
+
+    bool ReceiveQualityController::Update(const std::string &key, const ReceiveQualitySample &sample, int64_t nowMs, ReceiveQualityDecision *decision)
+    {
+        PeerState &peer = _peers[key];
+
+        bool isCongested = sample.lossFraction >= _config.degradeLoss || sample.rttMs >= _config.degradeRttMs;
+        bool isHealthy = sample.lossFraction <= _config.recoverLoss && sample.rttMs <= _config.recoverRttMs;
+
+        peer.congestedSamples = isCongested ? peer.congestedSamples + 1 : 0;
+        peer.healthySamples = isHealthy ? peer.healthySamples + 1 : 0;
+
+        ReceiveQualityDecision next = peer.current;
+        bool changed = false;
+
+        if (peer.congestedSamples >= _config.degradeSamples && CanChange(peer, _config.minDecreaseIntervalMs, nowMs)) {
+            changed = Degrade(peer, sample, &next);
+        }
+        else if (peer.healthySamples >= _config.recoverSamples && CanChange(peer, _config.minIncreaseIntervalMs, nowMs)) {
+            changed = Recover(peer, sample, &next);
+        }
+
+        if (!changed) {
+            return false;
+        }
+
+        *decision = next;
+
+        return true;
+    }
+
+    void ReceiveQualityController::Commit(const std::string &key, const ReceiveQualityDecision &decision, int64_t nowMs)
+    {
+        PeerState &peer = _peers[key];
+
+        // The next change needs a fresh run of samples, taken after this one has had an effect.
+
+        peer.current = decision;
+        peer.congestedSamples = 0;
+        peer.healthySamples = 0;
+        peer.lastChangeMs = nowMs;
+        peer.lastRenegotiationMs = nowMs;
+        _lastChangeMs = nowMs;
+    }
+
+    void ReceiveQualityController::DidRenegotiate(const std::string &key, int64_t nowMs)
+    {
+        _peers[key].lastRenegotiationMs = nowMs;
+    }
+
+    ReceiveQualityDecision ReceiveQualityController::Current(const std::string &key) const
+    {
+        std::map<std::string, PeerState>::const_iterator peer = _peers.find(key);
+
+        return peer != _peers.end() ? peer->second.current : ReceiveQualityDecision();
+    }
+
+    bool ReceiveQualityController::CanChange(const PeerState &peer, int64_t intervalMs, int64_t nowMs) const
+    {
+        bool peerReady = peer.lastChangeMs == kNoTime || nowMs - peer.lastChangeMs >= intervalMs;
+        bool renegotiationReady = peer.lastRenegotiationMs == kNoTime || nowMs - peer.lastRenegotiationMs >= _config.minRenegotiationIntervalMs;
+        bool sessionReady = _lastChangeMs == kNoTime || nowMs - _lastChangeMs >= _config.minSessionIntervalMs;
+
+        return peerReady && renegotiationReady && sessionReady;
+    }
+
+    bool ReceiveQualityController::Degrade(const PeerState &peer, const ReceiveQualitySample &sample, ReceiveQualityDecision *decision) const
+    {
+        const ReceiveQualityDecision &current = peer.current;
+        uint32_t peakKbps = _levelPeakKbps[current.level];
+        uint32_t currentKbps = current.capKbps ? current.capKbps : peakKbps;
+
+        // Step down from what actually arrived, if that's less than what we allowed.
+
+        if (sample.receiveKbps > 0) {
+            uint32_t deliveredKbps = (uint32_t)(sample.receiveKbps * (1.0 - std::min(sample.lossFraction, 1.0f)));
+            currentKbps = std::min(currentKbps, deliveredKbps);
+        }
+
+        uint32_t capKbps = (uint32_t)(currentKbps * _config.capStep);
+        uint32_t floorKbps = (uint32_t)(peakKbps * _config.minCapFraction);
+
+        if (capKbps >= floorKbps && capKbps > 0) {
+            decision->action = ReceiveQualityActionCapBitrate;
+            decision->capKbps = capKbps;
+            return true;
+        }
+
+        if (current.level + 1 < _levelPeakKbps.size()) {
+            decision->action = ReceiveQualityActionLowerFormat;
+            decision->level = current.level + 1;
+            decision->capKbps = 0;
+            return true;
+        }
+
+        // The smallest format, as low as it goes.
+
+        if (current.capKbps != 0 && current.capKbps <= floorKbps) {
+            return false;
+        }
+
+        decision->action = ReceiveQualityActionCapBitrate;
+        decision->capKbps = std::max(floorKbps, 1u);
+        return true;
+    }
+
+    bool ReceiveQualityController::Recover(const PeerState &peer, const ReceiveQualitySample &sample, ReceiveQualityDecision *decision) const
+    {
+        const ReceiveQualityDecision &current = peer.current;
+        bool raiseFormat = current.capKbps == 0;
+
+        if (raiseFormat && current.level == 0) {
+            return false;
+        }
+
+        // Lift the cap a step at a time, then step up a level.
+
+        uint32_t targetKbps = 0;
+        uint32_t capKbps = 0;
+
+        if (raiseFormat) {
+            targetKbps = _levelPeakKbps[current.level - 1];
+        }
+        else {
+            uint32_t peakKbps = _levelPeakKbps[current.level];
+            targetKbps = std::min((uint32_t)(current.capKbps / _config.capStep), peakKbps);
+            capKbps = targetKbps < peakKbps ? targetKbps : 0;
+        }
+
+        bool isCovered = sample.availableReceiveKbps < 0 || sample.availableReceiveKbps >= targetKbps * _config.headroom;
+
+        if (!isCovered) {
+            return false;
+        }
+
+        decision->action = raiseFormat ? ReceiveQualityActionRaiseFormat : ReceiveQualityActionCapBitrate;
+        decision->level = raiseFormat ? current.level - 1 : current.level;
+        decision->capKbps = capKbps;
+
+        return true;
+    }
+
+} // namespace perch
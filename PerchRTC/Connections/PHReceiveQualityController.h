@@ -0,0 +1,142 @@
+//
+//  PHReceiveQualityController.h
+//  PerchRTC
+//
+//  Created by Christopher Eagleston on 2015-08-10.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#ifndef PerchRTC_PHReceiveQualityController_h
+#define PerchRTC_PHReceiveQualityController_h
+
+#include <map>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace perch {
+
+    struct ReceiveQualityConfig
+    {
+        ReceiveQualityConfig()
+        : degradeLoss(0.08f), recoverLoss(0.02f), degradeRttMs(450), recoverRttMs(250), degradeSamples(2),
+          recoverSamples(5), capStep(0.75), minCapFraction(0.5), headroom(1.2), minDecreaseIntervalMs(6000),
+          minIncreaseIntervalMs(20000), minRenegotiationIntervalMs(3000), minSessionIntervalMs(2000)
+        {}
+
+        // A sample is congested at or above either of these, and healthy at or below both of the recover values.
+        float degradeLoss;
+        float recoverLoss;
+        int32_t degradeRttMs;
+        int32_t recoverRttMs;
+        // How many samples in a row it takes to act.
+        int degradeSamples;
+        int recoverSamples;
+
+        // Each step down caps the peer at this fraction of what it was sending.
+        double capStep;
+        // Below this fraction of a level's peak, step down a level instead.
+        double minCapFraction;
+        // Step up only if the receive estimate covers the new rate by this much.
+        double headroom;
+
+        // Per peer, since its last change.
+        int64_t minDecreaseIntervalMs;
+        int64_t minIncreaseIntervalMs;
+        // Per peer, since any renegotiation.
+        int64_t minRenegotiationIntervalMs;
+        // Across peers, since the last change to any of them.
+        int64_t minSessionIntervalMs;
+    };
+
+    // How one stats round went for the video a peer sends us.
+    struct ReceiveQualitySample
+    {
+        ReceiveQualitySample() : lossFraction(0), rttMs(-1), receiveKbps(0), availableReceiveKbps(-1) {}
+
+        float lossFraction;
+        // -1 when unknown.
+        int32_t rttMs;
+        uint32_t receiveKbps;
+        // WebRTC's estimate for the connection, -1 when unknown.
+        int32_t availableReceiveKbps;
+    };
+
+    enum ReceiveQualityAction
+    {
+        ReceiveQualityActionNone = 0,
+        ReceiveQualityActionCapBitrate,
+        ReceiveQualityActionLowerFormat,
+        ReceiveQualityActionRaiseFormat
+    };
+
+    // What to ask a peer to send us.
+    struct ReceiveQualityDecision
+    {
+        ReceiveQualityDecision() : action(ReceiveQualityActionNone), level(0), capKbps(0) {}
+
+        ReceiveQualityAction action;
+        // 0 is the preferred format. Each level after it is smaller.
+        size_t level;
+        // In kbps, 0 for the level's peak.
+        uint32_t capKbps;
+    };
+
+    /**
+     *  Decides, per peer, what to ask it to send us. Sustained loss or delay first caps the peer's bitrate a step at a
+     *  time, and then steps down to a smaller format once the cap would starve the current one. Sustained health
+     *  undoes that in reverse, only as far as the receive estimate allows, and more slowly than it was done.
+     *
+     *  Every change means renegotiating, so changes are spaced out per peer and across peers. Decisions only depend
+     *  on the samples and times given, so a recorded trace replays the same way. A decision only takes effect once it's
+ *  committed, which the caller does when it can actually renegotiate.
+     */
+    class ReceiveQualityController
+    {
+    public:
+        static const int64_t kNoTime = INT64_MIN;
+
+        // `levelPeakKbps` has the peak rate of each format level, largest first.
+        explicit ReceiveQualityController(const std::vector<uint32_t> &levelPeakKbps = std::vector<uint32_t>(1, 0),
+                                          ReceiveQualityConfig config = ReceiveQualityConfig());
+
+        // Returns true if the peer should be asked for `decision`. Nothing changes until it's committed, so an
+        // uncommitted decision is proposed again with the next sample.
+        bool Update(const std::string &key, const ReceiveQualitySample &sample, int64_t nowMs, ReceiveQualityDecision *decision);
+
+        // The peer has been asked for `decision`.
+        void Commit(const std::string &key, const ReceiveQualityDecision &decision, int64_t nowMs);
+
+        // A renegotiation for any other reason. Quality changes keep their distance from it.
+        void DidRenegotiate(const std::string &key, int64_t nowMs);
+
+        // What the peer was last asked for.
+        ReceiveQualityDecision Current(const std::string &key) const;
+
+        void Remove(const std::string &key) { _peers.erase(key); }
+
+    private:
+        struct PeerState
+        {
+            PeerState() : congestedSamples(0), healthySamples(0), lastChangeMs(kNoTime), lastRenegotiationMs(kNoTime) {}
+
+            ReceiveQualityDecision current;
+            int congestedSamples;
+            int healthySamples;
+            int64_t lastChangeMs;
+            int64_t lastRenegotiationMs;
+        };
+
+        bool CanChange(const PeerState &peer, int64_t intervalMs, int64_t nowMs) const;
+        bool Degrade(const PeerState &peer, const ReceiveQualitySample &sample, ReceiveQualityDecision *decision) const;
+        bool Recover(const PeerState &peer, const ReceiveQualitySample &sample, ReceiveQualityDecision *decision) const;
+
+        std::vector<uint32_t> _levelPeakKbps;
+        ReceiveQualityConfig _config;
+        std::map<std::string, PeerState> _peers;
+        int64_t _lastChangeMs;
+    };
+
+} // namespace perch
+
+#endif
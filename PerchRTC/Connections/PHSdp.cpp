@@ -0,0 +1,565 @@
+//
+//  PHSdp.cpp
+//  PerchRTC
+//
+//  Created by Christopher Eagleston on 2015-07-20.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#include "PHSdp.h"
+
+#include <stdio.h>
+#include <string.h>
+
+namespace perch {
+
+    namespace {
+
+        inline char ToLower(char c)
+        {
+            return (c >= 'A' && c <= 'Z') ? (char)(c - 'A' + 'a') : c;
+        }
+
+        inline bool IsSpace(char c)
+        {
+            return c == ' ' || c == '\t';
+        }
+
+        SdpLine MakeLine(char type, SdpToken value)
+        {
+            SdpLine line;
+            line.type = type;
+            line.value = value;
+
+            if (type == 'a' && !value.Split(':', &line.attributeName, &line.attributeValue)) {
+                line.attributeName = value;
+                line.attributeValue = SdpToken();
+            }
+
+            return line;
+        }
+
+        // "<payload type> <parameters>" from an fmtp or rtpmap attribute.
+        bool SplitPayloadType(SdpToken attributeValue, uint32_t *payloadType, SdpToken *rest)
+        {
+            SdpToken head;
+
+            if (!attributeValue.Split(' ', &head, rest)) {
+                head = attributeValue;
+                *rest = SdpToken();
+            }
+
+            return head.ToUInt(payloadType);
+        }
+
+    } // namespace
+
+    uint32_t SdpFrameSizeInMacroblocks(uint32_t width, uint32_t height)
+    {
+        return ((width + 15) / 16) * ((height + 15) / 16);
+    }
+
+    std::string SdpUInt(uint32_t value)
+    {
+        char buffer[16];
+        int length = snprintf(buffer, sizeof(buffer), "%u", value);
+        return std::string(buffer, length > 0 ? length : 0);
+    }
+
+    // SdpToken
+
+    bool SdpToken::Equals(const char *text) const
+    {
+        return strlen(text) == size && memcmp(data, text, size) == 0;
+    }
+
+    bool SdpToken::EqualsIgnoringCase(const char *text) const
+    {
+        if (strlen(text) != size) {
+            return false;
+        }
+
+        for (size_t i = 0; i < size; i++) {
+            if (ToLower(data[i]) != ToLower(text[i])) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    bool SdpToken::StartsWith(const char *prefix) const
+    {
+        size_t length = strlen(prefix);
+        return length <= size && memcmp(data, prefix, length) == 0;
+    }
+
+    bool SdpToken::Split(char separator, SdpToken *head, SdpToken *tail) const
+    {
+        const char *found = size > 0 ? (const char *)memchr(data, separator, size) : NULL;
+
+        if (!found) {
+            return false;
+        }
+
+        // Either half may be this token, so work out both before writing.
+
+        size_t headSize = found - data;
+        SdpToken first(data, headSize);
+        SdpToken second(found + 1, size - headSize - 1);
+
+        *head = first;
+        *tail = second;
+
+        return true;
+    }
+
+    SdpToken SdpToken::Trimmed() const
+    {
+        size_t start = 0;
+        size_t end = size;
+
+        while (start < end && IsSpace(data[start])) {
+            start++;
+        }
+        while (end > start && IsSpace(data[end - 1])) {
+            end--;
+        }
+
+        return SdpToken(data + start, end - start);
+    }
+
+    bool SdpToken::ToUInt(uint32_t *value) const
+    {
+        if (size == 0 || size > 10) {
+            return false;
+        }
+
+        uint64_t result = 0;
+
+        for (size_t i = 0; i < size; i++) {
+            if (data[i] < '0' || data[i] > '9') {
+                return false;
+            }
+            result = result * 10 + (data[i] - '0');
+        }
+
+        if (result > 0xFFFFFFFF) {
+            return false;
+        }
+
+        *value = (uint32_t)result;
+        return true;
+    }
+
+    // SdpMediaSection
+
+    int SdpMediaSection::FindAttribute(const char *name, size_t from) const
+    {
+        for (size_t i = from; i < _lines.size(); i++) {
+            if (_lines[i].type == 'a' && _lines[i].attributeName.Equals(name)) {
+                return (int)i;
+            }
+        }
+
+        return -1;
+    }
+
+    std::vector<SdpRtpMap> SdpMediaSection::RtpMaps() const
+    {
+        std::vector<SdpRtpMap> maps;
+
+        for (int i = FindAttribute("rtpmap"); i >= 0; i = FindAttribute("rtpmap", i + 1)) {
+            SdpRtpMap map = SdpRtpMap();
+            SdpToken encoding, clock, channels;
+
+            if (!SplitPayloadType(_lines[i].attributeValue, &map.payloadType, &encoding) ||
+                !encoding.Split('/', &map.encodingName, &clock)) {
+                continue;
+            }
+
+            if (clock.Split('/', &clock, &channels) && !channels.ToUInt(&map.channels)) {
+                continue;
+            }
+
+            if (clock.ToUInt(&map.clockRate)) {
+                maps.push_back(map);
+            }
+        }
+
+        return maps;
+    }
+
+    bool SdpMediaSection::PreferCodec(const char *encodingName, uint32_t clockRate)
+    {
+        std::vector<uint32_t> payloadTypes;
+        std::vector<SdpRtpMap> maps = RtpMaps();
+
+        for (size_t i = 0; i < maps.size(); i++) {
+            if (maps[i].encodingName.EqualsIgnoringCase(encodingName) && (clockRate == 0 || maps[i].clockRate == clockRate)) {
+                payloadTypes.push_back(maps[i].payloadType);
+            }
+        }
+
+        std::vector<SdpToken> preferred;
+        std::vector<SdpToken> others;
+
+        for (size_t i = 0; i < _formats.size(); i++) {
+            uint32_t format = 0;
+            bool matches = false;
+
+            if (_formats[i].ToUInt(&format)) {
+                for (size_t j = 0; j < payloadTypes.size() && !matches; j++) {
+                    matches = payloadTypes[j] == format;
+                }
+            }
+
+            (matches ? preferred : others).push_back(_formats[i]);
+        }
+
+        if (preferred.empty()) {
+            return false;
+        }
+
+        preferred.insert(preferred.end(), others.begin(), others.end());
+        _formats.swap(preferred);
+        RebuildMediaLine();
+
+        return true;
+    }
+
+    void SdpMediaSection::SetBandwidth(const char *modifier, uint32_t value)
+    {
+        std::string line = std::string(modifier) + ":" + SdpUInt(value);
+        size_t insertAt = 1;
+
+        for (size_t i = 1; i < _lines.size(); i++) {
+            SdpToken name, current;
+
+            if (_lines[i].type == 'b' && _lines[i].value.Split(':', &name, &current) && name.Equals(modifier)) {
+                ReplaceLine(i, 'b', line);
+                return;
+            }
+        }
+
+        while (insertAt < _lines.size() && (_lines[insertAt].type == 'i' || _lines[insertAt].type == 'c' || _lines[insertAt].type == 'b')) {
+            insertAt++;
+        }
+
+        InsertLine(insertAt, 'b', line);
+    }
+
+    bool SdpMediaSection::Bandwidth(const char *modifier, uint32_t *value) const
+    {
+        for (size_t i = 1; i < _lines.size(); i++) {
+            SdpToken name, current;
+
+            if (_lines[i].type == 'b' && _lines[i].value.Split(':', &name, &current) && name.Equals(modifier)) {
+                return current.ToUInt(value);
+            }
+        }
+
+        return false;
+    }
+
+    void SdpMediaSection::SetFormatParameter(uint32_t payloadType, const char *name, const std::string &value)
+    {
+        for (int i = FindAttribute("fmtp"); i >= 0; i = FindAttribute("fmtp", i + 1)) {
+            uint32_t linePayloadType = 0;
+            SdpToken parameters;
+
+            if (!SplitPayloadType(_lines[i].attributeValue, &linePayloadType, &parameters) || linePayloadType != payloadType) {
+                continue;
+            }
+
+            // Rewrite the parameter list, replacing or appending the one we're setting.
+
+            std::string updated = "fmtp:" + SdpUInt(payloadType) + " ";
+            bool found = false;
+            bool first = true;
+            SdpToken remaining = parameters;
+
+            while (!remaining.Empty()) {
+                SdpToken parameter, key, current;
+
+                if (!remaining.Split(';', &parameter, &remaining)) {
+                    parameter = remaining;
+                    remaining = SdpToken();
+                }
+
+                parameter = parameter.Trimmed();
+
+                if (parameter.Empty()) {
+                    continue;
+                }
+
+                if (!first) {
+                    updated += ";";
+                }
+                first = false;
+
+                if (parameter.Split('=', &key, &current) && key.Trimmed().Equals(name)) {
+                    updated += std::string(name) + "=" + value;
+                    found = true;
+                }
+                else {
+                    updated.append(parameter.data, parameter.size);
+                }
+            }
+
+            if (!found) {
+                updated += (first ? "" : ";") + std::string(name) + "=" + value;
+            }
+
+            ReplaceLine(i, 'a', updated);
+            return;
+        }
+
+        // No fmtp line yet, so add one after the codec's rtpmap.
+
+        size_t insertAt = _lines.size();
+
+        for (int i = FindAttribute("rtpmap"); i >= 0; i = FindAttribute("rtpmap", i + 1)) {
+            uint32_t linePayloadType = 0;
+            SdpToken rest;
+
+            if (SplitPayloadType(_lines[i].attributeValue, &linePayloadType, &rest) && linePayloadType == payloadType) {
+                insertAt = i + 1;
+                break;
+            }
+        }
+
+        InsertLine(insertAt, 'a', "fmtp:" + SdpUInt(payloadType) + " " + name + "=" + value);
+    }
+
+    bool SdpMediaSection::FormatParameter(uint32_t payloadType, const char *name, SdpToken *value) const
+    {
+        for (int i = FindAttribute("fmtp"); i >= 0; i = FindAttribute("fmtp", i + 1)) {
+            uint32_t linePayloadType = 0;
+            SdpToken remaining;
+
+            if (!SplitPayloadType(_lines[i].attributeValue, &linePayloadType, &remaining) || linePayloadType != payloadType) {
+                continue;
+            }
+
+            while (!remaining.Empty()) {
+                SdpToken parameter, key, current;
+
+                if (!remaining.Split(';', &parameter, &remaining)) {
+                    parameter = remaining;
+                    remaining = SdpToken();
+                }
+
+                if (parameter.Split('=', &key, &current) && key.Trimmed().Equals(name)) {
+                    *value = current.Trimmed();
+                    return true;
+                }
+            }
+        }
+
+        return false;
+    }
+
+    void SdpMediaSection::RemoveFormat(uint32_t payloadType)
+    {
+        for (size_t i = 0; i < _formats.size(); i++) {
+            uint32_t format = 0;
+
+            if (_formats[i].ToUInt(&format) && format == payloadType) {
+                _formats.erase(_formats.begin() + i);
+                RebuildMediaLine();
+                break;
+            }
+        }
+
+        for (size_t i = _lines.size(); i-- > 1;) {
+            const SdpLine &line = _lines[i];
+            uint32_t linePayloadType = 0;
+            SdpToken rest;
+
+            if (line.type == 'a' &&
+                (line.attributeName.Equals("rtpmap") || line.attributeName.Equals("fmtp") || line.attributeName.Equals("rtcp-fb")) &&
+                SplitPayloadType(line.attributeValue, &linePayloadType, &rest) && linePayloadType == payloadType) {
+                RemoveLine(i);
+            }
+        }
+    }
+
+    void SdpMediaSection::AddAttribute(const char *name, const std::string &value)
+    {
+        std::string line(name);
+
+        if (!value.empty()) {
+            line.append(":").append(value);
+        }
+
+        InsertLine(_lines.size(), 'a', line);
+    }
+
+    void SdpMediaSection::RemoveLine(size_t index)
+    {
+        if (index > 0 && index < _lines.size()) {
+            _lines.erase(_lines.begin() + index);
+        }
+    }
+
+    bool SdpMediaSection::ParseMediaLine()
+    {
+        // m=<media> <port> <proto> <fmt> ...
+
+        SdpToken remaining = _lines[0].value;
+        SdpToken fields[3];
+
+        for (int i = 0; i < 3; i++) {
+            if (!remaining.Split(' ', &fields[i], &remaining)) {
+                if (i < 2) {
+                    return false;
+                }
+                fields[i] = remaining;
+                remaining = SdpToken();
+            }
+        }
+
+        _media = fields[0];
+        _port = fields[1];
+        _protocol = fields[2];
+
+        while (!remaining.Empty()) {
+            SdpToken format;
+
+            if (!remaining.Split(' ', &format, &remaining)) {
+                format = remaining;
+                remaining = SdpToken();
+            }
+            if (!format.Empty()) {
+                _formats.push_back(format);
+            }
+        }
+
+        return !_media.Empty();
+    }
+
+    void SdpMediaSection::RebuildMediaLine()
+    {
+        std::string line;
+        line.reserve(_lines[0].value.size + 8);
+
+        line.append(_media.data, _media.size).append(" ");
+        line.append(_port.data, _port.size).append(" ");
+        line.append(_protocol.data, _protocol.size);
+
+        for (size_t i = 0; i < _formats.size(); i++) {
+            line.append(" ").append(_formats[i].data, _formats[i].size);
+        }
+
+        ReplaceLine(0, 'm', line);
+    }
+
+    void SdpMediaSection::ReplaceLine(size_t index, char type, const std::string &value)
+    {
+        _lines[index] = MakeLine(type, _session->Store(value));
+    }
+
+    void SdpMediaSection::InsertLine(size_t index, char type, const std::string &value)
+    {
+        _lines.insert(_lines.begin() + index, MakeLine(type, _session->Store(value)));
+    }
+
+    // SdpSession
+
+    bool SdpSession::Parse(const std::string &sdp)
+    {
+        _source = sdp;
+        _edits.clear();
+        _lines.clear();
+        _media.clear();
+
+        const char *cursor = _source.data();
+        const char *end = cursor + _source.size();
+
+        while (cursor < end) {
+            const char *newline = (const char *)memchr(cursor, '\n', end - cursor);
+            const char *lineEnd = newline ? newline : end;
+            const char *next = newline ? newline + 1 : end;
+
+            if (lineEnd > cursor && lineEnd[-1] == '\r') {
+                lineEnd--;
+            }
+
+            size_t length = lineEnd - cursor;
+
+            if (length == 0) {
+                cursor = next;
+                continue;
+            }
+
+            if (length < 2 || cursor[0] < 'a' || cursor[0] > 'z' || cursor[1] != '=') {
+                return false;
+            }
+
+            SdpLine line = MakeLine(cursor[0], SdpToken(cursor + 2, length - 2));
+
+            if (line.type == 'm') {
+                _media.push_back(SdpMediaSection(this));
+                _media.back()._lines.push_back(line);
+
+                if (!_media.back().ParseMediaLine()) {
+                    return false;
+                }
+            }
+            else if (!_media.empty()) {
+                _media.back()._lines.push_back(line);
+            }
+            else {
+                _lines.push_back(line);
+            }
+
+            cursor = next;
+        }
+
+        return !_lines.empty() && _lines[0].type == 'v';
+    }
+
+    std::string SdpSession::Serialize() const
+    {
+        std::string sdp;
+        size_t capacity = _source.size();
+
+        for (size_t i = 0; i < _edits.size(); i++) {
+            capacity += _edits[i].size() + 4;
+        }
+
+        sdp.reserve(capacity);
+
+        for (size_t i = 0; i <= _media.size(); i++) {
+            const std::vector<SdpLine> &lines = i == 0 ? _lines : _media[i - 1]._lines;
+
+            for (size_t j = 0; j < lines.size(); j++) {
+                sdp.push_back(lines[j].type);
+                sdp.push_back('=');
+                sdp.append(lines[j].value.data, lines[j].value.size);
+                sdp.append("\r\n");
+            }
+        }
+
+        return sdp;
+    }
+
+    SdpMediaSection *SdpSession::FindMedia(const char *media)
+    {
+        for (size_t i = 0; i < _media.size(); i++) {
+            if (_media[i]._media.Equals(media)) {
+                return &_media[i];
+            }
+        }
+
+        return NULL;
+    }
+
+    SdpToken SdpSession::Store(const std::string &text)
+    {
+        _edits.push_back(text);
+        return SdpToken(_edits.back().data(), _edits.back().size());
+    }
+
+} // namespace perch
@@ -0,0 +1,172 @@
+//
+//  PHSdp.h
+//  PerchRTC
+//
+//  Created by Christopher Eagleston on 2015-07-20.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#ifndef PerchRTC_PHSdp_h
+#define PerchRTC_PHSdp_h
+
+#include <deque>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace perch {
+
+    // A view of characters owned by an SdpSession. Valid for as long as the session is.
+    struct SdpToken
+    {
+        SdpToken() : data(NULL), size(0) {}
+        SdpToken(const char *tokenData, size_t tokenSize) : data(tokenData), size(tokenSize) {}
+
+        bool Empty() const { return size == 0; }
+        bool Equals(const char *text) const;
+        bool EqualsIgnoringCase(const char *text) const;
+        bool StartsWith(const char *prefix) const;
+
+        // Splits at the first `separator`. The separator is in neither half. Returns false if there is none.
+        bool Split(char separator, SdpToken *head, SdpToken *tail) const;
+        SdpToken Trimmed() const;
+
+        // Parses a non-negative decimal. Returns false if the token isn't one, or doesn't fit.
+        bool ToUInt(uint32_t *value) const;
+
+        std::string ToString() const { return std::string(data, size); }
+
+        const char *data;
+        size_t size;
+    };
+
+    // One "<type>=<value>" line. Attributes ("a=") are split further into "<name>[:<value>]".
+    struct SdpLine
+    {
+        char type;
+        SdpToken value;
+        SdpToken attributeName;
+        SdpToken attributeValue;
+    };
+
+    struct SdpRtpMap
+    {
+        uint32_t payloadType;
+        SdpToken encodingName;
+        uint32_t clockRate;
+        // 0 if not given.
+        uint32_t channels;
+    };
+
+    // The number of 16x16 macroblocks which cover a frame, the unit of the max-fs format parameter.
+    uint32_t SdpFrameSizeInMacroblocks(uint32_t width, uint32_t height);
+
+    // A number as SDP writes it, in decimal.
+    std::string SdpUInt(uint32_t value);
+
+    class SdpSession;
+
+    // Everything from an "m=" line up to the next one.
+    class SdpMediaSection
+    {
+    public:
+        // "audio", "video", "application".
+        SdpToken Media() const { return _media; }
+        SdpToken Port() const { return _port; }
+        SdpToken Protocol() const { return _protocol; }
+        const std::vector<SdpToken> &Formats() const { return _formats; }
+
+        // The m= line comes first.
+        const std::vector<SdpLine> &Lines() const { return _lines; }
+
+        // Returns the first attribute line named `name`, starting at `from`, or -1.
+        int FindAttribute(const char *name, size_t from = 0) const;
+
+        std::vector<SdpRtpMap> RtpMaps() const;
+
+        // Moves every format which maps to `encodingName` (and `clockRate`, unless 0) to the front of the m= line,
+        // keeping their relative order. Returns false if there's no such format.
+        bool PreferCodec(const char *encodingName, uint32_t clockRate = 0);
+
+        // Replaces the "b=<modifier>:" line, or adds one where RFC 4566 wants it (after any i= and c= lines).
+        void SetBandwidth(const char *modifier, uint32_t value);
+        // Returns false if there's no such line.
+        bool Bandwidth(const char *modifier, uint32_t *value) const;
+
+        // Sets `name=value` in the "a=fmtp:<payloadType>" line, adding the parameter or the line as needed.
+        void SetFormatParameter(uint32_t payloadType, const char *name, const std::string &value);
+        // Returns false if the parameter isn't set.
+        bool FormatParameter(uint32_t payloadType, const char *name, SdpToken *value) const;
+
+        // Removes the format from the m= line, along with its rtpmap, fmtp, and rtcp-fb lines.
+        void RemoveFormat(uint32_t payloadType);
+
+        // Appends "a=<name>:<value>" to the section, or "a=<name>" if the value is empty.
+        void AddAttribute(const char *name, const std::string &value);
+
+        // The m= line can't be removed.
+        void RemoveLine(size_t index);
+
+    private:
+        friend class SdpSession;
+
+        explicit SdpMediaSection(SdpSession *session) : _session(session) {}
+
+        bool ParseMediaLine();
+        void RebuildMediaLine();
+        void ReplaceLine(size_t index, char type, const std::string &value);
+        void InsertLine(size_t index, char type, const std::string &value);
+
+        SdpSession *_session;
+        SdpToken _media;
+        SdpToken _port;
+        SdpToken _protocol;
+        std::vector<SdpToken> _formats;
+        std::vector<SdpLine> _lines;
+    };
+
+    /**
+     *  A session description, tokenized in a single pass. Lines are views into one copy of the source text, edits only
+     *  allocate the lines which they change, and Serialize() writes everything out again in a single pass.
+     *  Round trips are exact for CRLF terminated input, which is what WebRTC produces. Other input is written with CRLF.
+     *
+     *  The session can't be copied, since tokens point into it.
+     */
+    class SdpSession
+    {
+    public:
+        SdpSession() {}
+
+        // Returns false for anything that isn't a sequence of "<letter>=<value>" lines, starting with "v=".
+        bool Parse(const std::string &sdp);
+        std::string Serialize() const;
+
+        // The lines before the first m= line.
+        const std::vector<SdpLine> &Lines() const { return _lines; }
+
+        size_t MediaCount() const { return _media.size(); }
+        SdpMediaSection &Media(size_t index) { return _media[index]; }
+        const SdpMediaSection &Media(size_t index) const { return _media[index]; }
+
+        // The first section for `media` ("audio", "video"), or NULL.
+        SdpMediaSection *FindMedia(const char *media);
+
+    private:
+        friend class SdpMediaSection;
+
+        SdpSession(const SdpSession &);
+        SdpSession &operator=(const SdpSession &);
+
+        // Edited lines live here. A deque never moves what it already holds, so tokens stay valid.
+        SdpToken Store(const std::string &text);
+
+        std::string _source;
+        std::deque<std::string> _edits;
+        std::vector<SdpLine> _lines;
+        std::vector<SdpMediaSection> _media;
+    };
+
+} // namespace perch
+
+#endif
@@ -0,0 +1,212 @@
+//
+//  PHSdpPolicy.cpp
+//  PerchRTC
+//
+//  Created by Christopher Eagleston on 2015-07-22.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#include "PHSdpPolicy.h"
+
+#include <algorithm>
+
+namespace perch {
+
+    namespace {
+
+        bool IsForwardErrorCorrection(const SdpRtpMap &map)
+        {
+            SdpToken name = map.encodingName;
+            return name.EqualsIgnoringCase("red") || name.EqualsIgnoringCase("ulpfec") ||
+                   (name.size >= 7 && SdpToken(name.data, 7).EqualsIgnoringCase("flexfec"));
+        }
+
+        bool IsRetransmission(const SdpRtpMap &map)
+        {
+            return map.encodingName.EqualsIgnoringCase("rtx");
+        }
+
+        bool Contains(const std::vector<uint32_t> &values, uint32_t value)
+        {
+            return std::find(values.begin(), values.end(), value) != values.end();
+        }
+
+        // Drops "a=ssrc-group:FID <primary> <retransmission>" groups, and the lines for their retransmission SSRCs.
+        void RemoveRetransmissionSsrcs(SdpMediaSection &section)
+        {
+            std::vector<std::string> ssrcs;
+
+            for (int i = section.FindAttribute("ssrc-group"); i >= 0; i = section.FindAttribute("ssrc-group", i)) {
+                SdpToken semantics, members, primary, secondary;
+                SdpToken value = section.Lines()[i].attributeValue;
+
+                if (!value.Split(' ', &semantics, &members) || !semantics.Equals("FID")) {
+                    i++;
+                    continue;
+                }
+
+                if (members.Split(' ', &primary, &secondary)) {
+                    // Any further members are retransmission SSRCs too.
+
+                    SdpToken ssrc, rest = secondary;
+
+                    while (rest.Split(' ', &ssrc, &rest)) {
+                        ssrcs.push_back(ssrc.ToString());
+                    }
+                    ssrcs.push_back(rest.ToString());
+                }
+
+                section.RemoveLine(i);
+            }
+
+            for (size_t i = section.Lines().size(); i-- > 1;) {
+                const SdpLine &line = section.Lines()[i];
+                SdpToken ssrc, rest;
+
+                if (line.type == 'a' && line.attributeName.Equals("ssrc") && line.attributeValue.Split(' ', &ssrc, &rest) &&
+                    std::find(ssrcs.begin(), ssrcs.end(), ssrc.ToString()) != ssrcs.end()) {
+                    section.RemoveLine(i);
+                }
+            }
+        }
+
+        void Prune(const SdpMediaPolicy &policy, SdpMediaSection &section)
+        {
+            std::vector<SdpRtpMap> maps = section.RtpMaps();
+            std::vector<uint32_t> removed;
+            bool removedRetransmission = false;
+
+            if (policy.pruneForwardErrorCorrection) {
+                for (size_t i = 0; i < maps.size(); i++) {
+                    if (IsForwardErrorCorrection(maps[i])) {
+                        removed.push_back(maps[i].payloadType);
+                    }
+                }
+            }
+
+            // Retransmission for something which is going away has to go as well.
+
+            for (size_t i = 0; i < maps.size(); i++) {
+                uint32_t associated = 0;
+                SdpToken apt;
+
+                if (!IsRetransmission(maps[i])) {
+                    continue;
+                }
+
+                bool orphaned = section.FormatParameter(maps[i].payloadType, "apt", &apt) && apt.ToUInt(&associated) &&
+                                Contains(removed, associated);
+
+                if (policy.pruneRetransmission || orphaned) {
+                    removed.push_back(maps[i].payloadType);
+                    removedRetransmission = true;
+                }
+            }
+
+            // Never leave a section without any formats.
+
+            size_t remaining = 0;
+
+            for (size_t i = 0; i < section.Formats().size(); i++) {
+                uint32_t format = 0;
+
+                if (!section.Formats()[i].ToUInt(&format) || !Contains(removed, format)) {
+                    remaining++;
+                }
+            }
+
+            if (remaining == 0) {
+                return;
+            }
+
+            for (size_t i = 0; i < removed.size(); i++) {
+                section.RemoveFormat(removed[i]);
+            }
+
+            if (removedRetransmission) {
+                bool anyRetransmission = false;
+                std::vector<SdpRtpMap> remainingMaps = section.RtpMaps();
+
+                for (size_t i = 0; i < remainingMaps.size() && !anyRetransmission; i++) {
+                    anyRetransmission = IsRetransmission(remainingMaps[i]);
+                }
+
+                if (!anyRetransmission) {
+                    RemoveRetransmissionSsrcs(section);
+                }
+            }
+        }
+
+        void ApplyFrameHints(const SdpMediaPolicy &policy, SdpMediaSection &section)
+        {
+            std::vector<SdpRtpMap> maps = section.RtpMaps();
+
+            for (size_t i = 0; i < maps.size(); i++) {
+                const SdpRtpMap &map = maps[i];
+                bool isH264 = map.encodingName.EqualsIgnoringCase("H264");
+                bool isVPx = map.encodingName.EqualsIgnoringCase("VP8") || map.encodingName.EqualsIgnoringCase("VP9");
+
+                if (!isH264 && !isVPx) {
+                    continue;
+                }
+
+                if (policy.maxFrameSize > 0) {
+                    section.SetFormatParameter(map.payloadType, "max-fs", SdpUInt(policy.maxFrameSize));
+                }
+
+                // RFC 6184 has no frame rate parameter, H.264 takes macroblocks per second instead.
+
+                if (isVPx && policy.maxFrameRate > 0) {
+                    section.SetFormatParameter(map.payloadType, "max-fr", SdpUInt(policy.maxFrameRate));
+                }
+                else if (isH264 && policy.maxFrameRate > 0 && policy.maxFrameSize > 0) {
+                    section.SetFormatParameter(map.payloadType, "max-mbps", SdpUInt(policy.maxFrameRate * policy.maxFrameSize));
+                }
+            }
+        }
+
+        void ApplyMediaPolicy(const SdpMediaPolicy &policy, SdpMediaSection &section)
+        {
+            Prune(policy, section);
+
+            // Preferring each codec moves it to the front, so go from least to most preferred.
+
+            for (size_t i = policy.codecOrder.size(); i-- > 0;) {
+                section.PreferCodec(policy.codecOrder[i].encodingName.c_str(), policy.codecOrder[i].clockRate);
+            }
+
+            if (policy.maxBitrateKbps > 0) {
+                section.SetBandwidth("AS", policy.maxBitrateKbps);
+                section.SetBandwidth("TIAS", policy.maxBitrateKbps * 1000);
+            }
+
+            ApplyFrameHints(policy, section);
+        }
+
+    } // namespace
+
+    size_t ApplySdpPolicy(const SdpPolicy &policy, SdpSession *session)
+    {
+        size_t applied = 0;
+
+        for (size_t i = 0; i < session->MediaCount(); i++) {
+            SdpMediaSection &section = session->Media(i);
+
+            if (section.Port().Equals("0")) {
+                continue;
+            }
+
+            if (section.Media().Equals("audio")) {
+                ApplyMediaPolicy(policy.audio, section);
+                applied++;
+            }
+            else if (section.Media().Equals("video")) {
+                ApplyMediaPolicy(policy.video, section);
+                applied++;
+            }
+        }
+
+        return applied;
+    }
+
+} // namespace perch
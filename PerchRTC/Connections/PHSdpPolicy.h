@@ -0,0 +1,68 @@
+//
+//  PHSdpPolicy.h
+//  PerchRTC
+//
+//  Created by Christopher Eagleston on 2015-07-22.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#ifndef PerchRTC_PHSdpPolicy_h
+#define PerchRTC_PHSdpPolicy_h
+
+#include "PHSdp.h"
+
+#include <string>
+#include <vector>
+
+namespace perch {
+
+    struct SdpCodecPreference
+    {
+        SdpCodecPreference(const std::string &name, uint32_t rate = 0) : encodingName(name), clockRate(rate) {}
+
+        // Compared without regard to case, as RFC 4855 asks.
+        std::string encodingName;
+        // 0 matches any clock rate.
+        uint32_t clockRate;
+    };
+
+    // What to do with each media section of one type. The defaults leave a section alone.
+    struct SdpMediaPolicy
+    {
+        SdpMediaPolicy()
+        : maxBitrateKbps(0), maxFrameRate(0), maxFrameSize(0), pruneRetransmission(false), pruneForwardErrorCorrection(false)
+        {}
+
+        // Most preferred first. Codecs which aren't listed keep their order, after the listed ones.
+        std::vector<SdpCodecPreference> codecOrder;
+
+        // Written as b=AS (kbps) and b=TIAS (bps). 0 for no cap.
+        uint32_t maxBitrateKbps;
+
+        // Receive hints for the video codecs, as fmtp parameters (max-fr, max-fs, and max-mbps for H.264).
+        // The frame size is in 16x16 macroblocks. 0 for no hint.
+        uint32_t maxFrameRate;
+        uint32_t maxFrameSize;
+
+        // Removes rtx, along with the retransmission SSRCs.
+        bool pruneRetransmission;
+        // Removes red, ulpfec, and flexfec, and any rtx which protects them.
+        bool pruneForwardErrorCorrection;
+    };
+
+    struct SdpPolicy
+    {
+        SdpMediaPolicy audio;
+        SdpMediaPolicy video;
+    };
+
+    /**
+     *  Applies the policy to every audio and video section, including bundled and repeated ones. Rejected sections
+     *  (port 0) and data sections are left alone. The output only depends on the input and the policy, and applying a
+     *  policy twice gives the same result as applying it once. Returns the number of sections the policy applied to.
+     */
+    size_t ApplySdpPolicy(const SdpPolicy &policy, SdpSession *session);
+
+} // namespace perch
+
+#endif
@@ -25,11 +25,55 @@
 
 + (RTCMediaConstraints *)videoConstraintsForFormat:(PHVideoFormat)videoFormat;
 
+/**
+ *  Applies the configuration's codec preferences, bitrate caps, receive format hints, and rtx/fec choices to every
+ *  audio and video section of the description. Our send layers aren't offered with a=simulcast, since each peer is
+ *  sent a single layer by its own encoder. See conditionedRemoteDescription:.
+ *
+ *  @param sessionDescription The description to condition. It's returned as is if it can't be parsed.
+ *  @param configuration      The media configuration.
+ *  @param videoBitRate       The video cap in kbps, or 0 for none.
+ *
+ *  @return The conditioned description.
+ */
 + (RTCSessionDescription *)conditionedSessionDescription:(RTCSessionDescription *)sessionDescription
-                                              audioCodec:(PHAudioCodec)audioCodec
-                                              videoCodec:(PHVideoCodec)videoCodec
-                                            videoBitRate:(NSUInteger)videoBitRate
-                                            audioBitRate:(NSUInteger)audioBitRate;
+                                           configuration:(PHMediaConfiguration *)configuration
+                                            videoBitRate:(NSUInteger)videoBitRate;
+
+/**
+ *  Picks the layer to send a peer, from what its description asks of us and the connection's share of the send
+ *  budget, then caps the description's video bandwidth to that layer. WebRTC takes its send limits from the remote
+ *  description, so this is what holds each connection to its own layer.
+ *
+ *  @param sessionDescription The peer's description. It's returned as is if it can't be parsed.
+ *  @param configuration      The media configuration.
+ *  @param sendBitRate        This connection's share of the video send budget in kbps.
+ *  @param maxLayer           The largest layer the connection may be sent, or -1 for any.
+ *  @param layer              On input the layer currently sent, on output the one to send.
+ *
+ *  @return The conditioned description.
+ */
++ (RTCSessionDescription *)conditionedRemoteDescription:(RTCSessionDescription *)sessionDescription
+                                          configuration:(PHMediaConfiguration *)configuration
+                                            sendBitRate:(NSUInteger)sendBitRate
+                                               maxLayer:(NSInteger)maxLayer
+                                                  layer:(PHVideoLayer *)layer;
+
+/**
+ *  Each connection runs its own encoder, so every peer added to a room adds to the encode load. Plans the largest layer
+ *  each connection can be sent while all their encoders stay within the device's budget, stepping the largest layers
+ *  down first, and the earliest on a tie. The plan only depends on how many connections there are, so a peer joining
+ *  re-plans them all, and no connection's layer goes up.
+ *
+ *  @param configuration   The media configuration.
+ *  @param connectionCount How many connections there are.
+ *  @param encodeBudget    How many encoders the device can run at maxSendFormat in real time.
+ *
+ *  @return The largest layer to send each connection, as NSNumbers. Connections keep their place as the room grows.
+ */
++ (NSArray *)maxLayersForConfiguration:(PHMediaConfiguration *)configuration
+                       connectionCount:(NSUInteger)connectionCount
+                          encodeBudget:(NSUInteger)encodeBudget;
 
 
 @end
@@ -0,0 +1,245 @@
+//
+//  PHSessionDescriptionFactory.m
+//  PerchRTC
+//
+//  Created by Christopher Eagleston on 2015-01-17.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#import "PHSessionDescriptionFactory.h"
+
+#import "RTCMediaConstraints.h"
+#import "RTCPair.h"
+#import "RTCSessionDescription.h"
+
+#include "PHSdpPolicy.h"
+#include "PHSimulcast.h"
+
+// Layers narrower than this aren't worth decoding.
+static uint32_t PHSessionDescriptionFactoryMinimumLayerWidth = 160;
+
+@implementation PHSessionDescriptionFactory
+
+#pragma mark - Public
+
+// In the AppRTC example optional offer contraints are nil, but with Talky they include the data channels.
++ (RTCMediaConstraints *)offerConstraints
+{
+    return [self offerConstraintsRestartIce:NO];
+}
+
++ (RTCMediaConstraints *)offerConstraintsRestartIce:(BOOL)restartICE;
+{
+    NSArray *optional = nil;
+
+    if (restartICE) {
+        RTCPair *icePair = [[RTCPair alloc] initWithKey:@"IceRestart" value:@"true"];
+        optional = @[icePair];
+    }
+
+    RTCMediaConstraints *constraints = [[RTCMediaConstraints alloc] initWithMandatoryConstraints:[self mandatoryConstraints]
+                                                                             optionalConstraints:optional];
+
+    return constraints;
+}
+
++ (RTCMediaConstraints *)connectionConstraints
+{
+    RTCMediaConstraints *constraints = [[RTCMediaConstraints alloc] initWithMandatoryConstraints:[self mandatoryConstraints]
+                                                                             optionalConstraints:[self optionalConstraints]];
+    return constraints;
+}
+
++ (RTCMediaConstraints *)videoConstraints
+{
+    RTCMediaConstraints *constraints = [[RTCMediaConstraints alloc] initWithMandatoryConstraints:nil optionalConstraints:nil];
+    return constraints;
+}
+
++ (RTCMediaConstraints *)videoConstraintsForFormat:(PHVideoFormat)videoFormat
+{
+    NSArray *videoConstraints = [self constraintsForVideoFormat:videoFormat];
+    RTCMediaConstraints *constraints = [[RTCMediaConstraints alloc] initWithMandatoryConstraints:videoConstraints optionalConstraints:nil];
+    return constraints;
+}
+
++ (RTCSessionDescription *)conditionedSessionDescription:(RTCSessionDescription *)sessionDescription
+                                           configuration:(PHMediaConfiguration *)configuration
+                                            videoBitRate:(NSUInteger)videoBitRate
+{
+    // Parse once, edit in place, and write out once.
+
+    perch::SdpSession session;
+    NSString *sdp = sessionDescription.description;
+
+    if (!sdp || !session.Parse([sdp UTF8String])) {
+        DDLogWarn(@"Can't parse the session description, leaving it as is.");
+        return sessionDescription;
+    }
+
+    perch::SdpPolicy policy = [self policyForConfiguration:configuration videoBitRate:videoBitRate];
+
+    if (perch::ApplySdpPolicy(policy, &session) == 0) {
+        DDLogWarn(@"No audio or video sections to condition.");
+    }
+
+    NSString *sdpString = [NSString stringWithUTF8String:session.Serialize().c_str()];
+
+    return [[RTCSessionDescription alloc] initWithType:sessionDescription.type sdp:sdpString];
+}
+
++ (RTCSessionDescription *)conditionedRemoteDescription:(RTCSessionDescription *)sessionDescription
+                                          configuration:(PHMediaConfiguration *)configuration
+                                            sendBitRate:(NSUInteger)sendBitRate
+                                               maxLayer:(NSInteger)maxLayer
+                                                  layer:(PHVideoLayer *)layer
+{
+    NSParameterAssert(layer);
+
+    perch::SdpSession session;
+    perch::SimulcastReceiveCapacity capacity;
+    NSString *sdp = sessionDescription.description;
+
+    if (!sdp || !session.Parse([sdp UTF8String])) {
+        DDLogWarn(@"Can't parse the remote session description, leaving it as is.");
+        return sessionDescription;
+    }
+
+    if (!perch::ReadSimulcastReceiveCapacity(session, &capacity)) {
+        *layer = PHVideoLayerNone;
+        return sessionDescription;
+    }
+
+    std::vector<perch::SimulcastLayer> layers = [self layersForConfiguration:configuration];
+
+    if (maxLayer >= 0 && (size_t)maxLayer + 1 < layers.size()) {
+        layers.resize(maxLayer + 1);
+    }
+
+    int index = perch::SelectSimulcastLayer(layers, capacity, (uint32_t)sendBitRate, (int)layer->index);
+
+    if (index < 0) {
+        *layer = PHVideoLayerNone;
+        return sessionDescription;
+    }
+
+    // A peer is sent its layer on its own, so the layer gets the connection's whole share up to its peak.
+
+    const perch::SimulcastLayer &selected = layers[index];
+    uint32_t bitRate = MIN(selected.maxBitrateKbps, (uint32_t)sendBitRate);
+
+    if (capacity.maxBitrateKbps > 0) {
+        bitRate = MIN(bitRate, capacity.maxBitrateKbps);
+    }
+
+    layer->index = index;
+    layer->format = configuration.maxSendFormat;
+    layer->format.dimensions = (CMVideoDimensions){(int32_t)selected.width, (int32_t)selected.height};
+    layer->format.frameRate = capacity.maxFrameRate > 0 ? MIN(selected.frameRate, capacity.maxFrameRate) : selected.frameRate;
+    layer->bitRate = bitRate;
+    layer->maxBitRate = capacity.maxBitrateKbps;
+
+    for (size_t i = 0; i < session.MediaCount(); i++) {
+        perch::SdpMediaSection &section = session.Media(i);
+
+        if (section.Media().Equals("video") && !section.Port().Equals("0")) {
+            section.SetBandwidth("AS", bitRate);
+            section.SetBandwidth("TIAS", bitRate * 1000);
+        }
+    }
+
+    NSString *sdpString = [NSString stringWithUTF8String:session.Serialize().c_str()];
+
+    return [[RTCSessionDescription alloc] initWithType:sessionDescription.type sdp:sdpString];
+}
+
++ (NSArray *)maxLayersForConfiguration:(PHMediaConfiguration *)configuration
+                       connectionCount:(NSUInteger)connectionCount
+                          encodeBudget:(NSUInteger)encodeBudget
+{
+    std::vector<perch::SimulcastLayer> layers = [self layersForConfiguration:configuration];
+    std::vector<int> planned = perch::PlanSimulcastEncodeBudget(layers, connectionCount, encodeBudget * perch::SimulcastEncodeRate(layers.back()));
+    NSMutableArray *maxLayers = [NSMutableArray arrayWithCapacity:planned.size()];
+
+    for (size_t i = 0; i < planned.size(); i++) {
+        [maxLayers addObject:@(planned[i])];
+    }
+
+    return maxLayers;
+}
+
+#pragma mark - Private
+
++ (NSArray *)constraintsForVideoFormat:(PHVideoFormat)format
+{
+    RTCPair *maxWidth = [[RTCPair alloc] initWithKey:@"maxWidth" value:[NSString stringWithFormat:@"%d", format.dimensions.width]];
+    RTCPair *maxHeight = [[RTCPair alloc] initWithKey:@"maxHeight" value:[NSString stringWithFormat:@"%d", format.dimensions.height]];
+    RTCPair *minWidth = [[RTCPair alloc] initWithKey:@"minWidth" value:@"240"];
+    RTCPair *minHeight = [[RTCPair alloc] initWithKey:@"minHeight" value:@"160"];
+
+    return @[maxWidth, maxHeight, minWidth, minHeight];
+}
+
++ (NSArray *)mandatoryConstraints
+{
+    RTCPair *audioPair = [[RTCPair alloc] initWithKey:@"OfferToReceiveAudio" value:@"true"];
+    RTCPair *videoPair = [[RTCPair alloc] initWithKey:@"OfferToReceiveVideo" value:@"true"];
+
+    return @[ audioPair, videoPair ];
+}
+
++ (NSArray *)optionalConstraints
+{
+    NSArray *optionalConstraints = @[[[RTCPair alloc] initWithKey:@"internalSctpDataChannels" value:@"true"],
+                                     [[RTCPair alloc] initWithKey:@"DtlsSrtpKeyAgreement" value:@"true"]];
+    return optionalConstraints;
+}
+
++ (perch::SdpPolicy)policyForConfiguration:(PHMediaConfiguration *)configuration videoBitRate:(NSUInteger)videoBitRate
+{
+    perch::SdpPolicy policy;
+
+    // Audio
+
+    if (configuration.preferredAudioCodec == PHAudioCodecISAC) {
+        policy.audio.codecOrder.push_back(perch::SdpCodecPreference("ISAC", 16000));
+    }
+    else {
+        policy.audio.codecOrder.push_back(perch::SdpCodecPreference("opus", 48000));
+    }
+
+    policy.audio.maxBitrateKbps = (uint32_t)configuration.maxAudioBitrate;
+
+    // Video
+
+    PHVideoFormat format = configuration.preferredReceiverFormat;
+
+    policy.video.codecOrder.push_back(perch::SdpCodecPreference(configuration.preferredVideoCodec == PHVideoCodecH264 ? "H264" : "VP8"));
+    policy.video.maxBitrateKbps = (uint32_t)videoBitRate;
+    policy.video.maxFrameRate = (uint32_t)round(format.frameRate);
+    policy.video.maxFrameSize = perch::SdpFrameSizeInMacroblocks(format.dimensions.width, format.dimensions.height);
+    policy.video.pruneRetransmission = !configuration.videoRetransmissionEnabled;
+    policy.video.pruneForwardErrorCorrection = !configuration.videoForwardErrorCorrectionEnabled;
+
+    return policy;
+}
+
++ (std::vector<perch::SimulcastLayer>)layersForConfiguration:(PHMediaConfiguration *)configuration
+{
+    PHVideoFormat format = configuration.maxSendFormat;
+    std::vector<perch::SimulcastLayer> layers = perch::ScaleSimulcastLayers(format.dimensions.width,
+                                                                            format.dimensions.height,
+                                                                            (uint32_t)round(format.frameRate),
+                                                                            MAX(configuration.sendLayerCount, 1),
+                                                                            PHSessionDescriptionFactoryMinimumLayerWidth);
+
+    for (size_t i = 0; i < layers.size(); i++) {
+        PHVideoFormat layerFormat = format;
+        layerFormat.dimensions = (CMVideoDimensions){(int32_t)layers[i].width, (int32_t)layers[i].height};
+        layers[i].maxBitrateKbps = (uint32_t)PHVideoFormatComputePeakRate(layerFormat, PHMediaSessionTargetBpp, PHMediaSessionMaximumVideoRate);
+    }
+
+    return layers;
+}
+
+@end
@@ -0,0 +1,229 @@
+//
+//  PHSimulcast.cpp
+//  PerchRTC
+//
+//  Created by Christopher Eagleston on 2015-07-27.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#include "PHSimulcast.h"
+
+#include <algorithm>
+
+namespace perch {
+
+    namespace {
+
+        // A layer sent on its own needs at least half its peak rate.
+        const uint32_t kSimulcastSelectShare = 2;
+
+        // Moving up a layer needs this much more than the layer's minimum, as a fraction (5/4).
+        const uint64_t kSimulcastUpSwitchNumerator = 5;
+        const uint64_t kSimulcastUpSwitchDenominator = 4;
+
+    } // namespace
+
+    const int64_t SimulcastStepDown::kNoTime;
+
+    std::vector<SimulcastLayer> ScaleSimulcastLayers(uint32_t width, uint32_t height, uint32_t frameRate, size_t count,
+                                                     uint32_t minWidth)
+    {
+        std::vector<SimulcastLayer> layers;
+
+        while (layers.size() < count && width > 0 && height > 0 && (layers.empty() || width >= minWidth)) {
+            SimulcastLayer layer;
+            layer.width = width;
+            layer.height = height;
+            layer.frameRate = frameRate;
+            layers.push_back(layer);
+
+            // Keep the dimensions even, for 4:2:0.
+
+            width = (width / 2) & ~1u;
+            height = (height / 2) & ~1u;
+        }
+
+        std::reverse(layers.begin(), layers.end());
+
+        return layers;
+    }
+
+    int SelectSimulcastLayer(const std::vector<SimulcastLayer> &layers, const SimulcastReceiveCapacity &capacity,
+                             uint32_t budgetKbps, int currentLayer)
+    {
+        uint64_t available = budgetKbps;
+        int selected = layers.empty() ? -1 : 0;
+
+        if (capacity.maxBitrateKbps > 0) {
+            available = std::min(available, (uint64_t)capacity.maxBitrateKbps);
+        }
+
+        for (size_t i = 1; i < layers.size(); i++) {
+            const SimulcastLayer &layer = layers[i];
+            uint64_t needed = layer.maxBitrateKbps / kSimulcastSelectShare;
+
+            if (currentLayer >= 0 && (int)i > currentLayer) {
+                needed = needed * kSimulcastUpSwitchNumerator / kSimulcastUpSwitchDenominator;
+            }
+
+            bool fitsSize = capacity.maxFrameSize == 0 || SdpFrameSizeInMacroblocks(layer.width, layer.height) <= capacity.maxFrameSize;
+
+            if (fitsSize && needed <= available) {
+                selected = (int)i;
+            }
+        }
+
+        return selected;
+    }
+
+    uint64_t SimulcastEncodeRate(const SimulcastLayer &layer)
+    {
+        return (uint64_t)SdpFrameSizeInMacroblocks(layer.width, layer.height) * layer.frameRate;
+    }
+
+    void FitSimulcastEncodeBudget(const std::vector<SimulcastLayer> &layers, uint64_t budget, std::vector<int> *selected)
+    {
+        std::vector<int> &indexes = *selected;
+        uint64_t total = 0;
+
+        for (size_t i = 0; i < indexes.size(); i++) {
+            indexes[i] = std::min(indexes[i], (int)layers.size() - 1);
+            total += indexes[i] >= 0 ? SimulcastEncodeRate(layers[indexes[i]]) : 0;
+        }
+
+        while (total > budget) {
+            size_t largest = 0;
+
+            for (size_t i = 1; i < indexes.size(); i++) {
+                if (indexes[i] > indexes[largest]) {
+                    largest = i;
+                }
+            }
+
+            if (indexes.empty() || indexes[largest] <= 0) {
+                break;
+            }
+
+            total -= SimulcastEncodeRate(layers[indexes[largest]]) - SimulcastEncodeRate(layers[indexes[largest] - 1]);
+            indexes[largest]--;
+        }
+    }
+
+    std::vector<int> PlanSimulcastEncodeBudget(const std::vector<SimulcastLayer> &layers, size_t connectionCount, uint64_t budget)
+    {
+        std::vector<int> planned(connectionCount, (int)layers.size() - 1);
+
+        FitSimulcastEncodeBudget(layers, budget, &planned);
+
+        return planned;
+    }
+
+    bool SimulcastStepDown::OnOverBudget(const std::string &key, bool isInitiator, int64_t nowMs)
+    {
+        if (isInitiator || _due.count(key)) {
+            Remove(key);
+            return true;
+        }
+
+        std::map<std::string, int64_t>::iterator waiting = _waiting.find(key);
+
+        if (waiting == _waiting.end()) {
+            _waiting[key] = nowMs + _receiverTakeoverMs;
+            return false;
+        }
+
+        if (waiting->second > nowMs) {
+            return false;
+        }
+
+        Remove(key);
+
+        return true;
+    }
+
+    void SimulcastStepDown::Poll(int64_t nowMs, std::vector<std::string> *keys)
+    {
+        std::map<std::string, int64_t>::iterator it = _waiting.begin();
+
+        while (it != _waiting.end()) {
+            if (it->second > nowMs) {
+                ++it;
+                continue;
+            }
+
+            keys->push_back(it->first);
+            _due.insert(it->first);
+            _waiting.erase(it++);
+        }
+    }
+
+    int64_t SimulcastStepDown::NextDueMs() const
+    {
+        int64_t next = kNoTime;
+
+        for (std::map<std::string, int64_t>::const_iterator it = _waiting.begin(); it != _waiting.end(); ++it) {
+            if (next == kNoTime || it->second < next) {
+                next = it->second;
+            }
+        }
+
+        return next;
+    }
+
+    void SimulcastStepDown::Remove(const std::string &key)
+    {
+        _waiting.erase(key);
+        _due.erase(key);
+    }
+
+    bool ReadSimulcastReceiveCapacity(const SdpSession &session, SimulcastReceiveCapacity *capacity)
+    {
+        const SdpMediaSection *video = NULL;
+
+        for (size_t i = 0; i < session.MediaCount() && !video; i++) {
+            const SdpMediaSection &section = session.Media(i);
+
+            if (section.Media().Equals("video") && !section.Port().Equals("0")) {
+                video = &section;
+            }
+        }
+
+        if (!video) {
+            return false;
+        }
+
+        *capacity = SimulcastReceiveCapacity();
+
+        uint32_t bitrate = 0;
+
+        if (video->Bandwidth("AS", &bitrate)) {
+            capacity->maxBitrateKbps = bitrate;
+        }
+        else if (video->Bandwidth("TIAS", &bitrate)) {
+            capacity->maxBitrateKbps = bitrate / 1000;
+        }
+
+        // The first format is the one which will be used, so its hints are the ones that count.
+
+        uint32_t payloadType = 0;
+
+        if (!video->Formats().empty() && video->Formats()[0].ToUInt(&payloadType)) {
+            SdpToken value;
+            uint32_t macroblocksPerSecond = 0;
+
+            if (video->FormatParameter(payloadType, "max-fs", &value)) {
+                value.ToUInt(&capacity->maxFrameSize);
+            }
+            if (video->FormatParameter(payloadType, "max-fr", &value)) {
+                value.ToUInt(&capacity->maxFrameRate);
+            }
+            else if (capacity->maxFrameSize > 0 && video->FormatParameter(payloadType, "max-mbps", &value) &&
+                     value.ToUInt(&macroblocksPerSecond)) {
+                capacity->maxFrameRate = macroblocksPerSecond / capacity->maxFrameSize;
+            }
+        }
+
+        return true;
+    }
+
+} // namespace perch
@@ -0,0 +1,125 @@
+//
+//  PHSimulcast.h
+//  PerchRTC
+//
+//  Created by Christopher Eagleston on 2015-07-27.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#ifndef PerchRTC_PHSimulcast_h
+#define PerchRTC_PHSimulcast_h
+
+#include "PHSdp.h"
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace perch {
+
+    struct SimulcastLayer
+    {
+        SimulcastLayer() : width(0), height(0), frameRate(0), maxBitrateKbps(0) {}
+
+        uint32_t width;
+        uint32_t height;
+        uint32_t frameRate;
+        // The peak rate for the layer. Anything above it is wasted.
+        uint32_t maxBitrateKbps;
+    };
+
+    // What a peer asks of our video, read from its session description. 0 for no limit.
+    struct SimulcastReceiveCapacity
+    {
+        SimulcastReceiveCapacity() : maxBitrateKbps(0), maxFrameSize(0), maxFrameRate(0) {}
+
+        uint32_t maxBitrateKbps;
+        // In 16x16 macroblocks.
+        uint32_t maxFrameSize;
+        uint32_t maxFrameRate;
+    };
+
+    /**
+     *  Scales a format down by halves, up to `count` layers, stopping before a layer would be narrower than
+     *  `minWidth`. Layers come smallest first. Bitrates are left at 0 for the caller to fill in.
+     */
+    std::vector<SimulcastLayer> ScaleSimulcastLayers(uint32_t width, uint32_t height, uint32_t frameRate, size_t count,
+                                                     uint32_t minWidth);
+
+    /**
+     *  Picks the largest layer to send one peer on its own, which is one that fits the peer's size limit.
+     *  The layer also needs at least half its peak rate from the lesser of `budgetKbps` and the peer's bitrate limit,
+     *  and a quarter more than that to move up from `currentLayer`, so that a peer sitting on the boundary doesn't
+     *  flap between layers. Pass -1 when nothing is selected yet. When nothing fits, the smallest layer is chosen
+     *  anyway. Returns -1 only if there are no layers.
+     */
+    int SelectSimulcastLayer(const std::vector<SimulcastLayer> &layers, const SimulcastReceiveCapacity &capacity,
+                             uint32_t budgetKbps, int currentLayer);
+
+    // The layer's encode rate, in 16x16 macroblocks per second.
+    uint64_t SimulcastEncodeRate(const SimulcastLayer &layer);
+
+    /**
+     *  Every connection runs its own encoder, so the device's encode rate is split between them. Steps down the largest
+     *  of the `selected` layer indexes, the earliest of them on a tie, until their total encode rate fits `budget`
+     *  macroblocks per second, or they are all on the smallest layer. An index of -1 isn't encoded.
+     */
+    void FitSimulcastEncodeBudget(const std::vector<SimulcastLayer> &layers, uint64_t budget, std::vector<int> *selected);
+
+    /**
+     *  The largest layer each of `connectionCount` connections may be sent within `budget`, fitted from the top layer.
+     *  The plan only depends on how many connections there are, so each one added re-plans them all, and every layer
+     *  either stays or steps down.
+     */
+    std::vector<int> PlanSimulcastEncodeBudget(const std::vector<SimulcastLayer> &layers, size_t connectionCount, uint64_t budget);
+
+    /**
+     *  Decides which side offers to step down a layer which is over the room's plan. Both sides re-plan when a peer
+     *  joins, and without rollback an offer from each at once would leave the connection stuck. The initiator offers
+     *  straight away. The receiver waits for that offer, whose answer re-plans its own layer, and only takes over if
+     *  its layer is still over the plan after `receiverTakeoverMs`, as when the initiator's plan has room for it.
+     *
+     *  Time is passed in, so that a simulated clock can drive it.
+     */
+    class SimulcastStepDown
+    {
+    public:
+        static const int64_t kNoTime = -1;
+
+        explicit SimulcastStepDown(int64_t receiverTakeoverMs = 6000) : _receiverTakeoverMs(receiverTakeoverMs) {}
+
+        // The connection is stable and sending more than its planned layer. Returns whether to offer now.
+        bool OnOverBudget(const std::string &key, bool isInitiator, int64_t nowMs);
+
+        // The connection is sending within its planned layer.
+        void OnFitted(const std::string &key) { Remove(key); }
+
+        // Moves the receivers whose wait is over into `keys`. Each is offered for at its next OnOverBudget.
+        void Poll(int64_t nowMs, std::vector<std::string> *keys);
+
+        // When Poll next has something to do, or kNoTime.
+        int64_t NextDueMs() const;
+
+        void Remove(const std::string &key);
+
+    private:
+        SimulcastStepDown(const SimulcastStepDown &) = delete;
+        SimulcastStepDown &operator=(const SimulcastStepDown &) = delete;
+
+        int64_t _receiverTakeoverMs;
+        // Receivers waiting for the initiator's offer, and when they take over.
+        std::map<std::string, int64_t> _waiting;
+        std::set<std::string> _due;
+    };
+
+    /**
+     *  Reads the first active video section. Returns false if there isn't one. Our layers are never offered with
+     *  a=simulcast, since each peer has its own encoder, so a peer's "a=simulcast:recv" list can't name them and isn't
+     *  read.
+     */
+    bool ReadSimulcastReceiveCapacity(const SdpSession &session, SimulcastReceiveCapacity *capacity);
+
+} // namespace perch
+
+#endif
@@ -17,6 +17,17 @@
 @class XSRoom;
 @class AFNetworkReachabilityManager;
 
+typedef struct {
+    /* Times signaling was lost while we had media connections, and those it came back in time to keep them. */
+    NSUInteger attempts;
+    NSUInteger resumptions;
+    /* Resumptions which reused the last socket token, rather than fetching a new one. */
+    NSUInteger cachedTokenResumptions;
+    /* From losing signaling to rejoining the room. */
+    NSTimeInterval lastResumeTime;
+    NSTimeInterval maxResumeTime;
+} PHSessionResumptionMetrics;
+
 // Provides information about connected streams, errors and final disconnections.
 @protocol PHConnectionBrokerDelegate<NSObject>
 
@@ -50,6 +61,15 @@
 
 @property (nonatomic, strong, readonly) AFNetworkReachabilityManager *reachability;
 
+/**
+ *  When signaling is lost, or the network changes, media connections are kept while the broker reconnects to the room.
+ *  The socket is reopened with the last token if it is still accepted, and connections are ICE restarted rather than
+ *  rebuilt. Defaults to YES.
+ */
+@property (nonatomic, assign) BOOL sessionResumptionEnabled;
+
+@property (nonatomic, assign, readonly) PHSessionResumptionMetrics sessionResumptionMetrics;
+
 - (instancetype)initWithDelegate:(id<PHConnectionBrokerDelegate>)delegate;
 
 - (BOOL)connectToRoom:(XSRoom *)room withConfiguration:(PHMediaConfiguration *)configuration;
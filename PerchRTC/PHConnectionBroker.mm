@@ -15,6 +15,7 @@
 
 #import "PHErrors.h"
 #import "PHCredentials.h"
+#import "PHIceServerCache.h"
 #import "PHMediaSession.h"
 #import "PHPeerConnection.h"
 
@@ -34,15 +35,31 @@
 
 #import "AFNetworkReachabilityManager.h"
 
+#include "PHSessionResumption.h"
+
 @import AVFoundation;
 
-static NSUInteger kPHConnectionManagerMaxIceAttempts = 3;
 static NSUInteger kPHConnectionManagerMaxWebSocketAuthAttempts = 3;
 
-// This is the maximum number of remote peers allowed in the room, not including yourself.
-// In this case we only allow 3 people in one room.
+// This is the maximum number of remote peers allowed in the room, not including yourself, unless large rooms are
+// enabled. Each remote peer runs its own encoder, and the device can only keep up with two at the send format.
 static NSUInteger kPHConnectionManagerMaxRoomPeers = 2;
 
+// With this set, rooms take up to 6 people. The media session re-plans every connection's send layer as peers join,
+// but a layer only caps the bitrate, and each connection still encodes the shared capture at the send format. Off
+// until each connection's encode can be scaled to its layer.
+static BOOL kPHConnectionManagerLargeRoomsEnabled = NO;
+static NSUInteger kPHConnectionManagerMaxLargeRoomPeers = 5;
+
+// Connections kept ready for peers who join after us. Never more than the room has space for.
+static NSUInteger kPHConnectionManagerConnectionPoolSize = 1;
+
+// Media connections are closed if signaling can't be resumed within this time.
+static NSTimeInterval kPHConnectionManagerResumeTimeout = 30;
+
+// A peer which leaves the room may be resuming its own session. Its connection is kept this long for it to come back.
+static NSTimeInterval kPHConnectionManagerPeerResumeInterval = 10;
+
 #if !TARGET_IPHONE_SIMULATOR
 static BOOL kPHConnectionManagerUseCaptureKit = YES;
 #endif
@@ -51,6 +68,11 @@ static NSString *XSWebSocketDefaultAddress = @"wss://endpoint01.uswest.xirsys.co
 
 static NSURL *peerServerURL = nil;
 
+static int64_t PHConnectionBrokerNowMs()
+{
+    return (int64_t)([[NSProcessInfo processInfo] systemUptime] * 1000);
+}
+
 @interface PHConnectionBroker() <PHSignalingDelegate, XSPeerClientDelegate, XSRoomObserver>
 
 @property (nonatomic, strong) XSClient *apiClient;
@@ -64,15 +86,22 @@ static NSURL *peerServerURL = nil;
 #endif
 
 @property (nonatomic, strong) AFNetworkReachabilityManager *reachability;
+@property (nonatomic, assign) AFNetworkReachabilityStatus reachabilityStatus;
 @property (nonatomic, assign) NSUInteger retryCount;
 
+// When the pending resumption poll is due, or perch::SessionResumption::kNoTime.
+@property (nonatomic, assign) int64_t sessionResumptionDueMs;
+
 @property (nonatomic, strong) NSURLSessionDataTask *socketURLTask;
 @property (nonatomic, strong) NSURLSessionDataTask *socketTokenTask;
-@property (nonatomic, strong) NSURLSessionDataTask *iceServersTask;
+@property (nonatomic, strong) PHIceServerCache *iceServerCache;
 
 @end
 
 @implementation PHConnectionBroker
+{
+    perch::SessionResumption _sessionResumption;
+}
 
 #pragma mark - Init & Dealloc
 
@@ -82,6 +111,14 @@ static NSURL *peerServerURL = nil;
     if (self) {
         _delegate = delegate;
         _mutableRemoteStreams = [NSMutableArray array];
+        _sessionResumptionEnabled = YES;
+
+        perch::SessionResumptionConfig resumptionConfig;
+        resumptionConfig.resumeTimeoutMs = (int64_t)(kPHConnectionManagerResumeTimeout * 1000);
+        resumptionConfig.peerResumeIntervalMs = (int64_t)(kPHConnectionManagerPeerResumeInterval * 1000);
+
+        _sessionResumption = perch::SessionResumption(resumptionConfig);
+        _sessionResumptionDueMs = perch::SessionResumption::kNoTime;
     }
     return self;
 }
@@ -153,12 +190,43 @@ static NSURL *peerServerURL = nil;
     return [self.mutableRemoteStreams copy];
 }
 
+- (PHSessionResumptionMetrics)sessionResumptionMetrics
+{
+    const perch::SessionResumptionMetrics &resumptionMetrics = _sessionResumption.Metrics();
+    PHSessionResumptionMetrics metrics;
+
+    metrics.attempts = (NSUInteger)resumptionMetrics.attempts;
+    metrics.resumptions = (NSUInteger)resumptionMetrics.resumptions;
+    metrics.cachedTokenResumptions = (NSUInteger)resumptionMetrics.cachedTokenResumptions;
+    metrics.lastResumeTime = resumptionMetrics.lastResumeMs / 1000.0;
+    metrics.maxResumeTime = resumptionMetrics.maxResumeMs / 1000.0;
+
+    return metrics;
+}
+
 #pragma mark - Private
 
 - (void)setupAPIClient
 {
     XSClient *apiClient = [[XSClient alloc] initWithUsername:kPHConnectionManagerXSUsername secretKey:kPHConnectionManagerXSSecretKey];
     self.apiClient = apiClient;
+
+    __weak PHConnectionBroker *weakSelf = self;
+
+    self.iceServerCache = [[PHIceServerCache alloc] initWithFetch:^NSURLSessionDataTask *(PHIceServersCompletion completion) {
+        XSRoom *room = weakSelf.room;
+
+        DDLogVerbose(@"Fetching ICE servers for room: %@", room);
+
+        return [weakSelf.apiClient getIceServersForDomain:kPHConnectionManagerDomain
+                                              application:kPHConnectionManagerApplication
+                                                     room:room.name
+                                                 username:room.localPeer.identifier
+                                                   secure:YES
+                                               completion:^(NSArray *collection, NSError *error) {
+                                                   completion(error ? nil : [weakSelf parseIceServers:collection], error);
+                                               }];
+    }];
 }
 
 - (void)setupMediaSessionWithConfiguration:(PHMediaConfiguration *)config
@@ -189,6 +257,7 @@ static NSURL *peerServerURL = nil;
 - (void)setupReachability
 {
     self.reachability = [AFNetworkReachabilityManager managerForDomain:@"api.xirsys.com"];
+    self.reachabilityStatus = AFNetworkReachabilityStatusUnknown;
 
     __weak typeof(self) weakSelf = self;
 
@@ -198,6 +267,7 @@ static NSURL *peerServerURL = nil;
             weakSelf.retryCount = 0;
         }
 
+        [weakSelf reachabilityDidChange:status];
         [weakSelf checkAuthorizationStatus];
     }];
 
@@ -242,6 +312,7 @@ static NSURL *peerServerURL = nil;
 
             if (!error) {
                 NSString *token = [self parseSocketCredentials:object];
+                _sessionResumption.OnTokenFetched();
                 [self.room authorizeWithToken:token url:peerServerURL];
                 [self.peerClient connect];
             }
@@ -271,8 +342,12 @@ static NSURL *peerServerURL = nil;
     BOOL authorizationInProgress = self.socketTokenTask != nil || self.socketURLTask != nil;
     BOOL isReachable = self.reachability.isReachable;
     BOOL retryAllowed = self.retryCount < kPHConnectionManagerMaxWebSocketAuthAttempts;
+    BOOL canReuseToken = _sessionResumption.CanReuseToken();
 
-    if (!isAuthorized && !authorizationInProgress && isReachable && retryAllowed) {
+    if (!isAuthorized && !authorizationInProgress && isReachable && canReuseToken) {
+        [self connectWithCachedToken];
+    }
+    else if (!isAuthorized && !authorizationInProgress && isReachable && retryAllowed) {
         [self authorizePeerClient];
     }
     else if (!retryAllowed) {
@@ -280,24 +355,154 @@ static NSURL *peerServerURL = nil;
     }
 }
 
-- (void)fetchICEServersAndSetupPeerConnectionForRoom:(XSRoom *)room peer:(XSPeer *)peer connectionId:(NSString *)connectionId offer:(RTCSessionDescription *)offerSDP
+- (void)connectWithCachedToken
 {
-    XSArrayCompletion iceServersHandler = ^(NSArray *collection, NSError *error) {
+    DDLogInfo(@"Reconnecting to signaling with the last token.");
 
-        dispatch_async(dispatch_get_main_queue(), ^{
-            if (!error) {
-                NSArray *servers = [self parseIceServers:collection];
+    // If the token has expired, the next attempt fetches a new one.
+
+    std::string cachedToken = _sessionResumption.TakeCachedToken();
+    NSString *token = [NSString stringWithUTF8String:cachedToken.c_str()];
+
+    [self.room authorizeWithToken:token url:peerServerURL];
+    [self.peerClient connect];
+}
+
+- (void)reachabilityDidChange:(AFNetworkReachabilityStatus)status
+{
+    BOOL isReachable = status == AFNetworkReachabilityStatusReachableViaWiFi || status == AFNetworkReachabilityStatusReachableViaWWAN;
+    BOOL isNetworkChange = isReachable && self.reachabilityStatus != AFNetworkReachabilityStatusUnknown && status != self.reachabilityStatus;
+
+    self.reachabilityStatus = status;
+
+    if (!isNetworkChange || !self.sessionResumptionEnabled || self.mediaSession.connectionCount == 0) {
+        return;
+    }
+
+    DDLogInfo(@"Network changed to: %@", AFStringFromNetworkReachabilityStatus(status));
+
+    // Our candidates are on the old network, and so is the socket, which could take a long time to notice. Drop the
+    // socket first, so that the restarts wait for the new one.
+
+    [self.peerClient abandonConnection];
+    [self.mediaSession restartIceForNetworkChange];
+}
+
+- (void)beginSessionResumption
+{
+    if (!self.sessionResumptionEnabled || !_sessionResumption.OnSignalingLost(self.mediaSession.connectionCount, PHConnectionBrokerNowMs())) {
+        return;
+    }
+
+    DDLogInfo(@"Lost signaling with %lu connections. Resuming.", (unsigned long)self.mediaSession.connectionCount);
+
+    [self scheduleSessionResumption];
+}
+
+- (void)finishSessionResumptionInRoom:(XSRoom *)room
+{
+    BOOL usingCachedToken = _sessionResumption.IsUsingCachedToken();
+    std::vector<std::string> missingPeers;
+
+    // Peers who left while we were away weren't announced.
+
+    for (PHPeerConnection *connection in self.mediaSession.connections) {
+        if (!room.peers[connection.peerId]) {
+            missingPeers.push_back([connection.peerId UTF8String]);
+        }
+    }
+
+    int64_t resumeMs = _sessionResumption.OnJoined([room.authToken UTF8String] ?: "", missingPeers, PHConnectionBrokerNowMs());
+
+    if (resumeMs != perch::SessionResumption::kNoTime) {
+        const perch::SessionResumptionMetrics &metrics = _sessionResumption.Metrics();
+
+        DDLogInfo(@"Resumed signaling in %lld ms%@. %llu of %llu resumed.", (long long)resumeMs, usingCachedToken ? @" with the last token" : @"",
+                  (unsigned long long)metrics.resumptions, (unsigned long long)metrics.attempts);
+    }
+
+    [self scheduleSessionResumption];
+}
+
+- (void)closeConnectionUnlessPeerResumes:(NSString *)peerId
+{
+    if (!self.sessionResumptionEnabled) {
+        [self.mediaSession closeConnectionWithPeer:peerId];
+        return;
+    }
+
+    _sessionResumption.OnPeerLeft([peerId UTF8String], PHConnectionBrokerNowMs());
+
+    [self scheduleSessionResumption];
+}
+
+- (void)scheduleSessionResumption
+{
+    int64_t dueMs = _sessionResumption.NextDueMs();
+
+    if (dueMs == perch::SessionResumption::kNoTime) {
+        return;
+    }
+
+    int64_t delayMs = dueMs - PHConnectionBrokerNowMs();
+
+    if (delayMs <= 0) {
+        [self pollSessionResumption];
+        return;
+    }
+
+    // Only a poll which is already sooner will do.
+
+    if (self.sessionResumptionDueMs != perch::SessionResumption::kNoTime && self.sessionResumptionDueMs <= dueMs) {
+        return;
+    }
+
+    self.sessionResumptionDueMs = dueMs;
+
+    __weak typeof(self) weakSelf = self;
+
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, delayMs * NSEC_PER_MSEC), dispatch_get_main_queue(), ^{
+        PHConnectionBroker *strongSelf = weakSelf;
+
+        if (strongSelf.sessionResumptionDueMs == dueMs) {
+            strongSelf.sessionResumptionDueMs = perch::SessionResumption::kNoTime;
+        }
+
+        [strongSelf pollSessionResumption];
+    });
+}
+
+- (void)pollSessionResumption
+{
+    std::vector<perch::SessionResumptionAction> actions;
 
-                [self.mediaSession addIceServers:servers singleUse:YES];
+    _sessionResumption.Poll(PHConnectionBrokerNowMs(), &actions);
+
+    for (size_t i = 0; i < actions.size(); i++) {
+        const perch::SessionResumptionAction &action = actions[i];
+
+        if (action.type == perch::SessionResumptionActionAbandon) {
+            DDLogWarn(@"Couldn't resume signaling. Closing %lu connections.", (unsigned long)self.mediaSession.connectionCount);
+
+            for (PHPeerConnection *connection in self.mediaSession.connections) {
+                [self.mediaSession closeConnectionWithPeer:connection.peerId];
             }
-            else {
-                [self.delegate connectionBroker:self didFailWithError:error];
+        }
+        else {
+            NSString *peerId = [NSString stringWithUTF8String:action.peerId.c_str()];
+
+            if (!self.room.peers[peerId]) {
+                DDLogInfo(@"Peer %@ didn't come back. Closing its connection.", peerId);
+                [self.mediaSession closeConnectionWithPeer:peerId];
             }
+        }
+    }
 
-            self.iceServersTask = nil;
-        });
-    };
+    [self scheduleSessionResumption];
+}
 
+- (void)fetchICEServersAndSetupPeerConnectionForRoom:(XSRoom *)room peer:(XSPeer *)peer connectionId:(NSString *)connectionId offer:(RTCSessionDescription *)offerSDP
+{
     if (offerSDP) {
         [self.mediaSession acceptConnectionFromPeer:peer.identifier withId:connectionId offer:offerSDP];
     }
@@ -305,30 +510,30 @@ static NSURL *peerServerURL = nil;
         [self.mediaSession connectToPeer:peer.identifier];
     }
 
-    if (!self.iceServersTask) {
-        DDLogVerbose(@"Fetching ICE servers for room: %@", room);
+    // Cached servers are given to the connection right away. Otherwise, it waits for the fetch in flight, or a new one.
 
-        self.iceServersTask = [self.apiClient getIceServersForDomain:kPHConnectionManagerDomain
-                                                         application:kPHConnectionManagerApplication
-                                                                room:room.name
-                                                            username:room.localPeer.identifier
-                                                              secure:YES
-                                                          completion:iceServersHandler];
-    }
-    else {
-        DDLogVerbose(@"Not fetching ICE servers, a request is already in progress.");
-    }
+    [self.iceServerCache fetchIceServers:^(NSArray *iceServers, NSError *error) {
+        if (!error) {
+            [self.mediaSession addIceServers:iceServers singleUse:YES];
+        }
+        else {
+            [self.delegate connectionBroker:self didFailWithError:error];
+        }
+    }];
 }
 
 - (void)checkCaptureFormat
 {
 #if !TARGET_IPHONE_SIMULATOR
 
-    // Reduce capture quality for multi-party.
+    // Capture for the most demanding peer. The others are sent scaled down layers, so one slow peer doesn't lower
+    // quality for everyone.
 
     PHCapturePreset preset = [PHVideoPublisher recommendedCapturePreset];
+    PHVideoFormat sendFormat = self.mediaSession.sendFormat;
+    CMVideoDimensions extraLow = [AVCaptureDevice dimensionsForPreset:PHCapturePresetAcademyExtraLowQuality];
 
-    if (self.mediaSession.connectionCount > 1) {
+    if (sendFormat.dimensions.width <= extraLow.width && sendFormat.dimensions.height <= extraLow.height) {
         preset = PHCapturePresetAcademyExtraLowQuality;
     }
 
@@ -362,8 +567,8 @@ static NSURL *peerServerURL = nil;
 
 - (void)teardownAPIClient
 {
-    [self.iceServersTask cancel];
-    self.iceServersTask = nil;
+    [self.iceServerCache invalidate];
+    self.iceServerCache = nil;
 
     [self.socketTokenTask cancel];
     self.socketTokenTask = nil;
@@ -371,6 +576,8 @@ static NSURL *peerServerURL = nil;
     self.apiClient = nil;
 
     self.retryCount = 0;
+
+    _sessionResumption.Reset();
 }
 
 - (void)teardownReachability
@@ -454,9 +661,7 @@ static NSURL *peerServerURL = nil;
 
 - (void)handleICEMessage:(XSMessage *)message
 {
-    NSDictionary *messageData = message.data[@"data"];
-    NSDictionary *iceData = messageData[kXSMessageICECandidateDataKey];
-    NSString *connectionId = messageData[kXSMessageConnectionIdKey];
+    NSString *connectionId = message.connectionId;
     BOOL shouldAccept = [connectionId length] > 0;
 
     if (!shouldAccept) {
@@ -464,28 +669,31 @@ static NSURL *peerServerURL = nil;
         return;
     }
 
-    NSString *mid = iceData[@"id"];
-    NSNumber *sdpLineIndex = iceData[@"label"];
-    NSString *sdp = iceData[@"candidate"];
-    RTCICECandidate *candidate = [[RTCICECandidate alloc] initWithMid:mid
-                                                                index:sdpLineIndex.intValue
-                                                                  sdp:sdp];
+    NSMutableArray *candidates = [NSMutableArray arrayWithCapacity:[message.iceCandidates count]];
 
-    [self.mediaSession addIceCandidate:candidate forPeer:message.senderId connectionId:connectionId];;
+    for (NSDictionary *iceData in message.iceCandidates) {
+        NSString *mid = iceData[@"id"];
+        NSNumber *sdpLineIndex = iceData[@"label"];
+        NSString *sdp = iceData[@"candidate"];
+        RTCICECandidate *candidate = [[RTCICECandidate alloc] initWithMid:mid
+                                                                    index:sdpLineIndex.intValue
+                                                                      sdp:sdp];
+        [candidates addObject:candidate];
+    }
+
+    [self.mediaSession addIceCandidates:candidates forPeer:message.senderId connectionId:connectionId];
 }
 
 - (void)handleOffer:(XSMessage *)message
 {
-    NSDictionary *messageData = message.data[@"data"];
-    NSString *connectionId = messageData[kXSMessageConnectionIdKey];
+    NSString *connectionId = message.connectionId;
     NSString *peerId = message.senderId;
     PHPeerConnection *peerConnection = [self.mediaSession connectionForPeerId:peerId];
     BOOL shouldAccept = !peerConnection && [connectionId length] > 0;
     BOOL shouldRenegotiate = peerConnection && [peerConnection.connectionId isEqualToString:connectionId];
 
-    NSString *sdpString = messageData[kXSMessageOfferDataKey][@"sdp"];
-    NSString *sdpType = messageData[kXSMessageOfferDataKey][@"type"];
-    RTCSessionDescription *sdp = [[RTCSessionDescription alloc] initWithType:sdpType sdp:sdpString];
+    RTCSessionDescription *sdp = [[RTCSessionDescription alloc] initWithType:message.sessionDescriptionType
+                                                                          sdp:message.sessionDescription];
     XSPeer *peer = self.peerClient.room.peers[peerId];
 
     if (shouldAccept) {
@@ -501,20 +709,14 @@ static NSURL *peerServerURL = nil;
 
 - (void)handleAnswer:(XSMessage *)message
 {
-    NSDictionary *messageData = message.data[@"data"];
-    NSString *connectionId = messageData[kXSMessageConnectionIdKey];
-    NSString *sdpString = messageData[kXSMessageAnswerDataKey][@"sdp"];
-    NSString *sdpType = messageData[kXSMessageAnswerDataKey][@"type"];
-    RTCSessionDescription *sdp = [[RTCSessionDescription alloc] initWithType:sdpType sdp:sdpString];
+    RTCSessionDescription *sdp = [[RTCSessionDescription alloc] initWithType:message.sessionDescriptionType
+                                                                          sdp:message.sessionDescription];
 
-    [self.mediaSession addAnswer:sdp forPeer:message.senderId connectionId:connectionId];
+    [self.mediaSession addAnswer:sdp forPeer:message.senderId connectionId:message.connectionId];
 }
 
 - (void)handleBye:(XSMessage *)message
 {
-    NSDictionary *messageData = message.data[@"data"];
-    NSString *connectionId = messageData[kXSMessageConnectionIdKey];
-
     [self.mediaSession closeConnectionWithPeer:message.senderId];
 }
 
@@ -534,7 +736,20 @@ static NSURL *peerServerURL = nil;
 
 - (BOOL)isRoomFull:(XSRoom *)room
 {
-    return [room.peers count] > kPHConnectionManagerMaxRoomPeers;
+    return [room.peers count] > [self maxRoomPeers];
+}
+
+- (NSUInteger)maxRoomPeers
+{
+    return kPHConnectionManagerLargeRoomsEnabled ? kPHConnectionManagerMaxLargeRoomPeers : kPHConnectionManagerMaxRoomPeers;
+}
+
+- (void)updateConnectionPoolForRoom:(XSRoom *)room
+{
+    NSUInteger maxRoomPeers = [self maxRoomPeers];
+    NSUInteger openSlots = maxRoomPeers - MIN([room.peers count], maxRoomPeers);
+
+    self.mediaSession.connectionPoolSize = MIN(openSlots, kPHConnectionManagerConnectionPoolSize);
 }
 
 #pragma mark - Class
@@ -563,17 +778,30 @@ static NSURL *peerServerURL = nil;
 
 - (void)signalICECandidate:(RTCICECandidate *)iceCandidate forConnection:(PHPeerConnection *)connection
 {
-    DDLogVerbose(@"Send ICE candidate: %@", iceCandidate.sdpMid);
+    [self signalICECandidates:@[iceCandidate] forConnection:connection];
+}
+
+- (void)signalICECandidates:(NSArray *)iceCandidates forConnection:(PHPeerConnection *)connection
+{
+    DDLogVerbose(@"Send %lu ICE candidates.", (unsigned long)[iceCandidates count]);
+
+    NSMutableArray *json = [NSMutableArray arrayWithCapacity:[iceCandidates count]];
 
-    NSDictionary *json = @{
-                           @"label" : @(iceCandidate.sdpMLineIndex),
-                           @"id" : iceCandidate.sdpMid,
-                           @"candidate" : iceCandidate.sdp
-                           };
+    for (RTCICECandidate *iceCandidate in iceCandidates) {
+        [json addObject:@{
+                          @"label" : @(iceCandidate.sdpMLineIndex),
+                          @"id" : iceCandidate.sdpMid,
+                          @"candidate" : iceCandidate.sdp
+                          }];
+    }
 
-    XSMessage *message = [XSMessage iceCredentialsWithUserId:connection.peerId connectionId:connection.connectionId andData:json];
+    XSPeer *peer = self.room.peers[connection.peerId];
+    NSArray *messages = [XSMessage iceCandidatesWithUserId:connection.peerId connectionId:connection.connectionId andData:json
+                                              peerFeatures:peer.features];
 
-    [self.peerClient sendMessage:message];
+    for (XSMessage *message in messages) {
+        [self.peerClient sendMessage:message];
+    }
 }
 
 - (void)connection:(PHPeerConnection *)connection addedStream:(RTCMediaStream *)stream
@@ -604,36 +832,15 @@ static NSURL *peerServerURL = nil;
             break;
         }
         case RTCICEConnectionDisconnected:
-        {
-            // We had an active connection, but we lost it.
-            // Recover with an ice-restart?
-
-            BOOL peerReachable = self.room.peers[connection.peerId] != nil;
-            BOOL closeConnection = self.peerConnectionState != XSPeerConnectionStateConnected || !peerReachable;
-
-            if (closeConnection) {
-                [self.mediaSession closeConnectionWithPeer:connection.peerId];
-            }
-
-            break;
-        }
         case RTCICEConnectionFailed:
         {
-            // The connection failed during the ICE candidate phase.
-            // While the peer is available on the signaling server we should retry with an ice-restart.
+            // The media session restarts ICE while the peer is in the room, and tells us if that doesn't work.
+            // Restarts wait while we resume signaling, and we can't tell who is in the room until we have.
 
             BOOL peerReachable = self.room.peers[connection.peerId] != nil;
-            BOOL isInitiator = connection.role == PHPeerConnectionRoleInitiator;
-            BOOL canAttemptRestart = connection.iceAttempts <= kPHConnectionManagerMaxIceAttempts;
-
-            BOOL restartICE = isInitiator && peerReachable && canAttemptRestart;
-            BOOL closeConnection = !peerReachable || !canAttemptRestart;
 
-            if (restartICE) {
-                [self.mediaSession restartIceWithPeer:connection.peerId];
-            }
-            else if (closeConnection) {
-                [self.mediaSession closeConnectionWithPeer:connection.peerId];
+            if (!peerReachable && !_sessionResumption.IsResuming()) {
+                [self closeConnectionUnlessPeerResumes:connection.peerId];
             }
 
             break;
@@ -648,6 +855,32 @@ static NSURL *peerServerURL = nil;
     return YES;
 }
 
+- (void)session:(PHMediaSession *)session connection:(PHPeerConnection *)connection didSelectSendFormat:(PHVideoFormat)sendFormat
+{
+    [self checkCaptureFormat];
+}
+
+- (void)session:(PHMediaSession *)session needsIceServers:(void (^)(NSArray *))completion
+{
+    // Pooling is an optimization. If there are no servers, the next peer waits for them as usual.
+
+    [self.iceServerCache fetchIceServers:^(NSArray *iceServers, NSError *error) {
+        completion(iceServers);
+    }];
+}
+
+- (void)session:(PHMediaSession *)session didFailToRecoverConnection:(PHPeerConnection *)connection
+{
+    [self.mediaSession closeConnectionWithPeer:connection.peerId];
+}
+
+- (void)session:(PHMediaSession *)session didMeasureAverageEncodeTime:(NSTimeInterval)encodeTime
+{
+#if !TARGET_IPHONE_SIMULATOR
+    [self.publisher reportAverageEncodeTime:encodeTime];
+#endif
+}
+
 #pragma mark - XSPeerClientDelegate
 
 - (void)clientDidConnect:(XSPeerClient *)client
@@ -662,18 +895,28 @@ static NSURL *peerServerURL = nil;
     // If this was a final disconnection, let our delegate know.
     // If we can reconnect, start now otherwise wait for reachability to return.
 
+    self.mediaSession.signalingAvailable = NO;
+
     if (!self.apiClient) {
         dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(0.2 * NSEC_PER_SEC)), dispatch_get_main_queue(), ^{
             [self.delegate connectionBrokerDidFinish:self];
         });
     }
     else {
+        [self beginSessionResumption];
         [self checkAuthorizationStatus];
     }
 }
 
 - (void)client:(XSPeerClient *)client didEncounterError:(NSError *)error
 {
+    // An expired token is expected now and then. We fetch a new one.
+
+    if (_sessionResumption.IsUsingCachedToken() && _sessionResumption.IsResuming()) {
+        DDLogInfo(@"Couldn't reconnect with the last token: %@", error);
+        return;
+    }
+
     [self.delegate connectionBroker:self didFailWithError:error];
 }
 
@@ -693,8 +936,16 @@ static NSURL *peerServerURL = nil;
 
     // If we are the first peer, wait for another.
     // If other peers already exist then wait for an offer.
+    // Either way, we will need ICE servers.
 
     DDLogVerbose(@"Joined room with peers: %@", room.peers);
+
+    [self finishSessionResumptionInRoom:room];
+
+    self.mediaSession.signalingAvailable = YES;
+
+    [self.iceServerCache prefetch];
+    [self updateConnectionPoolForRoom:room];
 }
 
 // TODO: Leave observer event is not fired.
@@ -704,13 +955,19 @@ static NSURL *peerServerURL = nil;
 
 - (void)room:(XSRoom *)room didAddPeer:(XSPeer *)peer
 {
+    _sessionResumption.OnPeerReturned([peer.identifier UTF8String]);
+
     if (![self isRoomFull:room]) {
         [self evaluatePeerCandidate:peer];
     }
+
+    [self updateConnectionPoolForRoom:room];
 }
 
 - (void)room:(XSRoom *)room didRemovePeer:(XSPeer *)peer
 {
+    [self updateConnectionPoolForRoom:room];
+
     NSString *peerId = peer.identifier;
     PHPeerConnection *peerConnectionWrapper = [self.mediaSession connectionForPeerId:peerId];
 
@@ -724,7 +981,7 @@ static NSURL *peerServerURL = nil;
         case RTCICEConnectionDisconnected:
         case RTCICEConnectionNew:
         case RTCICEConnectionFailed:
-            [self.mediaSession closeConnectionWithPeer:peerId];
+            [self closeConnectionUnlessPeerResumes:peerId];
             break;
         default:
             break;
@@ -733,22 +990,24 @@ static NSURL *peerServerURL = nil;
 
 - (void)room:(XSRoom *)room didReceiveMessage:(XSMessage *)message
 {
-    NSString *type = message.type;
-
     // Handle incoming SDP offers, and answers.
     // Handle ICE credentials from peers.
 
-    if ([type isEqualToString:kXSMessageEventICE]) {
-        [self handleICEMessage:message];
-    }
-    else if ([type isEqualToString:kXSMessageEventOffer]) {
-        [self handleOffer:message];
-    }
-    else if ([type isEqualToString:kXSMessageEventAnswer]) {
-        [self handleAnswer:message];
-    }
-    else if ([type isEqualToString:kXSMessageEventBye]) {
-        [self handleBye:message];
+    switch (message.event) {
+        case XSMessageEventICE:
+            [self handleICEMessage:message];
+            break;
+        case XSMessageEventOffer:
+            [self handleOffer:message];
+            break;
+        case XSMessageEventAnswer:
+            [self handleAnswer:message];
+            break;
+        case XSMessageEventBye:
+            [self handleBye:message];
+            break;
+        default:
+            break;
     }
 }
 
@@ -0,0 +1,24 @@
+//
+//  CADisplayLink+PHWeakTarget.h
+//  PerchRTC
+//
+//  Created by Christopher Eagleston on 2015-07-13.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#import <QuartzCore/QuartzCore.h>
+
+@interface CADisplayLink (PHWeakTarget)
+
+/**
+ *  Creates a display link which doesn't retain its target, so the target can own the link and invalidate it in dealloc.
+ *  The link invalidates itself if it fires after the target is gone.
+ *
+ *  @param target   The object to notify. `selector` takes the display link as its only argument.
+ *  @param selector The method to call on every refresh.
+ *
+ *  @return A display link, which must still be added to a run loop.
+ */
++ (CADisplayLink *)displayLinkWithWeakTarget:(id)target selector:(SEL)selector;
+
+@end
@@ -0,0 +1,46 @@
+//
+//  CADisplayLink+PHWeakTarget.m
+//  PerchRTC
+//
+//  Created by Christopher Eagleston on 2015-07-13.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#import "CADisplayLink+PHWeakTarget.h"
+
+@interface PHWeakDisplayLinkTarget : NSObject
+
+@property (nonatomic, weak) id target;
+@property (nonatomic, assign) SEL selector;
+
+@end
+
+@implementation PHWeakDisplayLinkTarget
+
+- (void)displayLinkDidFire:(CADisplayLink *)displayLink
+{
+    id target = self.target;
+
+    if (!target) {
+        [displayLink invalidate];
+        return;
+    }
+
+    void (*fire)(id, SEL, CADisplayLink *) = (void (*)(id, SEL, CADisplayLink *))[target methodForSelector:self.selector];
+    fire(target, self.selector, displayLink);
+}
+
+@end
+
+@implementation CADisplayLink (PHWeakTarget)
+
++ (CADisplayLink *)displayLinkWithWeakTarget:(id)target selector:(SEL)selector
+{
+    PHWeakDisplayLinkTarget *weakTarget = [[PHWeakDisplayLinkTarget alloc] init];
+    weakTarget.target = target;
+    weakTarget.selector = selector;
+
+    return [CADisplayLink displayLinkWithTarget:weakTarget selector:@selector(displayLinkDidFire:)];
+}
+
+@end
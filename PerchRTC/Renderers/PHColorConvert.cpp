@@ -0,0 +1,340 @@
+//
+//  PHColorConvert.cpp
+//  PerchRTC
+//
+//  Created by Christopher Eagleston on 2015-06-02.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#include "PHColorConvert.h"
+
+#include <vector>
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#define PH_COLOR_CONVERT_HAS_NEON 1
+#include <arm_neon.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#define PH_COLOR_CONVERT_HAS_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+    // 6-bit fixed-point coefficients. All intermediates fit in 16 bits, except for the final R and B sums,
+    // which saturate only when the result is out of range anyway. This lets the SIMD kernels work entirely in 16-bit lanes.
+    //
+    //  R = (yGain * (Y - yOffset) + rv * (V - 128) + 32) >> 6
+    //  G = (yGain * (Y - yOffset) - gu * (U - 128) - gv * (V - 128) + 32) >> 6
+    //  B = (yGain * (Y - yOffset) + bu * (U - 128) + 32) >> 6
+
+    struct ColorCoefficients
+    {
+        int16_t yOffset;
+        int16_t yGain;
+        int16_t rv;
+        int16_t gu;
+        int16_t gv;
+        int16_t bu;
+    };
+
+    const int kColorShift = 6;
+    const int kColorRound = 1 << (kColorShift - 1);
+
+    // Indexed by PHColorMatrix.
+    const ColorCoefficients kColorCoefficients[] = {
+        { 16, 75, 102, 25, 52, 129 },   // BT.601, video range.
+        { 0, 64, 90, 22, 46, 113 },     // BT.601, full range.
+        { 16, 75, 115, 14, 34, 135 },   // BT.709, video range.
+        { 0, 64, 101, 12, 30, 119 },    // BT.709, full range.
+    };
+
+    inline const ColorCoefficients &CoefficientsForMatrix(PHColorMatrix matrix)
+    {
+        return (matrix >= PHColorMatrixBT601VideoRange && matrix <= PHColorMatrixBT709FullRange) ? kColorCoefficients[matrix] : kColorCoefficients[0];
+    }
+
+    // Byte offsets of R, G, B and A within one output pixel.
+
+    template <PHRGBLayout Layout> struct LayoutOffsets;
+    template <> struct LayoutOffsets<PHRGBLayoutBGRA> { enum { R = 2, G = 1, B = 0, A = 3 }; };
+    template <> struct LayoutOffsets<PHRGBLayoutARGB> { enum { R = 1, G = 2, B = 3, A = 0 }; };
+    template <> struct LayoutOffsets<PHRGBLayoutRGBA> { enum { R = 0, G = 1, B = 2, A = 3 }; };
+
+    inline int Saturate16(int value)
+    {
+        return value < -32768 ? -32768 : (value > 32767 ? 32767 : value);
+    }
+
+    inline uint8_t Clamp255(int value)
+    {
+        return (uint8_t)(value < 0 ? 0 : (value > 255 ? 255 : value));
+    }
+
+    // Scalar reference. Mirrors the 16-bit saturating arithmetic of the SIMD kernels, so every kernel produces identical output.
+
+    template <PHRGBLayout Layout>
+    void ConvertPixelsScalar(const uint8_t *srcY, const uint8_t *srcU, const uint8_t *srcV, uint8_t *dstRGB, int width, const ColorCoefficients &c)
+    {
+        typedef LayoutOffsets<Layout> Offsets;
+
+        for (int i = 0; i < width; i++) {
+            int u = srcU[i >> 1] - 128;
+            int v = srcV[i >> 1] - 128;
+            int y = (srcY[i] - c.yOffset) * c.yGain + kColorRound;
+
+            uint8_t *pixel = dstRGB + 4 * i;
+            pixel[Offsets::R] = Clamp255(Saturate16(y + c.rv * v) >> kColorShift);
+            pixel[Offsets::G] = Clamp255(Saturate16(y - (c.gu * u + c.gv * v)) >> kColorShift);
+            pixel[Offsets::B] = Clamp255(Saturate16(y + c.bu * u) >> kColorShift);
+            pixel[Offsets::A] = 0xFF;
+        }
+    }
+
+    template <PHRGBLayout Layout>
+    void ConvertRowScalar(const uint8_t *srcY, const uint8_t *srcU, const uint8_t *srcV, uint8_t *dstRGB, int width, const ColorCoefficients &c)
+    {
+        ConvertPixelsScalar<Layout>(srcY, srcU, srcV, dstRGB, width, c);
+    }
+
+    // The SIMD kernels convert 16 pixels (8 chroma samples) at a time. Blocks always start on an even pixel,
+    // so the remaining tail of fewer than 16 pixels is finished by the scalar code.
+
+    const int kColorBlockWidth = 16;
+
+#if PH_COLOR_CONVERT_HAS_SSE2
+
+    struct CoefficientsSSE2
+    {
+        explicit CoefficientsSSE2(const ColorCoefficients &c)
+        : yOffset(_mm_set1_epi16(c.yOffset)), yGain(_mm_set1_epi16(c.yGain)), round(_mm_set1_epi16(kColorRound)),
+          rv(_mm_set1_epi16(c.rv)), gu(_mm_set1_epi16(c.gu)), gv(_mm_set1_epi16(c.gv)), bu(_mm_set1_epi16(c.bu)),
+          bias(_mm_set1_epi16(128)) {}
+
+        __m128i yOffset, yGain, round, rv, gu, gv, bu, bias;
+    };
+
+    inline __m128i PackChannelSSE2(__m128i yLo, __m128i yHi, __m128i termLo, __m128i termHi, bool subtract)
+    {
+        __m128i lo = subtract ? _mm_subs_epi16(yLo, termLo) : _mm_adds_epi16(yLo, termLo);
+        __m128i hi = subtract ? _mm_subs_epi16(yHi, termHi) : _mm_adds_epi16(yHi, termHi);
+
+        return _mm_packus_epi16(_mm_srai_epi16(lo, kColorShift), _mm_srai_epi16(hi, kColorShift));
+    }
+
+    template <PHRGBLayout Layout>
+    inline void ConvertBlockSSE2(const uint8_t *srcY, const uint8_t *srcU, const uint8_t *srcV, uint8_t *dstRGB, const CoefficientsSSE2 &c)
+    {
+        typedef LayoutOffsets<Layout> Offsets;
+        const __m128i zero = _mm_setzero_si128();
+
+        // Chroma terms for 8 samples, each duplicated across the 2 pixels which share it.
+
+        __m128i u = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)srcU), zero), c.bias);
+        __m128i v = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)srcV), zero), c.bias);
+
+        __m128i r = _mm_mullo_epi16(v, c.rv);
+        __m128i g = _mm_add_epi16(_mm_mullo_epi16(u, c.gu), _mm_mullo_epi16(v, c.gv));
+        __m128i b = _mm_mullo_epi16(u, c.bu);
+
+        __m128i y = _mm_loadu_si128((const __m128i *)srcY);
+        __m128i yLo = _mm_add_epi16(_mm_mullo_epi16(_mm_sub_epi16(_mm_unpacklo_epi8(y, zero), c.yOffset), c.yGain), c.round);
+        __m128i yHi = _mm_add_epi16(_mm_mullo_epi16(_mm_sub_epi16(_mm_unpackhi_epi8(y, zero), c.yOffset), c.yGain), c.round);
+
+        __m128i channels[4];
+        channels[Offsets::R] = PackChannelSSE2(yLo, yHi, _mm_unpacklo_epi16(r, r), _mm_unpackhi_epi16(r, r), false);
+        channels[Offsets::G] = PackChannelSSE2(yLo, yHi, _mm_unpacklo_epi16(g, g), _mm_unpackhi_epi16(g, g), true);
+        channels[Offsets::B] = PackChannelSSE2(yLo, yHi, _mm_unpacklo_epi16(b, b), _mm_unpackhi_epi16(b, b), false);
+        channels[Offsets::A] = _mm_set1_epi8((char)0xFF);
+
+        // Interleave the four channels into 16 pixels.
+
+        __m128i lo01 = _mm_unpacklo_epi8(channels[0], channels[1]);
+        __m128i hi01 = _mm_unpackhi_epi8(channels[0], channels[1]);
+        __m128i lo23 = _mm_unpacklo_epi8(channels[2], channels[3]);
+        __m128i hi23 = _mm_unpackhi_epi8(channels[2], channels[3]);
+
+        _mm_storeu_si128((__m128i *)dstRGB, _mm_unpacklo_epi16(lo01, lo23));
+        _mm_storeu_si128((__m128i *)(dstRGB + 16), _mm_unpackhi_epi16(lo01, lo23));
+        _mm_storeu_si128((__m128i *)(dstRGB + 32), _mm_unpacklo_epi16(hi01, hi23));
+        _mm_storeu_si128((__m128i *)(dstRGB + 48), _mm_unpackhi_epi16(hi01, hi23));
+    }
+
+    template <PHRGBLayout Layout>
+    void ConvertRowSSE2(const uint8_t *srcY, const uint8_t *srcU, const uint8_t *srcV, uint8_t *dstRGB, int width, const ColorCoefficients &coefficients)
+    {
+        const CoefficientsSSE2 c(coefficients);
+        int x = 0;
+
+        for (; x + kColorBlockWidth <= width; x += kColorBlockWidth) {
+            ConvertBlockSSE2<Layout>(srcY + x, srcU + x / 2, srcV + x / 2, dstRGB + 4 * x, c);
+        }
+
+        ConvertPixelsScalar<Layout>(srcY + x, srcU + x / 2, srcV + x / 2, dstRGB + 4 * x, width - x, coefficients);
+    }
+
+#endif
+
+#if PH_COLOR_CONVERT_HAS_NEON
+
+    inline uint8x8_t PackChannelNEON(int16x8_t y, int16x8_t term, bool subtract)
+    {
+        int16x8_t sum = subtract ? vqsubq_s16(y, term) : vqaddq_s16(y, term);
+
+        return vqmovun_s16(vshrq_n_s16(sum, kColorShift));
+    }
+
+    template <PHRGBLayout Layout>
+    inline void ConvertBlockNEON(const uint8_t *srcY, const uint8_t *srcU, const uint8_t *srcV, uint8_t *dstRGB, const ColorCoefficients &c)
+    {
+        typedef LayoutOffsets<Layout> Offsets;
+        const int16x8_t bias = vdupq_n_s16(128);
+
+        int16x8_t u = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vld1_u8(srcU))), bias);
+        int16x8_t v = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vld1_u8(srcV))), bias);
+
+        int16x8_t r = vmulq_n_s16(v, c.rv);
+        int16x8_t g = vmlaq_n_s16(vmulq_n_s16(u, c.gu), v, c.gv);
+        int16x8_t b = vmulq_n_s16(u, c.bu);
+
+        int16x8x2_t r2 = vzipq_s16(r, r);
+        int16x8x2_t g2 = vzipq_s16(g, g);
+        int16x8x2_t b2 = vzipq_s16(b, b);
+
+        uint8x16_t y = vld1q_u8(srcY);
+        const int16x8_t yOffset = vdupq_n_s16(c.yOffset);
+        const int16x8_t round = vdupq_n_s16(kColorRound);
+        int16x8_t yLo = vmlaq_n_s16(round, vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(y))), yOffset), c.yGain);
+        int16x8_t yHi = vmlaq_n_s16(round, vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(y))), yOffset), c.yGain);
+
+        uint8x16x4_t pixels;
+        pixels.val[Offsets::R] = vcombine_u8(PackChannelNEON(yLo, r2.val[0], false), PackChannelNEON(yHi, r2.val[1], false));
+        pixels.val[Offsets::G] = vcombine_u8(PackChannelNEON(yLo, g2.val[0], true), PackChannelNEON(yHi, g2.val[1], true));
+        pixels.val[Offsets::B] = vcombine_u8(PackChannelNEON(yLo, b2.val[0], false), PackChannelNEON(yHi, b2.val[1], false));
+        pixels.val[Offsets::A] = vdupq_n_u8(0xFF);
+
+        vst4q_u8(dstRGB, pixels);
+    }
+
+    template <PHRGBLayout Layout>
+    void ConvertRowNEON(const uint8_t *srcY, const uint8_t *srcU, const uint8_t *srcV, uint8_t *dstRGB, int width, const ColorCoefficients &c)
+    {
+        int x = 0;
+
+        for (; x + kColorBlockWidth <= width; x += kColorBlockWidth) {
+            ConvertBlockNEON<Layout>(srcY + x, srcU + x / 2, srcV + x / 2, dstRGB + 4 * x, c);
+        }
+
+        ConvertPixelsScalar<Layout>(srcY + x, srcU + x / 2, srcV + x / 2, dstRGB + 4 * x, width - x, c);
+    }
+
+#endif
+
+    // Layout dispatch. The public row functions take the matrix and layout, so that callers only need one function pointer.
+
+#define PH_COLOR_CONVERT_ROW(Kernel) \
+    void ConvertI420Row##Kernel(const uint8_t *srcY, const uint8_t *srcU, const uint8_t *srcV, uint8_t *dstRGB, int width, PHColorMatrix matrix, PHRGBLayout layout) \
+    { \
+        const ColorCoefficients &c = CoefficientsForMatrix(matrix); \
+        switch (layout) { \
+            case PHRGBLayoutARGB: \
+                ConvertRow##Kernel<PHRGBLayoutARGB>(srcY, srcU, srcV, dstRGB, width, c); \
+                break; \
+            case PHRGBLayoutRGBA: \
+                ConvertRow##Kernel<PHRGBLayoutRGBA>(srcY, srcU, srcV, dstRGB, width, c); \
+                break; \
+            default: \
+                ConvertRow##Kernel<PHRGBLayoutBGRA>(srcY, srcU, srcV, dstRGB, width, c); \
+                break; \
+        } \
+    }
+
+    PH_COLOR_CONVERT_ROW(Scalar)
+#if PH_COLOR_CONVERT_HAS_SSE2
+    PH_COLOR_CONVERT_ROW(SSE2)
+#endif
+#if PH_COLOR_CONVERT_HAS_NEON
+    PH_COLOR_CONVERT_ROW(NEON)
+#endif
+
+#undef PH_COLOR_CONVERT_ROW
+
+} // namespace
+
+PHColorConvertRowFunction PHColorConvertI420RowFunction(PHConvertKernel kernel)
+{
+    if (!PHConvertKernelIsSupported(kernel)) {
+        return NULL;
+    }
+
+    if (kernel == PHConvertKernelAutomatic) {
+        kernel = PHConvertActiveKernel();
+    }
+
+    switch (kernel) {
+#if PH_COLOR_CONVERT_HAS_NEON
+        case PHConvertKernelNEON:
+            return ConvertI420RowNEON;
+#endif
+#if PH_COLOR_CONVERT_HAS_SSE2
+        // The 16-bit arithmetic is load/store bound at 128 bits, so there is no separate AVX2 kernel.
+        case PHConvertKernelSSE2:
+        case PHConvertKernelAVX2:
+            return ConvertI420RowSSE2;
+#endif
+        default:
+            return ConvertI420RowScalar;
+    }
+}
+
+void PHConvertI420ToRGB(const uint8_t *srcY, int srcStrideY,
+                        const uint8_t *srcU, int srcStrideU,
+                        const uint8_t *srcV, int srcStrideV,
+                        uint8_t *dstRGB, int dstStride,
+                        int width, int height,
+                        PHColorMatrix matrix, PHRGBLayout layout)
+{
+    PHColorConvertRowFunction convertRow = PHColorConvertI420RowFunction(PHConvertActiveKernel());
+
+    for (int row = 0; row < height; row++) {
+        convertRow(srcY, srcU, srcV, dstRGB, width, matrix, layout);
+        srcY += srcStrideY;
+        dstRGB += dstStride;
+
+        // Each chroma row is shared by two luma rows.
+
+        if (row & 1) {
+            srcU += srcStrideU;
+            srcV += srcStrideV;
+        }
+    }
+}
+
+void PHConvertNV12ToRGB(const uint8_t *srcY, int srcStrideY,
+                        const uint8_t *srcUV, int srcStrideUV,
+                        uint8_t *dstRGB, int dstStride,
+                        int width, int height,
+                        PHColorMatrix matrix, PHRGBLayout layout)
+{
+    PHColorConvertRowFunction convertRow = PHColorConvertI420RowFunction(PHConvertActiveKernel());
+    PHDeinterleaveRowFunction deinterleaveRow = PHConvertDeinterleaveRowFunction(PHConvertActiveKernel());
+
+    // Split each UV row once, and reuse it for both of the luma rows which share it.
+
+    const int chromaWidth = (width + 1) / 2;
+    std::vector<uint8_t> chromaRow(2 * (size_t)chromaWidth);
+    uint8_t *rowU = chromaRow.data();
+    uint8_t *rowV = rowU + chromaWidth;
+
+    for (int row = 0; row < height; row++) {
+        if ((row & 1) == 0) {
+            deinterleaveRow(srcUV, rowU, rowV, chromaWidth);
+            srcUV += srcStrideUV;
+        }
+
+        convertRow(srcY, rowU, rowV, dstRGB, width, matrix, layout);
+        srcY += srcStrideY;
+        dstRGB += dstStride;
+    }
+}
@@ -0,0 +1,72 @@
+//
+//  PHColorConvert.h
+//  PerchRTC
+//
+//  Created by Christopher Eagleston on 2015-06-02.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#ifndef __PerchRTC__PHColorConvert__
+#define __PerchRTC__PHColorConvert__
+
+#include "PHConvert.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum PHColorMatrix
+{
+    /* Standard definition content, and the WebRTC decoders' default. */
+    PHColorMatrixBT601VideoRange = 0,
+    PHColorMatrixBT601FullRange = 1,
+    PHColorMatrixBT709VideoRange = 2,
+    PHColorMatrixBT709FullRange = 3,
+} PHColorMatrix;
+
+/**
+ *  The order of the output bytes in memory. Alpha is always opaque.
+ *  PHRGBLayoutBGRA matches kCVPixelFormatType_32BGRA, and PHRGBLayoutARGB matches kCVPixelFormatType_32ARGB.
+ *  PHRGBLayoutRGBA matches a CGImage using kCGBitmapByteOrder32Big | kCGImageAlphaNoneSkipLast.
+ */
+typedef enum PHRGBLayout
+{
+    PHRGBLayoutBGRA = 0,
+    PHRGBLayoutARGB = 1,
+    PHRGBLayoutRGBA = 2,
+} PHRGBLayout;
+
+/**
+ *  Converts one row of 4:2:0 samples. `srcU` and `srcV` hold (width + 1) / 2 samples.
+ *  All kernels are fixed-point, and produce output identical to the scalar kernel.
+ */
+typedef void (*PHColorConvertRowFunction)(const uint8_t *srcY, const uint8_t *srcU, const uint8_t *srcV,
+                                          uint8_t *dstRGB, int width,
+                                          PHColorMatrix matrix, PHRGBLayout layout);
+
+// Row function for a particular kernel, or NULL if the kernel is not supported. AVX2 uses the SSE2 kernel.
+PHColorConvertRowFunction PHColorConvertI420RowFunction(PHConvertKernel kernel);
+
+/**
+ *  Converts an I420 image into a 32-bit RGB destination.
+ *  Rows are written straight into `dstRGB` at `dstStride`, so a locked pixel buffer can be filled without an intermediate copy.
+ */
+void PHConvertI420ToRGB(const uint8_t *srcY, int srcStrideY,
+                        const uint8_t *srcU, int srcStrideU,
+                        const uint8_t *srcV, int srcStrideV,
+                        uint8_t *dstRGB, int dstStride,
+                        int width, int height,
+                        PHColorMatrix matrix, PHRGBLayout layout);
+
+// As above, for a bi-planar NV12 source.
+void PHConvertNV12ToRGB(const uint8_t *srcY, int srcStrideY,
+                        const uint8_t *srcUV, int srcStrideUV,
+                        uint8_t *dstRGB, int dstStride,
+                        int width, int height,
+                        PHColorMatrix matrix, PHRGBLayout layout);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* defined(__PerchRTC__PHColorConvert__) */
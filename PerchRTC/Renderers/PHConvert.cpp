@@ -0,0 +1,415 @@
+//
+//  PHConvert.cpp
+//  PerchRTC
+//
+//  Created by Christopher Eagleston on 2015-05-09.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#include "PHConvert.h"
+
+#include <atomic>
+#include <string.h>
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#define PH_CONVERT_HAS_NEON 1
+#include <arm_neon.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#define PH_CONVERT_HAS_X86 1
+#include <cpuid.h>
+#include <emmintrin.h>
+#include <immintrin.h>
+#define PH_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace {
+
+    // Scalar reference. Every other kernel must produce identical output.
+
+    void InterleaveRowScalar(const uint8_t *srcA, const uint8_t *srcB, uint8_t *dstAB, int width)
+    {
+        for (int i = 0; i < width; i++) {
+            dstAB[2 * i] = srcA[i];
+            dstAB[2 * i + 1] = srcB[i];
+        }
+    }
+
+    void DeinterleaveRowScalar(const uint8_t *srcAB, uint8_t *dstA, uint8_t *dstB, int width)
+    {
+        for (int i = 0; i < width; i++) {
+            dstA[i] = srcAB[2 * i];
+            dstB[i] = srcAB[2 * i + 1];
+        }
+    }
+
+    // The SIMD kernels process whole vectors, and then finish a ragged tail by re-running one vector
+    // which ends exactly at the row boundary. The overlapping stores write identical values, so this is
+    // safe for out of place conversion and avoids a per-row scalar fallback. Rows shorter than one vector use the scalar code.
+
+#if PH_CONVERT_HAS_NEON
+
+    // @note: NEON intrinsics conversion from: http://stackoverflow.com/questions/14567786/fastest-de-interleave-operation-in-c
+
+    inline void InterleaveBlockNEON(const uint8_t *srcA, const uint8_t *srcB, uint8_t *dstAB)
+    {
+        const uint8x16x2_t ab = { { vld1q_u8(srcA), vld1q_u8(srcB) } };
+        vst2q_u8(dstAB, ab);
+    }
+
+    void InterleaveRowNEON(const uint8_t *srcA, const uint8_t *srcB, uint8_t *dstAB, int width)
+    {
+        if (width < 16) {
+            InterleaveRowScalar(srcA, srcB, dstAB, width);
+            return;
+        }
+
+        int i = 0;
+        for (; i <= width - 16; i += 16) {
+            InterleaveBlockNEON(srcA + i, srcB + i, dstAB + 2 * i);
+        }
+        if (i < width) {
+            i = width - 16;
+            InterleaveBlockNEON(srcA + i, srcB + i, dstAB + 2 * i);
+        }
+    }
+
+    inline void DeinterleaveBlockNEON(const uint8_t *srcAB, uint8_t *dstA, uint8_t *dstB)
+    {
+        const uint8x16x2_t ab = vld2q_u8(srcAB);
+        vst1q_u8(dstA, ab.val[0]);
+        vst1q_u8(dstB, ab.val[1]);
+    }
+
+    void DeinterleaveRowNEON(const uint8_t *srcAB, uint8_t *dstA, uint8_t *dstB, int width)
+    {
+        if (width < 16) {
+            DeinterleaveRowScalar(srcAB, dstA, dstB, width);
+            return;
+        }
+
+        int i = 0;
+        for (; i <= width - 16; i += 16) {
+            DeinterleaveBlockNEON(srcAB + 2 * i, dstA + i, dstB + i);
+        }
+        if (i < width) {
+            i = width - 16;
+            DeinterleaveBlockNEON(srcAB + 2 * i, dstA + i, dstB + i);
+        }
+    }
+
+#endif
+
+#if PH_CONVERT_HAS_X86
+
+    inline void InterleaveBlockSSE2(const uint8_t *srcA, const uint8_t *srcB, uint8_t *dstAB)
+    {
+        const __m128i a = _mm_loadu_si128((const __m128i *)srcA);
+        const __m128i b = _mm_loadu_si128((const __m128i *)srcB);
+        _mm_storeu_si128((__m128i *)dstAB, _mm_unpacklo_epi8(a, b));
+        _mm_storeu_si128((__m128i *)(dstAB + 16), _mm_unpackhi_epi8(a, b));
+    }
+
+    void InterleaveRowSSE2(const uint8_t *srcA, const uint8_t *srcB, uint8_t *dstAB, int width)
+    {
+        if (width < 16) {
+            InterleaveRowScalar(srcA, srcB, dstAB, width);
+            return;
+        }
+
+        int i = 0;
+        for (; i <= width - 16; i += 16) {
+            InterleaveBlockSSE2(srcA + i, srcB + i, dstAB + 2 * i);
+        }
+        if (i < width) {
+            i = width - 16;
+            InterleaveBlockSSE2(srcA + i, srcB + i, dstAB + 2 * i);
+        }
+    }
+
+    inline void DeinterleaveBlockSSE2(const uint8_t *srcAB, uint8_t *dstA, uint8_t *dstB)
+    {
+        const __m128i lowMask = _mm_set1_epi16(0x00FF);
+        const __m128i ab0 = _mm_loadu_si128((const __m128i *)srcAB);
+        const __m128i ab1 = _mm_loadu_si128((const __m128i *)(srcAB + 16));
+        const __m128i a = _mm_packus_epi16(_mm_and_si128(ab0, lowMask), _mm_and_si128(ab1, lowMask));
+        const __m128i b = _mm_packus_epi16(_mm_srli_epi16(ab0, 8), _mm_srli_epi16(ab1, 8));
+        _mm_storeu_si128((__m128i *)dstA, a);
+        _mm_storeu_si128((__m128i *)dstB, b);
+    }
+
+    void DeinterleaveRowSSE2(const uint8_t *srcAB, uint8_t *dstA, uint8_t *dstB, int width)
+    {
+        if (width < 16) {
+            DeinterleaveRowScalar(srcAB, dstA, dstB, width);
+            return;
+        }
+
+        int i = 0;
+        for (; i <= width - 16; i += 16) {
+            DeinterleaveBlockSSE2(srcAB + 2 * i, dstA + i, dstB + i);
+        }
+        if (i < width) {
+            i = width - 16;
+            DeinterleaveBlockSSE2(srcAB + 2 * i, dstA + i, dstB + i);
+        }
+    }
+
+    PH_TARGET_AVX2 inline void InterleaveBlockAVX2(const uint8_t *srcA, const uint8_t *srcB, uint8_t *dstAB)
+    {
+        // unpack works within 128-bit lanes, so swap the middle lanes back into order afterwards.
+
+        const __m256i a = _mm256_loadu_si256((const __m256i *)srcA);
+        const __m256i b = _mm256_loadu_si256((const __m256i *)srcB);
+        const __m256i lo = _mm256_unpacklo_epi8(a, b);
+        const __m256i hi = _mm256_unpackhi_epi8(a, b);
+        _mm256_storeu_si256((__m256i *)dstAB, _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256((__m256i *)(dstAB + 32), _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+
+    PH_TARGET_AVX2 void InterleaveRowAVX2(const uint8_t *srcA, const uint8_t *srcB, uint8_t *dstAB, int width)
+    {
+        if (width < 32) {
+            InterleaveRowSSE2(srcA, srcB, dstAB, width);
+            return;
+        }
+
+        int i = 0;
+        for (; i <= width - 32; i += 32) {
+            InterleaveBlockAVX2(srcA + i, srcB + i, dstAB + 2 * i);
+        }
+        if (i < width) {
+            i = width - 32;
+            InterleaveBlockAVX2(srcA + i, srcB + i, dstAB + 2 * i);
+        }
+    }
+
+    PH_TARGET_AVX2 inline void DeinterleaveBlockAVX2(const uint8_t *srcAB, uint8_t *dstA, uint8_t *dstB)
+    {
+        // pack works within 128-bit lanes, leaving the quadwords ordered 0, 2, 1, 3.
+
+        const __m256i lowMask = _mm256_set1_epi16(0x00FF);
+        const __m256i ab0 = _mm256_loadu_si256((const __m256i *)srcAB);
+        const __m256i ab1 = _mm256_loadu_si256((const __m256i *)(srcAB + 32));
+        const __m256i a = _mm256_packus_epi16(_mm256_and_si256(ab0, lowMask), _mm256_and_si256(ab1, lowMask));
+        const __m256i b = _mm256_packus_epi16(_mm256_srli_epi16(ab0, 8), _mm256_srli_epi16(ab1, 8));
+        _mm256_storeu_si256((__m256i *)dstA, _mm256_permute4x64_epi64(a, _MM_SHUFFLE(3, 1, 2, 0)));
+        _mm256_storeu_si256((__m256i *)dstB, _mm256_permute4x64_epi64(b, _MM_SHUFFLE(3, 1, 2, 0)));
+    }
+
+    PH_TARGET_AVX2 void DeinterleaveRowAVX2(const uint8_t *srcAB, uint8_t *dstA, uint8_t *dstB, int width)
+    {
+        if (width < 32) {
+            DeinterleaveRowSSE2(srcAB, dstA, dstB, width);
+            return;
+        }
+
+        int i = 0;
+        for (; i <= width - 32; i += 32) {
+            DeinterleaveBlockAVX2(srcAB + 2 * i, dstA + i, dstB + i);
+        }
+        if (i < width) {
+            i = width - 32;
+            DeinterleaveBlockAVX2(srcAB + 2 * i, dstA + i, dstB + i);
+        }
+    }
+
+    bool CPUSupportsAVX2()
+    {
+        unsigned int eax, ebx, ecx, edx;
+
+        if (__get_cpuid_max(0, NULL) < 7) {
+            return false;
+        }
+
+        // The OS must save the YMM registers (OSXSAVE + XCR0 bits 1 & 2).
+
+        __cpuid(1, eax, ebx, ecx, edx);
+        const unsigned int kOSXSAVE = 1u << 27;
+        const unsigned int kAVX = 1u << 28;
+        if ((ecx & (kOSXSAVE | kAVX)) != (kOSXSAVE | kAVX)) {
+            return false;
+        }
+
+        unsigned int xcr0Low, xcr0High;
+        __asm__ volatile ("xgetbv" : "=a" (xcr0Low), "=d" (xcr0High) : "c" (0));
+        if ((xcr0Low & 0x6) != 0x6) {
+            return false;
+        }
+
+        __cpuid_count(7, 0, eax, ebx, ecx, edx);
+        const unsigned int kAVX2 = 1u << 5;
+        return (ebx & kAVX2) != 0;
+    }
+
+#endif
+
+    PHConvertKernel BestSupportedKernel()
+    {
+        static const PHConvertKernel bestKernel = [] {
+#if PH_CONVERT_HAS_NEON
+            return PHConvertKernelNEON;
+#elif PH_CONVERT_HAS_X86
+            return CPUSupportsAVX2() ? PHConvertKernelAVX2 : PHConvertKernelSSE2;
+#else
+            return PHConvertKernelScalar;
+#endif
+        }();
+
+        return bestKernel;
+    }
+
+    std::atomic<int> SelectedKernel(PHConvertKernelAutomatic);
+
+} // namespace
+
+bool PHConvertKernelIsSupported(PHConvertKernel kernel)
+{
+    switch (kernel) {
+        case PHConvertKernelAutomatic:
+        case PHConvertKernelScalar:
+            return true;
+        case PHConvertKernelNEON:
+#if PH_CONVERT_HAS_NEON
+            return true;
+#else
+            return false;
+#endif
+        case PHConvertKernelSSE2:
+#if PH_CONVERT_HAS_X86
+            return true;
+#else
+            return false;
+#endif
+        case PHConvertKernelAVX2:
+            return BestSupportedKernel() == PHConvertKernelAVX2;
+    }
+
+    return false;
+}
+
+PHConvertKernel PHConvertActiveKernel(void)
+{
+    PHConvertKernel kernel = (PHConvertKernel)SelectedKernel.load(std::memory_order_relaxed);
+
+    return kernel == PHConvertKernelAutomatic ? BestSupportedKernel() : kernel;
+}
+
+bool PHConvertSelectKernel(PHConvertKernel kernel)
+{
+    if (!PHConvertKernelIsSupported(kernel)) {
+        return false;
+    }
+
+    SelectedKernel.store(kernel, std::memory_order_relaxed);
+    return true;
+}
+
+PHInterleaveRowFunction PHConvertInterleaveRowFunction(PHConvertKernel kernel)
+{
+    if (!PHConvertKernelIsSupported(kernel)) {
+        return NULL;
+    }
+
+    if (kernel == PHConvertKernelAutomatic) {
+        kernel = BestSupportedKernel();
+    }
+
+    switch (kernel) {
+#if PH_CONVERT_HAS_NEON
+        case PHConvertKernelNEON:
+            return InterleaveRowNEON;
+#endif
+#if PH_CONVERT_HAS_X86
+        case PHConvertKernelSSE2:
+            return InterleaveRowSSE2;
+        case PHConvertKernelAVX2:
+            return InterleaveRowAVX2;
+#endif
+        default:
+            return InterleaveRowScalar;
+    }
+}
+
+PHDeinterleaveRowFunction PHConvertDeinterleaveRowFunction(PHConvertKernel kernel)
+{
+    if (!PHConvertKernelIsSupported(kernel)) {
+        return NULL;
+    }
+
+    if (kernel == PHConvertKernelAutomatic) {
+        kernel = BestSupportedKernel();
+    }
+
+    switch (kernel) {
+#if PH_CONVERT_HAS_NEON
+        case PHConvertKernelNEON:
+            return DeinterleaveRowNEON;
+#endif
+#if PH_CONVERT_HAS_X86
+        case PHConvertKernelSSE2:
+            return DeinterleaveRowSSE2;
+        case PHConvertKernelAVX2:
+            return DeinterleaveRowAVX2;
+#endif
+        default:
+            return DeinterleaveRowScalar;
+    }
+}
+
+void PHCopyPlane(const uint8_t *src, int srcStride, uint8_t *dst, int dstStride, int widthBytes, int height)
+{
+    if (srcStride == dstStride && srcStride == widthBytes) {
+        memcpy(dst, src, (size_t)widthBytes * height);
+        return;
+    }
+
+    for (int row = 0; row < height; row++) {
+        memcpy(dst, src, widthBytes);
+        src += srcStride;
+        dst += dstStride;
+    }
+}
+
+void PHInterleavePlanes(const uint8_t *srcA, int srcStrideA,
+                        const uint8_t *srcB, int srcStrideB,
+                        uint8_t *dstAB, int dstStrideAB,
+                        int width, int height)
+{
+    PHInterleaveRowFunction interleaveRow = PHConvertInterleaveRowFunction(PHConvertActiveKernel());
+
+    // Treat contiguous planes as one long row.
+
+    if (srcStrideA == width && srcStrideB == width && dstStrideAB == 2 * width) {
+        width *= height;
+        height = 1;
+    }
+
+    for (int row = 0; row < height; row++) {
+        interleaveRow(srcA, srcB, dstAB, width);
+        srcA += srcStrideA;
+        srcB += srcStrideB;
+        dstAB += dstStrideAB;
+    }
+}
+
+void PHDeinterleavePlane(const uint8_t *srcAB, int srcStrideAB,
+                         uint8_t *dstA, int dstStrideA,
+                         uint8_t *dstB, int dstStrideB,
+                         int width, int height)
+{
+    PHDeinterleaveRowFunction deinterleaveRow = PHConvertDeinterleaveRowFunction(PHConvertActiveKernel());
+
+    if (srcStrideAB == 2 * width && dstStrideA == width && dstStrideB == width) {
+        width *= height;
+        height = 1;
+    }
+
+    for (int row = 0; row < height; row++) {
+        deinterleaveRow(srcAB, dstA, dstB, width);
+        srcAB += srcStrideAB;
+        dstA += dstStrideA;
+        dstB += dstStrideB;
+    }
+}
@@ -9,8 +9,62 @@
 #ifndef __PerchRTC__PHConvert__
 #define __PerchRTC__PHConvert__
 
-#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
 
-void ConvertPlanarUVToPackedRow(const uint8_t *srcA, const uint8_t *srcB, uint8_t *dstAB, int dstABLength);
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ *  Plane interleave / deinterleave kernels.
+ *  Each kernel handles arbitrary widths (including ragged tails) without falling back to scalar code for the whole row.
+ *  The best supported kernel is chosen at runtime, unless one is selected explicitly.
+ */
+typedef enum PHConvertKernel
+{
+    PHConvertKernelAutomatic = 0,
+    PHConvertKernelScalar = 1,
+    PHConvertKernelNEON = 2,
+    PHConvertKernelSSE2 = 3,
+    PHConvertKernelAVX2 = 4,
+} PHConvertKernel;
+
+// Interleaves `width` samples of A and B into 2 * `width` bytes of AB.
+typedef void (*PHInterleaveRowFunction)(const uint8_t *srcA, const uint8_t *srcB, uint8_t *dstAB, int width);
+
+// Splits 2 * `width` bytes of AB into `width` samples of A and B.
+typedef void (*PHDeinterleaveRowFunction)(const uint8_t *srcAB, uint8_t *dstA, uint8_t *dstB, int width);
+
+bool PHConvertKernelIsSupported(PHConvertKernel kernel);
+
+// Returns the kernel which is currently used by the plane functions. Never returns PHConvertKernelAutomatic.
+PHConvertKernel PHConvertActiveKernel(void);
+
+// Forces a particular kernel (useful for verification and benchmarks). Returns false if the kernel is not supported.
+bool PHConvertSelectKernel(PHConvertKernel kernel);
+
+// Row functions for a particular kernel, or NULL if the kernel is not supported.
+PHInterleaveRowFunction PHConvertInterleaveRowFunction(PHConvertKernel kernel);
+PHDeinterleaveRowFunction PHConvertDeinterleaveRowFunction(PHConvertKernel kernel);
+
+// Copies `widthBytes` from each row of a plane, collapsing to a single memcpy when the strides match.
+void PHCopyPlane(const uint8_t *src, int srcStride, uint8_t *dst, int dstStride, int widthBytes, int height);
+
+// I420 U + V planes -> NV12 UV plane. Width and height are in chroma samples.
+void PHInterleavePlanes(const uint8_t *srcA, int srcStrideA,
+                        const uint8_t *srcB, int srcStrideB,
+                        uint8_t *dstAB, int dstStrideAB,
+                        int width, int height);
+
+// NV12 UV plane -> I420 U + V planes. Width and height are in chroma samples.
+void PHDeinterleavePlane(const uint8_t *srcAB, int srcStrideAB,
+                         uint8_t *dstA, int dstStrideA,
+                         uint8_t *dstB, int dstStrideB,
+                         int width, int height);
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif /* defined(__PerchRTC__PHConvert__) */
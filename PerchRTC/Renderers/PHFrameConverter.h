@@ -9,6 +9,7 @@
 #import <Foundation/Foundation.h>
 #import <CoreMedia/CoreMedia.h>
 #import "RTCVideoRenderer.h"
+#import "PHScaleConvert.h"
 
 @class RTCI420Frame;
 
@@ -28,12 +29,21 @@ typedef NS_ENUM(NSUInteger, PHFrameConverterOutput)
 @property (nonatomic, assign, readonly) CVPixelBufferRef pixelBuffer;
 @property (nonatomic, assign, readonly) CMSampleBufferRef sampleBuffer;
 @property (nonatomic, assign, readonly) PHFrameConverterOutput outputType;
+@property (nonatomic, assign, readonly) CMVideoDimensions sourceDimensions;
+// The size of the pooled output buffers. The pooled outputs (CVPixelBuffer backed CGImages, and sample buffers) scale to this size while converting.
+@property (nonatomic, assign, readonly) CMVideoDimensions outputDimensions;
 @property (nonatomic, assign) BOOL shouldPreallocateBuffers;
+// The YUV->RGB matrix used by the RGB outputs. Defaults to BT.601 video range, which is what the WebRTC decoders produce.
+@property (nonatomic, assign) PHColorMatrix colorMatrix;
+// Defaults to PHScaleFilterAutomatic.
+@property (nonatomic, assign) PHScaleFilter scaleFilter;
 
 - (instancetype)initWithOutput:(PHFrameConverterOutput)output;
 + (instancetype)converterWithOutput:(PHFrameConverterOutput)output;
 
 - (BOOL)prepareForSourceDimensions:(CMVideoDimensions)dimensions;
+// Output dimensions are ignored for outputs which can't be scaled.
+- (BOOL)prepareForSourceDimensions:(CMVideoDimensions)dimensions outputDimensions:(CMVideoDimensions)outputDimensions;
 
 // Creates a CGImageRef, CVPixelBuffer, or CMSampleBufferRef. You must CFRelease this when you are finished with it.
 - (CFTypeRef)copyConvertedFrame:(RTCI420Frame *)frame;
@@ -42,4 +52,13 @@ typedef NS_ENUM(NSUInteger, PHFrameConverterOutput)
 
 + (PHFrameConverterOutput)recommendedOutputFormat;
 
+// Counters for the pixel buffer pool shared by all converters (hits, misses, allocations, deallocations, outstanding, highWater).
++ (NSDictionary *)framePoolStatistics;
+
+/**
+ *  The smallest output which still covers `displaySize` (in pixels) in both directions, so aspect fit and aspect fill remain sharp.
+ *  The source is only ever reduced by powers of two, which keeps the filters on their fast paths and limits the number of distinct buffer sizes.
+ */
++ (CMVideoDimensions)outputDimensionsForSourceDimensions:(CMVideoDimensions)dimensions displaySize:(CGSize)displaySize;
+
 @end
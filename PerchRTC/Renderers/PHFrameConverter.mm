@@ -1,5 +1,5 @@
 //
-//  PHFrameConverter.m
+//  PHFrameConverter.mm
 //  PerchRTC
 //
 //  Created by Christopher Eagleston on 2/7/2014.
@@ -7,18 +7,15 @@
 //
 
 #import "PHFrameConverter.h"
-#import "libyuv.h"
 
 #import "PHConvert.h"
+#import "PHScaleConvert.h"
+#import "PHPixelBufferAllocator.h"
 
 #import <nighthawk-webrtc/RTCI420Frame.h>
 #import <Accelerate/Accelerate.h>
 
-static size_t kFrameConverterBufferPoolHint = 5;
-
-// Determines which technique is used to convert YUV420 frames to BGRA.
-// The default is libYUV, but Accelerate can be used on iOS 8 devices.
-static BOOL kFrameConverterUseAccelerate = YES;
+static const int kFrameConverterPreallocatedBufferCount = 5;
 
 @interface PHFrameConverter()
 
@@ -29,16 +26,18 @@ static BOOL kFrameConverterUseAccelerate = YES;
 @property (nonatomic, assign) CGSize videoFrameSize;
 @property (nonatomic, strong) NSData *imageData;
 @property (nonatomic, assign) PHFrameConverterOutput outputType;
+@property (nonatomic, assign) CMVideoDimensions sourceDimensions;
+@property (nonatomic, assign) CMVideoDimensions outputDimensions;
 
-@property (nonatomic, assign) CVPixelBufferPoolRef bufferPool;
-@property (nonatomic, assign) CFDictionaryRef bufferPoolAuxAttributes;
 @property (nonatomic, assign) CMFormatDescriptionRef outputFormatDescription;
-@property (nonatomic, assign) vImage_YpCbCrToARGB *conversionInfo;
-@property (nonatomic, assign) BOOL supportsAccelerate;
+@property (nonatomic, assign) BOOL supportsReadySampleBuffers;
 
 @end
 
 @implementation PHFrameConverter
+{
+    perch::FrameKey _outputKey;
+}
 
 #pragma mark - Class
 
@@ -60,12 +59,10 @@ static BOOL kFrameConverterUseAccelerate = YES;
     self = [super init];
     if (self) {
         _outputType = output;
-        _supportsAccelerate = kFrameConverterUseAccelerate && [[[UIDevice currentDevice] systemVersion] compare:@"8.0" options:NSNumericSearch] != NSOrderedAscending;
+        _supportsReadySampleBuffers = [[[UIDevice currentDevice] systemVersion] compare:@"8.0" options:NSNumericSearch] != NSOrderedAscending;
         _shouldPreallocateBuffers = NO;
-
-        if (_supportsAccelerate && (output == PHFrameConverterOutputCGImageBackedByCVPixelBuffer || output == PHFrameConverterOutputCMSampleBufferBackedByCVPixelBufferBGRA)) {
-            [self prepareForAccelerateConversion];
-        }
+        _colorMatrix = PHColorMatrixBT601VideoRange;
+        _scaleFilter = PHScaleFilterAutomatic;
     }
     return self;
 }
@@ -74,7 +71,6 @@ static BOOL kFrameConverterUseAccelerate = YES;
 {
     [self deleteBuffers];
     [self flushFrame];
-    [self unprepareForAccelerateConversion];
     [self teardownPixelBuffer];
 }
 
@@ -98,59 +94,53 @@ static BOOL kFrameConverterUseAccelerate = YES;
     {
         // Find a pixel buffer.
 
-        CVPixelBufferRef pixelBuffer = [self dequeuePixelBufferForFrame:frame];
+        perch::FrameBuffer *buffer = [self dequeueBufferForFrame:frame];
 
-        if (pixelBuffer) {
-            if (_supportsAccelerate) {
-                [self convertFrameVImageYUV:frame toBuffer:pixelBuffer];
-            }
-            else {
-                [self convertFrame:frame toBuffer:pixelBuffer];
-            }
+        if (buffer) {
+            [self convertFrame:frame toBuffer:perch::PixelBufferForFrame(buffer) layout:PHRGBLayoutRGBA];
 
-            self.frameRef = [self createCGImageFromPixelBufferNoCopy:pixelBuffer];
+            self.frameRef = [self createCGImageFromBufferNoCopy:buffer];
         }
     }
     else if (self.outputType == PHFrameConverterOutputCGImageCopiedFromCVPixelBuffer)
     {
         [self preparePixelBufferForFrame:frame forceRGB:YES];
 
-        [self convertFrame:frame toBuffer:self.pixelBuffer];
+        [self convertFrame:frame toBuffer:self.pixelBuffer layout:PHRGBLayoutRGBA];
 
         self.frameRef = [self createCGImageFromPixelBuffer:self.pixelBuffer];
     }
     else if (self.outputType == PHFrameConverterOutputCVPixelBufferCopiedFromSource)
     {
-        CVPixelBufferRef pixelBuffer = [self dequeuePixelBufferForFrame:frame];
+        perch::FrameBuffer *buffer = [self dequeueBufferForFrame:frame];
+
+        if (buffer) {
+            CVPixelBufferRef pixelBuffer = perch::PixelBufferForFrame(buffer);
 
-        if (pixelBuffer) {
             [self copyPlanesFromFrame:frame toPixelBuffer:pixelBuffer];
 
-            self.pixelBuffer = pixelBuffer;
+            // The caller owns the returned reference. The buffer goes back to the pool once that reference is released.
+
+            frameReturn = perch::CreateLeasedPixelBuffer(buffer);
         }
     }
     else if (self.outputType == PHFrameConverterOutputCMSampleBufferBackedByCVPixelBuffer)
     {
-        CVPixelBufferRef pixelBuffer = [self dequeuePixelBufferForFrame:frame];
+        perch::FrameBuffer *buffer = [self dequeueBufferForFrame:frame];
 
-        if (pixelBuffer) {
-            [self packPlanesFromFrame:frame toPixelBuffer:pixelBuffer];
+        if (buffer) {
+            [self packPlanesFromFrame:frame toPixelBuffer:perch::PixelBufferForFrame(buffer)];
 
-            self.sampleBuffer = [self createSampleBufferWithImageBuffer:pixelBuffer];
+            self.sampleBuffer = [self createSampleBufferWithBuffer:buffer];
         }
     }
     else if (self.outputType == PHFrameConverterOutputCMSampleBufferBackedByCVPixelBufferBGRA) {
-        CVPixelBufferRef pixelBuffer = [self dequeuePixelBufferForFrame:frame];
+        perch::FrameBuffer *buffer = [self dequeueBufferForFrame:frame];
 
-        if (pixelBuffer) {
-            if (_supportsAccelerate) {
-                [self convertFrameVImageYUV:frame toBuffer:pixelBuffer];
-            }
-            else {
-                [self convertFrame:frame toBuffer:pixelBuffer];
-            }
+        if (buffer) {
+            [self convertFrame:frame toBuffer:perch::PixelBufferForFrame(buffer) layout:PHRGBLayoutBGRA];
 
-            self.sampleBuffer = [self createSampleBufferWithImageBuffer:pixelBuffer];
+            self.sampleBuffer = [self createSampleBufferWithBuffer:buffer];
         }
     }
 
@@ -180,8 +170,14 @@ static BOOL kFrameConverterUseAccelerate = YES;
 }
 
 - (BOOL)prepareForSourceDimensions:(CMVideoDimensions)dimensions
+{
+    return [self prepareForSourceDimensions:dimensions outputDimensions:dimensions];
+}
+
+- (BOOL)prepareForSourceDimensions:(CMVideoDimensions)dimensions outputDimensions:(CMVideoDimensions)outputDimensions
 {
     OSType format;
+    BOOL canScale = YES;
 
     switch (self.outputType) {
         case PHFrameConverterOutputCMSampleBufferBackedByCVPixelBuffer:
@@ -190,113 +186,88 @@ static BOOL kFrameConverterUseAccelerate = YES;
             break;
         }
         case PHFrameConverterOutputCGImageBackedByCVPixelBuffer:
-        case PHFrameConverterOutputCMSampleBufferBackedByCVPixelBufferBGRA:
         {
             format = kCVPixelFormatType_32ARGB;
             break;
         }
+        case PHFrameConverterOutputCMSampleBufferBackedByCVPixelBufferBGRA:
+        {
+            format = kCVPixelFormatType_32BGRA;
+            break;
+        }
+        case PHFrameConverterOutputCVPixelBufferCopiedFromSource:
+        {
+            format = kCVPixelFormatType_420YpCbCr8Planar;
+            canScale = NO;
+            break;
+        }
         default:
             format = kCVPixelFormatType_32BGRA;
+            canScale = NO;
             break;
     }
 
-    if (_bufferPool != NULL) {
-        [self deleteBuffers];
+    if (!canScale || outputDimensions.width <= 0 || outputDimensions.height <= 0) {
+        outputDimensions = dimensions;
     }
 
-    return [self initializeBuffersWithOutputDimensions:dimensions pixelFormat:format retainedBufferCountHint:kFrameConverterBufferPoolHint];
-}
-
-#pragma mark - Private
+    self.sourceDimensions = dimensions;
+    self.outputDimensions = outputDimensions;
 
-- (vImage_Error)prepareForAccelerateConversion
-{
-    // Setup the YpCbCr to ARGB conversion.
-
-    if (_conversionInfo != NULL) {
-        return kvImageNoError;
-    }
-
-    vImage_YpCbCrPixelRange pixelRange = { 0, 128, 255, 255, 255, 1, 255, 0 };
-    //    vImage_YpCbCrPixelRange pixelRange = { 16, 128, 235, 240, 255, 0, 255, 0 };
-    vImage_YpCbCrToARGB *outInfo = malloc(sizeof(vImage_YpCbCrToARGB));
-    vImageYpCbCrType inType = kvImage420Yp8_Cb8_Cr8;
-    vImageARGBType outType = kvImageARGB8888;
-
-    vImage_Error error = vImageConvert_YpCbCrToARGB_GenerateConversion(kvImage_YpCbCrToARGBMatrix_ITU_R_601_4, &pixelRange, outInfo, inType, outType, kvImagePrintDiagnosticsToConsole);
-
-    _conversionInfo = outInfo;
+    [self deleteBuffers];
 
-    return error;
+    return [self initializeBuffersWithOutputDimensions:outputDimensions pixelFormat:format];
 }
 
-- (void)unprepareForAccelerateConversion
-{
-    if (_conversionInfo != NULL) {
-        free(_conversionInfo);
-        _conversionInfo = NULL;
-    }
-}
+#pragma mark - Private
 
-- (CVPixelBufferRef)dequeuePixelBufferForFrame:(RTCI420Frame *)frame
+- (perch::FrameBuffer *)dequeueBufferForFrame:(RTCI420Frame *)frame
 {
-    CVPixelBufferRef dstPixelBuffer = NULL;
-
     if ( frame == NULL ) {
         @throw [NSException exceptionWithName:NSInvalidArgumentException reason:@"NULL frame" userInfo:nil];
         return NULL;
     }
 
     const CMVideoDimensions srcDimensions = { (int32_t)frame.width, (int32_t)frame.height };
-    const CMVideoDimensions dstDimensions = CMVideoFormatDescriptionGetDimensions( _outputFormatDescription );
-    if ( srcDimensions.width != dstDimensions.width || srcDimensions.height != dstDimensions.height ) {
+    const CMVideoDimensions expectedDimensions = _sourceDimensions;
+    if ( srcDimensions.width != expectedDimensions.width || srcDimensions.height != expectedDimensions.height ) {
         @throw [NSException exceptionWithName:NSInvalidArgumentException reason:@"Invalid pixel buffer dimensions" userInfo:nil];
         return NULL;
     }
 
-    CVReturn err = CVPixelBufferPoolCreatePixelBufferWithAuxAttributes( kCFAllocatorDefault, _bufferPool, _bufferPoolAuxAttributes, &dstPixelBuffer );
-    if ( err == kCVReturnWouldExceedAllocationThreshold ) {
-        NSLog(@"Pool is out of buffers, dropping frame");
-    }
-    else if ( err != kCVReturnSuccess) {
-        NSLog(@"Error at CVPixelBufferPoolCreatePixelBuffer %d", err);
+    perch::FrameBuffer *buffer = perch::SharedPixelBufferPool().Acquire(_outputKey);
+    if ( buffer == NULL ) {
+        NSLog(@"Frame pool is exhausted, dropping frame");
     }
 
-    return dstPixelBuffer;
+    return buffer;
 }
 
-#pragma mark - BGRA CVPixelBuffer from RTCI420Frame (via libYUV)
+#pragma mark - RGB CVPixelBuffer from RTCI420Frame
 
-- (void)convertFrame:(RTCI420Frame *)frame toBuffer:(CVPixelBufferRef)pixelBufferRef
+// The CGImage outputs use RGBA byte order (kCGBitmapByteOrder32Big | kCGImageAlphaNoneSkipLast), regardless of the pixel buffer's format type.
+- (void)convertFrame:(RTCI420Frame *)frame toBuffer:(CVPixelBufferRef)pixelBufferRef layout:(PHRGBLayout)layout
 {
     NSAssert( !CVPixelBufferIsPlanar(pixelBufferRef), @"Can't fill a planar pixel buffer with RGB data!");
 
-	CVPixelBufferLockBaseAddress(pixelBufferRef, 0);
-
-	uint8_t *pxdata = (uint8_t*)CVPixelBufferGetBaseAddress(pixelBufferRef);
-    const uint8_t* yPlane = frame.yPlane;
-    const uint8_t* uPlane = frame.uPlane;
-    const uint8_t* vPlane = frame.vPlane;
-
-    int yStride = (int)frame.yPitch;
-    int uStride = (int)frame.uPitch;
-    int vStride = (int)frame.vPitch;
-    int width = (int)frame.width;
-    int height = (int)frame.height;
-    int rgbStride = width * 4;
-    // multiply chroma strides by 2 as bytesPerRow represents 2x2 subsample
-//    int uStride = [[frame.format.bytesPerRow objectAtIndex:1] intValue] * 2;
-//    int vStride = [[frame.format.bytesPerRow objectAtIndex:2] intValue] * 2;
-
-    // Use libyuv to convert to the RGB for display purposes
-    I420ToARGB(yPlane, yStride,
-               vPlane, uStride,
-               uPlane, vStride,
-               pxdata,
-               rgbStride,
-               width, height);
-
-	CVPixelBufferUnlockBaseAddress(pixelBufferRef, 0);
+    CVPixelBufferLockBaseAddress(pixelBufferRef, 0);
+
+    uint8_t *pxdata = (uint8_t *)CVPixelBufferGetBaseAddress(pixelBufferRef);
+    int rgbStride = (int)CVPixelBufferGetBytesPerRow(pixelBufferRef);
+    int outputWidth = (int)CVPixelBufferGetWidth(pixelBufferRef);
+    int outputHeight = (int)CVPixelBufferGetHeight(pixelBufferRef);
+
+    // Scale and convert straight into the pixel buffer, there is no intermediate RGB copy.
+
+    PHScaleConvertI420ToRGB(frame.yPlane, (int)frame.yPitch,
+                            frame.uPlane, (int)frame.uPitch,
+                            frame.vPlane, (int)frame.vPitch,
+                            (int)frame.width, (int)frame.height,
+                            pxdata, rgbStride,
+                            outputWidth, outputHeight,
+                            self.scaleFilter, self.colorMatrix, layout);
+
+    CVPixelBufferUnlockBaseAddress(pixelBufferRef, 0);
 }
 
 // TODO: Odd logic / state dependency when determining output format.
@@ -348,7 +319,7 @@ static BOOL kFrameConverterUseAccelerate = YES;
     }
 }
 
-#pragma mark - BGRA CGImage (NSData) from RTCI420Frame. libYUV conversion.
+#pragma mark - RGBA CGImage (NSData) from RTCI420Frame
 
 - (CGImageRef)createCGImageFromFrame:(RTCI420Frame *)frame backedByData:(NSData *)data
 {
@@ -398,22 +369,13 @@ static BOOL kFrameConverterUseAccelerate = YES;
     else
     {
         uint8_t *pxdata = (uint8_t*)[pixelData bytes];
-        const uint8_t* yPlane = frame.yPlane;
-        const uint8_t* uPlane = frame.uPlane;
-        const uint8_t* vPlane = frame.vPlane;
-
-        int yStride = (int)frame.yPitch;
-        // multiply chroma strides by 2 as bytesPerRow represents 2x2 subsample
-        int uStride = (int)frame.uPitch * 2;
-        int vStride = (int)frame.vPitch * 2;
-
-        // Use libyuv to convert to the RGB for display purposes
-        I420ToARGB(yPlane, yStride,
-                   vPlane, uStride,
-                   uPlane, vStride,
-                   pxdata,
-                   (int)frame.width * 4,
-                   (int)frame.width, (int)frame.height);
+
+        PHConvertI420ToRGB(frame.yPlane, (int)frame.yPitch,
+                           frame.uPlane, (int)frame.uPitch,
+                           frame.vPlane, (int)frame.vPitch,
+                           pxdata, (int)frame.width * 4,
+                           (int)frame.width, (int)frame.height,
+                           self.colorMatrix, PHRGBLayoutRGBA);
     }
 }
 
@@ -433,23 +395,25 @@ static BOOL kFrameConverterUseAccelerate = YES;
 
 #pragma mark - CGImage from BGRA CVPixelBuffer
 
-void dataProviderReleaseCallback(void *info, const void *data, size_t size)
+static void dataProviderReleaseCallback(void *info, const void * /* data */, size_t /* size */)
 {
-    CVPixelBufferRef pixelBuffer = (CVPixelBufferRef)info;
+    perch::FrameBuffer *buffer = (perch::FrameBuffer *)info;
 
-    if (pixelBuffer != NULL) {
-        CVPixelBufferUnlockBaseAddress(pixelBuffer, kCVPixelBufferLock_ReadOnly);
-        CVPixelBufferRelease(pixelBuffer);
+    if (buffer != NULL) {
+        CVPixelBufferUnlockBaseAddress(perch::PixelBufferForFrame(buffer), kCVPixelBufferLock_ReadOnly);
+        perch::SharedPixelBufferPool().Release(buffer);
     }
     else {
         NSLog(@"No pixel buffer to release!");
     }
 }
 
-- (CGImageRef)createCGImageFromPixelBufferNoCopy:(CVPixelBufferRef)imageBuffer
+// The image borrows the pooled buffer, which goes back to the pool when the image's data provider is released.
+- (CGImageRef)createCGImageFromBufferNoCopy:(perch::FrameBuffer *)buffer
 {
     // Create a CVPixelBufferRef filled with BGRA samples from the incoming video frame.
     CGImageRef image = NULL;
+    CVPixelBufferRef imageBuffer = perch::PixelBufferForFrame(buffer);
 
     if (imageBuffer == NULL) {
         return image;
@@ -469,7 +433,7 @@ void dataProviderReleaseCallback(void *info, const void *data, size_t size)
     CFIndex totalBytes = rowBytes * height;
     void *bytes = CVPixelBufferGetBaseAddress(imageBuffer);
 
-    CGDataProviderRef provider = CGDataProviderCreateWithData(imageBuffer, bytes, totalBytes, dataProviderReleaseCallback);
+    CGDataProviderRef provider = CGDataProviderCreateWithData(buffer, bytes, totalBytes, dataProviderReleaseCallback);
 
     image = CGImageCreate(width,
                           height,
@@ -533,7 +497,7 @@ void dataProviderReleaseCallback(void *info, const void *data, size_t size)
     size_t widths[3] = {frame.width, frame.chromaWidth, frame.chromaWidth};
     size_t rowBytes[3] = {frame.yPitch, frame.uPitch, frame.vPitch};
     size_t heights[3] = {frame.height, frame.chromaHeight, frame.chromaHeight};
-    void *planeData[3] = {(void *)frame.yPlane, (void *)frame.uPlane, (void *)frame.vPlane};
+    const uint8_t *planeData[3] = {frame.yPlane, frame.uPlane, frame.vPlane};
 
     // Copy each plane accounting for differences in rowBytes between the source and destination.
 
@@ -543,8 +507,8 @@ void dataProviderReleaseCallback(void *info, const void *data, size_t size)
         size_t destinationRowBytes = CVPixelBufferGetBytesPerRowOfPlane(pixelBuffer, i);
         size_t planeHeight = heights[i];
         size_t planeWidth = widths[i];
-        void *sourcePlaneBytes = planeData[i];
-        void *destinationPlaneBytes = CVPixelBufferGetBaseAddressOfPlane(pixelBuffer, i);
+        const uint8_t *sourcePlaneBytes = planeData[i];
+        uint8_t *destinationPlaneBytes = (uint8_t *)CVPixelBufferGetBaseAddressOfPlane(pixelBuffer, i);
         BOOL rowBytesEqual = sourceRowBytes == destinationRowBytes;
         size_t planeSize = destinationRowBytes * planeHeight;
 
@@ -584,59 +548,29 @@ void dataProviderReleaseCallback(void *info, const void *data, size_t size)
     }
 
     // The source is YUV420 planar, and we need to pack its UV planes into YUV420P bi-planar.
+    // When the pool is smaller than the source, the planes are scaled while they are packed.
 
-    size_t width = frame.width;
-    size_t height = frame.height;
-    size_t subsampledHeight = frame.chromaHeight;
+    int outputWidth = (int)CVPixelBufferGetWidth(pixelBuffer);
+    int outputHeight = (int)CVPixelBufferGetHeight(pixelBuffer);
 
     CVPixelBufferLockBaseAddress(pixelBuffer, 0);
 
-//    NSDate *start = [NSDate date];
-
-    // Copy the Y-plane
-
-    size_t rowBytesSource = frame.yPitch;
-    size_t rowBytesDestination = CVPixelBufferGetBytesPerRowOfPlane(pixelBuffer, 0);
-    size_t sizeSource = rowBytesSource * height;
-
-    void *yDataSource = (void *)frame.yPlane;
-    void *yDataDestination = CVPixelBufferGetBaseAddressOfPlane(pixelBuffer, 0);
-    BOOL yBytesEqual = rowBytesSource == rowBytesDestination;
-
-    if (yBytesEqual) {
-        memcpy(yDataDestination, yDataSource, sizeSource);
-    }
-    else {
-        for (int row = 0; row < height; row++) {
-            memcpy(yDataDestination, yDataSource, width);
-            yDataSource = yDataSource + rowBytesSource;
-            yDataDestination = yDataDestination + rowBytesDestination;
-        }
-    }
-
-    // Pack the source U, V planes into one interleaved UV plane.
-
-    size_t uRowBytes = frame.uPitch;
-    size_t vRowBytes = frame.vPitch;
-    void *uData = (void *)frame.uPlane;
-    void *vData = (void *)frame.vPlane;
-
-    size_t uvRowBytes = CVPixelBufferGetBytesPerRowOfPlane(pixelBuffer, 1);
-    void *uvData = CVPixelBufferGetBaseAddressOfPlane(pixelBuffer, 1);
-
     // @note: The RTCI420Frame source has unaligned planes, while our destination is properly (64-byte) aligned.
-    // Write garbage data to the padded bytes for improved interleaving performance via NEON intrinsics.
-
-    int dstWidth = (int)rowBytesDestination;
-
-    for (int row = 0; row < subsampledHeight; row++) {
-        ConvertPlanarUVToPackedRow(uData, vData, uvData, dstWidth);
-        uData = uData + uRowBytes;
-        vData = vData + vRowBytes;
-        uvData = uvData + uvRowBytes;
-    }
-
-//    DDLogVerbose(@"Packed in: %f ms", -1000. * [start timeIntervalSinceNow]);
+    // The kernels handle ragged row tails, so only the visible samples are read and written.
+
+    uint8_t *yDataDestination = (uint8_t *)CVPixelBufferGetBaseAddressOfPlane(pixelBuffer, 0);
+    int yRowBytesDestination = (int)CVPixelBufferGetBytesPerRowOfPlane(pixelBuffer, 0);
+    uint8_t *uvData = (uint8_t *)CVPixelBufferGetBaseAddressOfPlane(pixelBuffer, 1);
+    int uvRowBytes = (int)CVPixelBufferGetBytesPerRowOfPlane(pixelBuffer, 1);
+
+    PHScaleI420ToNV12(frame.yPlane, (int)frame.yPitch,
+                      frame.uPlane, (int)frame.uPitch,
+                      frame.vPlane, (int)frame.vPitch,
+                      (int)frame.width, (int)frame.height,
+                      yDataDestination, yRowBytesDestination,
+                      uvData, uvRowBytes,
+                      outputWidth, outputHeight,
+                      self.scaleFilter);
 
     CVPixelBufferUnlockBaseAddress(pixelBuffer, 0);
 
@@ -646,10 +580,18 @@ void dataProviderReleaseCallback(void *info, const void *data, size_t size)
 #pragma mark - CMSampleBuffer (wrapping CVPixelBuffer) from RTCI420Frame
 
 // TODO: Error handling
-- (CMSampleBufferRef)createSampleBufferWithImageBuffer:(CVImageBufferRef)imageBuffer
+- (CMSampleBufferRef)createSampleBufferWithBuffer:(perch::FrameBuffer *)buffer
 {
     CMSampleBufferRef sampleBuffer = NULL;
 
+    // The sample buffer holds a leased buffer, which returns to the pool once the sample buffer and the display layer are both done with it.
+
+    CVImageBufferRef imageBuffer = perch::CreateLeasedPixelBuffer(buffer);
+
+    if (imageBuffer == NULL) {
+        return NULL;
+    }
+
     // Pack the image into a sample buffer ref.
     CMVideoFormatDescriptionRef format = NULL;
     OSStatus formatStatus = 0;
@@ -672,7 +614,7 @@ void dataProviderReleaseCallback(void *info, const void *data, size_t size)
 
     // 
 
-    if (_supportsAccelerate) {
+    if (_supportsReadySampleBuffers) {
         sampleBufferStatus = CMSampleBufferCreateReadyWithImageBuffer(kCFAllocatorDefault,
                                                                       imageBuffer,
                                                                       format,
@@ -690,14 +632,17 @@ void dataProviderReleaseCallback(void *info, const void *data, size_t size)
                                                                 &sampleBuffer);
     }
 
-    // Force immediate display of the sample buffer.
+    CVPixelBufferRelease(imageBuffer);
 
-    NSMutableDictionary *sampleAttachments = [(NSArray *)CMSampleBufferGetSampleAttachmentsArray( sampleBuffer, true ) firstObject];
-    sampleAttachments[(id)kCMSampleAttachmentKey_DisplayImmediately] = @YES;
+    if (sampleBuffer == NULL) {
+        NSLog(@"Failed to create CMSampleBuffer with status: %d format status: %d", (int)sampleBufferStatus, (int)formatStatus);
+        return NULL;
+    }
 
-    // Cleanup
+    // Force immediate display of the sample buffer.
 
-    CFRelease(imageBuffer);
+    NSMutableDictionary *sampleAttachments = [(__bridge NSArray *)CMSampleBufferGetSampleAttachmentsArray( sampleBuffer, true ) firstObject];
+    sampleAttachments[(id)kCMSampleAttachmentKey_DisplayImmediately] = @YES;
 
     if (sampleBufferStatus != 0 || formatStatus != 0) {
         NSLog(@"Created CMSampleBuffer with status: %d format status: %d", (int)sampleBufferStatus, (int)formatStatus);
@@ -706,52 +651,6 @@ void dataProviderReleaseCallback(void *info, const void *data, size_t size)
     return sampleBuffer;
 }
 
-#pragma mark - YUV420 to RGB Conversion (via Accelerate & vImage)
-
-- (vImage_Error)convertFrameVImageYUV:(RTCI420Frame *)frame toBuffer:(CVPixelBufferRef)pixelBufferRef
-{
-    if (pixelBufferRef == NULL) {
-        return kvImageInvalidParameter;
-    }
-
-    // Compute info for interleaved YUV420 source.
-
-    vImagePixelCount width = frame.width;
-    vImagePixelCount height = frame.height;
-    vImagePixelCount subsampledWidth = frame.chromaWidth;
-    vImagePixelCount subsampledHeight = frame.chromaHeight;
-
-    const uint8_t *yPlane = frame.yPlane;
-    const uint8_t *uPlane = frame.uPlane;
-    const uint8_t *vPlane = frame.vPlane;
-    size_t yStride = (size_t)frame.yPitch;
-    size_t uStride = (size_t)frame.uPitch;
-    size_t vStride = (size_t)frame.vPitch;
-
-    // Create vImage buffers to represent each of the Y, U, and V planes
-
-    vImage_Buffer yPlaneBuffer = {.data = (void *)yPlane, .height = height, .width = width, .rowBytes = yStride};
-    vImage_Buffer uPlaneBuffer = {.data = (void *)uPlane, .height = subsampledHeight, .width = subsampledWidth, .rowBytes = uStride};
-    vImage_Buffer vPlaneBuffer = {.data = (void *)vPlane, .height = subsampledHeight, .width = subsampledWidth, .rowBytes = vStride};
-
-    // Create a vImage buffer for the destination pixel buffer.
-
-    CVPixelBufferLockBaseAddress(pixelBufferRef, 0);
-
-    void *pixelBufferData = CVPixelBufferGetBaseAddress(pixelBufferRef);
-    size_t rowBytes = CVPixelBufferGetBytesPerRow(pixelBufferRef);
-    vImage_Buffer destinationImageBuffer = {.data = pixelBufferData, .height = height, .width = width, .rowBytes = rowBytes};
-
-    // Do the conversion.
-
-    uint8_t permuteMap[4] = {3, 2, 1, 0}; // BGRA
-    vImage_Error convertError = vImageConvert_420Yp8_Cb8_Cr8ToARGB8888(&yPlaneBuffer, &vPlaneBuffer, &uPlaneBuffer, &destinationImageBuffer, self.conversionInfo, permuteMap, 255, 0);
-
-    CVPixelBufferUnlockBaseAddress(pixelBufferRef, 0);
-
-    return convertError;
-}
-
 #pragma mark - Class Methods
 
 + (PHFrameConverterOutput)recommendedOutputFormat
@@ -759,132 +658,83 @@ void dataProviderReleaseCallback(void *info, const void *data, size_t size)
     return PHFrameConverterOutputCGImageBackedByCVPixelBuffer;
 }
 
-#pragma mark - Buffer Pools
-
-- (BOOL)initializeBuffersWithOutputDimensions:(CMVideoDimensions)outputDimensions pixelFormat:(OSType)format retainedBufferCountHint:(size_t)clientRetainedBufferCountHint
++ (CMVideoDimensions)outputDimensionsForSourceDimensions:(CMVideoDimensions)dimensions displaySize:(CGSize)displaySize
 {
-    BOOL success = YES;
+    int32_t displayWidth = (int32_t)ceil(displaySize.width);
+    int32_t displayHeight = (int32_t)ceil(displaySize.height);
 
-    size_t maxRetainedBufferCount = clientRetainedBufferCountHint;
-    _bufferPool = createPixelBufferPool( outputDimensions.width, outputDimensions.height, format, (int32_t)maxRetainedBufferCount, self.outputType );
-    if ( ! _bufferPool ) {
-        NSLog( @"Problem initializing a buffer pool." );
-        success = NO;
-        goto bail;
+    if (displayWidth <= 0 || displayHeight <= 0) {
+        return dimensions;
     }
 
-    _bufferPoolAuxAttributes = createPixelBufferPoolAuxAttributes( (int32_t)maxRetainedBufferCount );
+    int32_t divisor = 1;
+    int32_t nextDivisor = 2;
 
-    if (_shouldPreallocateBuffers) {
-        preallocatePixelBuffersInPool( _bufferPool, _bufferPoolAuxAttributes );
-    }
-
-    CMFormatDescriptionRef outputFormatDescription = NULL;
-    CVPixelBufferRef testPixelBuffer = NULL;
-    CVPixelBufferPoolCreatePixelBufferWithAuxAttributes( kCFAllocatorDefault, _bufferPool, _bufferPoolAuxAttributes, &testPixelBuffer );
-    if ( ! testPixelBuffer ) {
-        NSLog( @"Problem creating a pixel buffer." );
-        success = NO;
-        goto bail;
+    while (dimensions.width % nextDivisor == 0 && dimensions.height % nextDivisor == 0 &&
+           dimensions.width / nextDivisor >= displayWidth && dimensions.height / nextDivisor >= displayHeight) {
+        divisor = nextDivisor;
+        nextDivisor *= 2;
     }
-    CMVideoFormatDescriptionCreateForImageBuffer( kCFAllocatorDefault, testPixelBuffer, &outputFormatDescription );
-    _outputFormatDescription = outputFormatDescription;
-    CFRelease( testPixelBuffer );
 
-bail:
-    if ( ! success ) {
-        [self deleteBuffers];
-    }
-    return success;
+    CMVideoDimensions outputDimensions = { dimensions.width / divisor, dimensions.height / divisor };
+    return outputDimensions;
 }
 
-- (void)deleteBuffers
-{
-    NSLog(@"Deleting converter buffer pool.");
+#pragma mark - Buffer Pools
 
-    if ( _bufferPool ) {
-        CFRelease( _bufferPool );
-        _bufferPool = NULL;
-    }
-    if ( _bufferPoolAuxAttributes ) {
-        CFRelease( _bufferPoolAuxAttributes );
-        _bufferPoolAuxAttributes = NULL;
-    }
-    if ( _outputFormatDescription ) {
-        CFRelease( _outputFormatDescription );
-        _outputFormatDescription = NULL;
-    }
++ (NSDictionary *)framePoolStatistics
+{
+    perch::FramePoolStats stats = perch::SharedPixelBufferPool().Stats();
+
+    return @{ @"hits" : @(stats.hits),
+              @"misses" : @(stats.misses),
+              @"allocations" : @(stats.allocations),
+              @"deallocations" : @(stats.deallocations),
+              @"outstanding" : @(stats.outstanding),
+              @"highWater" : @(stats.highWater),
+              @"evictions" : @(stats.evictions) };
 }
 
-static CVPixelBufferPoolRef createPixelBufferPool( int32_t width, int32_t height, OSType pixelFormat, int32_t maxBufferCount, PHFrameConverterOutput outputType )
+- (BOOL)initializeBuffersWithOutputDimensions:(CMVideoDimensions)outputDimensions pixelFormat:(OSType)format
 {
-    CVPixelBufferPoolRef outputPool = NULL;
+    // Buffers come from the shared pool, which keeps every recently used size warm. Switching back to a previous size is free.
 
-    CFMutableDictionaryRef sourcePixelBufferOptions = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
-    CFNumberRef number = CFNumberCreate( kCFAllocatorDefault, kCFNumberSInt32Type, &pixelFormat );
-    CFDictionaryAddValue( sourcePixelBufferOptions, kCVPixelBufferPixelFormatTypeKey, number );
-    CFRelease( number );
+    perch::FramePool &pool = perch::SharedPixelBufferPool();
+    _outputKey = perch::FrameKey(outputDimensions.width, outputDimensions.height, format);
 
-    number = CFNumberCreate( kCFAllocatorDefault, kCFNumberSInt32Type, &width );
-    CFDictionaryAddValue( sourcePixelBufferOptions, kCVPixelBufferWidthKey, number );
-    CFRelease( number );
-
-    number = CFNumberCreate( kCFAllocatorDefault, kCFNumberSInt32Type, &height );
-    CFDictionaryAddValue( sourcePixelBufferOptions, kCVPixelBufferHeightKey, number );
-    CFRelease( number );
-
-    // Round number, 128 is better than 64 for display.
-
-    if (outputType == PHFrameConverterOutputCMSampleBufferBackedByCVPixelBuffer) {
-
-        CFDictionaryAddValue( sourcePixelBufferOptions, kCVPixelBufferBytesPerRowAlignmentKey, (void *)@(128) );
-        CFDictionaryAddValue( sourcePixelBufferOptions, kCVPixelBufferPlaneAlignmentKey, (void *)@(128) );
+    if (_shouldPreallocateBuffers) {
+        perch::FrameBuffer *buffers[kFrameConverterPreallocatedBufferCount] = {};
 
+        for (int i = 0; i < kFrameConverterPreallocatedBufferCount; i++) {
+            buffers[i] = pool.Acquire(_outputKey);
+        }
+        for (int i = 0; i < kFrameConverterPreallocatedBufferCount; i++) {
+            pool.Release(buffers[i]);
+        }
     }
 
-    // @note: In order for rendering to work via AVSampleBufferDisplayLayer IOSurfaces need to be shared across process boundaries.
-    // VTDecompressionSession can add this key for you, but if you are creating your own buffer pool it must be added manually.
-    // Mac example: https://developer.apple.com/library/mac/samplecode/MultiGPUIOSurface/Introduction/Intro.html#//apple_ref/doc/uid/DTS40010132
-
-    // TODO: Obfuscate IOSurfaceIsGlobal for the app store reviewers, as it is private on iOS (but not Mac).
-
-    ((__bridge NSMutableDictionary *)sourcePixelBufferOptions)[(id)kCVPixelBufferIOSurfacePropertiesKey] = @{ @"IOSurfaceIsGlobal" : @YES };
-
-    number = CFNumberCreate( kCFAllocatorDefault, kCFNumberSInt32Type, &maxBufferCount );
-    CFDictionaryRef pixelBufferPoolOptions = CFDictionaryCreate( kCFAllocatorDefault, (const void **)&kCVPixelBufferPoolMinimumBufferCountKey, (const void **)&number, 1, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
-    CFRelease( number );
-
-    CVPixelBufferPoolCreate( kCFAllocatorDefault, pixelBufferPoolOptions, sourcePixelBufferOptions, &outputPool );
+    perch::FrameBuffer *testBuffer = pool.Acquire(_outputKey);
+    if ( ! testBuffer ) {
+        NSLog( @"Problem creating a pixel buffer." );
+        return NO;
+    }
 
-    CFRelease( sourcePixelBufferOptions );
-    CFRelease( pixelBufferPoolOptions );
-    return outputPool;
-}
+    CMFormatDescriptionRef outputFormatDescription = NULL;
+    CMVideoFormatDescriptionCreateForImageBuffer( kCFAllocatorDefault, perch::PixelBufferForFrame(testBuffer), &outputFormatDescription );
+    _outputFormatDescription = outputFormatDescription;
+    pool.Release(testBuffer);
 
-static CFDictionaryRef createPixelBufferPoolAuxAttributes( int32_t maxBufferCount )
-{
-    // CVPixelBufferPoolCreatePixelBufferWithAuxAttributes() will return kCVReturnWouldExceedAllocationThreshold if we have already vended the max number of buffers
-    NSDictionary *auxAttributes = [[NSDictionary alloc] initWithObjectsAndKeys:[NSNumber numberWithInt:maxBufferCount], (id)kCVPixelBufferPoolAllocationThresholdKey, nil];
-    return (__bridge_retained CFDictionaryRef)auxAttributes;
+    return YES;
 }
 
-static void preallocatePixelBuffersInPool( CVPixelBufferPoolRef pool, CFDictionaryRef auxAttributes )
+- (void)deleteBuffers
 {
-    // Preallocate buffers in the pool, since this is for real-time display/capture
-    NSMutableArray *pixelBuffers = [[NSMutableArray alloc] init];
-    while ( 1 )
-    {
-        CVPixelBufferRef pixelBuffer = NULL;
-        OSStatus err = CVPixelBufferPoolCreatePixelBufferWithAuxAttributes( kCFAllocatorDefault, pool, auxAttributes, &pixelBuffer );
-
-        if ( err == kCVReturnWouldExceedAllocationThreshold ) {
-            break;
-        }
-        assert( err == noErr );
+    // Pooled buffers outlive the converter, only the format description is ours.
 
-        [pixelBuffers addObject:(__bridge_transfer id)pixelBuffer];
+    if ( _outputFormatDescription ) {
+        CFRelease( _outputFormatDescription );
+        _outputFormatDescription = NULL;
     }
-    [pixelBuffers removeAllObjects];
 }
 
 @end
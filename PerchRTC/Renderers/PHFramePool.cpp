@@ -0,0 +1,442 @@
+//
+//  PHFramePool.cpp
+//  PerchRTC
+//
+//  Created by Christopher Eagleston on 2015-06-16.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#include "PHFramePool.h"
+
+#include <stdlib.h>
+
+namespace perch {
+
+    namespace {
+
+        const int kFrameAlignment = 64;
+
+        inline int AlignUp(int value)
+        {
+            return (value + kFrameAlignment - 1) & ~(kFrameAlignment - 1);
+        }
+
+        inline size_t AlignUp(size_t value)
+        {
+            return (value + kFrameAlignment - 1) & ~(size_t)(kFrameAlignment - 1);
+        }
+
+        // Size classes are packed into one word so that they can be claimed with a single compare-and-swap. Zero means unclaimed.
+        inline uint64_t PackKey(const FrameKey &key)
+        {
+            return ((uint64_t)key.format << 32) | ((uint64_t)(key.width & 0xFFFF) << 16) | (uint64_t)(key.height & 0xFFFF);
+        }
+
+        // Head words hold a generation tag in the high half, and index + 1 in the low half.
+        inline uint64_t MakeHead(uint64_t previous, uint32_t link)
+        {
+            return (((previous >> 32) + 1) << 32) | link;
+        }
+
+        inline uint32_t HeadLink(uint64_t head)
+        {
+            return (uint32_t)(head & 0xFFFFFFFF);
+        }
+
+        void UpdateHighWater(std::atomic<uint64_t> &highWater, uint64_t value)
+        {
+            uint64_t current = highWater.load(std::memory_order_relaxed);
+
+            while (value > current && !highWater.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+            }
+        }
+
+    } // namespace
+
+    bool FramePlaneLayoutForKey(const FrameKey &key, FramePlaneLayout *layout)
+    {
+        if (key.width <= 0 || key.height <= 0 || layout == NULL) {
+            return false;
+        }
+
+        const int chromaWidth = (key.width + 1) / 2;
+        const int chromaHeight = (key.height + 1) / 2;
+
+        switch (key.format) {
+            case kFrameFormatARGB:
+            case kFrameFormatBGRA:
+                layout->planeCount = 1;
+                layout->strides[0] = AlignUp(4 * key.width);
+                break;
+            case kFrameFormatNV12:
+                layout->planeCount = 2;
+                layout->strides[0] = AlignUp(key.width);
+                layout->strides[1] = AlignUp(2 * chromaWidth);
+                break;
+            case kFrameFormatI420:
+                layout->planeCount = 3;
+                layout->strides[0] = AlignUp(key.width);
+                layout->strides[1] = AlignUp(chromaWidth);
+                layout->strides[2] = AlignUp(chromaWidth);
+                break;
+            default:
+                return false;
+        }
+
+        size_t offset = 0;
+
+        for (int plane = 0; plane < layout->planeCount; plane++) {
+            int rows = plane == 0 ? key.height : chromaHeight;
+            layout->offsets[plane] = offset;
+            offset += AlignUp((size_t)layout->strides[plane] * rows);
+        }
+
+        layout->byteSize = offset;
+
+        return true;
+    }
+
+    void *AlignedHeapAllocator::Allocate(const FrameKey &key)
+    {
+        FramePlaneLayout layout;
+
+        if (!FramePlaneLayoutForKey(key, &layout)) {
+            return NULL;
+        }
+
+        void *storage = NULL;
+
+        if (posix_memalign(&storage, kFrameAlignment, layout.byteSize) != 0) {
+            return NULL;
+        }
+
+        return storage;
+    }
+
+    void AlignedHeapAllocator::Free(const FrameKey & /* key */, void *handle)
+    {
+        free(handle);
+    }
+
+    // FrameStack
+
+    void FrameStack::Push(FrameBuffer *buffers, uint32_t index)
+    {
+        uint64_t head = _head.load(std::memory_order_relaxed);
+
+        do {
+            buffers[index]._next.store(HeadLink(head), std::memory_order_relaxed);
+        } while (!_head.compare_exchange_weak(head, MakeHead(head, index + 1), std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    int32_t FrameStack::Pop(FrameBuffer *buffers)
+    {
+        uint64_t head = _head.load(std::memory_order_acquire);
+
+        while (HeadLink(head) != 0) {
+            uint32_t index = HeadLink(head) - 1;
+
+            // Buffers are never destroyed while the pool exists, so reading a stale link is harmless. The tag rejects the swap.
+            uint32_t next = buffers[index]._next.load(std::memory_order_relaxed);
+
+            if (_head.compare_exchange_weak(head, MakeHead(head, next), std::memory_order_acquire, std::memory_order_acquire)) {
+                return (int32_t)index;
+            }
+        }
+
+        return -1;
+    }
+
+    // FramePool
+
+    const int FramePool::kMaxSizeClasses;
+    const int FramePool::kMaxBuffers;
+
+    FramePool::FramePool(std::unique_ptr<FrameAllocator> allocator, int maxCachedPerSizeClass)
+    : _allocator(std::move(allocator)), _maxCachedPerSizeClass(maxCachedPerSizeClass), _clock(0),
+      _hits(0), _misses(0), _allocations(0), _deallocations(0), _outstanding(0), _highWater(0), _evictions(0)
+    {
+        for (int i = 0; i < kMaxSizeClasses; i++) {
+            _cachedCount[i].store(0, std::memory_order_relaxed);
+            _sizeClassKeys[i].store(0, std::memory_order_relaxed);
+            _sizeClassLastUsed[i].store(0, std::memory_order_relaxed);
+        }
+
+        for (int i = kMaxBuffers - 1; i >= 0; i--) {
+            _unused.Push(_buffers, (uint32_t)i);
+        }
+    }
+
+    FramePool::~FramePool()
+    {
+        // Outstanding buffers must have been released by now.
+
+        Trim();
+    }
+
+    FrameBuffer *FramePool::Acquire(const FrameKey &key)
+    {
+        int sizeClass = SizeClassForKey(key);
+
+        // Take the most recently released buffer of this size.
+
+        if (sizeClass >= 0) {
+            int32_t index = PopCached(sizeClass, key);
+
+            if (index >= 0) {
+                _hits.fetch_add(1, std::memory_order_relaxed);
+                UpdateHighWater(_highWater, _outstanding.fetch_add(1, std::memory_order_relaxed) + 1);
+                return &_buffers[index];
+            }
+        }
+
+        _misses.fetch_add(1, std::memory_order_relaxed);
+
+        int32_t index = _unused.Pop(_buffers);
+
+        // Every slot holds a buffer. Make room by freeing a cached one of another size, rather than dropping the frame.
+        // Another thread may take the freed slot first, so this is bounded rather than retried until it works.
+
+        for (int attempt = 0; index < 0 && attempt < kMaxBuffers && FreeLeastRecentlyUsedBuffer(); attempt++) {
+            index = _unused.Pop(_buffers);
+        }
+
+        if (index < 0) {
+            return NULL;
+        }
+
+        FrameBuffer &buffer = _buffers[index];
+        buffer._handle = _allocator->Allocate(key);
+
+        if (buffer._handle == NULL) {
+            _unused.Push(_buffers, (uint32_t)index);
+            return NULL;
+        }
+
+        buffer._key = key;
+
+        _allocations.fetch_add(1, std::memory_order_relaxed);
+        UpdateHighWater(_highWater, _outstanding.fetch_add(1, std::memory_order_relaxed) + 1);
+
+        return &buffer;
+    }
+
+    void FramePool::Release(FrameBuffer *buffer)
+    {
+        if (buffer == NULL) {
+            return;
+        }
+
+        uint32_t index = (uint32_t)(buffer - _buffers);
+        int sizeClass = FindSizeClass(PackKey(buffer->_key));
+
+        _outstanding.fetch_sub(1, std::memory_order_relaxed);
+
+        // Keep the buffer warm, unless its size has been evicted or its size class is full.
+
+        if (sizeClass >= 0) {
+            if (_cachedCount[sizeClass].fetch_add(1, std::memory_order_relaxed) < _maxCachedPerSizeClass) {
+                _cached[sizeClass].Push(_buffers, index);
+                return;
+            }
+
+            _cachedCount[sizeClass].fetch_sub(1, std::memory_order_relaxed);
+        }
+
+        FreeBuffer(index);
+    }
+
+    void FramePool::Trim()
+    {
+        for (int sizeClass = 0; sizeClass < kMaxSizeClasses; sizeClass++) {
+            DrainSizeClass(sizeClass, 0);
+
+            // Give the class up, so that the next new size doesn't have to evict one which is in use.
+            // A buffer released in the meantime is freed once the class is claimed by another size.
+
+            uint64_t key = _sizeClassKeys[sizeClass].load(std::memory_order_acquire);
+
+            if (key != 0 && _cachedCount[sizeClass].load(std::memory_order_relaxed) == 0) {
+                _sizeClassKeys[sizeClass].compare_exchange_strong(key, 0, std::memory_order_acq_rel);
+            }
+        }
+    }
+
+    FramePoolStats FramePool::Stats() const
+    {
+        FramePoolStats stats;
+        stats.hits = _hits.load(std::memory_order_relaxed);
+        stats.misses = _misses.load(std::memory_order_relaxed);
+        stats.allocations = _allocations.load(std::memory_order_relaxed);
+        stats.deallocations = _deallocations.load(std::memory_order_relaxed);
+        stats.outstanding = _outstanding.load(std::memory_order_relaxed);
+        stats.highWater = _highWater.load(std::memory_order_relaxed);
+        stats.evictions = _evictions.load(std::memory_order_relaxed);
+
+        return stats;
+    }
+
+    int FramePool::FindSizeClass(uint64_t packedKey) const
+    {
+        if (packedKey == 0) {
+            return -1;
+        }
+
+        for (int i = 0; i < kMaxSizeClasses; i++) {
+            if (_sizeClassKeys[i].load(std::memory_order_acquire) == packedKey) {
+                return i;
+            }
+        }
+
+        return -1;
+    }
+
+    int FramePool::SizeClassForKey(const FrameKey &key)
+    {
+        const uint64_t packedKey = PackKey(key);
+
+        if (packedKey == 0) {
+            return -1;
+        }
+
+        while (true) {
+            int sizeClass = FindSizeClass(packedKey);
+
+            if (sizeClass >= 0) {
+                TouchSizeClass(sizeClass);
+                return sizeClass;
+            }
+
+            // Claim a free size class, or else the one which was used least recently.
+
+            int victim = 0;
+            uint64_t victimKey = 0;
+            uint64_t victimLastUsed = UINT64_MAX;
+
+            for (int i = 0; i < kMaxSizeClasses; i++) {
+                uint64_t existing = _sizeClassKeys[i].load(std::memory_order_acquire);
+                uint64_t lastUsed = _sizeClassLastUsed[i].load(std::memory_order_relaxed);
+
+                if (existing == 0) {
+                    victim = i;
+                    victimKey = 0;
+                    break;
+                }
+
+                if (lastUsed < victimLastUsed) {
+                    victim = i;
+                    victimKey = existing;
+                    victimLastUsed = lastUsed;
+                }
+            }
+
+            if (_sizeClassKeys[victim].compare_exchange_strong(victimKey, packedKey, std::memory_order_acq_rel)) {
+                if (victimKey != 0) {
+                    _evictions.fetch_add(1, std::memory_order_relaxed);
+                }
+
+                // Free whatever the previous size left cached. Anything of the old size released later is freed by Release().
+
+                DrainSizeClass(victim, packedKey);
+                TouchSizeClass(victim);
+
+                return victim;
+            }
+
+            // Another thread claimed or evicted it first. Look again, since it may have claimed this size.
+        }
+    }
+
+    void FramePool::TouchSizeClass(int sizeClass)
+    {
+        _sizeClassLastUsed[sizeClass].store(_clock.fetch_add(1, std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    int32_t FramePool::PopCached(int sizeClass, const FrameKey &key)
+    {
+        int32_t index;
+
+        while ((index = _cached[sizeClass].Pop(_buffers)) >= 0) {
+            _cachedCount[sizeClass].fetch_sub(1, std::memory_order_relaxed);
+
+            // The class may have changed hands since this buffer was cached.
+
+            if (_buffers[index]._key == key) {
+                return index;
+            }
+
+            FreeBuffer((uint32_t)index);
+        }
+
+        return -1;
+    }
+
+    void FramePool::DrainSizeClass(int sizeClass, uint64_t keepKey)
+    {
+        uint32_t kept[kMaxBuffers];
+        int keptCount = 0;
+        int32_t index;
+
+        while ((index = _cached[sizeClass].Pop(_buffers)) >= 0) {
+            _cachedCount[sizeClass].fetch_sub(1, std::memory_order_relaxed);
+
+            if (keepKey != 0 && PackKey(_buffers[index]._key) == keepKey) {
+                kept[keptCount++] = (uint32_t)index;
+            }
+            else {
+                FreeBuffer((uint32_t)index);
+            }
+        }
+
+        for (int i = 0; i < keptCount; i++) {
+            _cachedCount[sizeClass].fetch_add(1, std::memory_order_relaxed);
+            _cached[sizeClass].Push(_buffers, kept[i]);
+        }
+    }
+
+    bool FramePool::FreeLeastRecentlyUsedBuffer()
+    {
+        // Visit the size classes from least to most recently used.
+
+        int order[kMaxSizeClasses];
+        uint64_t lastUsed[kMaxSizeClasses];
+
+        for (int i = 0; i < kMaxSizeClasses; i++) {
+            uint64_t used = _sizeClassLastUsed[i].load(std::memory_order_relaxed);
+            int position = i;
+
+            while (position > 0 && lastUsed[position - 1] > used) {
+                order[position] = order[position - 1];
+                lastUsed[position] = lastUsed[position - 1];
+                position--;
+            }
+
+            order[position] = i;
+            lastUsed[position] = used;
+        }
+
+        for (int i = 0; i < kMaxSizeClasses; i++) {
+            int32_t index = _cached[order[i]].Pop(_buffers);
+
+            if (index >= 0) {
+                _cachedCount[order[i]].fetch_sub(1, std::memory_order_relaxed);
+                FreeBuffer((uint32_t)index);
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    void FramePool::FreeBuffer(uint32_t index)
+    {
+        FrameBuffer &buffer = _buffers[index];
+
+        _allocator->Free(buffer._key, buffer._handle);
+        buffer._handle = NULL;
+
+        _deallocations.fetch_add(1, std::memory_order_relaxed);
+        _unused.Push(_buffers, index);
+    }
+
+} // namespace perch
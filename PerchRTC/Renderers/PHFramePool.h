@@ -0,0 +1,189 @@
+//
+//  PHFramePool.h
+//  PerchRTC
+//
+//  Created by Christopher Eagleston on 2015-06-16.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#ifndef PerchRTC_PHFramePool_h
+#define PerchRTC_PHFramePool_h
+
+#include <atomic>
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace perch {
+
+    // Pixel formats use the CoreVideo four character codes, so that keys can be built directly from an OSType.
+
+    const uint32_t kFrameFormatARGB = 0x00000020;   // kCVPixelFormatType_32ARGB
+    const uint32_t kFrameFormatBGRA = 0x42475241;   // kCVPixelFormatType_32BGRA ('BGRA')
+    const uint32_t kFrameFormatNV12 = 0x34323076;   // kCVPixelFormatType_420YpCbCr8BiPlanarVideoRange ('420v')
+    const uint32_t kFrameFormatI420 = 0x79343230;   // kCVPixelFormatType_420YpCbCr8Planar ('y420')
+
+    struct FrameKey
+    {
+        FrameKey() : width(0), height(0), format(0) {}
+        FrameKey(int w, int h, uint32_t f) : width(w), height(h), format(f) {}
+
+        bool operator==(const FrameKey &other) const
+        {
+            return width == other.width && height == other.height && format == other.format;
+        }
+
+        bool operator!=(const FrameKey &other) const
+        {
+            return !(*this == other);
+        }
+
+        int width;
+        int height;
+        uint32_t format;
+    };
+
+    struct FramePlaneLayout
+    {
+        int planeCount;
+        int strides[3];
+        size_t offsets[3];
+        size_t byteSize;
+    };
+
+    // Plane layout used by the heap allocator. Rows are padded to 64 bytes, and each plane starts on a 64 byte boundary.
+    bool FramePlaneLayoutForKey(const FrameKey &key, FramePlaneLayout *layout);
+
+    /**
+     *  Creates and destroys the storage behind pooled frames. The handle is opaque to the pool.
+     */
+    class FrameAllocator
+    {
+    public:
+        virtual ~FrameAllocator() {}
+
+        virtual void *Allocate(const FrameKey &key) = 0;
+        virtual void Free(const FrameKey &key, void *handle) = 0;
+    };
+
+    // 64 byte aligned heap storage, laid out by FramePlaneLayoutForKey().
+    class AlignedHeapAllocator : public FrameAllocator
+    {
+    public:
+        void *Allocate(const FrameKey &key) override;
+        void Free(const FrameKey &key, void *handle) override;
+    };
+
+    class FramePool;
+
+    class FrameBuffer
+    {
+    public:
+        const FrameKey &Key() const { return _key; }
+        void *Handle() const { return _handle; }
+
+    private:
+        friend class FramePool;
+        friend class FrameStack;
+
+        FrameBuffer() : _handle(NULL), _next(0) {}
+
+        FrameKey _key;
+        void *_handle;
+        std::atomic<uint32_t> _next;
+    };
+
+    struct FramePoolStats
+    {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t allocations;
+        uint64_t deallocations;
+        uint64_t outstanding;
+        uint64_t highWater;
+        // Size classes handed over to a new size.
+        uint64_t evictions;
+    };
+
+    /**
+     *  A lock-free stack of buffer indices. The head carries a generation tag, which protects against ABA when a buffer
+     *  is popped and pushed again between another thread's load and compare-and-swap.
+     */
+    class FrameStack
+    {
+    public:
+        FrameStack() : _head(0) {}
+
+        void Push(FrameBuffer *buffers, uint32_t index);
+        // Returns -1 when the stack is empty.
+        int32_t Pop(FrameBuffer *buffers);
+
+    private:
+        std::atomic<uint64_t> _head;
+    };
+
+    /**
+     *  A thread safe cache of frame buffers, bucketed by size class (width, height, and format).
+     *  Acquire() and Release() are lock-free, so buffers can be returned from any thread, for example from a
+     *  CGDataProvider release callback. Buckets stay warm when the active size changes, so switching back and forth
+     *  between resolutions does not reallocate.
+     *
+     *  A buffer is in flight from Acquire() until Release(), which callers make from the release callback of whatever
+     *  wraps it. Only released buffers are handed out again.
+     *
+     *  When every size class is taken, a new size evicts the one which was used least recently. When every buffer slot
+     *  is taken, Acquire() frees cached buffers of other sizes, least recently used first, to make room.
+     */
+    class FramePool
+    {
+    public:
+        static const int kMaxSizeClasses = 8;
+        static const int kMaxBuffers = 64;
+
+        FramePool(std::unique_ptr<FrameAllocator> allocator, int maxCachedPerSizeClass);
+        ~FramePool();
+
+        // Returns NULL if the allocator fails, or if kMaxBuffers are outstanding.
+        FrameBuffer *Acquire(const FrameKey &key);
+        void Release(FrameBuffer *buffer);
+
+        // Frees every cached buffer, and the size classes they leave empty. Outstanding buffers are unaffected.
+        void Trim();
+
+        FramePoolStats Stats() const;
+
+    private:
+        int FindSizeClass(uint64_t packedKey) const;
+        int SizeClassForKey(const FrameKey &key);
+        void TouchSizeClass(int sizeClass);
+        int32_t PopCached(int sizeClass, const FrameKey &key);
+        void DrainSizeClass(int sizeClass, uint64_t keepKey);
+        bool FreeLeastRecentlyUsedBuffer();
+        void FreeBuffer(uint32_t index);
+
+        std::unique_ptr<FrameAllocator> _allocator;
+        const int _maxCachedPerSizeClass;
+
+        FrameBuffer _buffers[kMaxBuffers];
+        FrameStack _unused;
+        FrameStack _cached[kMaxSizeClasses];
+        std::atomic<int> _cachedCount[kMaxSizeClasses];
+        std::atomic<uint64_t> _sizeClassKeys[kMaxSizeClasses];
+        std::atomic<uint64_t> _sizeClassLastUsed[kMaxSizeClasses];
+        std::atomic<uint64_t> _clock;
+
+        std::atomic<uint64_t> _hits;
+        std::atomic<uint64_t> _misses;
+        std::atomic<uint64_t> _allocations;
+        std::atomic<uint64_t> _deallocations;
+        std::atomic<uint64_t> _outstanding;
+        std::atomic<uint64_t> _highWater;
+        std::atomic<uint64_t> _evictions;
+
+        FramePool(const FramePool &) = delete;
+        FramePool &operator=(const FramePool &) = delete;
+    };
+
+} // namespace perch
+
+#endif
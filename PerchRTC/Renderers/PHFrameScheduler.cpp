@@ -0,0 +1,182 @@
+//
+//  PHFrameScheduler.cpp
+//  PerchRTC
+//
+//  Created by Christopher Eagleston on 2015-07-13.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#include "PHFrameScheduler.h"
+
+namespace perch {
+
+    namespace {
+
+        const int64_t kNoTime = -1;
+
+        const int64_t kNanosecondsPerSecond = 1000000000;
+
+        // Both filters weigh new samples by 1/16.
+        const int64_t kFrameSchedulerSmoothing = 16;
+
+        // Consecutive stalls which are taken as a lower frame rate.
+        const int kFrameSchedulerRateChangeRun = 4;
+
+        inline int64_t Abs(int64_t value)
+        {
+            return value < 0 ? -value : value;
+        }
+
+        inline int64_t Clamp(int64_t value, int64_t low, int64_t high)
+        {
+            return value < low ? low : (value > high ? high : value);
+        }
+
+    } // namespace
+
+    FrameScheduler::FrameScheduler(FrameSchedulerConfig config)
+    : _config(config), _lastArrivalNs(kNoTime), _stallCount(0), _lastDueNs(kNoTime), _lastPresentNs(kNoTime), _stats()
+    {
+        if (_config.maxPendingFrames < 1) {
+            _config.maxPendingFrames = 1;
+        }
+    }
+
+    void FrameScheduler::Push(void *frame, int64_t arrivalNs, std::vector<void *> *dropped)
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+
+        UpdateEstimates(arrivalNs);
+
+        // An early frame is held until one interval after the previous one, but for no longer than the playout delay.
+        // A late frame is due right away.
+
+        int64_t due = arrivalNs;
+
+        if (_lastDueNs != kNoTime) {
+            int64_t spaced = _lastDueNs + _stats.arrivalIntervalNs;
+            int64_t latest = arrivalNs + PlayoutDelay();
+
+            due = Clamp(spaced, arrivalNs, latest);
+        }
+
+        PendingFrame pending = { frame, due };
+        _pending.push_back(pending);
+        _lastDueNs = due;
+        _stats.received++;
+
+        while (_pending.size() > _config.maxPendingFrames) {
+            dropped->push_back(_pending.front().frame);
+            _pending.pop_front();
+            _stats.dropped++;
+        }
+    }
+
+    void *FrameScheduler::Tick(int64_t vsyncNs, int64_t refreshIntervalNs, std::vector<void *> *dropped)
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+
+        if (_pending.empty()) {
+            return NULL;
+        }
+
+        // Respect the frame rate cap, with half a refresh of slack so that the cadence doesn't beat against vsync.
+
+        if (_config.maxFrameRate > 0 && _lastPresentNs != kNoTime) {
+            int64_t minInterval = (int64_t)(kNanosecondsPerSecond / _config.maxFrameRate);
+
+            if (vsyncNs - _lastPresentNs < minInterval - refreshIntervalNs / 2) {
+                return NULL;
+            }
+        }
+
+        // Whatever is presented now is on screen at the next refresh.
+
+        const int64_t deadline = vsyncNs + refreshIntervalNs;
+        void *present = NULL;
+        int64_t presentDueNs = 0;
+
+        while (!_pending.empty() && _pending.front().dueNs <= deadline) {
+            if (present) {
+                dropped->push_back(present);
+                _stats.dropped++;
+            }
+
+            present = _pending.front().frame;
+            presentDueNs = _pending.front().dueNs;
+            _pending.pop_front();
+        }
+
+        if (present) {
+            _lastPresentNs = vsyncNs;
+            _stats.presented++;
+
+            if (presentDueNs + refreshIntervalNs < vsyncNs) {
+                _stats.late++;
+            }
+        }
+
+        return present;
+    }
+
+    void FrameScheduler::Flush(std::vector<void *> *flushed)
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+
+        for (size_t i = 0; i < _pending.size(); i++) {
+            flushed->push_back(_pending[i].frame);
+        }
+
+        _stats.flushed += _pending.size();
+        _stats.arrivalIntervalNs = 0;
+        _stats.jitterNs = 0;
+        _stats.delayNs = 0;
+
+        _pending.clear();
+        _lastArrivalNs = kNoTime;
+        _stallCount = 0;
+        _lastDueNs = kNoTime;
+        _lastPresentNs = kNoTime;
+    }
+
+    FrameSchedulerStats FrameScheduler::Stats() const
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        return _stats;
+    }
+
+    void FrameScheduler::UpdateEstimates(int64_t arrivalNs)
+    {
+        const int64_t interval = _lastArrivalNs != kNoTime ? arrivalNs - _lastArrivalNs : 0;
+        int64_t estimate = _stats.arrivalIntervalNs;
+
+        _lastArrivalNs = arrivalNs;
+
+        if (interval <= 0) {
+            return;
+        }
+
+        if (estimate == 0 || (2 * interval > 3 * estimate && ++_stallCount >= kFrameSchedulerRateChangeRun)) {
+            // Reseed, when starting out or when the sender has settled on a lower frame rate.
+
+            _stats.arrivalIntervalNs = interval;
+            _stallCount = 0;
+        }
+        else if (2 * interval <= 3 * estimate && 4 * interval >= estimate) {
+            // Stalls, and the bursts which follow them, are left out. They say nothing about the frame rate, and the
+            // jitter would take ages to recover.
+
+            _stats.jitterNs += (Abs(interval - estimate) - _stats.jitterNs) / kFrameSchedulerSmoothing;
+            _stats.arrivalIntervalNs += (interval - estimate) / kFrameSchedulerSmoothing;
+            _stallCount = 0;
+        }
+
+        _stats.delayNs = PlayoutDelay();
+    }
+
+    int64_t FrameScheduler::PlayoutDelay() const
+    {
+        return Clamp(_config.jitterMultiplier * _stats.jitterNs, _config.minDelayNs, _config.maxDelayNs);
+    }
+
+} // namespace perch
@@ -0,0 +1,101 @@
+//
+//  PHFrameScheduler.h
+//  PerchRTC
+//
+//  Created by Christopher Eagleston on 2015-07-13.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#ifndef PerchRTC_PHFrameScheduler_h
+#define PerchRTC_PHFrameScheduler_h
+
+#include <deque>
+#include <mutex>
+#include <stdint.h>
+#include <vector>
+
+namespace perch {
+
+    struct FrameSchedulerConfig
+    {
+        FrameSchedulerConfig()
+        : minDelayNs(0), maxDelayNs(100000000LL), jitterMultiplier(2), maxPendingFrames(3), maxFrameRate(0)
+        {}
+
+        // The longest an early frame is held. It follows the arrival jitter (times the multiplier), within these bounds.
+        int64_t minDelayNs;
+        int64_t maxDelayNs;
+        int jitterMultiplier;
+        // Frames beyond this are dropped, oldest first.
+        size_t maxPendingFrames;
+        // Caps presentation below the display rate. 0 for no cap.
+        double maxFrameRate;
+    };
+
+    struct FrameSchedulerStats
+    {
+        uint64_t received;
+        uint64_t presented;
+        // Superseded by a newer frame before their turn came, or pushed out of a full buffer.
+        uint64_t dropped;
+        // Presented, but at least a refresh after they were due. Counted in `presented` as well.
+        uint64_t late;
+        // Frames discarded by Flush().
+        uint64_t flushed;
+
+        int64_t arrivalIntervalNs;
+        int64_t jitterNs;
+        int64_t delayNs;
+    };
+
+    /**
+     *  Paces decoded frames to the display. Frames which arrive early are held back to the estimated frame interval,
+     *  for up to a playout delay which follows the arrival jitter, so uneven arrivals are presented evenly. On every
+     *  display refresh the newest frame which is due is chosen, and any older ones are dropped, so the caller only
+     *  converts the frames which will actually be seen. A burst after a stall collapses to its newest frame instead
+     *  of adding latency.
+     *
+     *  Frames are opaque to the scheduler. Anything passed in is handed back exactly once, either by Tick() (to present
+     *  or to drop) or by Flush(). Push() may be called from any thread, and Tick() from another.
+     */
+    class FrameScheduler
+    {
+    public:
+        explicit FrameScheduler(FrameSchedulerConfig config = FrameSchedulerConfig());
+
+        // Frames which don't fit are appended to `dropped`.
+        void Push(void *frame, int64_t arrivalNs, std::vector<void *> *dropped);
+
+        // Call once per display refresh. `vsyncNs` is the time of the refresh that just happened, and `refreshIntervalNs`
+        // the time until the next one. Returns the frame to present, or NULL. Frames passed over are appended to `dropped`.
+        void *Tick(int64_t vsyncNs, int64_t refreshIntervalNs, std::vector<void *> *dropped);
+
+        // Hands back every pending frame, and starts over with the timing estimates.
+        void Flush(std::vector<void *> *flushed);
+
+        FrameSchedulerStats Stats() const;
+
+    private:
+        struct PendingFrame
+        {
+            void *frame;
+            int64_t dueNs;
+        };
+
+        void UpdateEstimates(int64_t arrivalNs);
+        int64_t PlayoutDelay() const;
+
+        FrameSchedulerConfig _config;
+
+        mutable std::mutex _lock;
+        std::deque<PendingFrame> _pending;
+        int64_t _lastArrivalNs;
+        int _stallCount;
+        int64_t _lastDueNs;
+        int64_t _lastPresentNs;
+        FrameSchedulerStats _stats;
+    };
+
+} // namespace perch
+
+#endif
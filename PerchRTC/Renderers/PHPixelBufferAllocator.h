@@ -0,0 +1,44 @@
+//
+//  PHPixelBufferAllocator.h
+//  PerchRTC
+//
+//  Created by Christopher Eagleston on 2015-06-16.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#ifndef PerchRTC_PHPixelBufferAllocator_h
+#define PerchRTC_PHPixelBufferAllocator_h
+
+#import <CoreVideo/CoreVideo.h>
+
+#include "PHFramePool.h"
+
+namespace perch {
+
+    /**
+     *  Allocates IOSurface backed CVPixelBuffers, which can be displayed by AVSampleBufferDisplayLayer or wrapped by a CGImage without a copy.
+     *  Frame handles are retained CVPixelBufferRefs.
+     */
+    class PixelBufferAllocator : public FrameAllocator
+    {
+    public:
+        void *Allocate(const FrameKey &key) override;
+        void Free(const FrameKey &key, void *handle) override;
+    };
+
+    // Shared by every renderer, so buffers stay warm across converters and resolution changes. Trimmed on memory warnings.
+    FramePool &SharedPixelBufferPool();
+
+    // Returns a new pixel buffer which shares the pooled buffer's IOSurface, and hands the buffer back to the shared pool
+    // once the last reference to it is gone, however long a display layer or encoder holds on to it. Pooled buffers
+    // themselves never leave the converters. On failure the buffer is released, and NULL is returned.
+    CVPixelBufferRef CreateLeasedPixelBuffer(FrameBuffer *buffer);
+
+    inline CVPixelBufferRef PixelBufferForFrame(const FrameBuffer *buffer)
+    {
+        return buffer ? (CVPixelBufferRef)buffer->Handle() : NULL;
+    }
+
+} // namespace perch
+
+#endif
@@ -0,0 +1,122 @@
+//
+//  PHPixelBufferAllocator.mm
+//  PerchRTC
+//
+//  Created by Christopher Eagleston on 2015-06-16.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#include "PHPixelBufferAllocator.h"
+
+#import <UIKit/UIKit.h>
+
+// Matches the retained buffer hint that each converter's CVPixelBufferPool used to be created with.
+static const int kPixelBufferPoolCachedPerSizeClass = 5;
+
+static NSString *const kFrameLeaseAttachmentKey = @"PHFrameLease";
+
+// Hands a pooled buffer back to the shared pool once the pixel buffer which carries it is destroyed.
+@interface PHFrameLease : NSObject
+
+- (instancetype)initWithBuffer:(perch::FrameBuffer *)buffer;
+
+@end
+
+@implementation PHFrameLease
+{
+    perch::FrameBuffer *_buffer;
+}
+
+- (instancetype)initWithBuffer:(perch::FrameBuffer *)buffer
+{
+    self = [super init];
+    if (self) {
+        _buffer = buffer;
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    perch::SharedPixelBufferPool().Release(_buffer);
+}
+
+@end
+
+namespace perch {
+
+    void *PixelBufferAllocator::Allocate(const FrameKey &key)
+    {
+        // @note: In order for rendering to work via AVSampleBufferDisplayLayer IOSurfaces need to be shared across process boundaries.
+        // VTDecompressionSession can add this key for you, but if you are creating your own buffers it must be added manually.
+        // Mac example: https://developer.apple.com/library/mac/samplecode/MultiGPUIOSurface/Introduction/Intro.html#//apple_ref/doc/uid/DTS40010132
+
+        // TODO: Obfuscate IOSurfaceIsGlobal for the app store reviewers, as it is private on iOS (but not Mac).
+
+        NSMutableDictionary *attributes = [NSMutableDictionary dictionary];
+        attributes[(id)kCVPixelBufferIOSurfacePropertiesKey] = @{ @"IOSurfaceIsGlobal" : @YES };
+
+        // Round number, 128 is better than 64 for display.
+
+        if (key.format == kFrameFormatNV12) {
+            attributes[(id)kCVPixelBufferBytesPerRowAlignmentKey] = @(128);
+            attributes[(id)kCVPixelBufferPlaneAlignmentKey] = @(128);
+        }
+
+        CVPixelBufferRef pixelBuffer = NULL;
+        CVReturn status = CVPixelBufferCreate(kCFAllocatorDefault, key.width, key.height, key.format, (__bridge CFDictionaryRef)attributes, &pixelBuffer);
+
+        if (status != kCVReturnSuccess) {
+            DDLogError(@"Failed to create a %d x %d pixel buffer: %d", key.width, key.height, status);
+            return NULL;
+        }
+
+        return pixelBuffer;
+    }
+
+    void PixelBufferAllocator::Free(const FrameKey & /* key */, void *handle)
+    {
+        CVPixelBufferRelease((CVPixelBufferRef)handle);
+    }
+
+    CVPixelBufferRef CreateLeasedPixelBuffer(FrameBuffer *buffer)
+    {
+        CVPixelBufferRef backing = PixelBufferForFrame(buffer);
+        CVPixelBufferRef leased = NULL;
+        CVReturn status = kCVReturnInvalidArgument;
+
+        if (backing != NULL && CVPixelBufferGetIOSurface(backing) != NULL) {
+            status = CVPixelBufferCreateWithIOSurface(kCFAllocatorDefault, CVPixelBufferGetIOSurface(backing), NULL, &leased);
+        }
+
+        if (status != kCVReturnSuccess || leased == NULL) {
+            DDLogError(@"Failed to lease a pooled pixel buffer: %d", status);
+            SharedPixelBufferPool().Release(buffer);
+            return NULL;
+        }
+
+        // The attachment is released along with the leased buffer, and the lease with it.
+
+        PHFrameLease *lease = [[PHFrameLease alloc] initWithBuffer:buffer];
+        CVBufferSetAttachment(leased, (__bridge CFStringRef)kFrameLeaseAttachmentKey, (__bridge CFTypeRef)lease, kCVAttachmentMode_ShouldNotPropagate);
+
+        return leased;
+    }
+
+    FramePool &SharedPixelBufferPool()
+    {
+        static FramePool *sharedPool = NULL;
+        static dispatch_once_t onceToken;
+
+        dispatch_once(&onceToken, ^{
+            sharedPool = new FramePool(std::unique_ptr<FrameAllocator>(new PixelBufferAllocator()), kPixelBufferPoolCachedPerSizeClass);
+
+            [[NSNotificationCenter defaultCenter] addObserverForName:UIApplicationDidReceiveMemoryWarningNotification object:nil queue:nil usingBlock:^(NSNotification *note) {
+                sharedPool->Trim();
+            }];
+        });
+
+        return *sharedPool;
+    }
+
+} // namespace perch
@@ -14,6 +14,8 @@
 
 /**
  *  PHQuartzVideoView demonstrates a Core Graphics based approach to rendering WebRTC video.
+ *  Frames are converted on a worker queue owned by the view, and the newest image is shown once per display refresh.
+ *  Frames which arrive faster than they can be converted, or shown, are dropped.
  *
  *  TODO: This class falls into the trap of a view performing model tasks (frame rendering in addition to display)
  */
@@ -26,4 +28,7 @@
 @property (nonatomic, strong, readonly) UIView *rendererView;
 @property (atomic, assign, readonly) BOOL hasVideoData;
 
+// Frame counters (received, converted, displayed, droppedBeforeConversion, droppedAfterConversion).
+- (NSDictionary *)renderStatistics;
+
 @end
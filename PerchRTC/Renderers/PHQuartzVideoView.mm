@@ -0,0 +1,327 @@
+//
+//  PHVideoView.m
+//  PerchRTC
+//
+//  Created by Christopher Eagleston on 2/5/2014.
+//  Copyright (c) 2014 Perch Communications. All rights reserved.
+//
+
+#import "PHQuartzVideoView.h"
+
+#import "PHFrameConverter.h"
+#import "CADisplayLink+PHWeakTarget.h"
+
+#import <CoreVideo/CoreVideo.h>
+#import <nighthawk-webrtc/RTCVideoTrack.h>
+#import <QuartzCore/QuartzCore.h>
+
+#include <atomic>
+
+@interface PHQuartzVideoView()
+{
+    // Single slot mailboxes. A newer frame replaces (and releases) one which hasn't been picked up yet.
+    // The decoder posts to the worker's inbox, and the worker posts converted images to the display.
+    std::atomic<void *> _pendingFrame;
+    std::atomic<CGImageRef> _pendingImage;
+
+    std::atomic<uint64_t> _receivedCount;
+    std::atomic<uint64_t> _convertedCount;
+    std::atomic<uint64_t> _displayedCount;
+}
+
+@property (nonatomic, strong) dispatch_queue_t renderQueue;
+@property (nonatomic, strong) CADisplayLink *displayLink;
+@property (nonatomic, strong) PHFrameConverter *displayConverter;
+@property (nonatomic, assign) CGImageRef currentFrame;
+@property (nonatomic, assign) CGSize videoSize;
+@property (atomic, assign) BOOL hasVideoData;
+@property (atomic, assign) CGSize displayPixelSize;
+
+@end
+
+@implementation PHQuartzVideoView
+
+- (id)initWithFrame:(CGRect)frame
+{
+    self = [super initWithFrame:frame];
+    if (self) {
+        // Initialization code
+        self.layer.contentsGravity = kCAGravityResizeAspect;
+        self.layer.opaque = YES;
+        self.layer.needsDisplayOnBoundsChange = NO;
+
+        [self commonSetup];
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    [_displayLink invalidate];
+    [self clearPendingFrames];
+
+    if (_currentFrame != NULL) {
+        CFRelease(_currentFrame);
+    }
+
+    [self destroyConverters];
+}
+
+#pragma mark - Private
+
+- (void)commonSetup
+{
+    PHFrameConverterOutput output = PHFrameConverterOutputCGImageBackedByCVPixelBuffer;
+    self.displayConverter = [PHFrameConverter converterWithOutput:output];
+    self.renderQueue = dispatch_queue_create("com.perch.quartzvideoview", DISPATCH_QUEUE_SERIAL);
+
+    _pendingFrame = NULL;
+    _pendingImage = NULL;
+    _receivedCount = 0;
+    _convertedCount = 0;
+    _displayedCount = 0;
+    _hasVideoData = NO;
+}
+
+- (void)destroyConverters
+{
+    [self.displayConverter flushFrame];
+    self.displayConverter = nil;
+}
+
+- (void)enqueueFrame:(RTCI420Frame *)frame
+{
+    _receivedCount++;
+
+    void *replacedFrame = _pendingFrame.exchange((__bridge_retained void *)frame);
+
+    // An empty inbox means the worker is idle, or already past its last frame, so it needs a nudge.
+    // Otherwise the frame it hasn't converted yet is simply superseded.
+
+    if (replacedFrame != NULL) {
+        CFRelease(replacedFrame);
+        return;
+    }
+
+    dispatch_async(self.renderQueue, ^{
+        void *nextFrame = _pendingFrame.exchange(NULL);
+
+        if (nextFrame != NULL) {
+            [self processFrame:(__bridge_transfer RTCI420Frame *)nextFrame];
+        }
+    });
+}
+
+- (void)clearPendingFrames
+{
+    void *frame = _pendingFrame.exchange(NULL);
+    CGImageRef image = _pendingImage.exchange(NULL);
+
+    if (frame != NULL) {
+        CFRelease(frame);
+    }
+    if (image != NULL) {
+        CFRelease(image);
+    }
+}
+
+- (void)startDisplayLink
+{
+    if (self.displayLink) {
+        return;
+    }
+
+    self.displayLink = [CADisplayLink displayLinkWithWeakTarget:self selector:@selector(displayLinkDidFire:)];
+    [self.displayLink addToRunLoop:[NSRunLoop mainRunLoop] forMode:NSRunLoopCommonModes];
+}
+
+- (void)stopDisplayLink
+{
+    [self.displayLink invalidate];
+    self.displayLink = nil;
+
+    [self clearPendingFrames];
+}
+
+- (void)displayLinkDidFire:(CADisplayLink *)displayLink
+{
+    CGImageRef image = _pendingImage.exchange(NULL);
+
+    if (image == NULL) {
+        return;
+    }
+
+    if (self.currentFrame != NULL) {
+        CFRelease(self.currentFrame);
+    }
+
+    self.currentFrame = image;
+    _displayedCount++;
+
+    [self.layer setNeedsDisplay];
+}
+
+- (void)processFrame:(RTCI420Frame *)frame
+{
+    // .. And now for some expensive work, at no more than the size we are displayed at.
+
+    PHFrameConverter *availableConverter = self.displayConverter;
+    [self prepareConverter:availableConverter forFrame:frame];
+
+    CFTypeRef outputFrame = [availableConverter copyConvertedFrame:frame];
+
+    // .. Display the result.
+
+    if (outputFrame) {
+        [self outputFrame:(CGImageRef)outputFrame];
+    }
+}
+
+- (void)prepareConverter:(PHFrameConverter *)converter forFrame:(RTCI420Frame *)frame
+{
+    CMVideoDimensions sourceDimensions = {(int32_t)frame.width, (int32_t)frame.height};
+    CMVideoDimensions outputDimensions = [PHFrameConverter outputDimensionsForSourceDimensions:sourceDimensions displaySize:self.displayPixelSize];
+    CMVideoDimensions currentSource = converter.sourceDimensions;
+    CMVideoDimensions currentOutput = converter.outputDimensions;
+
+    BOOL sourceChanged = currentSource.width != sourceDimensions.width || currentSource.height != sourceDimensions.height;
+    BOOL outputChanged = currentOutput.width != outputDimensions.width || currentOutput.height != outputDimensions.height;
+
+    if (sourceChanged || outputChanged) {
+        [converter prepareForSourceDimensions:sourceDimensions outputDimensions:outputDimensions];
+    }
+}
+
+- (void)outputFrame:(CGImageRef)frame
+{
+    // At most two images are alive per view, the one on screen and the one waiting for the next refresh.
+
+    CGImageRef replacedImage = _pendingImage.exchange(frame);
+    _convertedCount++;
+
+    if (replacedImage != NULL) {
+        CFRelease(replacedImage);
+    }
+}
+
+#pragma mark - UIView
+
+- (void)layoutSubviews
+{
+    [super layoutSubviews];
+
+    CGFloat scale = self.contentScaleFactor;
+    self.displayPixelSize = CGSizeMake(CGRectGetWidth(self.bounds) * scale, CGRectGetHeight(self.bounds) * scale);
+}
+
+#pragma mark - Properties
+
+- (void)setContentMode:(UIViewContentMode)contentMode
+{
+    DDLogDebug(@"%s", __PRETTY_FUNCTION__);
+
+    [super setContentMode:contentMode];
+
+    // Make sure the layer's contents gravity matches.
+
+    static NSDictionary *contentModeToGravityMap = nil;
+    if (!contentModeToGravityMap) {
+
+        contentModeToGravityMap = @{ @(UIViewContentModeScaleToFill) : kCAGravityResizeAspectFill,
+                                     @(UIViewContentModeScaleAspectFit) : kCAGravityResizeAspect,
+                                     @(UIViewContentModeRedraw) : kCAGravityCenter,
+                                     @(UIViewContentModeCenter) : kCAGravityCenter,
+                                     @(UIViewContentModeTop) : kCAGravityTop,
+                                     @(UIViewContentModeBottom) : kCAGravityBottom,
+                                     @(UIViewContentModeLeft) : kCAGravityLeft,
+                                     @(UIViewContentModeRight) : kCAGravityRight,
+                                     @(UIViewContentModeTopLeft) : kCAGravityTopLeft,
+                                     @(UIViewContentModeTopRight) : kCAGravityTopRight,
+                                     @(UIViewContentModeBottomLeft) : kCAGravityBottomLeft,
+                                     @(UIViewContentModeBottomRight) : kCAGravityBottomRight };
+    }
+
+    NSString *gravity = contentModeToGravityMap[@(contentMode)];
+    self.layer.contentsGravity = gravity;
+    [self.layer setNeedsLayout];
+}
+
+- (void)setVideoTrack:(RTCVideoTrack *)videoTrack
+{
+    if (_videoTrack != videoTrack) {
+        [_videoTrack removeRenderer:self];
+        _videoTrack = videoTrack;
+        [_videoTrack addRenderer:self];
+
+        if (videoTrack) {
+            [self startDisplayLink];
+        }
+        else {
+            [self stopDisplayLink];
+        }
+    }
+}
+
+- (UIView *)rendererView
+{
+    return self;
+}
+
+#pragma mark - Public
+
+- (NSDictionary *)renderStatistics
+{
+    // Read downstream first, so that a frame in flight can't make a later stage look ahead of an earlier one.
+
+    uint64_t displayed = _displayedCount;
+    uint64_t converted = _convertedCount;
+    uint64_t received = _receivedCount;
+
+    return @{ @"received" : @(received),
+              @"converted" : @(converted),
+              @"displayed" : @(displayed),
+              @"droppedBeforeConversion" : @(received - converted),
+              @"droppedAfterConversion" : @(converted - displayed) };
+}
+
+#pragma mark - CALayerDelegate
+
+- (void)displayLayer:(CALayer *)layer
+{
+    self.layer.contents = (__bridge id)self.currentFrame;
+}
+
+#pragma mark - RTCVideoRenderDelegate
+
+- (void)renderFrame:(RTCI420Frame *)frame
+{
+    if (!_hasVideoData) {
+        self.hasVideoData = YES;
+
+        dispatch_async(dispatch_get_main_queue(), ^{
+            [self.delegate rendererDidReceiveVideoData:self];
+        });
+    }
+
+    [self enqueueFrame:frame];
+}
+
+- (void)setSize:(CGSize)size
+{
+    self.videoSize = size;
+
+    CMVideoDimensions dimensions = {(int32_t)size.width, (int32_t)size.height};
+    CMVideoDimensions outputDimensions = [PHFrameConverter outputDimensionsForSourceDimensions:dimensions displaySize:self.displayPixelSize];
+
+    // The converter belongs to the render queue.
+
+    dispatch_async(self.renderQueue, ^{
+        [self.displayConverter prepareForSourceDimensions:dimensions outputDimensions:outputDimensions];
+    });
+
+    dispatch_async(dispatch_get_main_queue(), ^{
+        [self.delegate renderer:self streamDimensionsDidChange:size];
+    });
+}
+
+@end
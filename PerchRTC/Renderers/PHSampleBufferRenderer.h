@@ -30,4 +30,7 @@
 - (instancetype)initWithDelegate:(id<PHRendererDelegate>)delegate;
 - (instancetype)initWithOutput:(PHFrameConverterOutput)output andDelegate:(id<PHRendererDelegate>)delegate;
 
+// Frame pacing counters (received, presented, dropped, late, flushed), and the current frameInterval, jitter, and delay in seconds.
+- (NSDictionary *)renderStatistics;
+
 @end
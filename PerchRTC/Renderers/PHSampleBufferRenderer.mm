@@ -11,20 +11,26 @@
 #import "PHFrameConverter.h"
 #import "PHSampleBufferView.h"
 
+#import "CADisplayLink+PHWeakTarget.h"
 #import "UIDevice+PHDeviceAdditions.h"
 #import "RTCVideoTrack.h"
 
-@import AVFoundation;
+#include "PHFrameScheduler.h"
+
+#include <atomic>
 
-static Float64 PHSampleBufferAdaptorMinFPS = 200.;
-static NSUInteger PHSampleBufferAdaptorDropSkipAmount = 4;
-static NSUInteger PHSampleBufferAdaptorDropThreshold = 2;
+@import AVFoundation;
 
 @interface PHSampleBufferRenderer()
+{
+    perch::FrameScheduler _scheduler;
 
-@property (nonatomic, assign) CMTime lastTime;
-@property (nonatomic, assign) CMClockRef adapterClock;
-@property (nonatomic, assign) NSUInteger adapterCounter;
+    // Set while a refresh is waiting for the render queue, so that a slow conversion doesn't pile up refreshes.
+    std::atomic<bool> _presentPending;
+}
+
+@property (nonatomic, strong) dispatch_queue_t renderQueue;
+@property (nonatomic, strong) CADisplayLink *displayLink;
 
 @property (nonatomic, strong) PHFrameConverter *displayConverter;
 @property (nonatomic, assign) CGSize videoSize;
@@ -57,6 +63,8 @@ static NSUInteger PHSampleBufferAdaptorDropThreshold = 2;
 
 - (void)dealloc
 {
+    [_displayLink invalidate];
+    [self flushScheduledFrames];
     [self destroyConverters];
 
     NSNotificationCenter *center = [NSNotificationCenter defaultCenter];
@@ -135,11 +143,10 @@ static NSUInteger PHSampleBufferAdaptorDropThreshold = 2;
 
     [_sampleView addObserver:self forKeyPath:@"layer.status" options:NSKeyValueObservingOptionNew context:NULL];
 
-    // fps timer.
+    // Frames are converted on the render queue, at most once per display refresh.
 
-    CMClockRef hostClock = CMClockGetHostTimeClock();
-    _adapterClock = hostClock;
-    _lastTime = CMClockGetTime(hostClock);
+    _renderQueue = dispatch_queue_create("com.perch.samplebufferrenderer", DISPATCH_QUEUE_SERIAL);
+    _presentPending = false;
 }
 
 - (void)restoreFailedSampleView
@@ -185,36 +192,96 @@ static NSUInteger PHSampleBufferAdaptorDropThreshold = 2;
     _displayConverter = nil;
 }
 
-- (void)processFrame:(RTCI420Frame *)frame
+#pragma mark - Frame Scheduling
+
+- (void)startDisplayLink
 {
-    CMTime adaptedTime = CMClockGetTime(_adapterClock);
-    CMTime difference = CMTimeSubtract(adaptedTime, _lastTime);
-    Float64 frameRate = 1 / CMTimeGetSeconds(difference);
-    _lastTime = adaptedTime;
+    if (self.displayLink) {
+        return;
+    }
 
-    // Check if we should adapt the input.
+    self.displayLink = [CADisplayLink displayLinkWithWeakTarget:self selector:@selector(displayLinkDidFire:)];
+    [self.displayLink addToRunLoop:[NSRunLoop mainRunLoop] forMode:NSRunLoopCommonModes];
+}
 
-    if (frameRate > PHSampleBufferAdaptorMinFPS) {
+- (void)stopDisplayLink
+{
+    [self.displayLink invalidate];
+    self.displayLink = nil;
 
-        _adapterCounter++;
+    [self flushScheduledFrames];
+}
+
+- (void)displayLinkDidFire:(CADisplayLink *)displayLink
+{
+    if (_presentPending.exchange(true)) {
+        return;
+    }
+
+    int64_t vsync = (int64_t)(displayLink.timestamp * NSEC_PER_SEC);
+    int64_t refreshInterval = (int64_t)(displayLink.duration * NSEC_PER_SEC);
+
+    dispatch_async(self.renderQueue, ^{
+        _presentPending = false;
+        [self presentFrameForRefresh:vsync interval:refreshInterval];
+    });
+}
+
+- (void)scheduleFrame:(RTCI420Frame *)frame
+{
+    std::vector<void *> dropped;
+    int64_t now = (int64_t)(CACurrentMediaTime() * NSEC_PER_SEC);
+
+    // The scheduler holds a reference to each frame, until it hands the frame back.
+
+    _scheduler.Push((__bridge_retained void *)frame, now, &dropped);
+
+    [self releaseFrames:dropped];
+}
+
+- (void)presentFrameForRefresh:(int64_t)vsync interval:(int64_t)refreshInterval
+{
+    std::vector<void *> dropped;
+    void *nextFrame = _scheduler.Tick(vsync, refreshInterval, &dropped);
 
-        // Drop frames above the threshold.
+    // Frames which will never be seen are released without being converted.
 
-        if (_adapterCounter > PHSampleBufferAdaptorDropThreshold) {
+    [self releaseFrames:dropped];
 
-            BOOL acceptFrame = ((_adapterCounter - PHSampleBufferAdaptorDropThreshold) % PHSampleBufferAdaptorDropSkipAmount) == 0;
+    if (nextFrame) {
+        RTCI420Frame *frame = (__bridge_transfer RTCI420Frame *)nextFrame;
 
-            if (!acceptFrame) {
-                return;
-            }
+        if (!_renderingPaused) {
+            [self processFrame:frame];
         }
     }
-    else {
-        _adapterCounter = 0;
+}
+
+- (void)flushScheduledFrames
+{
+    std::vector<void *> flushed;
+    _scheduler.Flush(&flushed);
+
+    [self releaseFrames:flushed];
+}
+
+- (void)releaseFrames:(const std::vector<void *> &)frames
+{
+    for (void *frame : frames) {
+        CFRelease(frame);
     }
+}
 
+#pragma mark - Frame Conversion
+
+- (void)processFrame:(RTCI420Frame *)frame
+{
     PHFrameConverter *availableConverter = self.displayConverter;
 
+    // .. Follow the view's size, so that we only convert as many pixels as will be displayed.
+
+    [self prepareConverter:availableConverter forFrame:frame];
+
     // .. Copy their incoming frame into our CVPixelBufferRef and wrap that in a CMSampleBufferRef.
 
     CMSampleBufferRef outputFrame = (CMSampleBufferRef)[availableConverter copyConvertedFrame:frame];
@@ -226,6 +293,21 @@ static NSUInteger PHSampleBufferAdaptorDropThreshold = 2;
     }
 }
 
+- (void)prepareConverter:(PHFrameConverter *)converter forFrame:(RTCI420Frame *)frame
+{
+    CMVideoDimensions sourceDimensions = {(int32_t)frame.width, (int32_t)frame.height};
+    CMVideoDimensions outputDimensions = [PHFrameConverter outputDimensionsForSourceDimensions:sourceDimensions displaySize:_sampleView.displayPixelSize];
+    CMVideoDimensions currentSource = converter.sourceDimensions;
+    CMVideoDimensions currentOutput = converter.outputDimensions;
+
+    BOOL sourceChanged = currentSource.width != sourceDimensions.width || currentSource.height != sourceDimensions.height;
+    BOOL outputChanged = currentOutput.width != outputDimensions.width || currentOutput.height != outputDimensions.height;
+
+    if (sourceChanged || outputChanged) {
+        [converter prepareForSourceDimensions:sourceDimensions outputDimensions:outputDimensions];
+    }
+}
+
 - (void)outputSampleBuffer:(CMSampleBufferRef)sampleBuffer
 {
     [_sampleView displaySampleBuffer:sampleBuffer];
@@ -233,6 +315,23 @@ static NSUInteger PHSampleBufferAdaptorDropThreshold = 2;
     CFRelease(sampleBuffer);
 }
 
+#pragma mark - Public
+
+- (NSDictionary *)renderStatistics
+{
+    perch::FrameSchedulerStats stats = _scheduler.Stats();
+    double nanosecondsPerSecond = NSEC_PER_SEC;
+
+    return @{ @"received" : @(stats.received),
+              @"presented" : @(stats.presented),
+              @"dropped" : @(stats.dropped),
+              @"late" : @(stats.late),
+              @"flushed" : @(stats.flushed),
+              @"frameInterval" : @(stats.arrivalIntervalNs / nanosecondsPerSecond),
+              @"jitter" : @(stats.jitterNs / nanosecondsPerSecond),
+              @"delay" : @(stats.delayNs / nanosecondsPerSecond) };
+}
+
 #pragma mark - Properties
 
 - (void)setVideoTrack:(RTCVideoTrack *)videoTrack
@@ -241,6 +340,13 @@ static NSUInteger PHSampleBufferAdaptorDropThreshold = 2;
         [_videoTrack removeRenderer:self];
         _videoTrack = videoTrack;
         [_videoTrack addRenderer:self];
+
+        if (videoTrack) {
+            [self startDisplayLink];
+        }
+        else {
+            [self stopDisplayLink];
+        }
     }
 }
 
@@ -262,7 +368,7 @@ static NSUInteger PHSampleBufferAdaptorDropThreshold = 2;
     }
 
     if (!_renderingPaused) {
-        [self processFrame:frame];
+        [self scheduleFrame:frame];
     }
 }
 
@@ -271,7 +377,13 @@ static NSUInteger PHSampleBufferAdaptorDropThreshold = 2;
     self.videoSize = size;
 
     CMVideoDimensions dimensions = {(int32_t)size.width, (int32_t)size.height};
-    [self.displayConverter prepareForSourceDimensions:dimensions];
+    CMVideoDimensions outputDimensions = [PHFrameConverter outputDimensionsForSourceDimensions:dimensions displaySize:_sampleView.displayPixelSize];
+
+    // The converter belongs to the render queue.
+
+    dispatch_async(self.renderQueue, ^{
+        [self.displayConverter prepareForSourceDimensions:dimensions outputDimensions:outputDimensions];
+    });
 
     dispatch_async(dispatch_get_main_queue(), ^{
         [self.delegate renderer:self streamDimensionsDidChange:size];
@@ -16,6 +16,8 @@ typedef CMSampleBufferRef (^PHVideoSampleRequestBlock)(void);
 @interface PHSampleBufferView : UIView
 
 @property (copy) NSString *videoGravity;
+// The size of the view in pixels, updated on layout. Safe to read from any thread.
+@property (atomic, assign, readonly) CGSize displayPixelSize;
 
 /* Sample provider.
  * The CMSampleBuffer refs provided will be released after they are enqueued for display.
@@ -22,6 +22,7 @@
 @interface PHSampleBufferView()
 
 @property (nonatomic, strong, readonly) AVSampleBufferDisplayLayer *displayLayer;
+@property (atomic, assign) CGSize displayPixelSize;
 
 @end
 
@@ -44,6 +45,14 @@
     return [AVSampleBufferDisplayLayer class];
 }
 
+- (void)layoutSubviews
+{
+    [super layoutSubviews];
+
+    CGFloat scale = self.contentScaleFactor;
+    self.displayPixelSize = CGSizeMake(CGRectGetWidth(self.bounds) * scale, CGRectGetHeight(self.bounds) * scale);
+}
+
 - (AVSampleBufferDisplayLayer *)displayLayer
 {
     return (AVSampleBufferDisplayLayer *)self.layer;
@@ -0,0 +1,532 @@
+//
+//  PHScaleConvert.cpp
+//  PerchRTC
+//
+//  Created by Christopher Eagleston on 2015-06-09.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#include "PHScaleConvert.h"
+
+#include <algorithm>
+#include <vector>
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#define PH_SCALE_CONVERT_HAS_NEON 1
+#include <arm_neon.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#define PH_SCALE_CONVERT_HAS_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+    // Exact 2:1 box reduction of two source rows, which is the common case for quarter sized tiles.
+    typedef void (*HalveRowFunction)(const uint8_t *src0, const uint8_t *src1, uint8_t *dst, int dstWidth);
+
+    void HalveRowScalar(const uint8_t *src0, const uint8_t *src1, uint8_t *dst, int dstWidth)
+    {
+        for (int x = 0; x < dstWidth; x++) {
+            dst[x] = (uint8_t)((src0[2 * x] + src0[2 * x + 1] + src1[2 * x] + src1[2 * x + 1] + 2) >> 2);
+        }
+    }
+
+#if PH_SCALE_CONVERT_HAS_SSE2
+
+    inline __m128i SumPairsSSE2(__m128i row0, __m128i row1)
+    {
+        const __m128i evenMask = _mm_set1_epi16(0x00FF);
+
+        __m128i sum0 = _mm_add_epi16(_mm_and_si128(row0, evenMask), _mm_srli_epi16(row0, 8));
+        __m128i sum1 = _mm_add_epi16(_mm_and_si128(row1, evenMask), _mm_srli_epi16(row1, 8));
+
+        return _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(sum0, sum1), _mm_set1_epi16(2)), 2);
+    }
+
+    void HalveRowSSE2(const uint8_t *src0, const uint8_t *src1, uint8_t *dst, int dstWidth)
+    {
+        int x = 0;
+
+        for (; x + 16 <= dstWidth; x += 16) {
+            __m128i lo = SumPairsSSE2(_mm_loadu_si128((const __m128i *)(src0 + 2 * x)), _mm_loadu_si128((const __m128i *)(src1 + 2 * x)));
+            __m128i hi = SumPairsSSE2(_mm_loadu_si128((const __m128i *)(src0 + 2 * x + 16)), _mm_loadu_si128((const __m128i *)(src1 + 2 * x + 16)));
+            _mm_storeu_si128((__m128i *)(dst + x), _mm_packus_epi16(lo, hi));
+        }
+
+        HalveRowScalar(src0 + 2 * x, src1 + 2 * x, dst + x, dstWidth - x);
+    }
+
+#endif
+
+#if PH_SCALE_CONVERT_HAS_NEON
+
+    void HalveRowNEON(const uint8_t *src0, const uint8_t *src1, uint8_t *dst, int dstWidth)
+    {
+        int x = 0;
+
+        for (; x + 16 <= dstWidth; x += 16) {
+            uint16x8_t lo = vpadalq_u8(vpaddlq_u8(vld1q_u8(src0 + 2 * x)), vld1q_u8(src1 + 2 * x));
+            uint16x8_t hi = vpadalq_u8(vpaddlq_u8(vld1q_u8(src0 + 2 * x + 16)), vld1q_u8(src1 + 2 * x + 16));
+            vst1q_u8(dst + x, vcombine_u8(vrshrn_n_u16(lo, 2), vrshrn_n_u16(hi, 2)));
+        }
+
+        HalveRowScalar(src0 + 2 * x, src1 + 2 * x, dst + x, dstWidth - x);
+    }
+
+#endif
+
+    // Adds one source row into the per-column sums used by the general box filter.
+    typedef void (*AccumulateRowFunction)(const uint8_t *src, uint32_t *sums, int width);
+
+    void AccumulateRowScalar(const uint8_t *src, uint32_t *sums, int width)
+    {
+        for (int x = 0; x < width; x++) {
+            sums[x] += src[x];
+        }
+    }
+
+#if PH_SCALE_CONVERT_HAS_SSE2
+
+    void AccumulateRowSSE2(const uint8_t *src, uint32_t *sums, int width)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        int x = 0;
+
+        for (; x + 16 <= width; x += 16) {
+            __m128i samples = _mm_loadu_si128((const __m128i *)(src + x));
+            __m128i lo = _mm_unpacklo_epi8(samples, zero);
+            __m128i hi = _mm_unpackhi_epi8(samples, zero);
+
+            __m128i *dst = (__m128i *)(sums + x);
+            _mm_storeu_si128(dst, _mm_add_epi32(_mm_loadu_si128(dst), _mm_unpacklo_epi16(lo, zero)));
+            _mm_storeu_si128(dst + 1, _mm_add_epi32(_mm_loadu_si128(dst + 1), _mm_unpackhi_epi16(lo, zero)));
+            _mm_storeu_si128(dst + 2, _mm_add_epi32(_mm_loadu_si128(dst + 2), _mm_unpacklo_epi16(hi, zero)));
+            _mm_storeu_si128(dst + 3, _mm_add_epi32(_mm_loadu_si128(dst + 3), _mm_unpackhi_epi16(hi, zero)));
+        }
+
+        AccumulateRowScalar(src + x, sums + x, width - x);
+    }
+
+#endif
+
+#if PH_SCALE_CONVERT_HAS_NEON
+
+    void AccumulateRowNEON(const uint8_t *src, uint32_t *sums, int width)
+    {
+        int x = 0;
+
+        for (; x + 16 <= width; x += 16) {
+            uint8x16_t samples = vld1q_u8(src + x);
+            uint16x8_t lo = vmovl_u8(vget_low_u8(samples));
+            uint16x8_t hi = vmovl_u8(vget_high_u8(samples));
+
+            uint32_t *dst = sums + x;
+            vst1q_u32(dst, vaddw_u16(vld1q_u32(dst), vget_low_u16(lo)));
+            vst1q_u32(dst + 4, vaddw_u16(vld1q_u32(dst + 4), vget_high_u16(lo)));
+            vst1q_u32(dst + 8, vaddw_u16(vld1q_u32(dst + 8), vget_low_u16(hi)));
+            vst1q_u32(dst + 12, vaddw_u16(vld1q_u32(dst + 12), vget_high_u16(hi)));
+        }
+
+        AccumulateRowScalar(src + x, sums + x, width - x);
+    }
+
+#endif
+
+    // Blends two source rows for the vertical pass of the bilinear filter. `fraction` is the weight of `src1`, out of 256.
+    typedef void (*BlendRowsFunction)(const uint8_t *src0, const uint8_t *src1, uint8_t *dst, int width, int fraction);
+
+    void BlendRowsScalar(const uint8_t *src0, const uint8_t *src1, uint8_t *dst, int width, int fraction)
+    {
+        for (int x = 0; x < width; x++) {
+            dst[x] = (uint8_t)((src0[x] * (256 - fraction) + src1[x] * fraction + 128) >> 8);
+        }
+    }
+
+#if PH_SCALE_CONVERT_HAS_SSE2
+
+    // The weighted sum is at most 255 * 256 + 128, so unsigned 16-bit lanes are sufficient.
+    inline __m128i BlendHalfSSE2(__m128i a, __m128i b, __m128i weight0, __m128i weight1)
+    {
+        __m128i sum = _mm_add_epi16(_mm_mullo_epi16(a, weight0), _mm_mullo_epi16(b, weight1));
+
+        return _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(128)), 8);
+    }
+
+    void BlendRowsSSE2(const uint8_t *src0, const uint8_t *src1, uint8_t *dst, int width, int fraction)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i weight0 = _mm_set1_epi16((short)(256 - fraction));
+        const __m128i weight1 = _mm_set1_epi16((short)fraction);
+        int x = 0;
+
+        for (; x + 16 <= width; x += 16) {
+            __m128i a = _mm_loadu_si128((const __m128i *)(src0 + x));
+            __m128i b = _mm_loadu_si128((const __m128i *)(src1 + x));
+
+            __m128i lo = BlendHalfSSE2(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero), weight0, weight1);
+            __m128i hi = BlendHalfSSE2(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero), weight0, weight1);
+            _mm_storeu_si128((__m128i *)(dst + x), _mm_packus_epi16(lo, hi));
+        }
+
+        BlendRowsScalar(src0 + x, src1 + x, dst + x, width - x, fraction);
+    }
+
+#endif
+
+#if PH_SCALE_CONVERT_HAS_NEON
+
+    void BlendRowsNEON(const uint8_t *src0, const uint8_t *src1, uint8_t *dst, int width, int fraction)
+    {
+        const uint8x8_t weight0 = vdup_n_u8((uint8_t)(256 - fraction));
+        const uint8x8_t weight1 = vdup_n_u8((uint8_t)fraction);
+        int x = 0;
+
+        // `fraction` is never 0 here, so both weights fit in 8 bits.
+
+        for (; x + 16 <= width; x += 16) {
+            uint8x16_t a = vld1q_u8(src0 + x);
+            uint8x16_t b = vld1q_u8(src1 + x);
+
+            uint16x8_t lo = vmlal_u8(vmull_u8(vget_low_u8(a), weight0), vget_low_u8(b), weight1);
+            uint16x8_t hi = vmlal_u8(vmull_u8(vget_high_u8(a), weight0), vget_high_u8(b), weight1);
+            vst1q_u8(dst + x, vcombine_u8(vrshrn_n_u16(lo, 8), vrshrn_n_u16(hi, 8)));
+        }
+
+        BlendRowsScalar(src0 + x, src1 + x, dst + x, width - x, fraction);
+    }
+
+#endif
+
+    HalveRowFunction HalveRowFunctionForKernel(PHConvertKernel kernel)
+    {
+        switch (kernel) {
+#if PH_SCALE_CONVERT_HAS_NEON
+            case PHConvertKernelNEON:
+                return HalveRowNEON;
+#endif
+#if PH_SCALE_CONVERT_HAS_SSE2
+            case PHConvertKernelSSE2:
+            case PHConvertKernelAVX2:
+                return HalveRowSSE2;
+#endif
+            default:
+                return HalveRowScalar;
+        }
+    }
+
+    BlendRowsFunction BlendRowsFunctionForKernel(PHConvertKernel kernel)
+    {
+        switch (kernel) {
+#if PH_SCALE_CONVERT_HAS_NEON
+            case PHConvertKernelNEON:
+                return BlendRowsNEON;
+#endif
+#if PH_SCALE_CONVERT_HAS_SSE2
+            case PHConvertKernelSSE2:
+            case PHConvertKernelAVX2:
+                return BlendRowsSSE2;
+#endif
+            default:
+                return BlendRowsScalar;
+        }
+    }
+
+    AccumulateRowFunction AccumulateRowFunctionForKernel(PHConvertKernel kernel)
+    {
+        switch (kernel) {
+#if PH_SCALE_CONVERT_HAS_NEON
+            case PHConvertKernelNEON:
+                return AccumulateRowNEON;
+#endif
+#if PH_SCALE_CONVERT_HAS_SSE2
+            case PHConvertKernelSSE2:
+            case PHConvertKernelAVX2:
+                return AccumulateRowSSE2;
+#endif
+            default:
+                return AccumulateRowScalar;
+        }
+    }
+
+    /**
+     *  Produces scaled rows of one 8-bit plane on demand, in any order.
+     *  Horizontal filter taps are computed once up front, so each row only does the per-sample arithmetic.
+     */
+    class PlaneRowScaler
+    {
+    public:
+        PlaneRowScaler(const uint8_t *src, int srcStride, int srcWidth, int srcHeight, int dstWidth, int dstHeight, PHScaleFilter filter)
+        : _src(src), _srcStride(srcStride), _srcWidth(srcWidth), _srcHeight(srcHeight),
+          _dstWidth(dstWidth), _dstHeight(dstHeight), _filter(filter), _halveRow(NULL), _accumulateRow(NULL), _blendRows(NULL), _reciprocalRows(0)
+        {
+            if (_filter == PHScaleFilterBox && srcWidth == 2 * dstWidth && srcHeight == 2 * dstHeight) {
+                _halveRow = HalveRowFunctionForKernel(PHConvertActiveKernel());
+            }
+            else if (_filter == PHScaleFilterBox) {
+                _accumulateRow = AccumulateRowFunctionForKernel(PHConvertActiveKernel());
+                _columnSums.resize(srcWidth);
+                _columnReciprocal.resize(dstWidth);
+                _columnBegin.resize(dstWidth);
+                _columnEnd.resize(dstWidth);
+
+                for (int x = 0; x < dstWidth; x++) {
+                    int end = std::min(std::max(BoxEdge(x + 1, srcWidth, dstWidth), BoxEdge(x, srcWidth, dstWidth) + 1), srcWidth);
+                    _columnBegin[x] = std::min(BoxEdge(x, srcWidth, dstWidth), end - 1);
+                    _columnEnd[x] = end;
+                }
+            }
+            else {
+                _blendRows = BlendRowsFunctionForKernel(PHConvertActiveKernel());
+                _blendedRow.resize(srcWidth);
+                _columnIndex.resize(dstWidth);
+                _columnFraction.resize(dstWidth);
+
+                for (int x = 0; x < dstWidth; x++) {
+                    int position = BilinearPosition(x, srcWidth, dstWidth);
+                    _columnIndex[x] = position >> 16;
+                    _columnFraction[x] = (uint8_t)((position >> 8) & 0xFF);
+                }
+            }
+        }
+
+        // Writes `dstWidth` samples of destination row `row` into `dst`.
+        void ScaleRow(int row, uint8_t *dst)
+        {
+            if (_halveRow) {
+                const uint8_t *src = _src + (size_t)(2 * row) * _srcStride;
+                _halveRow(src, src + _srcStride, dst, _dstWidth);
+            }
+            else if (_filter == PHScaleFilterBox) {
+                BoxRow(row, dst);
+            }
+            else {
+                BilinearRow(row, dst);
+            }
+        }
+
+    private:
+
+        // The first source sample covered by destination sample `i`. Every destination sample covers at least one source sample.
+        static int BoxEdge(int i, int srcLength, int dstLength)
+        {
+            return std::min((int)(((int64_t)i * srcLength) / dstLength), srcLength);
+        }
+
+        // Source position of the centre of destination sample `i`, in 16.16 fixed point and clamped to the plane.
+        static int BilinearPosition(int i, int srcLength, int dstLength)
+        {
+            int64_t position = (((int64_t)(2 * i + 1) * srcLength) << 16) / (2 * dstLength) - (1 << 15);
+            int64_t limit = (int64_t)(srcLength - 1) << 16;
+
+            return (int)std::max<int64_t>(0, std::min(position, limit));
+        }
+
+        void BoxRow(int row, uint8_t *dst)
+        {
+            int y0 = BoxEdge(row, _srcHeight, _dstHeight);
+            int y1 = std::max(BoxEdge(row + 1, _srcHeight, _dstHeight), y0 + 1);
+            y1 = std::min(y1, _srcHeight);
+            y0 = std::min(y0, y1 - 1);
+
+            // Sum the covered rows, then average the covered columns.
+
+            uint32_t *columnSums = _columnSums.data();
+            const uint8_t *src = _src + (size_t)y0 * _srcStride;
+
+            std::fill(_columnSums.begin(), _columnSums.end(), 0);
+
+            for (int y = y0; y < y1; y++) {
+                _accumulateRow(src, columnSums, _srcWidth);
+                src += _srcStride;
+            }
+
+            // Divide by the box area using a 0.32 fixed-point reciprocal. The row count takes at most two values, so these are rarely rebuilt.
+
+            const int rows = y1 - y0;
+
+            if (rows != _reciprocalRows) {
+                for (int x = 0; x < _dstWidth; x++) {
+                    uint64_t area = (uint64_t)rows * (_columnEnd[x] - _columnBegin[x]);
+                    _columnReciprocal[x] = ((1ull << 32) + area / 2) / area;
+                }
+                _reciprocalRows = rows;
+            }
+
+            const int *columnBegin = _columnBegin.data();
+            const int *columnEnd = _columnEnd.data();
+            const uint64_t *columnReciprocal = _columnReciprocal.data();
+
+            for (int x = 0; x < _dstWidth; x++) {
+                uint32_t sum = 0;
+                for (int i = columnBegin[x]; i < columnEnd[x]; i++) {
+                    sum += columnSums[i];
+                }
+
+                dst[x] = (uint8_t)std::min<uint64_t>(255, (sum * columnReciprocal[x] + (1ull << 31)) >> 32);
+            }
+        }
+
+        void BilinearRow(int row, uint8_t *dst)
+        {
+            int position = BilinearPosition(row, _srcHeight, _dstHeight);
+            int y0 = position >> 16;
+            int y1 = std::min(y0 + 1, _srcHeight - 1);
+            int fraction = (position >> 8) & 0xFF;
+
+            const uint8_t *src = _src + (size_t)y0 * _srcStride;
+
+            // Blend the two source rows, unless the sample lands exactly on one of them.
+
+            if (fraction != 0) {
+                _blendRows(src, _src + (size_t)y1 * _srcStride, _blendedRow.data(), _srcWidth, fraction);
+                src = _blendedRow.data();
+            }
+
+            const int lastColumn = _srcWidth - 1;
+
+            for (int x = 0; x < _dstWidth; x++) {
+                int x0 = _columnIndex[x];
+                int x1 = std::min(x0 + 1, lastColumn);
+                int f = _columnFraction[x];
+
+                dst[x] = (uint8_t)((src[x0] * (256 - f) + src[x1] * f + 128) >> 8);
+            }
+        }
+
+        const uint8_t *_src;
+        int _srcStride;
+        int _srcWidth;
+        int _srcHeight;
+        int _dstWidth;
+        int _dstHeight;
+        PHScaleFilter _filter;
+        HalveRowFunction _halveRow;
+        AccumulateRowFunction _accumulateRow;
+        BlendRowsFunction _blendRows;
+        int _reciprocalRows;
+
+        std::vector<uint32_t> _columnSums;
+        std::vector<uint64_t> _columnReciprocal;
+        std::vector<int> _columnBegin;
+        std::vector<int> _columnEnd;
+        std::vector<uint8_t> _blendedRow;
+        std::vector<int> _columnIndex;
+        std::vector<uint8_t> _columnFraction;
+    };
+
+    PHScaleFilter ResolveFilter(PHScaleFilter filter, int srcWidth, int srcHeight, int dstWidth, int dstHeight)
+    {
+        if (filter != PHScaleFilterAutomatic) {
+            return filter;
+        }
+
+        return (srcWidth >= 2 * dstWidth && srcHeight >= 2 * dstHeight) ? PHScaleFilterBox : PHScaleFilterBilinear;
+    }
+
+    inline int ChromaLength(int length)
+    {
+        return (length + 1) / 2;
+    }
+
+} // namespace
+
+void PHScaleConvertI420ToRGB(const uint8_t *srcY, int srcStrideY,
+                             const uint8_t *srcU, int srcStrideU,
+                             const uint8_t *srcV, int srcStrideV,
+                             int srcWidth, int srcHeight,
+                             uint8_t *dstRGB, int dstStride,
+                             int dstWidth, int dstHeight,
+                             PHScaleFilter filter, PHColorMatrix matrix, PHRGBLayout layout)
+{
+    if (srcWidth <= 0 || srcHeight <= 0 || dstWidth <= 0 || dstHeight <= 0) {
+        return;
+    }
+
+    if (srcWidth == dstWidth && srcHeight == dstHeight) {
+        PHConvertI420ToRGB(srcY, srcStrideY, srcU, srcStrideU, srcV, srcStrideV, dstRGB, dstStride, dstWidth, dstHeight, matrix, layout);
+        return;
+    }
+
+    filter = ResolveFilter(filter, srcWidth, srcHeight, dstWidth, dstHeight);
+
+    const int srcChromaWidth = ChromaLength(srcWidth);
+    const int srcChromaHeight = ChromaLength(srcHeight);
+    const int dstChromaWidth = ChromaLength(dstWidth);
+    const int dstChromaHeight = ChromaLength(dstHeight);
+
+    PlaneRowScaler scalerY(srcY, srcStrideY, srcWidth, srcHeight, dstWidth, dstHeight, filter);
+    PlaneRowScaler scalerU(srcU, srcStrideU, srcChromaWidth, srcChromaHeight, dstChromaWidth, dstChromaHeight, filter);
+    PlaneRowScaler scalerV(srcV, srcStrideV, srcChromaWidth, srcChromaHeight, dstChromaWidth, dstChromaHeight, filter);
+
+    std::vector<uint8_t> rows(dstWidth + 2 * dstChromaWidth);
+    uint8_t *rowY = rows.data();
+    uint8_t *rowU = rowY + dstWidth;
+    uint8_t *rowV = rowU + dstChromaWidth;
+
+    PHColorConvertRowFunction convertRow = PHColorConvertI420RowFunction(PHConvertActiveKernel());
+
+    for (int row = 0; row < dstHeight; row++) {
+        if ((row & 1) == 0) {
+            scalerU.ScaleRow(row / 2, rowU);
+            scalerV.ScaleRow(row / 2, rowV);
+        }
+
+        scalerY.ScaleRow(row, rowY);
+        convertRow(rowY, rowU, rowV, dstRGB, dstWidth, matrix, layout);
+        dstRGB += dstStride;
+    }
+}
+
+void PHScaleI420ToNV12(const uint8_t *srcY, int srcStrideY,
+                       const uint8_t *srcU, int srcStrideU,
+                       const uint8_t *srcV, int srcStrideV,
+                       int srcWidth, int srcHeight,
+                       uint8_t *dstY, int dstStrideY,
+                       uint8_t *dstUV, int dstStrideUV,
+                       int dstWidth, int dstHeight,
+                       PHScaleFilter filter)
+{
+    if (srcWidth <= 0 || srcHeight <= 0 || dstWidth <= 0 || dstHeight <= 0) {
+        return;
+    }
+
+    const int srcChromaWidth = ChromaLength(srcWidth);
+    const int srcChromaHeight = ChromaLength(srcHeight);
+    const int dstChromaWidth = ChromaLength(dstWidth);
+    const int dstChromaHeight = ChromaLength(dstHeight);
+
+    if (srcWidth == dstWidth && srcHeight == dstHeight) {
+        PHCopyPlane(srcY, srcStrideY, dstY, dstStrideY, dstWidth, dstHeight);
+        PHInterleavePlanes(srcU, srcStrideU, srcV, srcStrideV, dstUV, dstStrideUV, dstChromaWidth, dstChromaHeight);
+        return;
+    }
+
+    filter = ResolveFilter(filter, srcWidth, srcHeight, dstWidth, dstHeight);
+
+    // Luma rows are scaled straight into the destination plane.
+
+    PlaneRowScaler scalerY(srcY, srcStrideY, srcWidth, srcHeight, dstWidth, dstHeight, filter);
+
+    for (int row = 0; row < dstHeight; row++) {
+        scalerY.ScaleRow(row, dstY);
+        dstY += dstStrideY;
+    }
+
+    PlaneRowScaler scalerU(srcU, srcStrideU, srcChromaWidth, srcChromaHeight, dstChromaWidth, dstChromaHeight, filter);
+    PlaneRowScaler scalerV(srcV, srcStrideV, srcChromaWidth, srcChromaHeight, dstChromaWidth, dstChromaHeight, filter);
+
+    std::vector<uint8_t> rows(2 * dstChromaWidth);
+    uint8_t *rowU = rows.data();
+    uint8_t *rowV = rowU + dstChromaWidth;
+
+    PHInterleaveRowFunction interleaveRow = PHConvertInterleaveRowFunction(PHConvertActiveKernel());
+
+    for (int row = 0; row < dstChromaHeight; row++) {
+        scalerU.ScaleRow(row, rowU);
+        scalerV.ScaleRow(row, rowV);
+        interleaveRow(rowU, rowV, dstUV, dstChromaWidth);
+        dstUV += dstStrideUV;
+    }
+}
@@ -0,0 +1,53 @@
+//
+//  PHScaleConvert.h
+//  PerchRTC
+//
+//  Created by Christopher Eagleston on 2015-06-09.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#ifndef __PerchRTC__PHScaleConvert__
+#define __PerchRTC__PHScaleConvert__
+
+#include "PHColorConvert.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum PHScaleFilter
+{
+    /* Box when shrinking by 2x or more in both directions, bilinear otherwise. */
+    PHScaleFilterAutomatic = 0,
+    PHScaleFilterBox = 1,
+    PHScaleFilterBilinear = 2,
+} PHScaleFilter;
+
+/**
+ *  Scales and converts an I420 image to 32-bit RGB in a single pass.
+ *  Only one scaled row of each plane is held at a time, and each RGB row is written straight into `dstRGB`.
+ *  When the source and destination dimensions match this is equivalent to PHConvertI420ToRGB.
+ */
+void PHScaleConvertI420ToRGB(const uint8_t *srcY, int srcStrideY,
+                             const uint8_t *srcU, int srcStrideU,
+                             const uint8_t *srcV, int srcStrideV,
+                             int srcWidth, int srcHeight,
+                             uint8_t *dstRGB, int dstStride,
+                             int dstWidth, int dstHeight,
+                             PHScaleFilter filter, PHColorMatrix matrix, PHRGBLayout layout);
+
+// Scales an I420 image, and packs the result into bi-planar NV12 destination planes.
+void PHScaleI420ToNV12(const uint8_t *srcY, int srcStrideY,
+                       const uint8_t *srcU, int srcStrideU,
+                       const uint8_t *srcV, int srcStrideV,
+                       int srcWidth, int srcHeight,
+                       uint8_t *dstY, int dstStrideY,
+                       uint8_t *dstUV, int dstStrideUV,
+                       int dstWidth, int dstHeight,
+                       PHScaleFilter filter);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* defined(__PerchRTC__PHScaleConvert__) */
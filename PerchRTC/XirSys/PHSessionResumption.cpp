@@ -0,0 +1,131 @@
+//
+//  PHSessionResumption.cpp
+//  PerchRTC
+//
+//  Created by Christopher Eagleston on 2015-08-11.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#include "PHSessionResumption.h"
+
+#include <algorithm>
+
+namespace perch {
+
+    const int64_t SessionResumption::kNoTime;
+
+    SessionResumption::SessionResumption(SessionResumptionConfig config)
+    : _config(config), _resumeStartMs(kNoTime), _isUsingCachedToken(false)
+    {}
+
+    bool SessionResumption::OnSignalingLost(size_t connectionCount, int64_t nowMs)
+    {
+        if (IsResuming() || connectionCount == 0) {
+            return false;
+        }
+
+        _resumeStartMs = nowMs;
+        _metrics.attempts++;
+
+        return true;
+    }
+
+    std::string SessionResumption::TakeCachedToken()
+    {
+        if (!CanReuseToken()) {
+            return std::string();
+        }
+
+        // If it has expired, the next attempt fetches a new one.
+
+        std::string token;
+        token.swap(_token);
+        _isUsingCachedToken = true;
+
+        return token;
+    }
+
+    int64_t SessionResumption::OnJoined(const std::string &token, const std::vector<std::string> &missingPeers, int64_t nowMs)
+    {
+        _token = token;
+
+        if (!IsResuming()) {
+            return kNoTime;
+        }
+
+        int64_t resumeMs = nowMs - _resumeStartMs;
+
+        _resumeStartMs = kNoTime;
+        _metrics.resumptions++;
+        _metrics.cachedTokenResumptions += _isUsingCachedToken ? 1 : 0;
+        _metrics.lastResumeMs = resumeMs;
+        _metrics.maxResumeMs = std::max(_metrics.maxResumeMs, resumeMs);
+
+        // Peers who left while we were away weren't announced. Those who did come back are in the room.
+
+        _leftPeers.clear();
+
+        for (size_t i = 0; i < missingPeers.size(); i++) {
+            OnPeerLeft(missingPeers[i], nowMs);
+        }
+
+        return resumeMs;
+    }
+
+    void SessionResumption::OnPeerLeft(const std::string &peerId, int64_t nowMs)
+    {
+        // The first departure sets the deadline. A dropped connection doesn't extend it.
+
+        _leftPeers.insert(std::make_pair(peerId, nowMs + _config.peerResumeIntervalMs));
+    }
+
+    void SessionResumption::Poll(int64_t nowMs, std::vector<SessionResumptionAction> *actions)
+    {
+        if (IsResuming()) {
+            if (nowMs - _resumeStartMs >= _config.resumeTimeoutMs) {
+                Reset();
+                actions->push_back(SessionResumptionAction(std::string(), SessionResumptionActionAbandon));
+            }
+
+            return;
+        }
+
+        std::map<std::string, int64_t>::iterator it = _leftPeers.begin();
+
+        while (it != _leftPeers.end()) {
+            if (it->second > nowMs) {
+                ++it;
+                continue;
+            }
+
+            actions->push_back(SessionResumptionAction(it->first, SessionResumptionActionClosePeer));
+            _leftPeers.erase(it++);
+        }
+    }
+
+    int64_t SessionResumption::NextDueMs() const
+    {
+        if (IsResuming()) {
+            return _resumeStartMs + _config.resumeTimeoutMs;
+        }
+
+        int64_t next = kNoTime;
+
+        for (std::map<std::string, int64_t>::const_iterator it = _leftPeers.begin(); it != _leftPeers.end(); ++it) {
+            if (next == kNoTime || it->second < next) {
+                next = it->second;
+            }
+        }
+
+        return next;
+    }
+
+    void SessionResumption::Reset()
+    {
+        _resumeStartMs = kNoTime;
+        _token.clear();
+        _isUsingCachedToken = false;
+        _leftPeers.clear();
+    }
+
+} // namespace perch
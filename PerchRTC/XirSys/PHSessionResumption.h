@@ -0,0 +1,134 @@
+//
+//  PHSessionResumption.h
+//  PerchRTC
+//
+//  Created by Christopher Eagleston on 2015-08-11.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#ifndef PerchRTC_PHSessionResumption_h
+#define PerchRTC_PHSessionResumption_h
+
+#include <map>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace perch {
+
+    struct SessionResumptionConfig
+    {
+        SessionResumptionConfig() : resumeTimeoutMs(30000), peerResumeIntervalMs(10000) {}
+
+        // Media connections are closed if signaling can't be resumed within this time.
+        int64_t resumeTimeoutMs;
+        // A peer which leaves the room may be resuming its own session. Its connection is kept this long for it to
+        // come back.
+        int64_t peerResumeIntervalMs;
+    };
+
+    enum SessionResumptionActionType
+    {
+        // Close the connection with the peer.
+        SessionResumptionActionClosePeer,
+        // Signaling didn't come back in time. Close every connection.
+        SessionResumptionActionAbandon
+    };
+
+    struct SessionResumptionAction
+    {
+        SessionResumptionAction(const std::string &actionPeerId, SessionResumptionActionType actionType)
+        : peerId(actionPeerId), type(actionType)
+        {}
+
+        // Empty for SessionResumptionActionAbandon.
+        std::string peerId;
+        SessionResumptionActionType type;
+    };
+
+    struct SessionResumptionMetrics
+    {
+        SessionResumptionMetrics() : attempts(0), resumptions(0), cachedTokenResumptions(0), lastResumeMs(0), maxResumeMs(0) {}
+
+        // Times signaling was lost while we had media connections, and those it came back in time to keep them.
+        uint64_t attempts;
+        uint64_t resumptions;
+        // Resumptions which reused the last socket token, rather than fetching a new one.
+        uint64_t cachedTokenResumptions;
+        // From losing signaling to rejoining the room.
+        int64_t lastResumeMs;
+        int64_t maxResumeMs;
+    };
+
+    /**
+     *  Keeps media connections through a loss of signaling, and decides when to give up on them.
+     *
+     *  Losing the socket while we have connections begins resuming. The socket is reopened once with the token we last
+     *  joined with, and a new one is only fetched if that is refused. Resuming finishes when we rejoin the room, and is
+     *  abandoned if that takes longer than resumeTimeoutMs.
+     *
+     *  A peer which leaves the room, or is missing when we rejoin it, may be resuming too. Its connection is closed if
+     *  it hasn't come back within peerResumeIntervalMs. Nothing is closed while we are resuming ourselves, since the
+     *  room is only settled once we have rejoined it.
+     *
+     *  Time is passed in, so that a simulated clock can drive it.
+     */
+    class SessionResumption
+    {
+    public:
+        static const int64_t kNoTime = -1;
+
+        explicit SessionResumption(SessionResumptionConfig config = SessionResumptionConfig());
+
+        // Returns true if this begins resuming, which it only does with connections to keep.
+        bool OnSignalingLost(size_t connectionCount, int64_t nowMs);
+
+        // Whether TakeCachedToken has a token to give.
+        bool CanReuseToken() const { return IsResuming() && !_token.empty(); }
+
+        // The token to reconnect with, given out once per resumption. Empty if a new one has to be fetched.
+        std::string TakeCachedToken();
+
+        // A new token is in use.
+        void OnTokenFetched() { _isUsingCachedToken = false; }
+
+        // Whether the socket is being opened with the cached token, so that it being refused is expected.
+        bool IsUsingCachedToken() const { return _isUsingCachedToken; }
+
+        // We joined the room with `token`. `missingPeers` have connections, but aren't in the room. Returns how long
+        // resuming took, if this finished it, or kNoTime.
+        int64_t OnJoined(const std::string &token, const std::vector<std::string> &missingPeers, int64_t nowMs);
+
+        // A peer with a connection left the room, or its connection dropped while it was out of the room.
+        void OnPeerLeft(const std::string &peerId, int64_t nowMs);
+
+        // The peer is back in the room, or its connection is closed.
+        void OnPeerReturned(const std::string &peerId) { _leftPeers.erase(peerId); }
+
+        // Moves the actions which are due into `actions`.
+        void Poll(int64_t nowMs, std::vector<SessionResumptionAction> *actions);
+
+        // When Poll next has something to do, or kNoTime.
+        int64_t NextDueMs() const;
+
+        bool IsResuming() const { return _resumeStartMs != kNoTime; }
+
+        // Forgets the session, but not the metrics.
+        void Reset();
+
+        const SessionResumptionMetrics &Metrics() const { return _metrics; }
+
+    private:
+        SessionResumptionConfig _config;
+        int64_t _resumeStartMs;
+        std::string _token;
+        bool _isUsingCachedToken;
+        // When each peer which left has to be back by.
+        std::map<std::string, int64_t> _leftPeers;
+        SessionResumptionMetrics _metrics;
+    };
+
+} // namespace perch
+
+#endif
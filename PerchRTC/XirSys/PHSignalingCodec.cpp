@@ -0,0 +1,901 @@
+//
+//  PHSignalingCodec.cpp
+//  PerchRTC
+//
+//  Created by Christopher Eagleston on 2015-08-03.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#include "PHSignalingCodec.h"
+
+#include <stdio.h>
+#include <string.h>
+
+namespace perch {
+
+    namespace {
+
+        // Our deepest field is four objects down. Leave room for whatever else the server sends.
+        const int kSignalingMaxDepth = 16;
+
+        enum SignalingKey
+        {
+            SignalingKeyOther,
+            SignalingKeyType,
+            SignalingKeyEventName,
+            SignalingKeyUserId,
+            SignalingKeyTargetUserId,
+            SignalingKeyRoom,
+            SignalingKeyMessage,
+            SignalingKeyData,
+            SignalingKeyConnectionId,
+            SignalingKeyOffer,
+            SignalingKeyAnswer,
+            SignalingKeyIceCandidate,
+            SignalingKeyIceCandidates,
+            SignalingKeySdp,
+            SignalingKeyCandidate,
+            SignalingKeyId,
+            SignalingKeyLabel,
+            SignalingKeyUsers,
+            SignalingKeyFeatures
+        };
+
+        inline bool Matches(const SignalingText &text, const char *literal)
+        {
+            return memcmp(text.data, literal, text.size) == 0;
+        }
+
+        // Every key we read is told apart by its length and first character, so at most one comparison is made.
+        SignalingKey KeyFor(const SignalingText &key)
+        {
+            switch (key.size) {
+                case 2:
+                    return Matches(key, "id") ? SignalingKeyId : SignalingKeyOther;
+                case 3:
+                    return Matches(key, "sdp") ? SignalingKeySdp : SignalingKeyOther;
+                case 4:
+                    switch (key.data[0]) {
+                        case 't': return Matches(key, "type") ? SignalingKeyType : SignalingKeyOther;
+                        case 'r': return Matches(key, "room") ? SignalingKeyRoom : SignalingKeyOther;
+                        case 'd': return Matches(key, "data") ? SignalingKeyData : SignalingKeyOther;
+                        default: return SignalingKeyOther;
+                    }
+                case 5:
+                    switch (key.data[0]) {
+                        case 'o': return Matches(key, "offer") ? SignalingKeyOffer : SignalingKeyOther;
+                        case 'l': return Matches(key, "label") ? SignalingKeyLabel : SignalingKeyOther;
+                        case 'u': return Matches(key, "users") ? SignalingKeyUsers : SignalingKeyOther;
+                        default: return SignalingKeyOther;
+                    }
+                case 6:
+                    switch (key.data[0]) {
+                        case 'u': return Matches(key, "userid") ? SignalingKeyUserId : SignalingKeyOther;
+                        case 'a': return Matches(key, "answer") ? SignalingKeyAnswer : SignalingKeyOther;
+                        default: return SignalingKeyOther;
+                    }
+                case 7:
+                    return Matches(key, "message") ? SignalingKeyMessage : SignalingKeyOther;
+                case 8:
+                    return Matches(key, "features") ? SignalingKeyFeatures : SignalingKeyOther;
+                case 9:
+                    switch (key.data[0]) {
+                        case 'e': return Matches(key, "eventName") ? SignalingKeyEventName : SignalingKeyOther;
+                        case 'c': return Matches(key, "candidate") ? SignalingKeyCandidate : SignalingKeyOther;
+                        default: return SignalingKeyOther;
+                    }
+                case 12:
+                    switch (key.data[0]) {
+                        case 't': return Matches(key, "targetUserId") ? SignalingKeyTargetUserId : SignalingKeyOther;
+                        case 'c': return Matches(key, "connectionId") ? SignalingKeyConnectionId : SignalingKeyOther;
+                        case 'i': return Matches(key, "iceCandidate") ? SignalingKeyIceCandidate : SignalingKeyOther;
+                        default: return SignalingKeyOther;
+                    }
+                case 13:
+                    return Matches(key, "iceCandidates") ? SignalingKeyIceCandidates : SignalingKeyOther;
+                default:
+                    return SignalingKeyOther;
+            }
+        }
+
+        inline int HexValue(char c)
+        {
+            if (c >= '0' && c <= '9') {
+                return c - '0';
+            }
+            if (c >= 'a' && c <= 'f') {
+                return c - 'a' + 10;
+            }
+            if (c >= 'A' && c <= 'F') {
+                return c - 'A' + 10;
+            }
+            return -1;
+        }
+
+        // RFC 3629: no overlong forms, no surrogates, and nothing past U+10FFFF.
+        bool IsValidUTF8(const unsigned char *text, size_t size)
+        {
+            const unsigned char *end = text + size;
+
+            while (text < end) {
+                unsigned char lead = *text;
+
+                if (lead < 0x80) {
+                    text++;
+                    continue;
+                }
+
+                size_t length;
+                unsigned char low = 0x80;
+                unsigned char high = 0xBF;
+
+                if (lead >= 0xC2 && lead <= 0xDF) {
+                    length = 2;
+                }
+                else if (lead >= 0xE0 && lead <= 0xEF) {
+                    length = 3;
+                    low = lead == 0xE0 ? 0xA0 : 0x80;
+                    high = lead == 0xED ? 0x9F : 0xBF;
+                }
+                else if (lead >= 0xF0 && lead <= 0xF4) {
+                    length = 4;
+                    low = lead == 0xF0 ? 0x90 : 0x80;
+                    high = lead == 0xF4 ? 0x8F : 0xBF;
+                }
+                else {
+                    return false;
+                }
+
+                if ((size_t)(end - text) < length || text[1] < low || text[1] > high) {
+                    return false;
+                }
+
+                for (size_t i = 2; i < length; i++) {
+                    if ((text[i] & 0xC0) != 0x80) {
+                        return false;
+                    }
+                }
+
+                text += length;
+            }
+
+            return true;
+        }
+
+        char *AppendUTF8(char *out, uint32_t codePoint)
+        {
+            if (codePoint < 0x80) {
+                *out++ = (char)codePoint;
+            }
+            else if (codePoint < 0x800) {
+                *out++ = (char)(0xC0 | (codePoint >> 6));
+                *out++ = (char)(0x80 | (codePoint & 0x3F));
+            }
+            else if (codePoint < 0x10000) {
+                *out++ = (char)(0xE0 | (codePoint >> 12));
+                *out++ = (char)(0x80 | ((codePoint >> 6) & 0x3F));
+                *out++ = (char)(0x80 | (codePoint & 0x3F));
+            }
+            else {
+                *out++ = (char)(0xF0 | (codePoint >> 18));
+                *out++ = (char)(0x80 | ((codePoint >> 12) & 0x3F));
+                *out++ = (char)(0x80 | ((codePoint >> 6) & 0x3F));
+                *out++ = (char)(0x80 | (codePoint & 0x3F));
+            }
+
+            return out;
+        }
+
+        // A recursive descent reader over a mutable buffer. Each method leaves the cursor after what it read.
+        class JsonReader
+        {
+        public:
+            JsonReader(char *begin, char *end) : _cursor(begin), _end(end), _depth(0) {}
+
+            bool AtEnd()
+            {
+                SkipWhitespace();
+                return _cursor == _end;
+            }
+
+            bool Peek(char c)
+            {
+                SkipWhitespace();
+                return _cursor < _end && *_cursor == c;
+            }
+
+            // Calls `member(key)` for each member, which must read the value. Returns false on malformed input.
+            template <typename Member>
+            bool ReadObject(Member member)
+            {
+                if (!Consume('{') || !Enter()) {
+                    return false;
+                }
+
+                if (Peek('}')) {
+                    _cursor++;
+                    return Leave();
+                }
+
+                do {
+                    SignalingText key;
+
+                    if (!ReadString(&key) || !Consume(':') || !member(key)) {
+                        return false;
+                    }
+                } while (Consume(','));
+
+                return Consume('}') && Leave();
+            }
+
+            template <typename Element>
+            bool ReadArray(Element element)
+            {
+                if (!Consume('[') || !Enter()) {
+                    return false;
+                }
+
+                if (Peek(']')) {
+                    _cursor++;
+                    return Leave();
+                }
+
+                do {
+                    if (!element()) {
+                        return false;
+                    }
+                } while (Consume(','));
+
+                return Consume(']') && Leave();
+            }
+
+            // Unescapes in place. Unescaped text is never longer than its escaped form, so this can't overrun.
+            bool ReadString(SignalingText *text)
+            {
+                if (!Consume('"')) {
+                    return false;
+                }
+
+                char *start = _cursor;
+                char *out = _cursor;
+
+                while (_cursor < _end) {
+                    char c = *_cursor++;
+
+                    if (c == '"') {
+                        *text = SignalingText(start, out - start);
+                        return true;
+                    }
+                    if ((unsigned char)c < 0x20) {
+                        return false;
+                    }
+                    if (c != '\\') {
+                        *out++ = c;
+                        continue;
+                    }
+                    if (_cursor == _end) {
+                        return false;
+                    }
+
+                    switch (*_cursor++) {
+                        case '"': *out++ = '"'; break;
+                        case '\\': *out++ = '\\'; break;
+                        case '/': *out++ = '/'; break;
+                        case 'b': *out++ = '\b'; break;
+                        case 'f': *out++ = '\f'; break;
+                        case 'n': *out++ = '\n'; break;
+                        case 'r': *out++ = '\r'; break;
+                        case 't': *out++ = '\t'; break;
+                        case 'u': {
+                            uint32_t codePoint = 0;
+
+                            if (!ReadHex4(&codePoint)) {
+                                return false;
+                            }
+
+                            // A lone surrogate can't be written as UTF-8, so it has to be the first of a pair.
+
+                            if (codePoint >= 0xD800 && codePoint <= 0xDBFF) {
+                                uint32_t low = 0;
+
+                                if (_end - _cursor < 6 || _cursor[0] != '\\' || _cursor[1] != 'u') {
+                                    return false;
+                                }
+                                _cursor += 2;
+                                if (!ReadHex4(&low) || low < 0xDC00 || low > 0xDFFF) {
+                                    return false;
+                                }
+                                codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+                            }
+                            else if (codePoint >= 0xDC00 && codePoint <= 0xDFFF) {
+                                return false;
+                            }
+
+                            out = AppendUTF8(out, codePoint);
+                            break;
+                        }
+                        default:
+                            return false;
+                    }
+                }
+
+                return false;
+            }
+
+            // Strings are taken as they are, null leaves the text empty, and anything else is skipped.
+            bool ReadText(SignalingText *text)
+            {
+                if (Peek('"')) {
+                    return ReadString(text);
+                }
+
+                *text = SignalingText();
+                return SkipValue();
+            }
+
+            // Integers, or strings of digits as some clients send. Anything else leaves the value alone.
+            bool ReadInteger(int32_t *value)
+            {
+                SkipWhitespace();
+
+                bool quoted = _cursor < _end && *_cursor == '"';
+                char *start = _cursor + (quoted ? 1 : 0);
+
+                if (!SkipValue()) {
+                    return false;
+                }
+
+                char *end = quoted ? _cursor - 1 : _cursor;
+                bool negative = start < end && *start == '-';
+                int64_t result = 0;
+                char *digit = start + (negative ? 1 : 0);
+
+                if (digit == end) {
+                    return true;
+                }
+
+                for (; digit < end; digit++) {
+                    if (*digit < '0' || *digit > '9' || result > INT32_MAX) {
+                        return true;
+                    }
+                    result = result * 10 + (*digit - '0');
+                }
+
+                if (result <= INT32_MAX) {
+                    *value = (int32_t)(negative ? -result : result);
+                }
+
+                return true;
+            }
+
+            bool SkipValue()
+            {
+                SkipWhitespace();
+
+                if (_cursor == _end) {
+                    return false;
+                }
+
+                switch (*_cursor) {
+                    case '{':
+                        return ReadObject([this](const SignalingText &) { return SkipValue(); });
+                    case '[':
+                        return ReadArray([this]() { return SkipValue(); });
+                    case '"': {
+                        SignalingText ignored;
+                        return ReadString(&ignored);
+                    }
+                    case 't':
+                        return ConsumeLiteral("true");
+                    case 'f':
+                        return ConsumeLiteral("false");
+                    case 'n':
+                        return ConsumeLiteral("null");
+                    default:
+                        return SkipNumber();
+                }
+            }
+
+        private:
+            void SkipWhitespace()
+            {
+                while (_cursor < _end && (*_cursor == ' ' || *_cursor == '\t' || *_cursor == '\n' || *_cursor == '\r')) {
+                    _cursor++;
+                }
+            }
+
+            bool Consume(char c)
+            {
+                SkipWhitespace();
+
+                if (_cursor < _end && *_cursor == c) {
+                    _cursor++;
+                    return true;
+                }
+
+                return false;
+            }
+
+            bool ConsumeLiteral(const char *literal)
+            {
+                size_t length = strlen(literal);
+
+                if ((size_t)(_end - _cursor) < length || memcmp(_cursor, literal, length) != 0) {
+                    return false;
+                }
+
+                _cursor += length;
+                return true;
+            }
+
+            // -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+            bool SkipNumber()
+            {
+                if (_cursor < _end && *_cursor == '-') {
+                    _cursor++;
+                }
+                if (!SkipDigits()) {
+                    return false;
+                }
+                if (_cursor < _end && *_cursor == '.') {
+                    _cursor++;
+                    if (!SkipDigits()) {
+                        return false;
+                    }
+                }
+                if (_cursor < _end && (*_cursor == 'e' || *_cursor == 'E')) {
+                    _cursor++;
+                    if (_cursor < _end && (*_cursor == '+' || *_cursor == '-')) {
+                        _cursor++;
+                    }
+                    if (!SkipDigits()) {
+                        return false;
+                    }
+                }
+
+                return true;
+            }
+
+            bool SkipDigits()
+            {
+                char *start = _cursor;
+
+                while (_cursor < _end && *_cursor >= '0' && *_cursor <= '9') {
+                    _cursor++;
+                }
+
+                return _cursor > start;
+            }
+
+            bool ReadHex4(uint32_t *value)
+            {
+                if (_end - _cursor < 4) {
+                    return false;
+                }
+
+                uint32_t result = 0;
+
+                for (int i = 0; i < 4; i++) {
+                    int digit = HexValue(_cursor[i]);
+
+                    if (digit < 0) {
+                        return false;
+                    }
+                    result = (result << 4) | (uint32_t)digit;
+                }
+
+                _cursor += 4;
+                *value = result;
+                return true;
+            }
+
+            bool Enter()
+            {
+                return ++_depth <= kSignalingMaxDepth;
+            }
+
+            bool Leave()
+            {
+                _depth--;
+                return true;
+            }
+
+            char *_cursor;
+            char *_end;
+            int _depth;
+        };
+
+        // Message fields
+
+        bool ReadDescription(JsonReader &reader, SignalingMessage *message)
+        {
+            if (!reader.Peek('{')) {
+                return reader.SkipValue();
+            }
+
+            return reader.ReadObject([&](const SignalingText &key) {
+                switch (KeyFor(key)) {
+                    case SignalingKeySdp: return reader.ReadText(&message->sdp);
+                    case SignalingKeyType: return reader.ReadText(&message->sdpType);
+                    default: return reader.SkipValue();
+                }
+            });
+        }
+
+        bool ReadCandidate(JsonReader &reader, SignalingMessage *message)
+        {
+            if (!reader.Peek('{')) {
+                return reader.SkipValue();
+            }
+
+            SignalingCandidate candidate;
+
+            bool read = reader.ReadObject([&](const SignalingText &key) {
+                switch (KeyFor(key)) {
+                    case SignalingKeyCandidate: return reader.ReadText(&candidate.candidate);
+                    case SignalingKeyId: return reader.ReadText(&candidate.mid);
+                    case SignalingKeyLabel: return reader.ReadInteger(&candidate.index);
+                    default: return reader.SkipValue();
+                }
+            });
+
+            if (read && !candidate.candidate.Empty()) {
+                message->candidates.push_back(candidate);
+            }
+
+            return read;
+        }
+
+        bool ReadCandidates(JsonReader &reader, SignalingMessage *message)
+        {
+            if (!reader.Peek('[')) {
+                return reader.SkipValue();
+            }
+
+            return reader.ReadArray([&]() { return ReadCandidate(reader, message); });
+        }
+
+        bool ReadUsers(JsonReader &reader, SignalingMessage *message)
+        {
+            if (!reader.Peek('[')) {
+                return reader.SkipValue();
+            }
+
+            return reader.ReadArray([&]() {
+                SignalingText user;
+
+                if (reader.Peek('{')) {
+                    bool read = reader.ReadObject([&](const SignalingText &key) {
+                        return KeyFor(key) == SignalingKeyId ? reader.ReadText(&user) : reader.SkipValue();
+                    });
+
+                    if (read && !user.Empty()) {
+                        message->users.push_back(user);
+                    }
+
+                    return read;
+                }
+
+                if (!reader.ReadText(&user)) {
+                    return false;
+                }
+                if (!user.Empty()) {
+                    message->users.push_back(user);
+                }
+
+                return true;
+            });
+        }
+
+        bool ReadFeatures(JsonReader &reader, SignalingMessage *message)
+        {
+            if (!reader.Peek('[')) {
+                return reader.SkipValue();
+            }
+
+            return reader.ReadArray([&]() {
+                SignalingText feature;
+
+                if (!reader.ReadText(&feature)) {
+                    return false;
+                }
+                if (feature.Equals("iceCandidates")) {
+                    message->features |= SignalingFeatureCandidateBatches;
+                }
+
+                return true;
+            });
+        }
+
+        // The peer payload: what we send as "data", and receive as "message": { "data": ... }.
+        bool ReadPayload(JsonReader &reader, SignalingMessage *message)
+        {
+            if (!reader.Peek('{')) {
+                return reader.SkipValue();
+            }
+
+            return reader.ReadObject([&](const SignalingText &key) {
+                switch (KeyFor(key)) {
+                    case SignalingKeyConnectionId: return reader.ReadText(&message->connectionId);
+                    case SignalingKeyOffer:
+                    case SignalingKeyAnswer: return ReadDescription(reader, message);
+                    case SignalingKeyIceCandidate: return ReadCandidate(reader, message);
+                    case SignalingKeyIceCandidates: return ReadCandidates(reader, message);
+                    case SignalingKeyUsers: return ReadUsers(reader, message);
+                    case SignalingKeyFeatures: return ReadFeatures(reader, message);
+                    default: return reader.SkipValue();
+                }
+            });
+        }
+
+        bool ReadMessageBody(JsonReader &reader, SignalingMessage *message)
+        {
+            if (!reader.Peek('{')) {
+                return reader.SkipValue();
+            }
+
+            return reader.ReadObject([&](const SignalingText &key) {
+                switch (KeyFor(key)) {
+                    case SignalingKeyData: return ReadPayload(reader, message);
+                    case SignalingKeyUsers: return ReadUsers(reader, message);
+                    case SignalingKeyConnectionId: return reader.ReadText(&message->connectionId);
+                    default: return reader.SkipValue();
+                }
+            });
+        }
+
+    } // namespace
+
+    // SignalingText
+
+    SignalingText::SignalingText(const char *text) : data(text), size(text ? strlen(text) : 0)
+    {
+    }
+
+    bool SignalingText::Equals(const char *text) const
+    {
+        return strlen(text) == size && memcmp(data, text, size) == 0;
+    }
+
+    // Events
+
+    SignalingEvent SignalingEventForName(const SignalingText &name)
+    {
+        // Told apart by length, then first character.
+
+        switch (name.size) {
+            case 3:
+                if (name.Equals("ice")) {
+                    return SignalingEventICE;
+                }
+                return name.Equals("bye") ? SignalingEventBye : SignalingEventUnknown;
+            case 5:
+                if (name.data[0] == 'o') {
+                    return name.Equals("offer") ? SignalingEventOffer : SignalingEventUnknown;
+                }
+                return name.Equals("peers") ? SignalingEventRoomUsersUpdate : SignalingEventUnknown;
+            case 6:
+                return name.Equals("answer") ? SignalingEventAnswer : SignalingEventUnknown;
+            case 12:
+                return name.Equals("peer_removed") ? SignalingEventRoomLeave : SignalingEventUnknown;
+            case 14:
+                return name.Equals("peer_connected") ? SignalingEventRoomJoin : SignalingEventUnknown;
+            default:
+                return SignalingEventUnknown;
+        }
+    }
+
+    const char *SignalingEventName(SignalingEvent event)
+    {
+        switch (event) {
+            case SignalingEventOffer: return "offer";
+            case SignalingEventAnswer: return "answer";
+            case SignalingEventICE: return "ice";
+            case SignalingEventBye: return "bye";
+            case SignalingEventRoomJoin: return "peer_connected";
+            case SignalingEventRoomLeave: return "peer_removed";
+            case SignalingEventRoomUsersUpdate: return "peers";
+            case SignalingEventUnknown:
+            default: return "";
+        }
+    }
+
+    void SignalingMessage::Clear()
+    {
+        event = SignalingEventUnknown;
+        eventName = SignalingText();
+        senderId = SignalingText();
+        targetId = SignalingText();
+        room = SignalingText();
+        connectionId = SignalingText();
+        sdp = SignalingText();
+        sdpType = SignalingText();
+        features = 0;
+        candidates.clear();
+        users.clear();
+    }
+
+    // SignalingDecoder
+
+    bool SignalingDecoder::Decode(const char *frame, size_t size, SignalingMessage *message)
+    {
+        message->Clear();
+
+        // Text we hand out must be valid UTF-8, or NSString won't take it. Bytes outside strings fail as JSON anyway.
+
+        if (!IsValidUTF8((const unsigned char *)frame, size)) {
+            return false;
+        }
+
+        _buffer.assign(frame, frame + size);
+
+        char *begin = _buffer.empty() ? NULL : &_buffer[0];
+        JsonReader reader(begin, begin + size);
+        SignalingText type;
+        SignalingText eventName;
+
+        if (!reader.Peek('{')) {
+            return false;
+        }
+
+        bool read = reader.ReadObject([&](const SignalingText &key) {
+            switch (KeyFor(key)) {
+                case SignalingKeyType: return reader.ReadText(&type);
+                case SignalingKeyEventName: return reader.ReadText(&eventName);
+                case SignalingKeyUserId: return reader.ReadText(&message->senderId);
+                case SignalingKeyTargetUserId: return reader.ReadText(&message->targetId);
+                case SignalingKeyRoom: return reader.ReadText(&message->room);
+                case SignalingKeyMessage: return ReadMessageBody(reader, message);
+                case SignalingKeyData: return ReadPayload(reader, message);
+                default: return reader.SkipValue();
+            }
+        });
+
+        if (!read || !reader.AtEnd()) {
+            message->Clear();
+            return false;
+        }
+
+        // "type" wins over "eventName", as it always has.
+
+        message->eventName = !type.Empty() ? type : eventName;
+        message->event = SignalingEventForName(message->eventName);
+
+        return true;
+    }
+
+    // SignalingEncoder
+
+    const std::string &SignalingEncoder::Encode(const SignalingMessage &message)
+    {
+        _buffer.clear();
+
+        _buffer += '{';
+        AppendKey("eventName");
+        AppendString(message.event != SignalingEventUnknown ? SignalingText(SignalingEventName(message.event)) : message.eventName);
+
+        if (!message.targetId.Empty()) {
+            _buffer += ',';
+            AppendKey("targetUserId");
+            AppendString(message.targetId);
+        }
+
+        _buffer += ',';
+        AppendKey("data");
+        _buffer += '{';
+        AppendKey("connectionId");
+        AppendString(message.connectionId);
+
+        switch (message.event) {
+            case SignalingEventOffer:
+            case SignalingEventAnswer:
+                _buffer += ',';
+                AppendKey(SignalingEventName(message.event));
+                _buffer += '{';
+                AppendKey("sdp");
+                AppendString(message.sdp);
+                _buffer += ',';
+                AppendKey("type");
+                AppendString(message.sdpType);
+                _buffer += '}';
+                if (message.features & SignalingFeatureCandidateBatches) {
+                    _buffer += ',';
+                    AppendKey("features");
+                    _buffer += "[\"iceCandidates\"]";
+                }
+                break;
+            case SignalingEventICE:
+                _buffer += ',';
+                if (message.candidates.size() == 1) {
+                    AppendKey("iceCandidate");
+                    AppendCandidate(message.candidates[0]);
+                }
+                else {
+                    AppendKey("iceCandidates");
+                    _buffer += '[';
+                    for (size_t i = 0; i < message.candidates.size(); i++) {
+                        if (i > 0) {
+                            _buffer += ',';
+                        }
+                        AppendCandidate(message.candidates[i]);
+                    }
+                    _buffer += ']';
+                }
+                break;
+            case SignalingEventBye:
+                _buffer += ',';
+                AppendKey("bye");
+                _buffer += "{}";
+                break;
+            default:
+                break;
+        }
+
+        _buffer += "}}";
+
+        return _buffer;
+    }
+
+    void SignalingEncoder::AppendCandidate(const SignalingCandidate &candidate)
+    {
+        char label[16];
+        int length = snprintf(label, sizeof(label), "%d", candidate.index);
+
+        _buffer += '{';
+        AppendKey("label");
+        _buffer.append(label, length > 0 ? length : 0);
+        _buffer += ',';
+        AppendKey("id");
+        AppendString(candidate.mid);
+        _buffer += ',';
+        AppendKey("candidate");
+        AppendString(candidate.candidate);
+        _buffer += '}';
+    }
+
+    void SignalingEncoder::AppendKey(const char *key)
+    {
+        _buffer += '"';
+        _buffer += key;
+        _buffer += "\":";
+    }
+
+    void SignalingEncoder::AppendString(const SignalingText &text)
+    {
+        static const char kHex[] = "0123456789abcdef";
+
+        _buffer += '"';
+
+        // Copy runs which need no escaping in one go. SDP is mostly such runs, broken up by CRLFs.
+
+        size_t run = 0;
+
+        for (size_t i = 0; i < text.size; i++) {
+            unsigned char c = (unsigned char)text.data[i];
+
+            if (c >= 0x20 && c != '"' && c != '\\') {
+                continue;
+            }
+
+            _buffer.append(text.data + run, i - run);
+            run = i + 1;
+
+            switch (c) {
+                case '"': _buffer += "\\\""; break;
+                case '\\': _buffer += "\\\\"; break;
+                case '\n': _buffer += "\\n"; break;
+                case '\r': _buffer += "\\r"; break;
+                case '\t': _buffer += "\\t"; break;
+                default: {
+                    char escaped[6] = { '\\', 'u', '0', '0', kHex[c >> 4], kHex[c & 0xF] };
+                    _buffer.append(escaped, sizeof(escaped));
+                    break;
+                }
+            }
+        }
+
+        _buffer.append(text.data + run, text.size - run);
+        _buffer += '"';
+    }
+
+} // namespace perch
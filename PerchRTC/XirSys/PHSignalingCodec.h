@@ -0,0 +1,143 @@
+//
+//  PHSignalingCodec.h
+//  PerchRTC
+//
+//  Created by Christopher Eagleston on 2015-08-03.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#ifndef PerchRTC_PHSignalingCodec_h
+#define PerchRTC_PHSignalingCodec_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace perch {
+
+    // A view of decoded text. Valid until the decoder which produced it decodes again.
+    struct SignalingText
+    {
+        SignalingText() : data(NULL), size(0) {}
+        SignalingText(const char *textData, size_t textSize) : data(textData), size(textSize) {}
+        explicit SignalingText(const char *text);
+
+        bool Empty() const { return size == 0; }
+        bool Equals(const char *text) const;
+        std::string ToString() const { return std::string(data, size); }
+
+        const char *data;
+        size_t size;
+    };
+
+    enum SignalingEvent
+    {
+        SignalingEventUnknown = 0,
+        // Peer messages.
+        SignalingEventOffer,
+        SignalingEventAnswer,
+        SignalingEventICE,
+        SignalingEventBye,
+        // Server messages.
+        SignalingEventRoomJoin,
+        SignalingEventRoomLeave,
+        SignalingEventRoomUsersUpdate
+    };
+
+    // What a peer can read, beyond what every client can. Peers list them as "features" in their offers and answers.
+    enum SignalingFeature
+    {
+        // An "iceCandidates" batch, as well as single "iceCandidate" messages.
+        SignalingFeatureCandidateBatches = 1 << 0
+    };
+
+    // The XirSys name for an event ("offer", "peer_connected", ...), or SignalingEventUnknown.
+    SignalingEvent SignalingEventForName(const SignalingText &name);
+    const char *SignalingEventName(SignalingEvent event);
+
+    struct SignalingCandidate
+    {
+        SignalingCandidate() : index(0) {}
+
+        SignalingText candidate;
+        SignalingText mid;
+        int32_t index;
+    };
+
+    // Everything we use from a signaling message. Fields which weren't present are empty.
+    struct SignalingMessage
+    {
+        SignalingMessage() : event(SignalingEventUnknown), features(0) {}
+
+        void Clear();
+
+        SignalingEvent event;
+        // As it was received, for events we don't know.
+        SignalingText eventName;
+
+        SignalingText senderId;
+        SignalingText targetId;
+        SignalingText room;
+        SignalingText connectionId;
+
+        // Offers and answers.
+        SignalingText sdp;
+        SignalingText sdpType;
+        // SignalingFeature flags. Names we don't know are ignored.
+        uint32_t features;
+
+        // ICE candidates. Sent as "iceCandidate" when there is one, and as an "iceCandidates" batch otherwise. Only
+        // peers with SignalingFeatureCandidateBatches should be sent a batch.
+        std::vector<SignalingCandidate> candidates;
+
+        // Room users updates. Users may be given as ids, or as objects with an "id".
+        std::vector<SignalingText> users;
+    };
+
+    /**
+     *  Decodes XirSys signaling frames straight into a SignalingMessage, without building a JSON object tree. The frame
+     *  is copied once into a buffer which is reused from frame to frame, strings are unescaped where they lie, and
+     *  anything we don't use is validated and skipped. Decoded text points into the buffer.
+     */
+    class SignalingDecoder
+    {
+    public:
+        SignalingDecoder() {}
+
+        // Returns false for anything which isn't a well formed JSON object in UTF-8, nested no deeper than we allow.
+        bool Decode(const char *frame, size_t size, SignalingMessage *message);
+
+    private:
+        SignalingDecoder(const SignalingDecoder &);
+        SignalingDecoder &operator=(const SignalingDecoder &);
+
+        std::vector<char> _buffer;
+    };
+
+    /**
+     *  Writes a peer message in the form XirSys relays, into a buffer which is reused from message to message.
+     *  Only the fields the message's event uses are written.
+     */
+    class SignalingEncoder
+    {
+    public:
+        SignalingEncoder() {}
+
+        // Valid until the next call.
+        const std::string &Encode(const SignalingMessage &message);
+
+    private:
+        SignalingEncoder(const SignalingEncoder &);
+        SignalingEncoder &operator=(const SignalingEncoder &);
+
+        void AppendCandidate(const SignalingCandidate &candidate);
+        void AppendKey(const char *key);
+        void AppendString(const SignalingText &text);
+
+        std::string _buffer;
+    };
+
+} // namespace perch
+
+#endif
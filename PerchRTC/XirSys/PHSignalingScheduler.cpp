@@ -0,0 +1,143 @@
+//
+//  PHSignalingScheduler.cpp
+//  PerchRTC
+//
+//  Created by Christopher Eagleston on 2015-08-08.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#include "PHSignalingScheduler.h"
+
+namespace perch {
+
+    SignalingScheduler::SignalingScheduler(size_t maxFrames, size_t maxBytes, size_t maxCoalescedBytes)
+    : _maxFrames(maxFrames), _maxBytes(maxBytes), _maxCoalescedBytes(maxCoalescedBytes), _frameCount(0), _byteCount(0)
+    {}
+
+    bool SignalingScheduler::Enqueue(uint64_t id, SignalingLane lane, const std::string &coalescingKey, size_t bytes,
+                                     int64_t nowMs, std::vector<uint64_t> *evicted)
+    {
+        while (_frameCount + 1 > _maxFrames || _byteCount + bytes > _maxBytes) {
+            if (!EvictBelow(lane, evicted)) {
+                _metrics[lane].dropped++;
+                return false;
+            }
+        }
+
+        QueuedFrame frame;
+        frame.id = id;
+        frame.coalescingKey = coalescingKey;
+        frame.bytes = bytes;
+        frame.queuedMs = nowMs;
+
+        std::deque<QueuedFrame> &queue = _lanes[lane];
+        queue.push_back(frame);
+
+        _frameCount++;
+        _byteCount += bytes;
+
+        if (queue.size() > _metrics[lane].maxDepth) {
+            _metrics[lane].maxDepth = queue.size();
+        }
+
+        return true;
+    }
+
+    void SignalingScheduler::Take(int64_t nowMs, size_t byteBudget, std::vector<SignalingBatch> *batches)
+    {
+        size_t taken = 0;
+
+        for (int lane = SignalingLaneControl; lane < SignalingLaneCount; lane++) {
+            std::deque<QueuedFrame> &queue = _lanes[lane];
+
+            while (!queue.empty() && (taken < byteBudget || taken == 0)) {
+                QueuedFrame first = queue.front();
+                queue.pop_front();
+
+                SignalingBatch batch;
+                batch.lane = (SignalingLane)lane;
+                batch.ids.push_back(first.id);
+
+                size_t batchBytes = first.bytes;
+                Record(batch.lane, first, nowMs);
+
+                // Later frames with the same key go out with the first, in the order they were queued.
+
+                if (!first.coalescingKey.empty()) {
+                    std::deque<QueuedFrame>::iterator frame = queue.begin();
+
+                    while (frame != queue.end() && batchBytes < _maxCoalescedBytes) {
+                        if (frame->coalescingKey != first.coalescingKey || batchBytes + frame->bytes > _maxCoalescedBytes) {
+                            ++frame;
+                            continue;
+                        }
+
+                        batch.ids.push_back(frame->id);
+                        batchBytes += frame->bytes;
+
+                        _metrics[lane].coalesced++;
+                        Record(batch.lane, *frame, nowMs);
+
+                        frame = queue.erase(frame);
+                    }
+                }
+
+                taken += batchBytes;
+                batches->push_back(batch);
+            }
+        }
+    }
+
+    void SignalingScheduler::Clear()
+    {
+        for (int lane = SignalingLaneControl; lane < SignalingLaneCount; lane++) {
+            _metrics[lane].dropped += _lanes[lane].size();
+            _lanes[lane].clear();
+        }
+
+        _frameCount = 0;
+        _byteCount = 0;
+    }
+
+    void SignalingScheduler::Record(SignalingLane lane, const QueuedFrame &frame, int64_t nowMs)
+    {
+        SignalingLaneMetrics &metrics = _metrics[lane];
+        int64_t latencyMs = nowMs > frame.queuedMs ? nowMs - frame.queuedMs : 0;
+
+        metrics.written++;
+        metrics.totalLatencyMs += latencyMs;
+
+        if (latencyMs > metrics.maxLatencyMs) {
+            metrics.maxLatencyMs = latencyMs;
+        }
+
+        _frameCount--;
+        _byteCount -= frame.bytes;
+    }
+
+    // Evicts the oldest frame of the least urgent lane which is less urgent than `lane`.
+    bool SignalingScheduler::EvictBelow(SignalingLane lane, std::vector<uint64_t> *evicted)
+    {
+        for (int victim = SignalingLaneCount - 1; victim > lane; victim--) {
+            std::deque<QueuedFrame> &queue = _lanes[victim];
+
+            if (queue.empty()) {
+                continue;
+            }
+
+            const QueuedFrame &frame = queue.front();
+
+            evicted->push_back(frame.id);
+            _metrics[victim].dropped++;
+            _frameCount--;
+            _byteCount -= frame.bytes;
+
+            queue.pop_front();
+
+            return true;
+        }
+
+        return false;
+    }
+
+} // namespace perch
@@ -0,0 +1,113 @@
+//
+//  PHSignalingScheduler.h
+//  PerchRTC
+//
+//  Created by Christopher Eagleston on 2015-08-08.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#ifndef PerchRTC_PHSignalingScheduler_h
+#define PerchRTC_PHSignalingScheduler_h
+
+#include <deque>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace perch {
+
+    // Most urgent first.
+    enum SignalingLane
+    {
+        SignalingLaneControl = 0,
+        SignalingLaneSessionDescription,
+        SignalingLaneICE,
+        SignalingLaneTelemetry,
+        SignalingLaneCount
+    };
+
+    struct SignalingLaneMetrics
+    {
+        SignalingLaneMetrics()
+        : written(0), coalesced(0), dropped(0), totalLatencyMs(0), maxLatencyMs(0), maxDepth(0)
+        {}
+
+        double MeanLatencyMs() const { return written ? (double)totalLatencyMs / written : 0; }
+
+        // Frames which went out, including those coalesced into another.
+        uint64_t written;
+        uint64_t coalesced;
+        // Frames evicted or refused because the queue was full, or cleared on disconnect.
+        uint64_t dropped;
+        // From being queued to being taken for writing.
+        int64_t totalLatencyMs;
+        int64_t maxLatencyMs;
+        size_t maxDepth;
+    };
+
+    // Frames to be written as one. The first frame carries the others.
+    struct SignalingBatch
+    {
+        SignalingLane lane;
+        std::vector<uint64_t> ids;
+    };
+
+    /**
+     *  Orders outbound signaling. Frames are queued by id in one of four lanes, and taken most urgent lane first, so a
+     *  bye isn't stuck behind a backlog of candidates. Frames in a lane which share a coalescing key (e.g. candidates
+     *  for one connection) are taken together with the first of them, up to maxCoalescedBytes.
+     *
+     *  The queue is bounded. When it's full, the oldest frames of less urgent lanes are evicted to make room. If there
+     *  are none, the new frame is refused.
+     *
+     *  The scheduler only holds ids and sizes, the caller keeps the frames and writes them.
+     */
+    class SignalingScheduler
+    {
+    public:
+        explicit SignalingScheduler(size_t maxFrames = 256, size_t maxBytes = 256 * 1024, size_t maxCoalescedBytes = 8 * 1024);
+
+        // Returns false if the frame was refused. The ids of frames evicted to make room are appended to `evicted`.
+        bool Enqueue(uint64_t id, SignalingLane lane, const std::string &coalescingKey, size_t bytes, int64_t nowMs,
+                     std::vector<uint64_t> *evicted);
+
+        // Takes batches, most urgent first, until at least `byteBudget` has been taken or the queue is empty.
+        void Take(int64_t nowMs, size_t byteBudget, std::vector<SignalingBatch> *batches);
+
+        // Drops every queued frame.
+        void Clear();
+
+        bool Empty() const { return _frameCount == 0; }
+        size_t FrameCount() const { return _frameCount; }
+        size_t ByteCount() const { return _byteCount; }
+
+        const SignalingLaneMetrics &Metrics(SignalingLane lane) const { return _metrics[lane]; }
+
+    private:
+        struct QueuedFrame
+        {
+            uint64_t id;
+            std::string coalescingKey;
+            size_t bytes;
+            int64_t queuedMs;
+        };
+
+        void Record(SignalingLane lane, const QueuedFrame &frame, int64_t nowMs);
+        bool EvictBelow(SignalingLane lane, std::vector<uint64_t> *evicted);
+
+        size_t _maxFrames;
+        size_t _maxBytes;
+        size_t _maxCoalescedBytes;
+        size_t _frameCount;
+        size_t _byteCount;
+        std::deque<QueuedFrame> _lanes[SignalingLaneCount];
+        SignalingLaneMetrics _metrics[SignalingLaneCount];
+
+        SignalingScheduler(const SignalingScheduler &);
+        SignalingScheduler &operator=(const SignalingScheduler &);
+    };
+
+} // namespace perch
+
+#endif
@@ -34,7 +34,40 @@ extern NSString * const kXSMessageEventBye;
 extern NSString * const kXSMessageOfferDataKey;
 extern NSString * const kXSMessageAnswerDataKey;
 extern NSString * const kXSMessageICECandidateDataKey;
+extern NSString * const kXSMessageICECandidatesDataKey;
 extern NSString * const kXSMessageByeDataKey;
+extern NSString * const kXSMessageFeaturesDataKey;
+
+// Feature names.
+
+extern NSString * const kXSMessageFeatureICECandidates;
+
+typedef NS_ENUM(NSUInteger, XSMessageEvent)
+{
+    XSMessageEventUnknown = 0,
+    // Peer messages.
+    XSMessageEventOffer,
+    XSMessageEventAnswer,
+    XSMessageEventICE,
+    XSMessageEventBye,
+    // Server messages.
+    XSMessageEventRoomJoin,
+    XSMessageEventRoomLeave,
+    XSMessageEventRoomUsersUpdate
+};
+
+/**
+ *  What a peer can read beyond what every client can. Advertised in offers and answers, and mirrors
+ *  perch::SignalingFeature.
+ */
+typedef NS_OPTIONS(NSUInteger, XSMessageFeatures)
+{
+    // Batches of candidates, in one kXSMessageICECandidatesDataKey message.
+    XSMessageFeatureICECandidates = 1 << 0
+};
+
+// What we advertise.
+extern XSMessageFeatures const XSMessageSupportedFeatures;
 
 
 @interface XSMessage : NSObject
@@ -45,10 +78,34 @@ extern NSString * const kXSMessageByeDataKey;
 @property (nonatomic, copy) NSString *room;
 @property (nonatomic, copy) NSDictionary *data;
 
+/**
+ *  The event named by `type`, or XSMessageEventUnknown.
+ */
+@property (nonatomic, assign) XSMessageEvent event;
+
+// Typed payload fields. Those which the event doesn't use are nil.
+
+@property (nonatomic, copy) NSString *connectionId;
+
+// Offers and answers.
+@property (nonatomic, copy) NSString *sessionDescription;
+@property (nonatomic, copy) NSString *sessionDescriptionType;
+
+// ICE candidates, as dictionaries with "candidate", "id" and "label" keys. A batch, or a single candidate.
+@property (nonatomic, copy) NSArray *iceCandidates;
+
+// The sender's features, from an offer or an answer.
+@property (nonatomic, assign) XSMessageFeatures features;
+
+// Room users updates, as user ids.
+@property (nonatomic, copy) NSArray *users;
+
 - (id)initWithJSON:(NSDictionary *)json;
 
 - (NSDictionary *)toDictionary;
 
++ (XSMessageEvent)eventForType:(NSString *)type;
+
 + (XSMessage *)messageWithEventType:(NSString *)eventType userId:(NSString *)targetUserId messageData:(NSDictionary *)messageData;
 
 + (XSMessage *)offerWithUserId:(NSString *)targetUserId connectionId:(NSString *)connectionId andData:(NSDictionary *)offerData;
@@ -57,6 +114,13 @@ extern NSString * const kXSMessageByeDataKey;
 
 + (XSMessage *)iceCredentialsWithUserId:(NSString *)targetUserId connectionId:(NSString *)connectionId andData:(NSDictionary *)iceData;
 
+/**
+ *  The messages which carry `iceCandidates` to a peer: one batch for a peer with XSMessageFeatureICECandidates, and
+ *  one message per candidate for any other.
+ */
++ (NSArray *)iceCandidatesWithUserId:(NSString *)targetUserId connectionId:(NSString *)connectionId andData:(NSArray *)iceCandidates
+                        peerFeatures:(XSMessageFeatures)peerFeatures;
+
 + (XSMessage *)byeWithUserId:(NSString *)targetUserId connectionId:(NSString *)connectionId andData:(NSDictionary *)byeData;
 
 @end
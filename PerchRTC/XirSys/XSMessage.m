@@ -46,7 +46,15 @@ NSString * const kXSMessageEventBye = @"bye";
 NSString * const kXSMessageOfferDataKey = @"offer";
 NSString * const kXSMessageAnswerDataKey = @"answer";
 NSString * const kXSMessageICECandidateDataKey = @"iceCandidate";
+NSString * const kXSMessageICECandidatesDataKey = @"iceCandidates";
 NSString * const kXSMessageByeDataKey = @"bye";
+NSString * const kXSMessageFeaturesDataKey = @"features";
+
+// Feature names.
+
+NSString * const kXSMessageFeatureICECandidates = @"iceCandidates";
+
+XSMessageFeatures const XSMessageSupportedFeatures = XSMessageFeatureICECandidates;
 
 @implementation XSMessage
 
@@ -66,6 +74,19 @@ NSString * const kXSMessageByeDataKey = @"bye";
         if (!_type) {
             _type = json[kXSMessageEventName];
         }
+
+        _event = [[self class] eventForType:_type];
+
+        // Peer payloads arrive wrapped in "data", but are built unwrapped.
+
+        NSDictionary *payload = _data[kXSMessagePeerDataKey];
+
+        if (![payload isKindOfClass:[NSDictionary class]]) {
+            payload = _data;
+        }
+        if ([payload isKindOfClass:[NSDictionary class]]) {
+            [self readPayload:payload];
+        }
     }
 
     return self;
@@ -89,7 +110,8 @@ NSString * const kXSMessageByeDataKey = @"bye";
 + (XSMessage *)offerWithUserId:(NSString *)targetUserId connectionId:(NSString *)connectionId andData:(NSDictionary *)offerData
 {
     NSDictionary *messageData = @{kXSMessageConnectionIdKey : connectionId,
-                                  kXSMessageOfferDataKey : offerData};
+                                  kXSMessageOfferDataKey : offerData,
+                                  kXSMessageFeaturesDataKey : [self namesForFeatures:XSMessageSupportedFeatures]};
 
     return [XSMessage messageWithEventType:kXSMessageEventOffer userId:targetUserId messageData:messageData];
 }
@@ -97,7 +119,8 @@ NSString * const kXSMessageByeDataKey = @"bye";
 + (XSMessage *)answerWithUserId:(NSString *)targetUserId connectionId:(NSString *)connectionId andData:(NSDictionary *)answerData
 {
     NSDictionary *messageData = @{kXSMessageConnectionIdKey : connectionId,
-                                  kXSMessageAnswerDataKey : answerData};
+                                  kXSMessageAnswerDataKey : answerData,
+                                  kXSMessageFeaturesDataKey : [self namesForFeatures:XSMessageSupportedFeatures]};
 
     return [XSMessage messageWithEventType:kXSMessageEventAnswer userId:targetUserId messageData:messageData];
 }
@@ -110,6 +133,27 @@ NSString * const kXSMessageByeDataKey = @"bye";
     return [XSMessage messageWithEventType:kXSMessageEventICE userId:targetUserId messageData:messageData];
 }
 
++ (NSArray *)iceCandidatesWithUserId:(NSString *)targetUserId connectionId:(NSString *)connectionId andData:(NSArray *)iceCandidates
+                        peerFeatures:(XSMessageFeatures)peerFeatures
+{
+    // Older clients only read kXSMessageICECandidateDataKey, and would drop a batch without a word.
+
+    if ([iceCandidates count] == 1 || !(peerFeatures & XSMessageFeatureICECandidates)) {
+        NSMutableArray *messages = [NSMutableArray arrayWithCapacity:[iceCandidates count]];
+
+        for (NSDictionary *iceCandidate in iceCandidates) {
+            [messages addObject:[XSMessage iceCredentialsWithUserId:targetUserId connectionId:connectionId andData:iceCandidate]];
+        }
+
+        return messages;
+    }
+
+    NSDictionary *messageData = @{kXSMessageConnectionIdKey : connectionId,
+                                  kXSMessageICECandidatesDataKey : iceCandidates};
+
+    return @[[XSMessage messageWithEventType:kXSMessageEventICE userId:targetUserId messageData:messageData]];
+}
+
 + (XSMessage *)byeWithUserId:(NSString *)targetUserId connectionId:(NSString *)connectionId andData:(NSDictionary *)byeData
 {
     NSDictionary *messageData = @{kXSMessageConnectionIdKey : connectionId,
@@ -118,8 +162,78 @@ NSString * const kXSMessageByeDataKey = @"bye";
     return [XSMessage messageWithEventType:kXSMessageEventBye userId:targetUserId messageData:messageData];
 }
 
+#pragma mark - Private
+
+- (void)readPayload:(NSDictionary *)payload
+{
+    _connectionId = payload[kXSMessageConnectionIdKey];
+
+    NSDictionary *description = payload[kXSMessageOfferDataKey] ?: payload[kXSMessageAnswerDataKey];
+    NSDictionary *candidate = payload[kXSMessageICECandidateDataKey];
+    NSArray *candidates = payload[kXSMessageICECandidatesDataKey];
+    NSArray *users = payload[kXSMessageRoomUsersUpdateDataKey];
+    NSArray *features = payload[kXSMessageFeaturesDataKey];
+
+    if ([description isKindOfClass:[NSDictionary class]]) {
+        _sessionDescription = description[@"sdp"];
+        _sessionDescriptionType = description[@"type"];
+    }
+
+    if ([candidate isKindOfClass:[NSDictionary class]]) {
+        _iceCandidates = @[candidate];
+    }
+    else if ([candidates isKindOfClass:[NSArray class]]) {
+        NSIndexSet *indexes = [candidates indexesOfObjectsPassingTest:^BOOL(id object, NSUInteger idx, BOOL *stop) {
+            return [object isKindOfClass:[NSDictionary class]];
+        }];
+
+        _iceCandidates = [candidates objectsAtIndexes:indexes];
+    }
+
+    if ([features isKindOfClass:[NSArray class]] && [features containsObject:kXSMessageFeatureICECandidates]) {
+        _features |= XSMessageFeatureICECandidates;
+    }
+
+    if ([users isKindOfClass:[NSArray class]]) {
+        NSMutableArray *userIds = [NSMutableArray arrayWithCapacity:[users count]];
+
+        for (id user in users) {
+            id userId = [user isKindOfClass:[NSDictionary class]] ? user[@"id"] : user;
+
+            if ([userId isKindOfClass:[NSString class]]) {
+                [userIds addObject:userId];
+            }
+        }
+
+        _users = userIds;
+    }
+}
+
++ (NSArray *)namesForFeatures:(XSMessageFeatures)features
+{
+    return (features & XSMessageFeatureICECandidates) ? @[kXSMessageFeatureICECandidates] : @[];
+}
+
 #pragma mark - Public
 
++ (XSMessageEvent)eventForType:(NSString *)type
+{
+    static NSDictionary *events = nil;
+    static dispatch_once_t onceToken;
+
+    dispatch_once(&onceToken, ^{
+        events = @{ kXSMessageEventOffer : @(XSMessageEventOffer),
+                    kXSMessageEventAnswer : @(XSMessageEventAnswer),
+                    kXSMessageEventICE : @(XSMessageEventICE),
+                    kXSMessageEventBye : @(XSMessageEventBye),
+                    kXSMessageRoomJoin : @(XSMessageEventRoomJoin),
+                    kXSMessageRoomLeave : @(XSMessageEventRoomLeave),
+                    kXSMessageRoomUsersUpdate : @(XSMessageEventRoomUsersUpdate) };
+    });
+
+    return type ? (XSMessageEvent)[events[type] unsignedIntegerValue] : XSMessageEventUnknown;
+}
+
 - (NSDictionary *)toDictionary
 {
     return @{ kXSMessageEventName : self.type,
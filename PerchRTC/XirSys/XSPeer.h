@@ -8,11 +8,18 @@
 
 #import <Foundation/Foundation.h>
 
+#import "XSMessage.h"
+
 @interface XSPeer : NSObject
 
 @property (nonatomic, copy) NSString *identifier;
 @property (nonatomic, copy) NSString *connectionId;
 
+/**
+ *  What the peer told us it can read, in its last offer or answer. None until then.
+ */
+@property (nonatomic, assign) XSMessageFeatures features;
+
 - (id)initWithId:(NSString *)userId;
 
 - (id)initWithJSON:(NSDictionary *)json;
@@ -66,6 +66,12 @@ typedef NS_ENUM(NSUInteger, XSPeerConnectionState)
  */
 - (void)disconnect;
 
+/**
+ *  Drops the socket without the closing handshake, which can't complete once the network it was opened on is gone.
+ *  The delegate is told the client disconnected, as it would be had the socket failed.
+ */
+- (void)abandonConnection;
+
 /**
  *  Sends a message to the room.
  *
@@ -0,0 +1,601 @@
+//
+//  XSPeerClient.m
+//  PerchRTC
+//
+//  Created by Christopher Eagleston on 2014-09-27.
+//  Copyright (c) 2014 Perch Communications. All rights reserved.
+//
+
+#import "XSPeerClient.h"
+
+#import "XSMessage.h"
+#import "XSPeer.h"
+#import "XSRoom.h"
+
+#import <SocketRocket/SRWebSocket.h>
+
+#include "PHSignalingCodec.h"
+#include "PHSignalingScheduler.h"
+
+static_assert((int)XSMessageEventRoomUsersUpdate == (int)perch::SignalingEventRoomUsersUpdate,
+              "XSMessageEvent must mirror perch::SignalingEvent.");
+static_assert((int)XSMessageFeatureICECandidates == (int)perch::SignalingFeatureCandidateBatches,
+              "XSMessageFeatures must mirror perch::SignalingFeature.");
+
+/**
+ *  XirSys requires a keepalive for presence. The timing constant is taken from their Rails Demo.
+ */
+static NSTimeInterval kXSPeerClientKeepaliveInterval = 20.0;
+
+/**
+ *  Outbound messages are written this many bytes at a time, one run loop turn apart, so that urgent messages sent in
+ *  the meantime can go ahead of the rest.
+ */
+static size_t kXSPeerClientWriteBudget = 16 * 1024;
+
+// Rough framing overhead of a peer message, used to size messages before they are encoded.
+static NSUInteger kXSPeerClientMessageOverhead = 160;
+
+static int64_t XSPeerClientNowMs()
+{
+    return (int64_t)([[NSProcessInfo processInfo] systemUptime] * 1000);
+}
+
+@interface XSPeerClient() <SRWebSocketDelegate>
+{
+    perch::SignalingDecoder _decoder;
+    perch::SignalingEncoder _encoder;
+    perch::SignalingMessage _decodedMessage;
+    perch::SignalingScheduler _outboundScheduler;
+}
+
+@property (nonatomic, strong) dispatch_queue_t processingQueue;
+@property (nonatomic, strong) SRWebSocket *negotiationSocket;
+@property (nonatomic, strong) NSTimer *presenceKeepAliveTimer;
+@property (nonatomic, strong) XSRoom *room;
+@property (nonatomic, assign) XSPeerConnectionState connectionState;
+
+// Messages waiting in the outbound scheduler, keyed by their id.
+@property (nonatomic, strong) NSMutableDictionary *outboundMessages;
+@property (nonatomic, assign) uint64_t nextOutboundId;
+@property (nonatomic, assign) BOOL outboundWriteScheduled;
+
+@end
+
+@implementation XSPeerClient
+
+#pragma mark - Initialize & Dealloc
+
+- (instancetype)initWithRoom:(XSRoom *)room andDelegate:(id<XSPeerClientDelegate>)delegate
+{
+    self = [super init];
+
+    if (self) {
+        _delegate = delegate;
+        _room = room;
+        _processingQueue = dispatch_get_main_queue();
+        _connectionState = XSPeerConnectionStateDisconnected;
+        _outboundMessages = [NSMutableDictionary dictionary];
+
+        // TODO: Background processing.
+//        _processingQueue = dispatch_queue_create("com.xirsys.websocket.processing", DISPATCH_QUEUE_SERIAL);
+    }
+
+    return self;
+}
+
+- (void)dealloc
+{
+    [self cleanupConnection];
+}
+
+#pragma mark - NSObject
+
++ (BOOL)automaticallyNotifiesObserversForKey:(NSString *)key
+{
+    if ([key isEqualToString:@"connectionState"]) {
+        return NO;
+    }
+
+    return [super automaticallyNotifiesObserversForKey:key];
+}
+
+#pragma mark - Properties
+
+- (NSDictionary *)roomPeers
+{
+    return self.room.peers;
+}
+
+- (void)setConnectionState:(XSPeerConnectionState)connectionState
+{
+    if (_connectionState != connectionState) {
+        [self willChangeValueForKey:@"connectionState"];
+        _connectionState = connectionState;
+        [self didChangeValueForKey:@"connectionState"];
+    }
+}
+
+#pragma mark - Public
+
+- (void)connect
+{
+    [self connectToRoom:self.room];
+}
+
+- (void)connectToRoom:(XSRoom *)room
+{
+    NSParameterAssert(room);
+
+    if (self.room && self.room != room) {
+        DDLogError(@"We are already connected to a room.");
+        return;
+    }
+
+    NSURL *url = room.serverURL;
+
+    DDLogInfo(@"Opening socket to: %@ with room: %@", url, room);
+
+    NSString *token = room.authToken;
+    NSString *escapedToken = [token stringByAddingPercentEscapesUsingEncoding:NSUTF8StringEncoding];
+    NSURL *authorizedURL = [url URLByAppendingPathComponent:[NSString stringWithFormat:@"/%@", escapedToken]];
+    NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL:authorizedURL];
+
+    SRWebSocket *socket = [[SRWebSocket alloc] initWithURLRequest:request];
+    [socket setDelegateDispatchQueue:self.processingQueue];
+    socket.delegate = self;
+
+    self.negotiationSocket = socket;
+    self.room = room;
+
+    [socket open];
+
+    self.connectionState = (XSPeerConnectionState)socket.readyState;
+
+    [self addNotificationObservers];
+}
+
+- (void)disconnect
+{
+    [self removeNotificationObservers];
+
+    if (self.connectionState != XSPeerConnectionStateDisconnected) {
+        [self.negotiationSocket close];
+        self.connectionState = XSPeerConnectionStateDisconnecting;
+    }
+    else {
+        [self cleanupConnection];
+    }
+}
+
+- (void)abandonConnection
+{
+    if (self.connectionState == XSPeerConnectionStateDisconnected) {
+        return;
+    }
+
+    DDLogInfo(@"Abandoning socket to: %@", self.room.serverURL);
+
+    [self removeNotificationObservers];
+
+    SRWebSocket *socket = self.negotiationSocket;
+    [self cleanupConnection];
+    [socket close];
+
+    [self.delegate clientDidDisconnect:self];
+}
+
+- (void)sendMessage:(XSMessage *)message
+{
+    NSParameterAssert(message);
+
+    message.room = self.room.name;
+    message.senderId = self.room.localPeer.identifier;
+
+    if (self.connectionState == XSPeerConnectionStateDisconnected || self.connectionState == XSPeerConnectionStateDisconnecting) {
+        DDLogWarn(@"Socket is not ready to send a message!");
+        return;
+    }
+
+    // Messages sent while the socket is opening wait for it.
+
+    uint64_t messageId = self.nextOutboundId++;
+    perch::SignalingLane lane = [[self class] laneForMessage:message];
+    std::string coalescingKey;
+
+    // Candidates are only merged into a batch for peers which can read one.
+
+    XSPeer *target = message.targetId ? self.room.peers[message.targetId] : nil;
+
+    if (lane == perch::SignalingLaneICE && message.connectionId && (target.features & XSMessageFeatureICECandidates)) {
+        coalescingKey = [[NSString stringWithFormat:@"%@/%@", message.targetId, message.connectionId] UTF8String];
+    }
+
+    std::vector<uint64_t> evicted;
+    BOOL isQueued = _outboundScheduler.Enqueue(messageId, lane, coalescingKey, [[self class] estimatedSizeOfMessage:message],
+                                               XSPeerClientNowMs(), &evicted);
+
+    for (size_t i = 0; i < evicted.size(); i++) {
+        DDLogWarn(@"Outbound queue is full, dropping: %@", self.outboundMessages[@(evicted[i])]);
+        [self.outboundMessages removeObjectForKey:@(evicted[i])];
+    }
+
+    if (!isQueued) {
+        DDLogWarn(@"Outbound queue is full, dropping: %@", message);
+        return;
+    }
+
+    self.outboundMessages[@(messageId)] = message;
+
+    [self scheduleOutboundWrite];
+}
+
+#pragma mark - Private
+
+static NSString *XSStringFromText(const perch::SignalingText &text)
+{
+    if (text.Empty()) {
+        return nil;
+    }
+
+    return [[NSString alloc] initWithBytes:text.data length:text.size encoding:NSUTF8StringEncoding];
+}
+
+static perch::SignalingText XSTextFromString(NSString *string)
+{
+    return perch::SignalingText([string UTF8String]);
+}
+
+- (XSMessage *)decodeMessage:(const char *)bytes length:(NSUInteger)length
+{
+    perch::SignalingMessage &decoded = _decodedMessage;
+
+    if (!_decoder.Decode(bytes, length, &decoded)) {
+        return nil;
+    }
+
+    // The decoder only reads the fields of events we know. Anything else keeps its whole payload in `data`.
+
+    if (decoded.event == perch::SignalingEventUnknown) {
+        return [self decodeUnknownMessage:bytes length:length];
+    }
+
+    XSMessage *message = [[XSMessage alloc] init];
+    message.event = (XSMessageEvent)decoded.event;
+    message.type = XSStringFromText(decoded.eventName);
+    message.senderId = XSStringFromText(decoded.senderId);
+    message.room = XSStringFromText(decoded.room);
+    message.connectionId = XSStringFromText(decoded.connectionId);
+
+    switch (decoded.event) {
+        case perch::SignalingEventOffer:
+        case perch::SignalingEventAnswer:
+            message.sessionDescription = XSStringFromText(decoded.sdp);
+            message.sessionDescriptionType = XSStringFromText(decoded.sdpType);
+            message.features = (XSMessageFeatures)decoded.features;
+            break;
+        case perch::SignalingEventICE: {
+            NSMutableArray *candidates = [NSMutableArray arrayWithCapacity:decoded.candidates.size()];
+
+            for (size_t i = 0; i < decoded.candidates.size(); i++) {
+                const perch::SignalingCandidate &candidate = decoded.candidates[i];
+                NSString *sdp = XSStringFromText(candidate.candidate);
+
+                if (sdp) {
+                    [candidates addObject:@{ @"candidate" : sdp,
+                                             @"id" : XSStringFromText(candidate.mid) ?: @"",
+                                             @"label" : @(candidate.index) }];
+                }
+            }
+
+            message.iceCandidates = candidates;
+            break;
+        }
+        case perch::SignalingEventRoomUsersUpdate: {
+            NSMutableArray *users = [NSMutableArray arrayWithCapacity:decoded.users.size()];
+
+            for (size_t i = 0; i < decoded.users.size(); i++) {
+                NSString *user = XSStringFromText(decoded.users[i]);
+
+                if (user) {
+                    [users addObject:user];
+                }
+            }
+
+            message.users = users;
+            break;
+        }
+        default:
+            break;
+    }
+
+    return message;
+}
+
+- (XSMessage *)decodeUnknownMessage:(const char *)bytes length:(NSUInteger)length
+{
+    NSData *data = [NSData dataWithBytesNoCopy:(void *)bytes length:length freeWhenDone:NO];
+    NSError *jsonError = nil;
+    id json = [NSJSONSerialization JSONObjectWithData:data options:0 error:&jsonError];
+
+    if (![json isKindOfClass:[NSDictionary class]]) {
+        DDLogError(@"Couldn't decode message error: %@", jsonError);
+        return nil;
+    }
+
+    return [[XSMessage alloc] initWithJSON:json];
+}
+
+- (NSString *)encodeMessage:(XSMessage *)message
+{
+    BOOL isPeerMessage = message.event != XSMessageEventUnknown && message.event < XSMessageEventRoomJoin;
+
+    if (!isPeerMessage || !message.targetId || !message.connectionId) {
+        NSError *jsonError = nil;
+        NSData *data = [NSJSONSerialization dataWithJSONObject:[message toDictionary] options:0 error:&jsonError];
+
+        if (jsonError) {
+            DDLogError(@"Couldn't encode message: %@ error: %@", message, jsonError);
+            return nil;
+        }
+
+        return [[NSString alloc] initWithData:data encoding:NSUTF8StringEncoding];
+    }
+
+    perch::SignalingMessage outgoing;
+    outgoing.event = (perch::SignalingEvent)message.event;
+    outgoing.targetId = XSTextFromString(message.targetId);
+    outgoing.connectionId = XSTextFromString(message.connectionId);
+    outgoing.sdp = XSTextFromString(message.sessionDescription);
+    outgoing.sdpType = XSTextFromString(message.sessionDescriptionType);
+    outgoing.features = (uint32_t)message.features;
+
+    for (NSDictionary *candidate in message.iceCandidates) {
+        perch::SignalingCandidate outgoingCandidate;
+        outgoingCandidate.candidate = XSTextFromString(candidate[@"candidate"]);
+        outgoingCandidate.mid = XSTextFromString(candidate[@"id"]);
+        outgoingCandidate.index = (int32_t)[candidate[@"label"] integerValue];
+        outgoing.candidates.push_back(outgoingCandidate);
+    }
+
+    const std::string &frame = _encoder.Encode(outgoing);
+
+    return [[NSString alloc] initWithBytes:frame.data() length:frame.size() encoding:NSUTF8StringEncoding];
+}
+
++ (perch::SignalingLane)laneForMessage:(XSMessage *)message
+{
+    switch (message.event) {
+        case XSMessageEventBye:
+            return perch::SignalingLaneControl;
+        case XSMessageEventOffer:
+        case XSMessageEventAnswer:
+            return perch::SignalingLaneSessionDescription;
+        case XSMessageEventICE:
+            return perch::SignalingLaneICE;
+        default:
+            return perch::SignalingLaneTelemetry;
+    }
+}
+
++ (size_t)estimatedSizeOfMessage:(XSMessage *)message
+{
+    NSUInteger size = kXSPeerClientMessageOverhead + [message.sessionDescription length];
+
+    for (NSDictionary *candidate in message.iceCandidates) {
+        size += [candidate[@"candidate"] length] + [candidate[@"id"] length] + kXSPeerClientMessageOverhead / 4;
+    }
+
+    return size;
+}
+
+- (void)scheduleOutboundWrite
+{
+    if (self.outboundWriteScheduled || self.connectionState != XSPeerConnectionStateConnected || _outboundScheduler.Empty()) {
+        return;
+    }
+
+    self.outboundWriteScheduled = YES;
+
+    __weak XSPeerClient *weakSelf = self;
+
+    dispatch_async(dispatch_get_main_queue(), ^{
+        XSPeerClient *strongSelf = weakSelf;
+
+        strongSelf.outboundWriteScheduled = NO;
+        [strongSelf writeOutboundMessages];
+    });
+}
+
+- (void)writeOutboundMessages
+{
+    if (self.connectionState != XSPeerConnectionStateConnected) {
+        return;
+    }
+
+    std::vector<perch::SignalingBatch> batches;
+    _outboundScheduler.Take(XSPeerClientNowMs(), kXSPeerClientWriteBudget, &batches);
+
+    for (size_t i = 0; i < batches.size(); i++) {
+        const perch::SignalingBatch &batch = batches[i];
+        XSMessage *message = self.outboundMessages[@(batch.ids[0])];
+
+        // Coalesced candidates go out in the first message.
+
+        if (batch.ids.size() > 1) {
+            NSMutableArray *candidates = [NSMutableArray arrayWithArray:message.iceCandidates];
+
+            for (size_t j = 1; j < batch.ids.size(); j++) {
+                XSMessage *coalescedMessage = self.outboundMessages[@(batch.ids[j])];
+                [candidates addObjectsFromArray:coalescedMessage.iceCandidates];
+            }
+
+            message.iceCandidates = candidates;
+        }
+
+        for (size_t j = 0; j < batch.ids.size(); j++) {
+            [self.outboundMessages removeObjectForKey:@(batch.ids[j])];
+        }
+
+        NSString *jsonString = [self encodeMessage:message];
+
+        if (jsonString) {
+            DDLogVerbose(@"Send message: %@", message);
+
+            // XirSys expects text frames only for peer messages.
+
+            [self.negotiationSocket send:jsonString];
+        }
+    }
+
+    [self scheduleOutboundWrite];
+}
+
+- (void)logOutboundMetrics
+{
+    static NSString * const laneNames[perch::SignalingLaneCount] = { @"control", @"sdp", @"ice", @"telemetry" };
+
+    for (int lane = perch::SignalingLaneControl; lane < perch::SignalingLaneCount; lane++) {
+        const perch::SignalingLaneMetrics &metrics = _outboundScheduler.Metrics((perch::SignalingLane)lane);
+
+        if (metrics.written == 0 && metrics.dropped == 0) {
+            continue;
+        }
+
+        DDLogInfo(@"Outbound %@: %llu written (%llu coalesced), %llu dropped, latency mean %.1f ms max %lld ms, depth %lu.",
+                  laneNames[lane], metrics.written, metrics.coalesced, metrics.dropped, metrics.MeanLatencyMs(),
+                  metrics.maxLatencyMs, (unsigned long)metrics.maxDepth);
+    }
+}
+
+- (void)scheduleTimer
+{
+    [self invalidateTimer];
+
+    NSTimer *timer = [NSTimer timerWithTimeInterval:kXSPeerClientKeepaliveInterval target:self selector:@selector(handleTimer:) userInfo:nil repeats:NO];
+
+    [[NSRunLoop mainRunLoop] addTimer:timer forMode:NSRunLoopCommonModes];
+
+    self.presenceKeepAliveTimer = timer;
+}
+
+- (void)invalidateTimer
+{
+    [self.presenceKeepAliveTimer invalidate];
+    self.presenceKeepAliveTimer = nil;
+}
+
+- (void)handleTimer:(NSTimer *)timer
+{
+    [self sendPing];
+
+    [self scheduleTimer];
+}
+
+- (void)sendPing
+{
+    [self.negotiationSocket sendPing:nil];
+}
+
+- (void)applicationWillEnterForeground
+{
+    // TODO: @chris Reopen the socket here?
+}
+
+- (void)applicationDidEnterBackground
+{
+    // TODO: @chris Cleanup socket resources here?
+}
+
+- (void)cleanupConnection
+{
+    [self.room clearAuthorizationToken];
+
+    // What's left was meant for this session's peers.
+
+    _outboundScheduler.Clear();
+    [self.outboundMessages removeAllObjects];
+    [self logOutboundMetrics];
+
+    self.negotiationSocket.delegate = nil;
+    self.negotiationSocket = nil;
+    self.connectionState = XSPeerConnectionStateDisconnected;
+
+    [self invalidateTimer];
+}
+
+- (void)addNotificationObservers
+{
+    NSNotificationCenter *center = [NSNotificationCenter defaultCenter];
+
+    [center addObserver:self selector:@selector(applicationWillEnterForeground) name:UIApplicationWillEnterForegroundNotification object:nil];
+    [center addObserver:self selector:@selector(applicationDidEnterBackground) name:UIApplicationDidEnterBackgroundNotification object:nil];
+}
+
+- (void)removeNotificationObservers
+{
+    NSNotificationCenter *center = [NSNotificationCenter defaultCenter];
+
+    [center removeObserver:self name:UIApplicationWillEnterForegroundNotification object:nil];
+    [center removeObserver:self name:UIApplicationDidEnterBackgroundNotification object:nil];
+}
+
+#pragma mark - SRWebSocketDelegate
+
+- (void)webSocketDidOpen:(SRWebSocket *)webSocket
+{
+    self.connectionState = XSPeerConnectionStateConnected;
+
+    [self.delegate clientDidConnect:self];
+
+    [self scheduleTimer];
+    [self scheduleOutboundWrite];
+}
+
+- (void)webSocket:(SRWebSocket *)webSocket didReceiveMessage:(id)messageData
+{
+    XSMessage *message = nil;
+
+    // Frames are decoded straight from their bytes. Text frames are usually backed by UTF-8 already.
+
+    if ([messageData isKindOfClass:[NSData class]]) {
+        NSData *data = (NSData *)messageData;
+        message = [self decodeMessage:(const char *)[data bytes] length:[data length]];
+    }
+    else if ([messageData isKindOfClass:[NSString class]]) {
+        const char *bytes = [(NSString *)messageData UTF8String];
+        message = bytes ? [self decodeMessage:bytes length:strlen(bytes)] : nil;
+    }
+    else {
+        DDLogWarn(@"Unknown message format: %@", messageData);
+    }
+
+    if (!message) {
+        DDLogWarn(@"Discarding malformed message.");
+        return;
+    }
+
+    message.targetId = self.room.localPeer.identifier;
+
+    DDLogVerbose(@"WebSocket: did receive message: %@", message);
+
+    [self.room processMessage:message];
+}
+
+- (void)webSocket:(SRWebSocket *)webSocket didFailWithError:(NSError *)error
+{
+    [self cleanupConnection];
+
+    [self.delegate client:self didEncounterError:error];
+
+    [self.delegate clientDidDisconnect:self];
+}
+
+- (void)webSocket:(SRWebSocket *)webSocket didCloseWithCode:(NSInteger)code reason:(NSString *)reason wasClean:(BOOL)wasClean
+{
+    [self cleanupConnection];
+
+    [self.delegate clientDidDisconnect:self];
+}
+
+@end
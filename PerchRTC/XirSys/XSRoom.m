@@ -143,64 +143,57 @@
 {
     BOOL handled = YES;
 
-    NSString *type = message.type;
-
-    if ([type isEqualToString:kXSMessageRoomJoin]) {
-        NSString *userId = message.senderId;
-        if ([userId isKindOfClass:[NSString class]]) {
-            XSPeer *peer = [[XSPeer alloc] initWithId:(NSString *)userId];
-
-            if (![peer isEqual:self.localPeer]) {
-                self.mutableRoomPeers[peer.identifier] = peer;
-                [self informObserverPeerAdded:peer];
-            }
-            else {
-                // TODO: Grab room key for future message sends.
+    switch (message.event) {
+        case XSMessageEventRoomJoin: {
+            NSString *userId = message.senderId;
+            if ([userId isKindOfClass:[NSString class]]) {
+                XSPeer *peer = [[XSPeer alloc] initWithId:userId];
+
+                if (![peer isEqual:self.localPeer]) {
+                    self.mutableRoomPeers[peer.identifier] = peer;
+                    [self informObserverPeerAdded:peer];
+                }
+                else {
+                    // TODO: Grab room key for future message sends.
+                }
             }
+            break;
         }
-    }
-    else if ([type isEqualToString:kXSMessageRoomLeave]) {
-        NSString *userId = message.senderId;
-        if ([userId isKindOfClass:[NSString class]]) {
-            XSPeer *peerToRemove = self.mutableRoomPeers[userId];
-
-            if (peerToRemove) {
-                [self.mutableRoomPeers removeObjectForKey:userId];
-                [self informObserverPeerLost:peerToRemove];
-            }
-            else {
-                DDLogWarn(@"No peer to remove for message: %@", message);
+        case XSMessageEventRoomLeave: {
+            NSString *userId = message.senderId;
+            if ([userId isKindOfClass:[NSString class]]) {
+                XSPeer *peerToRemove = self.mutableRoomPeers[userId];
+
+                if (peerToRemove) {
+                    [self.mutableRoomPeers removeObjectForKey:userId];
+                    [self informObserverPeerLost:peerToRemove];
+                }
+                else {
+                    DDLogWarn(@"No peer to remove for message: %@", message);
+                }
             }
+            break;
         }
-    }
-    else if ([type isEqualToString:kXSMessageRoomUsersUpdate]) {
-        NSArray *users = message.data[kXSMessageRoomUsersUpdateDataKey];
-
-        // Create XSPeers
-        for (NSDictionary *peerDictionary in users) {
-
-            XSPeer *peer = nil;
-
-            if ([peerDictionary isKindOfClass:[NSDictionary class]]) {
-                peer = [[XSPeer alloc] initWithJSON:peerDictionary];
-            }
-            else if ([peerDictionary isKindOfClass:[NSString class]]) {
-                peer = [[XSPeer alloc] initWithId:(NSString *)peerDictionary];
+        case XSMessageEventRoomUsersUpdate: {
+            // Create XSPeers
+            for (NSString *userId in message.users) {
+                XSPeer *peer = [[XSPeer alloc] initWithId:userId];
+
+                if (![peer isEqual:self.localPeer]) {
+                    self.mutableRoomPeers[peer.identifier] = peer;
+                }
             }
 
-            if (![peer isEqual:self.localPeer]) {
-                self.mutableRoomPeers[peer.identifier] = peer;
-            }
-        }
-
-        self.joined = YES;
+            self.joined = YES;
 
-        [self informObserverJoined];
-    }
-    else {
-        handled = NO;
+            [self informObserverJoined];
+            break;
+        }
+        default:
+            handled = NO;
+            break;
     }
-    
+
     return handled;
 }
 
@@ -208,6 +201,13 @@
 
 - (BOOL)processMessage:(XSMessage *)message
 {
+    // Peers advertise their features with each session description.
+
+    if (message.event == XSMessageEventOffer || message.event == XSMessageEventAnswer) {
+        XSPeer *sender = message.senderId ? self.mutableRoomPeers[message.senderId] : nil;
+        sender.features = message.features;
+    }
+
     BOOL processed = [self handleServerMessage:message];
 
     if (!processed) {
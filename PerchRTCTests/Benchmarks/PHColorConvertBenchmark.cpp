@@ -0,0 +1,70 @@
+//
+//  PHColorConvertBenchmark.cpp
+//  PerchRTCTests
+//
+//  Created by Christopher Eagleston on 2015-08-11.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#include "PHColorConvert.h"
+
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+namespace {
+
+    // The cost of one frame, at the sizes the renderers see most.
+
+    void BM_ConvertFrame(benchmark::State &state, bool isNV12)
+    {
+        PHConvertKernel kernel = (PHConvertKernel)state.range(0);
+
+        if (!PHConvertSelectKernel(kernel)) {
+            state.SkipWithError("Unsupported kernel");
+            return;
+        }
+
+        int width = (int)state.range(1);
+        int height = (int)state.range(2);
+        int chromaWidth = (width + 1) / 2;
+        int chromaHeight = (height + 1) / 2;
+
+        std::vector<uint8_t> y(width * height, 120);
+        std::vector<uint8_t> u(chromaWidth * chromaHeight, 90);
+        std::vector<uint8_t> v(chromaWidth * chromaHeight, 160);
+        std::vector<uint8_t> uv(2 * chromaWidth * chromaHeight, 128);
+        std::vector<uint8_t> bgra(4 * width * height);
+
+        for (auto _ : state) {
+            if (isNV12) {
+                PHConvertNV12ToRGB(y.data(), width, uv.data(), 2 * chromaWidth, bgra.data(), 4 * width,
+                                   width, height, PHColorMatrixBT601VideoRange, PHRGBLayoutBGRA);
+            }
+            else {
+                PHConvertI420ToRGB(y.data(), width, u.data(), chromaWidth, v.data(), chromaWidth, bgra.data(), 4 * width,
+                                   width, height, PHColorMatrixBT601VideoRange, PHRGBLayoutBGRA);
+            }
+
+            benchmark::DoNotOptimize(bgra.data());
+        }
+
+        state.counters["frames/s"] = benchmark::Counter((double)state.iterations(), benchmark::Counter::kIsRate);
+
+        PHConvertSelectKernel(PHConvertKernelAutomatic);
+    }
+
+    void FrameArguments(benchmark::internal::Benchmark *benchmark)
+    {
+        for (int kernel = PHConvertKernelScalar; kernel <= PHConvertKernelAVX2; kernel++) {
+            benchmark->Args({ kernel, 640, 480 });
+            benchmark->Args({ kernel, 1280, 720 });
+        }
+
+        benchmark->ArgNames({ "kernel", "width", "height" });
+    }
+
+} // namespace
+
+BENCHMARK_CAPTURE(BM_ConvertFrame, I420ToBGRA, false)->Apply(FrameArguments);
+BENCHMARK_CAPTURE(BM_ConvertFrame, NV12ToBGRA, true)->Apply(FrameArguments);
@@ -0,0 +1,84 @@
+//
+//  PHConvertBenchmark.cpp
+//  PerchRTCTests
+//
+//  Created by Christopher Eagleston on 2015-08-11.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#include "PHConvert.h"
+
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+namespace {
+
+    // The chroma plane of a 640x480 frame, with a ragged width that isn't a multiple of any vector size.
+    const int kWidths[] = { 320, 327 };
+    const int kHeight = 240;
+
+    void BM_InterleaveRow(benchmark::State &state)
+    {
+        PHConvertKernel kernel = (PHConvertKernel)state.range(0);
+        PHInterleaveRowFunction interleave = PHConvertInterleaveRowFunction(kernel);
+
+        if (!interleave) {
+            state.SkipWithError("Unsupported kernel");
+            return;
+        }
+
+        int width = (int)state.range(1);
+        std::vector<uint8_t> a(width * kHeight, 1), b(width * kHeight, 2), ab(2 * width * kHeight);
+
+        for (auto _ : state) {
+            for (int y = 0; y < kHeight; y++) {
+                interleave(&a[y * width], &b[y * width], &ab[2 * y * width], width);
+            }
+
+            benchmark::DoNotOptimize(ab.data());
+        }
+
+        state.SetBytesProcessed(state.iterations() * 2 * width * kHeight);
+    }
+
+    void BM_DeinterleaveRow(benchmark::State &state)
+    {
+        PHConvertKernel kernel = (PHConvertKernel)state.range(0);
+        PHDeinterleaveRowFunction deinterleave = PHConvertDeinterleaveRowFunction(kernel);
+
+        if (!deinterleave) {
+            state.SkipWithError("Unsupported kernel");
+            return;
+        }
+
+        int width = (int)state.range(1);
+        std::vector<uint8_t> ab(2 * width * kHeight, 3), a(width * kHeight), b(width * kHeight);
+
+        for (auto _ : state) {
+            for (int y = 0; y < kHeight; y++) {
+                deinterleave(&ab[2 * y * width], &a[y * width], &b[y * width], width);
+            }
+
+            benchmark::DoNotOptimize(a.data());
+            benchmark::DoNotOptimize(b.data());
+        }
+
+        state.SetBytesProcessed(state.iterations() * 2 * width * kHeight);
+    }
+
+    void KernelArguments(benchmark::internal::Benchmark *benchmark)
+    {
+        for (int kernel = PHConvertKernelScalar; kernel <= PHConvertKernelAVX2; kernel++) {
+            for (int width : kWidths) {
+                benchmark->Args({ kernel, width });
+            }
+        }
+
+        benchmark->ArgNames({ "kernel", "width" });
+    }
+
+} // namespace
+
+BENCHMARK(BM_InterleaveRow)->Apply(KernelArguments);
+BENCHMARK(BM_DeinterleaveRow)->Apply(KernelArguments);
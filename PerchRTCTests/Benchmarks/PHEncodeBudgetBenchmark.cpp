@@ -0,0 +1,156 @@
+//
+//  PHEncodeBudgetBenchmark.cpp
+//  PerchRTCTests
+//
+//  Created by Christopher Eagleston on 2015-08-11.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#include "PHScaleConvert.h"
+#include "PHSimulcast.h"
+
+#include <benchmark/benchmark.h>
+
+#include <stdlib.h>
+#include <time.h>
+#include <vector>
+
+using namespace perch;
+
+namespace {
+
+    const uint32_t kCaptureWidth = 640;
+    const uint32_t kCaptureHeight = 480;
+
+    // The media session's budget, in encoders at the largest send format.
+    const uint64_t kEncodeBudget = 2;
+
+    int64_t ThreadCpuNs()
+    {
+        struct timespec now;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+
+        return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+    }
+
+    // Stands in for one connection's encoder, which we can't run here. It scales the captured frame to the layer it's
+    // sent, as the capture pipeline does, and searches each macroblock against the last frame at the same place, which
+    // scales with the layer's macroblocks the way motion estimation does.
+    class EncoderStandIn
+    {
+    public:
+        explicit EncoderStandIn(const SimulcastLayer &layer)
+        : _width((int)layer.width), _height((int)layer.height),
+          _y(layer.width * layer.height), _uv(layer.width * layer.height / 2), _lastY(_y.size())
+        {}
+
+        uint64_t Encode(const std::vector<uint8_t> &y, const std::vector<uint8_t> &u, const std::vector<uint8_t> &v)
+        {
+            PHScaleI420ToNV12(y.data(), kCaptureWidth, u.data(), kCaptureWidth / 2, v.data(), kCaptureWidth / 2,
+                              kCaptureWidth, kCaptureHeight, _y.data(), _width, _uv.data(), _width, _width, _height,
+                              PHScaleFilterAutomatic);
+
+            uint64_t sad = 0;
+
+            for (int mbY = 0; mbY + 16 <= _height; mbY += 16) {
+                for (int mbX = 0; mbX + 16 <= _width; mbX += 16) {
+                    for (int row = 0; row < 16; row++) {
+                        const uint8_t *current = &_y[(mbY + row) * _width + mbX];
+                        const uint8_t *last = &_lastY[(mbY + row) * _width + mbX];
+
+                        for (int col = 0; col < 16; col++) {
+                            sad += (uint64_t)abs(current[col] - last[col]);
+                        }
+                    }
+                }
+            }
+
+            _lastY.swap(_y);
+
+            return sad;
+        }
+
+    private:
+        int _width;
+        int _height;
+        std::vector<uint8_t> _y;
+        std::vector<uint8_t> _uv;
+        std::vector<uint8_t> _lastY;
+    };
+
+    // Every peer in a room of `peers` encoding each captured frame, at the layers the media session plans, or all at
+    // the top layer. Every connection shares one capture track, so today each encodes the top layer whatever it is
+    // planned, and only the unplanned rows are what the device pays. The planned rows are what scaling each
+    // connection's encode to its layer would save. Reports the encoder invocations and thread CPU each peer costs a
+    // frame, and the encode rate against the budget.
+
+    void BM_EncodeBudget(benchmark::State &state)
+    {
+        size_t peers = (size_t)state.range(0);
+        bool planned = state.range(1) != 0;
+
+        std::vector<SimulcastLayer> layers = ScaleSimulcastLayers(kCaptureWidth, kCaptureHeight, 30, 3, 160);
+        uint64_t budget = kEncodeBudget * SimulcastEncodeRate(layers.back());
+        std::vector<int> selected = planned ? PlanSimulcastEncodeBudget(layers, peers, budget) :
+                                              std::vector<int>(peers, (int)layers.size() - 1);
+
+        std::vector<EncoderStandIn> encoders;
+        uint64_t encodeRate = 0;
+
+        for (int index : selected) {
+            encoders.push_back(EncoderStandIn(layers[index]));
+            encodeRate += SimulcastEncodeRate(layers[index]);
+        }
+
+        // Two captured frames with something moving between them, so that every search has work to do.
+
+        std::vector<uint8_t> frames[2];
+
+        for (int frame = 0; frame < 2; frame++) {
+            frames[frame].resize(kCaptureWidth * kCaptureHeight);
+
+            for (size_t i = 0; i < frames[frame].size(); i++) {
+                frames[frame][i] = (uint8_t)((i % kCaptureWidth + i / kCaptureWidth) * 3 + frame * 17);
+            }
+        }
+
+        std::vector<uint8_t> u(kCaptureWidth * kCaptureHeight / 4, 90);
+        std::vector<uint8_t> v(kCaptureWidth * kCaptureHeight / 4, 160);
+
+        uint64_t invocations = 0;
+        int64_t cpuNs = 0;
+        int frame = 0;
+
+        for (auto _ : state) {
+            int64_t startNs = ThreadCpuNs();
+
+            for (EncoderStandIn &encoder : encoders) {
+                benchmark::DoNotOptimize(encoder.Encode(frames[frame], u, v));
+                invocations++;
+            }
+
+            cpuNs += ThreadCpuNs() - startNs;
+            frame ^= 1;
+        }
+
+        double captured = (double)state.iterations();
+
+        state.counters["encodes/frame"] = invocations / captured;
+        state.counters["cpu_us/peer"] = cpuNs / 1000.0 / captured / peers;
+        state.counters["budget_used"] = (double)encodeRate / budget;
+        state.counters["frames/s"] = benchmark::Counter(captured, benchmark::Counter::kIsRate);
+    }
+
+    void MeshArguments(benchmark::internal::Benchmark *benchmark)
+    {
+        for (int peers = 1; peers <= 5; peers++) {
+            benchmark->Args({ peers, 0 });
+            benchmark->Args({ peers, 1 });
+        }
+
+        benchmark->ArgNames({ "peers", "planned" });
+    }
+
+} // namespace
+
+BENCHMARK(BM_EncodeBudget)->Apply(MeshArguments);
@@ -0,0 +1,44 @@
+//
+//  PHIceCandidateBenchmark.cpp
+//  PerchRTCTests
+//
+//  Created by Christopher Eagleston on 2015-08-11.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#include "PHIceCandidate.h"
+#include "PHTestData.h"
+
+#include <benchmark/benchmark.h>
+
+using namespace perch;
+
+namespace {
+
+    // The whole corpus per iteration, about what a dual stack device gathers for one connection.
+    void BM_IceCandidateParse(benchmark::State &state)
+    {
+        std::vector<std::string> candidates;
+        size_t bytes = 0;
+
+        for (const std::string &name : test::ListDataFiles("IceCandidate", ".candidate")) {
+            candidates.push_back(test::ReadDataFile("IceCandidate/" + name));
+            bytes += candidates.back().size();
+        }
+
+        for (auto _ : state) {
+            for (const std::string &text : candidates) {
+                IceCandidateAttribute candidate;
+                bool parsed = ParseIceCandidate(SdpToken(text.data(), text.size()), &candidate);
+                benchmark::DoNotOptimize(parsed);
+                benchmark::DoNotOptimize(candidate.priority);
+            }
+        }
+
+        state.SetItemsProcessed(state.iterations() * candidates.size());
+        state.SetBytesProcessed(state.iterations() * bytes);
+    }
+
+} // namespace
+
+BENCHMARK(BM_IceCandidateParse);
@@ -0,0 +1,65 @@
+//
+//  PHScaleConvertBenchmark.cpp
+//  PerchRTCTests
+//
+//  Created by Christopher Eagleston on 2015-08-11.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#include "PHScaleConvert.h"
+
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+namespace {
+
+    // A 640x480 stream drawn into a full size view, a quarter tile, and a tile which isn't an exact reduction.
+
+    void BM_ScaleConvert(benchmark::State &state)
+    {
+        PHConvertKernel kernel = (PHConvertKernel)state.range(0);
+
+        if (!PHConvertSelectKernel(kernel)) {
+            state.SkipWithError("Unsupported kernel");
+            return;
+        }
+
+        const int srcWidth = 640;
+        const int srcHeight = 480;
+        int dstWidth = (int)state.range(1);
+        int dstHeight = (int)state.range(2);
+
+        std::vector<uint8_t> y(srcWidth * srcHeight, 120);
+        std::vector<uint8_t> u(srcWidth * srcHeight / 4, 90);
+        std::vector<uint8_t> v(srcWidth * srcHeight / 4, 160);
+        std::vector<uint8_t> bgra(4 * dstWidth * dstHeight);
+
+        for (auto _ : state) {
+            PHScaleConvertI420ToRGB(y.data(), srcWidth, u.data(), srcWidth / 2, v.data(), srcWidth / 2, srcWidth, srcHeight,
+                                    bgra.data(), 4 * dstWidth, dstWidth, dstHeight,
+                                    PHScaleFilterAutomatic, PHColorMatrixBT601VideoRange, PHRGBLayoutBGRA);
+
+            benchmark::DoNotOptimize(bgra.data());
+        }
+
+        state.counters["frames/s"] = benchmark::Counter((double)state.iterations(), benchmark::Counter::kIsRate);
+        state.SetBytesProcessed(state.iterations() * 4 * dstWidth * dstHeight);
+
+        PHConvertSelectKernel(PHConvertKernelAutomatic);
+    }
+
+    void TileArguments(benchmark::internal::Benchmark *benchmark)
+    {
+        for (int kernel = PHConvertKernelScalar; kernel <= PHConvertKernelAVX2; kernel++) {
+            benchmark->Args({ kernel, 640, 480 });
+            benchmark->Args({ kernel, 320, 240 });
+            benchmark->Args({ kernel, 240, 180 });
+        }
+
+        benchmark->ArgNames({ "kernel", "width", "height" });
+    }
+
+} // namespace
+
+BENCHMARK(BM_ScaleConvert)->Apply(TileArguments);
@@ -0,0 +1,200 @@
+//
+//  PHSdpBenchmark.cpp
+//  PerchRTCTests
+//
+//  Created by Christopher Eagleston on 2015-08-11.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#include "PHSdp.h"
+#include "PHTestData.h"
+
+#include <benchmark/benchmark.h>
+
+#include <regex>
+#include <sstream>
+
+using namespace perch;
+
+namespace {
+
+    // The conditioning PHSessionDescriptionFactory did before SdpSession, ported line for line with std::regex standing
+    // in for NSRegularExpression: a string replace for ISAC, a split and a regex per line to prefer the video codec,
+    // and two regexes per media type to insert b=AS after the first c= line.
+
+    namespace legacy {
+
+        std::string PreferISACSimple(const std::string &sdp)
+        {
+            std::string result = sdp;
+            size_t at = 0;
+
+            while ((at = result.find("111 103", at)) != std::string::npos) {
+                result.replace(at, 7, "103 111");
+                at += 7;
+            }
+
+            return result;
+        }
+
+        std::string PreferVideoCodec(const std::string &codec, const std::string &sdp)
+        {
+            std::vector<std::string> lines;
+            std::stringstream stream(sdp);
+            std::string line;
+
+            while (std::getline(stream, line, '\n')) {
+                lines.push_back(line);
+            }
+
+            int mLineIndex = -1;
+            std::string codecRtpMap;
+            std::regex regex("^a=rtpmap:(\\d+) " + codec + "(/\\d+)+[\r]?$");
+
+            for (size_t i = 0; i < lines.size() && (mLineIndex == -1 || codecRtpMap.empty()); i++) {
+                std::smatch match;
+
+                if (lines[i].compare(0, 7, "m=video") == 0) {
+                    mLineIndex = (int)i;
+                    continue;
+                }
+                if (std::regex_search(lines[i], match, regex)) {
+                    codecRtpMap = match[1];
+                }
+            }
+
+            if (mLineIndex == -1 || codecRtpMap.empty()) {
+                return sdp;
+            }
+
+            std::vector<std::string> parts;
+            std::stringstream mLine(lines[mLineIndex]);
+
+            while (std::getline(mLine, line, ' ')) {
+                parts.push_back(line);
+            }
+
+            if (parts.size() > 3) {
+                std::string rebuilt = parts[0] + " " + parts[1] + " " + parts[2] + " " + codecRtpMap;
+
+                for (size_t i = 3; i < parts.size(); i++) {
+                    if (parts[i] != codecRtpMap) {
+                        rebuilt += " " + parts[i];
+                    }
+                }
+
+                lines[mLineIndex] = rebuilt;
+            }
+
+            std::string joined;
+
+            for (size_t i = 0; i < lines.size(); i++) {
+                joined += (i > 0 ? "\n" : "") + lines[i];
+            }
+
+            return joined;
+        }
+
+        std::string LimitBandwidth(const std::string &sdp, const char *mLinePattern, unsigned limit)
+        {
+            std::regex mRegex(mLinePattern);
+            std::regex cRegex("c=IN(.*)");
+            std::smatch mMatch, cMatch;
+
+            if (!std::regex_search(sdp, mMatch, mRegex)) {
+                return sdp;
+            }
+
+            std::string::const_iterator searchFrom = mMatch[0].second;
+
+            if (!std::regex_search(searchFrom, sdp.end(), cMatch, cRegex)) {
+                return sdp;
+            }
+
+            size_t at = cMatch[0].second - sdp.begin();
+            return sdp.substr(0, at) + "\nb=AS:" + std::to_string(limit) + sdp.substr(at);
+        }
+
+        std::string Condition(const std::string &sdp)
+        {
+            std::string result = PreferISACSimple(sdp);
+            result = PreferVideoCodec("H264", result);
+            result = LimitBandwidth(result, "m=audio(.*)", 32);
+            return LimitBandwidth(result, "m=video(.*)", 500);
+        }
+
+    } // namespace legacy
+
+    std::string Condition(const std::string &sdp)
+    {
+        SdpSession session;
+
+        if (!session.Parse(sdp)) {
+            return sdp;
+        }
+
+        for (size_t i = 0; i < session.MediaCount(); i++) {
+            SdpMediaSection &section = session.Media(i);
+
+            if (section.Media().Equals("audio")) {
+                section.PreferCodec("ISAC", 16000);
+                section.SetBandwidth("AS", 32);
+            }
+            else if (section.Media().Equals("video")) {
+                section.PreferCodec("H264");
+                section.SetBandwidth("AS", 500);
+            }
+        }
+
+        return session.Serialize();
+    }
+
+    const char *const kCorpus[] = {
+        "chrome45_offer.sdp",
+        "chrome_unified_plan_two_video.sdp",
+        "firefox40_offer.sdp",
+        "safari_h264_offer.sdp",
+    };
+
+    void CorpusArguments(benchmark::internal::Benchmark *benchmark)
+    {
+        for (size_t i = 0; i < sizeof(kCorpus) / sizeof(kCorpus[0]); i++) {
+            benchmark->Arg((int)i);
+        }
+        benchmark->ArgName("sdp");
+    }
+
+    template <std::string (*Conditioner)(const std::string &)>
+    void BM_Condition(benchmark::State &state)
+    {
+        std::string sdp = test::ReadDataFile(std::string("Sdp/") + kCorpus[state.range(0)]);
+
+        for (auto _ : state) {
+            std::string conditioned = Conditioner(sdp);
+            benchmark::DoNotOptimize(conditioned.data());
+        }
+
+        state.SetLabel(kCorpus[state.range(0)]);
+        state.SetBytesProcessed(state.iterations() * sdp.size());
+    }
+
+    void BM_SdpRoundTrip(benchmark::State &state)
+    {
+        std::string sdp = test::ReadDataFile(std::string("Sdp/") + kCorpus[state.range(0)]);
+
+        for (auto _ : state) {
+            SdpSession session;
+            session.Parse(sdp);
+            std::string serialized = session.Serialize();
+            benchmark::DoNotOptimize(serialized.data());
+        }
+
+        state.SetLabel(kCorpus[state.range(0)]);
+        state.SetBytesProcessed(state.iterations() * sdp.size());
+    }
+
+} // namespace
+
+BENCHMARK_TEMPLATE(BM_Condition, legacy::Condition)->Apply(CorpusArguments);
+BENCHMARK_TEMPLATE(BM_Condition, Condition)->Apply(CorpusArguments);
+BENCHMARK(BM_SdpRoundTrip)->Apply(CorpusArguments);
@@ -0,0 +1,72 @@
+//
+//  PHSignalingCodecBenchmark.cpp
+//  PerchRTCTests
+//
+//  Created by Christopher Eagleston on 2015-08-11.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#include "PHSignalingCodec.h"
+#include "PHTestData.h"
+
+#include <benchmark/benchmark.h>
+
+using namespace perch;
+
+namespace {
+
+    // The frames a call is made of, from the largest to the most frequent.
+    const char *const kFrames[] = {
+        "offer.json",
+        "answer.json",
+        "ice_candidates.json",
+        "ice_candidate.json",
+        "peers.json",
+    };
+
+    void FrameArguments(benchmark::internal::Benchmark *benchmark)
+    {
+        for (size_t i = 0; i < sizeof(kFrames) / sizeof(kFrames[0]); i++) {
+            benchmark->Arg((int)i);
+        }
+        benchmark->ArgName("frame");
+    }
+
+    void BM_SignalingDecode(benchmark::State &state)
+    {
+        std::string frame = test::ReadDataFile(std::string("Signaling/") + kFrames[state.range(0)]);
+        SignalingDecoder decoder;
+        SignalingMessage message;
+
+        for (auto _ : state) {
+            bool decoded = decoder.Decode(frame.data(), frame.size(), &message);
+            benchmark::DoNotOptimize(decoded);
+        }
+
+        state.SetLabel(kFrames[state.range(0)]);
+        state.SetBytesProcessed(state.iterations() * frame.size());
+    }
+
+    // Encoding reads from the decoded message, as PHConnectionBroker's strings would be.
+    void BM_SignalingEncode(benchmark::State &state)
+    {
+        std::string frame = test::ReadDataFile(std::string("Signaling/") + kFrames[state.range(0)]);
+        SignalingDecoder decoder;
+        SignalingEncoder encoder;
+        SignalingMessage message;
+
+        decoder.Decode(frame.data(), frame.size(), &message);
+
+        for (auto _ : state) {
+            const std::string &encoded = encoder.Encode(message);
+            benchmark::DoNotOptimize(encoded.data());
+        }
+
+        state.SetLabel(kFrames[state.range(0)]);
+        state.SetBytesProcessed(state.iterations() * frame.size());
+    }
+
+} // namespace
+
+BENCHMARK(BM_SignalingDecode)->Apply(FrameArguments);
+BENCHMARK(BM_SignalingEncode)->Apply(FrameArguments);
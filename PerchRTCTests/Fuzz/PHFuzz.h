@@ -0,0 +1,29 @@
+//
+//  PHFuzz.h
+//  PerchRTCTests
+//
+//  Created by Christopher Eagleston on 2015-08-11.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#ifndef PerchRTCTests_PHFuzz_h
+#define PerchRTCTests_PHFuzz_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Each fuzz target defines this, as libFuzzer expects. Built without libFuzzer, PHFuzzDriver.cpp calls it instead.
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+// A property every input must have. Failing one aborts, which both libFuzzer and ctest report as a crash.
+#define PERCH_FUZZ_CHECK(condition)                                                         \
+    do {                                                                                    \
+        if (!(condition)) {                                                                 \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition);   \
+            abort();                                                                        \
+        }                                                                                   \
+    } while (0)
+
+#endif
@@ -0,0 +1,212 @@
+//
+//  PHFuzzDriver.cpp
+//  PerchRTCTests
+//
+//  Created by Christopher Eagleston on 2015-08-11.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+// Runs a fuzz target without libFuzzer, so that it can run under ctest with any compiler.
+//
+//     PHSdpFuzzer [-runs=<mutations per input>] [-seed=<n>] <file or directory> ...
+//
+// Every file is run as it is, and then as `runs` mutations of itself: bytes flipped, inserted, and removed, lines
+// repeated and dropped, and the file cut short or spliced with another input. The mutations are the same on every
+// machine for a given seed, so a failure can be replayed.
+
+#include "PHFuzz.h"
+
+#include <algorithm>
+#include <dirent.h>
+#include <fstream>
+#include <sstream>
+#include <string.h>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+namespace {
+
+    class Mutator
+    {
+    public:
+        explicit Mutator(uint32_t seed) : _state(seed ? seed : 1) {}
+
+        uint32_t Next(uint32_t bound)
+        {
+            _state ^= _state << 13;
+            _state ^= _state >> 17;
+            _state ^= _state << 5;
+
+            return bound > 0 ? _state % bound : 0;
+        }
+
+        std::string Mutate(const std::string &input, const std::string &other)
+        {
+            std::string output = input;
+            uint32_t count = 1 + Next(4);
+
+            for (uint32_t i = 0; i < count; i++) {
+                size_t at = output.empty() ? 0 : Next((uint32_t)output.size());
+
+                switch (Next(7)) {
+                    case 0:
+                        if (!output.empty()) {
+                            output[at] ^= (char)(1 << Next(8));
+                        }
+                        break;
+                    case 1:
+                        output.insert(at, 1, Interesting());
+                        break;
+                    case 2:
+                        output.erase(at, 1 + Next(16));
+                        break;
+                    case 3:
+                        output.resize(at);
+                        break;
+                    case 4: {
+                        // Repeat a line.
+                        size_t start = output.rfind('\n', at);
+                        size_t end = output.find('\n', at);
+                        start = start == std::string::npos ? 0 : start + 1;
+                        end = end == std::string::npos ? output.size() : end + 1;
+                        output.insert(start, output.substr(start, end - start));
+                        break;
+                    }
+                    case 5: {
+                        // Drop a line.
+                        size_t start = output.rfind('\n', at);
+                        size_t end = output.find('\n', at);
+                        start = start == std::string::npos ? 0 : start + 1;
+                        end = end == std::string::npos ? output.size() : end + 1;
+                        output.erase(start, end - start);
+                        break;
+                    }
+                    default:
+                        if (!other.empty()) {
+                            size_t from = Next((uint32_t)other.size());
+                            output.replace(at, Next(64), other.substr(from, Next(256)));
+                        }
+                        break;
+                }
+            }
+
+            return output;
+        }
+
+    private:
+        // Characters the parsers split on, and the ones which are easy to get wrong.
+        char Interesting()
+        {
+            static const char characters[] = { '\r', '\n', ' ', ':', ';', '=', '/', ',', '~', '"', '\\', '{', '}', '[',
+                                               ']', '0', '9', '-', '\0', '\x7f', '\xc3', '\xff' };
+            return characters[Next(sizeof(characters))];
+        }
+
+        uint32_t _state;
+    };
+
+    bool ReadFile(const std::string &path, std::string *contents)
+    {
+        std::ifstream file(path.c_str(), std::ios::binary);
+        std::stringstream stream;
+
+        if (!file) {
+            return false;
+        }
+
+        stream << file.rdbuf();
+        *contents = stream.str();
+
+        return true;
+    }
+
+    void CollectInputs(const std::string &path, std::vector<std::string> *inputs)
+    {
+        struct stat info;
+
+        if (stat(path.c_str(), &info) != 0) {
+            fprintf(stderr, "Can't read %s\n", path.c_str());
+            exit(1);
+        }
+
+        if (!S_ISDIR(info.st_mode)) {
+            std::string contents;
+
+            if (ReadFile(path, &contents)) {
+                inputs->push_back(contents);
+            }
+            return;
+        }
+
+        DIR *directory = opendir(path.c_str());
+        std::vector<std::string> names;
+
+        while (struct dirent *entry = directory ? readdir(directory) : NULL) {
+            if (entry->d_name[0] != '.') {
+                names.push_back(entry->d_name);
+            }
+        }
+
+        if (directory) {
+            closedir(directory);
+        }
+
+        std::sort(names.begin(), names.end());
+
+        for (size_t i = 0; i < names.size(); i++) {
+            CollectInputs(path + "/" + names[i], inputs);
+        }
+    }
+
+    void Run(const std::string &input)
+    {
+        // A copy the exact size of the input, so that ASan catches reads past the end.
+
+        std::vector<uint8_t> data(input.begin(), input.end());
+        LLVMFuzzerTestOneInput(data.empty() ? NULL : data.data(), data.size());
+    }
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    unsigned long runs = 1000;
+    unsigned long seed = 1;
+    std::vector<std::string> inputs;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "-runs=", 6) == 0) {
+            runs = strtoul(argv[i] + 6, NULL, 10);
+        }
+        else if (strncmp(argv[i], "-seed=", 6) == 0) {
+            seed = strtoul(argv[i] + 6, NULL, 10);
+        }
+        else {
+            CollectInputs(argv[i], &inputs);
+        }
+    }
+
+    if (inputs.empty()) {
+        inputs.push_back(std::string());
+    }
+
+    Mutator mutator((uint32_t)seed);
+    unsigned long executions = 0;
+
+    for (size_t i = 0; i < inputs.size(); i++) {
+        Run(inputs[i]);
+        executions++;
+
+        for (unsigned long run = 0; run < runs; run++) {
+            const std::string &other = inputs[mutator.Next((uint32_t)inputs.size())];
+
+            Run(mutator.Mutate(inputs[i], other));
+            executions++;
+        }
+    }
+
+    printf("Ran %lu inputs from %lu files, seed %lu.\n", executions, (unsigned long)inputs.size(), seed);
+
+    return 0;
+}
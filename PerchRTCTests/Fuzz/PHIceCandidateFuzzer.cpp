@@ -0,0 +1,59 @@
+//
+//  PHIceCandidateFuzzer.cpp
+//  PerchRTCTests
+//
+//  Created by Christopher Eagleston on 2015-08-11.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+// Every candidate we gather, and every candidate a peer trickles, is parsed before it's filtered or prioritized.
+// Whatever the text, parsing must not read out of bounds, and what it returns must point into the text and keep to
+// the RFC's limits.
+
+#include "PHFuzz.h"
+#include "PHIceCandidate.h"
+
+#include <string>
+
+using namespace perch;
+
+namespace {
+
+    bool Within(SdpToken token, const std::string &text)
+    {
+        return token.Empty() || (token.data >= text.data() && token.data + token.size <= text.data() + text.size());
+    }
+
+} // namespace
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    // A copy, so reads past the end are caught at the end of the input rather than of the fuzzer's buffer.
+
+    std::string text((const char *)data, size);
+    IceCandidateAttribute candidate;
+
+    if (!ParseIceCandidate(SdpToken(text.data(), text.size()), &candidate)) {
+        return 0;
+    }
+
+    PERCH_FUZZ_CHECK(!candidate.foundation.Empty() && candidate.foundation.size <= 32);
+    PERCH_FUZZ_CHECK(candidate.component > 0);
+    PERCH_FUZZ_CHECK(candidate.port <= 65535 && candidate.relatedPort <= 65535);
+    PERCH_FUZZ_CHECK(!candidate.address.Empty());
+    PERCH_FUZZ_CHECK(Within(candidate.foundation, text) && Within(candidate.address, text));
+    PERCH_FUZZ_CHECK(Within(candidate.relatedAddress, text) && Within(candidate.ufrag, text));
+
+    // The same candidate with the attribute prefix, as the SDP layer would hand it over, reads the same.
+
+    std::string prefixed = "a=candidate:" + std::string(candidate.foundation.data, text.data() + text.size() - candidate.foundation.data);
+    IceCandidateAttribute again;
+
+    PERCH_FUZZ_CHECK(ParseIceCandidate(SdpToken(prefixed.data(), prefixed.size()), &again));
+    PERCH_FUZZ_CHECK(again.foundation.ToString() == candidate.foundation.ToString());
+    PERCH_FUZZ_CHECK(again.priority == candidate.priority && again.port == candidate.port);
+    PERCH_FUZZ_CHECK(again.type == candidate.type && again.transport == candidate.transport);
+    PERCH_FUZZ_CHECK(again.tcpType == candidate.tcpType && again.generation == candidate.generation);
+
+    return 0;
+}
@@ -0,0 +1,71 @@
+//
+//  PHSdpFuzzer.cpp
+//  PerchRTCTests
+//
+//  Created by Christopher Eagleston on 2015-08-11.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+// Session descriptions come from the far end of the signaling channel. Whatever arrives, parsing and editing it must
+// not read out of bounds, and anything which parses must write out a description which parses back the same way.
+
+#include "PHFuzz.h"
+#include "PHSdp.h"
+
+#include <string>
+
+using namespace perch;
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    SdpSession session;
+
+    if (!session.Parse(std::string((const char *)data, size))) {
+        return 0;
+    }
+
+    std::string serialized = session.Serialize();
+    SdpSession reparsed;
+
+    PERCH_FUZZ_CHECK(reparsed.Parse(serialized));
+    PERCH_FUZZ_CHECK(reparsed.Serialize() == serialized);
+    PERCH_FUZZ_CHECK(reparsed.MediaCount() == session.MediaCount());
+
+    // Every edit, on every section, whatever shape it's in.
+
+    for (size_t i = 0; i < session.MediaCount(); i++) {
+        SdpMediaSection &section = session.Media(i);
+        std::vector<SdpRtpMap> maps = section.RtpMaps();
+        SdpToken value;
+        uint32_t bandwidth = 0;
+
+        section.PreferCodec("VP8");
+        section.PreferCodec("opus", 48000);
+        section.Bandwidth("AS", &bandwidth);
+        section.SetBandwidth("AS", 300);
+        section.SetBandwidth("TIAS", 300000);
+
+        for (size_t j = 0; j < maps.size(); j++) {
+            section.FormatParameter(maps[j].payloadType, "apt", &value);
+            section.SetFormatParameter(maps[j].payloadType, "max-fs", "396");
+        }
+
+        if (!maps.empty()) {
+            section.RemoveFormat(maps[0].payloadType);
+        }
+
+        section.AddAttribute("x-perch", "1");
+        section.RemoveLine(section.Lines().size() - 1);
+        section.RemoveLine(0);
+
+        PERCH_FUZZ_CHECK(section.Bandwidth("AS", &bandwidth) && bandwidth == 300);
+    }
+
+    serialized = session.Serialize();
+
+    SdpSession edited;
+    PERCH_FUZZ_CHECK(edited.Parse(serialized));
+    PERCH_FUZZ_CHECK(edited.Serialize() == serialized);
+
+    return 0;
+}
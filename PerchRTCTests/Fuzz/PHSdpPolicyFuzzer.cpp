@@ -0,0 +1,78 @@
+//
+//  PHSdpPolicyFuzzer.cpp
+//  PerchRTCTests
+//
+//  Created by Christopher Eagleston on 2015-08-11.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+// Every description is conditioned before it's set, and a peer's is read for its receive capacity. Whatever the
+// input, the policy must not read out of bounds, must write something which parses, must be idempotent, and must
+// never leave a section without formats.
+
+#include "PHFuzz.h"
+#include "PHSdpPolicy.h"
+#include "PHSimulcast.h"
+
+#include <string>
+
+using namespace perch;
+
+namespace {
+
+    SdpPolicy EverythingPolicy()
+    {
+        SdpPolicy policy;
+
+        policy.audio.codecOrder.push_back(SdpCodecPreference("ISAC", 16000));
+        policy.audio.codecOrder.push_back(SdpCodecPreference("opus", 48000));
+        policy.audio.maxBitrateKbps = 64;
+        policy.audio.pruneForwardErrorCorrection = true;
+
+        policy.video.codecOrder.push_back(SdpCodecPreference("H264"));
+        policy.video.codecOrder.push_back(SdpCodecPreference("VP8", 90000));
+        policy.video.maxBitrateKbps = 500;
+        policy.video.maxFrameRate = 30;
+        policy.video.maxFrameSize = SdpFrameSizeInMacroblocks(640, 480);
+        policy.video.pruneRetransmission = true;
+        policy.video.pruneForwardErrorCorrection = true;
+
+        return policy;
+    }
+
+} // namespace
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    static const SdpPolicy policy = EverythingPolicy();
+
+    SdpSession session;
+
+    if (!session.Parse(std::string((const char *)data, size))) {
+        return 0;
+    }
+
+    std::vector<bool> hadFormats;
+
+    for (size_t i = 0; i < session.MediaCount(); i++) {
+        hadFormats.push_back(!session.Media(i).Formats().empty());
+    }
+
+    PERCH_FUZZ_CHECK(ApplySdpPolicy(policy, &session) <= session.MediaCount());
+
+    for (size_t i = 0; i < session.MediaCount(); i++) {
+        PERCH_FUZZ_CHECK(!hadFormats[i] || !session.Media(i).Formats().empty());
+    }
+
+    std::string once = session.Serialize();
+    SdpSession again;
+
+    PERCH_FUZZ_CHECK(again.Parse(once));
+    ApplySdpPolicy(policy, &again);
+    PERCH_FUZZ_CHECK(again.Serialize() == once);
+
+    SimulcastReceiveCapacity capacity;
+    ReadSimulcastReceiveCapacity(session, &capacity);
+
+    return 0;
+}
@@ -0,0 +1,78 @@
+//
+//  PHSignalingCodecFuzzer.cpp
+//  PerchRTCTests
+//
+//  Created by Christopher Eagleston on 2015-08-11.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+// Every frame the signaling socket receives is decoded in place. Whatever arrives, decoding must not read or write
+// out of bounds, and a peer message must encode and decode back to the same fields.
+
+#include "PHFuzz.h"
+#include "PHSignalingCodec.h"
+
+#include <string.h>
+#include <string>
+
+using namespace perch;
+
+namespace {
+
+    bool SameText(const SignalingText &a, const SignalingText &b)
+    {
+        return a.size == b.size && (a.size == 0 || memcmp(a.data, b.data, a.size) == 0);
+    }
+
+} // namespace
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    static SignalingDecoder decoder;
+    static SignalingDecoder redecoder;
+    static SignalingEncoder encoder;
+
+    SignalingMessage message;
+
+    if (!decoder.Decode((const char *)data, size, &message)) {
+        PERCH_FUZZ_CHECK(message.event == SignalingEventUnknown && message.candidates.empty());
+        return 0;
+    }
+
+    PERCH_FUZZ_CHECK(message.event == SignalingEventForName(message.eventName));
+
+    for (size_t i = 0; i < message.candidates.size(); i++) {
+        PERCH_FUZZ_CHECK(!message.candidates[i].candidate.Empty());
+    }
+
+    if (message.event == SignalingEventUnknown || message.event >= SignalingEventRoomJoin) {
+        return 0;
+    }
+
+    // What we'd send, the far end would read back the same. Only the fields an event sends are compared.
+
+    const std::string &encoded = encoder.Encode(message);
+    SignalingMessage again;
+
+    PERCH_FUZZ_CHECK(redecoder.Decode(encoded.data(), encoded.size(), &again));
+    PERCH_FUZZ_CHECK(again.event == message.event);
+    PERCH_FUZZ_CHECK(SameText(again.connectionId, message.connectionId));
+
+    if (message.event == SignalingEventOffer || message.event == SignalingEventAnswer) {
+        PERCH_FUZZ_CHECK(SameText(again.sdp, message.sdp));
+        PERCH_FUZZ_CHECK(SameText(again.sdpType, message.sdpType));
+        PERCH_FUZZ_CHECK(again.features == message.features);
+    }
+
+    if (message.event == SignalingEventICE) {
+        PERCH_FUZZ_CHECK(again.candidates.size() == message.candidates.size());
+
+        for (size_t i = 0; i < message.candidates.size(); i++) {
+            PERCH_FUZZ_CHECK(SameText(again.candidates[i].candidate, message.candidates[i].candidate));
+            PERCH_FUZZ_CHECK(SameText(again.candidates[i].mid, message.candidates[i].mid));
+            PERCH_FUZZ_CHECK(again.candidates[i].index == message.candidates[i].index);
+        }
+    }
+
+    return 0;
+}
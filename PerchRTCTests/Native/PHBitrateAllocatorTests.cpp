@@ -0,0 +1,351 @@
+//
+//  PHBitrateAllocatorTests.cpp
+//  PerchRTCTests
+//
+//  Created by Christopher Eagleston on 2015-08-11.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#include "PHBitrateAllocator.h"
+#include "PHTestData.h"
+
+#include <gtest/gtest.h>
+
+#include <stdio.h>
+
+using namespace perch;
+
+namespace {
+
+    // PHMediaSession's multiparty audio rate, and the peak of the default 640x480 send format.
+    const uint32_t kAudioPeakKbps = 48;
+    const uint32_t kVideoPeakKbps = 774;
+
+    // The budget PHMediaSession starts three connections with: the video send rate, and audio for each.
+    const uint32_t kThreeWayBudgetKbps = 1000 + 3 * kAudioPeakKbps;
+
+    // The streams PHMediaSession allocates for each connection, keyed the same way.
+    std::vector<BitrateStream> Connections(int count, uint32_t videoCapKbps = kVideoPeakKbps)
+    {
+        std::vector<BitrateStream> streams;
+
+        for (int i = 0; i < count; i++) {
+            std::string connection = "connection" + std::to_string(i);
+
+            streams.push_back(BitrateStream(connection + "/audio", BitrateCodecOpus, kAudioPeakKbps));
+            streams.push_back(BitrateStream(connection + "/video", BitrateCodecVP8, kVideoPeakKbps, videoCapKbps));
+        }
+
+        return streams;
+    }
+
+    uint32_t Total(const std::vector<uint32_t> &allocation)
+    {
+        uint32_t total = 0;
+
+        for (uint32_t kbps : allocation) {
+            total += kbps;
+        }
+
+        return total;
+    }
+
+    uint32_t Total(const std::map<std::string, uint32_t> &caps)
+    {
+        uint32_t total = 0;
+
+        for (const auto &cap : caps) {
+            total += cap.second;
+        }
+
+        return total;
+    }
+
+    struct EstimateSample
+    {
+        int64_t timeMs;
+        uint32_t estimateKbps;
+    };
+
+    std::vector<EstimateSample> LoadTrace(const std::string &name)
+    {
+        std::vector<EstimateSample> samples;
+
+        for (const std::string &line : test::ReadTraceLines("BitrateAllocator/" + name)) {
+            int seconds;
+            unsigned estimate;
+
+            if (sscanf(line.c_str(), "%d %u", &seconds, &estimate) == 2) {
+                EstimateSample sample = { seconds * 1000LL, estimate };
+                samples.push_back(sample);
+            }
+        }
+
+        return samples;
+    }
+
+    struct ReplayResult
+    {
+        int decreases;
+        int increases;
+        std::map<std::string, uint32_t> finalCaps;
+    };
+
+    // Replays an estimate trace against `streams`, checking on every update that every stream has a cap, that pushed
+    // decreases and increases are spaced out, and that once a decrease could have been pushed the caps fit the
+    // estimate, give or take changes too small to push.
+    ReplayResult Replay(BitrateAllocator &allocator, const BitrateAllocatorConfig &config,
+                        const std::vector<BitrateStream> &streams, const std::vector<EstimateSample> &samples)
+    {
+        ReplayResult result = { 0, 0, std::map<std::string, uint32_t>() };
+        int64_t lastDecreaseMs = -1;
+        int64_t lastIncreaseMs = -1;
+
+        for (const EstimateSample &sample : samples) {
+            std::map<std::string, uint32_t> previous = allocator.Caps();
+            std::map<std::string, uint32_t> pushed;
+
+            allocator.Update(streams, sample.estimateKbps, sample.timeMs, &pushed);
+
+            const std::map<std::string, uint32_t> &caps = allocator.Caps();
+            bool decreased = false;
+            bool increased = false;
+
+            EXPECT_EQ(streams.size(), caps.size()) << "at " << sample.timeMs << " ms";
+
+            for (const auto &cap : pushed) {
+                std::map<std::string, uint32_t>::const_iterator last = previous.find(cap.first);
+
+                if (last != previous.end()) {
+                    decreased |= cap.second < last->second;
+                    increased |= cap.second > last->second;
+                }
+            }
+
+            if (decreased) {
+                EXPECT_TRUE(lastDecreaseMs < 0 || sample.timeMs - lastDecreaseMs >= config.minDecreaseIntervalMs)
+                    << "at " << sample.timeMs << " ms";
+                lastDecreaseMs = sample.timeMs;
+                result.decreases++;
+            }
+
+            if (increased) {
+                EXPECT_TRUE(lastIncreaseMs < 0 || sample.timeMs - lastIncreaseMs >= config.minIncreaseIntervalMs)
+                    << "at " << sample.timeMs << " ms";
+                lastIncreaseMs = sample.timeMs;
+                result.increases++;
+            }
+
+            if (lastDecreaseMs < 0 || sample.timeMs - lastDecreaseMs >= config.minDecreaseIntervalMs || decreased) {
+                double slack = allocator.EstimateKbps() / (1.0 - config.minChangeFraction) + streams.size();
+                EXPECT_LE(Total(caps), slack) << "at " << sample.timeMs << " ms, estimate " << allocator.EstimateKbps();
+            }
+        }
+
+        result.finalCaps = allocator.Caps();
+
+        return result;
+    }
+
+} // namespace
+
+TEST(PHBitrateAllocatorTest, QualityCurves)
+{
+    const BitrateCodec codecs[] = { BitrateCodecOpus, BitrateCodecISAC, BitrateCodecVP8, BitrateCodecH264 };
+
+    for (BitrateCodec codec : codecs) {
+        EXPECT_DOUBLE_EQ(0, BitrateQuality(codec, 0)) << codec;
+        EXPECT_DOUBLE_EQ(1, BitrateQuality(codec, 1)) << codec;
+        EXPECT_DOUBLE_EQ(1, BitrateQuality(codec, 2)) << codec;
+
+        for (double fraction = 0; fraction < 1; fraction += 0.05) {
+            EXPECT_LE(BitrateQuality(codec, fraction), BitrateQuality(codec, fraction + 0.05)) << codec << " at " << fraction;
+        }
+    }
+
+    // H.264 needs more than VP8 for the same quality, and iSAC is done at half its peak.
+
+    EXPECT_LT(BitrateQuality(BitrateCodecH264, 0.5), BitrateQuality(BitrateCodecVP8, 0.5));
+    EXPECT_DOUBLE_EQ(1, BitrateQuality(BitrateCodecISAC, 0.5));
+}
+
+TEST(PHBitrateAllocatorTest, AllocateFromBudget)
+{
+    struct Case
+    {
+        const char *name;
+        std::vector<BitrateStream> streams;
+        uint32_t budgetKbps;
+        std::vector<uint32_t> expected;
+    };
+
+    const BitrateStream opus("a", BitrateCodecOpus, kAudioPeakKbps);
+    const BitrateStream vp8("v", BitrateCodecVP8, kVideoPeakKbps);
+    const BitrateStream cappedVP8("v", BitrateCodecVP8, kVideoPeakKbps, 300);
+
+    const Case cases[] = {
+        // Enough for everything, or for everything up to the receiver's cap.
+
+        { "plenty", { opus, vp8 }, 2000, { 48, 774 } },
+        { "capped", { opus, cappedVP8 }, 2000, { 48, 300 } },
+
+        // Exactly the minimums: a tenth of each peak, rounded up.
+
+        { "minimums", { opus, vp8 }, 83, { 5, 78 } },
+
+        // Audio gets its minimum before video gets anything, and short minimums are shared evenly.
+
+        { "audio first", { opus, vp8 }, 10, { 5, 5 } },
+        { "shared audio minimum", { opus, opus, vp8 }, 6, { 3, 3, 0 } },
+        { "nothing", { opus, vp8 }, 0, { 0, 0 } },
+        { "no streams", {}, 1000, {} },
+    };
+
+    for (const Case &test : cases) {
+        EXPECT_EQ(test.expected, AllocateBitrate(test.streams, test.budgetKbps)) << test.name;
+    }
+}
+
+// Between the minimums and the peaks, video streams of one codec reach the same quality, and audio climbs twice as fast.
+TEST(PHBitrateAllocatorTest, SharedBudgetEqualizesQuality)
+{
+    std::vector<BitrateStream> streams = Connections(3);
+    streams[5].capKbps = 150;
+
+    const uint32_t budgets[] = { 300, 450, 600, 900, 1144, 1600 };
+
+    for (uint32_t budget : budgets) {
+        std::vector<uint32_t> allocation = AllocateBitrate(streams, budget);
+
+        ASSERT_EQ(streams.size(), allocation.size());
+        EXPECT_LE(Total(allocation), budget) << budget << " kbps";
+        EXPECT_GE(Total(allocation) + 3, std::min(budget, Total(std::vector<uint32_t>{ 48, 774, 48, 774, 48, 150 })))
+            << budget << " kbps leaves budget unused";
+
+        double video = BitrateQuality(BitrateCodecVP8, allocation[1] / (double)kVideoPeakKbps);
+        double audio = BitrateQuality(BitrateCodecOpus, allocation[0] / (double)kAudioPeakKbps);
+
+        EXPECT_EQ(allocation[1], allocation[3]) << budget << " kbps";
+        EXPECT_LE(allocation[5], 150u) << budget << " kbps";
+        EXPECT_NEAR(std::min(1.0, 2 * video), audio, 0.05) << budget << " kbps";
+    }
+}
+
+TEST(PHBitrateAllocatorTest, PushesOnlyWorthwhileChanges)
+{
+    struct Step
+    {
+        int64_t timeMs;
+        uint32_t estimateKbps;
+        bool pushed;
+    };
+
+    // A single connection whose video cap follows the estimate, less 48 kbps of audio.
+
+    const Step steps[] = {
+        { 0, 600, true },       // Everything is pushed the first time.
+        { 2000, 580, false },   // Less than a tenth.
+        { 4000, 400, true },    // Decreases are taken at once...
+        { 6000, 300, false },   // ...but not again within 4 s.
+        { 8000, 300, true },
+        { 10000, 1000, true },  // Increases are smoothed over four updates, but the first step is worth pushing.
+        { 12000, 1000, false }, // Not again within 5 s.
+        { 14000, 1000, false },
+        { 16000, 1000, true },
+        { 18000, 1000, false }, // What's left is less than a tenth.
+        { 40000, 1000, false }, // Settled.
+    };
+
+    BitrateAllocatorConfig config;
+    BitrateAllocator allocator(config);
+    std::vector<BitrateStream> streams = Connections(1);
+
+    for (const Step &step : steps) {
+        std::map<std::string, uint32_t> caps;
+
+        EXPECT_EQ(step.pushed, allocator.Update(streams, step.estimateKbps, step.timeMs, &caps)) << "at " << step.timeMs << " ms";
+        EXPECT_EQ(step.pushed, !caps.empty()) << "at " << step.timeMs << " ms";
+    }
+
+    allocator.Reset();
+
+    std::map<std::string, uint32_t> caps;
+    EXPECT_TRUE(allocator.Update(streams, 300, 41000, &caps));
+    EXPECT_EQ(2u, caps.size());
+}
+
+// PHMediaSession passes every connection it has, so one which is still negotiating keeps its cap for the answer.
+TEST(PHBitrateAllocatorTest, NegotiatingConnectionKeepsItsCap)
+{
+    BitrateAllocator allocator;
+    std::map<std::string, uint32_t> caps;
+
+    allocator.Update(Connections(2), 1000, 0, &caps);
+
+    // A third peer joins. Its streams are new, so they're pushed, and everyone else's share shrinks.
+
+    std::vector<BitrateStream> three = Connections(3);
+    ASSERT_TRUE(allocator.Update(three, 1000, 2000, &caps));
+    ASSERT_EQ(1u, caps.count("connection2/video"));
+    uint32_t joined = caps["connection2/video"];
+
+    // It keeps it while the estimate holds, for as long as it's passed in.
+
+    for (int64_t timeMs = 4000; timeMs < 20000; timeMs += 2000) {
+        allocator.Update(three, 1000, timeMs, &caps);
+        ASSERT_EQ(1u, allocator.Caps().count("connection2/video"));
+        EXPECT_EQ(joined, allocator.Caps().at("connection2/video"));
+    }
+
+    // Leaving a connection out is how it's forgotten.
+
+    allocator.Update(Connections(2), 1000, 20000, &caps);
+    EXPECT_EQ(0u, allocator.Caps().count("connection2/video"));
+    EXPECT_EQ(4u, allocator.Caps().size());
+}
+
+// Handing over to LTE drops the estimate in steps. The caps follow in fewer, spaced renegotiations, and settle at the
+// allocation for the estimate once back on Wi-Fi.
+TEST(PHBitrateAllocatorTest, ReplayHandover)
+{
+    std::vector<EstimateSample> samples = LoadTrace("lte_handover.trace");
+    std::vector<BitrateStream> streams = Connections(3);
+    ASSERT_FALSE(samples.empty());
+
+    BitrateAllocatorConfig config;
+    BitrateAllocator allocator(config);
+    ReplayResult result = Replay(allocator, config, streams, samples);
+
+    BitrateAllocatorConfig unspaced = config;
+    unspaced.minDecreaseIntervalMs = 0;
+    BitrateAllocator unspacedAllocator(unspaced);
+    ReplayResult unspacedResult = Replay(unspacedAllocator, unspaced, streams, samples);
+
+    EXPECT_GE(result.decreases, 1);
+    EXPECT_LT(result.decreases, unspacedResult.decreases);
+    EXPECT_GE(result.increases, 1);
+
+    std::vector<uint32_t> settled = AllocateBitrate(streams, kThreeWayBudgetKbps);
+
+    for (size_t i = 0; i < streams.size(); i++) {
+        EXPECT_NEAR(settled[i], result.finalCaps[streams[i].key], settled[i] * config.minChangeFraction) << streams[i].key;
+    }
+}
+
+// A sawtooth estimate, from a bulk upload sharing the uplink. The caps can't chase every tooth.
+TEST(PHBitrateAllocatorTest, ReplaySawtooth)
+{
+    std::vector<EstimateSample> samples = LoadTrace("congestion_sawtooth.trace");
+    std::vector<BitrateStream> streams = Connections(3);
+    ASSERT_FALSE(samples.empty());
+
+    BitrateAllocatorConfig config;
+    BitrateAllocator allocator(config);
+    ReplayResult result = Replay(allocator, config, streams, samples);
+
+    int64_t durationMs = samples.back().timeMs - samples.front().timeMs;
+
+    EXPECT_LE(result.decreases, durationMs / config.minDecreaseIntervalMs + 1);
+    EXPECT_LE(result.increases, durationMs / config.minIncreaseIntervalMs + 1);
+    EXPECT_LT(result.decreases + result.increases, (int)samples.size() / 2);
+}
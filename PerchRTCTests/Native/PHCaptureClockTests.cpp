@@ -0,0 +1,218 @@
+//
+//  PHCaptureClockTests.cpp
+//  PerchRTCTests
+//
+//  Created by Christopher Eagleston on 2015-08-11.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#include "PHCaptureClock.h"
+#include "PHTestData.h"
+
+#include <gtest/gtest.h>
+
+#include <stdlib.h>
+
+using namespace perch;
+
+namespace {
+
+    const int64_t kMsec = 1000000;
+    const int64_t k30fps = 33333333;
+
+    struct TraceFrame
+    {
+        int64_t ptsValue;
+        int32_t ptsTimescale;
+        int64_t nowNs;
+    };
+
+    std::vector<TraceFrame> LoadTrace(const std::string &name)
+    {
+        std::vector<TraceFrame> frames;
+
+        for (const std::string &line : test::ReadTraceLines("CaptureClock/" + name)) {
+            TraceFrame frame;
+            long long value, now;
+            int timescale;
+
+            if (sscanf(line.c_str(), "%lld %d %lld", &value, &timescale, &now) == 3) {
+                frame.ptsValue = value;
+                frame.ptsTimescale = timescale;
+                frame.nowNs = now;
+                frames.push_back(frame);
+            }
+        }
+
+        return frames;
+    }
+
+    // Replays a trace, checking the properties every timeline must have.
+    std::vector<CaptureClockFrame> Replay(CaptureClock &clock, const std::vector<TraceFrame> &trace)
+    {
+        std::vector<CaptureClockFrame> output;
+
+        for (const TraceFrame &input : trace) {
+            CaptureClockFrame frame = clock.Update(input.ptsValue, input.ptsTimescale, input.nowNs);
+
+            if (output.empty()) {
+                EXPECT_EQ(input.nowNs, frame.timestampNs);
+                EXPECT_EQ(0, frame.elapsedTimeNs);
+            }
+            else {
+                EXPECT_GT(frame.timestampNs, output.back().timestampNs) << "frame " << output.size();
+                EXPECT_EQ(frame.timestampNs - output.front().timestampNs, frame.elapsedTimeNs) << "frame " << output.size();
+            }
+
+            output.push_back(frame);
+        }
+
+        return output;
+    }
+
+} // namespace
+
+TEST(PHCaptureClockTest, PtsToNanoseconds)
+{
+    EXPECT_EQ(0, CaptureClock::PtsToNanoseconds(5, 0));
+    EXPECT_EQ(41666666, CaptureClock::PtsToNanoseconds(25, 600));
+    EXPECT_EQ(1500000000, CaptureClock::PtsToNanoseconds(1500, 1000));
+
+    // A device that has been up for 100 days, in a nanosecond timescale, and in a 90 kHz one.
+
+    const int64_t uptime = 100LL * 86400 * 1000000000;
+    EXPECT_EQ(uptime + 7, CaptureClock::PtsToNanoseconds(uptime + 7, 1000000000));
+    EXPECT_EQ(uptime, CaptureClock::PtsToNanoseconds(100LL * 86400 * 90000, 90000));
+}
+
+TEST(PHCaptureClockTest, SteadyTrace)
+{
+    CaptureClock clock(k30fps);
+    std::vector<TraceFrame> trace = LoadTrace("steady_30fps.trace");
+    ASSERT_EQ(300u, trace.size());
+
+    std::vector<CaptureClockFrame> frames = Replay(clock, trace);
+
+    // Source spacing is kept exactly.
+
+    int64_t sourceSpan = CaptureClock::PtsToNanoseconds(trace.back().ptsValue - trace.front().ptsValue, trace.front().ptsTimescale);
+    EXPECT_EQ(sourceSpan, frames.back().elapsedTimeNs);
+
+    CaptureClockStats stats = clock.Stats();
+    EXPECT_EQ(300u, stats.frames);
+    EXPECT_EQ(0u, stats.gaps);
+    EXPECT_EQ(0u, stats.discontinuities);
+    EXPECT_EQ(0u, stats.rateChanges);
+    EXPECT_NEAR(k30fps, stats.estimatedIntervalNs, kMsec / 2);
+    EXPECT_GT(stats.jitterNs, 0);
+    EXPECT_LE(stats.jitterNs, kMsec);
+    EXPECT_LE(stats.maxJitterNs, 2 * kMsec);
+}
+
+TEST(PHCaptureClockTest, LowLightRateChange)
+{
+    CaptureClock clock(k30fps);
+    std::vector<CaptureClockFrame> frames = Replay(clock, LoadTrace("low_light_30_to_15fps.trace"));
+
+    CaptureClockStats stats = clock.Stats();
+    EXPECT_EQ(1u, stats.rateChanges);
+    EXPECT_NEAR(2 * k30fps, stats.estimatedIntervalNs, kMsec);
+    EXPECT_EQ(0u, stats.discontinuities);
+
+    // Only the run which established the new rate looks like missing frames.
+
+    EXPECT_LE(stats.gaps, 4u);
+
+    for (size_t i = 160; i < frames.size(); i++) {
+        EXPECT_EQ(0, frames[i].missedFrames) << "frame " << i;
+    }
+}
+
+TEST(PHCaptureClockTest, DroppedFramesAreCounted)
+{
+    CaptureClock clock(k30fps);
+    std::vector<CaptureClockFrame> frames = Replay(clock, LoadTrace("dropped_frames_30fps.trace"));
+
+    ASSERT_EQ(292u, frames.size());
+    EXPECT_EQ(2, frames[50].missedFrames);
+    EXPECT_EQ(5, frames[118].missedFrames);
+    EXPECT_EQ(1, frames[193].missedFrames);
+
+    CaptureClockStats stats = clock.Stats();
+    EXPECT_EQ(3u, stats.gaps);
+    EXPECT_EQ(8u, stats.missedFrames);
+    EXPECT_EQ(0u, stats.rateChanges);
+    EXPECT_NEAR(k30fps, stats.estimatedIntervalNs, kMsec / 2);
+}
+
+// The source clock restarts when the camera changes. The timeline carries on one interval later, rather than jumping back.
+TEST(PHCaptureClockTest, CameraSwitchIsADiscontinuity)
+{
+    CaptureClock clock(k30fps);
+    std::vector<CaptureClockFrame> frames = Replay(clock, LoadTrace("camera_switch_30fps.trace"));
+
+    ASSERT_EQ(200u, frames.size());
+    EXPECT_TRUE(frames[100].discontinuity);
+    EXPECT_NEAR(k30fps, frames[100].timestampNs - frames[99].timestampNs, kMsec);
+
+    CaptureClockStats stats = clock.Stats();
+    EXPECT_EQ(1u, stats.discontinuities);
+    EXPECT_EQ(0u, stats.gaps);
+    EXPECT_NEAR(k30fps, stats.estimatedIntervalNs, kMsec / 2);
+}
+
+TEST(PHCaptureClockTest, MovieTimescale)
+{
+    CaptureClock clock(0);
+    std::vector<CaptureClockFrame> frames = Replay(clock, LoadTrace("timescale_600_24fps.trace"));
+
+    ASSERT_EQ(240u, frames.size());
+    EXPECT_EQ(CaptureClock::PtsToNanoseconds(239 * 25, 600), frames.back().elapsedTimeNs);
+
+    CaptureClockStats stats = clock.Stats();
+    EXPECT_NEAR(41666666, stats.estimatedIntervalNs, 1);
+    EXPECT_EQ(0u, stats.rateChanges);
+    EXPECT_LE(stats.maxJitterNs, 1);
+}
+
+TEST(PHCaptureClockTest, ExpectedRateChangeReseedsEstimate)
+{
+    CaptureClock clock(k30fps);
+    int64_t pts = 0;
+
+    for (int i = 0; i < 10; i++) {
+        pts = i * k30fps;
+        clock.Update(pts, 1000000000, pts);
+    }
+
+    clock.ExpectRateChange();
+
+    for (int i = 0; i < 3; i++) {
+        pts += k30fps / 2;
+        CaptureClockFrame frame = clock.Update(pts, 1000000000, pts);
+        EXPECT_EQ(0, frame.missedFrames);
+    }
+
+    CaptureClockStats stats = clock.Stats();
+    EXPECT_EQ(1u, stats.rateChanges);
+    EXPECT_NEAR(k30fps / 2, stats.estimatedIntervalNs, 1);
+}
+
+TEST(PHCaptureClockTest, ResetStartsANewTimeline)
+{
+    CaptureClock clock(k30fps);
+
+    clock.Update(0, 1000, 5 * kMsec);
+    clock.Update(33, 1000, 40 * kMsec);
+    clock.NoteDroppedFrame();
+
+    clock.Reset(k30fps);
+
+    CaptureClockFrame frame = clock.Update(1000, 1000, 2000 * kMsec);
+    EXPECT_EQ(2000 * kMsec, frame.timestampNs);
+    EXPECT_EQ(0, frame.elapsedTimeNs);
+
+    CaptureClockStats stats = clock.Stats();
+    EXPECT_EQ(1u, stats.frames);
+    EXPECT_EQ(0u, stats.reportedDrops);
+}
@@ -0,0 +1,259 @@
+//
+//  PHCaptureRingTests.cpp
+//  PerchRTCTests
+//
+//  Created by Christopher Eagleston on 2015-08-11.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#include "PHCaptureRing.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace perch;
+
+namespace {
+
+    const int64_t kMsec = 1000000;
+
+    // Every value is accounted for exactly once, as delivered, discarded by the producer, flushed, or still queued.
+    struct Ledger
+    {
+        explicit Ledger(size_t count) : seen(count) {}
+
+        void Record(uint64_t value)
+        {
+            seen[value].fetch_add(1, std::memory_order_relaxed);
+        }
+
+        int Missing() const
+        {
+            int missing = 0;
+
+            for (const std::atomic<int> &count : seen) {
+                missing += count.load() == 0;
+            }
+
+            return missing;
+        }
+
+        int Duplicated() const
+        {
+            int duplicated = 0;
+
+            for (const std::atomic<int> &count : seen) {
+                duplicated += count.load() > 1;
+            }
+
+            return duplicated;
+        }
+
+        std::vector<std::atomic<int>> seen;
+    };
+
+} // namespace
+
+TEST(PHCaptureRingTest, DepthIsClamped)
+{
+    EXPECT_EQ(kCaptureRingMinDepth, CaptureRing<int>(0).Depth());
+    EXPECT_EQ(kCaptureRingMinDepth, CaptureRing<int>(1).Depth());
+    EXPECT_EQ(5u, CaptureRing<int>(5).Depth());
+    EXPECT_EQ(kCaptureRingMaxDepth, CaptureRing<int>(100).Depth());
+}
+
+TEST(PHCaptureRingTest, PushAndPopInOrder)
+{
+    CaptureRing<int> ring(4);
+    int discarded = -1;
+
+    for (int i = 0; i < 3; i++) {
+        EXPECT_EQ(CaptureRing<int>::kPushed, ring.Push(i, i * kMsec, &discarded));
+    }
+
+    EXPECT_EQ(3u, ring.Size());
+
+    for (int i = 0; i < 3; i++) {
+        int value = -1;
+        int64_t latency = -1;
+
+        ASSERT_TRUE(ring.Pop(10 * kMsec, &value, &latency));
+        EXPECT_EQ(i, value);
+        EXPECT_EQ((10 - i) * kMsec, latency);
+    }
+
+    int value;
+    EXPECT_FALSE(ring.Pop(0, &value, NULL));
+    EXPECT_EQ(-1, discarded);
+}
+
+TEST(PHCaptureRingTest, FullRingEvictsOldest)
+{
+    CaptureRing<int> ring(3);
+    int discarded = -1;
+
+    for (int i = 0; i < 3; i++) {
+        ring.Push(i, 0, &discarded);
+    }
+
+    EXPECT_EQ(CaptureRing<int>::kPushedEvictingOldest, ring.Push(3, 0, &discarded));
+    EXPECT_EQ(0, discarded);
+    EXPECT_EQ(CaptureRing<int>::kPushedEvictingOldest, ring.Push(4, 0, &discarded));
+    EXPECT_EQ(1, discarded);
+
+    int value;
+    for (int expected = 2; expected <= 4; expected++) {
+        ASSERT_TRUE(ring.Pop(0, &value, NULL));
+        EXPECT_EQ(expected, value);
+    }
+
+    CaptureRingStats stats = ring.Stats();
+    EXPECT_EQ(5u, stats.pushed);
+    EXPECT_EQ(3u, stats.popped);
+    EXPECT_EQ(2u, stats.evicted);
+    EXPECT_EQ(0u, stats.rejected);
+}
+
+TEST(PHCaptureRingTest, DiscardIsNotCountedAsDelivered)
+{
+    CaptureRing<int> ring(2);
+    int discarded;
+
+    ring.Push(7, 0, &discarded);
+
+    int value = 0;
+    ASSERT_TRUE(ring.Discard(&value));
+    EXPECT_EQ(7, value);
+    EXPECT_FALSE(ring.Discard(&value));
+
+    EXPECT_EQ(0u, ring.Stats().popped);
+}
+
+TEST(PHCaptureRingTest, MoveOnlyValues)
+{
+    CaptureRing<std::unique_ptr<int>> ring(2);
+    std::unique_ptr<int> discarded;
+
+    for (int i = 0; i < 3; i++) {
+        ring.Push(std::unique_ptr<int>(new int(i)), 0, &discarded);
+    }
+
+    ASSERT_TRUE(discarded != nullptr);
+    EXPECT_EQ(0, *discarded);
+
+    std::unique_ptr<int> value;
+    ASSERT_TRUE(ring.Pop(0, &value, NULL));
+    EXPECT_EQ(1, *value);
+}
+
+TEST(PHCaptureRingTest, HistogramsUseCallerClock)
+{
+    CaptureRing<int> ring(4);
+    int discarded, value;
+
+    // Waits of 0.1, 3 and 700 msec.
+
+    const int64_t waits[] = { kMsec / 10, 3 * kMsec, 700 * kMsec };
+
+    for (int64_t wait : waits) {
+        ring.Push(0, 0, &discarded);
+        ring.Pop(wait, &value, NULL);
+    }
+
+    ring.Push(0, 0, &discarded);
+    ring.Push(0, 0, &discarded);
+
+    CaptureRingStats stats = ring.Stats();
+    EXPECT_EQ(1u, stats.latencyHistogram[0]);
+    EXPECT_EQ(1u, stats.latencyHistogram[CaptureRingLatencyBucket(3 * kMsec)]);
+    EXPECT_EQ(1u, stats.latencyHistogram[kCaptureRingLatencyBuckets - 1]);
+    EXPECT_EQ((uint64_t)(700 * kMsec), stats.maxLatencyNs);
+    EXPECT_EQ(4u, stats.depthHistogram[1]);
+    EXPECT_EQ(1u, stats.depthHistogram[2]);
+}
+
+TEST(PHCaptureRingTest, LatencyBuckets)
+{
+    EXPECT_EQ(0, CaptureRingLatencyBucket(0));
+    EXPECT_EQ(0, CaptureRingLatencyBucket(kCaptureRingFirstLatencyBucketNs - 1));
+    EXPECT_EQ(1, CaptureRingLatencyBucket(kCaptureRingFirstLatencyBucketNs));
+    EXPECT_EQ(2, CaptureRingLatencyBucket(2 * kCaptureRingFirstLatencyBucketNs));
+    EXPECT_EQ(kCaptureRingLatencyBuckets - 1, CaptureRingLatencyBucket(512 * 1000 * kMsec));
+}
+
+// One producer and one consumer, with a third thread flushing the ring as Stop() does. Every value must come out
+// exactly once, and the consumer must see its values in order. Build with PERCH_SANITIZE=thread to check for races.
+TEST(PHCaptureRingTest, StressProducerConsumerAndFlusher)
+{
+    const size_t depths[] = { kCaptureRingMinDepth, 3, kCaptureRingMaxDepth };
+    const uint64_t count = 100000;
+
+    for (size_t depth : depths) {
+        CaptureRing<uint64_t> ring(depth);
+        Ledger ledger(count);
+        std::atomic<bool> done(false);
+        std::atomic<int> outOfOrder(0);
+
+        std::thread producer([&]() {
+            for (uint64_t value = 0; value < count; value++) {
+                uint64_t discarded = 0;
+
+                if (ring.Push(value, (int64_t)value, &discarded) != CaptureRing<uint64_t>::kPushed) {
+                    ledger.Record(discarded);
+                }
+            }
+
+            done.store(true);
+        });
+
+        std::thread consumer([&]() {
+            uint64_t last = 0;
+            bool first = true;
+            uint64_t value;
+
+            while (!done.load() || ring.Size() > 0) {
+                if (ring.Pop((int64_t)count, &value, NULL)) {
+                    if (!first && value <= last) {
+                        outOfOrder.fetch_add(1);
+                    }
+
+                    first = false;
+                    last = value;
+                    ledger.Record(value);
+                }
+            }
+        });
+
+        std::thread flusher([&]() {
+            uint64_t value;
+
+            while (!done.load()) {
+                if (ring.Discard(&value)) {
+                    ledger.Record(value);
+                }
+
+                std::this_thread::yield();
+            }
+        });
+
+        producer.join();
+        consumer.join();
+        flusher.join();
+
+        uint64_t value;
+        while (ring.Discard(&value)) {
+            ledger.Record(value);
+        }
+
+        EXPECT_EQ(0, ledger.Missing()) << "depth " << depth;
+        EXPECT_EQ(0, ledger.Duplicated()) << "depth " << depth;
+        EXPECT_EQ(0, outOfOrder.load()) << "depth " << depth;
+
+        CaptureRingStats stats = ring.Stats();
+        EXPECT_EQ(count, stats.pushed + stats.rejected) << "depth " << depth;
+    }
+}
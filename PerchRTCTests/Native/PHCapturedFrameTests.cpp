@@ -0,0 +1,236 @@
+//
+//  PHCapturedFrameTests.cpp
+//  PerchRTCTests
+//
+//  Created by Christopher Eagleston on 2015-08-11.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#include "PHCapturedFrame.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace perch;
+
+namespace {
+
+    // Stands in for a retained CMSampleBufferRef, and counts how many are still alive.
+    class FakeFrameSource : public CapturedFrameSource
+    {
+    public:
+        FakeFrameSource(std::atomic<int> &live, int tag) : _live(live), _tag(tag), _pixels(16 * 16 * 3 / 2, (uint8_t)tag)
+        {
+            _live.fetch_add(1);
+        }
+
+        ~FakeFrameSource() override
+        {
+            _live.fetch_sub(1);
+        }
+
+        int Width() const override { return 16; }
+        int Height() const override { return 16; }
+        uint32_t Format() const override { return kFrameFormatI420; }
+
+        bool LockPlanes(CapturedFramePlanes *planes) override
+        {
+            planes->planeCount = 3;
+            planes->data[0] = _pixels.data();
+            planes->data[1] = _pixels.data() + 256;
+            planes->data[2] = _pixels.data() + 320;
+            planes->strides[0] = 16;
+            planes->strides[1] = 8;
+            planes->strides[2] = 8;
+            return true;
+        }
+
+        void UnlockPlanes() override {}
+
+        int Tag() const { return _tag; }
+
+    private:
+        std::atomic<int> &_live;
+        const int _tag;
+        std::vector<uint8_t> _pixels;
+    };
+
+    class PHCapturedFrameTest : public ::testing::Test
+    {
+    protected:
+        PHCapturedFrameTest() : _live(0) {}
+
+        CapturedFrame *MakeFrame(int tag)
+        {
+            return CapturedFrame::Create(std::unique_ptr<CapturedFrameSource>(new FakeFrameSource(_live, tag)), tag * 1000, tag * 1000);
+        }
+
+        int TagOf(CapturedFrame *frame)
+        {
+            return static_cast<FakeFrameSource &>(frame->Source()).Tag();
+        }
+
+        std::atomic<int> _live;
+    };
+
+} // namespace
+
+TEST_F(PHCapturedFrameTest, SourceLivesUntilLastReference)
+{
+    CapturedFrame *frame = MakeFrame(1);
+
+    EXPECT_EQ(2, frame->AddRef());
+    EXPECT_EQ(1, frame->Release());
+    EXPECT_EQ(1, _live.load());
+
+    EXPECT_EQ(0, frame->Release());
+    EXPECT_EQ(0, _live.load());
+}
+
+TEST_F(PHCapturedFrameTest, CreateRejectsMissingSource)
+{
+    EXPECT_TRUE(CapturedFrame::Create(std::unique_ptr<CapturedFrameSource>(), 0, 0) == NULL);
+}
+
+TEST_F(PHCapturedFrameTest, QueueDeliversInOrderAndStampsTimes)
+{
+    CapturedFrameQueue queue(3);
+
+    for (int tag = 1; tag <= 2; tag++) {
+        CapturedFrame *frame = MakeFrame(tag);
+        frame->RecordCopy();
+        EXPECT_TRUE(queue.Push(frame, tag * 100));
+        frame->Release();
+    }
+
+    for (int tag = 1; tag <= 2; tag++) {
+        CapturedFrame *frame = queue.Pop(1000 + tag);
+
+        ASSERT_TRUE(frame != NULL);
+        EXPECT_EQ(tag, TagOf(frame));
+        EXPECT_EQ(tag * 100, frame->EnqueueTimeNs());
+        EXPECT_EQ(1000 + tag, frame->DequeueTimeNs());
+
+        frame->Release();
+    }
+
+    EXPECT_TRUE(queue.Pop(2000) == NULL);
+    EXPECT_EQ(2u, queue.Stats().copies);
+    EXPECT_EQ(0, _live.load());
+}
+
+// A consumer which falls behind loses the oldest frames, and their capture buffers are given back immediately.
+TEST_F(PHCapturedFrameTest, FullQueueReleasesOldestFrame)
+{
+    CapturedFrameQueue queue(3);
+
+    for (int tag = 1; tag <= 5; tag++) {
+        CapturedFrame *frame = MakeFrame(tag);
+        queue.Push(frame, tag);
+        frame->Release();
+    }
+
+    EXPECT_EQ(3, _live.load());
+    EXPECT_EQ(2u, queue.Stats().ring.evicted);
+
+    CapturedFrame *frame = queue.Pop(10);
+    ASSERT_TRUE(frame != NULL);
+    EXPECT_EQ(3, TagOf(frame));
+    frame->Release();
+
+    queue.Clear();
+
+    EXPECT_EQ(0, _live.load());
+}
+
+TEST_F(PHCapturedFrameTest, PooledSourceReturnsBufferToPool)
+{
+    FramePool pool(std::unique_ptr<FrameAllocator>(new AlignedHeapAllocator()), 2);
+    FrameBuffer *buffer = pool.Acquire(FrameKey(33, 17, kFrameFormatI420));
+    ASSERT_TRUE(buffer != NULL);
+
+    {
+        PooledFrameSource source(pool, buffer);
+
+        // Planes are packed back to back, without padding.
+
+        int strides[3];
+        uint8_t *y = source.MutablePlane(0, &strides[0]);
+        uint8_t *u = source.MutablePlane(1, &strides[1]);
+        uint8_t *v = source.MutablePlane(2, &strides[2]);
+
+        EXPECT_EQ(33, strides[0]);
+        EXPECT_EQ(17, strides[1]);
+        EXPECT_EQ(17, strides[2]);
+        EXPECT_EQ(y + 33 * 17, u);
+        EXPECT_EQ(u + 17 * 9, v);
+        EXPECT_EQ((size_t)(33 * 17 + 2 * 17 * 9), source.ByteSize());
+        EXPECT_TRUE(source.MutablePlane(3, &strides[0]) == NULL);
+
+        CapturedFramePlanes planes;
+        ASSERT_TRUE(source.LockPlanes(&planes));
+        EXPECT_EQ(3, planes.planeCount);
+        EXPECT_EQ(y, planes.data[0]);
+
+        EXPECT_EQ(1u, pool.Stats().outstanding);
+    }
+
+    EXPECT_EQ(0u, pool.Stats().outstanding);
+}
+
+// The capture bridge queues and posts under a lock, and Stop() clears the queue under the same lock. Whatever order
+// the three threads run in, no frame may be left queued after a stop, which would hold a capture buffer until the next start.
+TEST_F(PHCapturedFrameTest, StopNeverStrandsQueuedFrames)
+{
+    for (int round = 0; round < 50; round++) {
+        CapturedFrameQueue queue(3);
+        std::mutex startThreadLock;
+        bool running = true;
+        std::atomic<bool> stopped(false);
+
+        std::thread producer([&]() {
+            for (int tag = 0; tag < 200; tag++) {
+                CapturedFrame *frame = MakeFrame(tag);
+
+                {
+                    std::lock_guard<std::mutex> lock(startThreadLock);
+
+                    if (running) {
+                        queue.Push(frame, tag);
+                    }
+                }
+
+                frame->Release();
+            }
+        });
+
+        std::thread consumer([&]() {
+            while (!stopped.load()) {
+                CapturedFrame *frame = queue.Pop(0);
+
+                if (frame != NULL) {
+                    frame->Release();
+                }
+            }
+        });
+
+        std::this_thread::yield();
+
+        {
+            std::lock_guard<std::mutex> lock(startThreadLock);
+            running = false;
+            queue.Clear();
+        }
+
+        stopped.store(true);
+        producer.join();
+        consumer.join();
+
+        EXPECT_TRUE(queue.Pop(0) == NULL);
+        EXPECT_EQ(0, _live.load());
+    }
+}
@@ -0,0 +1,220 @@
+//
+//  PHColorConvertTests.cpp
+//  PerchRTCTests
+//
+//  Created by Christopher Eagleston on 2015-08-11.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#include "PHColorConvert.h"
+
+#include <gtest/gtest.h>
+
+#include <math.h>
+#include <stdlib.h>
+#include <vector>
+
+namespace {
+
+    const PHConvertKernel kKernels[] = { PHConvertKernelScalar, PHConvertKernelNEON, PHConvertKernelSSE2, PHConvertKernelAVX2 };
+    const PHColorMatrix kMatrices[] = { PHColorMatrixBT601VideoRange, PHColorMatrixBT601FullRange, PHColorMatrixBT709VideoRange, PHColorMatrixBT709FullRange };
+    const PHRGBLayout kLayouts[] = { PHRGBLayoutBGRA, PHRGBLayoutARGB, PHRGBLayoutRGBA };
+
+    // 6-bit coefficients are within this much of the exact conversion.
+    const int kMaxError = 3;
+
+    std::vector<uint8_t> RandomBytes(size_t count, unsigned int seed)
+    {
+        std::vector<uint8_t> bytes(count);
+
+        srand(seed);
+
+        for (size_t i = 0; i < count; i++) {
+            bytes[i] = (uint8_t)(rand() & 0xFF);
+        }
+
+        return bytes;
+    }
+
+    void ReferenceRGB(int y, int u, int v, PHColorMatrix matrix, int rgb[3])
+    {
+        bool isBT709 = matrix == PHColorMatrixBT709VideoRange || matrix == PHColorMatrixBT709FullRange;
+        bool isVideoRange = matrix == PHColorMatrixBT601VideoRange || matrix == PHColorMatrixBT709VideoRange;
+
+        double kr = isBT709 ? 0.2126 : 0.299;
+        double kb = isBT709 ? 0.0722 : 0.114;
+        double luma = isVideoRange ? (y - 16) * 255.0 / 219.0 : y;
+        double cb = (u - 128) * (isVideoRange ? 255.0 / 224.0 : 1.0);
+        double cr = (v - 128) * (isVideoRange ? 255.0 / 224.0 : 1.0);
+
+        double r = luma + 2 * (1 - kr) * cr;
+        double b = luma + 2 * (1 - kb) * cb;
+        double g = (luma - kr * r - kb * b) / (1 - kr - kb);
+        double channels[3] = { r, g, b };
+
+        for (int i = 0; i < 3; i++) {
+            rgb[i] = (int)lround(channels[i] < 0 ? 0 : (channels[i] > 255 ? 255 : channels[i]));
+        }
+    }
+
+    class PHColorConvertTest : public ::testing::Test
+    {
+    protected:
+        virtual void TearDown()
+        {
+            PHConvertSelectKernel(PHConvertKernelAutomatic);
+        }
+    };
+
+} // namespace
+
+TEST_F(PHColorConvertTest, RowKernelsMatchScalar)
+{
+    PHColorConvertRowFunction reference = PHColorConvertI420RowFunction(PHConvertKernelScalar);
+
+    for (PHConvertKernel kernel : kKernels) {
+        PHColorConvertRowFunction convertRow = PHColorConvertI420RowFunction(kernel);
+
+        if (!convertRow) {
+            continue;
+        }
+
+        for (PHColorMatrix matrix : kMatrices) {
+            for (PHRGBLayout layout : kLayouts) {
+                for (int width = 1; width < 70; width++) {
+                    std::vector<uint8_t> y = RandomBytes(width, width);
+                    std::vector<uint8_t> u = RandomBytes((width + 1) / 2, width + 100);
+                    std::vector<uint8_t> v = RandomBytes((width + 1) / 2, width + 200);
+                    std::vector<uint8_t> expected(4 * width + 16, 0);
+                    std::vector<uint8_t> actual(4 * width + 16, 0);
+
+                    reference(y.data(), u.data(), v.data(), expected.data(), width, matrix, layout);
+                    convertRow(y.data(), u.data(), v.data(), actual.data(), width, matrix, layout);
+
+                    ASSERT_EQ(expected, actual) << "kernel " << kernel << " matrix " << matrix << " layout " << layout << " width " << width;
+                }
+            }
+        }
+    }
+}
+
+TEST_F(PHColorConvertTest, MatricesAreCloseToExactConversion)
+{
+    for (PHColorMatrix matrix : kMatrices) {
+        for (int y = 0; y < 256; y += 3) {
+            for (int u = 0; u < 256; u += 5) {
+                for (int v = 0; v < 256; v += 5) {
+                    uint8_t srcY[2] = { (uint8_t)y, (uint8_t)y };
+                    uint8_t srcU = (uint8_t)u;
+                    uint8_t srcV = (uint8_t)v;
+                    uint8_t rgba[8];
+                    int expected[3];
+
+                    PHConvertI420ToRGB(srcY, 2, &srcU, 1, &srcV, 1, rgba, 8, 2, 1, matrix, PHRGBLayoutRGBA);
+                    ReferenceRGB(y, u, v, matrix, expected);
+
+                    for (int channel = 0; channel < 3; channel++) {
+                        ASSERT_NEAR(expected[channel], rgba[channel], kMaxError) << "matrix " << matrix << " yuv " << y << " " << u << " " << v;
+                    }
+
+                    ASSERT_EQ(0xFF, rgba[3]);
+                }
+            }
+        }
+    }
+}
+
+TEST_F(PHColorConvertTest, RangeEndpoints)
+{
+    struct {
+        PHColorMatrix matrix;
+        uint8_t black;
+        uint8_t white;
+    } cases[] = {
+        { PHColorMatrixBT601VideoRange, 16, 235 },
+        { PHColorMatrixBT709VideoRange, 16, 235 },
+        { PHColorMatrixBT601FullRange, 0, 255 },
+        { PHColorMatrixBT709FullRange, 0, 255 },
+    };
+
+    for (const auto &c : cases) {
+        uint8_t y[2] = { c.black, c.white };
+        uint8_t chroma = 128;
+        uint8_t rgba[8];
+
+        PHConvertI420ToRGB(y, 2, &chroma, 1, &chroma, 1, rgba, 8, 2, 1, c.matrix, PHRGBLayoutRGBA);
+
+        EXPECT_EQ(0, rgba[0]);
+        EXPECT_EQ(0, rgba[1]);
+        EXPECT_EQ(0, rgba[2]);
+        EXPECT_EQ(255, rgba[4]);
+        EXPECT_EQ(255, rgba[5]);
+        EXPECT_EQ(255, rgba[6]);
+    }
+}
+
+TEST_F(PHColorConvertTest, LayoutsOrderChannels)
+{
+    // Saturated red.
+    uint8_t y[2] = { 76, 76 };
+    uint8_t u = 85;
+    uint8_t v = 255;
+    uint8_t rgba[8], bgra[8], argb[8];
+
+    PHConvertI420ToRGB(y, 2, &u, 1, &v, 1, rgba, 8, 2, 1, PHColorMatrixBT601FullRange, PHRGBLayoutRGBA);
+    PHConvertI420ToRGB(y, 2, &u, 1, &v, 1, bgra, 8, 2, 1, PHColorMatrixBT601FullRange, PHRGBLayoutBGRA);
+    PHConvertI420ToRGB(y, 2, &u, 1, &v, 1, argb, 8, 2, 1, PHColorMatrixBT601FullRange, PHRGBLayoutARGB);
+
+    EXPECT_GT(rgba[0], 250);
+    EXPECT_LT(rgba[1], 5);
+    EXPECT_LT(rgba[2], 5);
+
+    EXPECT_EQ(rgba[0], bgra[2]);
+    EXPECT_EQ(rgba[1], bgra[1]);
+    EXPECT_EQ(rgba[2], bgra[0]);
+    EXPECT_EQ(0xFF, bgra[3]);
+
+    EXPECT_EQ(0xFF, argb[0]);
+    EXPECT_EQ(rgba[0], argb[1]);
+    EXPECT_EQ(rgba[1], argb[2]);
+    EXPECT_EQ(rgba[2], argb[3]);
+}
+
+TEST_F(PHColorConvertTest, NV12MatchesI420)
+{
+    // Odd dimensions, and destination rows with padding that must be left alone.
+    const int width = 77;
+    const int height = 9;
+    const int chromaWidth = (width + 1) / 2;
+    const int chromaHeight = (height + 1) / 2;
+    const int dstStride = 4 * width + 12;
+
+    std::vector<uint8_t> y = RandomBytes(width * height, 1);
+    std::vector<uint8_t> u = RandomBytes(chromaWidth * chromaHeight, 2);
+    std::vector<uint8_t> v = RandomBytes(chromaWidth * chromaHeight, 3);
+    std::vector<uint8_t> uv(2 * chromaWidth * chromaHeight);
+
+    PHInterleavePlanes(u.data(), chromaWidth, v.data(), chromaWidth, uv.data(), 2 * chromaWidth, chromaWidth, chromaHeight);
+
+    for (PHConvertKernel kernel : kKernels) {
+        if (!PHConvertSelectKernel(kernel)) {
+            continue;
+        }
+
+        std::vector<uint8_t> fromI420(dstStride * height, 0x5A);
+        std::vector<uint8_t> fromNV12(dstStride * height, 0x5A);
+
+        PHConvertI420ToRGB(y.data(), width, u.data(), chromaWidth, v.data(), chromaWidth,
+                           fromI420.data(), dstStride, width, height, PHColorMatrixBT709VideoRange, PHRGBLayoutBGRA);
+        PHConvertNV12ToRGB(y.data(), width, uv.data(), 2 * chromaWidth,
+                           fromNV12.data(), dstStride, width, height, PHColorMatrixBT709VideoRange, PHRGBLayoutBGRA);
+
+        ASSERT_EQ(fromI420, fromNV12) << "kernel " << kernel;
+
+        for (int row = 0; row < height; row++) {
+            for (int x = 4 * width; x < dstStride; x++) {
+                ASSERT_EQ(0x5A, fromI420[row * dstStride + x]);
+            }
+        }
+    }
+}
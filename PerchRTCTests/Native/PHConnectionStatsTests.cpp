@@ -0,0 +1,316 @@
+//
+//  PHConnectionStatsTests.cpp
+//  PerchRTCTests
+//
+//  Created by Christopher Eagleston on 2015-08-11.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#include "PHConnectionStats.h"
+#include "PHTestData.h"
+
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <thread>
+
+using namespace perch;
+
+namespace {
+
+    // Replays a dump of getStats rounds, as PHMediaSession's didGetStats: would parse and record them.
+    std::vector<StatsSnapshot> ReplayDump(const std::string &name, ConnectionStats *stats)
+    {
+        std::vector<StatsSnapshot> snapshots;
+        StatsReportParser parser;
+        bool inRound = false;
+        bool inReport = false;
+
+        for (const std::string &line : test::ReadTraceLines("ConnectionStats/" + name)) {
+            size_t space = line.find(' ');
+            std::string word = line.substr(0, space);
+            std::string rest = space == std::string::npos ? std::string() : line.substr(space + 1);
+
+            if (inReport && (word == "round" || word == "report")) {
+                parser.End();
+                inReport = false;
+            }
+
+            if (word == "round") {
+                if (inRound) {
+                    snapshots.push_back(parser.Snapshot());
+                }
+
+                parser = StatsReportParser();
+                inRound = true;
+            }
+            else if (word == "report") {
+                char type[64], reportId[64];
+                double timestampMs = 0;
+
+                EXPECT_EQ(3, sscanf(rest.c_str(), "%63s %63s %lf", type, reportId, &timestampMs)) << line;
+                inReport = parser.Begin(type, reportId, timestampMs);
+            }
+            else if (inReport) {
+                parser.AddValue(word.c_str(), rest.c_str());
+            }
+        }
+
+        if (inReport) {
+            parser.End();
+        }
+        if (inRound) {
+            snapshots.push_back(parser.Snapshot());
+        }
+
+        for (const StatsSnapshot &snapshot : snapshots) {
+            stats->Record(snapshot);
+        }
+
+        return snapshots;
+    }
+
+    StatsSnapshot Stream(uint32_t ssrc, int64_t timestampMs, int64_t bytes)
+    {
+        StatsSnapshot snapshot;
+        StreamStats stream;
+
+        stream.ssrc = ssrc;
+        stream.media = StatsMediaVideo;
+        stream.direction = StatsDirectionReceive;
+        stream.timestampMs = timestampMs;
+        stream.bytes = bytes;
+        snapshot.streams.push_back(stream);
+
+        return snapshot;
+    }
+
+} // namespace
+
+TEST(PHConnectionStatsTest, ParseRecordedReports)
+{
+    ConnectionStats stats;
+    std::vector<StatsSnapshot> snapshots = ReplayDump("one_to_one_call.stats", &stats);
+
+    ASSERT_EQ(5u, snapshots.size());
+
+    // Tracks and the inactive candidate pair aren't recorded.
+
+    const StatsSnapshot &last = snapshots.back();
+    ASSERT_EQ(4u, last.streams.size());
+
+    const StreamStats &videoSend = last.streams[0];
+    EXPECT_EQ(2841963702u, videoSend.ssrc);
+    EXPECT_EQ(StatsMediaVideo, videoSend.media);
+    EXPECT_EQ(StatsDirectionSend, videoSend.direction);
+    EXPECT_EQ(1439295604000, videoSend.timestampMs);
+    EXPECT_EQ(250000, videoSend.bytes);
+    EXPECT_EQ(200, videoSend.packets);
+    EXPECT_EQ(48, videoSend.rttMs);
+    EXPECT_EQ(30, videoSend.frameRate);
+    EXPECT_EQ(640, videoSend.frameWidth);
+    EXPECT_EQ(480, videoSend.frameHeight);
+    EXPECT_EQ(7, videoSend.codecTimeMs);
+    EXPECT_EQ(-1, videoSend.jitterMs);
+
+    const StreamStats &videoReceive = last.streams[1];
+    EXPECT_EQ(StatsDirectionReceive, videoReceive.direction);
+    EXPECT_EQ(6, videoReceive.packetsLost);
+    EXPECT_EQ(360, videoReceive.frameHeight);
+    EXPECT_EQ(4, videoReceive.codecTimeMs);
+
+    EXPECT_EQ(StatsMediaAudio, last.streams[2].media);
+    EXPECT_EQ(12, last.streams[3].jitterMs);
+
+    // Bits per second become kbps, a fraction is dropped, and the RTT is the active pair's.
+
+    ASSERT_TRUE(last.hasBandwidth);
+    EXPECT_EQ(1600, last.bandwidth.availableSendKbps);
+    EXPECT_EQ(900, last.bandwidth.availableReceiveKbps);
+    EXPECT_EQ(550, last.bandwidth.transmitKbps);
+    EXPECT_EQ(0, last.bandwidth.retransmitKbps);
+    EXPECT_EQ(500, last.bandwidth.targetEncodeKbps);
+    EXPECT_EQ(480, last.bandwidth.actualEncodeKbps);
+    EXPECT_EQ(49, last.bandwidth.rttMs);
+}
+
+TEST(PHConnectionStatsTest, RatesFromRecordedCall)
+{
+    ConnectionStats stats;
+    ReplayDump("one_to_one_call.stats", &stats);
+
+    StreamStats history[ConnectionStats::kSeriesCapacity];
+
+    // The first sample has nothing to compare with.
+
+    ASSERT_EQ(5u, stats.StreamHistory(3995264871u, history, ConnectionStats::kSeriesCapacity));
+    EXPECT_EQ(0, history[0].intervalMs);
+    EXPECT_EQ(0u, history[0].bitrateKbps);
+
+    struct Case
+    {
+        uint32_t bitrateKbps;
+        uint32_t packetRate;
+        float lossFraction;
+    };
+
+    const Case expected[] = {
+        { 0, 0, 0 },
+        { 300, 40, 0 },
+        { 300, 40, 2.0f / 42 },
+        { 300, 40, 0 },
+        { 300, 40, 4.0f / 44 },
+    };
+
+    for (size_t i = 0; i < 5; i++) {
+        EXPECT_EQ(i > 0 ? 1000 : 0, history[i].intervalMs) << i;
+        EXPECT_EQ(expected[i].bitrateKbps, history[i].bitrateKbps) << i;
+        EXPECT_EQ(expected[i].packetRate, history[i].packetRate) << i;
+        EXPECT_FLOAT_EQ(expected[i].lossFraction, history[i].lossFraction) << i;
+    }
+
+    // Sent packets count as expected, without the lost ones.
+
+    StreamStats videoSend;
+    ASSERT_EQ(5u, stats.StreamHistory(2841963702u, history, ConnectionStats::kSeriesCapacity));
+    EXPECT_EQ(500u, history[4].bitrateKbps);
+    EXPECT_FLOAT_EQ(1.0f / 50, history[3].lossFraction);
+    ASSERT_TRUE(stats.LatestStream(2841963702u, &videoSend));
+    EXPECT_EQ(1439295604000, videoSend.timestampMs);
+
+    StreamStats streams[ConnectionStats::kMaxStreams];
+    EXPECT_EQ(1u, stats.LatestStreams(StatsMediaVideo, StatsDirectionReceive, streams, ConnectionStats::kMaxStreams));
+    EXPECT_EQ(3995264871u, streams[0].ssrc);
+    EXPECT_EQ(1u, stats.LatestStreams(StatsMediaAudio, StatsDirectionSend, streams, ConnectionStats::kMaxStreams));
+    EXPECT_EQ(1148223591u, streams[0].ssrc);
+
+    BandwidthStats bandwidth;
+    ASSERT_TRUE(stats.LatestBandwidth(&bandwidth));
+    EXPECT_EQ(1600, bandwidth.availableSendKbps);
+}
+
+TEST(PHConnectionStatsTest, RecreatedStreamStartsOver)
+{
+    ConnectionStats stats;
+    ReplayDump("stream_recreated.stats", &stats);
+
+    StreamStats history[ConnectionStats::kSeriesCapacity];
+
+    // The report collected twice is recorded once, and the sample after the reset has no rates.
+
+    ASSERT_EQ(4u, stats.StreamHistory(3995264871u, history, ConnectionStats::kSeriesCapacity));
+    EXPECT_EQ(300u, history[1].bitrateKbps);
+    EXPECT_EQ(2000, history[2].bytes);
+    EXPECT_EQ(0u, history[2].bitrateKbps);
+    EXPECT_EQ(0, history[2].intervalMs);
+    EXPECT_EQ(300u, history[3].bitrateKbps);
+    EXPECT_EQ(1000, history[3].intervalMs);
+}
+
+// A new SSRC with every slot taken takes the one which has gone longest without a sample.
+TEST(PHConnectionStatsTest, NewStreamTakesTheStalestSlot)
+{
+    ConnectionStats stats;
+
+    for (uint32_t ssrc = 1; ssrc <= ConnectionStats::kMaxStreams; ssrc++) {
+        stats.Record(Stream(ssrc, 1000, 0));
+    }
+    for (uint32_t ssrc = 1; ssrc <= ConnectionStats::kMaxStreams; ssrc++) {
+        if (ssrc != 3) {
+            stats.Record(Stream(ssrc, 2000, 1000));
+        }
+    }
+
+    stats.Record(Stream(100, 3000, 0));
+
+    StreamStats latest;
+    EXPECT_FALSE(stats.LatestStream(3, &latest));
+    ASSERT_TRUE(stats.LatestStream(100, &latest));
+    EXPECT_EQ(0u, latest.bitrateKbps);
+
+    StreamStats history[ConnectionStats::kSeriesCapacity];
+    EXPECT_EQ(1u, stats.StreamHistory(100, history, ConnectionStats::kSeriesCapacity));
+    EXPECT_EQ(2u, stats.StreamHistory(4, history, ConnectionStats::kSeriesCapacity));
+    EXPECT_EQ(0u, stats.StreamHistory(3, history, ConnectionStats::kSeriesCapacity));
+}
+
+TEST(PHConnectionStatsTest, SeriesKeepsTheLatestSamples)
+{
+    StatsSeries<int64_t, 4> series;
+    int64_t samples[8];
+    int64_t latest = 0;
+
+    EXPECT_FALSE(series.Latest(&latest));
+    EXPECT_EQ(0u, series.Copy(samples, 8));
+
+    for (int64_t i = 1; i <= 10; i++) {
+        series.Append(i);
+    }
+
+    EXPECT_EQ(10u, series.Count());
+    ASSERT_TRUE(series.Latest(&latest));
+    EXPECT_EQ(10, latest);
+
+    ASSERT_EQ(4u, series.Copy(samples, 8));
+    EXPECT_EQ(std::vector<int64_t>({ 7, 8, 9, 10 }), std::vector<int64_t>(samples, samples + 4));
+
+    ASSERT_EQ(2u, series.Copy(samples, 2));
+    EXPECT_EQ(std::vector<int64_t>({ 9, 10 }), std::vector<int64_t>(samples, samples + 2));
+}
+
+// The stats are recorded on the main queue and read from the capture and render threads. A reader must never see a
+// sample which is half written: every field of these is the same number, so a torn one is easy to spot.
+TEST(PHConnectionStatsTest, ReadersNeverSeeTornSamples)
+{
+    StatsSeries<BandwidthStats, 64> series;
+    const int32_t kSamples = 20000;
+    bool torn = false, copiedTorn = false;
+    bool outOfOrder = false, copiedOutOfOrder = false;
+
+    std::thread writer([&]() {
+        for (int32_t i = 1; i <= kSamples; i++) {
+            BandwidthStats sample;
+            sample.timestampMs = i;
+            sample.availableSendKbps = sample.availableReceiveKbps = sample.transmitKbps = i;
+            sample.retransmitKbps = sample.targetEncodeKbps = sample.actualEncodeKbps = sample.rttMs = i;
+
+            series.Append(sample);
+        }
+    });
+
+    std::thread reader([&]() {
+        BandwidthStats samples[64];
+
+        while (series.Count() < (uint64_t)kSamples) {
+            size_t copied = series.Copy(samples, 64);
+
+            for (size_t i = 0; i < copied; i++) {
+                const BandwidthStats &sample = samples[i];
+                int32_t value = (int32_t)sample.timestampMs;
+
+                copiedTorn |= sample.availableSendKbps != value || sample.availableReceiveKbps != value ||
+                        sample.transmitKbps != value || sample.retransmitKbps != value ||
+                        sample.targetEncodeKbps != value || sample.actualEncodeKbps != value || sample.rttMs != value;
+                copiedOutOfOrder |= i > 0 && sample.timestampMs != samples[i - 1].timestampMs + 1;
+            }
+        }
+    });
+
+    BandwidthStats latest;
+    int64_t previous = 0;
+
+    while (series.Count() < (uint64_t)kSamples) {
+        if (series.Latest(&latest)) {
+            torn |= latest.rttMs != (int32_t)latest.timestampMs;
+            outOfOrder |= latest.timestampMs < previous;
+            previous = latest.timestampMs;
+        }
+    }
+
+    writer.join();
+    reader.join();
+
+    EXPECT_FALSE(torn || copiedTorn);
+    EXPECT_FALSE(outOfOrder || copiedOutOfOrder);
+    ASSERT_TRUE(series.Latest(&latest));
+    EXPECT_EQ(kSamples, latest.timestampMs);
+}
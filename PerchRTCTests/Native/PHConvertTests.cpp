@@ -0,0 +1,204 @@
+//
+//  PHConvertTests.cpp
+//  PerchRTCTests
+//
+//  Created by Christopher Eagleston on 2015-08-11.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#include "PHConvert.h"
+
+#include <gtest/gtest.h>
+
+#include <stdlib.h>
+#include <vector>
+
+namespace {
+
+    const PHConvertKernel kKernels[] = { PHConvertKernelScalar, PHConvertKernelNEON, PHConvertKernelSSE2, PHConvertKernelAVX2 };
+
+    // Guard bytes after each row, which no kernel may touch.
+    const int kGuardBytes = 64;
+    const uint8_t kGuardValue = 0xA5;
+
+    std::vector<uint8_t> RandomBytes(size_t count, unsigned int seed)
+    {
+        std::vector<uint8_t> bytes(count);
+
+        srand(seed);
+
+        for (size_t i = 0; i < count; i++) {
+            bytes[i] = (uint8_t)(rand() & 0xFF);
+        }
+
+        return bytes;
+    }
+
+    class PHConvertTest : public ::testing::Test
+    {
+    protected:
+        virtual void TearDown()
+        {
+            PHConvertSelectKernel(PHConvertKernelAutomatic);
+        }
+    };
+
+} // namespace
+
+TEST_F(PHConvertTest, AutomaticKernelIsSupported)
+{
+    ASSERT_TRUE(PHConvertSelectKernel(PHConvertKernelAutomatic));
+
+    PHConvertKernel kernel = PHConvertActiveKernel();
+
+    EXPECT_NE(PHConvertKernelAutomatic, kernel);
+    EXPECT_TRUE(PHConvertKernelIsSupported(kernel));
+    EXPECT_TRUE(PHConvertKernelIsSupported(PHConvertKernelScalar));
+}
+
+TEST_F(PHConvertTest, UnsupportedKernelIsRefused)
+{
+    for (PHConvertKernel kernel : kKernels) {
+        bool isSupported = PHConvertKernelIsSupported(kernel);
+
+        EXPECT_EQ(isSupported, PHConvertSelectKernel(kernel));
+        EXPECT_EQ(isSupported, PHConvertInterleaveRowFunction(kernel) != NULL);
+        EXPECT_EQ(isSupported, PHConvertDeinterleaveRowFunction(kernel) != NULL);
+
+        if (isSupported) {
+            EXPECT_EQ(kernel, PHConvertActiveKernel());
+        }
+    }
+}
+
+TEST_F(PHConvertTest, InterleaveRowMatchesScalarForEveryWidth)
+{
+    PHInterleaveRowFunction reference = PHConvertInterleaveRowFunction(PHConvertKernelScalar);
+
+    for (PHConvertKernel kernel : kKernels) {
+        PHInterleaveRowFunction interleave = PHConvertInterleaveRowFunction(kernel);
+
+        if (!interleave) {
+            continue;
+        }
+
+        for (int width = 0; width < 200; width++) {
+            // Offset the sources by one byte, so that no kernel can rely on alignment.
+            std::vector<uint8_t> a = RandomBytes(width + 1, width);
+            std::vector<uint8_t> b = RandomBytes(width + 1, width + 1000);
+            std::vector<uint8_t> expected(2 * width + kGuardBytes, kGuardValue);
+            std::vector<uint8_t> actual(2 * width + kGuardBytes, kGuardValue);
+
+            reference(a.data() + 1, b.data() + 1, expected.data(), width);
+            interleave(a.data() + 1, b.data() + 1, actual.data(), width);
+
+            ASSERT_EQ(expected, actual) << "kernel " << kernel << " width " << width;
+
+            for (int x = 0; x < width; x++) {
+                ASSERT_EQ(a[x + 1], expected[2 * x]);
+                ASSERT_EQ(b[x + 1], expected[2 * x + 1]);
+            }
+        }
+    }
+}
+
+TEST_F(PHConvertTest, DeinterleaveRowMatchesScalarForEveryWidth)
+{
+    PHDeinterleaveRowFunction reference = PHConvertDeinterleaveRowFunction(PHConvertKernelScalar);
+
+    for (PHConvertKernel kernel : kKernels) {
+        PHDeinterleaveRowFunction deinterleave = PHConvertDeinterleaveRowFunction(kernel);
+
+        if (!deinterleave) {
+            continue;
+        }
+
+        for (int width = 0; width < 200; width++) {
+            std::vector<uint8_t> ab = RandomBytes(2 * width + 1, width);
+            std::vector<uint8_t> expectedA(width + kGuardBytes, kGuardValue);
+            std::vector<uint8_t> expectedB(width + kGuardBytes, kGuardValue);
+            std::vector<uint8_t> actualA(width + kGuardBytes, kGuardValue);
+            std::vector<uint8_t> actualB(width + kGuardBytes, kGuardValue);
+
+            reference(ab.data() + 1, expectedA.data(), expectedB.data(), width);
+            deinterleave(ab.data() + 1, actualA.data(), actualB.data(), width);
+
+            ASSERT_EQ(expectedA, actualA) << "kernel " << kernel << " width " << width;
+            ASSERT_EQ(expectedB, actualB) << "kernel " << kernel << " width " << width;
+
+            for (int x = 0; x < width; x++) {
+                ASSERT_EQ(ab[2 * x + 1], expectedA[x]);
+                ASSERT_EQ(ab[2 * x + 2], expectedB[x]);
+            }
+        }
+    }
+}
+
+TEST_F(PHConvertTest, PlanesRoundTripWithPaddedStrides)
+{
+    const int width = 181;
+    const int height = 7;
+    const int stride = 200;
+    const int packedStride = 2 * width + 13;
+
+    std::vector<uint8_t> u = RandomBytes(stride * height, 1);
+    std::vector<uint8_t> v = RandomBytes(stride * height, 2);
+
+    for (PHConvertKernel kernel : kKernels) {
+        if (!PHConvertSelectKernel(kernel)) {
+            continue;
+        }
+
+        std::vector<uint8_t> uv(packedStride * height, kGuardValue);
+        std::vector<uint8_t> u2(stride * height, kGuardValue);
+        std::vector<uint8_t> v2(stride * height, kGuardValue);
+
+        PHInterleavePlanes(u.data(), stride, v.data(), stride, uv.data(), packedStride, width, height);
+        PHDeinterleavePlane(uv.data(), packedStride, u2.data(), stride, v2.data(), stride, width, height);
+
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                ASSERT_EQ(u[y * stride + x], u2[y * stride + x]);
+                ASSERT_EQ(v[y * stride + x], v2[y * stride + x]);
+            }
+
+            // Padding is left alone.
+            for (int x = width; x < stride; x++) {
+                ASSERT_EQ(kGuardValue, u2[y * stride + x]);
+            }
+
+            for (int x = 2 * width; x < packedStride; x++) {
+                ASSERT_EQ(kGuardValue, uv[y * packedStride + x]);
+            }
+        }
+    }
+}
+
+TEST_F(PHConvertTest, CopyPlaneCopiesOnlyTheVisibleWidth)
+{
+    const int widthBytes = 37;
+    const int height = 5;
+
+    // Contiguous planes take the single copy path, padded ones are copied row by row.
+    const int strides[][2] = { { widthBytes, widthBytes }, { 48, 64 } };
+
+    for (const int *stride : strides) {
+        int srcStride = stride[0];
+        int dstStride = stride[1];
+
+        std::vector<uint8_t> src = RandomBytes(srcStride * height, 3);
+        std::vector<uint8_t> dst(dstStride * height, kGuardValue);
+
+        PHCopyPlane(src.data(), srcStride, dst.data(), dstStride, widthBytes, height);
+
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < widthBytes; x++) {
+                ASSERT_EQ(src[y * srcStride + x], dst[y * dstStride + x]);
+            }
+
+            for (int x = widthBytes; x < dstStride; x++) {
+                ASSERT_EQ(kGuardValue, dst[y * dstStride + x]);
+            }
+        }
+    }
+}
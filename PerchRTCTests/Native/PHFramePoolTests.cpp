@@ -0,0 +1,370 @@
+//
+//  PHFramePoolTests.cpp
+//  PerchRTCTests
+//
+//  Created by Christopher Eagleston on 2015-08-11.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#include "PHFramePool.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace perch;
+
+namespace {
+
+    const FrameKey kCIF(352, 288, kFrameFormatNV12);
+    const FrameKey kVGA(640, 480, kFrameFormatNV12);
+
+    // Heap storage which counts what is live, and can be told to fail.
+    class CountingAllocator : public FrameAllocator
+    {
+    public:
+        CountingAllocator(std::atomic<int> &live) : _live(live), _heap() {}
+
+        void *Allocate(const FrameKey &key) override
+        {
+            void *handle = _heap.Allocate(key);
+
+            if (handle != NULL) {
+                _live.fetch_add(1);
+            }
+
+            return handle;
+        }
+
+        void Free(const FrameKey &key, void *handle) override
+        {
+            _heap.Free(key, handle);
+            _live.fetch_sub(1);
+        }
+
+    private:
+        std::atomic<int> &_live;
+        AlignedHeapAllocator _heap;
+    };
+
+    class PHFramePoolTest : public ::testing::Test
+    {
+    protected:
+        PHFramePoolTest() : _live(0) {}
+
+        std::unique_ptr<FramePool> MakePool(int maxCachedPerSizeClass)
+        {
+            return std::unique_ptr<FramePool>(new FramePool(std::unique_ptr<FrameAllocator>(new CountingAllocator(_live)), maxCachedPerSizeClass));
+        }
+
+        FrameKey KeyForSizeClass(int index)
+        {
+            return FrameKey(64 + 16 * index, 48 + 16 * index, kFrameFormatI420);
+        }
+
+        std::atomic<int> _live;
+    };
+
+} // namespace
+
+TEST_F(PHFramePoolTest, ReleasedBuffersAreReused)
+{
+    auto pool = MakePool(4);
+
+    FrameBuffer *first = pool->Acquire(kVGA);
+    ASSERT_TRUE(first != NULL);
+    EXPECT_EQ(kVGA, first->Key());
+
+    pool->Release(first);
+
+    FrameBuffer *second = pool->Acquire(kVGA);
+    EXPECT_EQ(first, second);
+
+    FramePoolStats stats = pool->Stats();
+    EXPECT_EQ(1u, stats.hits);
+    EXPECT_EQ(1u, stats.misses);
+    EXPECT_EQ(1u, stats.allocations);
+    EXPECT_EQ(1u, stats.outstanding);
+
+    pool->Release(second);
+}
+
+TEST_F(PHFramePoolTest, InFlightBuffersAreNeverHandedOut)
+{
+    auto pool = MakePool(4);
+
+    FrameBuffer *first = pool->Acquire(kVGA);
+    FrameBuffer *second = pool->Acquire(kVGA);
+
+    ASSERT_TRUE(first != NULL && second != NULL);
+    EXPECT_NE(first, second);
+    EXPECT_EQ(2, _live.load());
+
+    pool->Release(first);
+    pool->Release(second);
+}
+
+// A stream which flips between two resolutions stays warm in both, and stops allocating after the first round.
+TEST_F(PHFramePoolTest, ResolutionFlipsDoNotReallocate)
+{
+    auto pool = MakePool(3);
+
+    for (int round = 0; round < 50; round++) {
+        const FrameKey &key = (round % 2) ? kCIF : kVGA;
+        FrameBuffer *buffers[3];
+
+        for (FrameBuffer *&buffer : buffers) {
+            buffer = pool->Acquire(key);
+            ASSERT_TRUE(buffer != NULL);
+        }
+        for (FrameBuffer *buffer : buffers) {
+            pool->Release(buffer);
+        }
+    }
+
+    FramePoolStats stats = pool->Stats();
+    EXPECT_EQ(6u, stats.allocations);
+    EXPECT_EQ(0u, stats.deallocations);
+    EXPECT_EQ(0u, stats.evictions);
+    EXPECT_EQ(0u, stats.outstanding);
+}
+
+TEST_F(PHFramePoolTest, CachePerSizeClassIsBounded)
+{
+    auto pool = MakePool(2);
+    std::vector<FrameBuffer *> buffers;
+
+    for (int i = 0; i < 5; i++) {
+        buffers.push_back(pool->Acquire(kVGA));
+    }
+    for (FrameBuffer *buffer : buffers) {
+        pool->Release(buffer);
+    }
+
+    EXPECT_EQ(2, _live.load());
+    EXPECT_EQ(3u, pool->Stats().deallocations);
+}
+
+TEST_F(PHFramePoolTest, TrimFreesBuffersAndSizeClasses)
+{
+    auto pool = MakePool(4);
+
+    for (int i = 0; i < FramePool::kMaxSizeClasses; i++) {
+        pool->Release(pool->Acquire(KeyForSizeClass(i)));
+    }
+
+    EXPECT_EQ(FramePool::kMaxSizeClasses, _live.load());
+
+    pool->Trim();
+
+    EXPECT_EQ(0, _live.load());
+
+    // Every class was given up, so a new size doesn't evict anything.
+
+    pool->Release(pool->Acquire(kVGA));
+
+    EXPECT_EQ(0u, pool->Stats().evictions);
+}
+
+TEST_F(PHFramePoolTest, TrimLeavesOutstandingBuffers)
+{
+    auto pool = MakePool(4);
+
+    FrameBuffer *outstanding = pool->Acquire(kVGA);
+    pool->Release(pool->Acquire(kCIF));
+
+    pool->Trim();
+
+    EXPECT_EQ(1, _live.load());
+
+    // Its class may be gone, in which case the buffer is freed rather than cached.
+
+    pool->Release(outstanding);
+    pool->Trim();
+
+    EXPECT_EQ(0, _live.load());
+}
+
+TEST_F(PHFramePoolTest, NewSizeEvictsLeastRecentlyUsedClass)
+{
+    auto pool = MakePool(4);
+
+    for (int i = 0; i < FramePool::kMaxSizeClasses; i++) {
+        pool->Release(pool->Acquire(KeyForSizeClass(i)));
+    }
+
+    // Touch every class but the first, which leaves it the oldest.
+
+    for (int i = 1; i < FramePool::kMaxSizeClasses; i++) {
+        pool->Release(pool->Acquire(KeyForSizeClass(i)));
+    }
+
+    uint64_t allocations = pool->Stats().allocations;
+
+    pool->Release(pool->Acquire(kVGA));
+
+    FramePoolStats stats = pool->Stats();
+    EXPECT_EQ(1u, stats.evictions);
+    EXPECT_EQ(1u, stats.deallocations);
+    EXPECT_EQ(allocations + 1, stats.allocations);
+
+    // The other sizes are still warm.
+
+    for (int i = 1; i < FramePool::kMaxSizeClasses; i++) {
+        pool->Release(pool->Acquire(KeyForSizeClass(i)));
+    }
+
+    EXPECT_EQ(allocations + 1, pool->Stats().allocations);
+
+    // The evicted size is not.
+
+    pool->Release(pool->Acquire(KeyForSizeClass(0)));
+
+    EXPECT_EQ(allocations + 2, pool->Stats().allocations);
+}
+
+TEST_F(PHFramePoolTest, BufferReleasedAfterEvictionIsFreed)
+{
+    auto pool = MakePool(4);
+
+    FrameBuffer *outstanding = pool->Acquire(KeyForSizeClass(0));
+
+    for (int i = 1; i <= FramePool::kMaxSizeClasses; i++) {
+        pool->Release(pool->Acquire(KeyForSizeClass(i)));
+    }
+
+    ASSERT_EQ(1u, pool->Stats().evictions);
+
+    int live = _live.load();
+    pool->Release(outstanding);
+
+    EXPECT_EQ(live - 1, _live.load());
+}
+
+// With every slot cached under other sizes, a new size frees one of them instead of failing.
+TEST_F(PHFramePoolTest, AcquireStealsFromOtherSizeClasses)
+{
+    const int perClass = FramePool::kMaxBuffers / 2;
+    auto pool = MakePool(perClass);
+
+    for (int c = 0; c < 2; c++) {
+        std::vector<FrameBuffer *> buffers;
+
+        for (int i = 0; i < perClass; i++) {
+            buffers.push_back(pool->Acquire(KeyForSizeClass(c)));
+            ASSERT_TRUE(buffers.back() != NULL);
+        }
+        for (FrameBuffer *buffer : buffers) {
+            pool->Release(buffer);
+        }
+    }
+
+    ASSERT_EQ(FramePool::kMaxBuffers, _live.load());
+
+    // Size class 1 is the most recently used, so the buffer comes out of class 0.
+
+    FrameBuffer *buffer = pool->Acquire(kVGA);
+
+    ASSERT_TRUE(buffer != NULL);
+    EXPECT_EQ(1u, pool->Stats().deallocations);
+
+    pool->Release(buffer);
+
+    uint64_t allocations = pool->Stats().allocations;
+    pool->Release(pool->Acquire(KeyForSizeClass(1)));
+
+    EXPECT_EQ(allocations, pool->Stats().allocations);
+}
+
+TEST_F(PHFramePoolTest, AcquireFailsOnlyWhenEveryBufferIsOutstanding)
+{
+    auto pool = MakePool(4);
+    std::vector<FrameBuffer *> buffers;
+
+    for (int i = 0; i < FramePool::kMaxBuffers; i++) {
+        buffers.push_back(pool->Acquire(KeyForSizeClass(i % 3)));
+        ASSERT_TRUE(buffers.back() != NULL);
+    }
+
+    EXPECT_TRUE(pool->Acquire(kVGA) == NULL);
+
+    pool->Release(buffers.back());
+    buffers.pop_back();
+
+    FrameBuffer *buffer = pool->Acquire(kVGA);
+    EXPECT_TRUE(buffer != NULL);
+    buffers.push_back(buffer);
+
+    for (FrameBuffer *outstanding : buffers) {
+        pool->Release(outstanding);
+    }
+}
+
+// Threads acquire and release across more sizes than there are classes, to exercise eviction and stealing together.
+// Build with PERCH_SANITIZE=thread to check the pool for races.
+TEST_F(PHFramePoolTest, ConcurrentAcquireAndRelease)
+{
+    auto pool = MakePool(4);
+    const int threadCount = 4;
+    const int iterations = 5000;
+    std::atomic<int> corrupted(0);
+    std::vector<std::thread> threads;
+
+    for (int t = 0; t < threadCount; t++) {
+        threads.push_back(std::thread([&, t]() {
+            FramePlaneLayout layout;
+            std::vector<FrameBuffer *> held;
+
+            for (int i = 0; i < iterations; i++) {
+                FrameKey key = KeyForSizeClass((t * 7 + i) % (FramePool::kMaxSizeClasses + 3));
+                FrameBuffer *buffer = pool->Acquire(key);
+
+                if (buffer != NULL) {
+                    // No two holders may share a buffer, so stamp it and check the stamp survives.
+
+                    FramePlaneLayoutForKey(key, &layout);
+                    uint8_t *bytes = (uint8_t *)buffer->Handle();
+                    bytes[0] = (uint8_t)t;
+                    bytes[layout.byteSize - 1] = (uint8_t)t;
+
+                    if (buffer->Key() != key) {
+                        corrupted.fetch_add(1);
+                    }
+
+                    held.push_back(buffer);
+                }
+
+                if (held.size() > 3 || (buffer == NULL && !held.empty())) {
+                    FrameBuffer *released = held.front();
+                    held.erase(held.begin());
+
+                    FramePlaneLayoutForKey(released->Key(), &layout);
+                    const uint8_t *bytes = (const uint8_t *)released->Handle();
+
+                    if (bytes[0] != (uint8_t)t || bytes[layout.byteSize - 1] != (uint8_t)t) {
+                        corrupted.fetch_add(1);
+                    }
+
+                    pool->Release(released);
+                }
+            }
+
+            for (FrameBuffer *buffer : held) {
+                pool->Release(buffer);
+            }
+        }));
+    }
+
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+
+    EXPECT_EQ(0, corrupted.load());
+    EXPECT_EQ(0u, pool->Stats().outstanding);
+
+    pool->Trim();
+
+    EXPECT_EQ(0, _live.load());
+}
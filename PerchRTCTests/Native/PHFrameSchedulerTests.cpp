@@ -0,0 +1,338 @@
+//
+//  PHFrameSchedulerTests.cpp
+//  PerchRTCTests
+//
+//  Created by Christopher Eagleston on 2015-08-11.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#include "PHFrameScheduler.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <map>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+using namespace perch;
+
+namespace {
+
+    const int64_t kMsec = 1000000;
+    const int64_t k60Hz = 16666667;
+    const int64_t k30fps = 33333333;
+
+    inline void *FrameWithId(intptr_t id)
+    {
+        return (void *)(id + 1);
+    }
+
+    inline intptr_t IdOfFrame(void *frame)
+    {
+        return (intptr_t)frame - 1;
+    }
+
+    struct Presentation
+    {
+        intptr_t frame;
+        int64_t arrivalNs;
+        int64_t vsyncNs;
+    };
+
+    /**
+     *  Drives a scheduler with a simulated display and a list of frame arrivals, merged by time. Arrivals which land
+     *  on a refresh are pushed first, as they would be when decoding finishes just before the display link fires.
+     */
+    class SimulatedDisplay
+    {
+    public:
+        SimulatedDisplay(FrameScheduler &scheduler, int64_t refreshIntervalNs)
+        : _scheduler(scheduler), _refreshIntervalNs(refreshIntervalNs), _handedBack(0)
+        {
+        }
+
+        void Run(const std::vector<int64_t> &arrivals, int64_t untilNs)
+        {
+            size_t next = 0;
+            std::vector<void *> dropped;
+
+            for (int64_t vsync = 0; vsync <= untilNs; vsync += _refreshIntervalNs) {
+                while (next < arrivals.size() && arrivals[next] <= vsync) {
+                    _arrivals[(intptr_t)next] = arrivals[next];
+                    _scheduler.Push(FrameWithId((intptr_t)next), arrivals[next], &dropped);
+                    next++;
+                }
+
+                void *frame = _scheduler.Tick(vsync, _refreshIntervalNs, &dropped);
+
+                if (frame) {
+                    Presentation presentation = { IdOfFrame(frame), _arrivals[IdOfFrame(frame)], vsync };
+                    presented.push_back(presentation);
+                    _handedBack++;
+                }
+            }
+
+            _handedBack += dropped.size();
+            droppedFrames += dropped.size();
+            stats = _scheduler.Stats();
+
+            std::vector<void *> flushed;
+            _scheduler.Flush(&flushed);
+            _handedBack += flushed.size();
+
+            EXPECT_EQ(next, _handedBack) << "every frame is handed back exactly once";
+        }
+
+        // Refreshes between consecutive presentations.
+        std::map<int64_t, int> Cadence() const
+        {
+            std::map<int64_t, int> histogram;
+
+            for (size_t i = 1; i < presented.size(); i++) {
+                histogram[(presented[i].vsyncNs - presented[i - 1].vsyncNs + _refreshIntervalNs / 2) / _refreshIntervalNs]++;
+            }
+
+            return histogram;
+        }
+
+        int64_t MaxLatencyNs() const
+        {
+            int64_t latency = 0;
+
+            for (const Presentation &presentation : presented) {
+                latency = std::max(latency, presentation.vsyncNs - presentation.arrivalNs);
+            }
+
+            return latency;
+        }
+
+        std::vector<Presentation> presented;
+        size_t droppedFrames = 0;
+
+        // Taken before the final flush, which resets the estimates.
+        FrameSchedulerStats stats;
+
+    private:
+        FrameScheduler &_scheduler;
+        const int64_t _refreshIntervalNs;
+        std::map<intptr_t, int64_t> _arrivals;
+        size_t _handedBack;
+    };
+
+    // Arrivals at a steady rate, shifted by up to +/- jitter. Generated here rather than by rand(), so they are the same everywhere.
+    std::vector<int64_t> JitteredArrivals(int count, int64_t intervalNs, int64_t jitterNs, uint32_t seed)
+    {
+        std::vector<int64_t> arrivals;
+        uint32_t random = seed;
+        int64_t previous = 0;
+
+        for (int i = 0; i < count; i++) {
+            random ^= random << 13;
+            random ^= random >> 17;
+            random ^= random << 5;
+
+            int64_t offset = jitterNs > 0 ? (int64_t)(random % (uint32_t)(2 * jitterNs / kMsec + 1)) * kMsec - jitterNs : 0;
+            int64_t arrival = std::max(previous + 1, 5 * kMsec + i * intervalNs + offset);
+
+            arrivals.push_back(arrival);
+            previous = arrival;
+        }
+
+        return arrivals;
+    }
+
+} // namespace
+
+TEST(PHFrameSchedulerTest, SteadyStreamPresentsEveryFrame)
+{
+    FrameScheduler scheduler;
+    SimulatedDisplay display(scheduler, k60Hz);
+
+    display.Run(JitteredArrivals(300, k30fps, 0, 1), 10500 * kMsec);
+
+    EXPECT_EQ(300u, display.presented.size());
+    EXPECT_EQ(0u, display.droppedFrames);
+
+    std::map<int64_t, int> cadence = display.Cadence();
+    EXPECT_EQ(299, cadence[2]);
+
+    FrameSchedulerStats stats = scheduler.Stats();
+    EXPECT_EQ(0u, stats.late);
+    EXPECT_EQ(300u, stats.flushed + stats.presented);
+}
+
+// Jitter which fits within a refresh is absorbed by the display itself, so it must not cost any latency or frames.
+TEST(PHFrameSchedulerTest, SmallJitterAddsNoLatency)
+{
+    FrameScheduler scheduler;
+    SimulatedDisplay display(scheduler, k60Hz);
+    display.Run(JitteredArrivals(600, k30fps, 8 * kMsec, 42), 20500 * kMsec);
+
+    EXPECT_GE(display.presented.size(), 597u);
+    EXPECT_LE(display.MaxLatencyNs(), k60Hz);
+    EXPECT_GT(display.stats.jitterNs, 0);
+    EXPECT_EQ(0u, display.stats.late);
+}
+
+// Network jitter of +/- 20 msec on a 30 fps stream. The playout delay soaks some of it up, so the cadence is more even
+// than presenting each frame on the refresh after it arrives, and holding a frame never costs more than the delay.
+TEST(PHFrameSchedulerTest, JitterIsSmoothed)
+{
+    std::vector<int64_t> arrivals = JitteredArrivals(600, k30fps, 20 * kMsec, 42);
+
+    FrameScheduler scheduler;
+    SimulatedDisplay display(scheduler, k60Hz);
+    display.Run(arrivals, 20500 * kMsec);
+
+    FrameSchedulerConfig immediateConfig;
+    immediateConfig.maxDelayNs = 0;
+    FrameScheduler immediate(immediateConfig);
+    SimulatedDisplay baseline(immediate, k60Hz);
+    baseline.Run(arrivals, 20500 * kMsec);
+
+    std::map<int64_t, int> cadence = display.Cadence();
+    std::map<int64_t, int> baselineCadence = baseline.Cadence();
+
+    EXPECT_GT(cadence[2], baselineCadence[2]);
+    EXPECT_LE(cadence[4] + cadence[5], baselineCadence[4] + baselineCadence[5]);
+    EXPECT_GE(display.presented.size(), 540u);
+
+    EXPECT_GT(display.stats.delayNs, 0);
+    EXPECT_LE(display.stats.delayNs, FrameSchedulerConfig().maxDelayNs);
+    EXPECT_LE(display.MaxLatencyNs(), FrameSchedulerConfig().maxDelayNs + k60Hz);
+    EXPECT_LE(baseline.MaxLatencyNs(), k60Hz);
+}
+
+// A stall followed by a burst collapses to the newest frame, rather than playing the burst out and adding latency.
+TEST(PHFrameSchedulerTest, BurstAfterStallCollapses)
+{
+    std::vector<int64_t> arrivals = JitteredArrivals(60, k30fps, 0, 1);
+    int64_t resume = arrivals.back() + 300 * kMsec;
+
+    for (int i = 0; i < 8; i++) {
+        arrivals.push_back(resume + i * kMsec);
+    }
+    for (int i = 1; i <= 30; i++) {
+        arrivals.push_back(resume + 7 * kMsec + i * k30fps);
+    }
+
+    FrameScheduler scheduler;
+    SimulatedDisplay display(scheduler, k60Hz);
+    display.Run(arrivals, arrivals.back() + 200 * kMsec);
+
+    EXPECT_GE(display.droppedFrames, 5u);
+    EXPECT_LE(display.MaxLatencyNs(), 2 * k30fps);
+
+    // The stream settles back into its cadence.
+
+    const Presentation &last = display.presented.back();
+    EXPECT_EQ((intptr_t)arrivals.size() - 1, last.frame);
+}
+
+TEST(PHFrameSchedulerTest, FrameRateCap)
+{
+    FrameSchedulerConfig config;
+    config.maxFrameRate = 15;
+
+    FrameScheduler scheduler(config);
+    SimulatedDisplay display(scheduler, k60Hz);
+    display.Run(JitteredArrivals(300, k30fps, 0, 1), 10500 * kMsec);
+
+    EXPECT_NEAR(150, (int)display.presented.size(), 2);
+    EXPECT_EQ(display.presented.size() - 1, (size_t)display.Cadence()[4]);
+}
+
+TEST(PHFrameSchedulerTest, LowerFrameRateReseedsInterval)
+{
+    std::vector<int64_t> arrivals = JitteredArrivals(90, k30fps, 0, 1);
+
+    for (int i = 1; i <= 60; i++) {
+        arrivals.push_back(arrivals[89] + i * 2 * k30fps);
+    }
+
+    FrameScheduler scheduler;
+    std::vector<void *> dropped;
+
+    for (size_t i = 0; i < arrivals.size(); i++) {
+        scheduler.Push(FrameWithId((intptr_t)i), arrivals[i], &dropped);
+        scheduler.Tick(arrivals[i], k60Hz, &dropped);
+    }
+
+    EXPECT_NEAR(2 * k30fps, scheduler.Stats().arrivalIntervalNs, kMsec);
+}
+
+TEST(PHFrameSchedulerTest, FullBufferDropsOldest)
+{
+    FrameSchedulerConfig config;
+    config.maxPendingFrames = 2;
+
+    FrameScheduler scheduler(config);
+    std::vector<void *> dropped;
+
+    for (intptr_t i = 0; i < 4; i++) {
+        scheduler.Push(FrameWithId(i), i * kMsec, &dropped);
+    }
+
+    ASSERT_EQ(2u, dropped.size());
+    EXPECT_EQ(0, IdOfFrame(dropped[0]));
+    EXPECT_EQ(1, IdOfFrame(dropped[1]));
+
+    std::vector<void *> flushed;
+    scheduler.Flush(&flushed);
+
+    ASSERT_EQ(2u, flushed.size());
+    EXPECT_EQ(2, IdOfFrame(flushed[0]));
+    EXPECT_EQ(0u, scheduler.Stats().arrivalIntervalNs);
+}
+
+// Push() from a decoder thread while the display link ticks. Build with PERCH_SANITIZE=thread to check for races.
+TEST(PHFrameSchedulerTest, ConcurrentPushAndTick)
+{
+    FrameScheduler scheduler;
+    const int count = 20000;
+    std::atomic<bool> done(false);
+    std::vector<int> handedBack(count, 0);
+    std::vector<void *> decoderDropped;
+
+    std::thread decoder([&]() {
+        for (int i = 0; i < count; i++) {
+            scheduler.Push(FrameWithId(i), i * kMsec, &decoderDropped);
+        }
+
+        done.store(true);
+    });
+
+    std::vector<void *> displayDropped;
+    int64_t vsync = 0;
+
+    while (!done.load()) {
+        void *frame = scheduler.Tick(vsync, k60Hz, &displayDropped);
+
+        if (frame) {
+            handedBack[IdOfFrame(frame)]++;
+        }
+
+        vsync += kMsec;
+    }
+
+    decoder.join();
+
+    std::vector<void *> flushed;
+    scheduler.Flush(&flushed);
+
+    for (void *frame : decoderDropped) {
+        handedBack[IdOfFrame(frame)]++;
+    }
+    for (void *frame : displayDropped) {
+        handedBack[IdOfFrame(frame)]++;
+    }
+    for (void *frame : flushed) {
+        handedBack[IdOfFrame(frame)]++;
+    }
+
+    for (int i = 0; i < count; i++) {
+        ASSERT_EQ(1, handedBack[i]) << "frame " << i;
+    }
+}
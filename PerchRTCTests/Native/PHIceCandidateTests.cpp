@@ -0,0 +1,150 @@
+//
+//  PHIceCandidateTests.cpp
+//  PerchRTCTests
+//
+//  Created by Christopher Eagleston on 2015-08-11.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#include "PHIceCandidate.h"
+#include "PHTestData.h"
+
+#include <gtest/gtest.h>
+#include <string.h>
+
+using namespace perch;
+
+namespace {
+
+    bool Parse(const std::string &text, IceCandidateAttribute *candidate)
+    {
+        return ParseIceCandidate(SdpToken(text.data(), text.size()), candidate);
+    }
+
+    // Literals parse in place, so their tokens stay valid.
+    bool Parse(const char *text, IceCandidateAttribute *candidate)
+    {
+        return ParseIceCandidate(SdpToken(text, strlen(text)), candidate);
+    }
+
+} // namespace
+
+// What the browsers and our own clients send, as filteredIceCandidate: and the trickle filter read it.
+TEST(PHIceCandidateTest, ParseCorpus)
+{
+    struct Case
+    {
+        const char *name;
+        const char *foundation;
+        uint32_t component;
+        IceTransport transport;
+        uint32_t priority;
+        const char *address;
+        uint32_t port;
+        IceCandidateType type;
+        IceTcpType tcpType;
+        const char *relatedAddress;
+        uint32_t relatedPort;
+    };
+
+    const Case cases[] = {
+        { "chrome_host_udp", "1467250027", 1, IceTransportUDP, 2122260223, "192.168.0.196", 46243, IceCandidateTypeHost, IceTcpTypeNone, "", 0 },
+        { "chrome_host_tcp", "435653019", 1, IceTransportTCP, 1845501695, "192.168.0.196", 0, IceCandidateTypeHost, IceTcpTypeActive, "", 0 },
+        { "chrome_host_ipv6", "2999745851", 1, IceTransportUDP, 2122194687, "2001:db8:85a3::8a2e:370:7334", 54321, IceCandidateTypeHost, IceTcpTypeNone, "", 0 },
+        { "chrome_srflx", "842163049", 1, IceTransportUDP, 1677729535, "203.0.113.7", 61665, IceCandidateTypeServerReflexive, IceTcpTypeNone, "192.168.0.196", 46243 },
+        { "chrome_relay", "3745745140", 1, IceTransportUDP, 41885439, "198.51.100.20", 50472, IceCandidateTypeRelay, IceTcpTypeNone, "203.0.113.7", 61665 },
+        { "chrome_rtcp", "1467250027", 2, IceTransportUDP, 2122260222, "192.168.0.196", 56143, IceCandidateTypeHost, IceTcpTypeNone, "", 0 },
+        { "chrome_ufrag", "1467250027", 1, IceTransportUDP, 2122260223, "192.168.0.196", 46243, IceCandidateTypeHost, IceTcpTypeNone, "", 0 },
+        { "firefox_host", "0", 1, IceTransportUDP, 2122252543, "10.0.1.12", 49203, IceCandidateTypeHost, IceTcpTypeNone, "", 0 },
+        { "firefox_srflx", "1", 1, IceTransportUDP, 1686052863, "203.0.113.7", 49203, IceCandidateTypeServerReflexive, IceTcpTypeNone, "10.0.1.12", 49203 },
+        { "firefox_relay_tcp", "4", 1, IceTransportTCP, 8331263, "198.51.100.20", 3478, IceCandidateTypeRelay, IceTcpTypePassive, "198.51.100.20", 3478 },
+        { "firefox_prflx", "5", 1, IceTransportUDP, 1853824767, "203.0.113.9", 52002, IceCandidateTypePeerReflexive, IceTcpTypeNone, "10.0.1.12", 49203 },
+        { "ios_so", "2", 1, IceTransportTCP, 1518283007, "10.0.1.12", 9, IceCandidateTypeHost, IceTcpTypeSimultaneousOpen, "", 0 },
+
+        // The substring filter took this for UDP, twice over.
+
+        { "udp_in_address", "udp", 1, IceTransportTCP, 1518214911, "fd00:udp::1", 9, IceCandidateTypeHost, IceTcpTypePassive, "", 0 },
+
+        // Unknown types, transports and extensions are kept, not rejected.
+
+        { "extension_type", "7", 1, IceTransportUDP, 1, "192.0.2.1", 9, IceCandidateTypeUnknown, IceTcpTypeNone, "", 0 },
+        { "dangling_extension", "8", 1, IceTransportUnknown, 1, "192.0.2.1", 9, IceCandidateTypeHost, IceTcpTypeNone, "", 0 },
+    };
+
+    ASSERT_EQ(sizeof(cases) / sizeof(cases[0]), test::ListDataFiles("IceCandidate", ".candidate").size());
+
+    for (const Case &test : cases) {
+        // Tokens point into the text, so it has to outlive them.
+
+        std::string text = test::ReadDataFile(std::string("IceCandidate/") + test.name + ".candidate");
+        IceCandidateAttribute candidate;
+
+        ASSERT_TRUE(Parse(text, &candidate)) << test.name;
+
+        EXPECT_EQ(test.foundation, candidate.foundation.ToString()) << test.name;
+        EXPECT_EQ(test.component, candidate.component) << test.name;
+        EXPECT_EQ(test.transport, candidate.transport) << test.name;
+        EXPECT_EQ(test.priority, candidate.priority) << test.name;
+        EXPECT_EQ(test.address, candidate.address.ToString()) << test.name;
+        EXPECT_EQ(test.port, candidate.port) << test.name;
+        EXPECT_EQ(test.type, candidate.type) << test.name;
+        EXPECT_EQ(test.tcpType, candidate.tcpType) << test.name;
+        EXPECT_EQ(test.relatedAddress, candidate.relatedAddress.ToString()) << test.name;
+        EXPECT_EQ(test.relatedPort, candidate.relatedPort) << test.name;
+    }
+}
+
+TEST(PHIceCandidateTest, ParseExtensions)
+{
+    std::string text = test::ReadDataFile("IceCandidate/chrome_ufrag.candidate");
+    IceCandidateAttribute candidate;
+
+    ASSERT_TRUE(Parse(text, &candidate));
+    EXPECT_EQ("Oyef7uvBlwafI3hT", candidate.ufrag.ToString());
+    EXPECT_EQ(1u, candidate.generation);
+
+    // A malformed related port is left at 0, and doesn't reject the candidate.
+
+    ASSERT_TRUE(Parse("candidate:1 1 udp 1 192.0.2.1 9 typ srflx raddr 10.0.0.1 rport 70000 generation x", &candidate));
+    EXPECT_EQ("10.0.0.1", candidate.relatedAddress.ToString());
+    EXPECT_EQ(0u, candidate.relatedPort);
+    EXPECT_EQ(0u, candidate.generation);
+
+    // Tabs and line endings separate words too.
+
+    ASSERT_TRUE(Parse("  a=candidate:1\t1 udp 1 192.0.2.1 9 typ relay\r\n", &candidate));
+    EXPECT_EQ(IceCandidateTypeRelay, candidate.type);
+}
+
+TEST(PHIceCandidateTest, RejectsMalformedCandidates)
+{
+    const char *malformed[] = {
+        "",
+        "candidate:",
+        "candidate:1 1 udp 1 192.0.2.1 9 typ",
+        "candidate:1 1 udp 1 192.0.2.1 9 type host",
+        "candidate:1 0 udp 1 192.0.2.1 9 typ host",
+        "candidate:1 x udp 1 192.0.2.1 9 typ host",
+        "candidate:1 1 udp 4294967296 192.0.2.1 9 typ host",
+        "candidate:1 1 udp -1 192.0.2.1 9 typ host",
+        "candidate:1 1 udp 1 192.0.2.1 65536 typ host",
+        "candidate:1 1 udp 1 192.0.2.1 port typ host",
+        "candidate:a-b 1 udp 1 192.0.2.1 9 typ host",
+        "candidate:123456789012345678901234567890123 1 udp 1 192.0.2.1 9 typ host",
+        "a=ice-ufrag:Oyef7uvBlwafI3hT",
+    };
+
+    for (const char *text : malformed) {
+        IceCandidateAttribute candidate;
+        candidate.port = 1234;
+
+        EXPECT_FALSE(Parse(text, &candidate)) << text;
+        EXPECT_EQ(1234u, candidate.port) << text;
+    }
+
+    // The limits themselves are fine.
+
+    IceCandidateAttribute candidate;
+    EXPECT_TRUE(Parse("candidate:12345678901234567890123456789012 1 udp 4294967295 192.0.2.1 65535 typ host", &candidate));
+    EXPECT_TRUE(Parse("1+/ 1 udp 1 192.0.2.1 9 typ host", &candidate));
+}
@@ -0,0 +1,308 @@
+//
+//  PHIceRecoveryTests.cpp
+//  PerchRTCTests
+//
+//  Created by Christopher Eagleston on 2015-08-11.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#include "PHIceRecovery.h"
+
+#include <gtest/gtest.h>
+
+using namespace perch;
+
+namespace {
+
+    struct TimedAction
+    {
+        int64_t timeMs;
+        std::string key;
+        IceRecoveryActionType type;
+    };
+
+    // Stands in for PHMediaSession's recovery timer. Time only moves when the test advances it, straight to whatever
+    // is due next, so hours of backoff run instantly and the same way every time. Run it up to an event's time before
+    // reporting the event, so that what was due before it happens first.
+    class SimulatedClock
+    {
+    public:
+        explicit SimulatedClock(IceRecovery &recovery) : _recovery(recovery), _nowMs(0) {}
+
+        int64_t Now() const { return _nowMs; }
+
+        // Polls at every due time up to and including `endMs`, and returns what was done.
+        std::vector<TimedAction> RunUntil(int64_t endMs)
+        {
+            std::vector<TimedAction> done;
+
+            for (;;) {
+                int64_t dueMs = _recovery.NextDueMs();
+
+                if (dueMs == IceRecovery::kNoTime || dueMs > endMs) {
+                    break;
+                }
+
+                _nowMs = std::max(_nowMs, dueMs);
+
+                std::vector<IceRecoveryAction> actions;
+                _recovery.Poll(_nowMs, &actions);
+
+                for (const IceRecoveryAction &action : actions) {
+                    TimedAction timed = { _nowMs, action.key, action.type };
+                    done.push_back(timed);
+                }
+            }
+
+            _nowMs = std::max(_nowMs, endMs);
+
+            return done;
+        }
+
+    private:
+        IceRecovery &_recovery;
+        int64_t _nowMs;
+    };
+
+    IceRecoveryConfig NoJitter()
+    {
+        IceRecoveryConfig config;
+        config.jitter = 0;
+
+        return config;
+    }
+
+} // namespace
+
+TEST(PHIceRecoveryTest, BriefDisconnectionClearsUp)
+{
+    IceRecovery recovery;
+    SimulatedClock clock(recovery);
+
+    recovery.OnIceState("a", true, IceConnectionStateConnected, 0);
+    recovery.OnIceState("a", true, IceConnectionStateDisconnected, 1000);
+
+    EXPECT_TRUE(clock.RunUntil(2400).empty());
+    EXPECT_EQ(1400, recovery.OnIceState("a", true, IceConnectionStateConnected, 2400));
+    EXPECT_TRUE(clock.RunUntil(60000).empty());
+
+    const IceRecoveryMetrics &metrics = recovery.Metrics();
+    EXPECT_EQ(1u, metrics.disconnections);
+    EXPECT_EQ(1u, metrics.recoveries);
+    EXPECT_EQ(0u, metrics.restarts);
+    EXPECT_EQ(1400, metrics.maxRecoveryMs);
+}
+
+// Without jitter, the initiator restarts after the grace period, then every doubled backoff, then gives up.
+TEST(PHIceRecoveryTest, InitiatorBacksOffAndGivesUp)
+{
+    IceRecovery recovery(NoJitter());
+    SimulatedClock clock(recovery);
+
+    recovery.OnIceState("a", true, IceConnectionStateConnected, 0);
+    recovery.OnIceState("a", true, IceConnectionStateDisconnected, 0);
+
+    std::vector<TimedAction> actions = clock.RunUntil(600000);
+
+    struct Expected
+    {
+        int64_t timeMs;
+        IceRecoveryActionType type;
+    };
+
+    const Expected expected[] = {
+        { 1500, IceRecoveryActionRestart },
+        { 3500, IceRecoveryActionRestart },
+        { 7500, IceRecoveryActionRestart },
+        { 15500, IceRecoveryActionGiveUp },
+    };
+
+    ASSERT_EQ(sizeof(expected) / sizeof(expected[0]), actions.size());
+
+    for (size_t i = 0; i < actions.size(); i++) {
+        EXPECT_EQ(expected[i].timeMs, actions[i].timeMs) << "action " << i;
+        EXPECT_EQ(expected[i].type, actions[i].type) << "action " << i;
+    }
+
+    EXPECT_EQ(3u, recovery.Metrics().restarts);
+    EXPECT_EQ(1u, recovery.Metrics().failures);
+    EXPECT_EQ(IceRecovery::kNoTime, recovery.NextDueMs());
+}
+
+TEST(PHIceRecoveryTest, BackoffIsCappedAndJittered)
+{
+    IceRecoveryConfig config;
+    config.maxRestarts = 8;
+
+    IceRecovery recovery(config, 7);
+    SimulatedClock clock(recovery);
+
+    recovery.OnIceState("a", true, IceConnectionStateDisconnected, 0);
+
+    std::vector<TimedAction> actions = clock.RunUntil(600000);
+    ASSERT_EQ(9u, actions.size());
+
+    int64_t backoffMs = config.initialBackoffMs;
+    bool spread = false;
+
+    for (size_t i = 1; i < actions.size(); i++) {
+        int64_t intervalMs = actions[i].timeMs - actions[i - 1].timeMs;
+
+        EXPECT_GE(intervalMs, (int64_t)(backoffMs * (1 - config.jitter))) << "restart " << i;
+        EXPECT_LE(intervalMs, (int64_t)(backoffMs * (1 + config.jitter))) << "restart " << i;
+
+        spread |= intervalMs != backoffMs;
+        backoffMs = std::min(backoffMs * 2, config.maxBackoffMs);
+    }
+
+    EXPECT_TRUE(spread);
+
+    // The same seed replays the same way.
+
+    IceRecovery replay(config, 7);
+    SimulatedClock replayClock(replay);
+
+    replay.OnIceState("a", true, IceConnectionStateDisconnected, 0);
+    std::vector<TimedAction> replayed = replayClock.RunUntil(600000);
+
+    ASSERT_EQ(actions.size(), replayed.size());
+
+    for (size_t i = 0; i < actions.size(); i++) {
+        EXPECT_EQ(actions[i].timeMs, replayed[i].timeMs);
+    }
+}
+
+// Both ends of one call, with 100 ms of signaling between them. The receiver never restarts while the initiator's
+// restarts keep arriving.
+TEST(PHIceRecoveryTest, ReceiverFollowsTheInitiator)
+{
+    const int64_t kSignalingMs = 100;
+
+    IceRecovery initiator(IceRecoveryConfig(), 1);
+    IceRecovery receiver(IceRecoveryConfig(), 2);
+    SimulatedClock initiatorClock(initiator);
+    SimulatedClock receiverClock(receiver);
+
+    initiator.OnIceState("call", true, IceConnectionStateDisconnected, 0);
+    receiver.OnIceState("call", false, IceConnectionStateDisconnected, 0);
+
+    // Two restarts which don't work, then one which does.
+
+    int64_t nowMs = 0;
+
+    for (int restart = 0; restart < 3; restart++) {
+        std::vector<TimedAction> actions;
+
+        while (actions.empty()) {
+            nowMs = initiator.NextDueMs();
+            actions = initiatorClock.RunUntil(nowMs);
+        }
+
+        ASSERT_EQ(IceRecoveryActionRestart, actions[0].type);
+
+        receiver.OnRemoteOffer("call", nowMs + kSignalingMs);
+        EXPECT_TRUE(receiverClock.RunUntil(nowMs + kSignalingMs).empty());
+
+        if (restart < 2) {
+            initiator.OnIceState("call", true, IceConnectionStateDisconnected, nowMs + 500);
+        }
+    }
+
+    int64_t reconnectedMs = nowMs + 800;
+
+    EXPECT_TRUE(receiverClock.RunUntil(reconnectedMs).empty());
+    EXPECT_EQ(reconnectedMs, initiator.OnIceState("call", true, IceConnectionStateConnected, reconnectedMs));
+    EXPECT_EQ(reconnectedMs, receiver.OnIceState("call", false, IceConnectionStateConnected, reconnectedMs));
+
+    EXPECT_TRUE(receiverClock.RunUntil(600000).empty());
+    EXPECT_EQ(0u, receiver.Metrics().restarts);
+    EXPECT_EQ(3u, initiator.Metrics().restarts);
+}
+
+TEST(PHIceRecoveryTest, ReceiverTakesOverFromASilentInitiator)
+{
+    IceRecovery recovery(NoJitter());
+    SimulatedClock clock(recovery);
+
+    recovery.OnIceState("a", false, IceConnectionStateDisconnected, 0);
+
+    std::vector<TimedAction> actions = clock.RunUntil(7500);
+    ASSERT_EQ(1u, actions.size());
+    EXPECT_EQ(7500, actions[0].timeMs);
+
+    // Failing outright retries at once, but no sooner than a second after the last restart.
+
+    recovery.OnIceState("a", false, IceConnectionStateFailed, 7600);
+    EXPECT_EQ(8500, recovery.NextDueMs());
+}
+
+// A pair which stays connected without media is lost from when it stopped receiving, so it's restarted at once, and
+// only media recovers it.
+TEST(PHIceRecoveryTest, StalledMediaRestarts)
+{
+    IceRecovery recovery(NoJitter());
+    SimulatedClock clock(recovery);
+
+    recovery.OnIceState("a", true, IceConnectionStateConnected, 0);
+
+    std::vector<TimedAction> actions;
+
+    for (int64_t nowMs = 2000; nowMs <= 8000; nowMs += 2000) {
+        std::vector<TimedAction> done = clock.RunUntil(nowMs);
+        actions.insert(actions.end(), done.begin(), done.end());
+
+        recovery.OnMediaReceived("a", nowMs < 4000, nowMs - 2000, nowMs);
+        EXPECT_EQ(nowMs < 8000 ? IceRecovery::kNoTime : 4000 + 1500, recovery.NextDueMs()) << "at " << nowMs;
+
+        done = clock.RunUntil(nowMs);
+        actions.insert(actions.end(), done.begin(), done.end());
+    }
+
+    ASSERT_EQ(1u, actions.size());
+    EXPECT_EQ(8000, actions[0].timeMs);
+
+    EXPECT_EQ(IceRecovery::kNoTime, recovery.OnIceState("a", true, IceConnectionStateConnected, 8500));
+    EXPECT_EQ(IceRecovery::kNoTime, recovery.OnMediaReceived("a", true, 2000, 9000));
+    EXPECT_EQ(9500 - 4000, recovery.OnMediaReceived("a", true, 9000, 9500));
+    EXPECT_TRUE(clock.RunUntil(600000).empty());
+}
+
+// Every connection is restarted together, whatever its role, and held back while signaling is down.
+TEST(PHIceRecoveryTest, NetworkChangeWaitsForSignaling)
+{
+    IceRecovery recovery;
+    SimulatedClock clock(recovery);
+
+    recovery.OnIceState("a", true, IceConnectionStateConnected, 0);
+    recovery.OnIceState("b", false, IceConnectionStateConnected, 0);
+    recovery.SetSignalingAvailable(false);
+    recovery.OnNetworkChange(1000);
+
+    EXPECT_EQ(IceRecovery::kNoTime, recovery.NextDueMs());
+    EXPECT_TRUE(clock.RunUntil(5000).empty());
+
+    recovery.SetSignalingAvailable(true);
+
+    std::vector<TimedAction> actions = clock.RunUntil(5000);
+    ASSERT_EQ(2u, actions.size());
+    EXPECT_EQ("a", actions[0].key);
+    EXPECT_EQ("b", actions[1].key);
+    EXPECT_EQ(5000, actions[1].timeMs);
+
+    EXPECT_EQ(6000 - 1000, recovery.OnMediaReceived("a", true, 5500, 6000));
+    EXPECT_EQ(6500 - 1000, recovery.OnMediaReceived("b", true, 6000, 6500));
+    EXPECT_EQ(IceRecovery::kNoTime, recovery.NextDueMs());
+    EXPECT_EQ(5500, recovery.Metrics().maxRecoveryMs);
+}
+
+TEST(PHIceRecoveryTest, ClosedConnectionsAreForgotten)
+{
+    IceRecovery recovery;
+    SimulatedClock clock(recovery);
+
+    recovery.OnIceState("a", true, IceConnectionStateDisconnected, 0);
+    recovery.OnIceState("a", true, IceConnectionStateClosed, 100);
+
+    EXPECT_EQ(IceRecovery::kNoTime, recovery.NextDueMs());
+    EXPECT_TRUE(clock.RunUntil(600000).empty());
+}
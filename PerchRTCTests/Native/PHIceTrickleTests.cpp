@@ -0,0 +1,156 @@
+//
+//  PHIceTrickleTests.cpp
+//  PerchRTCTests
+//
+//  Created by Christopher Eagleston on 2015-08-11.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#include "PHIceTrickle.h"
+
+#include <gtest/gtest.h>
+
+using namespace perch;
+
+namespace {
+
+    IceCandidate Host(uint32_t port, uint32_t priority = 2122260223)
+    {
+        return IceCandidate("audio", 0, "candidate:1467250027 1 udp " + std::to_string(priority) + " 192.168.0.196 " +
+                                        std::to_string(port) + " typ host generation 0");
+    }
+
+    IceCandidate Reflexive(uint32_t port)
+    {
+        return IceCandidate("audio", 0, "candidate:3211654 1 udp 1686052607 203.0.113.7 " + std::to_string(port) +
+                                        " typ srflx raddr 192.168.0.196 rport " + std::to_string(port) + " generation 0");
+    }
+
+    std::vector<IceCandidateBatch> TakeDue(IceCandidateBatcher &batcher, int64_t nowMs)
+    {
+        std::vector<IceCandidateBatch> batches;
+        batcher.TakeDue(nowMs, &batches);
+
+        return batches;
+    }
+
+} // namespace
+
+// A gathering burst goes out as one batch, a window after its first candidate.
+TEST(PHIceTrickleTest, BatchesWithinTheWindow)
+{
+    IceCandidateBatcher batcher(100, 20);
+
+    EXPECT_TRUE(batcher.Empty());
+    EXPECT_EQ(IceCandidateBatcher::kNoTime, batcher.NextDueMs());
+
+    batcher.Add("c1", Host(46243), 1000);
+    batcher.Add("c1", Host(46244), 1030);
+    batcher.Add("c2", Host(50000), 1050);
+
+    EXPECT_EQ(1100, batcher.NextDueMs());
+    EXPECT_TRUE(TakeDue(batcher, 1099).empty());
+
+    std::vector<IceCandidateBatch> batches = TakeDue(batcher, 1100);
+    ASSERT_EQ(1u, batches.size());
+    EXPECT_EQ("c1", batches[0].key);
+    EXPECT_EQ(2u, batches[0].candidates.size());
+
+    EXPECT_EQ(1150, batcher.NextDueMs());
+
+    // A candidate after the batch went out starts a new window.
+
+    batcher.Add("c1", Reflexive(46243), 1120);
+    EXPECT_EQ(1150, batcher.NextDueMs());
+
+    batches = TakeDue(batcher, 1220);
+    EXPECT_EQ(2u, batches.size());
+    EXPECT_TRUE(batcher.Empty());
+}
+
+TEST(PHIceTrickleTest, FullBatchAndFinishAreDueAtOnce)
+{
+    IceCandidateBatcher batcher(100, 3);
+
+    batcher.Add("c1", Host(1), 0);
+    batcher.Add("c1", Host(2), 10);
+    EXPECT_EQ(100, batcher.NextDueMs());
+    batcher.Add("c1", Host(3), 20);
+    EXPECT_EQ(20, batcher.NextDueMs());
+
+    EXPECT_EQ(3u, TakeDue(batcher, 20)[0].candidates.size());
+
+    batcher.Add("c2", Host(4), 30);
+    batcher.Finish("c2", 40);
+    batcher.Finish("c3", 40);
+
+    std::vector<IceCandidateBatch> batches = TakeDue(batcher, 40);
+    ASSERT_EQ(1u, batches.size());
+    EXPECT_EQ("c2", batches[0].key);
+
+    // A connection which goes away takes its candidates with it.
+
+    batcher.Add("c4", Host(5), 50);
+    batcher.Remove("c4");
+    EXPECT_TRUE(batcher.Empty());
+    EXPECT_TRUE(TakeDue(batcher, 1000).empty());
+}
+
+// The far end pairs candidates in the order they arrive, so the best go first. Ties keep their order.
+TEST(PHIceTrickleTest, BatchIsInPriorityOrder)
+{
+    IceCandidateBatcher batcher;
+
+    batcher.Add("c1", Reflexive(46243), 0);
+    batcher.Add("c1", Host(46244, 2122194687), 0);
+    batcher.Add("c1", IceCandidate("audio", 0, "garbage"), 0);
+    batcher.Add("c1", Host(46243), 0);
+    batcher.Add("c1", Host(46245, 2122194687), 0);
+
+    std::vector<IceCandidateBatch> batches = TakeDue(batcher, 100);
+    ASSERT_EQ(1u, batches.size());
+
+    const std::vector<IceCandidate> &candidates = batches[0].candidates;
+    ASSERT_EQ(5u, candidates.size());
+    EXPECT_EQ(Host(46243).sdp, candidates[0].sdp);
+    EXPECT_EQ(Host(46244, 2122194687).sdp, candidates[1].sdp);
+    EXPECT_EQ(Host(46245, 2122194687).sdp, candidates[2].sdp);
+    EXPECT_EQ(Reflexive(46243).sdp, candidates[3].sdp);
+    EXPECT_EQ("garbage", candidates[4].sdp);
+}
+
+TEST(PHIceTrickleTest, FilterDropsRepeats)
+{
+    IceCandidateFilter filter;
+
+    struct Case
+    {
+        const char *name;
+        IceCandidate candidate;
+        bool accepted;
+    };
+
+    const Case cases[] = {
+        { "first", Host(46243), true },
+        { "again", Host(46243), false },
+        { "another port", Host(46244), true },
+        { "another priority", Host(46243, 1), false },
+        { "another foundation", IceCandidate("audio", 0, "candidate:99 1 udp 2122260223 192.168.0.196 46243 typ host"), false },
+        { "with a=", IceCandidate("audio", 0, "a=candidate:1 1 udp 2122260223 192.168.0.196 46243 typ host"), false },
+        { "another component", IceCandidate("audio", 0, "candidate:1 2 udp 2122260223 192.168.0.196 46243 typ host"), true },
+        { "another transport", IceCandidate("audio", 0, "candidate:1 1 tcp 2122260223 192.168.0.196 46243 typ host"), true },
+        { "another media", IceCandidate("video", 1, Host(46243).sdp), true },
+        { "another ufrag", IceCandidate("audio", 0, Host(46243).sdp + " ufrag abcd"), true },
+        { "unparsed", IceCandidate("audio", 0, "garbage"), true },
+        { "unparsed again", IceCandidate("audio", 0, "garbage"), false },
+    };
+
+    for (const Case &test : cases) {
+        EXPECT_EQ(test.accepted, filter.Accept(test.candidate)) << test.name;
+    }
+
+    // A new ICE generation may repeat the last one's candidates.
+
+    filter.Reset();
+    EXPECT_TRUE(filter.Accept(Host(46243)));
+}
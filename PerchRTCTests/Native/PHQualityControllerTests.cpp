@@ -0,0 +1,216 @@
+//
+//  PHQualityControllerTests.cpp
+//  PerchRTCTests
+//
+//  Created by Christopher Eagleston on 2015-08-11.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#include "PHQualityController.h"
+#include "PHTestData.h"
+
+#include <gtest/gtest.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace perch;
+
+namespace {
+
+    const int64_t kSecond = 1000000000LL;
+
+    // The ladder PHCaptureQualityController builds, best first.
+    std::vector<QualityTier> Ladder()
+    {
+        const QualityTier tiers[] = {
+            { 0, 1280, 720, 30 },
+            { 1, 640, 480, 30 },
+            { 1, 640, 480, 20 },
+            { 2, 480, 360, 20 },
+            { 2, 480, 360, 15 },
+            { 3, 352, 288, 15 },
+        };
+
+        return std::vector<QualityTier>(tiers, tiers + sizeof(tiers) / sizeof(tiers[0]));
+    }
+
+    std::vector<QualitySample> LoadTrace(const std::string &name)
+    {
+        std::vector<QualitySample> samples;
+
+        for (const std::string &line : test::ReadTraceLines("QualityController/" + name)) {
+            int seconds;
+            unsigned captured, dropped;
+            QualitySample sample;
+
+            if (sscanf(line.c_str(), "%d %lf %lf %u %u", &seconds, &sample.cpuLoad, &sample.encodeTimeMs, &captured, &dropped) == 5) {
+                sample.timeNs = seconds * kSecond;
+                sample.framesCaptured = captured;
+                sample.framesDropped = dropped;
+                samples.push_back(sample);
+            }
+        }
+
+        return samples;
+    }
+
+    struct TierChange
+    {
+        int64_t timeNs;
+        int tier;
+    };
+
+    // Replays the samples, and returns every tier change. A change always moves by one tier, and is never followed by
+    // another within the cooldown.
+    std::vector<TierChange> Replay(QualityController &controller, const std::vector<QualitySample> &samples)
+    {
+        std::vector<TierChange> changes;
+        const QualityControllerConfig config;
+
+        for (const QualitySample &sample : samples) {
+            int previous = controller.Tier();
+
+            if (controller.Update(sample)) {
+                EXPECT_EQ(1, abs(controller.Tier() - previous)) << "at " << sample.timeNs / kSecond << " s";
+
+                if (!changes.empty()) {
+                    EXPECT_GE(sample.timeNs - changes.back().timeNs, config.cooldownNs) << "at " << sample.timeNs / kSecond << " s";
+                }
+
+                TierChange change = { sample.timeNs, controller.Tier() };
+                changes.push_back(change);
+            }
+        }
+
+        return changes;
+    }
+
+} // namespace
+
+// Sustained CPU pressure walks down the ladder one step per hold and cooldown, and headroom brings it back up slowly.
+TEST(PHQualityControllerTest, ThermalThrottle)
+{
+    QualityController controller(Ladder(), 0);
+    std::vector<TierChange> changes = Replay(controller, LoadTrace("thermal_throttle.trace"));
+
+    ASSERT_FALSE(changes.empty());
+
+    int lowest = 0;
+    int64_t firstUpgradeNs = -1;
+
+    for (const TierChange &change : changes) {
+        if (change.timeNs < 80 * kSecond) {
+            EXPECT_GE(change.timeNs, 32 * kSecond) << "stepped down before the pressure held for 2 s";
+            EXPECT_GT(change.tier, lowest) << "stepped up under pressure";
+            lowest = change.tier;
+        }
+        else if (firstUpgradeNs < 0) {
+            firstUpgradeNs = change.timeNs;
+        }
+    }
+
+    // 50 s of pressure is enough to reach the bottom of the ladder.
+
+    EXPECT_EQ((int)Ladder().size() - 1, lowest);
+
+    // Headroom has to last 10 s before the first step back up, and the rest follow.
+
+    ASSERT_GE(firstUpgradeNs, 0);
+    EXPECT_GE(firstUpgradeNs, 90 * kSecond);
+    EXPECT_LT(controller.Tier(), lowest);
+}
+
+// The encoders are the bottleneck. Without the measured encode time the controller can't tell, and stays put.
+TEST(PHQualityControllerTest, EncodeBound)
+{
+    std::vector<QualitySample> samples = LoadTrace("encode_bound.trace");
+
+    QualityController measured(Ladder(), 0);
+    Replay(measured, samples);
+
+    // 30 ms of encoding fits a 20 fps frame, but not a 30 fps one. It isn't enough headroom to go back up either.
+
+    EXPECT_EQ(2, measured.Tier());
+    EXPECT_EQ(20, measured.CurrentTier().frameRate);
+
+    for (QualitySample &sample : samples) {
+        sample.encodeTimeMs = -1;
+    }
+
+    QualityController unmeasured(Ladder(), 0);
+    EXPECT_TRUE(Replay(unmeasured, samples).empty());
+}
+
+TEST(PHQualityControllerTest, BriefSpikeIsIgnored)
+{
+    QualityController controller(Ladder(), 1);
+
+    EXPECT_TRUE(Replay(controller, LoadTrace("cpu_spike.trace")).empty());
+    EXPECT_EQ(1, controller.Tier());
+}
+
+TEST(PHQualityControllerTest, DroppedFramesArePressure)
+{
+    QualityController controller(Ladder(), 0);
+    std::vector<TierChange> changes = Replay(controller, LoadTrace("dropped_frames.trace"));
+
+    ASSERT_FALSE(changes.empty());
+    EXPECT_GE(changes.front().timeNs, 12 * kSecond);
+    EXPECT_GT(changes.front().tier, 0);
+}
+
+// Each upgrade is undone by the next burst of load, so the upgrade hold doubles until it outlasts the quiet periods.
+TEST(PHQualityControllerTest, OscillatingLoadBacksOff)
+{
+    QualityController controller(Ladder(), 0);
+    std::vector<TierChange> changes = Replay(controller, LoadTrace("oscillating_load.trace"));
+
+    const QualityControllerConfig config;
+    EXPECT_GT(controller.UpgradeHoldNs(), config.upgradeHoldNs);
+
+    int upgrades = 0;
+
+    for (size_t i = 1; i < changes.size(); i++) {
+        upgrades += changes[i].tier < changes[i - 1].tier;
+    }
+
+    // Without the back off, every 11 s quiet period would buy an upgrade.
+
+    EXPECT_LT(upgrades, 200 / 20);
+}
+
+TEST(PHQualityControllerTest, CeilingLimitsUpgrades)
+{
+    QualityController controller(Ladder(), 3);
+
+    EXPECT_FALSE(controller.SetCeiling(2, 0));
+
+    QualitySample idle;
+    idle.cpuLoad = 0.2;
+    idle.encodeTimeMs = 5;
+    idle.framesCaptured = 20;
+    idle.framesDropped = 0;
+
+    for (int seconds = 1; seconds < 120; seconds++) {
+        idle.timeNs = seconds * kSecond;
+        controller.Update(idle);
+    }
+
+    EXPECT_EQ(2, controller.Tier());
+
+    // Lowering the ceiling applies right away, and a pinned tier follows a raised one.
+
+    EXPECT_TRUE(controller.SetCeiling(4, 121 * kSecond));
+    EXPECT_EQ(4, controller.Tier());
+    EXPECT_TRUE(controller.SetCeiling(1, 122 * kSecond));
+    EXPECT_EQ(1, controller.Tier());
+}
+
+TEST(PHQualityControllerTest, EmptyLadderHasOneTier)
+{
+    QualityController controller(std::vector<QualityTier>(), 3);
+
+    EXPECT_EQ(0, controller.Tier());
+    EXPECT_EQ(kQualityStateStable, controller.State());
+}
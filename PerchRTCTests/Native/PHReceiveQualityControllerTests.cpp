@@ -0,0 +1,282 @@
+//
+//  PHReceiveQualityControllerTests.cpp
+//  PerchRTCTests
+//
+//  Created by Christopher Eagleston on 2015-08-11.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#include "PHReceiveQualityController.h"
+#include "PHTestData.h"
+
+#include <gtest/gtest.h>
+
+#include <stdio.h>
+
+using namespace perch;
+
+namespace {
+
+    // What PHMediaSession asks for at each level of the default 640x480 receive format.
+    std::vector<uint32_t> LevelPeaks()
+    {
+        const uint32_t peaks[] = { 774, 194, 48 };
+
+        return std::vector<uint32_t>(peaks, peaks + sizeof(peaks) / sizeof(peaks[0]));
+    }
+
+    struct TimedSample
+    {
+        int64_t timeMs;
+        ReceiveQualitySample sample;
+    };
+
+    std::vector<TimedSample> LoadTrace(const std::string &name)
+    {
+        std::vector<TimedSample> samples;
+
+        for (const std::string &line : test::ReadTraceLines("ReceiveQuality/" + name)) {
+            int seconds;
+            TimedSample timed;
+
+            if (sscanf(line.c_str(), "%d %f %d %u %d", &seconds, &timed.sample.lossFraction, &timed.sample.rttMs,
+                       &timed.sample.receiveKbps, &timed.sample.availableReceiveKbps) == 5) {
+                timed.timeMs = seconds * 1000LL;
+                samples.push_back(timed);
+            }
+        }
+
+        return samples;
+    }
+
+    struct Change
+    {
+        int64_t timeMs;
+        ReceiveQualityDecision decision;
+    };
+
+    // The rate a decision asks the peer for.
+    uint32_t AskedKbps(const ReceiveQualityDecision &decision)
+    {
+        return decision.capKbps ? decision.capKbps : LevelPeaks()[decision.level];
+    }
+
+    // Replays the samples for one peer, committing every decision as PHMediaSession does once it has offered, and
+    // returns them. Each change moves by one step, in the direction of its action, and keeps its distance from the last.
+    std::vector<Change> Replay(ReceiveQualityController &controller, const std::vector<TimedSample> &samples)
+    {
+        const ReceiveQualityConfig config;
+        std::vector<Change> changes;
+
+        for (const TimedSample &timed : samples) {
+            ReceiveQualityDecision previous = controller.Current("peer");
+            ReceiveQualityDecision decision;
+
+            if (!controller.Update("peer", timed.sample, timed.timeMs, &decision)) {
+                continue;
+            }
+
+            controller.Commit("peer", decision, timed.timeMs);
+
+            bool isDecrease = AskedKbps(decision) < AskedKbps(previous);
+
+            EXPECT_EQ(decision.action == ReceiveQualityActionLowerFormat, decision.level == previous.level + 1) << "at " << timed.timeMs;
+            EXPECT_EQ(decision.action == ReceiveQualityActionRaiseFormat, decision.level + 1 == previous.level) << "at " << timed.timeMs;
+
+            if (!changes.empty()) {
+                int64_t intervalMs = isDecrease ? config.minDecreaseIntervalMs : config.minIncreaseIntervalMs;
+                EXPECT_GE(timed.timeMs - changes.back().timeMs, intervalMs) << "at " << timed.timeMs;
+            }
+
+            Change change = { timed.timeMs, decision };
+            changes.push_back(change);
+        }
+
+        return changes;
+    }
+
+} // namespace
+
+// Congestion caps the peer a step at a time, then drops a level once the cap would starve it. A clear link undoes
+// it in reverse, a step every 20 s.
+TEST(PHReceiveQualityControllerTest, CongestedWifi)
+{
+    ReceiveQualityController controller(LevelPeaks());
+    std::vector<Change> changes = Replay(controller, LoadTrace("congested_wifi.trace"));
+
+    ASSERT_FALSE(changes.empty());
+
+    // Two congested rounds from 20 s.
+
+    EXPECT_EQ(22000, changes.front().timeMs);
+    EXPECT_EQ(ReceiveQualityActionCapBitrate, changes.front().decision.action);
+
+    size_t lowest = 0;
+    int64_t firstIncreaseMs = -1;
+    uint32_t askedKbps = LevelPeaks()[0];
+
+    for (const Change &change : changes) {
+        if (change.timeMs < 60000) {
+            EXPECT_LT(AskedKbps(change.decision), askedKbps) << "asked for more under congestion at " << change.timeMs;
+            lowest = std::max(lowest, change.decision.level);
+        }
+        else if (firstIncreaseMs < 0) {
+            firstIncreaseMs = change.timeMs;
+        }
+
+        askedKbps = AskedKbps(change.decision);
+    }
+
+    EXPECT_EQ(2u, lowest);
+
+    // Five healthy rounds from 60 s, 20 s after the last step down at 58 s.
+
+    EXPECT_EQ(78000, firstIncreaseMs);
+
+    ReceiveQualityDecision current = controller.Current("peer");
+    EXPECT_EQ(0u, current.level);
+    EXPECT_EQ(0u, current.capKbps);
+}
+
+// After congestion the estimate covers the middle level, but not the top one.
+TEST(PHReceiveQualityControllerTest, RecoveryFollowsTheEstimate)
+{
+    ReceiveQualityController controller(LevelPeaks());
+    std::vector<Change> changes = Replay(controller, LoadTrace("cellular_recovery.trace"));
+
+    ASSERT_FALSE(changes.empty());
+
+    ReceiveQualityDecision current = controller.Current("peer");
+    EXPECT_EQ(1u, current.level);
+    EXPECT_EQ(0u, current.capKbps);
+}
+
+TEST(PHReceiveQualityControllerTest, IsolatedSpikesAreIgnored)
+{
+    ReceiveQualityController controller(LevelPeaks());
+
+    EXPECT_TRUE(Replay(controller, LoadTrace("isolated_spikes.trace")).empty());
+}
+
+// Changes to different peers are spaced out too, so the same trace for two peers changes the second a round later.
+TEST(PHReceiveQualityControllerTest, PeersTakeTurns)
+{
+    ReceiveQualityController controller(LevelPeaks());
+    const ReceiveQualityConfig config;
+    int64_t lastChangeMs = ReceiveQualityController::kNoTime;
+    std::vector<int64_t> firstChangeMs(2, -1);
+
+    for (const TimedSample &timed : LoadTrace("congested_wifi.trace")) {
+        for (int peer = 0; peer < 2; peer++) {
+            std::string key = peer == 0 ? "first" : "second";
+            ReceiveQualityDecision decision;
+
+            if (!controller.Update(key, timed.sample, timed.timeMs, &decision)) {
+                continue;
+            }
+
+            controller.Commit(key, decision, timed.timeMs);
+
+            if (lastChangeMs != ReceiveQualityController::kNoTime) {
+                EXPECT_GE(timed.timeMs - lastChangeMs, config.minSessionIntervalMs);
+            }
+            if (firstChangeMs[peer] < 0) {
+                firstChangeMs[peer] = timed.timeMs;
+            }
+
+            lastChangeMs = timed.timeMs;
+        }
+    }
+
+    EXPECT_EQ(22000, firstChangeMs[0]);
+    EXPECT_EQ(24000, firstChangeMs[1]);
+}
+
+// A decision that can't be offered yet changes nothing, and is proposed again with the next sample.
+TEST(PHReceiveQualityControllerTest, UncommittedDecisionIsProposedAgain)
+{
+    ReceiveQualityController controller(LevelPeaks());
+    ReceiveQualitySample congested;
+    congested.lossFraction = 0.2f;
+    congested.rttMs = 600;
+    congested.receiveKbps = 700;
+
+    ReceiveQualityDecision decision;
+    EXPECT_FALSE(controller.Update("peer", congested, 0, &decision));
+    ASSERT_TRUE(controller.Update("peer", congested, 2000, &decision));
+    EXPECT_EQ(ReceiveQualityActionCapBitrate, decision.action);
+
+    EXPECT_EQ(ReceiveQualityActionNone, controller.Current("peer").action);
+
+    ReceiveQualityDecision again;
+    ASSERT_TRUE(controller.Update("peer", congested, 4000, &again));
+    EXPECT_EQ(decision.capKbps, again.capKbps);
+
+    controller.Commit("peer", again, 4000);
+    EXPECT_EQ(again.capKbps, controller.Current("peer").capKbps);
+
+    // Once committed, the next change needs a fresh run of samples and a decrease interval.
+
+    EXPECT_FALSE(controller.Update("peer", congested, 6000, &decision));
+    EXPECT_FALSE(controller.Update("peer", congested, 8000, &decision));
+    EXPECT_TRUE(controller.Update("peer", congested, 10000, &decision));
+}
+
+// Any other renegotiation holds off a change for a while.
+TEST(PHReceiveQualityControllerTest, RenegotiationHoldsOffChanges)
+{
+    ReceiveQualityController controller(LevelPeaks());
+    ReceiveQualitySample congested;
+    congested.lossFraction = 0.2f;
+    congested.rttMs = 600;
+
+    ReceiveQualityDecision decision;
+    controller.DidRenegotiate("peer", 1000);
+
+    EXPECT_FALSE(controller.Update("peer", congested, 2000, &decision));
+    EXPECT_FALSE(controller.Update("peer", congested, 3000, &decision));
+    EXPECT_TRUE(controller.Update("peer", congested, 4000, &decision));
+
+    controller.Remove("peer");
+    EXPECT_EQ(ReceiveQualityActionNone, controller.Current("peer").action);
+}
+
+// Both ends of one call see the same link, so their controllers propose changes in the same rounds. Only the initiator
+// offers. The receiver's proposal waits, uncommitted, for the initiator's offer, and is committed with its answer.
+TEST(PHReceiveQualityControllerTest, ReceiverAsksInItsNextAnswer)
+{
+    ReceiveQualityController initiator(LevelPeaks());
+    ReceiveQualityController receiver(LevelPeaks());
+    std::vector<int64_t> offersMs;
+    std::vector<int64_t> receiverCommitsMs;
+
+    for (const TimedSample &timed : LoadTrace("congested_wifi.trace")) {
+        ReceiveQualityDecision decision;
+        ReceiveQualityDecision pending;
+        bool isOffering = initiator.Update("call", timed.sample, timed.timeMs, &decision);
+        bool hasPending = receiver.Update("call", timed.sample, timed.timeMs, &pending);
+
+        if (!isOffering) {
+            continue;
+        }
+
+        // The initiator's offer is set, then the receiver's answer is, with whatever it had pending.
+
+        initiator.Commit("call", decision, timed.timeMs);
+        offersMs.push_back(timed.timeMs);
+
+        if (hasPending) {
+            receiver.Commit("call", pending, timed.timeMs);
+            receiverCommitsMs.push_back(timed.timeMs);
+        }
+    }
+
+    ASSERT_FALSE(offersMs.empty());
+    EXPECT_EQ(22000, offersMs.front());
+    EXPECT_EQ(offersMs, receiverCommitsMs);
+
+    // Seeing the same trace, both ends step the same way.
+
+    EXPECT_EQ(initiator.Current("call").level, receiver.Current("call").level);
+    EXPECT_EQ(initiator.Current("call").capKbps, receiver.Current("call").capKbps);
+}
@@ -0,0 +1,253 @@
+//
+//  PHScaleConvertTests.cpp
+//  PerchRTCTests
+//
+//  Created by Christopher Eagleston on 2015-08-11.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#include "PHScaleConvert.h"
+
+#include <gtest/gtest.h>
+
+#include <math.h>
+#include <vector>
+
+namespace {
+
+    const PHConvertKernel kKernels[] = { PHConvertKernelScalar, PHConvertKernelNEON, PHConvertKernelSSE2, PHConvertKernelAVX2 };
+
+    // A synthetic I420 test card: gradients, a checkerboard and noise, so that every filter tap matters.
+    // The noise is generated here rather than by rand(), so the golden images hold on every platform.
+    struct TestImage
+    {
+        TestImage(int imageWidth, int imageHeight)
+        : width(imageWidth), height(imageHeight), chromaWidth((imageWidth + 1) / 2), chromaHeight((imageHeight + 1) / 2),
+          y(imageWidth * imageHeight), u(chromaWidth * chromaHeight), v(chromaWidth * chromaHeight), _random(42)
+        {
+            for (int row = 0; row < height; row++) {
+                for (int x = 0; x < width; x++) {
+                    int checker = ((x / 8 + row / 8) & 1) ? 40 : 0;
+                    y[row * width + x] = (uint8_t)((x * 200 / width + checker + (Random() & 7)) & 0xFF);
+                }
+            }
+
+            for (int row = 0; row < chromaHeight; row++) {
+                for (int x = 0; x < chromaWidth; x++) {
+                    u[row * chromaWidth + x] = (uint8_t)(64 + row * 128 / chromaHeight);
+                    v[row * chromaWidth + x] = (uint8_t)(192 - x * 128 / chromaWidth + (Random() & 3));
+                }
+            }
+        }
+
+        int width, height, chromaWidth, chromaHeight;
+        std::vector<uint8_t> y, u, v;
+
+    private:
+        uint32_t Random()
+        {
+            _random ^= _random << 13;
+            _random ^= _random >> 17;
+            _random ^= _random << 5;
+            return _random;
+        }
+
+        uint32_t _random;
+    };
+
+    struct ScaledNV12
+    {
+        ScaledNV12(const TestImage &image, int dstWidth, int dstHeight, PHScaleFilter filter)
+        : width(dstWidth), height(dstHeight), y(dstWidth * dstHeight), uv(2 * ((dstWidth + 1) / 2) * ((dstHeight + 1) / 2))
+        {
+            PHScaleI420ToNV12(image.y.data(), image.width, image.u.data(), image.chromaWidth, image.v.data(), image.chromaWidth,
+                              image.width, image.height, y.data(), dstWidth, uv.data(), 2 * ((dstWidth + 1) / 2), dstWidth, dstHeight, filter);
+        }
+
+        int width, height;
+        std::vector<uint8_t> y, uv;
+    };
+
+    uint32_t Fnv1a(const std::vector<uint8_t> &bytes)
+    {
+        uint32_t hash = 2166136261u;
+
+        for (uint8_t byte : bytes) {
+            hash = (hash ^ byte) * 16777619u;
+        }
+
+        return hash;
+    }
+
+    // Exact area average, rounded, over the same source boxes as the scaler.
+    uint8_t ReferenceBox(const std::vector<uint8_t> &plane, int srcWidth, int srcHeight, int dstWidth, int dstHeight, int x, int row)
+    {
+        int x0 = (int)((int64_t)x * srcWidth / dstWidth);
+        int x1 = std::max((int)((int64_t)(x + 1) * srcWidth / dstWidth), x0 + 1);
+        int y0 = (int)((int64_t)row * srcHeight / dstHeight);
+        int y1 = std::max((int)((int64_t)(row + 1) * srcHeight / dstHeight), y0 + 1);
+
+        x1 = std::min(x1, srcWidth);
+        y1 = std::min(y1, srcHeight);
+
+        int sum = 0;
+
+        for (int sy = y0; sy < y1; sy++) {
+            for (int sx = x0; sx < x1; sx++) {
+                sum += plane[sy * srcWidth + sx];
+            }
+        }
+
+        return (uint8_t)lround((double)sum / ((x1 - x0) * (y1 - y0)));
+    }
+
+    uint8_t ReferenceBilinear(const std::vector<uint8_t> &plane, int srcWidth, int srcHeight, int dstWidth, int dstHeight, int x, int row)
+    {
+        double sx = std::max(0.0, std::min((x + 0.5) * srcWidth / dstWidth - 0.5, srcWidth - 1.0));
+        double sy = std::max(0.0, std::min((row + 0.5) * srcHeight / dstHeight - 0.5, srcHeight - 1.0));
+        int x0 = (int)sx, y0 = (int)sy;
+        int x1 = std::min(x0 + 1, srcWidth - 1), y1 = std::min(y0 + 1, srcHeight - 1);
+        double fx = sx - x0, fy = sy - y0;
+
+        double top = plane[y0 * srcWidth + x0] * (1 - fx) + plane[y0 * srcWidth + x1] * fx;
+        double bottom = plane[y1 * srcWidth + x0] * (1 - fx) + plane[y1 * srcWidth + x1] * fx;
+
+        return (uint8_t)lround(top * (1 - fy) + bottom * fy);
+    }
+
+    class PHScaleConvertTest : public ::testing::Test
+    {
+    protected:
+        virtual void TearDown()
+        {
+            PHConvertSelectKernel(PHConvertKernelAutomatic);
+        }
+    };
+
+} // namespace
+
+TEST_F(PHScaleConvertTest, HalvingIsAnExactBoxAverage)
+{
+    TestImage image(640, 480);
+
+    for (PHConvertKernel kernel : kKernels) {
+        if (!PHConvertSelectKernel(kernel)) {
+            continue;
+        }
+
+        ScaledNV12 scaled(image, 320, 240, PHScaleFilterAutomatic);
+
+        for (int row = 0; row < 240; row++) {
+            for (int x = 0; x < 320; x++) {
+                const uint8_t *src = &image.y[2 * row * 640 + 2 * x];
+                int expected = (src[0] + src[1] + src[640] + src[641] + 2) >> 2;
+
+                ASSERT_EQ(expected, scaled.y[row * 320 + x]) << "kernel " << kernel << " at " << x << "," << row;
+            }
+        }
+    }
+}
+
+TEST_F(PHScaleConvertTest, BoxMatchesAreaAverage)
+{
+    TestImage image(641, 363);
+
+    for (PHConvertKernel kernel : kKernels) {
+        if (!PHConvertSelectKernel(kernel)) {
+            continue;
+        }
+
+        ScaledNV12 scaled(image, 200, 90, PHScaleFilterBox);
+
+        for (int row = 0; row < scaled.height; row++) {
+            for (int x = 0; x < scaled.width; x++) {
+                int expected = ReferenceBox(image.y, image.width, image.height, scaled.width, scaled.height, x, row);
+
+                ASSERT_NEAR(expected, scaled.y[row * scaled.width + x], 1) << "kernel " << kernel << " at " << x << "," << row;
+            }
+        }
+    }
+}
+
+TEST_F(PHScaleConvertTest, BilinearMatchesReference)
+{
+    TestImage image(352, 288);
+
+    // Down, up, and a mix of both.
+    const int sizes[][2] = { { 240, 180 }, { 500, 400 }, { 300, 320 } };
+
+    for (PHConvertKernel kernel : kKernels) {
+        if (!PHConvertSelectKernel(kernel)) {
+            continue;
+        }
+
+        for (const int *size : sizes) {
+            ScaledNV12 scaled(image, size[0], size[1], PHScaleFilterBilinear);
+
+            for (int row = 0; row < scaled.height; row++) {
+                for (int x = 0; x < scaled.width; x++) {
+                    int expected = ReferenceBilinear(image.y, image.width, image.height, scaled.width, scaled.height, x, row);
+
+                    ASSERT_NEAR(expected, scaled.y[row * scaled.width + x], 2) << "kernel " << kernel << " at " << x << "," << row;
+                }
+            }
+        }
+    }
+}
+
+TEST_F(PHScaleConvertTest, SameSizeMatchesPlainConversion)
+{
+    TestImage image(97, 31);
+
+    std::vector<uint8_t> scaled(4 * 97 * 31), converted(4 * 97 * 31);
+
+    PHScaleConvertI420ToRGB(image.y.data(), 97, image.u.data(), image.chromaWidth, image.v.data(), image.chromaWidth, 97, 31,
+                            scaled.data(), 4 * 97, 97, 31, PHScaleFilterBilinear, PHColorMatrixBT601VideoRange, PHRGBLayoutBGRA);
+    PHConvertI420ToRGB(image.y.data(), 97, image.u.data(), image.chromaWidth, image.v.data(), image.chromaWidth,
+                       converted.data(), 4 * 97, 97, 31, PHColorMatrixBT601VideoRange, PHRGBLayoutBGRA);
+
+    EXPECT_EQ(converted, scaled);
+}
+
+// Golden outputs, recorded from the scalar kernels. Every kernel must reproduce them exactly.
+TEST_F(PHScaleConvertTest, GoldenImages)
+{
+    struct {
+        int width;
+        int height;
+        PHScaleFilter filter;
+        uint32_t rgbHash;
+        uint32_t nv12Hash;
+    } goldens[] = {
+        { 320, 240, PHScaleFilterAutomatic, 2895935175u, 1024175439u },
+        { 160, 120, PHScaleFilterBox, 2625107137u, 3722126180u },
+        { 213, 160, PHScaleFilterBox, 928982060u, 801657925u },
+        { 480, 360, PHScaleFilterBilinear, 54245590u, 1371236844u },
+        { 1280, 720, PHScaleFilterBilinear, 3489870236u, 2604717018u },
+    };
+
+    TestImage image(640, 480);
+
+    for (PHConvertKernel kernel : kKernels) {
+        if (!PHConvertSelectKernel(kernel)) {
+            continue;
+        }
+
+        for (const auto &golden : goldens) {
+            // Padded destination rows, as a pixel buffer would have.
+            int dstStride = 4 * golden.width + 32;
+            std::vector<uint8_t> rgb(dstStride * golden.height, 0);
+
+            PHScaleConvertI420ToRGB(image.y.data(), image.width, image.u.data(), image.chromaWidth, image.v.data(), image.chromaWidth,
+                                    image.width, image.height, rgb.data(), dstStride, golden.width, golden.height,
+                                    golden.filter, PHColorMatrixBT709VideoRange, PHRGBLayoutBGRA);
+
+            ScaledNV12 nv12(image, golden.width, golden.height, golden.filter);
+            std::vector<uint8_t> planes(nv12.y);
+            planes.insert(planes.end(), nv12.uv.begin(), nv12.uv.end());
+
+            EXPECT_EQ(golden.rgbHash, Fnv1a(rgb)) << "kernel " << kernel << " " << golden.width << "x" << golden.height;
+            EXPECT_EQ(golden.nv12Hash, Fnv1a(planes)) << "kernel " << kernel << " " << golden.width << "x" << golden.height;
+        }
+    }
+}
@@ -0,0 +1,264 @@
+//
+//  PHSdpPolicyTests.cpp
+//  PerchRTCTests
+//
+//  Created by Christopher Eagleston on 2015-08-11.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#include "PHSdpPolicy.h"
+#include "PHTestData.h"
+
+#include <gtest/gtest.h>
+
+using namespace perch;
+
+namespace {
+
+    // What PHSessionDescriptionFactory builds from +[PHMediaConfiguration defaultConfiguration], with a 500 kbps cap.
+    SdpPolicy DefaultPolicy()
+    {
+        SdpPolicy policy;
+
+        policy.audio.codecOrder.push_back(SdpCodecPreference("opus", 48000));
+        policy.audio.maxBitrateKbps = 64;
+
+        policy.video.codecOrder.push_back(SdpCodecPreference("VP8"));
+        policy.video.maxBitrateKbps = 500;
+        policy.video.maxFrameRate = 30;
+        policy.video.maxFrameSize = SdpFrameSizeInMacroblocks(640, 480);
+
+        return policy;
+    }
+
+    std::string Condition(const SdpPolicy &policy, const std::string &sdp, size_t *applied = NULL)
+    {
+        SdpSession session;
+        EXPECT_TRUE(session.Parse(sdp));
+
+        size_t count = ApplySdpPolicy(policy, &session);
+
+        if (applied) {
+            *applied = count;
+        }
+
+        return session.Serialize();
+    }
+
+    std::string MediaLine(const SdpMediaSection &section)
+    {
+        return std::string("m=") + section.Lines()[0].value.ToString();
+    }
+
+    bool HasEncoding(const SdpMediaSection &section, const char *name)
+    {
+        std::vector<SdpRtpMap> maps = section.RtpMaps();
+
+        for (size_t i = 0; i < maps.size(); i++) {
+            if (maps[i].encodingName.EqualsIgnoringCase(name)) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    int CountAttributes(const SdpMediaSection &section, const char *name, const char *valuePrefix = "")
+    {
+        int count = 0;
+
+        for (int i = section.FindAttribute(name); i >= 0; i = section.FindAttribute(name, i + 1)) {
+            count += section.Lines()[i].attributeValue.StartsWith(valuePrefix);
+        }
+
+        return count;
+    }
+
+} // namespace
+
+// The conditioned Chrome offer is checked in, so that any change to what we send is a reviewed one.
+TEST(PHSdpPolicyTest, DefaultPolicyMatchesGolden)
+{
+    std::string expected = test::ReadDataFile("Sdp/Conditioned/chrome45_offer.sdp");
+
+    ASSERT_FALSE(expected.empty());
+    EXPECT_EQ(expected, Condition(DefaultPolicy(), test::ReadDataFile("Sdp/chrome45_offer.sdp")));
+}
+
+// Output depends only on the input and the policy, and a second pass changes nothing.
+TEST(PHSdpPolicyTest, CorpusIsDeterministicAndIdempotent)
+{
+    SdpPolicy policy = DefaultPolicy();
+    policy.audio.codecOrder.insert(policy.audio.codecOrder.begin(), SdpCodecPreference("ISAC", 16000));
+    policy.video.codecOrder.push_back(SdpCodecPreference("H264"));
+    policy.video.pruneRetransmission = true;
+    policy.video.pruneForwardErrorCorrection = true;
+
+    for (const std::string &name : test::ListDataFiles("Sdp", ".sdp")) {
+        std::string sdp = test::ReadDataFile("Sdp/" + name);
+        std::string once = Condition(policy, sdp);
+
+        EXPECT_EQ(once, Condition(policy, sdp)) << name;
+        EXPECT_EQ(once, Condition(policy, once)) << name;
+    }
+}
+
+TEST(PHSdpPolicyTest, EverySectionOfAMultiStreamOffer)
+{
+    SdpSession session;
+    ASSERT_TRUE(session.Parse(test::ReadDataFile("Sdp/chrome_unified_plan_two_video.sdp")));
+
+    SdpPolicy policy = DefaultPolicy();
+    policy.video.codecOrder[0] = SdpCodecPreference("H264");
+
+    EXPECT_EQ(3u, ApplySdpPolicy(policy, &session));
+
+    EXPECT_EQ("m=video 9 UDP/TLS/RTP/SAVPF 100 96 97 98 99 101 102 125 104 105", MediaLine(session.Media(1)));
+    EXPECT_EQ("m=video 9 UDP/TLS/RTP/SAVPF 100 96 97 101", MediaLine(session.Media(2)));
+
+    for (size_t i = 1; i < 3; i++) {
+        const SdpMediaSection &video = session.Media(i);
+        uint32_t value = 0;
+        SdpToken parameter;
+
+        EXPECT_TRUE(video.Bandwidth("AS", &value));
+        EXPECT_EQ(500u, value);
+        EXPECT_TRUE(video.Bandwidth("TIAS", &value));
+        EXPECT_EQ(500000u, value);
+
+        // H.264 takes macroblocks per second in place of a frame rate.
+
+        ASSERT_TRUE(video.FormatParameter(96, "max-fr", &parameter));
+        EXPECT_TRUE(parameter.Equals("30"));
+        ASSERT_TRUE(video.FormatParameter(100, "max-mbps", &parameter));
+        EXPECT_TRUE(parameter.Equals("36000"));
+        EXPECT_FALSE(video.FormatParameter(100, "max-fr", &parameter));
+        EXPECT_FALSE(video.FormatParameter(97, "max-fs", &parameter)) << "rtx has no frame size";
+    }
+}
+
+// The old string replace of "111 103" relied on Chrome 45's order. Later Chrome puts red between them.
+TEST(PHSdpPolicyTest, PreferredAudioCodecAnywhereInTheList)
+{
+    SdpPolicy policy;
+    policy.audio.codecOrder.push_back(SdpCodecPreference("ISAC", 16000));
+
+    const char *inputs[] = { "chrome_unified_plan_two_video.sdp", "firefox40_offer.sdp", "perch_ios_conditioned_answer.sdp" };
+    const char *expected[] = {
+        "m=audio 9 UDP/TLS/RTP/SAVPF 103 111 63 9 0 8 110 126",
+        "m=audio 9 UDP/TLS/RTP/SAVPF 109 9 0 8",
+        "m=audio 9 UDP/TLS/RTP/SAVPF 103 111 9 0 8 126",
+    };
+
+    for (size_t i = 0; i < 3; i++) {
+        SdpSession session;
+        ASSERT_TRUE(session.Parse(test::ReadDataFile(std::string("Sdp/") + inputs[i])));
+
+        ApplySdpPolicy(policy, &session);
+        EXPECT_EQ(expected[i], MediaLine(session.Media(0))) << inputs[i];
+    }
+}
+
+TEST(PHSdpPolicyTest, RejectedAndDataSectionsAreLeftAlone)
+{
+    std::string sdp = test::ReadDataFile("Sdp/chrome45_answer_rejected_video.sdp");
+    size_t applied = 0;
+
+    SdpSession session;
+    ASSERT_TRUE(session.Parse(Condition(DefaultPolicy(), sdp, &applied)));
+
+    SdpSession original;
+    ASSERT_TRUE(original.Parse(sdp));
+
+    EXPECT_EQ(1u, applied);
+    ASSERT_EQ(3u, session.MediaCount());
+
+    for (size_t i = 1; i < 3; i++) {
+        ASSERT_EQ(original.Media(i).Lines().size(), session.Media(i).Lines().size());
+
+        for (size_t j = 0; j < session.Media(i).Lines().size(); j++) {
+            EXPECT_EQ(original.Media(i).Lines()[j].value.ToString(), session.Media(i).Lines()[j].value.ToString());
+        }
+    }
+}
+
+TEST(PHSdpPolicyTest, PruneForwardErrorCorrection)
+{
+    SdpSession session;
+    ASSERT_TRUE(session.Parse(test::ReadDataFile("Sdp/chrome_unified_plan_two_video.sdp")));
+
+    SdpPolicy policy;
+    policy.video.pruneForwardErrorCorrection = true;
+    ApplySdpPolicy(policy, &session);
+
+    // red, ulpfec and flexfec go, as does the rtx which protects red. The other rtx formats and their SSRCs stay.
+
+    const SdpMediaSection &video = session.Media(1);
+    EXPECT_EQ("m=video 9 UDP/TLS/RTP/SAVPF 96 97 98 99 100 101", MediaLine(video));
+    EXPECT_FALSE(HasEncoding(video, "red"));
+    EXPECT_FALSE(HasEncoding(video, "ulpfec"));
+    EXPECT_FALSE(HasEncoding(video, "flexfec-03"));
+    EXPECT_EQ(0, CountAttributes(video, "rtcp-fb", "105 "));
+    EXPECT_EQ(0, CountAttributes(video, "fmtp", "125 "));
+    EXPECT_EQ(1, CountAttributes(video, "ssrc-group", "FID"));
+
+    // Audio red is redundant audio, not video FEC, and audio wasn't asked to prune anything.
+
+    EXPECT_TRUE(HasEncoding(session.Media(0), "red"));
+}
+
+TEST(PHSdpPolicyTest, PruneRetransmission)
+{
+    SdpSession session;
+    ASSERT_TRUE(session.Parse(test::ReadDataFile("Sdp/chrome45_offer.sdp")));
+
+    SdpPolicy policy;
+    policy.video.pruneRetransmission = true;
+    ApplySdpPolicy(policy, &session);
+
+    const SdpMediaSection &video = session.Media(1);
+    EXPECT_EQ("m=video 9 UDP/TLS/RTP/SAVPF 100 116 117", MediaLine(video));
+    EXPECT_EQ(0, CountAttributes(video, "ssrc-group"));
+    EXPECT_EQ(0, CountAttributes(video, "ssrc", "632943048 "));
+    EXPECT_EQ(4, CountAttributes(video, "ssrc", "2231627014 "));
+}
+
+TEST(PHSdpPolicyTest, NeverRemovesTheLastFormat)
+{
+    SdpSession session;
+    ASSERT_TRUE(session.Parse("v=0\r\nm=video 9 RTP/SAVPF 116 117\r\na=rtpmap:116 red/90000\r\na=rtpmap:117 ulpfec/90000\r\n"));
+
+    SdpPolicy policy;
+    policy.video.pruneForwardErrorCorrection = true;
+    ApplySdpPolicy(policy, &session);
+
+    EXPECT_EQ("m=video 9 RTP/SAVPF 116 117", MediaLine(session.Media(0)));
+}
+
+TEST(PHSdpPolicyTest, ExistingBandwidthIsReplaced)
+{
+    SdpSession session;
+    ASSERT_TRUE(session.Parse(test::ReadDataFile("Sdp/firefox_simulcast_recv_answer.sdp")));
+
+    SdpPolicy policy;
+    policy.video.maxBitrateKbps = 300;
+    ApplySdpPolicy(policy, &session);
+
+    const SdpMediaSection &video = session.Media(1);
+    uint32_t value = 0;
+    int bandwidthLines = 0;
+
+    for (size_t i = 0; i < video.Lines().size(); i++) {
+        bandwidthLines += video.Lines()[i].type == 'b';
+    }
+
+    EXPECT_EQ(2, bandwidthLines);
+    EXPECT_TRUE(video.Bandwidth("AS", &value));
+    EXPECT_EQ(300u, value);
+
+    // Hints the policy doesn't set are left as they were.
+
+    SdpToken parameter;
+    ASSERT_TRUE(video.FormatParameter(120, "max-fs", &parameter));
+    EXPECT_TRUE(parameter.Equals("1200"));
+}
@@ -0,0 +1,400 @@
+//
+//  PHSdpTests.cpp
+//  PerchRTCTests
+//
+//  Created by Christopher Eagleston on 2015-08-11.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#include "PHSdp.h"
+#include "PHTestData.h"
+
+#include <gtest/gtest.h>
+
+using namespace perch;
+
+namespace {
+
+    std::vector<std::string> Corpus()
+    {
+        return test::ListDataFiles("Sdp", ".sdp");
+    }
+
+    std::string ReadSdp(const std::string &name)
+    {
+        return test::ReadDataFile("Sdp/" + name);
+    }
+
+    std::string MediaLine(const SdpMediaSection &section)
+    {
+        return std::string("m=") + section.Lines()[0].value.ToString();
+    }
+
+    // The lines of the section with the given attribute name, as "name:value".
+    std::vector<std::string> Attributes(const SdpMediaSection &section, const char *name)
+    {
+        std::vector<std::string> values;
+
+        for (int i = section.FindAttribute(name); i >= 0; i = section.FindAttribute(name, i + 1)) {
+            values.push_back(section.Lines()[i].value.ToString());
+        }
+
+        return values;
+    }
+
+    // Where the first line of the given type is in the section, or -1.
+    int IndexOfType(const SdpMediaSection &section, char type)
+    {
+        for (size_t i = 0; i < section.Lines().size(); i++) {
+            if (section.Lines()[i].type == type) {
+                return (int)i;
+            }
+        }
+
+        return -1;
+    }
+
+} // namespace
+
+TEST(PHSdpTest, CorpusIsPresent)
+{
+    EXPECT_GE(Corpus().size(), 7u);
+}
+
+// WebRTC writes CRLF, and anything it reads back must be exactly what it wrote.
+TEST(PHSdpTest, CorpusRoundTripsExactly)
+{
+    for (const std::string &name : Corpus()) {
+        std::string sdp = ReadSdp(name);
+        SdpSession session;
+
+        ASSERT_FALSE(sdp.empty()) << name;
+        ASSERT_TRUE(session.Parse(sdp)) << name;
+        EXPECT_EQ(sdp, session.Serialize()) << name;
+    }
+}
+
+TEST(PHSdpTest, LineFeedsAreWrittenAsCrlf)
+{
+    SdpSession session;
+
+    ASSERT_TRUE(session.Parse("v=0\no=- 1 2 IN IP4 127.0.0.1\n\ns=-\r\nt=0 0"));
+    EXPECT_EQ("v=0\r\no=- 1 2 IN IP4 127.0.0.1\r\ns=-\r\nt=0 0\r\n", session.Serialize());
+}
+
+TEST(PHSdpTest, RejectsMalformedInput)
+{
+    const char *inputs[] = {
+        "",
+        "\r\n\r\n",
+        "o=- 1 2 IN IP4 127.0.0.1\r\nv=0\r\n",
+        "v=0\r\nnot a line\r\n",
+        "v=0\r\nA=upper case type\r\n",
+        "v=0\r\nx\r\n",
+        "v=0\r\nm=video\r\n",
+        "v=0\r\nm= 9 RTP/AVP 96\r\n",
+    };
+
+    for (const char *input : inputs) {
+        SdpSession session;
+        EXPECT_FALSE(session.Parse(input)) << input;
+    }
+
+    // A media line may omit its formats.
+
+    SdpSession session;
+    ASSERT_TRUE(session.Parse("v=0\r\nm=video 0 RTP/AVP\r\n"));
+    EXPECT_TRUE(session.Media(0).Formats().empty());
+}
+
+TEST(PHSdpTest, SessionAndMediaStructure)
+{
+    SdpSession session;
+    ASSERT_TRUE(session.Parse(ReadSdp("chrome45_offer.sdp")));
+
+    EXPECT_EQ(6u, session.Lines().size());
+    EXPECT_EQ('v', session.Lines()[0].type);
+    ASSERT_EQ(3u, session.MediaCount());
+
+    const SdpMediaSection &audio = session.Media(0);
+    EXPECT_TRUE(audio.Media().Equals("audio"));
+    EXPECT_TRUE(audio.Port().Equals("9"));
+    EXPECT_TRUE(audio.Protocol().Equals("UDP/TLS/RTP/SAVPF"));
+    EXPECT_EQ(10u, audio.Formats().size());
+
+    const SdpMediaSection &data = session.Media(2);
+    EXPECT_TRUE(data.Media().Equals("application"));
+    ASSERT_EQ(1u, data.Formats().size());
+    EXPECT_TRUE(data.Formats()[0].Equals("5000"));
+
+    EXPECT_EQ(&session.Media(1), session.FindMedia("video"));
+    EXPECT_TRUE(session.FindMedia("text") == NULL);
+
+    // Attribute names and values are split at the first colon only.
+
+    int fingerprint = audio.FindAttribute("fingerprint");
+    ASSERT_GE(fingerprint, 0);
+    EXPECT_TRUE(audio.Lines()[fingerprint].attributeValue.StartsWith("sha-256 49:66:12"));
+
+    int rtcpMux = audio.FindAttribute("rtcp-mux");
+    ASSERT_GE(rtcpMux, 0);
+    EXPECT_TRUE(audio.Lines()[rtcpMux].attributeValue.Empty());
+}
+
+TEST(PHSdpTest, RtpMaps)
+{
+    SdpSession session;
+    ASSERT_TRUE(session.Parse(ReadSdp("firefox40_offer.sdp")));
+
+    std::vector<SdpRtpMap> audio = session.Media(0).RtpMaps();
+    ASSERT_EQ(4u, audio.size());
+    EXPECT_EQ(109u, audio[0].payloadType);
+    EXPECT_TRUE(audio[0].encodingName.Equals("opus"));
+    EXPECT_EQ(48000u, audio[0].clockRate);
+    EXPECT_EQ(2u, audio[0].channels);
+    EXPECT_EQ(1u, audio[1].channels);
+    EXPECT_EQ(0u, audio[2].channels);
+
+    std::vector<SdpRtpMap> video = session.Media(1).RtpMaps();
+    ASSERT_EQ(3u, video.size());
+    EXPECT_TRUE(video[2].encodingName.Equals("H264"));
+}
+
+TEST(PHSdpTest, PreferCodecKeepsRelativeOrder)
+{
+    SdpSession session;
+    ASSERT_TRUE(session.Parse(ReadSdp("firefox40_offer.sdp")));
+
+    SdpMediaSection &video = session.Media(1);
+
+    EXPECT_TRUE(video.PreferCodec("h264", 90000));
+    EXPECT_EQ("m=video 9 UDP/TLS/RTP/SAVPF 126 97 120", MediaLine(video));
+
+    EXPECT_FALSE(video.PreferCodec("VP9"));
+    EXPECT_FALSE(video.PreferCodec("VP8", 48000));
+    EXPECT_EQ("m=video 9 UDP/TLS/RTP/SAVPF 126 97 120", MediaLine(video));
+
+    EXPECT_TRUE(video.PreferCodec("VP8"));
+    EXPECT_EQ("m=video 9 UDP/TLS/RTP/SAVPF 120 126 97", MediaLine(video));
+    EXPECT_EQ(ReadSdp("firefox40_offer.sdp"), session.Serialize());
+}
+
+// The old string replace of "111 103" didn't match when Chrome put ISAC anywhere else.
+TEST(PHSdpTest, PreferCodecMatchesClockRate)
+{
+    SdpSession session;
+    ASSERT_TRUE(session.Parse(ReadSdp("chrome45_offer.sdp")));
+
+    SdpMediaSection &audio = session.Media(0);
+
+    EXPECT_TRUE(audio.PreferCodec("ISAC", 32000));
+    EXPECT_EQ("m=audio 9 UDP/TLS/RTP/SAVPF 104 111 103 9 0 8 106 105 13 126", MediaLine(audio));
+
+    EXPECT_TRUE(audio.PreferCodec("ISAC"));
+    EXPECT_EQ("m=audio 9 UDP/TLS/RTP/SAVPF 104 103 111 9 0 8 106 105 13 126", MediaLine(audio));
+}
+
+TEST(PHSdpTest, SetBandwidthFollowsConnectionLine)
+{
+    SdpSession session;
+    ASSERT_TRUE(session.Parse(ReadSdp("chrome45_offer.sdp")));
+
+    SdpMediaSection &video = session.Media(1);
+    uint32_t value = 0;
+
+    EXPECT_FALSE(video.Bandwidth("AS", &value));
+
+    video.SetBandwidth("AS", 500);
+    video.SetBandwidth("TIAS", 500000);
+
+    EXPECT_EQ(IndexOfType(video, 'c') + 1, IndexOfType(video, 'b'));
+    EXPECT_EQ("AS:500", video.Lines()[2].value.ToString());
+    EXPECT_EQ("TIAS:500000", video.Lines()[3].value.ToString());
+
+    // Replacing a line keeps its place.
+
+    video.SetBandwidth("AS", 250);
+    EXPECT_EQ("AS:250", video.Lines()[2].value.ToString());
+    EXPECT_TRUE(video.Bandwidth("AS", &value));
+    EXPECT_EQ(250u, value);
+    EXPECT_TRUE(video.Bandwidth("TIAS", &value));
+    EXPECT_EQ(500000u, value);
+
+    // Only video was touched.
+
+    EXPECT_FALSE(session.Media(0).Bandwidth("AS", &value));
+}
+
+TEST(PHSdpTest, SetBandwidthWithoutConnectionLine)
+{
+    SdpSession session;
+    ASSERT_TRUE(session.Parse("v=0\r\nm=audio 9 RTP/AVP 0\r\na=rtpmap:0 PCMU/8000\r\n"));
+
+    session.Media(0).SetBandwidth("AS", 64);
+    EXPECT_EQ("v=0\r\nm=audio 9 RTP/AVP 0\r\nb=AS:64\r\na=rtpmap:0 PCMU/8000\r\n", session.Serialize());
+}
+
+TEST(PHSdpTest, FormatParameters)
+{
+    SdpSession session;
+    ASSERT_TRUE(session.Parse(ReadSdp("firefox40_offer.sdp")));
+
+    SdpMediaSection &video = session.Media(1);
+    SdpToken value;
+
+    // Replace a parameter in place, and append one.
+
+    ASSERT_TRUE(video.FormatParameter(120, "max-fs", &value));
+    EXPECT_TRUE(value.Equals("12288"));
+
+    video.SetFormatParameter(120, "max-fs", "1200");
+    video.SetFormatParameter(126, "max-fs", "3600");
+
+    EXPECT_EQ(std::vector<std::string>({
+        "fmtp:126 profile-level-id=42e01f;level-asymmetry-allowed=1;packetization-mode=1;max-fs=3600",
+        "fmtp:120 max-fs=1200;max-fr=60",
+        "fmtp:97 profile-level-id=42e01f;level-asymmetry-allowed=1",
+    }), Attributes(video, "fmtp"));
+
+    // Chrome writes "minptime=10; useinbandfec=1", with a space. The parameter is still found.
+
+    SdpSession chrome;
+    ASSERT_TRUE(chrome.Parse(ReadSdp("chrome45_offer.sdp")));
+
+    ASSERT_TRUE(chrome.Media(0).FormatParameter(111, "useinbandfec", &value));
+    EXPECT_TRUE(value.Equals("1"));
+    chrome.Media(0).SetFormatParameter(111, "useinbandfec", "0");
+    EXPECT_EQ("fmtp:111 minptime=10;useinbandfec=0", Attributes(chrome.Media(0), "fmtp")[0]);
+}
+
+TEST(PHSdpTest, SetFormatParameterAddsLineAfterRtpMap)
+{
+    SdpSession session;
+    ASSERT_TRUE(session.Parse(ReadSdp("chrome45_offer.sdp")));
+
+    SdpMediaSection &video = session.Media(1);
+    SdpToken value;
+
+    EXPECT_FALSE(video.FormatParameter(100, "max-fr", &value));
+
+    video.SetFormatParameter(100, "max-fr", "15");
+
+    int rtpmap = video.FindAttribute("rtpmap");
+    ASSERT_GE(rtpmap, 0);
+    EXPECT_EQ("fmtp:100 max-fr=15", video.Lines()[rtpmap + 1].value.ToString());
+    EXPECT_TRUE(video.FormatParameter(100, "max-fr", &value));
+    EXPECT_TRUE(value.Equals("15"));
+}
+
+TEST(PHSdpTest, RemoveFormat)
+{
+    SdpSession session;
+    ASSERT_TRUE(session.Parse(ReadSdp("chrome45_offer.sdp")));
+
+    SdpMediaSection &video = session.Media(1);
+    size_t lines = video.Lines().size();
+
+    video.RemoveFormat(100);
+
+    EXPECT_EQ("m=video 9 UDP/TLS/RTP/SAVPF 116 117 96", MediaLine(video));
+    EXPECT_EQ(lines - 5, video.Lines().size());
+    EXPECT_TRUE(Attributes(video, "rtcp-fb").empty());
+
+    // A format which isn't there changes nothing.
+
+    video.RemoveFormat(42);
+    EXPECT_EQ(lines - 5, video.Lines().size());
+}
+
+// Edited lines are stored in a deque, so views taken before an edit stay valid however many edits follow.
+TEST(PHSdpTest, EditsKeepEarlierTokensValid)
+{
+    SdpSession session;
+    ASSERT_TRUE(session.Parse(ReadSdp("chrome45_offer.sdp")));
+
+    SdpMediaSection &video = session.Media(1);
+    video.SetFormatParameter(100, "max-fs", "0");
+
+    SdpToken first = video.Lines()[video.FindAttribute("fmtp")].value;
+    std::string expected = first.ToString();
+
+    for (uint32_t i = 1; i <= 2000; i++) {
+        video.SetBandwidth("AS", i);
+        video.SetFormatParameter(100, "max-fr", std::to_string(i));
+    }
+
+    EXPECT_EQ(expected, first.ToString());
+    EXPECT_EQ("AS:2000", video.Lines()[IndexOfType(video, 'b')].value.ToString());
+}
+
+// An edited description parses back to the same thing, and serializes the same way.
+TEST(PHSdpTest, EditedDescriptionRoundTrips)
+{
+    for (const std::string &name : Corpus()) {
+        SdpSession session;
+        ASSERT_TRUE(session.Parse(ReadSdp(name))) << name;
+
+        for (size_t i = 0; i < session.MediaCount(); i++) {
+            SdpMediaSection &section = session.Media(i);
+
+            section.PreferCodec("VP8");
+            section.SetBandwidth("AS", 300);
+            section.AddAttribute("x-perch", "");
+
+            std::vector<SdpRtpMap> maps = section.RtpMaps();
+            if (!maps.empty()) {
+                section.SetFormatParameter(maps.back().payloadType, "x-google-max-bitrate", "300");
+            }
+        }
+
+        std::string edited = session.Serialize();
+        SdpSession reparsed;
+
+        ASSERT_TRUE(reparsed.Parse(edited)) << name;
+        EXPECT_EQ(edited, reparsed.Serialize()) << name;
+        EXPECT_EQ(session.MediaCount(), reparsed.MediaCount()) << name;
+    }
+}
+
+TEST(PHSdpTest, Tokens)
+{
+    uint32_t value = 0;
+
+    EXPECT_TRUE(SdpToken("4294967295", 10).ToUInt(&value));
+    EXPECT_EQ(4294967295u, value);
+    EXPECT_FALSE(SdpToken("4294967296", 10).ToUInt(&value));
+    EXPECT_FALSE(SdpToken("12345678901", 11).ToUInt(&value));
+    EXPECT_FALSE(SdpToken("-1", 2).ToUInt(&value));
+    EXPECT_FALSE(SdpToken("", 0).ToUInt(&value));
+
+    SdpToken head, tail;
+    SdpToken token("a:b:c", 5);
+
+    ASSERT_TRUE(token.Split(':', &head, &tail));
+    EXPECT_TRUE(head.Equals("a"));
+    EXPECT_TRUE(tail.Equals("b:c"));
+
+    // The token may be split into itself.
+
+    ASSERT_TRUE(token.Split(':', &head, &token));
+    EXPECT_TRUE(token.Equals("b:c"));
+    EXPECT_FALSE(SdpToken().Split(':', &head, &tail));
+
+    EXPECT_TRUE(SdpToken(" \tx y\t ", 7).Trimmed().Equals("x y"));
+    EXPECT_TRUE(SdpToken("  ", 2).Trimmed().Empty());
+}
+
+TEST(PHSdpTest, FrameSizeInMacroblocks)
+{
+    EXPECT_EQ(3600u, SdpFrameSizeInMacroblocks(1280, 720));
+    EXPECT_EQ(396u, SdpFrameSizeInMacroblocks(352, 288));
+    EXPECT_EQ(1u, SdpFrameSizeInMacroblocks(1, 1));
+    EXPECT_EQ(0u, SdpFrameSizeInMacroblocks(0, 720));
+}
+
+TEST(PHSdpTest, UInt)
+{
+    EXPECT_EQ("0", SdpUInt(0));
+    EXPECT_EQ("96", SdpUInt(96));
+    EXPECT_EQ("4294967295", SdpUInt(4294967295u));
+}
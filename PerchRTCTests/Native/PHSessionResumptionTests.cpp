@@ -0,0 +1,245 @@
+//
+//  PHSessionResumptionTests.cpp
+//  PerchRTCTests
+//
+//  Created by Christopher Eagleston on 2015-08-11.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#include "PHSessionResumption.h"
+
+#include <gtest/gtest.h>
+
+#include <map>
+
+using namespace perch;
+
+namespace {
+
+    // Stands in for the XirSys token API and signaling socket, with the latencies we measure from a phone on LTE.
+    // Tokens are only good for a while after they're issued.
+    class SignalingStandIn
+    {
+    public:
+        SignalingStandIn() : tokenFetchMs(450), joinMs(250), tokenLifetimeMs(60000), _issued(0) {}
+
+        std::string IssueToken(int64_t nowMs)
+        {
+            std::string token = "token" + std::to_string(++_issued);
+            _issuedMs[token] = nowMs;
+
+            return token;
+        }
+
+        bool Accepts(const std::string &token, int64_t nowMs) const
+        {
+            std::map<std::string, int64_t>::const_iterator issued = _issuedMs.find(token);
+
+            return issued != _issuedMs.end() && nowMs - issued->second < tokenLifetimeMs;
+        }
+
+        int Issued() const { return _issued; }
+
+        int64_t tokenFetchMs;
+        int64_t joinMs;
+        int64_t tokenLifetimeMs;
+
+    private:
+        int _issued;
+        std::map<std::string, int64_t> _issuedMs;
+    };
+
+    // Does what PHConnectionBroker does while resuming, from the moment the network is back. Tries the cached token
+    // first, fetches a new one when it's refused, and polls for anything due along the way. Returns the time the room
+    // was rejoined, or kNoTime if resuming was abandoned first.
+    class Client
+    {
+    public:
+        Client(SessionResumption &resumption, SignalingStandIn &server) : _resumption(resumption), _server(server) {}
+
+        int64_t Join(int64_t nowMs, const std::vector<std::string> &missingPeers = std::vector<std::string>())
+        {
+            for (int attempt = 0; attempt < 3; attempt++) {
+                std::string token = _resumption.TakeCachedToken();
+
+                if (token.empty()) {
+                    nowMs += _server.tokenFetchMs;
+                    token = _server.IssueToken(nowMs);
+                    _resumption.OnTokenFetched();
+                }
+
+                nowMs += _server.joinMs;
+
+                if (!PollUntil(nowMs)) {
+                    return SessionResumption::kNoTime;
+                }
+
+                if (_server.Accepts(token, nowMs)) {
+                    _resumption.OnJoined(token, missingPeers, nowMs);
+                    return nowMs;
+                }
+            }
+
+            return SessionResumption::kNoTime;
+        }
+
+        // Returns false if resuming was abandoned.
+        bool PollUntil(int64_t endMs)
+        {
+            for (int64_t dueMs = _resumption.NextDueMs(); dueMs != SessionResumption::kNoTime && dueMs <= endMs; dueMs = _resumption.NextDueMs()) {
+                std::vector<SessionResumptionAction> due;
+                _resumption.Poll(dueMs, &due);
+
+                for (const SessionResumptionAction &action : due) {
+                    if (action.type == SessionResumptionActionAbandon) {
+                        abandonedMs.push_back(dueMs);
+                    }
+                    else {
+                        closed[action.peerId] = dueMs;
+                    }
+                }
+            }
+
+            return abandonedMs.empty();
+        }
+
+        std::vector<int64_t> abandonedMs;
+        std::map<std::string, int64_t> closed;
+
+    private:
+        SessionResumption &_resumption;
+        SignalingStandIn &_server;
+    };
+
+} // namespace
+
+// A short handoff resumes in one socket round trip with the last token, which is what makes keeping it worthwhile.
+TEST(PHSessionResumptionTest, CachedTokenResumesFaster)
+{
+    SignalingStandIn server;
+    SessionResumption resumption;
+    Client client(resumption, server);
+
+    ASSERT_NE(SessionResumption::kNoTime, client.Join(0));
+    EXPECT_EQ(1, server.Issued());
+    EXPECT_FALSE(resumption.IsResuming());
+
+    // A WiFi to LTE handoff at 10 s. The new interface is up 1.2 s later.
+
+    ASSERT_TRUE(resumption.OnSignalingLost(2, 10000));
+    EXPECT_TRUE(resumption.CanReuseToken());
+
+    int64_t joinedMs = client.Join(11200);
+    EXPECT_EQ(11200 + server.joinMs, joinedMs);
+    EXPECT_EQ(1, server.Issued());
+
+    const SessionResumptionMetrics &metrics = resumption.Metrics();
+    EXPECT_EQ(1u, metrics.attempts);
+    EXPECT_EQ(1u, metrics.resumptions);
+    EXPECT_EQ(1u, metrics.cachedTokenResumptions);
+    EXPECT_EQ(1450, metrics.lastResumeMs);
+
+    // Without the cached token, the same handoff waits for a fetch as well.
+
+    SessionResumption fetching;
+    Client fetchingClient(fetching, server);
+
+    ASSERT_TRUE(fetching.OnSignalingLost(2, 10000));
+    EXPECT_EQ(11200 + server.tokenFetchMs + server.joinMs, fetchingClient.Join(11200));
+    EXPECT_EQ(0u, fetching.Metrics().cachedTokenResumptions);
+    EXPECT_GT(fetching.Metrics().lastResumeMs, metrics.lastResumeMs);
+}
+
+// An expired token costs one refused socket, then a fetch. It's only tried once.
+TEST(PHSessionResumptionTest, ExpiredTokenIsFetchedAgain)
+{
+    SignalingStandIn server;
+    SessionResumption resumption;
+    Client client(resumption, server);
+
+    client.Join(0);
+
+    ASSERT_TRUE(resumption.OnSignalingLost(1, 61000));
+
+    int64_t joinedMs = client.Join(62000);
+    EXPECT_EQ(62000 + server.joinMs + server.tokenFetchMs + server.joinMs, joinedMs);
+    EXPECT_EQ(2, server.Issued());
+
+    EXPECT_EQ(joinedMs - 61000, resumption.Metrics().lastResumeMs);
+    EXPECT_EQ(0u, resumption.Metrics().cachedTokenResumptions);
+    EXPECT_FALSE(resumption.IsUsingCachedToken());
+}
+
+TEST(PHSessionResumptionTest, LongOutageIsAbandoned)
+{
+    SignalingStandIn server;
+    SessionResumption resumption;
+    Client client(resumption, server);
+
+    client.Join(0);
+
+    ASSERT_TRUE(resumption.OnSignalingLost(2, 5000));
+    EXPECT_EQ(35000, resumption.NextDueMs());
+
+    EXPECT_EQ(SessionResumption::kNoTime, client.Join(34900));
+    ASSERT_EQ(1u, client.abandonedMs.size());
+    EXPECT_EQ(35000, client.abandonedMs[0]);
+
+    EXPECT_FALSE(resumption.IsResuming());
+    EXPECT_EQ(1u, resumption.Metrics().attempts);
+    EXPECT_EQ(0u, resumption.Metrics().resumptions);
+}
+
+// Losing signaling without connections, or again while resuming, isn't a new attempt.
+TEST(PHSessionResumptionTest, OnlyConnectionsAreResumed)
+{
+    SessionResumption resumption;
+
+    EXPECT_FALSE(resumption.OnSignalingLost(0, 0));
+    EXPECT_FALSE(resumption.IsResuming());
+    EXPECT_TRUE(resumption.TakeCachedToken().empty());
+
+    EXPECT_TRUE(resumption.OnSignalingLost(1, 1000));
+    EXPECT_FALSE(resumption.OnSignalingLost(1, 2000));
+    EXPECT_EQ(1u, resumption.Metrics().attempts);
+
+    // There's no token until we have joined.
+
+    EXPECT_FALSE(resumption.CanReuseToken());
+}
+
+// A peer that leaves has a while to come back before its connection is closed. Nothing is closed while we resume,
+// and whoever is missing when we rejoin gets the same while.
+TEST(PHSessionResumptionTest, PeersGetTimeToResume)
+{
+    SignalingStandIn server;
+    SessionResumption resumption;
+    Client client(resumption, server);
+
+    client.Join(0);
+
+    resumption.OnPeerLeft("alice", 1000);
+    resumption.OnPeerLeft("bob", 2000);
+    resumption.OnPeerLeft("alice", 5000);
+    resumption.OnPeerReturned("bob");
+
+    client.PollUntil(10999);
+    EXPECT_TRUE(client.closed.empty());
+
+    client.PollUntil(20000);
+    ASSERT_EQ(1u, client.closed.size());
+    EXPECT_EQ(11000, client.closed["alice"]);
+
+    resumption.OnPeerLeft("carol", 21000);
+    ASSERT_TRUE(resumption.OnSignalingLost(2, 22000));
+
+    // Carol's deadline passes while we're away.
+
+    int64_t joinedMs = client.Join(40000, std::vector<std::string>(1, "dave"));
+    ASSERT_NE(SessionResumption::kNoTime, joinedMs);
+    EXPECT_EQ(0u, client.closed.count("carol"));
+
+    client.PollUntil(joinedMs + 60000);
+    EXPECT_EQ(0u, client.closed.count("carol"));
+    EXPECT_EQ(joinedMs + 10000, client.closed["dave"]);
+}
@@ -0,0 +1,389 @@
+//
+//  PHSignalingCodecTests.cpp
+//  PerchRTCTests
+//
+//  Created by Christopher Eagleston on 2015-08-11.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#include "PHSignalingCodec.h"
+#include "PHTestData.h"
+
+#include <gtest/gtest.h>
+
+using namespace perch;
+
+namespace {
+
+    const char *const kConnectionId = "6F1C3A52-9B0E-4D8A-8C1E-2A7B5D3F9E41";
+
+    bool Decode(SignalingDecoder &decoder, const std::string &frame, SignalingMessage *message)
+    {
+        return decoder.Decode(frame.data(), frame.size(), message);
+    }
+
+    SignalingMessage DecodeFile(SignalingDecoder &decoder, const std::string &name)
+    {
+        SignalingMessage message;
+        EXPECT_TRUE(Decode(decoder, test::ReadDataFile("Signaling/" + name), &message)) << name;
+
+        return message;
+    }
+
+    std::vector<std::string> Strings(const std::vector<SignalingText> &texts)
+    {
+        std::vector<std::string> strings;
+
+        for (const SignalingText &text : texts) {
+            strings.push_back(text.ToString());
+        }
+
+        return strings;
+    }
+
+} // namespace
+
+TEST(PHSignalingCodecTest, EventNames)
+{
+    const SignalingEvent events[] = {
+        SignalingEventOffer, SignalingEventAnswer, SignalingEventICE, SignalingEventBye,
+        SignalingEventRoomJoin, SignalingEventRoomLeave, SignalingEventRoomUsersUpdate
+    };
+
+    for (SignalingEvent event : events) {
+        EXPECT_EQ(event, SignalingEventForName(SignalingText(SignalingEventName(event)))) << SignalingEventName(event);
+    }
+
+    const char *unknown[] = { "", "Offer", "offers", "peer", "peer_connecte", "iceCandidate", "room_locked" };
+
+    for (const char *name : unknown) {
+        EXPECT_EQ(SignalingEventUnknown, SignalingEventForName(SignalingText(name))) << name;
+    }
+}
+
+TEST(PHSignalingCodecTest, DecodeOffer)
+{
+    SignalingDecoder decoder;
+    SignalingMessage message = DecodeFile(decoder, "offer.json");
+
+    EXPECT_EQ(SignalingEventOffer, message.event);
+    EXPECT_EQ("alice", message.senderId.ToString());
+    EXPECT_EQ("perch-demo", message.room.ToString());
+    EXPECT_EQ(kConnectionId, message.connectionId.ToString());
+    EXPECT_EQ("offer", message.sdpType.ToString());
+
+    // Escaped CRLFs come back as they were sent.
+
+    EXPECT_EQ(test::ReadDataFile("Sdp/chrome45_offer.sdp"), message.sdp.ToString());
+}
+
+TEST(PHSignalingCodecTest, DecodeAnswer)
+{
+    SignalingDecoder decoder;
+    SignalingMessage message = DecodeFile(decoder, "answer.json");
+
+    EXPECT_EQ(SignalingEventAnswer, message.event);
+    EXPECT_EQ("answer", message.sdpType.ToString());
+    EXPECT_EQ(test::ReadDataFile("Sdp/perch_ios_conditioned_answer.sdp"), message.sdp.ToString());
+}
+
+TEST(PHSignalingCodecTest, DecodeCandidates)
+{
+    SignalingDecoder decoder;
+    SignalingMessage message = DecodeFile(decoder, "ice_candidate.json");
+
+    ASSERT_EQ(SignalingEventICE, message.event);
+    ASSERT_EQ(1u, message.candidates.size());
+    EXPECT_EQ("audio", message.candidates[0].mid.ToString());
+    EXPECT_EQ(0, message.candidates[0].index);
+    EXPECT_EQ(0u, message.candidates[0].candidate.ToString().find("candidate:1467250027 1 udp"));
+
+    // A batch, with one label sent as a string.
+
+    message = DecodeFile(decoder, "ice_candidates.json");
+
+    ASSERT_EQ(3u, message.candidates.size());
+    EXPECT_EQ(1, message.candidates[1].index);
+    EXPECT_EQ("video", message.candidates[2].mid.ToString());
+    EXPECT_NE(std::string::npos, message.candidates[2].candidate.ToString().find("typ srflx"));
+}
+
+TEST(PHSignalingCodecTest, DecodeRoomEvents)
+{
+    SignalingDecoder decoder;
+
+    EXPECT_EQ(SignalingEventBye, DecodeFile(decoder, "bye.json").event);
+
+    SignalingMessage message = DecodeFile(decoder, "peer_connected.json");
+    EXPECT_EQ(SignalingEventRoomJoin, message.event);
+    EXPECT_EQ("carol", message.senderId.ToString());
+
+    // "eventName" stands in for "type".
+
+    message = DecodeFile(decoder, "peer_removed.json");
+    EXPECT_EQ(SignalingEventRoomLeave, message.event);
+    EXPECT_EQ("peer_removed", message.eventName.ToString());
+
+    // Users are ids or objects with one. Nulls and empty ids are left out.
+
+    message = DecodeFile(decoder, "peers.json");
+    EXPECT_EQ(SignalingEventRoomUsersUpdate, message.event);
+    EXPECT_EQ(std::vector<std::string>({ "alice", "bob", "carol" }), Strings(message.users));
+}
+
+// Events we don't know still decode, so that XSPeerClient can hand them to NSJSONSerialization by name.
+TEST(PHSignalingCodecTest, DecodeUnknownEvent)
+{
+    SignalingDecoder decoder;
+    SignalingMessage message = DecodeFile(decoder, "unknown_event.json");
+
+    EXPECT_EQ(SignalingEventUnknown, message.event);
+    EXPECT_EQ("room_locked", message.eventName.ToString());
+    EXPECT_EQ("server", message.senderId.ToString());
+    EXPECT_TRUE(message.sdp.Empty());
+    EXPECT_TRUE(message.candidates.empty());
+}
+
+TEST(PHSignalingCodecTest, DecodeEscapesAndUTF8)
+{
+    SignalingDecoder decoder;
+    SignalingMessage message = DecodeFile(decoder, "unicode.json");
+
+    EXPECT_EQ("caf\xC3\xA9", message.room.ToString());
+    EXPECT_EQ(std::vector<std::string>({ "Zo\xC3\xAB", "\xF0\x9F\x98\x80 smile", "tab\tnew\nline \"quoted\" \\ /" }),
+              Strings(message.users));
+}
+
+TEST(PHSignalingCodecTest, RejectsMalformedFrames)
+{
+    const char *frames[] = {
+        "",
+        "   ",
+        "[]",
+        "\"offer\"",
+        "{",
+        "{\"type\":\"offer\"",
+        "{\"type\":\"offer\"}}",
+        "{\"type\":\"offer\",}",
+        "{\"type\" \"offer\"}",
+        "{\"type\":offer}",
+        "{\"type\":\"off\ner\"}",
+        "{\"type\":\"\\x\"}",
+        "{\"type\":\"\\u12\"}",
+        "{\"type\":\"\\ud83d\"}",
+        "{\"type\":\"\\ude00\\ud83d\"}",
+        "{\"label\":01x}",
+        "{\"a\":tru}",
+        "{\"a\":1.}",
+        "{\"a\":-}",
+        "{\"type\":\"offer\"} {}",
+    };
+
+    SignalingDecoder decoder;
+
+    for (const char *frame : frames) {
+        SignalingMessage message;
+        EXPECT_FALSE(Decode(decoder, frame, &message)) << frame;
+        EXPECT_EQ(SignalingEventUnknown, message.event) << frame;
+    }
+
+    // Sixteen levels deep is the most we read.
+
+    std::string deep = "{\"a\":";
+    for (int i = 0; i < 15; i++) {
+        deep += "[";
+    }
+    deep += "1";
+    for (int i = 0; i < 15; i++) {
+        deep += "]";
+    }
+    deep += "}";
+
+    SignalingMessage message;
+    EXPECT_TRUE(Decode(decoder, deep, &message));
+    EXPECT_FALSE(Decode(decoder, "{\"b\":" + deep + "}", &message));
+}
+
+// Raw bytes have to be UTF-8 too. NSString returns nil for anything else, which would leave fields silently empty.
+TEST(PHSignalingCodecTest, RejectsInvalidUTF8)
+{
+    struct Case
+    {
+        const char *name;
+        std::string bytes;
+        bool valid;
+    };
+
+    const Case cases[] = {
+        { "two bytes", "\xC3\xA9", true },
+        { "three bytes", "\xE2\x82\xAC", true },
+        { "four bytes", "\xF0\x9F\x98\x80", true },
+        { "last code point", "\xF4\x8F\xBF\xBF", true },
+        { "lone continuation", "\x80", false },
+        { "truncated", "\xE2\x82", false },
+        { "truncated at the end", "\xC3", false },
+        { "overlong slash", "\xC0\xAF", false },
+        { "overlong three bytes", "\xE0\x80\xAF", false },
+        { "overlong four bytes", "\xF0\x80\x80\xAF", false },
+        { "surrogate", "\xED\xA0\x80", false },
+        { "past U+10FFFF", "\xF4\x90\x80\x80", false },
+        { "invalid lead", "\xFF", false },
+        { "bad continuation", "\xE2\x28\xA1", false },
+    };
+
+    SignalingDecoder decoder;
+
+    for (const Case &test : cases) {
+        SignalingMessage message;
+        std::string frame = "{\"type\":\"peers\",\"room\":\"" + test.bytes + "\"}";
+
+        EXPECT_EQ(test.valid, Decode(decoder, frame, &message)) << test.name;
+
+        if (test.valid) {
+            EXPECT_EQ(test.bytes, message.room.ToString()) << test.name;
+        }
+    }
+}
+
+// Text stays valid until the next decode, even once the frame it came from is gone.
+TEST(PHSignalingCodecTest, DecodedTextOutlivesTheFrame)
+{
+    SignalingDecoder decoder;
+    SignalingMessage message;
+
+    {
+        std::string frame = test::ReadDataFile("Signaling/offer.json");
+        ASSERT_TRUE(Decode(decoder, frame, &message));
+        frame.assign(frame.size(), 'x');
+    }
+
+    EXPECT_EQ(kConnectionId, message.connectionId.ToString());
+}
+
+TEST(PHSignalingCodecTest, EncodePeerMessages)
+{
+    SignalingEncoder encoder;
+    SignalingMessage message;
+
+    message.event = SignalingEventBye;
+    message.targetId = SignalingText("bob");
+    message.connectionId = SignalingText("c1");
+
+    EXPECT_EQ("{\"eventName\":\"bye\",\"targetUserId\":\"bob\",\"data\":{\"connectionId\":\"c1\",\"bye\":{}}}", encoder.Encode(message));
+
+    message.event = SignalingEventICE;
+
+    SignalingCandidate candidate;
+    candidate.candidate = SignalingText("candidate:1 1 udp 1 10.0.0.1 9 typ host");
+    candidate.mid = SignalingText("audio");
+    candidate.index = -1;
+    message.candidates.push_back(candidate);
+
+    EXPECT_EQ("{\"eventName\":\"ice\",\"targetUserId\":\"bob\",\"data\":{\"connectionId\":\"c1\",\"iceCandidate\":"
+              "{\"label\":-1,\"id\":\"audio\",\"candidate\":\"candidate:1 1 udp 1 10.0.0.1 9 typ host\"}}}",
+              encoder.Encode(message));
+
+    message.candidates.push_back(candidate);
+    EXPECT_NE(std::string::npos, encoder.Encode(message).find("\"iceCandidates\":[{"));
+}
+
+// Only a peer which lists "iceCandidates" in its offer or answer can read a batch. Names we don't know are ignored.
+TEST(PHSignalingCodecTest, Features)
+{
+    SignalingDecoder decoder;
+    SignalingEncoder encoder;
+    SignalingMessage message;
+
+    struct Case
+    {
+        const char *features;
+        uint32_t expected;
+    };
+
+    const Case cases[] = {
+        { "", 0 },
+        { ",\"features\":[]", 0 },
+        { ",\"features\":[\"iceCandidates\"]", SignalingFeatureCandidateBatches },
+        { ",\"features\":[\"trickle\",\"iceCandidates\",\"rtx\"]", SignalingFeatureCandidateBatches },
+        { ",\"features\":[\"icecandidates\"]", 0 },
+        { ",\"features\":\"iceCandidates\"", 0 },
+        { ",\"features\":{\"iceCandidates\":true}", 0 },
+        { ",\"features\":[1,\"iceCandidates\"]", SignalingFeatureCandidateBatches },
+    };
+
+    for (const Case &test : cases) {
+        std::string frame = std::string("{\"type\":\"offer\",\"userid\":\"alice\",\"message\":{\"data\":{\"connectionId\":\"c1\","
+                                        "\"offer\":{\"sdp\":\"v=0\",\"type\":\"offer\"}") + test.features + "}}}";
+
+        ASSERT_TRUE(Decode(decoder, frame, &message)) << frame;
+        EXPECT_EQ(test.expected, message.features) << frame;
+    }
+
+    EXPECT_TRUE(Decode(decoder, "{\"type\":\"offer\",\"message\":{\"data\":{\"features\":[1,null]}}}", &message));
+    EXPECT_EQ(0u, message.features);
+    EXPECT_FALSE(Decode(decoder, "{\"type\":\"offer\",\"message\":{\"data\":{\"features\":[\"iceCandidates\",]}}}", &message));
+    EXPECT_EQ(0u, message.features);
+
+    // We advertise with our descriptions, and nothing else.
+
+    message = SignalingMessage();
+    message.event = SignalingEventAnswer;
+    message.connectionId = SignalingText("c1");
+    message.sdp = SignalingText("v=0");
+    message.sdpType = SignalingText("answer");
+    message.features = SignalingFeatureCandidateBatches;
+
+    std::string encoded = encoder.Encode(message);
+    EXPECT_NE(std::string::npos, encoded.find("},\"features\":[\"iceCandidates\"]}"));
+
+    SignalingMessage again;
+    ASSERT_TRUE(Decode(decoder, encoded, &again));
+    EXPECT_EQ(SignalingFeatureCandidateBatches, again.features);
+
+    message.event = SignalingEventBye;
+    EXPECT_EQ(std::string::npos, encoder.Encode(message).find("features"));
+
+    message.features = 0;
+    message.event = SignalingEventOffer;
+    EXPECT_EQ(std::string::npos, encoder.Encode(message).find("features"));
+}
+
+// Whatever we encode, we decode back the same, including control characters and quotes in the SDP.
+TEST(PHSignalingCodecTest, RoundTrip)
+{
+    SignalingDecoder decoder;
+    SignalingEncoder encoder;
+
+    for (const std::string &name : test::ListDataFiles("Signaling", ".json")) {
+        SignalingMessage decoded = DecodeFile(decoder, name);
+
+        if (decoded.event == SignalingEventUnknown || decoded.event >= SignalingEventRoomJoin) {
+            continue;
+        }
+
+        // Encoding reads the decoder's buffer, so take a copy before decoding again.
+
+        std::string encoded = encoder.Encode(decoded);
+        std::string sdp = decoded.sdp.ToString();
+        size_t candidates = decoded.candidates.size();
+        SignalingMessage again;
+
+        ASSERT_TRUE(Decode(decoder, encoded, &again)) << name;
+        EXPECT_EQ(decoded.event, again.event) << name;
+        EXPECT_EQ(kConnectionId, again.connectionId.ToString()) << name;
+        EXPECT_EQ(sdp, again.sdp.ToString()) << name;
+        EXPECT_EQ(candidates, again.candidates.size()) << name;
+    }
+
+    SignalingMessage message;
+    std::string awkward("v=0\r\n\"quoted\" back\\slash \x01\x1f tab\t");
+
+    message.event = SignalingEventOffer;
+    message.connectionId = SignalingText("c1");
+    message.sdp = SignalingText(awkward.data(), awkward.size());
+    message.sdpType = SignalingText("offer");
+
+    SignalingMessage again;
+    ASSERT_TRUE(Decode(decoder, encoder.Encode(message), &again));
+    EXPECT_EQ(awkward, again.sdp.ToString());
+}
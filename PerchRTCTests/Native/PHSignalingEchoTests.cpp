@@ -0,0 +1,340 @@
+//
+//  PHSignalingEchoTests.cpp
+//  PerchRTCTests
+//
+//  Created by Christopher Eagleston on 2015-08-11.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#include "PHSignalingCodec.h"
+#include "PHSignalingScheduler.h"
+#include "PHWebSocketEcho.h"
+
+#include <gtest/gtest.h>
+
+#include <map>
+
+using namespace perch;
+
+namespace {
+
+    // A peer message waiting to be written, owning its text.
+    struct OutboundMessage
+    {
+        SignalingEvent event;
+        std::string targetId;
+        std::string connectionId;
+        std::string sdp;
+        std::vector<std::string> candidates;
+    };
+
+    OutboundMessage Candidate(const std::string &targetId, int index)
+    {
+        OutboundMessage message;
+        message.event = SignalingEventICE;
+        message.targetId = targetId;
+        message.connectionId = "c-" + targetId;
+        message.candidates.push_back("candidate:" + std::to_string(index) + " 1 udp 2122260223 192.168.1." +
+                                     std::to_string(index % 250) + " 5" + std::to_string(1000 + index) + " typ host generation 0");
+        return message;
+    }
+
+    OutboundMessage Control(SignalingEvent event, const std::string &targetId, size_t sdpSize = 0)
+    {
+        OutboundMessage message;
+        message.event = event;
+        message.targetId = targetId;
+        message.connectionId = "c-" + targetId;
+        message.sdp = std::string(sdpSize, 'a');
+        return message;
+    }
+
+    // Does what XSPeerClient does between sendMessage: and the socket: sorts each message into its lane, keeps it by
+    // id while the scheduler orders it, and merges candidates for peers which read batches into the first of them.
+    class Outbox
+    {
+    public:
+        explicit Outbox(SignalingScheduler &scheduler) : _scheduler(scheduler), _nextId(1) {}
+
+        // Peers which advertised candidate batches.
+        void SetBatching(const std::string &peerId) { _batchingPeers[peerId] = true; }
+
+        bool Send(const OutboundMessage &message, int64_t nowMs)
+        {
+            SignalingLane lane = SignalingLaneTelemetry;
+            std::string coalescingKey;
+            size_t bytes = 160 + message.sdp.size();
+
+            switch (message.event) {
+                case SignalingEventBye:
+                    lane = SignalingLaneControl;
+                    break;
+                case SignalingEventOffer:
+                case SignalingEventAnswer:
+                    lane = SignalingLaneSessionDescription;
+                    break;
+                case SignalingEventICE:
+                    lane = SignalingLaneICE;
+                    break;
+                default:
+                    break;
+            }
+
+            if (lane == SignalingLaneICE && _batchingPeers.count(message.targetId)) {
+                coalescingKey = message.targetId + "/" + message.connectionId;
+            }
+
+            for (const std::string &candidate : message.candidates) {
+                bytes += candidate.size() + 40;
+            }
+
+            std::vector<uint64_t> evicted;
+            uint64_t id = _nextId++;
+
+            if (!_scheduler.Enqueue(id, lane, coalescingKey, bytes, nowMs, &evicted)) {
+                return false;
+            }
+
+            for (uint64_t evictedId : evicted) {
+                _queued.erase(evictedId);
+            }
+
+            _queued[id] = message;
+
+            return true;
+        }
+
+        // Writes one budget's worth of frames. Returns how many frames were written.
+        size_t Write(int64_t nowMs, test::WebSocketClient &socket)
+        {
+            std::vector<SignalingBatch> batches;
+            _scheduler.Take(nowMs, 16 * 1024, &batches);
+
+            for (const SignalingBatch &batch : batches) {
+                OutboundMessage message = _queued[batch.ids[0]];
+
+                for (size_t i = 1; i < batch.ids.size(); i++) {
+                    const std::vector<std::string> &more = _queued[batch.ids[i]].candidates;
+                    message.candidates.insert(message.candidates.end(), more.begin(), more.end());
+                }
+
+                for (uint64_t id : batch.ids) {
+                    _queued.erase(id);
+                }
+
+                EXPECT_TRUE(socket.Send(Encode(message)));
+            }
+
+            return batches.size();
+        }
+
+    private:
+        const std::string &Encode(const OutboundMessage &outbound)
+        {
+            SignalingMessage message;
+            message.event = outbound.event;
+            message.senderId = SignalingText("me");
+            message.room = SignalingText("room");
+            message.targetId = SignalingText(outbound.targetId.data(), outbound.targetId.size());
+            message.connectionId = SignalingText(outbound.connectionId.data(), outbound.connectionId.size());
+            message.sdp = SignalingText(outbound.sdp.data(), outbound.sdp.size());
+            message.sdpType = SignalingText(outbound.event == SignalingEventAnswer ? "answer" : "offer");
+
+            for (const std::string &text : outbound.candidates) {
+                SignalingCandidate candidate;
+                candidate.candidate = SignalingText(text.data(), text.size());
+                candidate.mid = SignalingText("video");
+                candidate.index = 1;
+                message.candidates.push_back(candidate);
+            }
+
+            return _encoder.Encode(message);
+        }
+
+        SignalingScheduler &_scheduler;
+        SignalingEncoder _encoder;
+        uint64_t _nextId;
+        std::map<uint64_t, OutboundMessage> _queued;
+        std::map<std::string, bool> _batchingPeers;
+    };
+
+    // What came back from the echo server, in order.
+    struct Echo
+    {
+        SignalingEvent event;
+        std::string targetId;
+        std::vector<std::string> candidates;
+    };
+
+    std::vector<Echo> ReceiveEchoes(test::WebSocketClient &socket, size_t count)
+    {
+        SignalingDecoder decoder;
+        std::vector<Echo> echoes;
+        std::string frame;
+
+        while (echoes.size() < count && socket.Receive(&frame)) {
+            SignalingMessage message;
+
+            if (!decoder.Decode(frame.data(), frame.size(), &message)) {
+                ADD_FAILURE() << "Echo didn't decode: " << frame;
+                break;
+            }
+
+            Echo echo;
+            echo.event = message.event;
+            echo.targetId = message.targetId.ToString();
+
+            for (const SignalingCandidate &candidate : message.candidates) {
+                echo.candidates.push_back(candidate.candidate.ToString());
+            }
+
+            echoes.push_back(echo);
+        }
+
+        return echoes;
+    }
+
+} // namespace
+
+// A call starting up in a room: candidates for two peers, a large offer, then a bye. Over a real socket the bye and the
+// offer go first, Alice's candidates arrive as one batch she can read, and Bob's arrive one frame each.
+TEST(PHSignalingEchoTest, FramesReachTheSocketMostUrgentFirst)
+{
+    test::WebSocketEchoServer server;
+    ASSERT_NE(0, server.Port());
+
+    test::WebSocketClient socket;
+    ASSERT_TRUE(socket.Connect(server.Port()));
+
+    SignalingScheduler scheduler;
+    Outbox outbox(scheduler);
+    outbox.SetBatching("alice");
+
+    std::vector<std::string> sent;
+
+    for (int i = 0; i < 12; i++) {
+        OutboundMessage message = Candidate(i < 9 ? "alice" : "bob", i);
+        sent.push_back(message.candidates[0]);
+        ASSERT_TRUE(outbox.Send(message, i));
+    }
+
+    ASSERT_TRUE(outbox.Send(Control(SignalingEventOffer, "carol", 6000), 12));
+    ASSERT_TRUE(outbox.Send(Control(SignalingEventBye, "dave"), 15));
+
+    EXPECT_EQ(6u, outbox.Write(20, socket));
+    EXPECT_TRUE(scheduler.Empty());
+
+    std::vector<Echo> echoes = ReceiveEchoes(socket, 6);
+    ASSERT_EQ(6u, echoes.size());
+
+    EXPECT_EQ(SignalingEventBye, echoes[0].event);
+    EXPECT_EQ(SignalingEventOffer, echoes[1].event);
+    EXPECT_EQ("alice", echoes[2].targetId);
+    EXPECT_EQ(9u, echoes[2].candidates.size());
+
+    std::vector<std::string> received;
+
+    for (size_t i = 2; i < echoes.size(); i++) {
+        EXPECT_EQ(SignalingEventICE, echoes[i].event);
+        received.insert(received.end(), echoes[i].candidates.begin(), echoes[i].candidates.end());
+
+        if (i > 2) {
+            EXPECT_EQ("bob", echoes[i].targetId);
+            EXPECT_EQ(1u, echoes[i].candidates.size());
+        }
+    }
+
+    EXPECT_EQ(sent, received);
+
+    const SignalingLaneMetrics &ice = scheduler.Metrics(SignalingLaneICE);
+    EXPECT_EQ(12u, ice.written);
+    EXPECT_EQ(8u, ice.coalesced);
+    EXPECT_EQ(20, ice.maxLatencyMs);
+    EXPECT_EQ(5, scheduler.Metrics(SignalingLaneControl).maxLatencyMs);
+
+    socket.Close();
+}
+
+// Frames queue while the socket opens. When the queue fills, the oldest candidates make way for a bye, and candidates
+// are refused once only urgent frames are left. What was kept arrives once the socket is up.
+TEST(PHSignalingEchoTest, BackpressureKeepsControlFlowing)
+{
+    test::WebSocketEchoServer server;
+    ASSERT_NE(0, server.Port());
+
+    SignalingScheduler scheduler(8);
+    Outbox outbox(scheduler);
+
+    for (int i = 0; i < 8; i++) {
+        ASSERT_TRUE(outbox.Send(Candidate("bob", i), i));
+    }
+
+    ASSERT_TRUE(outbox.Send(Control(SignalingEventBye, "carol"), 8));
+    ASSERT_TRUE(outbox.Send(Control(SignalingEventBye, "dave"), 9));
+    EXPECT_EQ(8u, scheduler.FrameCount());
+    EXPECT_EQ(2u, scheduler.Metrics(SignalingLaneICE).dropped);
+
+    for (int i = 0; i < 6; i++) {
+        ASSERT_TRUE(outbox.Send(Control(SignalingEventBye, "erin"), 10 + i));
+    }
+
+    EXPECT_FALSE(outbox.Send(Candidate("bob", 99), 20));
+    EXPECT_EQ(9u, scheduler.Metrics(SignalingLaneICE).dropped);
+
+    test::WebSocketClient socket;
+    ASSERT_TRUE(socket.Connect(server.Port()));
+
+    EXPECT_EQ(8u, outbox.Write(100, socket));
+
+    std::vector<Echo> echoes = ReceiveEchoes(socket, 8);
+    ASSERT_EQ(8u, echoes.size());
+
+    for (const Echo &echo : echoes) {
+        EXPECT_EQ(SignalingEventBye, echo.event);
+    }
+
+    EXPECT_EQ("carol", echoes[0].targetId);
+    EXPECT_EQ(92, scheduler.Metrics(SignalingLaneControl).maxLatencyMs);
+
+    socket.Close();
+}
+
+// A backlog larger than one write's budget goes out over several writes, each taking the most urgent frames left.
+TEST(PHSignalingEchoTest, LargeBacklogIsWrittenInBudgets)
+{
+    test::WebSocketEchoServer server;
+    ASSERT_NE(0, server.Port());
+
+    test::WebSocketClient socket;
+    ASSERT_TRUE(socket.Connect(server.Port()));
+
+    SignalingScheduler scheduler;
+    Outbox outbox(scheduler);
+
+    for (int i = 0; i < 4; i++) {
+        ASSERT_TRUE(outbox.Send(Control(SignalingEventOffer, "peer" + std::to_string(i), 10000), i));
+    }
+
+    size_t writes = 0;
+    size_t frames = 0;
+
+    for (int64_t nowMs = 10; !scheduler.Empty(); nowMs += 10) {
+        if (writes == 1) {
+            ASSERT_TRUE(outbox.Send(Control(SignalingEventBye, "peer0"), nowMs));
+        }
+
+        frames += outbox.Write(nowMs, socket);
+        writes++;
+    }
+
+    EXPECT_EQ(5u, frames);
+    EXPECT_EQ(2u, writes);
+
+    std::vector<Echo> echoes = ReceiveEchoes(socket, 5);
+    ASSERT_EQ(5u, echoes.size());
+    EXPECT_EQ(SignalingEventOffer, echoes[1].event);
+    EXPECT_EQ(SignalingEventBye, echoes[2].event);
+    EXPECT_EQ("peer2", echoes[3].targetId);
+
+    socket.Close();
+}
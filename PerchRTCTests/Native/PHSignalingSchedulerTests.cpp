@@ -0,0 +1,164 @@
+//
+//  PHSignalingSchedulerTests.cpp
+//  PerchRTCTests
+//
+//  Created by Christopher Eagleston on 2015-08-11.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#include "PHSignalingScheduler.h"
+
+#include <gtest/gtest.h>
+
+using namespace perch;
+
+namespace {
+
+    // XSPeerClient's coalescing key for candidates, which it leaves empty for peers that can't read a batch.
+    const char *const kBatchingPeer = "alice/c1";
+    const char *const kSinglePeer = "";
+
+    std::vector<SignalingBatch> Take(SignalingScheduler &scheduler, int64_t nowMs, size_t byteBudget = 16 * 1024)
+    {
+        std::vector<SignalingBatch> batches;
+        scheduler.Take(nowMs, byteBudget, &batches);
+
+        return batches;
+    }
+
+    std::vector<uint64_t> Ids(const std::vector<SignalingBatch> &batches)
+    {
+        std::vector<uint64_t> ids;
+
+        for (const SignalingBatch &batch : batches) {
+            ids.push_back(batch.ids[0]);
+        }
+
+        return ids;
+    }
+
+} // namespace
+
+// A bye queued behind a backlog of candidates goes out first, then descriptions, candidates and telemetry.
+TEST(PHSignalingSchedulerTest, MostUrgentLaneFirst)
+{
+    SignalingScheduler scheduler;
+    std::vector<uint64_t> evicted;
+
+    ASSERT_TRUE(scheduler.Enqueue(1, SignalingLaneTelemetry, "", 100, 0, &evicted));
+    for (uint64_t id = 2; id < 6; id++) {
+        ASSERT_TRUE(scheduler.Enqueue(id, SignalingLaneICE, kSinglePeer, 200, 0, &evicted));
+    }
+    ASSERT_TRUE(scheduler.Enqueue(6, SignalingLaneSessionDescription, "", 3000, 0, &evicted));
+    ASSERT_TRUE(scheduler.Enqueue(7, SignalingLaneControl, "", 100, 5, &evicted));
+
+    EXPECT_EQ(7u, scheduler.FrameCount());
+    EXPECT_EQ(4000u, scheduler.ByteCount());
+
+    std::vector<SignalingBatch> batches = Take(scheduler, 10);
+
+    EXPECT_EQ(std::vector<uint64_t>({ 7, 6, 2, 3, 4, 5, 1 }), Ids(batches));
+    EXPECT_TRUE(scheduler.Empty());
+    EXPECT_EQ(0u, scheduler.ByteCount());
+    EXPECT_TRUE(evicted.empty());
+
+    EXPECT_EQ(1u, scheduler.Metrics(SignalingLaneControl).written);
+    EXPECT_EQ(5, scheduler.Metrics(SignalingLaneControl).maxLatencyMs);
+    EXPECT_EQ(4u, scheduler.Metrics(SignalingLaneICE).written);
+    EXPECT_EQ(4u, scheduler.Metrics(SignalingLaneICE).maxDepth);
+    EXPECT_DOUBLE_EQ(10, scheduler.Metrics(SignalingLaneICE).MeanLatencyMs());
+}
+
+// Candidates are only merged for a peer which can read a batch. The others go one frame per candidate.
+TEST(PHSignalingSchedulerTest, CoalescesOnlyKeyedFrames)
+{
+    SignalingScheduler scheduler(256, 256 * 1024, 1000);
+    std::vector<uint64_t> evicted;
+
+    struct Frame
+    {
+        uint64_t id;
+        const char *key;
+        size_t bytes;
+    };
+
+    const Frame frames[] = {
+        { 1, kBatchingPeer, 300 },
+        { 2, kSinglePeer, 300 },
+        { 3, kBatchingPeer, 300 },
+        { 4, "bob/c2", 300 },
+        { 5, kSinglePeer, 300 },
+        { 6, kBatchingPeer, 300 },
+        { 7, kBatchingPeer, 300 },
+    };
+
+    for (const Frame &frame : frames) {
+        ASSERT_TRUE(scheduler.Enqueue(frame.id, SignalingLaneICE, frame.key, frame.bytes, 0, &evicted));
+    }
+
+    std::vector<SignalingBatch> batches = Take(scheduler, 0);
+
+    // Merged up to 1000 bytes, and the rest in the next batch for the key.
+
+    ASSERT_EQ(5u, batches.size());
+    EXPECT_EQ(std::vector<uint64_t>({ 1, 3, 6 }), batches[0].ids);
+    EXPECT_EQ(std::vector<uint64_t>({ 2 }), batches[1].ids);
+    EXPECT_EQ(std::vector<uint64_t>({ 4 }), batches[2].ids);
+    EXPECT_EQ(std::vector<uint64_t>({ 5 }), batches[3].ids);
+    EXPECT_EQ(std::vector<uint64_t>({ 7 }), batches[4].ids);
+    EXPECT_EQ(2u, scheduler.Metrics(SignalingLaneICE).coalesced);
+    EXPECT_EQ(7u, scheduler.Metrics(SignalingLaneICE).written);
+}
+
+TEST(PHSignalingSchedulerTest, TakesUpToTheByteBudget)
+{
+    SignalingScheduler scheduler;
+    std::vector<uint64_t> evicted;
+
+    for (uint64_t id = 1; id <= 4; id++) {
+        ASSERT_TRUE(scheduler.Enqueue(id, SignalingLaneSessionDescription, "", 3000, 0, &evicted));
+    }
+
+    // At least one frame goes out, however large.
+
+    EXPECT_EQ(std::vector<uint64_t>({ 1 }), Ids(Take(scheduler, 0, 1)));
+    EXPECT_EQ(std::vector<uint64_t>({ 2, 3 }), Ids(Take(scheduler, 0, 5000)));
+    EXPECT_EQ(std::vector<uint64_t>({ 4 }), Ids(Take(scheduler, 0, 5000)));
+    EXPECT_TRUE(Take(scheduler, 0).empty());
+}
+
+// A full queue makes room by dropping the oldest frames of less urgent lanes, and refuses what it can't make room for.
+TEST(PHSignalingSchedulerTest, EvictsLessUrgentLanes)
+{
+    SignalingScheduler scheduler(4, 1000);
+    std::vector<uint64_t> evicted;
+
+    ASSERT_TRUE(scheduler.Enqueue(1, SignalingLaneTelemetry, "", 100, 0, &evicted));
+    ASSERT_TRUE(scheduler.Enqueue(2, SignalingLaneICE, kSinglePeer, 100, 0, &evicted));
+    ASSERT_TRUE(scheduler.Enqueue(3, SignalingLaneICE, kSinglePeer, 100, 0, &evicted));
+    ASSERT_TRUE(scheduler.Enqueue(4, SignalingLaneSessionDescription, "", 500, 0, &evicted));
+
+    EXPECT_TRUE(scheduler.Enqueue(5, SignalingLaneControl, "", 100, 0, &evicted));
+    EXPECT_EQ(std::vector<uint64_t>({ 1 }), evicted);
+
+    // A frame can't push out its own lane, or a more urgent one.
+
+    evicted.clear();
+    EXPECT_FALSE(scheduler.Enqueue(6, SignalingLaneICE, kSinglePeer, 100, 0, &evicted));
+    EXPECT_TRUE(evicted.empty());
+    EXPECT_EQ(1u, scheduler.Metrics(SignalingLaneICE).dropped);
+
+    // Bytes count as well as frames. A large description evicts both candidates.
+
+    EXPECT_TRUE(scheduler.Enqueue(7, SignalingLaneSessionDescription, "", 350, 0, &evicted));
+    EXPECT_EQ(std::vector<uint64_t>({ 2, 3 }), evicted);
+    EXPECT_EQ(3u, scheduler.FrameCount());
+    EXPECT_EQ(950u, scheduler.ByteCount());
+
+    // Clearing counts whatever was left as dropped.
+
+    scheduler.Clear();
+    EXPECT_TRUE(scheduler.Empty());
+    EXPECT_EQ(2u, scheduler.Metrics(SignalingLaneSessionDescription).dropped);
+    EXPECT_EQ(1u, scheduler.Metrics(SignalingLaneControl).dropped);
+}
@@ -0,0 +1,361 @@
+//
+//  PHSimulcastTests.cpp
+//  PerchRTCTests
+//
+//  Created by Christopher Eagleston on 2015-08-11.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#include "PHSdpPolicy.h"
+#include "PHSimulcast.h"
+#include "PHTestData.h"
+
+#include <gtest/gtest.h>
+
+using namespace perch;
+
+namespace {
+
+    // What PHSessionDescriptionFactory builds from the default 640x480 send format, with the peak rates
+    // PHVideoFormatComputePeakRate gives at PHMediaSessionTargetBpp.
+    std::vector<SimulcastLayer> DefaultLayers()
+    {
+        std::vector<SimulcastLayer> layers = ScaleSimulcastLayers(640, 480, 30, 3, 160);
+        const uint32_t peaks[] = { 48, 194, 774 };
+
+        for (size_t i = 0; i < layers.size(); i++) {
+            layers[i].maxBitrateKbps = peaks[i];
+        }
+
+        return layers;
+    }
+
+    SimulcastReceiveCapacity ReadCapacity(const std::string &sdp)
+    {
+        SdpSession session;
+        SimulcastReceiveCapacity capacity;
+
+        EXPECT_TRUE(session.Parse(sdp));
+        EXPECT_TRUE(ReadSimulcastReceiveCapacity(session, &capacity));
+
+        return capacity;
+    }
+
+} // namespace
+
+TEST(PHSimulcastTest, ScaleLayers)
+{
+    std::vector<SimulcastLayer> layers = ScaleSimulcastLayers(1280, 720, 30, 4, 160);
+
+    ASSERT_EQ(4u, layers.size());
+    EXPECT_EQ(160u, layers[0].width);
+    EXPECT_EQ(90u, layers[0].height);
+    EXPECT_EQ(1280u, layers[3].width);
+    EXPECT_EQ(30u, layers[3].frameRate);
+
+    // Stops before a layer would be too narrow, and keeps dimensions even.
+
+    layers = ScaleSimulcastLayers(480, 360, 15, 3, 160);
+    ASSERT_EQ(2u, layers.size());
+    EXPECT_EQ(240u, layers[0].width);
+    EXPECT_EQ(180u, layers[0].height);
+
+    layers = ScaleSimulcastLayers(352, 290, 15, 2, 0);
+    EXPECT_EQ(176u, layers[0].width);
+    EXPECT_EQ(144u, layers[0].height);
+
+    // The top layer is always there, however small.
+
+    EXPECT_EQ(1u, ScaleSimulcastLayers(100, 100, 30, 3, 160).size());
+    EXPECT_TRUE(ScaleSimulcastLayers(0, 480, 30, 3, 160).empty());
+}
+
+// Each peer gets the largest layer its share of the uplink carries at half the layer's peak or better.
+TEST(PHSimulcastTest, SelectLayerFromBudget)
+{
+    std::vector<SimulcastLayer> layers = DefaultLayers();
+    SimulcastReceiveCapacity any;
+
+    struct Case
+    {
+        uint32_t budgetKbps;
+        int current;
+        int expected;
+    };
+
+    const Case cases[] = {
+        { 2000, -1, 2 },
+        { 387, -1, 2 },
+        { 386, -1, 1 },
+        { 97, -1, 1 },
+        { 96, -1, 0 },
+        { 10, -1, 0 },
+        { 0, -1, 0 },
+
+        // Moving up needs a quarter more than staying. Moving down doesn't.
+
+        { 387, 1, 1 },
+        { 482, 1, 1 },
+        { 483, 1, 2 },
+        { 387, 2, 2 },
+        { 386, 2, 1 },
+        { 120, 0, 0 },
+        { 121, 0, 1 },
+    };
+
+    for (const Case &test : cases) {
+        EXPECT_EQ(test.expected, SelectSimulcastLayer(layers, any, test.budgetKbps, test.current))
+            << test.budgetKbps << " kbps from layer " << test.current;
+    }
+
+    EXPECT_EQ(-1, SelectSimulcastLayer(std::vector<SimulcastLayer>(), any, 1000, -1));
+}
+
+TEST(PHSimulcastTest, SelectLayerFromPeerCapacity)
+{
+    std::vector<SimulcastLayer> layers = DefaultLayers();
+    SimulcastReceiveCapacity capacity;
+
+    // The peer's bitrate limit applies on top of the budget.
+
+    capacity.maxBitrateKbps = 200;
+    EXPECT_EQ(1, SelectSimulcastLayer(layers, capacity, 2000, -1));
+
+    // So does its frame size limit, in macroblocks: 320x240 is 300.
+
+    capacity = SimulcastReceiveCapacity();
+    capacity.maxFrameSize = 299;
+    EXPECT_EQ(0, SelectSimulcastLayer(layers, capacity, 2000, -1));
+    capacity.maxFrameSize = 300;
+    EXPECT_EQ(1, SelectSimulcastLayer(layers, capacity, 2000, -1));
+}
+
+TEST(PHSimulcastTest, ReadCapacityFromSimulcastAnswer)
+{
+    SimulcastReceiveCapacity capacity = ReadCapacity(test::ReadDataFile("Sdp/firefox_simulcast_recv_answer.sdp"));
+
+    EXPECT_EQ(900u, capacity.maxBitrateKbps);
+    EXPECT_EQ(1200u, capacity.maxFrameSize);
+    EXPECT_EQ(30u, capacity.maxFrameRate);
+
+    // Its recv list pauses one of its own rids, which aren't ours, so only the limits choose our layer.
+
+    EXPECT_EQ(2, SelectSimulcastLayer(DefaultLayers(), capacity, 2000, -1));
+}
+
+// Browsers name the streams they receive as they like. Chrome's "h", "m" and "l" don't limit what we send.
+TEST(PHSimulcastTest, BrowserRecvListDoesNotLimitLayers)
+{
+    SimulcastReceiveCapacity capacity = ReadCapacity("v=0\r\n"
+                                                     "m=video 9 UDP/TLS/RTP/SAVPF 96\r\n"
+                                                     "a=rtpmap:96 VP8/90000\r\n"
+                                                     "a=rid:h recv\r\n"
+                                                     "a=rid:m recv\r\n"
+                                                     "a=rid:l recv\r\n"
+                                                     "a=simulcast:recv h;m;~l\r\n");
+
+    EXPECT_EQ(0u, capacity.maxBitrateKbps);
+    EXPECT_EQ(0u, capacity.maxFrameSize);
+    EXPECT_EQ(2, SelectSimulcastLayer(DefaultLayers(), capacity, 2000, -1));
+    EXPECT_EQ(1, SelectSimulcastLayer(DefaultLayers(), capacity, 300, -1));
+}
+
+TEST(PHSimulcastTest, ReadCapacityVariants)
+{
+    // No hints at all.
+
+    SimulcastReceiveCapacity capacity = ReadCapacity(test::ReadDataFile("Sdp/chrome45_offer.sdp"));
+    EXPECT_EQ(0u, capacity.maxBitrateKbps);
+    EXPECT_EQ(0u, capacity.maxFrameSize);
+
+    // TIAS when there's no AS, and H.264's max-mbps for the frame rate.
+
+    capacity = ReadCapacity("v=0\r\n"
+                            "m=video 9 RTP/SAVPF 126 97\r\n"
+                            "b=TIAS:300000\r\n"
+                            "a=rtpmap:126 H264/90000\r\n"
+                            "a=fmtp:126 profile-level-id=42e01f;max-fs=396;max-mbps=5940\r\n"
+                            "a=simulcast:send rid=x recv rid=l0;l1,~l2\r\n");
+
+    EXPECT_EQ(300u, capacity.maxBitrateKbps);
+    EXPECT_EQ(396u, capacity.maxFrameSize);
+    EXPECT_EQ(15u, capacity.maxFrameRate);
+
+    // Only the first active video section counts.
+
+    SdpSession session;
+    ASSERT_TRUE(session.Parse(test::ReadDataFile("Sdp/chrome45_answer_rejected_video.sdp")));
+    EXPECT_FALSE(ReadSimulcastReceiveCapacity(session, &capacity));
+}
+
+// We never offer to send simulcast, so conditioning leaves a=simulcast and a=rid alone, and adds neither.
+TEST(PHSimulcastTest, PolicyWritesNoSendLayers)
+{
+    SdpPolicy policy;
+    policy.video.maxBitrateKbps = 500;
+    policy.video.maxFrameSize = SdpFrameSizeInMacroblocks(640, 480);
+
+    for (const std::string &name : test::ListDataFiles("Sdp", ".sdp")) {
+        std::string sdp = test::ReadDataFile("Sdp/" + name);
+        SdpSession session;
+
+        ASSERT_TRUE(session.Parse(sdp));
+        ApplySdpPolicy(policy, &session);
+
+        std::string conditioned = session.Serialize();
+        size_t before = 0, after = 0;
+
+        for (size_t at = sdp.find("a=rid:"); at != std::string::npos; at = sdp.find("a=rid:", at + 1)) {
+            before++;
+        }
+        for (size_t at = conditioned.find("a=rid:"); at != std::string::npos; at = conditioned.find("a=rid:", at + 1)) {
+            after++;
+        }
+
+        EXPECT_EQ(before, after) << name;
+        EXPECT_EQ(std::string::npos, conditioned.find("a=simulcast:send")) << name;
+        EXPECT_EQ(std::string::npos, conditioned.find(" send max-width")) << name;
+    }
+}
+
+TEST(PHSimulcastTest, EncodeRate)
+{
+    SimulcastLayer layer;
+    layer.width = 640;
+    layer.height = 480;
+    layer.frameRate = 30;
+
+    EXPECT_EQ(36000u, SimulcastEncodeRate(layer));
+
+    layer.frameRate = 0;
+    EXPECT_EQ(0u, SimulcastEncodeRate(layer));
+}
+
+// Every peer has its own encoder. The largest layers give way first, the earliest on a tie, until the sum fits.
+TEST(PHSimulcastTest, FitEncodeBudget)
+{
+    std::vector<SimulcastLayer> layers = DefaultLayers();
+    const uint64_t top = SimulcastEncodeRate(layers[2]);
+
+    struct Case
+    {
+        uint64_t budget;
+        std::vector<int> selected;
+        std::vector<int> expected;
+    };
+
+    const Case cases[] = {
+        { 2 * top, { 2, 2 }, { 2, 2 } },
+        { 2 * top, { 2, 2, 2 }, { 1, 1, 2 } },
+        { 2 * top, { 2, 2, 2, 2 }, { 1, 1, 1, 2 } },
+        { 2 * top, { 2, -1, 2, -1 }, { 2, -1, 2, -1 } },
+        { top, { 2, 2, 2, 2, 2, 2, 2, 2 }, { 0, 0, 0, 0, 0, 0, 1, 1 } },
+        { 0, { 2, 1, 0 }, { 0, 0, 0 } },
+        { top, { 5 }, { 2 } },
+    };
+
+    for (const Case &test : cases) {
+        std::vector<int> selected = test.selected;
+        FitSimulcastEncodeBudget(layers, test.budget, &selected);
+
+        EXPECT_EQ(test.expected, selected) << test.selected.size() << " connections, budget " << test.budget;
+    }
+}
+
+// The plan only depends on the number of connections. Wherever a new one falls in the order, the others' layers stay
+// or step down, so only those need renegotiating.
+TEST(PHSimulcastTest, PlanEncodeBudgetAsTheMeshGrows)
+{
+    std::vector<SimulcastLayer> layers = DefaultLayers();
+    const uint64_t top = SimulcastEncodeRate(layers[2]);
+
+    EXPECT_TRUE(PlanSimulcastEncodeBudget(layers, 0, 2 * top).empty());
+    EXPECT_EQ(std::vector<int>({ 2, 2 }), PlanSimulcastEncodeBudget(layers, 2, 2 * top));
+    EXPECT_EQ(std::vector<int>({ 1, 1, 2 }), PlanSimulcastEncodeBudget(layers, 3, 2 * top));
+    EXPECT_EQ(std::vector<int>({ 1, 1, 1, 1, 1, 1 }), PlanSimulcastEncodeBudget(layers, 6, 2 * top));
+    EXPECT_EQ(std::vector<int>({ 0, 0, 1, 1, 1, 1, 1, 1, 1 }), PlanSimulcastEncodeBudget(layers, 9, 2 * top));
+
+    for (uint64_t budget : { top, 2 * top, 3 * top }) {
+        std::vector<int> before = PlanSimulcastEncodeBudget(layers, 1, budget);
+
+        for (size_t count = 2; count <= 8; count++) {
+            std::vector<int> after = PlanSimulcastEncodeBudget(layers, count, budget);
+            uint64_t total = 0;
+
+            for (int layer : after) {
+                total += SimulcastEncodeRate(layers[layer]);
+            }
+
+            EXPECT_TRUE(total <= budget || after.back() == 0) << count << " connections, budget " << budget;
+
+            for (size_t added = 0; added < count; added++) {
+                for (size_t i = 0; i < before.size(); i++) {
+                    EXPECT_LE(after[i < added ? i : i + 1], before[i]) << count << " connections, added at " << added;
+                }
+            }
+
+            before = after;
+        }
+    }
+}
+
+// A peer joins a room that both ends are in, and each re-plans its layer to the other at once. Only the initiator
+// offers. The receiver's layer is re-planned when it sets that offer, so it never takes over.
+TEST(PHSimulcastTest, BothEndsRePlanTogether)
+{
+    const int64_t signalingMs = 100;
+
+    SimulcastStepDown alice;
+    SimulcastStepDown bob;
+    std::vector<std::string> due;
+
+    EXPECT_TRUE(alice.OnOverBudget("bob", true, 0));
+    EXPECT_FALSE(bob.OnOverBudget("alice", false, 0));
+    EXPECT_EQ(SimulcastStepDown::kNoTime, alice.NextDueMs());
+    EXPECT_EQ(6000, bob.NextDueMs());
+
+    // Bob is stable until the offer arrives. Checking again doesn't offer, or put off taking over.
+
+    EXPECT_FALSE(bob.OnOverBudget("alice", false, signalingMs / 2));
+    EXPECT_EQ(6000, bob.NextDueMs());
+
+    // Bob sets the offer, answers, and is back within his plan.
+
+    bob.OnFitted("alice");
+    alice.OnFitted("bob");
+
+    EXPECT_EQ(SimulcastStepDown::kNoTime, bob.NextDueMs());
+
+    alice.Poll(10000, &due);
+    bob.Poll(10000, &due);
+    EXPECT_TRUE(due.empty());
+}
+
+// The initiator's plan may have room for its layer while the receiver's doesn't, so no offer comes. The receiver
+// offers once its wait is over, even if it was negotiating something else when it was polled.
+TEST(PHSimulcastTest, ReceiverTakesOverStepDown)
+{
+    SimulcastStepDown bob(3000);
+    std::vector<std::string> due;
+
+    EXPECT_FALSE(bob.OnOverBudget("alice", false, 0));
+    EXPECT_FALSE(bob.OnOverBudget("carol", false, 1000));
+    EXPECT_EQ(3000, bob.NextDueMs());
+
+    bob.Poll(2999, &due);
+    EXPECT_TRUE(due.empty());
+
+    bob.Poll(3000, &due);
+    EXPECT_EQ(std::vector<std::string>({ "alice" }), due);
+    EXPECT_EQ(4000, bob.NextDueMs());
+
+    EXPECT_TRUE(bob.OnOverBudget("alice", false, 3500));
+    EXPECT_TRUE(bob.OnOverBudget("carol", false, 4000));
+    EXPECT_EQ(SimulcastStepDown::kNoTime, bob.NextDueMs());
+
+    // A connection closed while waiting is forgotten.
+
+    EXPECT_FALSE(bob.OnOverBudget("dave", false, 5000));
+    bob.Remove("dave");
+    EXPECT_EQ(SimulcastStepDown::kNoTime, bob.NextDueMs());
+}
@@ -0,0 +1,159 @@
+//
+//  PHIceServerCacheTests.m
+//  PerchRTCTests
+//
+//  Created by Christopher Eagleston on 2015-08-11.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "PHIceServerCache.h"
+#import "RTCICEServer.h"
+
+@interface PHIceServerCacheTests : XCTestCase
+
+// The stub fetch's requests, as completions which haven't been called.
+@property (nonatomic, strong) NSMutableArray *requests;
+@property (nonatomic, strong) PHIceServerCache *cache;
+
+@end
+
+@implementation PHIceServerCacheTests
+
+- (void)setUp
+{
+    [super setUp];
+
+    self.requests = [NSMutableArray array];
+
+    __weak PHIceServerCacheTests *weakSelf = self;
+
+    self.cache = [[PHIceServerCache alloc] initWithFetch:^NSURLSessionDataTask *(PHIceServersCompletion completion) {
+        [weakSelf.requests addObject:[completion copy]];
+
+        // Never resumed, only there to be cancelled.
+        return [[NSURLSession sharedSession] dataTaskWithURL:[NSURL URLWithString:@"http://127.0.0.1/ice"]];
+    }];
+}
+
+- (void)tearDown
+{
+    [self.cache invalidate];
+
+    [super tearDown];
+}
+
+- (NSArray *)serversWithUsername:(NSString *)username
+{
+    return @[[[RTCICEServer alloc] initWithURI:[NSURL URLWithString:@"turn:turn.example.com:3478"] username:username password:@"secret"]];
+}
+
+- (void)completeRequest:(NSUInteger)index withServers:(NSArray *)servers error:(NSError *)error
+{
+    PHIceServersCompletion completion = self.requests[index];
+    completion(servers, error);
+}
+
+// Peers which join while the credentials are in flight wait for the same request.
+- (void)testConcurrentRequestsShareOneFetch
+{
+    NSArray *servers = [self serversWithUsername:@"user"];
+    XCTestExpectation *first = [self expectationWithDescription:@"first"];
+    XCTestExpectation *second = [self expectationWithDescription:@"second"];
+
+    [self.cache fetchIceServers:^(NSArray *iceServers, NSError *error) {
+        XCTAssertEqualObjects(servers, iceServers);
+        [first fulfill];
+    }];
+    [self.cache fetchIceServers:^(NSArray *iceServers, NSError *error) {
+        XCTAssertEqualObjects(servers, iceServers);
+        [second fulfill];
+    }];
+
+    XCTAssertEqual(1u, [self.requests count]);
+    XCTAssertTrue(self.cache.isFetching);
+
+    [self completeRequest:0 withServers:servers error:nil];
+    [self waitForExpectationsWithTimeout:1 handler:nil];
+
+    XCTAssertFalse(self.cache.isFetching);
+    XCTAssertEqualObjects(servers, self.cache.iceServers);
+
+    // Later peers are answered at once, from the cache.
+
+    __block NSArray *cached = nil;
+    [self.cache fetchIceServers:^(NSArray *iceServers, NSError *error) {
+        cached = iceServers;
+    }];
+
+    XCTAssertEqualObjects(servers, cached);
+    XCTAssertEqual(1u, [self.requests count]);
+}
+
+// TURN REST usernames say when they expire. Nearing expiry starts a refresh, but the credentials are still used.
+- (void)testRefreshesAheadOfExpiry
+{
+    NSTimeInterval expiry = [[NSDate date] timeIntervalSince1970] + 10;
+    NSArray *servers = [self serversWithUsername:[NSString stringWithFormat:@"%.0f:user", expiry]];
+    XCTestExpectation *fetched = [self expectationWithDescription:@"fetched"];
+
+    // Any time left counts as nearing expiry.
+
+    self.cache.refreshFraction = 1;
+
+    [self.cache fetchIceServers:^(NSArray *iceServers, NSError *error) {
+        [fetched fulfill];
+    }];
+    [self completeRequest:0 withServers:servers error:nil];
+    [self waitForExpectationsWithTimeout:1 handler:nil];
+
+    __block NSArray *cached = nil;
+    [self.cache fetchIceServers:^(NSArray *iceServers, NSError *error) {
+        cached = iceServers;
+    }];
+
+    XCTAssertEqualObjects(servers, cached);
+    XCTAssertEqual(2u, [self.requests count]);
+    XCTAssertTrue(self.cache.isFetching);
+}
+
+- (void)testFailedFetchReportsTheError
+{
+    NSError *failure = [NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorTimedOut userInfo:nil];
+    XCTestExpectation *failed = [self expectationWithDescription:@"failed"];
+
+    [self.cache fetchIceServers:^(NSArray *iceServers, NSError *error) {
+        XCTAssertNil(iceServers);
+        XCTAssertEqualObjects(failure, error);
+        [failed fulfill];
+    }];
+
+    [self completeRequest:0 withServers:nil error:failure];
+    [self waitForExpectationsWithTimeout:1 handler:nil];
+
+    XCTAssertNil(self.cache.iceServers);
+    XCTAssertFalse(self.cache.isFetching);
+}
+
+// A fetch started before an invalidate doesn't fill the cache, or call anyone back.
+- (void)testInvalidateDropsFetchesInFlight
+{
+    [self.cache fetchIceServers:^(NSArray *iceServers, NSError *error) {
+        XCTFail(@"Waiting completions are not called after an invalidate.");
+    }];
+
+    [self.cache invalidate];
+    [self completeRequest:0 withServers:[self serversWithUsername:@"user"] error:nil];
+
+    XCTestExpectation *drained = [self expectationWithDescription:@"drained"];
+    dispatch_async(dispatch_get_main_queue(), ^{
+        [drained fulfill];
+    });
+    [self waitForExpectationsWithTimeout:1 handler:nil];
+
+    XCTAssertNil(self.cache.iceServers);
+    XCTAssertFalse(self.cache.isFetching);
+}
+
+@end
@@ -0,0 +1,86 @@
+//
+//  PHPixelBufferPoolTests.mm
+//  PerchRTCTests
+//
+//  Created by Christopher Eagleston on 2015-08-11.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "PHPixelBufferAllocator.h"
+
+@interface PHPixelBufferPoolTests : XCTestCase
+
+@end
+
+@implementation PHPixelBufferPoolTests
+
+- (void)tearDown
+{
+    perch::SharedPixelBufferPool().Trim();
+
+    [super tearDown];
+}
+
+- (void)testLeasedBufferReturnsWhenReleased
+{
+    perch::FramePool &pool = perch::SharedPixelBufferPool();
+    perch::FrameKey key(352, 288, perch::kFrameFormatNV12);
+
+    uint64_t outstanding = pool.Stats().outstanding;
+    perch::FrameBuffer *buffer = pool.Acquire(key);
+    XCTAssertTrue(buffer != NULL);
+
+    CVPixelBufferRef leased = perch::CreateLeasedPixelBuffer(buffer);
+    XCTAssertTrue(leased != NULL);
+    XCTAssertTrue(CVPixelBufferGetIOSurface(leased) == CVPixelBufferGetIOSurface(perch::PixelBufferForFrame(buffer)));
+    XCTAssertEqual(outstanding + 1, pool.Stats().outstanding);
+
+    CVPixelBufferRelease(leased);
+
+    XCTAssertEqual(outstanding, pool.Stats().outstanding);
+    XCTAssertTrue(pool.Acquire(key) == buffer);
+
+    pool.Release(buffer);
+}
+
+// A consumer which outlives the sample buffer, such as a display layer, keeps the buffer in flight.
+- (void)testRetainedLeaseIsNotReused
+{
+    perch::FramePool &pool = perch::SharedPixelBufferPool();
+    perch::FrameKey key(640, 480, perch::kFrameFormatBGRA);
+
+    perch::FrameBuffer *buffer = pool.Acquire(key);
+    CVPixelBufferRef leased = perch::CreateLeasedPixelBuffer(buffer);
+    CVPixelBufferRef consumer = CVPixelBufferRetain(leased);
+
+    CVPixelBufferRelease(leased);
+
+    perch::FrameBuffer *next = pool.Acquire(key);
+    XCTAssertTrue(next != buffer);
+
+    CVPixelBufferRelease(consumer);
+
+    pool.Release(next);
+}
+
+- (void)testResolutionFlipsReuseBuffers
+{
+    perch::FramePool &pool = perch::SharedPixelBufferPool();
+    perch::FrameKey keys[] = { perch::FrameKey(352, 288, perch::kFrameFormatNV12), perch::FrameKey(640, 480, perch::kFrameFormatNV12) };
+
+    for (int round = 0; round < 2; round++) {
+        CVPixelBufferRelease(perch::CreateLeasedPixelBuffer(pool.Acquire(keys[round])));
+    }
+
+    uint64_t allocations = pool.Stats().allocations;
+
+    for (int round = 0; round < 20; round++) {
+        CVPixelBufferRelease(perch::CreateLeasedPixelBuffer(pool.Acquire(keys[round % 2])));
+    }
+
+    XCTAssertEqual(allocations, pool.Stats().allocations);
+}
+
+@end
@@ -0,0 +1,58 @@
+//
+//  PHSessionDescriptionFactoryTests.m
+//  PerchRTCTests
+//
+//  Created by Christopher Eagleston on 2015-08-11.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "PHMediaConfiguration.h"
+#import "PHSessionDescriptionFactory.h"
+
+@interface PHSessionDescriptionFactoryTests : XCTestCase
+
+@end
+
+@implementation PHSessionDescriptionFactoryTests
+
+// The default configuration sends 160x120, 320x240 and 640x480, and the media session budgets for two 640x480 encoders.
+- (void)testPlannedLayersFitAsTheRoomGrows
+{
+    PHMediaConfiguration *configuration = [PHMediaConfiguration defaultConfiguration];
+    NSUInteger macroblocks[] = { 80, 300, 1200 };
+    NSArray *previous = @[];
+
+    for (NSUInteger count = 1; count <= 5; count++) {
+        NSArray *layers = [PHSessionDescriptionFactory maxLayersForConfiguration:configuration connectionCount:count encodeBudget:2];
+        NSUInteger load = 0;
+
+        XCTAssertEqual([layers count], count);
+
+        for (NSUInteger i = 0; i < [layers count]; i++) {
+            NSInteger layer = [layers[i] integerValue];
+            load += macroblocks[layer];
+
+            if (i < [previous count]) {
+                XCTAssertLessThanOrEqual(layer, [previous[i] integerValue], @"connection %lu went up with %lu", (unsigned long)i, (unsigned long)count);
+            }
+        }
+
+        XCTAssertLessThanOrEqual(load, 2 * macroblocks[2], @"%lu connections are over budget", (unsigned long)count);
+
+        previous = layers;
+    }
+
+    XCTAssertEqualObjects([PHSessionDescriptionFactory maxLayersForConfiguration:configuration connectionCount:2 encodeBudget:2], (@[@2, @2]));
+    XCTAssertEqualObjects([PHSessionDescriptionFactory maxLayersForConfiguration:configuration connectionCount:3 encodeBudget:2], (@[@1, @1, @2]));
+}
+
+- (void)testNoConnectionsPlansNothing
+{
+    PHMediaConfiguration *configuration = [PHMediaConfiguration defaultConfiguration];
+
+    XCTAssertEqual([[PHSessionDescriptionFactory maxLayersForConfiguration:configuration connectionCount:0 encodeBudget:2] count], 0u);
+}
+
+@end
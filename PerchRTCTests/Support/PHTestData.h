@@ -0,0 +1,83 @@
+//
+//  PHTestData.h
+//  PerchRTCTests
+//
+//  Created by Christopher Eagleston on 2015-08-11.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#ifndef PerchRTCTests_PHTestData_h
+#define PerchRTCTests_PHTestData_h
+
+#include <algorithm>
+#include <dirent.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace perch {
+namespace test {
+
+    // Files under PerchRTCTests/Data, such as recorded traces and corpora.
+    inline std::string DataPath(const std::string &relativePath)
+    {
+        return std::string(PERCH_TEST_DATA_DIR) + "/" + relativePath;
+    }
+
+    inline std::string ReadDataFile(const std::string &relativePath)
+    {
+        std::ifstream file(DataPath(relativePath), std::ios::binary);
+        std::stringstream contents;
+        contents << file.rdbuf();
+
+        return contents.str();
+    }
+
+    // The lines of a trace, without blank lines or '#' comments.
+    inline std::vector<std::string> ReadTraceLines(const std::string &relativePath)
+    {
+        std::ifstream file(DataPath(relativePath));
+        std::vector<std::string> lines;
+        std::string line;
+
+        while (std::getline(file, line)) {
+            if (!line.empty() && line[line.size() - 1] == '\r') {
+                line.erase(line.size() - 1);
+            }
+            if (!line.empty() && line[0] != '#') {
+                lines.push_back(line);
+            }
+        }
+
+        return lines;
+    }
+
+    // The names of the files in a directory under PerchRTCTests/Data which end with `extension`, sorted.
+    inline std::vector<std::string> ListDataFiles(const std::string &relativePath, const std::string &extension)
+    {
+        std::vector<std::string> names;
+        DIR *directory = opendir(DataPath(relativePath).c_str());
+
+        if (!directory) {
+            return names;
+        }
+
+        while (struct dirent *entry = readdir(directory)) {
+            std::string name(entry->d_name);
+
+            if (name.size() > extension.size() && name.compare(name.size() - extension.size(), extension.size(), extension) == 0) {
+                names.push_back(name);
+            }
+        }
+
+        closedir(directory);
+        std::sort(names.begin(), names.end());
+
+        return names;
+    }
+
+} // namespace test
+} // namespace perch
+
+#endif
@@ -0,0 +1,422 @@
+//
+//  PHWebSocketEcho.h
+//  PerchRTCTests
+//
+//  Created by Christopher Eagleston on 2015-08-11.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#ifndef PerchRTCTests_PHWebSocketEcho_h
+#define PerchRTCTests_PHWebSocketEcho_h
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdint.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+namespace perch {
+namespace test {
+
+    // Just enough RFC 6455 for a loopback echo: text frames up to 64 KB and close. Sockets are blocking, with a
+    // timeout on reads so that a broken test fails instead of hanging.
+
+    inline std::string Sha1(const std::string &input)
+    {
+        uint32_t h[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+        std::string message = input;
+        uint64_t bits = (uint64_t)input.size() * 8;
+
+        message += (char)0x80;
+        while (message.size() % 64 != 56) {
+            message += (char)0;
+        }
+        for (int i = 7; i >= 0; i--) {
+            message += (char)(bits >> (i * 8));
+        }
+
+        for (size_t chunk = 0; chunk < message.size(); chunk += 64) {
+            uint32_t w[80];
+
+            for (int i = 0; i < 16; i++) {
+                const uint8_t *p = (const uint8_t *)&message[chunk + i * 4];
+                w[i] = (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+            }
+            for (int i = 16; i < 80; i++) {
+                uint32_t x = w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16];
+                w[i] = x << 1 | x >> 31;
+            }
+
+            uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+
+            for (int i = 0; i < 80; i++) {
+                uint32_t f, k;
+
+                if (i < 20) { f = (b & c) | (~b & d); k = 0x5A827999; }
+                else if (i < 40) { f = b ^ c ^ d; k = 0x6ED9EBA1; }
+                else if (i < 60) { f = (b & c) | (b & d) | (c & d); k = 0x8F1BBCDC; }
+                else { f = b ^ c ^ d; k = 0xCA62C1D6; }
+
+                uint32_t t = (a << 5 | a >> 27) + f + e + k + w[i];
+                e = d;
+                d = c;
+                c = b << 30 | b >> 2;
+                b = a;
+                a = t;
+            }
+
+            h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+        }
+
+        std::string digest;
+
+        for (int i = 0; i < 20; i++) {
+            digest += (char)(h[i / 4] >> (24 - (i % 4) * 8));
+        }
+
+        return digest;
+    }
+
+    inline std::string Base64(const std::string &input)
+    {
+        static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        std::string output;
+
+        for (size_t i = 0; i < input.size(); i += 3) {
+            uint32_t n = (uint32_t)(uint8_t)input[i] << 16;
+            n |= i + 1 < input.size() ? (uint32_t)(uint8_t)input[i + 1] << 8 : 0;
+            n |= i + 2 < input.size() ? (uint32_t)(uint8_t)input[i + 2] : 0;
+
+            output += alphabet[n >> 18 & 63];
+            output += alphabet[n >> 12 & 63];
+            output += i + 1 < input.size() ? alphabet[n >> 6 & 63] : '=';
+            output += i + 2 < input.size() ? alphabet[n & 63] : '=';
+        }
+
+        return output;
+    }
+
+    inline std::string WebSocketAccept(const std::string &key)
+    {
+        return Base64(Sha1(key + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"));
+    }
+
+    class WebSocketStream
+    {
+    public:
+        explicit WebSocketStream(int fd = -1) : _fd(fd) {}
+        ~WebSocketStream() { Close(); }
+
+        void Attach(int fd) { Close(); _fd = fd; }
+
+        void Close()
+        {
+            if (_fd >= 0) {
+                close(_fd);
+                _fd = -1;
+            }
+        }
+
+        bool IsOpen() const { return _fd >= 0; }
+
+        bool Write(const std::string &bytes)
+        {
+            size_t written = 0;
+
+            while (written < bytes.size()) {
+                ssize_t n = send(_fd, bytes.data() + written, bytes.size() - written, MSG_NOSIGNAL);
+
+                if (n <= 0) {
+                    return false;
+                }
+
+                written += (size_t)n;
+            }
+
+            return true;
+        }
+
+        bool Read(size_t size, std::string *bytes, int timeoutMs = 2000)
+        {
+            bytes->clear();
+
+            while (bytes->size() < size) {
+                struct pollfd readable = { _fd, POLLIN, 0 };
+
+                if (poll(&readable, 1, timeoutMs) <= 0) {
+                    return false;
+                }
+
+                char buffer[4096];
+                ssize_t n = recv(_fd, buffer, std::min(sizeof(buffer), size - bytes->size()), 0);
+
+                if (n <= 0) {
+                    return false;
+                }
+
+                bytes->append(buffer, (size_t)n);
+            }
+
+            return true;
+        }
+
+        // Up to and including the blank line which ends an HTTP header.
+        bool ReadHeader(std::string *header)
+        {
+            header->clear();
+
+            while (header->size() < 8192 && header->find("\r\n\r\n") == std::string::npos) {
+                std::string byte;
+
+                if (!Read(1, &byte)) {
+                    return false;
+                }
+
+                *header += byte;
+            }
+
+            return header->find("\r\n\r\n") != std::string::npos;
+        }
+
+        // Clients mask what they send, servers don't.
+        bool WriteFrame(uint8_t opcode, const std::string &payload, bool masked)
+        {
+            std::string frame;
+            frame += (char)(0x80 | opcode);
+
+            uint8_t maskBit = masked ? 0x80 : 0;
+
+            if (payload.size() < 126) {
+                frame += (char)(maskBit | payload.size());
+            }
+            else {
+                frame += (char)(maskBit | 126);
+                frame += (char)(payload.size() >> 8);
+                frame += (char)(payload.size() & 0xFF);
+            }
+
+            if (!masked) {
+                return Write(frame + payload);
+            }
+
+            const uint8_t mask[4] = { 0x37, 0xFA, 0x21, 0x3D };
+
+            frame.append((const char *)mask, 4);
+
+            for (size_t i = 0; i < payload.size(); i++) {
+                frame += (char)(payload[i] ^ mask[i % 4]);
+            }
+
+            return Write(frame);
+        }
+
+        bool ReadFrame(uint8_t *opcode, std::string *payload, int timeoutMs = 2000)
+        {
+            std::string head;
+
+            if (!Read(2, &head, timeoutMs)) {
+                return false;
+            }
+
+            *opcode = (uint8_t)head[0] & 0x0F;
+            bool masked = ((uint8_t)head[1] & 0x80) != 0;
+            size_t size = (uint8_t)head[1] & 0x7F;
+
+            if (size == 127) {
+                return false;
+            }
+
+            if (size == 126) {
+                std::string extended;
+
+                if (!Read(2, &extended)) {
+                    return false;
+                }
+
+                size = (size_t)(uint8_t)extended[0] << 8 | (uint8_t)extended[1];
+            }
+
+            std::string mask;
+
+            if (masked && !Read(4, &mask)) {
+                return false;
+            }
+            if (!Read(size, payload)) {
+                return false;
+            }
+
+            for (size_t i = 0; masked && i < payload->size(); i++) {
+                (*payload)[i] ^= mask[i % 4];
+            }
+
+            return true;
+        }
+
+    private:
+        WebSocketStream(const WebSocketStream &) = delete;
+        WebSocketStream &operator=(const WebSocketStream &) = delete;
+
+        int _fd;
+    };
+
+    // Accepts one client on a loopback port and echoes its text frames back until it closes.
+    class WebSocketEchoServer
+    {
+    public:
+        WebSocketEchoServer() : _listener(-1), _port(0)
+        {
+            _listener = socket(AF_INET, SOCK_STREAM, 0);
+
+            struct sockaddr_in address = {};
+            address.sin_family = AF_INET;
+            address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            socklen_t length = sizeof(address);
+
+            if (_listener < 0 || bind(_listener, (struct sockaddr *)&address, length) != 0 || listen(_listener, 1) != 0 ||
+                getsockname(_listener, (struct sockaddr *)&address, &length) != 0) {
+                return;
+            }
+
+            _port = ntohs(address.sin_port);
+            _thread = std::thread(&WebSocketEchoServer::Serve, this);
+        }
+
+        ~WebSocketEchoServer()
+        {
+            if (_listener >= 0) {
+                shutdown(_listener, SHUT_RDWR);
+                close(_listener);
+            }
+            if (_thread.joinable()) {
+                _thread.join();
+            }
+        }
+
+        // 0 if the server couldn't listen.
+        uint16_t Port() const { return _port; }
+
+    private:
+        WebSocketEchoServer(const WebSocketEchoServer &) = delete;
+        WebSocketEchoServer &operator=(const WebSocketEchoServer &) = delete;
+
+        void Serve()
+        {
+            WebSocketStream stream(accept(_listener, NULL, NULL));
+            std::string header;
+
+            if (!stream.IsOpen() || !stream.ReadHeader(&header)) {
+                return;
+            }
+
+            const std::string keyField = "Sec-WebSocket-Key: ";
+            size_t key = header.find(keyField);
+
+            if (key == std::string::npos) {
+                return;
+            }
+
+            key += keyField.size();
+
+            std::string response = "HTTP/1.1 101 Switching Protocols\r\n"
+                                   "Upgrade: websocket\r\n"
+                                   "Connection: Upgrade\r\n"
+                                   "Sec-WebSocket-Accept: " + WebSocketAccept(header.substr(key, header.find("\r\n", key) - key)) + "\r\n\r\n";
+
+            if (!stream.Write(response)) {
+                return;
+            }
+
+            uint8_t opcode;
+            std::string payload;
+
+            while (stream.ReadFrame(&opcode, &payload, 10000)) {
+                if (opcode == 0x8) {
+                    stream.WriteFrame(0x8, std::string(), false);
+                    return;
+                }
+
+                stream.WriteFrame(opcode, payload, false);
+            }
+        }
+
+        int _listener;
+        uint16_t _port;
+        std::thread _thread;
+    };
+
+    class WebSocketClient
+    {
+    public:
+        WebSocketClient() {}
+
+        bool Connect(uint16_t port)
+        {
+            int fd = socket(AF_INET, SOCK_STREAM, 0);
+            int noDelay = 1;
+
+            struct sockaddr_in address = {};
+            address.sin_family = AF_INET;
+            address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            address.sin_port = htons(port);
+
+            if (fd < 0 || connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+                if (fd >= 0) {
+                    close(fd);
+                }
+                return false;
+            }
+
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+            _stream.Attach(fd);
+
+            const std::string key = "dGhlIHNhbXBsZSBub25jZQ==";
+            std::string header;
+
+            return _stream.Write("GET /ws HTTP/1.1\r\n"
+                                 "Host: 127.0.0.1\r\n"
+                                 "Upgrade: websocket\r\n"
+                                 "Connection: Upgrade\r\n"
+                                 "Sec-WebSocket-Key: " + key + "\r\n"
+                                 "Sec-WebSocket-Version: 13\r\n\r\n") &&
+                   _stream.ReadHeader(&header) && header.compare(0, 12, "HTTP/1.1 101") == 0 &&
+                   header.find("Sec-WebSocket-Accept: " + WebSocketAccept(key) + "\r\n") != std::string::npos;
+        }
+
+        bool Send(const std::string &text) { return _stream.WriteFrame(0x1, text, true); }
+
+        // The next text frame, or false if none comes in time.
+        bool Receive(std::string *text)
+        {
+            uint8_t opcode;
+
+            return _stream.ReadFrame(&opcode, text) && opcode == 0x1;
+        }
+
+        void Close()
+        {
+            uint8_t opcode;
+            std::string payload;
+
+            if (_stream.IsOpen() && _stream.WriteFrame(0x8, std::string(), true)) {
+                _stream.ReadFrame(&opcode, &payload);
+            }
+
+            _stream.Close();
+        }
+
+    private:
+        WebSocketClient(const WebSocketClient &) = delete;
+        WebSocketClient &operator=(const WebSocketClient &) = delete;
+
+        WebSocketStream _stream;
+    };
+
+} // namespace test
+} // namespace perch
+
+#endif
@@ -0,0 +1,107 @@
+//
+//  XSPeerClientTests.mm
+//  PerchRTCTests
+//
+//  Created by Christopher Eagleston on 2015-08-11.
+//  Copyright (c) 2015 Perch Communications. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "XSMessage.h"
+#import "XSPeerClient.h"
+
+@interface XSPeerClient (Testing)
+
+- (XSMessage *)decodeMessage:(const char *)bytes length:(NSUInteger)length;
+
+@end
+
+@interface XSPeerClientTests : XCTestCase
+
+@property (nonatomic, strong) XSPeerClient *client;
+
+@end
+
+@implementation XSPeerClientTests
+
+- (void)setUp
+{
+    [super setUp];
+
+    self.client = [[XSPeerClient alloc] initWithRoom:nil andDelegate:nil];
+}
+
+- (XSMessage *)decode:(NSString *)frame
+{
+    const char *bytes = [frame UTF8String];
+    return [self.client decodeMessage:bytes length:strlen(bytes)];
+}
+
+- (void)testDecodesKnownEventsIntoTypedFields
+{
+    XSMessage *message = [self decode:@"{\"type\":\"offer\",\"userid\":\"alice\",\"message\":{\"data\":{\"connectionId\":\"c1\","
+                                       "\"offer\":{\"sdp\":\"v=0\\r\\n\",\"type\":\"offer\"}}}}"];
+
+    XCTAssertEqual(XSMessageEventOffer, message.event);
+    XCTAssertEqualObjects(@"alice", message.senderId);
+    XCTAssertEqualObjects(@"c1", message.connectionId);
+    XCTAssertEqualObjects(@"v=0\r\n", message.sessionDescription);
+}
+
+// Events the codec doesn't know keep their whole payload, as NSJSONSerialization reads it.
+- (void)testUnknownEventsKeepTheirData
+{
+    XSMessage *message = [self decode:@"{\"type\":\"room_locked\",\"userid\":\"server\",\"message\":{\"locked\":true,\"by\":[\"alice\"]}}"];
+
+    XCTAssertNotNil(message);
+    XCTAssertEqual(XSMessageEventUnknown, message.event);
+    XCTAssertEqualObjects(@"room_locked", message.type);
+    XCTAssertEqualObjects(@"server", message.senderId);
+    XCTAssertEqualObjects(@YES, message.data[@"locked"]);
+    XCTAssertEqualObjects(@[@"alice"], message.data[@"by"]);
+}
+
+- (void)testRejectsMalformedFrames
+{
+    XCTAssertNil([self decode:@"{\"type\":\"offer\""]);
+    XCTAssertNil([self decode:@"[\"offer\"]"]);
+
+    const char invalid[] = "{\"type\":\"peers\",\"room\":\"caf\xE9\"}";
+    XCTAssertNil([self.client decodeMessage:invalid length:sizeof(invalid) - 1]);
+}
+
+// A peer's features come with its offer or answer, whichever decoder read them.
+- (void)testDecodesFeatures
+{
+    NSString *frame = @"{\"type\":\"answer\",\"userid\":\"bob\",\"message\":{\"data\":{\"connectionId\":\"c1\","
+                       "\"answer\":{\"sdp\":\"v=0\",\"type\":\"answer\"},\"features\":[\"rtx\",\"iceCandidates\"]}}}";
+
+    XCTAssertEqual(XSMessageFeatureICECandidates, [self decode:frame].features);
+
+    XSMessage *answer = [XSMessage answerWithUserId:@"bob" connectionId:@"c1" andData:@{@"sdp" : @"v=0", @"type" : @"answer"}];
+    XCTAssertEqual(XSMessageSupportedFeatures, answer.features);
+}
+
+// Only a peer which advertised batches gets one. Any other gets a message per candidate.
+- (void)testCandidateMessagesFollowThePeersFeatures
+{
+    NSArray *candidates = @[@{@"candidate" : @"candidate:1 1 udp 2122260223 10.0.0.1 9 typ host", @"id" : @"audio", @"label" : @0},
+                            @{@"candidate" : @"candidate:2 1 udp 2122260223 10.0.0.1 10 typ host", @"id" : @"audio", @"label" : @0}];
+
+    NSArray *messages = [XSMessage iceCandidatesWithUserId:@"bob" connectionId:@"c1" andData:candidates
+                                              peerFeatures:XSMessageFeatureICECandidates];
+    XCTAssertEqual(1u, [messages count]);
+    XCTAssertEqualObjects(candidates, [messages[0] iceCandidates]);
+
+    messages = [XSMessage iceCandidatesWithUserId:@"bob" connectionId:@"c1" andData:candidates peerFeatures:0];
+    XCTAssertEqual(2u, [messages count]);
+
+    for (NSUInteger i = 0; i < [messages count]; i++) {
+        XSMessage *message = messages[i];
+        XCTAssertEqualObjects(candidates[i], message.data[kXSMessageICECandidateDataKey]);
+        XCTAssertNil(message.data[kXSMessageICECandidatesDataKey]);
+    }
+}
+
+@end